@@ -0,0 +1,66 @@
+#include <android/log.h>
+#include <atomic>
+#include <cstdio>
+#include <cstdlib>
+#include <mutex>
+
+// Host implementation of the <android/log.h> subset declared in host/include
+
+static std::atomic<int32_t> minimum_priority{-1};
+static std::mutex log_mutex;
+
+static int32_t current_minimum_priority() {
+    int32_t priority = minimum_priority.load(std::memory_order_relaxed);
+    if (priority < 0) {
+        const char* env = getenv("SPDFCORE_LOG_LEVEL");
+        priority = env ? atoi(env) : ANDROID_LOG_VERBOSE;
+        minimum_priority.store(priority, std::memory_order_relaxed);
+    }
+    return priority;
+}
+
+static char priority_letter(int prio) {
+    switch (prio) {
+        case ANDROID_LOG_VERBOSE: return 'V';
+        case ANDROID_LOG_DEBUG: return 'D';
+        case ANDROID_LOG_INFO: return 'I';
+        case ANDROID_LOG_WARN: return 'W';
+        case ANDROID_LOG_ERROR: return 'E';
+        case ANDROID_LOG_FATAL: return 'F';
+        default: return '?';
+    }
+}
+
+extern "C" int __android_log_write(int prio, const char* tag, const char* text) {
+    if (prio < current_minimum_priority()) {
+        return 0;
+    }
+    std::lock_guard<std::mutex> lock(log_mutex);
+    return fprintf(stderr, "%c/%s: %s\n", priority_letter(prio), tag ? tag : "", text ? text : "");
+}
+
+extern "C" int __android_log_vprint(int prio, const char* tag, const char* fmt, va_list ap) {
+    if (prio < current_minimum_priority()) {
+        return 0;
+    }
+    char buffer[1024];
+    vsnprintf(buffer, sizeof(buffer), fmt, ap);
+    return __android_log_write(prio, tag, buffer);
+}
+
+extern "C" int __android_log_print(int prio, const char* tag, const char* fmt, ...) {
+    if (prio < current_minimum_priority()) {
+        return 0;
+    }
+    va_list ap;
+    va_start(ap, fmt);
+    int written = __android_log_vprint(prio, tag, fmt, ap);
+    va_end(ap);
+    return written;
+}
+
+extern "C" int32_t __android_log_set_minimum_priority(int32_t priority) {
+    int32_t previous = current_minimum_priority();
+    minimum_priority.store(priority, std::memory_order_relaxed);
+    return previous;
+}
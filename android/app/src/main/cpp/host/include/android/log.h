@@ -0,0 +1,45 @@
+#ifndef SPDFCORE_HOST_ANDROID_LOG_H
+#define SPDFCORE_HOST_ANDROID_LOG_H
+
+/* Host stand-in for the NDK <android/log.h>
+ *
+ * Only the subset used by the native layer is declared. Messages go to stderr
+ * and can be filtered with __android_log_set_minimum_priority or the
+ * SPDFCORE_LOG_LEVEL environment variable (numeric android_LogPriority).
+ */
+
+#include <stdarg.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef enum android_LogPriority {
+    ANDROID_LOG_UNKNOWN = 0,
+    ANDROID_LOG_DEFAULT,
+    ANDROID_LOG_VERBOSE,
+    ANDROID_LOG_DEBUG,
+    ANDROID_LOG_INFO,
+    ANDROID_LOG_WARN,
+    ANDROID_LOG_ERROR,
+    ANDROID_LOG_FATAL,
+    ANDROID_LOG_SILENT,
+} android_LogPriority;
+
+int __android_log_write(int prio, const char *tag, const char *text);
+int __android_log_print(int prio, const char *tag, const char *fmt, ...)
+    __attribute__((__format__(printf, 3, 4)));
+int __android_log_vprint(int prio, const char *tag, const char *fmt, va_list ap);
+
+/**
+ * Drop messages below the given priority
+ * Returns: the previous minimum priority
+ */
+int32_t __android_log_set_minimum_priority(int32_t priority);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* SPDFCORE_HOST_ANDROID_LOG_H */
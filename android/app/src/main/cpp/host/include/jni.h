@@ -0,0 +1,125 @@
+#ifndef SPDFCORE_HOST_JNI_H
+#define SPDFCORE_HOST_JNI_H
+
+/* JVM-free stand-in for <jni.h> used by the host build
+ *
+ * Source compatible with the subset of the JNI API used by spdfcore_jni.cpp.
+ * The function table is filled in by the host harness, so entry points can be
+ * driven without a Java VM. Not ABI compatible with a real JDK.
+ */
+
+#include <stdarg.h>
+#include <stdint.h>
+
+typedef uint8_t jboolean;
+typedef int8_t jbyte;
+typedef uint16_t jchar;
+typedef int16_t jshort;
+typedef int32_t jint;
+typedef int64_t jlong;
+typedef float jfloat;
+typedef double jdouble;
+typedef jint jsize;
+
+#ifdef __cplusplus
+class _jobject {};
+class _jclass : public _jobject {};
+class _jstring : public _jobject {};
+class _jarray : public _jobject {};
+class _jobjectArray : public _jarray {};
+class _jintArray : public _jarray {};
+
+typedef _jobject* jobject;
+typedef _jclass* jclass;
+typedef _jstring* jstring;
+typedef _jarray* jarray;
+typedef _jobjectArray* jobjectArray;
+typedef _jintArray* jintArray;
+#else
+typedef void* jobject;
+typedef jobject jclass;
+typedef jobject jstring;
+typedef jobject jarray;
+typedef jarray jobjectArray;
+typedef jarray jintArray;
+#endif
+
+#define JNI_FALSE 0
+#define JNI_TRUE 1
+
+#define JNI_OK 0
+#define JNI_ERR (-1)
+
+#define JNIEXPORT __attribute__((visibility("default")))
+#define JNICALL
+
+struct JNINativeInterface;
+struct _JNIEnv;
+
+#ifdef __cplusplus
+typedef _JNIEnv JNIEnv;
+#else
+typedef const struct JNINativeInterface* JNIEnv;
+#endif
+
+struct JNINativeInterface {
+    void* reserved0;
+
+    jsize (*GetArrayLength)(JNIEnv*, jarray);
+    jobject (*GetObjectArrayElement)(JNIEnv*, jobjectArray, jsize);
+    jobjectArray (*NewObjectArray)(JNIEnv*, jsize, jclass, jobject);
+    void (*SetObjectArrayElement)(JNIEnv*, jobjectArray, jsize, jobject);
+
+    jstring (*NewStringUTF)(JNIEnv*, const char*);
+    jsize (*GetStringUTFLength)(JNIEnv*, jstring);
+    const char* (*GetStringUTFChars)(JNIEnv*, jstring, jboolean*);
+    void (*ReleaseStringUTFChars)(JNIEnv*, jstring, const char*);
+
+    jintArray (*NewIntArray)(JNIEnv*, jsize);
+    void (*GetIntArrayRegion)(JNIEnv*, jintArray, jsize, jsize, jint*);
+    void (*SetIntArrayRegion)(JNIEnv*, jintArray, jsize, jsize, const jint*);
+
+    jclass (*FindClass)(JNIEnv*, const char*);
+    void (*DeleteLocalRef)(JNIEnv*, jobject);
+    jboolean (*ExceptionCheck)(JNIEnv*);
+};
+
+#ifdef __cplusplus
+struct _JNIEnv {
+    const struct JNINativeInterface* functions;
+
+    jsize GetArrayLength(jarray array) { return functions->GetArrayLength(this, array); }
+    jobject GetObjectArrayElement(jobjectArray array, jsize index) {
+        return functions->GetObjectArrayElement(this, array, index);
+    }
+    jobjectArray NewObjectArray(jsize length, jclass elementClass, jobject initialElement) {
+        return functions->NewObjectArray(this, length, elementClass, initialElement);
+    }
+    void SetObjectArrayElement(jobjectArray array, jsize index, jobject value) {
+        functions->SetObjectArrayElement(this, array, index, value);
+    }
+
+    jstring NewStringUTF(const char* bytes) { return functions->NewStringUTF(this, bytes); }
+    jsize GetStringUTFLength(jstring string) { return functions->GetStringUTFLength(this, string); }
+    const char* GetStringUTFChars(jstring string, jboolean* isCopy) {
+        return functions->GetStringUTFChars(this, string, isCopy);
+    }
+    void ReleaseStringUTFChars(jstring string, const char* utf) {
+        functions->ReleaseStringUTFChars(this, string, utf);
+    }
+
+    jintArray NewIntArray(jsize length) { return functions->NewIntArray(this, length); }
+    void GetIntArrayRegion(jintArray array, jsize start, jsize len, jint* buf) {
+        functions->GetIntArrayRegion(this, array, start, len, buf);
+    }
+    void SetIntArrayRegion(jintArray array, jsize start, jsize len, const jint* buf) {
+        functions->SetIntArrayRegion(this, array, start, len, buf);
+    }
+
+    jclass FindClass(const char* name) { return functions->FindClass(this, name); }
+    void DeleteLocalRef(jobject localRef) { functions->DeleteLocalRef(this, localRef); }
+    jboolean ExceptionCheck() { return functions->ExceptionCheck(this); }
+};
+#endif
+
+#endif /* SPDFCORE_HOST_JNI_H */
@@ -0,0 +1,196 @@
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <sys/stat.h>
+#include "../spdfcore.h"
+#include "pdf_fixture.h"
+
+// Host stand-in for libspdfcore_ffi.so
+//
+// Implements the spdfcore.h ABI with cheap, deterministic behaviour so the JNI
+// layer can be exercised and profiled without the Rust core. Page counts come
+// from a byte scan for page objects; every write produces a fixture PDF with
+// the page count the real operation would have produced.
+
+static bool fail(PdfErrorCode code, const std::string& message, PdfErrorCode* error_code, char** error_message) {
+    if (error_code) {
+        *error_code = code;
+    }
+    if (error_message) {
+        *error_message = strdup(message.c_str());
+    }
+    return false;
+}
+
+static bool succeed(PdfErrorCode* error_code, char** error_message) {
+    if (error_code) {
+        *error_code = PdfErrorCode_Success;
+    }
+    if (error_message) {
+        *error_message = nullptr;
+    }
+    return true;
+}
+
+static bool read_file(const char* path, std::string* data, PdfErrorCode* error_code, char** error_message) {
+    if (!path) {
+        return fail(PdfErrorCode_InvalidParameter, "null path", error_code, error_message);
+    }
+    FILE* file = fopen(path, "rb");
+    if (!file) {
+        return fail(errno == ENOENT ? PdfErrorCode_FileNotFound : PdfErrorCode_IoError,
+                    std::string("cannot open ") + path, error_code, error_message);
+    }
+    char buffer[65536];
+    size_t n;
+    while ((n = fread(buffer, 1, sizeof(buffer), file)) > 0) {
+        data->append(buffer, n);
+    }
+    fclose(file);
+    return true;
+}
+
+static int32_t count_pages(const std::string& data) {
+    int32_t pages = 0;
+    for (size_t pos = data.find("/Type"); pos != std::string::npos; pos = data.find("/Type", pos + 5)) {
+        size_t value = pos + 5;
+        while (value < data.size() && (data[value] == ' ' || data[value] == '\n' || data[value] == '\r')) {
+            value++;
+        }
+        if (data.compare(value, 5, "/Page") == 0 && (value + 5 >= data.size() || data[value + 5] != 's')) {
+            pages++;
+        }
+    }
+    return pages;
+}
+
+static bool load_pdf(const char* path, int32_t* pages, PdfErrorCode* error_code, char** error_message) {
+    std::string data;
+    if (!read_file(path, &data, error_code, error_message)) {
+        return false;
+    }
+    if (data.compare(0, 5, "%PDF-") != 0) {
+        return fail(PdfErrorCode_InvalidPdf, "missing %PDF- header", error_code, error_message);
+    }
+    if (data.find("%%EOF", data.size() > 1024 ? data.size() - 1024 : 0) == std::string::npos) {
+        return fail(PdfErrorCode_ParseError, "missing %%EOF marker", error_code, error_message);
+    }
+    *pages = count_pages(data);
+    return true;
+}
+
+static bool write_pdf(const std::string& path, int32_t pages, PdfErrorCode* error_code, char** error_message) {
+    if (!write_fixture_pdf(path, pages)) {
+        return fail(PdfErrorCode_IoError, "cannot write " + path, error_code, error_message);
+    }
+    return succeed(error_code, error_message);
+}
+
+extern "C" {
+
+bool spdfcore_init(void) {
+    return true;
+}
+
+void spdfcore_cleanup(void) {}
+
+const char* spdfcore_version(void) {
+    return "0.0.0-host-mock";
+}
+
+bool pdf_get_page_count(const char* file_path, int32_t* page_count, PdfErrorCode* error_code, char** error_message) {
+    int32_t pages = 0;
+    if (!load_pdf(file_path, &pages, error_code, error_message)) {
+        return false;
+    }
+    *page_count = pages;
+    return succeed(error_code, error_message);
+}
+
+bool pdf_get_file_size(const char* file_path, uint64_t* file_size, PdfErrorCode* error_code, char** error_message) {
+    struct stat st;
+    if (!file_path || stat(file_path, &st) != 0) {
+        return fail(PdfErrorCode_FileNotFound, "cannot stat file", error_code, error_message);
+    }
+    *file_size = (uint64_t)st.st_size;
+    return succeed(error_code, error_message);
+}
+
+bool pdf_validate(const char* file_path, bool* is_valid, PdfErrorCode* error_code, char** error_message) {
+    int32_t pages = 0;
+    if (!load_pdf(file_path, &pages, error_code, error_message)) {
+        // Malformed input is a successful call with a negative verdict
+        *is_valid = false;
+        return !error_code || *error_code != PdfErrorCode_FileNotFound;
+    }
+    *is_valid = pages > 0;
+    return succeed(error_code, error_message);
+}
+
+bool pdf_merge_files(const char* const* input_paths, size_t path_count, const char* output_path,
+                     PdfErrorCode* error_code, char** error_message) {
+    if (!input_paths || path_count == 0 || !output_path) {
+        return fail(PdfErrorCode_InvalidParameter, "no input files", error_code, error_message);
+    }
+    int32_t total = 0;
+    for (size_t i = 0; i < path_count; i++) {
+        int32_t pages = 0;
+        if (!load_pdf(input_paths[i], &pages, error_code, error_message)) {
+            return false;
+        }
+        total += pages;
+    }
+    return write_pdf(output_path, total, error_code, error_message);
+}
+
+bool pdf_split_by_pages(const char* input_path, const int32_t* pages, size_t page_count, const char* output_path,
+                        PdfErrorCode* error_code, char** error_message) {
+    int32_t total = 0;
+    if (!load_pdf(input_path, &total, error_code, error_message)) {
+        return false;
+    }
+    for (size_t i = 0; i < page_count; i++) {
+        if (pages[i] < 1 || pages[i] > total) {
+            return fail(PdfErrorCode_InvalidParameter, "page out of range", error_code, error_message);
+        }
+    }
+    return write_pdf(output_path, (int32_t)page_count, error_code, error_message);
+}
+
+bool pdf_extract_page(const char* input_path, int32_t page_number, const char* output_path,
+                      PdfErrorCode* error_code, char** error_message) {
+    return pdf_split_by_pages(input_path, &page_number, 1, output_path, error_code, error_message);
+}
+
+bool pdf_split_at_page(const char* input_path, int32_t split_page, const char* output_prefix,
+                       PdfErrorCode* error_code, char** error_message) {
+    int32_t total = 0;
+    if (!load_pdf(input_path, &total, error_code, error_message)) {
+        return false;
+    }
+    if (split_page < 1 || split_page >= total) {
+        return fail(PdfErrorCode_InvalidParameter, "split page out of range", error_code, error_message);
+    }
+    std::string prefix(output_prefix);
+    return write_pdf(prefix + "_part1.pdf", split_page, error_code, error_message) &&
+           write_pdf(prefix + "_part2.pdf", total - split_page, error_code, error_message);
+}
+
+void free_c_string(char* str) {
+    free(str);
+}
+
+void free_pdf_metadata(PdfMetadata* metadata) {
+    if (!metadata) {
+        return;
+    }
+    free(metadata->title);
+    free(metadata->author);
+    free(metadata->subject);
+    free(metadata->keywords);
+    free(metadata->creator);
+    free(metadata->producer);
+}
+
+} // extern "C"
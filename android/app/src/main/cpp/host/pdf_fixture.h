@@ -0,0 +1,105 @@
+#ifndef SPDFCORE_HOST_PDF_FIXTURE_H
+#define SPDFCORE_HOST_PDF_FIXTURE_H
+
+#include <cstdio>
+#include <string>
+#include <vector>
+
+// Cross-reference table and trailer for objects 1.. at offsets, catalog 1
+static inline void finish_fixture_pdf(const std::vector<size_t>& offsets, std::string* out) {
+    size_t xref_offset = out->size();
+    *out += "xref\n0 " + std::to_string(offsets.size()) + "\n0000000000 65535 f \n";
+    char entry[32];
+    for (size_t i = 1; i < offsets.size(); i++) {
+        snprintf(entry, sizeof(entry), "%010zu 00000 n \n", offsets[i]);
+        *out += entry;
+    }
+    *out += "trailer\n<< /Size " + std::to_string(offsets.size()) + " /Root 1 0 R >>\nstartxref\n" +
+            std::to_string(xref_offset) + "\n%%EOF\n";
+}
+
+// Minimal, well-formed multi-page PDF used by the host tools as input data.
+// Object layout: 1 catalog, 2 page tree, 3 font, then a page/content pair per page.
+static inline std::string build_fixture_pdf(int page_count) {
+    std::string out = "%PDF-1.4\n%\xE2\xE3\xCF\xD3\n";
+    std::vector<size_t> offsets;
+    auto begin_object = [&](int number) {
+        offsets.resize(number + 1, 0);
+        offsets[number] = out.size();
+        out += std::to_string(number) + " 0 obj\n";
+    };
+
+    begin_object(1);
+    out += "<< /Type /Catalog /Pages 2 0 R >>\nendobj\n";
+
+    begin_object(2);
+    out += "<< /Type /Pages /Kids [";
+    for (int i = 0; i < page_count; i++) {
+        out += " " + std::to_string(4 + i * 2) + " 0 R";
+    }
+    out += " ] /Count " + std::to_string(page_count) + " >>\nendobj\n";
+
+    begin_object(3);
+    out += "<< /Type /Font /Subtype /Type1 /BaseFont /Helvetica /Encoding /WinAnsiEncoding >>\nendobj\n";
+
+    for (int i = 0; i < page_count; i++) {
+        int page_object = 4 + i * 2;
+        std::string content = "BT /F1 24 Tf 72 720 Td (Page " + std::to_string(i + 1) + " of fixture) Tj ET\n";
+
+        begin_object(page_object);
+        out += "<< /Type /Page /Parent 2 0 R /MediaBox [0 0 612 792] /Resources << /Font << /F1 3 0 R >> >> /Contents " +
+               std::to_string(page_object + 1) + " 0 R >>\nendobj\n";
+
+        begin_object(page_object + 1);
+        out += "<< /Length " + std::to_string(content.size()) + " >>\nstream\n" + content + "endstream\nendobj\n";
+    }
+
+    finish_fixture_pdf(offsets, &out);
+    return out;
+}
+
+// One-page AcroForm: a text field "name" (Helvetica from /DR, auto size) and
+// a check box "agree" with /Yes and /Off appearances.
+// Object layout: 1 catalog, 2 page tree, 3 font, 4 page, 5 content, 6 text
+// field, 7 check box, 8 and 9 its appearances.
+static inline std::string build_form_fixture_pdf() {
+    std::string out = "%PDF-1.4\n%\xE2\xE3\xCF\xD3\n";
+    std::vector<size_t> offsets(1, 0);
+    auto add_object = [&](const std::string& body) {
+        offsets.push_back(out.size());
+        out += std::to_string(offsets.size() - 1) + " 0 obj\n" + body + "\nendobj\n";
+    };
+    auto stream = [](const std::string& dict, const std::string& data) {
+        return "<< " + dict + " /Length " + std::to_string(data.size()) + " >>\nstream\n" + data + "\nendstream";
+    };
+    add_object("<< /Type /Catalog /Pages 2 0 R /AcroForm << /Fields [6 0 R 7 0 R] "
+               "/DR << /Font << /Helv 3 0 R >> >> /DA (/Helv 0 Tf 0 g) >> >>");
+    add_object("<< /Type /Pages /Kids [4 0 R] /Count 1 >>");
+    add_object("<< /Type /Font /Subtype /Type1 /BaseFont /Helvetica /Encoding /WinAnsiEncoding >>");
+    add_object("<< /Type /Page /Parent 2 0 R /MediaBox [0 0 612 792] /Resources << /Font << /F1 3 0 R >> >> "
+               "/Contents 5 0 R /Annots [6 0 R 7 0 R] >>");
+    add_object(stream("", "BT /F1 24 Tf 72 740 Td (Form fixture) Tj ET"));
+    add_object("<< /Type /Annot /Subtype /Widget /FT /Tx /T (name) /Rect [72 690 372 714] /P 4 0 R /F 4 "
+               "/MK << /BC [0 0 1] >> >>");
+    add_object("<< /Type /Annot /Subtype /Widget /FT /Btn /T (agree) /Rect [72 660 86 674] /P 4 0 R /F 4 "
+               "/V /Off /AS /Off /AP << /N << /Yes 8 0 R /Off 9 0 R >> >> >>");
+    add_object(stream("/Type /XObject /Subtype /Form /BBox [0 0 14 14]", "0 g 2 2 10 10 re f"));
+    add_object(stream("/Type /XObject /Subtype /Form /BBox [0 0 14 14]", ""));
+    finish_fixture_pdf(offsets, &out);
+    return out;
+}
+
+static inline bool write_pdf(const std::string& path, const std::string& data) {
+    FILE* file = fopen(path.c_str(), "wb");
+    if (!file) {
+        return false;
+    }
+    bool ok = fwrite(data.data(), 1, data.size(), file) == data.size();
+    return fclose(file) == 0 && ok;
+}
+
+static inline bool write_fixture_pdf(const std::string& path, int page_count) {
+    return write_pdf(path, build_fixture_pdf(page_count));
+}
+
+#endif // SPDFCORE_HOST_PDF_FIXTURE_H
@@ -0,0 +1,231 @@
+#include <sys/stat.h>
+#include <unistd.h>
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <string>
+#include <thread>
+#include <vector>
+#include "../spdf_executor.h"
+#include "../spdf_writer.h"
+
+// Shared executor: topology, scheduling order and interactive latency
+//
+// Reads made-up sysfs trees (big.LITTLE by cpu_capacity, by cpufreq, alike
+// cores, nothing known) into a CpuTopology, then checks in deterministic mode
+// that interactive work submitted by a bulk chunk runs at the next chunk
+// boundary while bulk work waits for run_pending(). With threads it checks
+// nested parallel runs, then keeps every core busy with --bulk-ms of bulk
+// chunks while --requests short interactive requests come in, and reports
+// their latency with and without an interactive TaskClassScope; bulk work
+// must have yielded to the scoped ones.
+
+struct Options {
+    int requests = 20;
+    int bulk_ms = 400;
+    int chunk_us = 2000;
+    int request_us = 1000;
+};
+
+static bool make_dir(const std::string& path) {
+    return mkdir(path.c_str(), 0755) == 0 || errno == EEXIST;
+}
+
+static void write_value(const std::string& path, uint64_t value) {
+    std::ofstream file(path);
+    file << value << "\n";
+}
+
+static std::string describe(const std::vector<int>& cpus) {
+    std::string out;
+    for (int cpu : cpus) {
+        out += (out.empty() ? "" : ",") + std::to_string(cpu);
+    }
+    return out.empty() ? "-" : out;
+}
+
+// A made-up sysfs tree with one value per core (0 leaves the file out) and the
+// topology it should read as
+struct TopologyCase {
+    const char* name;
+    const char* file;  // below cpuN
+    std::vector<uint64_t> values;
+    std::vector<int> performance;
+    std::vector<int> efficiency;
+};
+
+static bool check_topologies(const std::string& workdir) {
+    const TopologyCase cases[] = {
+        {"big.LITTLE capacity", "cpu_capacity", {446, 446, 446, 446, 1024, 1024, 1024, 1024}, {4, 5, 6, 7}, {0, 1, 2, 3}},
+        {"cpufreq", "cpufreq/cpuinfo_max_freq", {1800000, 1800000, 2400000}, {2}, {0, 1}},
+        {"alike cores", "cpu_capacity", {1024, 1024, 1024, 1024}, {0, 1, 2, 3}, {}},
+        {"nothing known", "cpu_capacity", {0, 0}, {0, 1}, {}},
+    };
+    bool ok = true;
+    int index = 0;
+    for (const auto& test : cases) {
+        std::string root = workdir + "/sysfs" + std::to_string(index++);
+        make_dir(root);
+        for (size_t cpu = 0; cpu < test.values.size(); cpu++) {
+            std::string dir = root + "/cpu" + std::to_string(cpu);
+            make_dir(dir);
+            make_dir(dir + "/cpufreq");
+            if (test.values[cpu]) {
+                write_value(dir + "/" + test.file, test.values[cpu]);
+            }
+        }
+        spdf::CpuTopology topology = spdf::CpuTopology::read(root);
+        bool match = topology.performance == test.performance && topology.efficiency == test.efficiency;
+        printf("  %-20s performance %-8s efficiency %-8s %s\n", test.name, describe(topology.performance).c_str(),
+               describe(topology.efficiency).c_str(), match ? "ok" : "MISMATCH");
+        ok = ok && match;
+    }
+    return ok;
+}
+
+// Bulk chunks submit an interactive and a bulk task; only the interactive one
+// may run before the chunks are done
+static bool check_deterministic() {
+    spdf::ExecutorOptions options;
+    options.deterministic = true;
+    spdf::executor().configure(options);
+
+    std::vector<std::string> order;
+    spdf::run_parallel(5, 4, [&](size_t i) {
+        order.push_back("bulk" + std::to_string(i));
+        if (i == 1) {
+            spdf::executor().submit(spdf::TaskClass::Interactive, [&]() { order.push_back("interactive"); });
+            spdf::executor().submit(spdf::TaskClass::Bulk, [&]() { order.push_back("queued"); });
+        }
+    });
+    size_t pending = spdf::executor().run_pending();
+    {
+        // Interactive work does not give way to more interactive work
+        spdf::TaskClassScope scope(spdf::TaskClass::Interactive);
+        spdf::run_parallel(2, 4, [&](size_t i) {
+            order.push_back("scoped" + std::to_string(i));
+            if (i == 0) {
+                spdf::executor().submit(spdf::TaskClass::Interactive, [&]() { order.push_back("late"); });
+            }
+        });
+    }
+    pending += spdf::executor().run_pending();
+
+    const std::vector<std::string> expected = {"bulk0", "bulk1", "interactive", "bulk2", "bulk3", "bulk4",
+                                               "queued", "scoped0", "scoped1", "late"};
+    std::string seen;
+    for (const auto& entry : order) {
+        seen += " " + entry;
+    }
+    bool ok = order == expected && pending == 2;
+    printf("  deterministic order:%s %s\n", seen.c_str(), ok ? "ok" : "MISMATCH");
+    spdf::executor().configure(spdf::ExecutorOptions());
+    return ok;
+}
+
+static void spin(std::chrono::microseconds duration) {
+    auto end = std::chrono::steady_clock::now() + duration;
+    while (std::chrono::steady_clock::now() < end) {
+    }
+}
+
+// Every item of nested runs exactly once
+static bool check_nested() {
+    const size_t outer = 8;
+    const size_t inner = 200;
+    std::vector<std::atomic<int>> runs(outer * inner);
+    spdf::run_parallel(outer, 0, [&](size_t i) {
+        spdf::run_parallel(inner, 0, [&](size_t j) { runs[i * inner + j]++; });
+    });
+    bool ok = std::all_of(runs.begin(), runs.end(), [](const std::atomic<int>& count) { return count == 1; });
+    printf("  nested parallel runs: %s\n", ok ? "ok" : "MISMATCH");
+    return ok;
+}
+
+// Latency of requests while bulk chunks keep every core busy
+static void measure_latency(const Options& options, bool scoped, double* average, double* worst) {
+    std::atomic<bool> stop{false};
+    std::thread bulk([&]() {
+        while (!stop) {
+            size_t chunks = (size_t)options.bulk_ms * 1000 / options.chunk_us;
+            spdf::run_parallel(chunks, 0, [&](size_t) {
+                if (!stop) {
+                    spin(std::chrono::microseconds(options.chunk_us));
+                }
+            });
+        }
+    });
+    std::this_thread::sleep_for(std::chrono::milliseconds(20));
+    double total = 0;
+    *worst = 0;
+    for (int i = 0; i < options.requests; i++) {
+        auto start = std::chrono::steady_clock::now();
+        {
+            spdf::TaskClassScope scope(scoped ? spdf::TaskClass::Interactive : spdf::TaskClass::Bulk);
+            // A request is a few short slices of work with the thread giving up the core between them
+            for (int slice = 0; slice < 4; slice++) {
+                spin(std::chrono::microseconds(options.request_us / 4));
+                std::this_thread::yield();
+            }
+        }
+        double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+        total += ms;
+        *worst = std::max(*worst, ms);
+        std::this_thread::sleep_for(std::chrono::milliseconds(5));
+    }
+    stop = true;
+    bulk.join();
+    *average = total / options.requests;
+}
+
+int main(int argc, char** argv) {
+    Options options;
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        if (arg == "--requests" && i + 1 < argc) {
+            options.requests = std::max(1, atoi(argv[++i]));
+        } else if (arg == "--bulk-ms" && i + 1 < argc) {
+            options.bulk_ms = std::max(10, atoi(argv[++i]));
+        } else {
+            fprintf(stderr, "Usage: %s [--requests N] [--bulk-ms N]\n", argv[0]);
+            return 2;
+        }
+    }
+
+    char dir[] = "/tmp/spdf_executor_test_XXXXXX";
+    if (!mkdtemp(dir)) {
+        perror("mkdtemp");
+        return 1;
+    }
+    const spdf::CpuTopology& host = spdf::executor().topology();
+    printf("spdf executor test: performance cores %s, efficiency cores %s\n", describe(host.performance).c_str(),
+           describe(host.efficiency).c_str());
+
+    bool ok = check_topologies(dir);
+    std::string remove = std::string("rm -rf '") + dir + "'";
+    if (system(remove.c_str()) != 0) {
+        fprintf(stderr, "cannot remove %s\n", dir);
+    }
+    ok = check_deterministic() && ok;
+    ok = check_nested() && ok;
+
+    double plain_average = 0;
+    double plain_worst = 0;
+    double scoped_average = 0;
+    double scoped_worst = 0;
+    measure_latency(options, false, &plain_average, &plain_worst);
+    uint64_t yields = spdf::executor().stats().yields;
+    measure_latency(options, true, &scoped_average, &scoped_worst);
+    yields = spdf::executor().stats().yields - yields;
+    printf("  request latency under bulk load: %.2f ms average, %.2f ms worst unscoped; "
+           "%.2f ms average, %.2f ms worst interactive (%llu bulk yields)\n",
+           plain_average, plain_worst, scoped_average, scoped_worst, (unsigned long long)yields);
+    ok = ok && yields > 0;
+
+    printf("%s\n", ok ? "PASS" : "FAIL");
+    return ok ? 0 : 1;
+}
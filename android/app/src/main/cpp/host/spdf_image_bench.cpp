@@ -0,0 +1,275 @@
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <thread>
+#include <vector>
+#include "../spdf_ccitt.h"
+#include "../spdf_image.h"
+#include "../spdf_jpeg.h"
+#include "../spdf_simd.h"
+
+// Image compression path throughput
+//
+// Synthesises an A4 page scanned at --dpi (paper texture, lines of text-like
+// strokes and a photograph), stores it as a JPEG the way scanners embed it,
+// then times what compress does to it: decoding, resampling to --target-dpi
+// with the area and Lanczos filters at every SIMD level the CPU supports, and
+// the JPEG quality search. A second scan of text only is checked for the
+// black-and-white path: the histogram must call it bilevel, then it is
+// binarized at 300 dpi and coded as CCITT G4. All levels must resample to the
+// same pixels (within one step of rounding) and produce the same luma
+// histogram; a mismatch fails the run.
+
+struct Options {
+    int dpi = 600;
+    int target_dpi = 150;
+    int repeat = 3;
+    unsigned threads = 0;
+    bool gray = false;
+};
+
+static uint64_t next_random(uint64_t* state) {
+    *state ^= *state << 13;
+    *state ^= *state >> 7;
+    *state ^= *state << 17;
+    return *state;
+}
+
+static spdf::Bitmap build_scan(int width, int height, int components, int dpi, bool photo) {
+    spdf::Bitmap scan;
+    scan.width = width;
+    scan.height = height;
+    scan.components = components;
+    scan.pixels.resize(scan.stride() * (size_t)height);
+    uint64_t state = 0x9E3779B97F4A7C15ull;
+    // Off-white paper with sensor noise
+    for (size_t i = 0; i < scan.pixels.size(); i++) {
+        scan.pixels[i] = (uint8_t)(236 + next_random(&state) % 12 - (i % (size_t)components == 2 ? 6 : 0));
+    }
+    auto fill = [&](int x0, int y0, int w, int h, int r, int g, int b) {
+        for (int y = std::max(0, y0); y < std::min(height, y0 + h); y++) {
+            uint8_t* line = scan.pixels.data() + (size_t)y * scan.stride();
+            for (int x = std::max(0, x0); x < std::min(width, x0 + w); x++) {
+                uint8_t* p = line + (size_t)x * (size_t)components;
+                p[0] = (uint8_t)r;
+                if (components == 3) {
+                    p[1] = (uint8_t)g, p[2] = (uint8_t)b;
+                }
+            }
+        }
+    };
+    // Lines of 10 pt "words" made of vertical and horizontal strokes
+    int margin = dpi;
+    int line_height = dpi * 14 / 72;
+    int glyph = dpi * 6 / 72;
+    int stroke = std::max(1, dpi / 150);
+    int photo_top = photo ? height / 2 : height;
+    int photo_bottom = photo ? height / 2 + height / 5 : height;
+    for (int y = margin; y + line_height < height - margin; y += line_height) {
+        if (y + line_height > photo_top && y < photo_bottom) {
+            continue;
+        }
+        for (int x = margin; x + glyph < width - margin;) {
+            int letters = 2 + (int)(next_random(&state) % 8);
+            for (int i = 0; i < letters && x + glyph < width - margin; i++, x += glyph) {
+                uint64_t shape = next_random(&state);
+                int ink = 20 + (int)(shape % 30);
+                fill(x, y, stroke, glyph, ink, ink, ink);
+                if (shape & 0x100) {
+                    fill(x, y + glyph / 2, glyph - stroke, stroke, ink, ink, ink);
+                }
+                if (shape & 0x200) {
+                    fill(x + glyph - 2 * stroke, y, stroke, glyph, ink, ink, ink);
+                }
+                if (shape & 0x400) {
+                    fill(x, y, glyph - stroke, stroke, ink, ink, ink);
+                }
+            }
+            x += glyph;
+        }
+    }
+    // A photograph: smooth colour gradients with fine texture
+    for (int y = photo_top; y < photo_bottom; y++) {
+        uint8_t* line = scan.pixels.data() + (size_t)y * scan.stride();
+        for (int x = margin; x < width - margin; x++) {
+            uint8_t* p = line + (size_t)x * (size_t)components;
+            int texture = (int)(next_random(&state) % 16);
+            p[0] = (uint8_t)(40 + (x * 160 / width) + texture);
+            if (components == 3) {
+                p[1] = (uint8_t)(60 + ((y - photo_top) * 150 / (photo_bottom - photo_top)) + texture);
+                p[2] = (uint8_t)(120 + ((x + y) % 97) + texture / 2);
+            }
+        }
+    }
+    return scan;
+}
+
+static double seconds_since(std::chrono::steady_clock::time_point start) {
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+static int max_difference(const spdf::Bitmap& a, const spdf::Bitmap& b) {
+    if (a.pixels.size() != b.pixels.size()) {
+        return 256;
+    }
+    int worst = 0;
+    for (size_t i = 0; i < a.pixels.size(); i++) {
+        worst = std::max(worst, std::abs((int)a.pixels[i] - (int)b.pixels[i]));
+    }
+    return worst;
+}
+
+int main(int argc, char** argv) {
+    Options options;
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        if (arg == "--dpi" && i + 1 < argc) {
+            options.dpi = std::max(10, atoi(argv[++i]));
+        } else if (arg == "--target-dpi" && i + 1 < argc) {
+            options.target_dpi = std::max(1, atoi(argv[++i]));
+        } else if (arg == "--repeat" && i + 1 < argc) {
+            options.repeat = std::max(1, atoi(argv[++i]));
+        } else if (arg == "--threads" && i + 1 < argc) {
+            options.threads = (unsigned)std::max(1, atoi(argv[++i]));
+        } else if (arg == "--gray") {
+            options.gray = true;
+        } else {
+            fprintf(stderr, "Usage: %s [--dpi N] [--target-dpi N] [--repeat N] [--threads N] [--gray]\n", argv[0]);
+            return 2;
+        }
+    }
+    unsigned threads = options.threads ? options.threads : std::max(1u, std::thread::hardware_concurrency());
+
+    // A4 is 8.27 x 11.69 inches
+    int width = options.dpi * 827 / 100;
+    int height = options.dpi * 1169 / 100;
+    int target_width = options.target_dpi * 827 / 100;
+    int target_height = options.target_dpi * 1169 / 100;
+    int components = options.gray ? 1 : 3;
+    spdf::Bitmap scan = build_scan(width, height, components, options.dpi, true);
+    double megapixels = (double)width * height / 1e6;
+    std::string embedded;
+    if (!spdf::jpeg_encode(scan, 90, threads, &embedded)) {
+        fprintf(stderr, "cannot encode the synthetic scan\n");
+        return 1;
+    }
+
+    printf("spdf image bench: A4 %s scan at %d dpi (%dx%d, %.1f MP, %.1f MB as JPEG) to %d dpi, %u threads, "
+           "best of %d\n",
+           options.gray ? "gray" : "colour", options.dpi, width, height, megapixels, embedded.size() / 1e6,
+           options.target_dpi, threads, options.repeat);
+
+    bool ok = true;
+    spdf::Bitmap decoded;
+    for (unsigned decode_threads : {1u, threads}) {
+        double best = 1e30;
+        for (int r = 0; r < options.repeat; r++) {
+            std::string error;
+            auto start = std::chrono::steady_clock::now();
+            ok = spdf::jpeg_decode(embedded, &decoded, &error, decode_threads) && ok;
+            best = std::min(best, seconds_since(start));
+        }
+        printf("%-22s %10.1f ms %10.1f MP/s\n", decode_threads == 1 ? "decode, 1 thread" : "decode, restarts", best * 1e3,
+               megapixels / best);
+        if (threads == 1) {
+            break;
+        }
+    }
+
+    printf("%-8s %-9s %10s %10s %8s\n", "level", "filter", "ms", "MP/s", "maxdiff");
+    spdf::SimdLevel initial = spdf::simd_level();
+    spdf::Bitmap reference[2];
+    spdf::Bitmap resampled;
+    for (spdf::SimdLevel level : {spdf::SimdLevel::Scalar, spdf::SimdLevel::Sse2, spdf::SimdLevel::Neon,
+                                  spdf::SimdLevel::Avx2}) {
+        if (!spdf::set_simd_level(level)) {
+            continue;
+        }
+        for (int f = 0; f < 2; f++) {
+            spdf::ResampleFilter filter = f == 0 ? spdf::ResampleFilter::Area : spdf::ResampleFilter::Lanczos3;
+            double best = 1e30;
+            for (int r = 0; r < options.repeat; r++) {
+                auto start = std::chrono::steady_clock::now();
+                ok = spdf::resample_bitmap(decoded, target_width, target_height, filter, threads, &resampled) && ok;
+                best = std::min(best, seconds_since(start));
+            }
+            if (reference[f].pixels.empty()) {
+                reference[f] = resampled;
+            }
+            int difference = max_difference(reference[f], resampled);
+            ok = ok && difference <= 1;
+            printf("%-8s %-9s %10.1f %10.1f %8d%s\n", spdf::simd_level_name(level), f == 0 ? "area" : "lanczos3",
+                   best * 1e3, megapixels / best, difference, difference <= 1 ? "" : "  MISMATCH");
+        }
+    }
+    spdf::set_simd_level(initial);
+
+    spdf::JpegTarget target;
+    spdf::JpegResult result;
+    double best = 1e30;
+    for (int r = 0; r < options.repeat; r++) {
+        auto start = std::chrono::steady_clock::now();
+        ok = spdf::encode_jpeg_to_target(reference[1], target, threads, &result) && ok;
+        best = std::min(best, seconds_since(start));
+    }
+    double pixels = (double)target_width * target_height;
+    printf("quality search: %.1f ms, quality %d, SSIM %.4f, %.1f KB (%.2f bits/pixel, %.1fx smaller than the scan)\n",
+           best * 1e3, result.quality, result.ssim, result.data.size() / 1e3, result.data.size() * 8 / pixels,
+           (double)embedded.size() / std::max<size_t>(1, result.data.size()));
+    ok = ok && result.ssim >= target.ssim;
+
+    // Black-and-white path on a page of text
+    spdf::Bitmap text = build_scan(width, height, components, options.dpi, false);
+    spdf::LumaHistogram histograms[2];
+    printf("%-8s %10s %10s %8s\n", "level", "luma ms", "MP/s", "same");
+    for (spdf::SimdLevel level : {spdf::SimdLevel::Scalar, spdf::SimdLevel::Sse2, spdf::SimdLevel::Neon,
+                                  spdf::SimdLevel::Avx2}) {
+        if (!spdf::set_simd_level(level)) {
+            continue;
+        }
+        best = 1e30;
+        spdf::LumaHistogram* histogram = &histograms[histograms[0].pixels ? 1 : 0];
+        for (int r = 0; r < options.repeat; r++) {
+            auto start = std::chrono::steady_clock::now();
+            spdf::luma_histogram(text, threads, histogram);
+            best = std::min(best, seconds_since(start));
+        }
+        bool same = std::equal(std::begin(histograms[0].counts), std::end(histograms[0].counts),
+                               std::begin(histogram->counts)) &&
+                    histograms[0].coloured == histogram->coloured;
+        ok = ok && same;
+        printf("%-8s %10.1f %10.1f %8s\n", spdf::simd_level_name(level), best * 1e3, megapixels / best,
+               same ? "yes" : "MISMATCH");
+    }
+    spdf::set_simd_level(initial);
+    int threshold = spdf::bilevel_threshold(histograms[0]);
+    int bilevel_width = std::min(width, 300 * 827 / 100);
+    int bilevel_height = std::min(height, 300 * 1169 / 100);
+    std::vector<uint8_t> bits;
+    std::string g4;
+    std::string text_jpeg;
+    ok = ok && threshold >= 0 && spdf::jpeg_encode(text, 90, threads, &text_jpeg);
+    double binarize_best = 1e30;
+    double g4_best = 1e30;
+    for (int r = 0; r < options.repeat && threshold >= 0; r++) {
+        auto start = std::chrono::steady_clock::now();
+        ok = spdf::binarize_bitmap(text, bilevel_width, bilevel_height, threshold, threads, &bits) && ok;
+        binarize_best = std::min(binarize_best, seconds_since(start));
+        start = std::chrono::steady_clock::now();
+        spdf::ccitt_g4_encode(bits.data(), bilevel_width, bilevel_height, ((size_t)bilevel_width + 7) / 8, &g4);
+        g4_best = std::min(g4_best, seconds_since(start));
+    }
+    if (threshold < 0) {
+        printf("bilevel: text scan not recognised  FAIL\n");
+    } else {
+        printf("bilevel: threshold %d, binarize %.1f ms, G4 %.1f ms, %.1f KB (%.1fx smaller than the scan)\n",
+               threshold, binarize_best * 1e3, g4_best * 1e3, g4.size() / 1e3,
+               (double)text_jpeg.size() / std::max<size_t>(1, g4.size()));
+    }
+
+    printf("%s\n", ok ? "PASS" : "FAIL");
+    return ok ? 0 : 1;
+}
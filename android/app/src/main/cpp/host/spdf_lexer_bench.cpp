@@ -0,0 +1,189 @@
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+#include "../spdf_lexer.h"
+#include "../spdf_simd.h"
+
+// Content-stream tokenizer throughput
+//
+// Generates synthetic page content (text, paths, graphics state, arrays,
+// escaped strings and names) split into streams of --stream-kb, tokenizes all
+// of it at every SIMD level the CPU supports and reports GB/s. The token
+// streams of all levels, and the matches of the byte search the recovery
+// scanner uses, must be identical; a mismatch fails the run.
+
+struct Options {
+    size_t megabytes = 100;
+    size_t stream_kb = 64;
+    int repeat = 3;
+};
+
+static uint64_t next_random(uint64_t* state) {
+    *state ^= *state << 13;
+    *state ^= *state >> 7;
+    *state ^= *state << 17;
+    return *state;
+}
+
+static void append_number(std::string* out, uint64_t* state) {
+    uint64_t r = next_random(state);
+    char number[32];
+    if (r & 1) {
+        snprintf(number, sizeof(number), "%d ", (int)(r >> 8) % 1000);
+    } else {
+        snprintf(number, sizeof(number), "%.2f ", (double)((r >> 8) % 100000) / 100.0);
+    }
+    *out += number;
+}
+
+static std::string build_content(size_t size, uint64_t seed) {
+    static const char* words[] = {"Invoice", "total", "amount due", "Section 4.2", "the quick brown fox",
+                                  "jumps over", "lazy dog", "Page", "of", "Summary"};
+    std::string out;
+    out.reserve(size + 512);
+    uint64_t state = seed | 1;
+    while (out.size() < size) {
+        switch (next_random(&state) % 5) {
+            case 0:
+                out += "q ";
+                for (int i = 0; i < 6; i++) {
+                    append_number(&out, &state);
+                }
+                out += "cm /GS0 gs 0.5 0.25 0.75 rg\n";
+                break;
+            case 1:
+                out += "BT /F1 ";
+                append_number(&out, &state);
+                out += "Tf ";
+                append_number(&out, &state);
+                append_number(&out, &state);
+                out += "Td (";
+                out += words[next_random(&state) % 10];
+                out += ") Tj\n[(";
+                out += words[next_random(&state) % 10];
+                out += ")-120(";
+                out += words[next_random(&state) % 10];
+                out += ") 250(x)] TJ ET\n";
+                break;
+            case 2:
+                for (int i = 0; i < 4; i++) {
+                    append_number(&out, &state);
+                    append_number(&out, &state);
+                    out += i == 0 ? "m " : "l ";
+                }
+                append_number(&out, &state);
+                append_number(&out, &state);
+                append_number(&out, &state);
+                append_number(&out, &state);
+                append_number(&out, &state);
+                append_number(&out, &state);
+                out += "c h f\n";
+                break;
+            case 3:
+                out += "BT (Escaped \\(paren\\) and \\n newline) Tj <48656C6C6F20576F726C64> Tj /F#232 9 Tf ET\n";
+                break;
+            default:
+                out += "/Im1 Do Q % image placement\n";
+                break;
+        }
+    }
+    return out;
+}
+
+// Order-sensitive digest of every token field
+static uint64_t digest(const spdf::TokenBuffer& tokens) {
+    uint64_t hash = 1469598103934665603ull;
+    auto mix = [&hash](uint64_t value) { hash = (hash ^ value) * 1099511628211ull; };
+    for (const auto& token : tokens) {
+        mix((uint64_t)token.type);
+        mix(token.offset);
+        mix((uint64_t)token.integer);
+        for (char c : tokens.text(token)) {
+            mix((unsigned char)c);
+        }
+    }
+    return hash;
+}
+
+int main(int argc, char** argv) {
+    Options options;
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        if (arg == "--megabytes" && i + 1 < argc) {
+            options.megabytes = (size_t)std::max(1, atoi(argv[++i]));
+        } else if (arg == "--stream-kb" && i + 1 < argc) {
+            options.stream_kb = (size_t)std::max(1, atoi(argv[++i]));
+        } else if (arg == "--repeat" && i + 1 < argc) {
+            options.repeat = std::max(1, atoi(argv[++i]));
+        } else {
+            fprintf(stderr, "Usage: %s [--megabytes N] [--stream-kb N] [--repeat N]\n", argv[0]);
+            return 2;
+        }
+    }
+
+    size_t stream_count = std::max<size_t>(1, options.megabytes * 1024 / options.stream_kb);
+    std::vector<std::string> streams;
+    size_t total_bytes = 0;
+    for (size_t i = 0; i < stream_count; i++) {
+        streams.push_back(build_content(options.stream_kb * 1024, 0x9E3779B97F4A7C15ull * (i + 1)));
+        total_bytes += streams.back().size();
+    }
+
+    printf("spdf lexer bench: %zu streams of %zu KB (%.1f MB), best of %d\n", streams.size(), options.stream_kb,
+           total_bytes / 1e6, options.repeat);
+    printf("%-8s %10s %10s %14s %18s\n", "level", "ms", "GB/s", "Mtokens/s", "digest");
+
+    spdf::SimdLevel initial = spdf::simd_level();
+    spdf::TokenBuffer tokens;
+    bool ok = true;
+    bool have_reference = false;
+    uint64_t reference = 0;
+    for (spdf::SimdLevel level : {spdf::SimdLevel::Scalar, spdf::SimdLevel::Sse2, spdf::SimdLevel::Neon,
+                                  spdf::SimdLevel::Avx2}) {
+        if (!spdf::set_simd_level(level)) {
+            continue;
+        }
+        // Verification pass, untimed
+        uint64_t combined = 0;
+        for (const auto& stream : streams) {
+            spdf::tokenize(stream.data(), stream.size(), &tokens);
+            combined = combined * 31 + digest(tokens);
+            for (const char* needle : {"T", "Tj", "re\n", "endstream"}) {
+                size_t length = strlen(needle);
+                for (size_t at = 0; at < stream.size(); at++) {
+                    at += spdf::find_bytes(stream.data() + at, stream.size() - at, needle, length);
+                    combined = combined * 31 + at;
+                }
+            }
+        }
+        if (!have_reference) {
+            reference = combined;
+            have_reference = true;
+        }
+        ok = ok && combined == reference;
+
+        size_t token_count = 0;
+        double best = 1e30;
+        for (int r = 0; r < options.repeat; r++) {
+            token_count = 0;
+            auto start = std::chrono::steady_clock::now();
+            for (const auto& stream : streams) {
+                spdf::tokenize(stream.data(), stream.size(), &tokens);
+                token_count += tokens.size();
+            }
+            best = std::min(best, std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count());
+        }
+        printf("%-8s %10.1f %10.2f %14.1f %18llx%s\n", spdf::simd_level_name(level), best * 1e3,
+               total_bytes / best / 1e9, token_count / best / 1e6, (unsigned long long)combined,
+               combined == reference ? "" : "  MISMATCH");
+    }
+    spdf::set_simd_level(initial);
+
+    printf("%s\n", ok ? "PASS" : "FAIL");
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,376 @@
+#include <malloc.h>
+#include <sys/resource.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <string>
+#include <vector>
+#include "../spdf_document.h"
+#include "../spdf_memory.h"
+#include "../spdf_merge.h"
+
+// Merges under a memory budget
+//
+// Writes --inputs documents of --megabytes each, made of incompressible page
+// streams, then merges all of them, runs a merge session over pairs of them
+// and assembles a batch from their pages with memory_budget() limited to
+// --budget MB. Every output must open with the pages it was given, and the
+// peak resident size may grow by no more than the budget plus --slack MB
+// (default: half the budget, at least 24) for the batches being serialised
+// and written, which are not reserved.
+// With --cgroup the work runs in a child process inside a memory cgroup
+// limited to the same amount, so going over is an OOM kill rather than a
+// number; without cgroup support the resident size check is used instead.
+
+struct Options {
+    int inputs = 6;
+    int megabytes = 8;
+    int budget = 24;
+    int slack = -1;
+    unsigned threads = 4;
+    bool cgroup = false;
+    std::string workdir;
+};
+
+// Pages per generated input; each carries megabytes / PAGES_PER_INPUT
+static const int PAGES_PER_INPUT = 8;
+// Size of the chunks the inputs are generated in, so generating them does not
+// count towards the peak
+static const size_t WRITE_CHUNK = 64u << 10;
+
+static uint64_t next_random(uint64_t* state) {
+    *state ^= *state << 13;
+    *state ^= *state >> 7;
+    *state ^= *state << 17;
+    return *state;
+}
+
+// A document whose page streams are random bytes (no filter), so neither
+// the reader nor the writer can make them smaller
+static bool write_input(const std::string& path, int megabytes, uint64_t seed) {
+    FILE* file = fopen(path.c_str(), "wb");
+    if (!file) {
+        return false;
+    }
+    size_t stream_size = ((size_t)megabytes << 20) / PAGES_PER_INPUT;
+    std::vector<long> offsets(4 + PAGES_PER_INPUT * 2, 0);
+    fputs("%PDF-1.4\n%\xE2\xE3\xCF\xD3\n", file);
+    offsets[1] = ftell(file);
+    fputs("1 0 obj\n<< /Type /Catalog /Pages 2 0 R >>\nendobj\n", file);
+    offsets[2] = ftell(file);
+    fputs("2 0 obj\n<< /Type /Pages /Kids [", file);
+    for (int i = 0; i < PAGES_PER_INPUT; i++) {
+        fprintf(file, " %d 0 R", 3 + i * 2);
+    }
+    fprintf(file, " ] /Count %d >>\nendobj\n", PAGES_PER_INPUT);
+
+    std::vector<char> chunk(WRITE_CHUNK);
+    uint64_t state = seed * 0x9E3779B97F4A7C15ull + 1;
+    for (int i = 0; i < PAGES_PER_INPUT; i++) {
+        int page = 3 + i * 2;
+        offsets[page] = ftell(file);
+        fprintf(file, "%d 0 obj\n<< /Type /Page /Parent 2 0 R /MediaBox [0 0 612 792] /Contents %d 0 R >>\nendobj\n",
+                page, page + 1);
+        offsets[page + 1] = ftell(file);
+        fprintf(file, "%d 0 obj\n<< /Length %zu >>\nstream\n", page + 1, stream_size);
+        for (size_t done = 0; done < stream_size; done += chunk.size()) {
+            size_t size = std::min(chunk.size(), stream_size - done);
+            for (size_t j = 0; j < size; j += 8) {
+                uint64_t value = next_random(&state);
+                memcpy(&chunk[j], &value, std::min<size_t>(8, size - j));
+            }
+            fwrite(chunk.data(), 1, size, file);
+        }
+        fputs("\nendstream\nendobj\n", file);
+    }
+
+    size_t count = 3 + PAGES_PER_INPUT * 2;
+    long xref_offset = ftell(file);
+    fprintf(file, "xref\n0 %zu\n0000000000 65535 f \n", count);
+    for (size_t i = 1; i < count; i++) {
+        fprintf(file, "%010ld 00000 n \n", offsets[i]);
+    }
+    fprintf(file, "trailer\n<< /Size %zu /Root 1 0 R >>\nstartxref\n%ld\n%%%%EOF\n", count, xref_offset);
+    return fclose(file) == 0;
+}
+
+static bool check_output(const std::string& path, size_t pages) {
+    spdf::PdfDocument document;
+    std::string error;
+    if (!document.open(path, &error)) {
+        printf("  %s: %s\n", path.c_str(), error.c_str());
+        return false;
+    }
+    if (document.page_count() != pages) {
+        printf("  %s: %zu pages, expected %zu\n", path.c_str(), document.page_count(), pages);
+        return false;
+    }
+    return true;
+}
+
+static uint64_t peak_resident() {
+    struct rusage usage {};
+    getrusage(RUSAGE_SELF, &usage);
+    return (uint64_t)usage.ru_maxrss << 10;
+}
+
+// Every output the merges write, with its page count
+struct Outputs {
+    std::string merged;
+    std::vector<std::string> session;
+    std::vector<spdf::AssemblyOutput> assembled;
+    std::vector<std::pair<std::string, size_t>> expected;
+};
+
+static Outputs plan_outputs(const Options& options, const std::vector<std::string>& inputs) {
+    Outputs outputs;
+    outputs.merged = options.workdir + "/merged.pdf";
+    outputs.expected.push_back({outputs.merged, inputs.size() * PAGES_PER_INPUT});
+    for (size_t i = 1; i < inputs.size(); i++) {
+        outputs.session.push_back(options.workdir + "/session" + std::to_string(i) + ".pdf");
+        outputs.expected.push_back({outputs.session.back(), 2 * PAGES_PER_INPUT});
+    }
+    // Each assembled output takes the first half of one input and the second half of the next
+    std::vector<int32_t> first_half;
+    std::vector<int32_t> second_half;
+    for (int page = 1; page <= PAGES_PER_INPUT; page++) {
+        (page <= PAGES_PER_INPUT / 2 ? first_half : second_half).push_back(page);
+    }
+    for (size_t i = 0; i < inputs.size(); i++) {
+        spdf::AssemblyOutput output;
+        output.path = options.workdir + "/assembled" + std::to_string(i) + ".pdf";
+        output.parts.push_back({inputs[i], first_half});
+        output.parts.push_back({inputs[(i + 1) % inputs.size()], second_half});
+        outputs.assembled.push_back(output);
+        outputs.expected.push_back({output.path, PAGES_PER_INPUT});
+    }
+    return outputs;
+}
+
+// Runs every merge; outputs are checked afterwards, by the parent, so that
+// reading them back does not count
+static bool run_merges(const Options& options, const std::vector<std::string>& inputs, const Outputs& outputs) {
+    bool ok = true;
+    PdfErrorCode code = PdfErrorCode_Success;
+    std::string error;
+    auto start = std::chrono::steady_clock::now();
+
+    if (!spdf::merge_documents(inputs, outputs.merged, options.threads, &code, &error)) {
+        printf("  merge_documents: %s\n", error.c_str());
+        ok = false;
+    }
+
+    {
+        spdf::MergeSession session;
+        for (size_t i = 1; i < inputs.size() && ok; i++) {
+            if (!session.merge({inputs[0], inputs[i]}, outputs.session[i - 1], options.threads, &code, &error)) {
+                printf("  session merge %zu: %s\n", i, error.c_str());
+                ok = false;
+            }
+        }
+        spdf::MergeSession::Stats stats = session.stats();
+        printf("  session: %llu hits, %llu misses, %.1f MB kept, %.1f MB of it spilled\n",
+               (unsigned long long)stats.hits, (unsigned long long)stats.misses, stats.bytes / 1048576.0,
+               stats.spilled / 1048576.0);
+    }
+
+    if (ok && !spdf::assemble_documents(outputs.assembled, options.threads, &code, &error)) {
+        printf("  assemble_documents: %s\n", error.c_str());
+        ok = false;
+    }
+
+    spdf::MemoryBudget::Stats stats = spdf::memory_budget().stats();
+    printf("  budget: peak %.1f MB held, %llu waits, %llu overcommits, %.1f MB spilled, %.2f s\n",
+           stats.peak / 1048576.0, (unsigned long long)stats.waits, (unsigned long long)stats.overcommits,
+           stats.spilled / 1048576.0,
+           std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count());
+    return ok;
+}
+
+static bool write_value(const std::string& path, const std::string& value) {
+    std::ofstream file(path);
+    file << value;
+    file.flush();
+    return (bool)file;
+}
+
+// Memory cgroup path of this process, relative to where the controller is
+// mounted: the v2 unified entry, or the v1 memory one
+static bool create_cgroup(uint64_t limit, std::string* dir, bool* v2) {
+    std::ifstream self("/proc/self/cgroup");
+    std::string line;
+    std::string v1_path;
+    std::string v2_path;
+    while (std::getline(self, line)) {
+        size_t first = line.find(':');
+        size_t second = line.find(':', first + 1);
+        if (first == std::string::npos || second == std::string::npos) {
+            continue;
+        }
+        std::string controllers = line.substr(first + 1, second - first - 1);
+        std::string path = line.substr(second + 1);
+        if (controllers.empty()) {
+            v2_path = path;
+        } else if (("," + controllers + ",").find(",memory,") != std::string::npos) {
+            v1_path = path;
+        }
+    }
+    std::string name = "/spdf-memory-test-" + std::to_string(getpid());
+    struct stat info {};
+    std::vector<std::pair<std::string, bool>> candidates;
+    if (!v1_path.empty()) {
+        candidates.push_back({"/sys/fs/cgroup/memory" + v1_path, false});
+    }
+    if (!v2_path.empty()) {
+        candidates.push_back({"/sys/fs/cgroup" + v2_path, true});
+        candidates.push_back({"/sys/fs/cgroup/unified" + v2_path, true});
+    }
+    for (const auto& candidate : candidates) {
+        std::string limit_file = candidate.second ? "/memory.max" : "/memory.limit_in_bytes";
+        if (stat((candidate.first + limit_file).c_str(), &info) != 0 && candidate.second) {
+            // v2 only has memory.max where the parent enables the controller
+            std::ifstream enabled(candidate.first + "/cgroup.subtree_control");
+            std::string controllers;
+            std::getline(enabled, controllers);
+            if (controllers.find("memory") == std::string::npos) {
+                continue;
+            }
+        }
+        std::string path = candidate.first + name;
+        if (mkdir(path.c_str(), 0755) != 0) {
+            continue;
+        }
+        bool limited = write_value(path + limit_file, std::to_string(limit));
+        if (!candidate.second) {
+            // Swap would hide going over
+            write_value(path + "/memory.memsw.limit_in_bytes", std::to_string(limit));
+        } else {
+            write_value(path + "/memory.swap.max", "0");
+        }
+        if (limited) {
+            *dir = path;
+            *v2 = candidate.second;
+            return true;
+        }
+        rmdir(path.c_str());
+    }
+    return false;
+}
+
+static uint64_t read_number(const std::string& path) {
+    std::ifstream file(path);
+    uint64_t value = 0;
+    file >> value;
+    return value;
+}
+
+int main(int argc, char** argv) {
+    Options options;
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        if (arg == "--inputs" && i + 1 < argc) {
+            options.inputs = std::max(2, atoi(argv[++i]));
+        } else if (arg == "--megabytes" && i + 1 < argc) {
+            options.megabytes = std::max(1, atoi(argv[++i]));
+        } else if (arg == "--budget" && i + 1 < argc) {
+            options.budget = std::max(1, atoi(argv[++i]));
+        } else if (arg == "--slack" && i + 1 < argc) {
+            options.slack = std::max(0, atoi(argv[++i]));
+        } else if (arg == "--threads" && i + 1 < argc) {
+            options.threads = (unsigned)std::max(1, atoi(argv[++i]));
+        } else if (arg == "--cgroup") {
+            options.cgroup = true;
+        } else if (arg == "--workdir" && i + 1 < argc) {
+            options.workdir = argv[++i];
+        } else {
+            fprintf(stderr,
+                    "Usage: %s [--inputs N] [--megabytes N] [--budget MB] [--slack MB] [--threads N] [--cgroup]\n"
+                    "          [--workdir DIR]\n",
+                    argv[0]);
+            return 2;
+        }
+    }
+    // Large buffers go back to the system when freed, so the resident peak
+    // follows what is held rather than what the allocator keeps around
+    mallopt(M_MMAP_THRESHOLD, 256 << 10);
+    mallopt(M_TRIM_THRESHOLD, 256 << 10);
+
+    bool own_workdir = options.workdir.empty();
+    if (own_workdir) {
+        char dir[] = "/tmp/spdf_memory_test_XXXXXX";
+        if (!mkdtemp(dir)) {
+            perror("mkdtemp");
+            return 1;
+        }
+        options.workdir = dir;
+    }
+    std::vector<std::string> inputs;
+    for (int i = 0; i < options.inputs; i++) {
+        inputs.push_back(options.workdir + "/input" + std::to_string(i) + ".pdf");
+        if (!write_input(inputs.back(), options.megabytes, (uint64_t)i + 1)) {
+            perror(inputs.back().c_str());
+            return 1;
+        }
+    }
+    uint64_t budget = (uint64_t)options.budget << 20;
+    int slack = options.slack >= 0 ? options.slack : std::max(24, options.budget / 2);
+    uint64_t allowed = budget + ((uint64_t)slack << 20);
+    printf("spdf memory test: %d inputs of %d MB, budget %d MB, %u threads\n", options.inputs, options.megabytes,
+           options.budget, options.threads);
+
+    // The merges run in a child, inside the cgroup when there is one; the
+    // parent only reads the outputs back
+    std::string cgroup;
+    bool v2 = false;
+    bool limited = options.cgroup && create_cgroup(allowed, &cgroup, &v2);
+    if (options.cgroup && !limited) {
+        printf("  no memory cgroup available, checking the resident size instead\n");
+    }
+    Outputs outputs = plan_outputs(options, inputs);
+    fflush(stdout);
+    pid_t child = fork();
+    if (child == 0) {
+        if (limited && !write_value(cgroup + "/cgroup.procs", "0")) {
+            _exit(1);
+        }
+        uint64_t baseline = peak_resident();
+        spdf::memory_budget().configure(budget, options.workdir);
+        bool merged = run_merges(options, inputs, outputs);
+        uint64_t growth = peak_resident() - baseline;
+        printf("  resident peak grew by %.1f MB (allowed %.0f MB)\n", growth / 1048576.0, allowed / 1048576.0);
+        fflush(stdout);
+        _exit(merged && (limited || growth <= allowed) ? 0 : 1);
+    }
+    int status = 0;
+    waitpid(child, &status, 0);
+    bool ok = WIFEXITED(status) && WEXITSTATUS(status) == 0;
+    if (WIFSIGNALED(status)) {
+        printf("  killed by signal %d%s\n", WTERMSIG(status), limited ? " in the cgroup" : "");
+    }
+    if (limited) {
+        uint64_t peak = read_number(cgroup + (v2 ? "/memory.peak" : "/memory.max_usage_in_bytes"));
+        printf("  cgroup %s: limit %.0f MB, peak %.1f MB\n", v2 ? "v2" : "v1", allowed / 1048576.0,
+               peak / 1048576.0);
+        rmdir(cgroup.c_str());
+    }
+    for (const auto& output : outputs.expected) {
+        ok = ok && check_output(output.first, output.second);
+        unlink(output.first.c_str());
+    }
+
+    for (const auto& input : inputs) {
+        unlink(input.c_str());
+    }
+    if (own_workdir) {
+        rmdir(options.workdir.c_str());
+    }
+    printf("%s\n", ok ? "PASS" : "FAIL");
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,755 @@
+#include <jni.h>
+#include <android/log.h>
+#include <dlfcn.h>
+#include <ftw.h>
+#include <sys/stat.h>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <functional>
+#include <iterator>
+#include <memory>
+#include <string>
+#include <thread>
+#include <unordered_set>
+#include <vector>
+#include "../spdfcore.h"
+#include "pdf_fixture.h"
+
+// JVM-free driver for the JNI entry points in spdfcore_jni.cpp
+//
+// Provides a fake JNIEnv backed by plain C++ objects, generates fixture PDFs,
+// then calls every Java_com_example_smart_1pdf_SpdfcorePlugin_* function under
+// load from several threads. Each call is checked for the expected result and
+// for unbalanced GetStringUTFChars/ReleaseStringUTFChars pairs. Timings are
+// reported per entry point next to a direct C ABI baseline so the marshalling
+// overhead of the JNI transport can be read off directly.
+
+extern "C" {
+jboolean Java_com_example_smart_1pdf_SpdfcorePlugin_nativeInit(JNIEnv* env, jobject thiz);
+jboolean Java_com_example_smart_1pdf_SpdfcorePlugin_nativeMergeFiles(JNIEnv* env, jobject thiz, jobjectArray inputPaths, jstring outputPath);
+jboolean Java_com_example_smart_1pdf_SpdfcorePlugin_nativeValidateFile(JNIEnv* env, jobject thiz, jstring filePath);
+jint Java_com_example_smart_1pdf_SpdfcorePlugin_nativeGetPageCount(JNIEnv* env, jobject thiz, jstring filePath);
+jlong Java_com_example_smart_1pdf_SpdfcorePlugin_nativeGetFileSize(JNIEnv* env, jobject thiz, jstring filePath);
+jboolean Java_com_example_smart_1pdf_SpdfcorePlugin_nativeSplitByPages(JNIEnv* env, jobject thiz, jstring inputPath, jintArray pages, jstring outputPath);
+jboolean Java_com_example_smart_1pdf_SpdfcorePlugin_nativeExtractPage(JNIEnv* env, jobject thiz, jstring inputPath, jint pageNumber, jstring outputPath);
+jboolean Java_com_example_smart_1pdf_SpdfcorePlugin_nativeSplitAtPage(JNIEnv* env, jobject thiz, jstring inputPath, jint splitPage, jstring outputPrefix);
+jstring Java_com_example_smart_1pdf_SpdfcorePlugin_nativeGetVersion(JNIEnv* env, jobject thiz);
+jboolean Java_com_example_smart_1pdf_SpdfcorePlugin_nativeConfigureResultCache(JNIEnv* env, jobject thiz, jstring cacheDir, jlong maxBytes);
+jboolean Java_com_example_smart_1pdf_SpdfcorePlugin_nativeConfigureMemoryBudget(JNIEnv* env, jobject thiz, jstring spillDir, jlong maxBytes);
+jstring Java_com_example_smart_1pdf_SpdfcorePlugin_nativeMemoryBudgetStats(JNIEnv* env, jobject thiz);
+jstring Java_com_example_smart_1pdf_SpdfcorePlugin_nativeExtractText(JNIEnv* env, jobject thiz, jstring filePath, jint pageNumber);
+jboolean Java_com_example_smart_1pdf_SpdfcorePlugin_nativeConfigureSearchIndex(JNIEnv* env, jobject thiz, jstring indexFile);
+jstring Java_com_example_smart_1pdf_SpdfcorePlugin_nativeSearchText(JNIEnv* env, jobject thiz, jobjectArray filePaths, jstring query, jint limit);
+jint Java_com_example_smart_1pdf_SpdfcorePlugin_nativeIsPasswordProtected(JNIEnv* env, jobject thiz, jstring filePath);
+jint Java_com_example_smart_1pdf_SpdfcorePlugin_nativeLockPdf(JNIEnv* env, jobject thiz, jstring inputPath, jstring password, jstring outputPath, jboolean linearize, jboolean objectStreams);
+jint Java_com_example_smart_1pdf_SpdfcorePlugin_nativeUnlockPdf(JNIEnv* env, jobject thiz, jstring inputPath, jstring password, jstring outputPath, jboolean linearize, jboolean objectStreams);
+jint Java_com_example_smart_1pdf_SpdfcorePlugin_nativeMergeFilesParallel(JNIEnv* env, jobject thiz, jobjectArray inputPaths, jstring outputPath);
+jint Java_com_example_smart_1pdf_SpdfcorePlugin_nativeRepairPdf(JNIEnv* env, jobject thiz, jstring inputPath, jstring outputPath);
+jint Java_com_example_smart_1pdf_SpdfcorePlugin_nativeRewritePdf(JNIEnv* env, jobject thiz, jstring inputPath, jstring outputPath, jboolean linearize, jboolean objectStreams, jboolean prune, jboolean subsetFonts);
+jint Java_com_example_smart_1pdf_SpdfcorePlugin_nativeEditPages(JNIEnv* env, jobject thiz, jstring inputPath, jstring outputPath, jstring script);
+jint Java_com_example_smart_1pdf_SpdfcorePlugin_nativeCompressPdf(JNIEnv* env, jobject thiz, jstring inputPath, jstring outputPath, jint targetDpi);
+jstring Java_com_example_smart_1pdf_SpdfcorePlugin_nativeEstimateCompression(JNIEnv* env, jobject thiz, jstring inputPath, jintArray targetDpis);
+jlong Java_com_example_smart_1pdf_SpdfcorePlugin_nativeEstimateMergeSize(JNIEnv* env, jobject thiz, jobjectArray inputPaths);
+jlong Java_com_example_smart_1pdf_SpdfcorePlugin_nativeOpenMergeSession(JNIEnv* env, jobject thiz, jlong maxBytes);
+jint Java_com_example_smart_1pdf_SpdfcorePlugin_nativeSessionMerge(JNIEnv* env, jobject thiz, jlong session, jobjectArray inputPaths, jstring outputPath);
+void Java_com_example_smart_1pdf_SpdfcorePlugin_nativeCloseMergeSession(JNIEnv* env, jobject thiz, jlong session);
+jint Java_com_example_smart_1pdf_SpdfcorePlugin_nativeAssembleDocuments(JNIEnv* env, jobject thiz, jstring plan);
+jstring Java_com_example_smart_1pdf_SpdfcorePlugin_nativeFindDuplicatePages(JNIEnv* env, jobject thiz, jobjectArray inputPaths, jdouble similarity);
+jint Java_com_example_smart_1pdf_SpdfcorePlugin_nativeMergeWithoutDuplicates(JNIEnv* env, jobject thiz, jobjectArray inputPaths, jstring outputPath, jdouble similarity);
+jint Java_com_example_smart_1pdf_SpdfcorePlugin_nativeFillForms(JNIEnv* env, jobject thiz, jstring templatePath, jstring csv, jstring outputPattern);
+}
+
+// ---------------------------------------------------------------------------
+// Fake JNIEnv
+
+struct HostString : _jstring {
+    std::string value;
+};
+
+struct HostObjectArray : _jobjectArray {
+    std::vector<jobject> elements;
+};
+
+struct HostIntArray : _jintArray {
+    std::vector<jint> elements;
+};
+
+// One per thread; owns every object created through it until reset()
+struct HostEnv : _JNIEnv {
+    std::vector<std::shared_ptr<void>> objects;
+    std::unordered_set<jarray> int_arrays;
+    long outstanding_utf_chars = 0;
+    long local_refs_deleted = 0;
+
+    HostEnv();
+
+    template <typename T>
+    T* make() {
+        auto object = std::make_shared<T>();
+        objects.push_back(object);
+        return object.get();
+    }
+
+    jstring string(const std::string& value) {
+        HostString* str = make<HostString>();
+        str->value = value;
+        return str;
+    }
+
+    jobjectArray string_array(const std::vector<std::string>& values) {
+        HostObjectArray* array = make<HostObjectArray>();
+        for (const auto& value : values) {
+            array->elements.push_back(string(value));
+        }
+        return array;
+    }
+
+    void reset() {
+        objects.clear();
+        int_arrays.clear();
+    }
+};
+
+static HostEnv* host(JNIEnv* env) {
+    return static_cast<HostEnv*>(env);
+}
+
+static const JNINativeInterface host_interface = {
+    nullptr,
+    /* GetArrayLength */
+    [](JNIEnv* env, jarray array) -> jsize {
+        if (host(env)->int_arrays.count(array)) {
+            return (jsize) static_cast<HostIntArray*>(array)->elements.size();
+        }
+        return (jsize) static_cast<HostObjectArray*>(array)->elements.size();
+    },
+    /* GetObjectArrayElement */
+    [](JNIEnv*, jobjectArray array, jsize index) -> jobject {
+        return static_cast<HostObjectArray*>(array)->elements.at(index);
+    },
+    /* NewObjectArray */
+    [](JNIEnv* env, jsize length, jclass, jobject initial) -> jobjectArray {
+        HostObjectArray* array = host(env)->make<HostObjectArray>();
+        array->elements.assign(length, initial);
+        return array;
+    },
+    /* SetObjectArrayElement */
+    [](JNIEnv*, jobjectArray array, jsize index, jobject value) {
+        static_cast<HostObjectArray*>(array)->elements.at(index) = value;
+    },
+    /* NewStringUTF */
+    [](JNIEnv* env, const char* bytes) -> jstring { return host(env)->string(bytes ? bytes : ""); },
+    /* GetStringUTFLength */
+    [](JNIEnv*, jstring str) -> jsize { return (jsize) static_cast<HostString*>(str)->value.size(); },
+    /* GetStringUTFChars */
+    [](JNIEnv* env, jstring str, jboolean* is_copy) -> const char* {
+        if (is_copy) {
+            *is_copy = JNI_TRUE;
+        }
+        host(env)->outstanding_utf_chars++;
+        return strdup(static_cast<HostString*>(str)->value.c_str());
+    },
+    /* ReleaseStringUTFChars */
+    [](JNIEnv* env, jstring, const char* utf) {
+        host(env)->outstanding_utf_chars--;
+        free(const_cast<char*>(utf));
+    },
+    /* NewIntArray */
+    [](JNIEnv* env, jsize length) -> jintArray {
+        HostIntArray* array = host(env)->make<HostIntArray>();
+        array->elements.assign(length, 0);
+        host(env)->int_arrays.insert(array);
+        return array;
+    },
+    /* GetIntArrayRegion */
+    [](JNIEnv*, jintArray array, jsize start, jsize len, jint* buf) {
+        const auto& elements = static_cast<HostIntArray*>(array)->elements;
+        std::copy(elements.begin() + start, elements.begin() + start + len, buf);
+    },
+    /* SetIntArrayRegion */
+    [](JNIEnv*, jintArray array, jsize start, jsize len, const jint* buf) {
+        std::copy(buf, buf + len, static_cast<HostIntArray*>(array)->elements.begin() + start);
+    },
+    /* FindClass */
+    [](JNIEnv* env, const char*) -> jclass { return host(env)->make<_jclass>(); },
+    /* DeleteLocalRef */
+    [](JNIEnv* env, jobject) { host(env)->local_refs_deleted++; },
+    /* ExceptionCheck */
+    [](JNIEnv*) -> jboolean { return JNI_FALSE; },
+};
+
+HostEnv::HostEnv() {
+    functions = &host_interface;
+}
+
+// ---------------------------------------------------------------------------
+// Benchmark driver
+
+struct Options {
+    int iterations = 200;
+    int threads = 1;
+    int pages = 8;
+    std::string workdir;
+    bool verbose = false;
+};
+
+struct Context {
+    Options options;
+    std::string fixture_a;
+    std::string fixture_b;
+    std::string broken;
+    std::string form;
+    uint64_t fixture_a_size = 0;
+};
+
+struct Scenario {
+    const char* name;
+    // Returns true when the call produced the expected result
+    std::function<bool(HostEnv&, const Context&, int thread, int iteration)> run;
+};
+
+struct Timing {
+    std::vector<double> samples_ns;
+    std::atomic<long> failures{0};
+};
+
+static std::string output_path(const Context& ctx, const char* tag, int thread) {
+    return ctx.options.workdir + "/" + tag + "_t" + std::to_string(thread) + ".pdf";
+}
+
+static std::string file_contents(const std::string& path) {
+    std::ifstream file(path, std::ios::binary);
+    return std::string(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+}
+
+static std::vector<Scenario> jni_scenarios() {
+    return {
+        {"nativeInit", [](HostEnv& env, const Context&, int, int) {
+             return Java_com_example_smart_1pdf_SpdfcorePlugin_nativeInit(&env, nullptr) == JNI_TRUE;
+         }},
+        {"nativeGetVersion", [](HostEnv& env, const Context&, int, int) {
+             jstring version = Java_com_example_smart_1pdf_SpdfcorePlugin_nativeGetVersion(&env, nullptr);
+             return version && !static_cast<HostString*>(version)->value.empty();
+         }},
+        {"nativeGetPageCount", [](HostEnv& env, const Context& ctx, int, int) {
+             return Java_com_example_smart_1pdf_SpdfcorePlugin_nativeGetPageCount(&env, nullptr, env.string(ctx.fixture_a)) ==
+                    ctx.options.pages;
+         }},
+        {"nativeGetFileSize", [](HostEnv& env, const Context& ctx, int, int) {
+             return Java_com_example_smart_1pdf_SpdfcorePlugin_nativeGetFileSize(&env, nullptr, env.string(ctx.fixture_a)) ==
+                    (jlong)ctx.fixture_a_size;
+         }},
+        {"nativeValidateFile", [](HostEnv& env, const Context& ctx, int, int iteration) {
+             // Alternate valid and broken inputs so both verdicts are exercised
+             bool expect_valid = iteration % 2 == 0;
+             jstring path = env.string(expect_valid ? ctx.fixture_a : ctx.broken);
+             return (Java_com_example_smart_1pdf_SpdfcorePlugin_nativeValidateFile(&env, nullptr, path) == JNI_TRUE) ==
+                    expect_valid;
+         }},
+        {"nativeMergeFiles", [](HostEnv& env, const Context& ctx, int thread, int) {
+             std::string out = output_path(ctx, "merge", thread);
+             jboolean ok = Java_com_example_smart_1pdf_SpdfcorePlugin_nativeMergeFiles(
+                 &env, nullptr, env.string_array({ctx.fixture_a, ctx.fixture_b}), env.string(out));
+             return ok == JNI_TRUE &&
+                    Java_com_example_smart_1pdf_SpdfcorePlugin_nativeGetPageCount(&env, nullptr, env.string(out)) ==
+                        ctx.options.pages * 2;
+         }},
+        {"nativeMergeFilesParallel", [](HostEnv& env, const Context& ctx, int thread, int iteration) {
+             // Pages of the second input follow those of the first; check a different one each time
+             std::string out = output_path(ctx, "merge_parallel", thread);
+             if (Java_com_example_smart_1pdf_SpdfcorePlugin_nativeMergeFilesParallel(
+                     &env, nullptr, env.string_array({ctx.fixture_a, ctx.fixture_b}), env.string(out)) != 0) {
+                 return false;
+             }
+             jint page = 1 + iteration % ctx.options.pages;
+             jstring text = Java_com_example_smart_1pdf_SpdfcorePlugin_nativeExtractText(
+                 &env, nullptr, env.string(out), ctx.options.pages + page);
+             return Java_com_example_smart_1pdf_SpdfcorePlugin_nativeGetPageCount(&env, nullptr, env.string(out)) ==
+                        ctx.options.pages * 2 &&
+                    text && static_cast<HostString*>(text)->value == "Page " + std::to_string(page) + " of fixture";
+         }},
+        {"nativeSplitByPages", [](HostEnv& env, const Context& ctx, int thread, int iteration) {
+             // Keeps the first page and one that moves with the iteration, in that order
+             std::string out = output_path(ctx, "split_pages", thread);
+             const jint pages[] = {1, 1 + iteration % ctx.options.pages};
+             jintArray array = env.NewIntArray(2);
+             env.SetIntArrayRegion(array, 0, 2, pages);
+             return Java_com_example_smart_1pdf_SpdfcorePlugin_nativeSplitByPages(
+                        &env, nullptr, env.string(ctx.fixture_a), array, env.string(out)) == JNI_TRUE &&
+                    Java_com_example_smart_1pdf_SpdfcorePlugin_nativeGetPageCount(&env, nullptr, env.string(out)) == 2;
+         }},
+        {"nativeExtractPage", [](HostEnv& env, const Context& ctx, int thread, int iteration) {
+             jint page = 1 + iteration % ctx.options.pages;
+             return Java_com_example_smart_1pdf_SpdfcorePlugin_nativeExtractPage(
+                        &env, nullptr, env.string(ctx.fixture_a), page, env.string(output_path(ctx, "extract", thread))) ==
+                    JNI_TRUE;
+         }},
+        {"nativeSplitAtPage", [](HostEnv& env, const Context& ctx, int thread, int) {
+             std::string prefix = ctx.options.workdir + "/split_t" + std::to_string(thread);
+             return Java_com_example_smart_1pdf_SpdfcorePlugin_nativeSplitAtPage(
+                        &env, nullptr, env.string(ctx.fixture_a), ctx.options.pages / 2, env.string(prefix)) == JNI_TRUE;
+         }},
+        {"nativeExtractText", [](HostEnv& env, const Context& ctx, int, int iteration) {
+             jint page = 1 + iteration % ctx.options.pages;
+             jstring text = Java_com_example_smart_1pdf_SpdfcorePlugin_nativeExtractText(
+                 &env, nullptr, env.string(ctx.fixture_a), page);
+             return text && static_cast<HostString*>(text)->value == "Page " + std::to_string(page) + " of fixture";
+         }},
+        {"nativeSearchText", [](HostEnv& env, const Context& ctx, int, int iteration) {
+             // Both fixtures have the same text; the first call indexes them, the rest are index lookups
+             jint page = 1 + iteration % ctx.options.pages;
+             jstring hits = Java_com_example_smart_1pdf_SpdfcorePlugin_nativeSearchText(
+                 &env, nullptr, env.string_array({ctx.fixture_a, ctx.fixture_b}),
+                 env.string("fixture " + std::to_string(page)), 10);
+             return hits && static_cast<HostString*>(hits)->value.find("\"page\":" + std::to_string(page) + ",") !=
+                                std::string::npos;
+         }},
+        {"nativeIsPasswordProtected", [](HostEnv& env, const Context& ctx, int, int) {
+             return Java_com_example_smart_1pdf_SpdfcorePlugin_nativeIsPasswordProtected(
+                        &env, nullptr, env.string(ctx.fixture_a)) == 0;
+         }},
+        {"nativeLockPdf", [](HostEnv& env, const Context& ctx, int thread, int iteration) {
+             // Odd iterations encrypt into object streams
+             std::string out = output_path(ctx, "locked", thread);
+             return Java_com_example_smart_1pdf_SpdfcorePlugin_nativeLockPdf(
+                        &env, nullptr, env.string(ctx.fixture_a), env.string("secret"), env.string(out), JNI_FALSE,
+                        iteration % 2 == 1 ? JNI_TRUE : JNI_FALSE) == 0 &&
+                    Java_com_example_smart_1pdf_SpdfcorePlugin_nativeIsPasswordProtected(&env, nullptr, env.string(out)) == 1;
+         }},
+        {"nativeUnlockPdf", [](HostEnv& env, const Context& ctx, int thread, int iteration) {
+             // Unlocks the output of nativeLockPdf; odd iterations use a wrong password and must be refused
+             std::string out = output_path(ctx, "unlocked", thread);
+             bool wrong = iteration % 2 == 1;
+             jint code = Java_com_example_smart_1pdf_SpdfcorePlugin_nativeUnlockPdf(
+                 &env, nullptr, env.string(output_path(ctx, "locked", thread)), env.string(wrong ? "guess" : "secret"),
+                 env.string(out), JNI_FALSE, JNI_FALSE);
+             if (wrong) {
+                 return code == 3;
+             }
+             jstring text = Java_com_example_smart_1pdf_SpdfcorePlugin_nativeExtractText(&env, nullptr, env.string(out), 1);
+             return code == 0 && text && static_cast<HostString*>(text)->value == "Page 1 of fixture";
+         }},
+        {"nativeRewritePdf", [](HostEnv& env, const Context& ctx, int thread, int iteration) {
+             // Alternates the linearized layout and object streams, pruning and subsetting fonts every third
+             // time; every page must survive, check a different one each time
+             std::string out = output_path(ctx, "rewritten", thread);
+             jint page = 1 + iteration % ctx.options.pages;
+             bool linearize = iteration % 2 == 0;
+             jboolean trim = iteration % 3 == 0 ? JNI_TRUE : JNI_FALSE;
+             if (Java_com_example_smart_1pdf_SpdfcorePlugin_nativeRewritePdf(
+                     &env, nullptr, env.string(ctx.fixture_a), env.string(out), linearize ? JNI_TRUE : JNI_FALSE,
+                     linearize ? JNI_FALSE : JNI_TRUE, trim, trim) != 0) {
+                 return false;
+             }
+             jstring text = Java_com_example_smart_1pdf_SpdfcorePlugin_nativeExtractText(&env, nullptr, env.string(out), page);
+             return text && static_cast<HostString*>(text)->value == "Page " + std::to_string(page) + " of fixture";
+         }},
+        {"nativeRepairPdf", [](HostEnv& env, const Context& ctx, int thread, int) {
+             // The truncated fixture the core rejects must come back valid, with its first page intact
+             std::string out = output_path(ctx, "repaired", thread);
+             if (Java_com_example_smart_1pdf_SpdfcorePlugin_nativeRepairPdf(&env, nullptr, env.string(ctx.broken),
+                                                                           env.string(out)) != 0) {
+                 return false;
+             }
+             jstring text = Java_com_example_smart_1pdf_SpdfcorePlugin_nativeExtractText(&env, nullptr, env.string(out), 1);
+             return Java_com_example_smart_1pdf_SpdfcorePlugin_nativeValidateFile(&env, nullptr, env.string(out)) ==
+                        JNI_TRUE &&
+                    text && static_cast<HostString*>(text)->value == "Page 1 of fixture";
+         }},
+        {"nativeEditPages", [](HostEnv& env, const Context& ctx, int thread, int iteration) {
+             // Moves a different page to the front each time, turns it and drops the last page
+             std::string out = output_path(ctx, "edited", thread);
+             jint page = 1 + iteration % (ctx.options.pages - 1);
+             std::string script = "order " + std::to_string(page) + "; rotate 90 " + std::to_string(page) +
+                                  "; delete " + std::to_string(ctx.options.pages);
+             if (Java_com_example_smart_1pdf_SpdfcorePlugin_nativeEditPages(
+                     &env, nullptr, env.string(ctx.fixture_a), env.string(out), env.string(script)) != 0) {
+                 return false;
+             }
+             jstring first = Java_com_example_smart_1pdf_SpdfcorePlugin_nativeExtractText(&env, nullptr, env.string(out), 1);
+             jstring removed = Java_com_example_smart_1pdf_SpdfcorePlugin_nativeExtractText(
+                 &env, nullptr, env.string(out), ctx.options.pages);
+             return first && static_cast<HostString*>(first)->value == "Page " + std::to_string(page) + " of fixture" &&
+                    !removed;
+         }},
+        {"nativeCompressPdf", [](HostEnv& env, const Context& ctx, int thread, int iteration) {
+             // The fixture has no images, so the pages must come through as they were
+             std::string out = output_path(ctx, "compressed", thread);
+             jint page = 1 + iteration % ctx.options.pages;
+             if (Java_com_example_smart_1pdf_SpdfcorePlugin_nativeCompressPdf(
+                     &env, nullptr, env.string(ctx.fixture_a), env.string(out), 150) != 0) {
+                 return false;
+             }
+             jstring text = Java_com_example_smart_1pdf_SpdfcorePlugin_nativeExtractText(&env, nullptr, env.string(out), page);
+             return text && static_cast<HostString*>(text)->value == "Page " + std::to_string(page) + " of fixture";
+         }},
+        {"nativeEstimateCompression", [](HostEnv& env, const Context& ctx, int thread, int) {
+             // Without images every resolution predicts the exact size nativeCompressPdf writes
+             std::string out = output_path(ctx, "estimated", thread);
+             const jint dpis[] = {72, 150};
+             jintArray array = env.NewIntArray(2);
+             env.SetIntArrayRegion(array, 0, 2, dpis);
+             jstring estimates = Java_com_example_smart_1pdf_SpdfcorePlugin_nativeEstimateCompression(
+                 &env, nullptr, env.string(ctx.fixture_a), array);
+             if (!estimates || Java_com_example_smart_1pdf_SpdfcorePlugin_nativeCompressPdf(
+                                   &env, nullptr, env.string(ctx.fixture_a), env.string(out), 150) != 0) {
+                 return false;
+             }
+             std::string bytes = "\"bytes\":" + std::to_string(Java_com_example_smart_1pdf_SpdfcorePlugin_nativeGetFileSize(
+                                                     &env, nullptr, env.string(out))) + ",";
+             const std::string& json = static_cast<HostString*>(estimates)->value;
+             size_t first = json.find(bytes);
+             return first != std::string::npos && json.find(bytes, first + 1) != std::string::npos;
+         }},
+        {"nativeEstimateMergeSize", [](HostEnv& env, const Context& ctx, int thread, int) {
+             // The estimate is the first pass of the parallel merge, so it must match its output exactly
+             std::string out = output_path(ctx, "merge_estimated", thread);
+             jlong size = Java_com_example_smart_1pdf_SpdfcorePlugin_nativeEstimateMergeSize(
+                 &env, nullptr, env.string_array({ctx.fixture_a, ctx.fixture_b}));
+             return size > 0 &&
+                    Java_com_example_smart_1pdf_SpdfcorePlugin_nativeMergeFilesParallel(
+                        &env, nullptr, env.string_array({ctx.fixture_a, ctx.fixture_b}), env.string(out)) == 0 &&
+                    Java_com_example_smart_1pdf_SpdfcorePlugin_nativeGetFileSize(&env, nullptr, env.string(out)) == size;
+         }},
+        {"nativeSessionMerge", [](HostEnv& env, const Context& ctx, int thread, int iteration) {
+             // One session for every thread. Each thread's cover is rewritten with a different page count
+             // every fourth time, which must be noticed; the rest of the time both inputs come from the session.
+             static jlong session = Java_com_example_smart_1pdf_SpdfcorePlugin_nativeOpenMergeSession(&env, nullptr, 0);
+             std::string cover = ctx.options.workdir + "/cover_t" + std::to_string(thread) + ".pdf";
+             std::string out = output_path(ctx, "session_merge", thread);
+             int cover_pages = 1 + (iteration / 4) % 3;
+             if (iteration % 4 == 0 && !write_fixture_pdf(cover, cover_pages)) {
+                 return false;
+             }
+             jint page = 1 + iteration % ctx.options.pages;
+             if (Java_com_example_smart_1pdf_SpdfcorePlugin_nativeSessionMerge(
+                     &env, nullptr, session, env.string_array({cover, ctx.fixture_b}), env.string(out)) != 0) {
+                 return false;
+             }
+             jstring text = Java_com_example_smart_1pdf_SpdfcorePlugin_nativeExtractText(
+                 &env, nullptr, env.string(out), cover_pages + page);
+             return Java_com_example_smart_1pdf_SpdfcorePlugin_nativeGetPageCount(&env, nullptr, env.string(out)) ==
+                        cover_pages + ctx.options.pages &&
+                    text && static_cast<HostString*>(text)->value == "Page " + std::to_string(page) + " of fixture";
+         }},
+        {"nativeAssembleDocuments", [](HostEnv& env, const Context& ctx, int thread, int iteration) {
+             // Two outputs from pages of both fixtures; a different page leads the first each time
+             std::string first = output_path(ctx, "assembled_a", thread);
+             std::string second = output_path(ctx, "assembled_b", thread);
+             int page = 1 + iteration % ctx.options.pages;
+             std::string plan = "\"" + first + "\" \"" + ctx.fixture_a + ":" + std::to_string(page) + ",1\" \"" +
+                                ctx.fixture_b + ":3\"\n\"" + second + "\" \"" + ctx.fixture_b + "\"\n";
+             if (Java_com_example_smart_1pdf_SpdfcorePlugin_nativeAssembleDocuments(&env, nullptr, env.string(plan)) != 0) {
+                 return false;
+             }
+             jstring lead = Java_com_example_smart_1pdf_SpdfcorePlugin_nativeExtractText(&env, nullptr, env.string(first), 1);
+             jstring last = Java_com_example_smart_1pdf_SpdfcorePlugin_nativeExtractText(&env, nullptr, env.string(first), 3);
+             return Java_com_example_smart_1pdf_SpdfcorePlugin_nativeGetPageCount(&env, nullptr, env.string(first)) == 3 &&
+                    Java_com_example_smart_1pdf_SpdfcorePlugin_nativeGetPageCount(&env, nullptr, env.string(second)) ==
+                        ctx.options.pages &&
+                    lead && static_cast<HostString*>(lead)->value == "Page " + std::to_string(page) + " of fixture" &&
+                    last && static_cast<HostString*>(last)->value == "Page 3 of fixture";
+         }},
+        {"nativeFindDuplicatePages", [](HostEnv& env, const Context& ctx, int, int) {
+             // The fixtures are written alike, so every page of b repeats the same page of a
+             jobjectArray inputs = env.string_array({ctx.fixture_a, ctx.fixture_b});
+             jstring groups = Java_com_example_smart_1pdf_SpdfcorePlugin_nativeFindDuplicatePages(&env, nullptr, inputs, 1.0);
+             if (!groups) {
+                 return false;
+             }
+             const std::string& json = static_cast<HostString*>(groups)->value;
+             size_t count = 0;
+             for (size_t at = json.find("[{"); at != std::string::npos; at = json.find("[{", at + 1)) {
+                 count++;
+             }
+             std::string first = "[[{\"input\":0,\"page\":1},{\"input\":1,\"page\":1}]";
+             return count == (size_t)ctx.options.pages && json.compare(0, first.size(), first) == 0;
+         }},
+        {"nativeMergeWithoutDuplicates", [](HostEnv& env, const Context& ctx, int thread, int) {
+             std::string output = output_path(ctx, "deduplicated", thread);
+             jobjectArray inputs = env.string_array({ctx.fixture_a, ctx.fixture_b, ctx.fixture_a});
+             return Java_com_example_smart_1pdf_SpdfcorePlugin_nativeMergeWithoutDuplicates(
+                        &env, nullptr, inputs, env.string(output), 1.0) == 0 &&
+                    Java_com_example_smart_1pdf_SpdfcorePlugin_nativeGetPageCount(&env, nullptr, env.string(output)) ==
+                        ctx.options.pages;
+         }},
+        {"nativeFillForms", [](HostEnv& env, const Context& ctx, int thread, int iteration) {
+             // Each copy is the template's bytes followed by an update carrying its row's values
+             std::string prefix = ctx.options.workdir + "/form_t" + std::to_string(thread) + "_";
+             std::string csv = "name,agree\n";
+             for (int row = 1; row <= 3; row++) {
+                 csv += "Row " + std::to_string(iteration * 3 + row) + (row % 2 ? ",yes\n" : ",no\n");
+             }
+             if (Java_com_example_smart_1pdf_SpdfcorePlugin_nativeFillForms(
+                     &env, nullptr, env.string(ctx.form), env.string(csv), env.string(prefix + "{row}.pdf")) != 0) {
+                 return false;
+             }
+             std::string form = file_contents(ctx.form);
+             for (int row = 1; row <= 3; row++) {
+                 std::string data = file_contents(prefix + std::to_string(row) + ".pdf");
+                 if (data.compare(0, form.size(), form) != 0 ||
+                     data.find("/V (Row " + std::to_string(iteration * 3 + row) + ")", form.size()) == std::string::npos ||
+                     data.find(row % 2 ? "/AS /Yes" : "/AS /Off", form.size()) == std::string::npos) {
+                     return false;
+                 }
+             }
+             return Java_com_example_smart_1pdf_SpdfcorePlugin_nativeValidateFile(&env, nullptr,
+                                                                                 env.string(prefix + "1.pdf")) == JNI_TRUE;
+         }},
+    };
+}
+
+// Write operations rerun with the result cache on; after the first call per thread every call is a hit
+static std::vector<Scenario> cached_scenarios() {
+    std::vector<Scenario> cached;
+    static const std::pair<const char*, const char*> labels[] = {
+        {"nativeMergeFiles", "nativeMergeFiles (cached)"},
+        {"nativeExtractPage", "nativeExtractPage (cached)"},
+        {"nativeSplitAtPage", "nativeSplitAtPage (cached)"},
+    };
+    for (auto& scenario : jni_scenarios()) {
+        for (const auto& label : labels) {
+            if (strcmp(scenario.name, label.first) == 0) {
+                scenario.name = label.second;
+                cached.push_back(scenario);
+            }
+        }
+    }
+    return cached;
+}
+
+// Same operations through the C ABI with no JNI marshalling, for comparison
+static std::vector<Scenario> direct_scenarios(void* ffi) {
+    auto page_count = (decltype(&pdf_get_page_count))dlsym(ffi, "pdf_get_page_count");
+    auto validate = (decltype(&pdf_validate))dlsym(ffi, "pdf_validate");
+    auto merge = (decltype(&pdf_merge_files))dlsym(ffi, "pdf_merge_files");
+    auto free_string = (decltype(&free_c_string))dlsym(ffi, "free_c_string");
+    if (!page_count || !validate || !merge || !free_string) {
+        return {};
+    }
+    return {
+        {"direct pdf_get_page_count", [=](HostEnv&, const Context& ctx, int, int) {
+             int32_t pages = 0;
+             PdfErrorCode code = PdfErrorCode_Success;
+             char* message = nullptr;
+             bool ok = page_count(ctx.fixture_a.c_str(), &pages, &code, &message);
+             free_string(message);
+             return ok && pages == ctx.options.pages;
+         }},
+        {"direct pdf_validate", [=](HostEnv&, const Context& ctx, int, int) {
+             bool valid = false;
+             PdfErrorCode code = PdfErrorCode_Success;
+             char* message = nullptr;
+             bool ok = validate(ctx.fixture_a.c_str(), &valid, &code, &message);
+             free_string(message);
+             return ok && valid;
+         }},
+        {"direct pdf_merge_files", [=](HostEnv&, const Context& ctx, int thread, int) {
+             std::string out = output_path(ctx, "direct_merge", thread);
+             const char* inputs[] = {ctx.fixture_a.c_str(), ctx.fixture_b.c_str()};
+             PdfErrorCode code = PdfErrorCode_Success;
+             char* message = nullptr;
+             bool ok = merge(inputs, 2, out.c_str(), &code, &message);
+             free_string(message);
+             return ok;
+         }},
+    };
+}
+
+static double percentile(std::vector<double>& samples, double p) {
+    if (samples.empty()) {
+        return 0;
+    }
+    size_t index = std::min(samples.size() - 1, (size_t)(p * (samples.size() - 1) + 0.5));
+    std::nth_element(samples.begin(), samples.begin() + index, samples.end());
+    return samples[index];
+}
+
+// Runs a scenario on every thread and prints one result row; returns false on failures or leaks
+static bool run_scenario(const Scenario& scenario, const Context& ctx) {
+    int threads = ctx.options.threads;
+    std::vector<std::vector<double>> samples(threads);
+    std::atomic<long> failures{0};
+    std::atomic<long> leaked{0};
+
+    auto wall_start = std::chrono::steady_clock::now();
+    std::vector<std::thread> workers;
+    for (int t = 0; t < threads; t++) {
+        workers.emplace_back([&, t]() {
+            HostEnv env;
+            samples[t].reserve(ctx.options.iterations);
+            for (int i = 0; i < ctx.options.iterations; i++) {
+                auto start = std::chrono::steady_clock::now();
+                bool ok = scenario.run(env, ctx, t, i);
+                auto end = std::chrono::steady_clock::now();
+                samples[t].push_back(std::chrono::duration<double, std::nano>(end - start).count());
+                if (!ok) {
+                    failures++;
+                }
+                env.reset();
+            }
+            leaked += env.outstanding_utf_chars;
+        });
+    }
+    for (auto& worker : workers) {
+        worker.join();
+    }
+    double wall_s = std::chrono::duration<double>(std::chrono::steady_clock::now() - wall_start).count();
+
+    std::vector<double> all;
+    for (auto& s : samples) {
+        all.insert(all.end(), s.begin(), s.end());
+    }
+    double mean = 0;
+    for (double v : all) {
+        mean += v;
+    }
+    mean = all.empty() ? 0 : mean / all.size();
+    double p50 = percentile(all, 0.50);
+    double p99 = percentile(all, 0.99);
+
+    printf("%-28s %10.1f %10.1f %10.1f %12.0f %8ld %6ld\n", scenario.name, mean / 1000, p50 / 1000, p99 / 1000,
+           all.size() / wall_s, failures.load(), leaked.load());
+    return failures == 0 && leaked == 0;
+}
+
+static void usage(const char* argv0) {
+    fprintf(stderr,
+            "Usage: %s [--iterations N] [--threads N] [--pages N] [--workdir DIR] [--verbose]\n"
+            "Drives every SpdfcorePlugin JNI entry point through a JVM-free JNIEnv.\n",
+            argv0);
+}
+
+int main(int argc, char** argv) {
+    Context ctx;
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        auto next = [&]() -> const char* {
+            if (i + 1 >= argc) {
+                usage(argv[0]);
+                exit(2);
+            }
+            return argv[++i];
+        };
+        if (arg == "--iterations") {
+            ctx.options.iterations = atoi(next());
+        } else if (arg == "--threads") {
+            ctx.options.threads = std::max(1, atoi(next()));
+        } else if (arg == "--pages") {
+            ctx.options.pages = std::max(2, atoi(next()));
+        } else if (arg == "--workdir") {
+            ctx.options.workdir = next();
+        } else if (arg == "--verbose") {
+            ctx.options.verbose = true;
+        } else {
+            usage(argv[0]);
+            return 2;
+        }
+    }
+
+    // The JNI layer logs every parameter; keep stderr quiet unless asked so timings reflect marshalling
+    if (!ctx.options.verbose) {
+        __android_log_set_minimum_priority(ANDROID_LOG_WARN);
+    }
+
+    bool own_workdir = ctx.options.workdir.empty();
+    if (own_workdir) {
+        char tmpl[] = "/tmp/spdfcore_harness_XXXXXX";
+        if (!mkdtemp(tmpl)) {
+            perror("mkdtemp");
+            return 1;
+        }
+        ctx.options.workdir = tmpl;
+    }
+    ctx.fixture_a = ctx.options.workdir + "/fixture_a.pdf";
+    ctx.fixture_b = ctx.options.workdir + "/fixture_b.pdf";
+    ctx.broken = ctx.options.workdir + "/broken.pdf";
+    ctx.form = ctx.options.workdir + "/form.pdf";
+    if (!write_fixture_pdf(ctx.fixture_a, ctx.options.pages) || !write_fixture_pdf(ctx.fixture_b, ctx.options.pages) ||
+        !write_pdf(ctx.form, build_form_fixture_pdf())) {
+        fprintf(stderr, "cannot write fixtures to %s\n", ctx.options.workdir.c_str());
+        return 1;
+    }
+    FILE* broken = fopen(ctx.broken.c_str(), "wb");
+    if (broken) {
+        // Truncated download: header present, trailer missing
+        std::string data = build_fixture_pdf(ctx.options.pages);
+        fwrite(data.data(), 1, data.size() / 2, broken);
+        fclose(broken);
+    }
+    struct stat st;
+    stat(ctx.fixture_a.c_str(), &st);
+    ctx.fixture_a_size = (uint64_t)st.st_size;
+
+    printf("spdfcore JNI harness: %d iterations x %d threads, %d-page fixtures in %s\n", ctx.options.iterations,
+           ctx.options.threads, ctx.options.pages, ctx.options.workdir.c_str());
+    printf("%-28s %10s %10s %10s %12s %8s %6s\n", "entry point", "mean us", "p50 us", "p99 us", "calls/s", "fails",
+           "leaks");
+
+    bool ok = true;
+    {
+        HostEnv env;
+        Java_com_example_smart_1pdf_SpdfcorePlugin_nativeConfigureSearchIndex(
+            &env, nullptr, env.string(ctx.options.workdir + "/search.idx"));
+    }
+    for (const auto& scenario : jni_scenarios()) {
+        ok = run_scenario(scenario, ctx) && ok;
+    }
+
+    {
+        HostEnv env;
+        std::string cache_dir = ctx.options.workdir + "/result_cache";
+        bool configured = Java_com_example_smart_1pdf_SpdfcorePlugin_nativeConfigureResultCache(
+                              &env, nullptr, env.string(cache_dir), 64ll << 20) == JNI_TRUE;
+        printf("%-28s %s\n", "nativeConfigureResultCache", configured ? "ok" : "FAILED");
+        ok = configured && ok;
+        for (const auto& scenario : cached_scenarios()) {
+            ok = run_scenario(scenario, ctx) && ok;
+        }
+        // Leave the remaining scenarios uncached
+        Java_com_example_smart_1pdf_SpdfcorePlugin_nativeConfigureResultCache(&env, nullptr, env.string(cache_dir), 0);
+    }
+
+    {
+        // The merges again, with a budget smaller than two fixtures so they wait and spill
+        HostEnv env;
+        std::string spill_dir = ctx.options.workdir + "/spill";
+        mkdir(spill_dir.c_str(), 0755);
+        bool configured = Java_com_example_smart_1pdf_SpdfcorePlugin_nativeConfigureMemoryBudget(
+                              &env, nullptr, env.string(spill_dir), 4096) == JNI_TRUE;
+        jstring stats = Java_com_example_smart_1pdf_SpdfcorePlugin_nativeMemoryBudgetStats(&env, nullptr);
+        configured = configured && stats &&
+                     static_cast<HostString*>(stats)->value.find("\"limit\":4096,") != std::string::npos;
+        printf("%-28s %s\n", "nativeConfigureMemoryBudget", configured ? "ok" : "FAILED");
+        ok = configured && ok;
+        for (const auto& scenario : jni_scenarios()) {
+            if (strstr(scenario.name, "Merge") || strstr(scenario.name, "Assemble")) {
+                ok = run_scenario(scenario, ctx) && ok;
+            }
+        }
+        Java_com_example_smart_1pdf_SpdfcorePlugin_nativeConfigureMemoryBudget(&env, nullptr, env.string(spill_dir), 0);
+    }
+
+    void* ffi = dlopen(SPDFCORE_FFI_LIBRARY, RTLD_LAZY);
+    if (ffi) {
+        for (const auto& scenario : direct_scenarios(ffi)) {
+            ok = run_scenario(scenario, ctx) && ok;
+        }
+    } else {
+        fprintf(stderr, "direct baseline skipped: %s\n", dlerror());
+    }
+
+    if (own_workdir) {
+        nftw(ctx.options.workdir.c_str(),
+             [](const char* path, const struct stat*, int, struct FTW*) { return remove(path); }, 16,
+             FTW_DEPTH | FTW_PHYS);
+    }
+
+    printf("%s\n", ok ? "PASS" : "FAIL");
+    return ok ? 0 : 1;
+}
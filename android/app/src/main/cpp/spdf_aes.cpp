@@ -0,0 +1,524 @@
+#include "spdf_aes.h"
+#include <atomic>
+#include <cstring>
+#include <initializer_list>
+
+#if defined(__x86_64__) || (defined(__i386__) && defined(__SSE2__))
+#include <cpuid.h>
+#include <immintrin.h>
+#define SPDF_AES_X86 1
+#elif defined(__aarch64__) && defined(__linux__)
+#include <arm_neon.h>
+#include <sys/auxv.h>
+#define SPDF_AES_ARM 1
+#ifndef HWCAP_AES
+#define HWCAP_AES (1 << 3)
+#endif
+#endif
+
+namespace spdf {
+
+// ---------------------------------------------------------------------------
+// Portable: 32-bit T-tables, generated from the S-box at startup
+
+namespace {
+
+struct Tables {
+    uint8_t sbox[256];
+    uint8_t inverse_sbox[256];
+    uint32_t te[4][256];
+    uint32_t td[4][256];
+
+    Tables() {
+        // S-box from the multiplicative inverse in GF(2^8) and the affine map,
+        // walking p over the field with generator 3 and q = 1/p alongside
+        uint8_t p = 1;
+        uint8_t q = 1;
+        do {
+            p = (uint8_t)(p ^ (p << 1) ^ (p & 0x80 ? 0x1b : 0));
+            q ^= (uint8_t)(q << 1);
+            q ^= (uint8_t)(q << 2);
+            q ^= (uint8_t)(q << 4);
+            if (q & 0x80) {
+                q ^= 0x09;
+            }
+            uint8_t x = (uint8_t)(q ^ rotl8(q, 1) ^ rotl8(q, 2) ^ rotl8(q, 3) ^ rotl8(q, 4));
+            sbox[p] = (uint8_t)(x ^ 0x63);
+        } while (p != 1);
+        sbox[0] = 0x63;
+        for (int i = 0; i < 256; i++) {
+            inverse_sbox[sbox[i]] = (uint8_t)i;
+        }
+
+        for (int i = 0; i < 256; i++) {
+            uint8_t s = sbox[i];
+            uint32_t e = (uint32_t)mul(s, 2) << 24 | (uint32_t)s << 16 | (uint32_t)s << 8 | mul(s, 3);
+            uint8_t v = inverse_sbox[i];
+            uint32_t d = (uint32_t)mul(v, 14) << 24 | (uint32_t)mul(v, 9) << 16 | (uint32_t)mul(v, 13) << 8 |
+                         mul(v, 11);
+            for (int t = 0; t < 4; t++) {
+                te[t][i] = e;
+                td[t][i] = d;
+                e = e >> 8 | e << 24;
+                d = d >> 8 | d << 24;
+            }
+        }
+    }
+
+    static uint8_t rotl8(uint8_t x, int n) { return (uint8_t)(x << n | x >> (8 - n)); }
+
+    static uint8_t mul(uint8_t a, uint8_t b) {
+        uint8_t product = 0;
+        while (b) {
+            if (b & 1) {
+                product ^= a;
+            }
+            a = (uint8_t)(a << 1 ^ (a & 0x80 ? 0x1b : 0));
+            b >>= 1;
+        }
+        return product;
+    }
+};
+
+const Tables tables;
+
+inline uint32_t load_be32(const uint8_t* p) {
+    return (uint32_t)p[0] << 24 | (uint32_t)p[1] << 16 | (uint32_t)p[2] << 8 | p[3];
+}
+
+inline void store_be32(uint8_t* p, uint32_t v) {
+    p[0] = (uint8_t)(v >> 24);
+    p[1] = (uint8_t)(v >> 16);
+    p[2] = (uint8_t)(v >> 8);
+    p[3] = (uint8_t)v;
+}
+
+inline uint32_t sub_word(uint32_t w) {
+    const uint8_t* s = tables.sbox;
+    return (uint32_t)s[w >> 24] << 24 | (uint32_t)s[(w >> 16) & 0xff] << 16 | (uint32_t)s[(w >> 8) & 0xff] << 8 |
+           s[w & 0xff];
+}
+
+inline uint32_t inverse_mix_word(uint32_t w) {
+    // td[t][inverse_sbox[sbox[x]]] = InvMixColumns of x in row t
+    const uint8_t* s = tables.sbox;
+    return tables.td[0][s[w >> 24]] ^ tables.td[1][s[(w >> 16) & 0xff]] ^ tables.td[2][s[(w >> 8) & 0xff]] ^
+           tables.td[3][s[w & 0xff]];
+}
+
+void portable_encrypt_block(const uint8_t* keys, int rounds, const uint8_t* in, uint8_t* out) {
+    const uint32_t(*te)[256] = tables.te;
+    uint32_t s0 = load_be32(in) ^ load_be32(keys);
+    uint32_t s1 = load_be32(in + 4) ^ load_be32(keys + 4);
+    uint32_t s2 = load_be32(in + 8) ^ load_be32(keys + 8);
+    uint32_t s3 = load_be32(in + 12) ^ load_be32(keys + 12);
+    for (int r = 1; r < rounds; r++) {
+        const uint8_t* k = keys + r * 16;
+        uint32_t t0 = te[0][s0 >> 24] ^ te[1][(s1 >> 16) & 0xff] ^ te[2][(s2 >> 8) & 0xff] ^ te[3][s3 & 0xff];
+        uint32_t t1 = te[0][s1 >> 24] ^ te[1][(s2 >> 16) & 0xff] ^ te[2][(s3 >> 8) & 0xff] ^ te[3][s0 & 0xff];
+        uint32_t t2 = te[0][s2 >> 24] ^ te[1][(s3 >> 16) & 0xff] ^ te[2][(s0 >> 8) & 0xff] ^ te[3][s1 & 0xff];
+        uint32_t t3 = te[0][s3 >> 24] ^ te[1][(s0 >> 16) & 0xff] ^ te[2][(s1 >> 8) & 0xff] ^ te[3][s2 & 0xff];
+        s0 = t0 ^ load_be32(k);
+        s1 = t1 ^ load_be32(k + 4);
+        s2 = t2 ^ load_be32(k + 8);
+        s3 = t3 ^ load_be32(k + 12);
+    }
+    const uint8_t* s = tables.sbox;
+    const uint8_t* k = keys + rounds * 16;
+    auto last = [s](uint32_t a, uint32_t b, uint32_t c, uint32_t d) {
+        return (uint32_t)s[a >> 24] << 24 | (uint32_t)s[(b >> 16) & 0xff] << 16 | (uint32_t)s[(c >> 8) & 0xff] << 8 |
+               s[d & 0xff];
+    };
+    store_be32(out, last(s0, s1, s2, s3) ^ load_be32(k));
+    store_be32(out + 4, last(s1, s2, s3, s0) ^ load_be32(k + 4));
+    store_be32(out + 8, last(s2, s3, s0, s1) ^ load_be32(k + 8));
+    store_be32(out + 12, last(s3, s0, s1, s2) ^ load_be32(k + 12));
+}
+
+void portable_decrypt_block(const uint8_t* keys, int rounds, const uint8_t* in, uint8_t* out) {
+    const uint32_t(*td)[256] = tables.td;
+    uint32_t s0 = load_be32(in) ^ load_be32(keys);
+    uint32_t s1 = load_be32(in + 4) ^ load_be32(keys + 4);
+    uint32_t s2 = load_be32(in + 8) ^ load_be32(keys + 8);
+    uint32_t s3 = load_be32(in + 12) ^ load_be32(keys + 12);
+    for (int r = 1; r < rounds; r++) {
+        const uint8_t* k = keys + r * 16;
+        uint32_t t0 = td[0][s0 >> 24] ^ td[1][(s3 >> 16) & 0xff] ^ td[2][(s2 >> 8) & 0xff] ^ td[3][s1 & 0xff];
+        uint32_t t1 = td[0][s1 >> 24] ^ td[1][(s0 >> 16) & 0xff] ^ td[2][(s3 >> 8) & 0xff] ^ td[3][s2 & 0xff];
+        uint32_t t2 = td[0][s2 >> 24] ^ td[1][(s1 >> 16) & 0xff] ^ td[2][(s0 >> 8) & 0xff] ^ td[3][s3 & 0xff];
+        uint32_t t3 = td[0][s3 >> 24] ^ td[1][(s2 >> 16) & 0xff] ^ td[2][(s1 >> 8) & 0xff] ^ td[3][s0 & 0xff];
+        s0 = t0 ^ load_be32(k);
+        s1 = t1 ^ load_be32(k + 4);
+        s2 = t2 ^ load_be32(k + 8);
+        s3 = t3 ^ load_be32(k + 12);
+    }
+    const uint8_t* s = tables.inverse_sbox;
+    const uint8_t* k = keys + rounds * 16;
+    auto last = [s](uint32_t a, uint32_t b, uint32_t c, uint32_t d) {
+        return (uint32_t)s[a >> 24] << 24 | (uint32_t)s[(b >> 16) & 0xff] << 16 | (uint32_t)s[(c >> 8) & 0xff] << 8 |
+               s[d & 0xff];
+    };
+    store_be32(out, last(s0, s3, s2, s1) ^ load_be32(k));
+    store_be32(out + 4, last(s1, s0, s3, s2) ^ load_be32(k + 4));
+    store_be32(out + 8, last(s2, s1, s0, s3) ^ load_be32(k + 8));
+    store_be32(out + 12, last(s3, s2, s1, s0) ^ load_be32(k + 12));
+}
+
+void portable_cbc_encrypt(const uint8_t* keys, int rounds, const uint8_t* in, uint8_t* out, size_t size,
+                          uint8_t* iv) {
+    uint8_t block[16];
+    for (size_t i = 0; i < size; i += 16) {
+        for (int j = 0; j < 16; j++) {
+            block[j] = in[i + j] ^ iv[j];
+        }
+        portable_encrypt_block(keys, rounds, block, out + i);
+        memcpy(iv, out + i, 16);
+    }
+}
+
+void portable_cbc_decrypt(const uint8_t* keys, int rounds, const uint8_t* in, uint8_t* out, size_t size,
+                          uint8_t* iv) {
+    uint8_t ciphertext[16];
+    uint8_t block[16];
+    for (size_t i = 0; i < size; i += 16) {
+        memcpy(ciphertext, in + i, 16);
+        portable_decrypt_block(keys, rounds, ciphertext, block);
+        for (int j = 0; j < 16; j++) {
+            out[i + j] = block[j] ^ iv[j];
+        }
+        memcpy(iv, ciphertext, 16);
+    }
+}
+
+// ---------------------------------------------------------------------------
+// AES-NI
+
+#if SPDF_AES_X86
+
+#define SPDF_AESNI __attribute__((target("aes,sse2")))
+
+SPDF_AESNI inline void aesni_load_keys(const uint8_t* keys, int rounds, __m128i* k) {
+    for (int r = 0; r <= rounds; r++) {
+        k[r] = _mm_load_si128((const __m128i*)(keys + r * 16));
+    }
+}
+
+SPDF_AESNI inline __m128i aesni_encrypt(__m128i s, const __m128i* k, int rounds) {
+    s = _mm_xor_si128(s, k[0]);
+    for (int r = 1; r < rounds; r++) {
+        s = _mm_aesenc_si128(s, k[r]);
+    }
+    return _mm_aesenclast_si128(s, k[rounds]);
+}
+
+SPDF_AESNI inline __m128i aesni_decrypt(__m128i s, const __m128i* k, int rounds) {
+    s = _mm_xor_si128(s, k[0]);
+    for (int r = 1; r < rounds; r++) {
+        s = _mm_aesdec_si128(s, k[r]);
+    }
+    return _mm_aesdeclast_si128(s, k[rounds]);
+}
+
+SPDF_AESNI void aesni_encrypt_block(const uint8_t* keys, int rounds, const uint8_t* in, uint8_t* out) {
+    __m128i k[15] = {};
+    aesni_load_keys(keys, rounds, k);
+    _mm_storeu_si128((__m128i*)out, aesni_encrypt(_mm_loadu_si128((const __m128i*)in), k, rounds));
+}
+
+SPDF_AESNI void aesni_decrypt_block(const uint8_t* keys, int rounds, const uint8_t* in, uint8_t* out) {
+    __m128i k[15] = {};
+    aesni_load_keys(keys, rounds, k);
+    _mm_storeu_si128((__m128i*)out, aesni_decrypt(_mm_loadu_si128((const __m128i*)in), k, rounds));
+}
+
+SPDF_AESNI void aesni_cbc_encrypt(const uint8_t* keys, int rounds, const uint8_t* in, uint8_t* out, size_t size,
+                                  uint8_t* iv) {
+    __m128i k[15] = {};
+    aesni_load_keys(keys, rounds, k);
+    __m128i chain = _mm_loadu_si128((const __m128i*)iv);
+    for (size_t i = 0; i < size; i += 16) {
+        chain = aesni_encrypt(_mm_xor_si128(_mm_loadu_si128((const __m128i*)(in + i)), chain), k, rounds);
+        _mm_storeu_si128((__m128i*)(out + i), chain);
+    }
+    _mm_storeu_si128((__m128i*)iv, chain);
+}
+
+SPDF_AESNI void aesni_cbc_decrypt(const uint8_t* keys, int rounds, const uint8_t* in, uint8_t* out, size_t size,
+                                  uint8_t* iv) {
+    __m128i k[15] = {};
+    aesni_load_keys(keys, rounds, k);
+    __m128i chain = _mm_loadu_si128((const __m128i*)iv);
+    size_t i = 0;
+    // Eight independent blocks in flight hide the aesdec latency
+    for (; i + 128 <= size; i += 128) {
+        __m128i c[8];
+        __m128i s[8];
+        for (int b = 0; b < 8; b++) {
+            c[b] = _mm_loadu_si128((const __m128i*)(in + i + b * 16));
+            s[b] = _mm_xor_si128(c[b], k[0]);
+        }
+        for (int r = 1; r < rounds; r++) {
+            for (int b = 0; b < 8; b++) {
+                s[b] = _mm_aesdec_si128(s[b], k[r]);
+            }
+        }
+        for (int b = 0; b < 8; b++) {
+            s[b] = _mm_aesdeclast_si128(s[b], k[rounds]);
+        }
+        _mm_storeu_si128((__m128i*)(out + i), _mm_xor_si128(s[0], chain));
+        for (int b = 1; b < 8; b++) {
+            _mm_storeu_si128((__m128i*)(out + i + b * 16), _mm_xor_si128(s[b], c[b - 1]));
+        }
+        chain = c[7];
+    }
+    for (; i < size; i += 16) {
+        __m128i c = _mm_loadu_si128((const __m128i*)(in + i));
+        _mm_storeu_si128((__m128i*)(out + i), _mm_xor_si128(aesni_decrypt(c, k, rounds), chain));
+        chain = c;
+    }
+    _mm_storeu_si128((__m128i*)iv, chain);
+}
+
+bool aesni_supported() {
+    unsigned eax, ebx, ecx, edx;
+    return __get_cpuid(1, &eax, &ebx, &ecx, &edx) && (ecx & bit_AES) != 0;
+}
+
+#endif // SPDF_AES_X86
+
+// ---------------------------------------------------------------------------
+// ARMv8 Cryptography Extensions
+
+#if SPDF_AES_ARM
+
+#if defined(__ARM_FEATURE_AES) || defined(__ARM_FEATURE_CRYPTO)
+#define SPDF_ARM_AES
+#elif defined(__clang__)
+#define SPDF_ARM_AES __attribute__((target("crypto")))
+#else
+#define SPDF_ARM_AES __attribute__((target("+crypto")))
+#endif
+
+// AESE/AESD add the round key first, so the final round key is a plain XOR
+SPDF_ARM_AES inline uint8x16_t arm_encrypt(uint8x16_t s, const uint8x16_t* k, int rounds) {
+    for (int r = 0; r < rounds - 1; r++) {
+        s = vaesmcq_u8(vaeseq_u8(s, k[r]));
+    }
+    return veorq_u8(vaeseq_u8(s, k[rounds - 1]), k[rounds]);
+}
+
+SPDF_ARM_AES inline uint8x16_t arm_decrypt(uint8x16_t s, const uint8x16_t* k, int rounds) {
+    for (int r = 0; r < rounds - 1; r++) {
+        s = vaesimcq_u8(vaesdq_u8(s, k[r]));
+    }
+    return veorq_u8(vaesdq_u8(s, k[rounds - 1]), k[rounds]);
+}
+
+SPDF_ARM_AES inline void arm_load_keys(const uint8_t* keys, int rounds, uint8x16_t* k) {
+    for (int r = 0; r <= rounds; r++) {
+        k[r] = vld1q_u8(keys + r * 16);
+    }
+}
+
+SPDF_ARM_AES void arm_encrypt_block(const uint8_t* keys, int rounds, const uint8_t* in, uint8_t* out) {
+    uint8x16_t k[15];
+    arm_load_keys(keys, rounds, k);
+    vst1q_u8(out, arm_encrypt(vld1q_u8(in), k, rounds));
+}
+
+SPDF_ARM_AES void arm_decrypt_block(const uint8_t* keys, int rounds, const uint8_t* in, uint8_t* out) {
+    uint8x16_t k[15];
+    arm_load_keys(keys, rounds, k);
+    vst1q_u8(out, arm_decrypt(vld1q_u8(in), k, rounds));
+}
+
+SPDF_ARM_AES void arm_cbc_encrypt(const uint8_t* keys, int rounds, const uint8_t* in, uint8_t* out, size_t size,
+                                  uint8_t* iv) {
+    uint8x16_t k[15];
+    arm_load_keys(keys, rounds, k);
+    uint8x16_t chain = vld1q_u8(iv);
+    for (size_t i = 0; i < size; i += 16) {
+        chain = arm_encrypt(veorq_u8(vld1q_u8(in + i), chain), k, rounds);
+        vst1q_u8(out + i, chain);
+    }
+    vst1q_u8(iv, chain);
+}
+
+SPDF_ARM_AES void arm_cbc_decrypt(const uint8_t* keys, int rounds, const uint8_t* in, uint8_t* out, size_t size,
+                                  uint8_t* iv) {
+    uint8x16_t k[15];
+    arm_load_keys(keys, rounds, k);
+    uint8x16_t chain = vld1q_u8(iv);
+    size_t i = 0;
+    // Eight independent blocks keep the AESD/AESIMC pairs fused and pipelined
+    for (; i + 128 <= size; i += 128) {
+        uint8x16_t c[8];
+        uint8x16_t s[8];
+        for (int b = 0; b < 8; b++) {
+            c[b] = vld1q_u8(in + i + b * 16);
+            s[b] = c[b];
+        }
+        for (int r = 0; r < rounds - 1; r++) {
+            for (int b = 0; b < 8; b++) {
+                s[b] = vaesimcq_u8(vaesdq_u8(s[b], k[r]));
+            }
+        }
+        for (int b = 0; b < 8; b++) {
+            s[b] = veorq_u8(vaesdq_u8(s[b], k[rounds - 1]), k[rounds]);
+        }
+        vst1q_u8(out + i, veorq_u8(s[0], chain));
+        for (int b = 1; b < 8; b++) {
+            vst1q_u8(out + i + b * 16, veorq_u8(s[b], c[b - 1]));
+        }
+        chain = c[7];
+    }
+    for (; i < size; i += 16) {
+        uint8x16_t c = vld1q_u8(in + i);
+        vst1q_u8(out + i, veorq_u8(arm_decrypt(c, k, rounds), chain));
+        chain = c;
+    }
+    vst1q_u8(iv, chain);
+}
+
+bool arm_aes_supported() {
+    return (getauxval(AT_HWCAP) & HWCAP_AES) != 0;
+}
+
+#endif // SPDF_AES_ARM
+
+// ---------------------------------------------------------------------------
+// Dispatch
+
+struct AesOps {
+    AesBackend backend;
+    void (*encrypt_block)(const uint8_t*, int, const uint8_t*, uint8_t*);
+    void (*decrypt_block)(const uint8_t*, int, const uint8_t*, uint8_t*);
+    void (*cbc_encrypt)(const uint8_t*, int, const uint8_t*, uint8_t*, size_t, uint8_t*);
+    void (*cbc_decrypt)(const uint8_t*, int, const uint8_t*, uint8_t*, size_t, uint8_t*);
+};
+
+const AesOps portable_ops = {AesBackend::Portable, portable_encrypt_block, portable_decrypt_block,
+                             portable_cbc_encrypt, portable_cbc_decrypt};
+#if SPDF_AES_X86
+const AesOps aesni_ops = {AesBackend::AesNi, aesni_encrypt_block, aesni_decrypt_block, aesni_cbc_encrypt,
+                          aesni_cbc_decrypt};
+#endif
+#if SPDF_AES_ARM
+const AesOps arm_ops = {AesBackend::ArmCrypto, arm_encrypt_block, arm_decrypt_block, arm_cbc_encrypt,
+                        arm_cbc_decrypt};
+#endif
+
+const AesOps* ops_for(AesBackend backend) {
+    switch (backend) {
+#if SPDF_AES_X86
+        case AesBackend::AesNi:
+            return aesni_supported() ? &aesni_ops : nullptr;
+#endif
+#if SPDF_AES_ARM
+        case AesBackend::ArmCrypto:
+            return arm_aes_supported() ? &arm_ops : nullptr;
+#endif
+        case AesBackend::Portable:
+            return &portable_ops;
+        default:
+            return nullptr;
+    }
+}
+
+const AesOps* best_ops() {
+    for (AesBackend backend : {AesBackend::AesNi, AesBackend::ArmCrypto}) {
+        if (const AesOps* ops = ops_for(backend)) {
+            return ops;
+        }
+    }
+    return &portable_ops;
+}
+
+std::atomic<const AesOps*> active_ops{best_ops()};
+
+inline const AesOps* ops() {
+    return active_ops.load(std::memory_order_relaxed);
+}
+
+} // namespace
+
+AesBackend aes_backend() {
+    return ops()->backend;
+}
+
+const char* aes_backend_name(AesBackend backend) {
+    switch (backend) {
+        case AesBackend::AesNi: return "aes-ni";
+        case AesBackend::ArmCrypto: return "armv8-ce";
+        default: return "portable";
+    }
+}
+
+bool aes_backend_supported(AesBackend backend) {
+    return ops_for(backend) != nullptr;
+}
+
+bool set_aes_backend(AesBackend backend) {
+    const AesOps* selected = ops_for(backend);
+    if (!selected) {
+        return false;
+    }
+    active_ops.store(selected, std::memory_order_relaxed);
+    return true;
+}
+
+bool Aes::set_key(const uint8_t* key, size_t key_size) {
+    if (key_size != 16 && key_size != 24 && key_size != 32) {
+        return false;
+    }
+    int nk = (int)(key_size / 4);
+    rounds_ = nk + 6;
+    int words = 4 * (rounds_ + 1);
+    uint32_t w[60];
+    for (int i = 0; i < nk; i++) {
+        w[i] = load_be32(key + i * 4);
+    }
+    uint32_t rcon = 1;
+    for (int i = nk; i < words; i++) {
+        uint32_t t = w[i - 1];
+        if (i % nk == 0) {
+            t = sub_word(t << 8 | t >> 24) ^ rcon << 24;
+            rcon = Tables::mul((uint8_t)rcon, 2);
+        } else if (nk > 6 && i % nk == 4) {
+            t = sub_word(t);
+        }
+        w[i] = w[i - nk] ^ t;
+    }
+    for (int i = 0; i < words; i++) {
+        store_be32(encrypt_keys_ + i * 4, w[i]);
+    }
+    // Equivalent inverse cipher: reversed round keys, InvMixColumns on the inner ones
+    for (int r = 0; r <= rounds_; r++) {
+        for (int c = 0; c < 4; c++) {
+            uint32_t word = w[(rounds_ - r) * 4 + c];
+            if (r > 0 && r < rounds_) {
+                word = inverse_mix_word(word);
+            }
+            store_be32(decrypt_keys_ + (r * 4 + c) * 4, word);
+        }
+    }
+    return true;
+}
+
+void Aes::encrypt_block(const uint8_t in[16], uint8_t out[16]) const {
+    ops()->encrypt_block(encrypt_keys_, rounds_, in, out);
+}
+
+void Aes::decrypt_block(const uint8_t in[16], uint8_t out[16]) const {
+    ops()->decrypt_block(decrypt_keys_, rounds_, in, out);
+}
+
+void Aes::cbc_encrypt(const uint8_t* in, uint8_t* out, size_t size, uint8_t iv[16]) const {
+    ops()->cbc_encrypt(encrypt_keys_, rounds_, in, out, size & ~(size_t)15, iv);
+}
+
+void Aes::cbc_decrypt(const uint8_t* in, uint8_t* out, size_t size, uint8_t iv[16]) const {
+    ops()->cbc_decrypt(decrypt_keys_, rounds_, in, out, size & ~(size_t)15, iv);
+}
+
+} // namespace spdf
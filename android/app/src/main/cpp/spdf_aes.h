@@ -0,0 +1,50 @@
+#ifndef SPDF_AES_H
+#define SPDF_AES_H
+
+#include <cstddef>
+#include <cstdint>
+
+namespace spdf {
+
+// Block cipher implementations. The best supported one is picked at startup:
+// AES-NI on x86 and the ARMv8 Cryptography Extensions on AArch64 are detected
+// at runtime; the table-driven portable code is the fallback everywhere.
+enum class AesBackend { Portable, AesNi, ArmCrypto };
+
+AesBackend aes_backend();
+const char* aes_backend_name(AesBackend backend);
+bool aes_backend_supported(AesBackend backend);
+
+// Switches every Aes instance to backend (benchmarks and cross-checks); false when unsupported
+bool set_aes_backend(AesBackend backend);
+
+// AES-128/192/256 with the key schedule expanded once. Const methods are
+// thread-safe, so one key can encrypt or decrypt many streams in parallel.
+class Aes {
+public:
+    static const size_t BLOCK_SIZE = 16;
+
+    // key_size is 16, 24 or 32 bytes; false for anything else
+    bool set_key(const uint8_t* key, size_t key_size);
+
+    void encrypt_block(const uint8_t in[16], uint8_t out[16]) const;
+    void decrypt_block(const uint8_t in[16], uint8_t out[16]) const;
+
+    // CBC over whole blocks (size must be a multiple of 16); iv is updated to
+    // the last ciphertext block so calls can be chained. in and out may alias.
+    // Encryption is inherently serial; decryption runs several blocks at once.
+    void cbc_encrypt(const uint8_t* in, uint8_t* out, size_t size, uint8_t iv[16]) const;
+    void cbc_decrypt(const uint8_t* in, uint8_t* out, size_t size, uint8_t iv[16]) const;
+
+    int rounds() const { return rounds_; }
+
+private:
+    int rounds_ = 0;
+    // Round keys as bytes; decrypt_keys_ is the equivalent inverse cipher schedule
+    alignas(16) uint8_t encrypt_keys_[15 * 16];
+    alignas(16) uint8_t decrypt_keys_[15 * 16];
+};
+
+} // namespace spdf
+
+#endif // SPDF_AES_H
@@ -0,0 +1,804 @@
+#include "spdf_batch.h"
+#include <glob.h>
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <sstream>
+#include "spdf_compress.h"
+#include "spdf_document.h"
+#include "spdf_edit.h"
+#include "spdf_form.h"
+#include "spdf_json.h"
+#include "spdf_merge.h"
+#include "spdf_text.h"
+#include "spdf_writer.h"
+
+namespace spdf {
+
+const char* batch_kind_name(BatchJob::Kind kind) {
+    switch (kind) {
+        case BatchJob::Kind::Info: return "info";
+        case BatchJob::Kind::Merge: return "merge";
+        case BatchJob::Kind::Split: return "split";
+        case BatchJob::Kind::SplitAt: return "split-at";
+        case BatchJob::Kind::Extract: return "extract";
+        case BatchJob::Kind::Compress: return "compress";
+        case BatchJob::Kind::Text: return "text";
+        case BatchJob::Kind::Index: return "index";
+        case BatchJob::Kind::Edit: return "edit";
+        case BatchJob::Kind::Assemble: return "assemble";
+        case BatchJob::Kind::Duplicates: return "duplicates";
+        case BatchJob::Kind::Fill: return "fill";
+    }
+    return "unknown";
+}
+
+std::vector<std::string> tokenize_command_line(const std::string& line) {
+    std::vector<std::string> tokens;
+    std::string current;
+    bool in_token = false;
+    bool quoted = false;
+    for (char c : line) {
+        if (quoted) {
+            if (c == '"') {
+                quoted = false;
+            } else {
+                current += c;
+            }
+        } else if (c == '"') {
+            quoted = true;
+            in_token = true;
+        } else if (c == '#' && !in_token) {
+            break;
+        } else if (c == ' ' || c == '\t' || c == '\r' || c == '\n') {
+            if (in_token) {
+                tokens.push_back(current);
+                current.clear();
+                in_token = false;
+            }
+        } else {
+            current += c;
+            in_token = true;
+        }
+    }
+    if (in_token) {
+        tokens.push_back(current);
+    }
+    return tokens;
+}
+
+std::vector<std::string> expand_globs(const std::vector<std::string>& patterns) {
+    std::vector<std::string> paths;
+    for (const auto& pattern : patterns) {
+        glob_t matches;
+        if (glob(pattern.c_str(), 0, nullptr, &matches) == 0) {
+            for (size_t i = 0; i < matches.gl_pathc; i++) {
+                paths.push_back(matches.gl_pathv[i]);
+            }
+        } else {
+            // Let the core report a missing file instead of silently dropping it
+            paths.push_back(pattern);
+        }
+        globfree(&matches);
+    }
+    return paths;
+}
+
+static std::string output_stem(const std::string& out_dir, const std::string& input) {
+    size_t slash = input.find_last_of('/');
+    std::string name = slash == std::string::npos ? input : input.substr(slash + 1);
+    if (name.size() > 4 && strcasecmp(name.c_str() + name.size() - 4, ".pdf") == 0) {
+        name.resize(name.size() - 4);
+    }
+    return (out_dir.empty() ? std::string(".") : out_dir) + "/" + name;
+}
+
+bool build_jobs(const std::vector<std::string>& args, const std::string& default_out_dir,
+                std::vector<BatchJob>* jobs, std::string* error) {
+    if (args.empty()) {
+        *error = "missing command";
+        return false;
+    }
+
+    BatchJob::Kind kind;
+    const std::string& command = args[0];
+    if (command == "info") {
+        kind = BatchJob::Kind::Info;
+    } else if (command == "merge") {
+        kind = BatchJob::Kind::Merge;
+    } else if (command == "split") {
+        kind = BatchJob::Kind::Split;
+    } else if (command == "split-at") {
+        kind = BatchJob::Kind::SplitAt;
+    } else if (command == "extract") {
+        kind = BatchJob::Kind::Extract;
+    } else if (command == "compress") {
+        kind = BatchJob::Kind::Compress;
+    } else if (command == "text") {
+        kind = BatchJob::Kind::Text;
+    } else if (command == "index") {
+        kind = BatchJob::Kind::Index;
+    } else if (command == "edit") {
+        kind = BatchJob::Kind::Edit;
+    } else if (command == "assemble") {
+        kind = BatchJob::Kind::Assemble;
+    } else if (command == "duplicates") {
+        kind = BatchJob::Kind::Duplicates;
+    } else if (command == "fill") {
+        kind = BatchJob::Kind::Fill;
+    } else {
+        *error = "unknown command '" + command + "'";
+        return false;
+    }
+
+    std::string output;
+    std::string out_dir = default_out_dir;
+    std::vector<int32_t> pages;
+    int32_t page = 0;
+    bool linearize = false;
+    bool object_streams = false;
+    bool parallel = false;
+    bool skip_duplicates = false;
+    double similarity = 1.0;
+    bool prune = false;
+    bool subset_fonts = false;
+    std::string script;
+    std::string data;
+    std::vector<int32_t> dpis;
+    bool bilevel = true;
+    bool estimate = false;
+    std::vector<std::string> patterns;
+    for (size_t i = 1; i < args.size(); i++) {
+        const std::string& arg = args[i];
+        bool has_value = i + 1 < args.size();
+        if ((arg == "-o" || arg == "--output") && has_value) {
+            output = args[++i];
+        } else if (arg == "--out-dir" && has_value) {
+            out_dir = args[++i];
+        } else if (arg == "--pages" && has_value) {
+            if (!parse_page_list(args[++i], &pages)) {
+                *error = "invalid page list '" + args[i] + "'";
+                return false;
+            }
+        } else if (arg == "--page" && has_value) {
+            page = atoi(args[++i].c_str());
+            if (page < 1) {
+                *error = "invalid page '" + args[i] + "'";
+                return false;
+            }
+        } else if (arg == "--linearize" && kind != BatchJob::Kind::Info && kind != BatchJob::Kind::Text &&
+                   kind != BatchJob::Kind::Index) {
+            linearize = true;
+        } else if (arg == "--object-streams" && kind != BatchJob::Kind::Info && kind != BatchJob::Kind::Text &&
+                   kind != BatchJob::Kind::Index) {
+            object_streams = true;
+        } else if (arg == "--prune" && kind != BatchJob::Kind::Info && kind != BatchJob::Kind::Text &&
+                   kind != BatchJob::Kind::Index) {
+            prune = true;
+        } else if (arg == "--subset-fonts" && kind != BatchJob::Kind::Info && kind != BatchJob::Kind::Text &&
+                   kind != BatchJob::Kind::Index) {
+            subset_fonts = true;
+        } else if (arg == "--parallel" && kind == BatchJob::Kind::Merge) {
+            parallel = true;
+        } else if (arg == "--skip-duplicates" && kind == BatchJob::Kind::Merge) {
+            skip_duplicates = true;
+        } else if (arg == "--similarity" && has_value &&
+                   (kind == BatchJob::Kind::Merge || kind == BatchJob::Kind::Duplicates)) {
+            char* end = nullptr;
+            similarity = strtod(args[++i].c_str(), &end);
+            if (*end != '\0' || !(similarity > 0 && similarity <= 1)) {
+                *error = "invalid similarity '" + args[i] + "', expected a share above 0 and up to 1";
+                return false;
+            }
+        } else if (arg == "--script" && has_value && kind == BatchJob::Kind::Edit) {
+            script = args[++i];
+            PageEditScript edits;
+            if (!parse_page_edit_script(script, &edits, error)) {
+                *error = "edit: " + *error;
+                return false;
+            }
+        } else if (arg == "--data" && has_value && kind == BatchJob::Kind::Fill) {
+            data = args[++i];
+        } else if (arg == "--dpi" && has_value && kind == BatchJob::Kind::Compress) {
+            // A list only makes sense with --estimate, which is checked below
+            dpis.clear();
+            std::string list = args[++i];
+            for (size_t start = 0; start <= list.size();) {
+                size_t comma = std::min(list.find(',', start), list.size());
+                int32_t dpi = atoi(list.substr(start, comma - start).c_str());
+                if (dpi < 1) {
+                    *error = "invalid resolution '" + args[i] + "'";
+                    return false;
+                }
+                dpis.push_back(dpi);
+                start = comma + 1;
+            }
+        } else if (arg == "--no-bilevel" && kind == BatchJob::Kind::Compress) {
+            bilevel = false;
+        } else if (arg == "--estimate" && (kind == BatchJob::Kind::Compress || kind == BatchJob::Kind::Merge)) {
+            estimate = true;
+        } else if (arg.size() > 1 && arg[0] == '-') {
+            *error = command + ": unknown or incomplete option '" + arg + "'";
+            return false;
+        } else {
+            patterns.push_back(arg);
+        }
+    }
+
+    std::vector<std::string> inputs = expand_globs(patterns);
+    if (inputs.empty()) {
+        *error = command + ": no input files";
+        return false;
+    }
+    if (dpis.size() > 1 && !estimate) {
+        *error = "compress: --dpi takes one resolution unless --estimate is given";
+        return false;
+    }
+    if (dpis.empty()) {
+        dpis.push_back(150);
+    }
+    if (kind == BatchJob::Kind::Duplicates) {
+        // One job: pages repeat across the inputs
+        BatchJob job;
+        job.kind = kind;
+        job.inputs = inputs;
+        job.similarity = similarity;
+        jobs->push_back(job);
+        return true;
+    }
+    if (kind == BatchJob::Kind::Merge) {
+        if (output.empty() && !estimate) {
+            *error = "merge: -o OUTPUT is required";
+            return false;
+        }
+        BatchJob job;
+        job.kind = kind;
+        job.inputs = inputs;
+        job.output = output;
+        job.linearize = linearize;
+        job.object_streams = object_streams;
+        job.prune = prune;
+        job.subset_fonts = subset_fonts;
+        job.parallel = parallel;
+        job.skip_duplicates = skip_duplicates;
+        job.similarity = similarity;
+        job.estimate = estimate;
+        jobs->push_back(job);
+        return true;
+    }
+    if (kind == BatchJob::Kind::Split && pages.empty()) {
+        *error = "split: --pages LIST is required";
+        return false;
+    }
+    if (kind == BatchJob::Kind::Edit && script.empty()) {
+        *error = "edit: --script SCRIPT is required";
+        return false;
+    }
+    if (kind == BatchJob::Kind::Fill && data.empty()) {
+        *error = "fill: --data CSV is required";
+        return false;
+    }
+    if ((kind == BatchJob::Kind::SplitAt || kind == BatchJob::Kind::Extract) && page == 0) {
+        *error = command + ": --page N is required";
+        return false;
+    }
+    if (!output.empty() && inputs.size() > 1) {
+        *error = command + ": -o only applies to a single input, use --out-dir";
+        return false;
+    }
+
+    for (const auto& input : inputs) {
+        BatchJob job;
+        job.kind = kind;
+        job.inputs.push_back(input);
+        job.pages = pages;
+        job.page = page;
+        job.linearize = linearize;
+        job.object_streams = object_streams;
+        // Subsets of a document still carry its objects and whole fonts; keep only what their pages use
+        bool subset = kind == BatchJob::Kind::Split || kind == BatchJob::Kind::SplitAt ||
+                      kind == BatchJob::Kind::Extract;
+        job.prune = prune || subset;
+        job.subset_fonts = subset_fonts || subset;
+        job.script = script;
+        job.data = data;
+        job.dpi = dpis[0];
+        job.dpis = dpis;
+        job.bilevel = bilevel;
+        job.estimate = estimate;
+        if (estimate) {
+            // Nothing is written
+        } else if (!output.empty()) {
+            job.output = output;
+        } else if (kind == BatchJob::Kind::Split) {
+            job.output = output_stem(out_dir, input) + "_pages.pdf";
+        } else if (kind == BatchJob::Kind::SplitAt) {
+            job.output = output_stem(out_dir, input);
+        } else if (kind == BatchJob::Kind::Extract) {
+            job.output = output_stem(out_dir, input) + "_page" + std::to_string(page) + ".pdf";
+        } else if (kind == BatchJob::Kind::Compress) {
+            job.output = output_stem(out_dir, input) + "_compressed.pdf";
+        } else if (kind == BatchJob::Kind::Text) {
+            job.output = output_stem(out_dir, input) + ".txt";
+        } else if (kind == BatchJob::Kind::Edit) {
+            job.output = output_stem(out_dir, input) + "_edited.pdf";
+        } else if (kind == BatchJob::Kind::Fill) {
+            job.output = output_stem(out_dir, input) + "_{row}.pdf";
+        }
+        jobs->push_back(job);
+    }
+    return true;
+}
+
+// Records the outcome of one C ABI call in *result and frees the core's message
+static bool check(bool call_result, PdfErrorCode error_code, char* error_message, BatchResult* result) {
+    bool ok = call_result && error_code == PdfErrorCode_Success;
+    if (!ok && result->error_message.empty()) {
+        result->error_code = error_code == PdfErrorCode_Success ? PdfErrorCode_UnknownError : error_code;
+        result->error_message = error_message ? error_message : "operation failed";
+    }
+    free_c_string(error_message);
+    return ok;
+}
+
+static bool run_info(const std::string& path, BatchResult* result) {
+    PdfErrorCode error_code = PdfErrorCode_Success;
+    char* error_message = nullptr;
+    bool ok = check(pdf_get_file_size(path.c_str(), &result->file_size, &error_code, &error_message), error_code,
+                    error_message, result);
+    if (!ok) {
+        return false;
+    }
+
+    error_code = PdfErrorCode_Success;
+    error_message = nullptr;
+    bool validated = pdf_validate(path.c_str(), &result->is_valid, &error_code, &error_message);
+    if (check(validated, error_code, error_message, result) && !result->is_valid) {
+        result->error_code = PdfErrorCode_InvalidPdf;
+        result->error_message = "not a valid PDF";
+    }
+    if (!result->error_message.empty()) {
+        // Say whether merge, split and extract would still get pages out of it
+        PdfDocument document;
+        std::string error;
+        if (document.open(path, &error) && document.recovered() && document.page_count() > 0) {
+            result->recoverable = true;
+            result->page_count = (int32_t)document.page_count();
+            result->error_message += " (recoverable)";
+        }
+        return false;
+    }
+
+    error_code = PdfErrorCode_Success;
+    error_message = nullptr;
+    return check(pdf_get_page_count(path.c_str(), &result->page_count, &error_code, &error_message), error_code,
+                 error_message, result);
+}
+
+// Pages are written in order, each followed by a form feed
+static bool write_text_file(const std::string& path, const std::vector<std::string>& pages) {
+    FILE* file = fopen(path.c_str(), "wb");
+    if (!file) {
+        return false;
+    }
+    bool ok = true;
+    for (const auto& page : pages) {
+        ok = ok && fwrite(page.data(), 1, page.size(), file) == page.size() && fputc('\f', file) != EOF;
+    }
+    return fclose(file) == 0 && ok;
+}
+
+static bool run_text(const BatchJob& job, BatchResult* result) {
+    std::vector<std::string> pages;
+    if (!extract_document_text(job.inputs[0], &pages, &result->error_code, &result->error_message)) {
+        return false;
+    }
+    result->page_count = (int32_t)pages.size();
+    if (job.kind == BatchJob::Kind::Index) {
+        result->page_texts.swap(pages);
+        return true;
+    }
+    if (!write_text_file(job.output, pages)) {
+        result->error_code = PdfErrorCode_IoError;
+        result->error_message = "cannot write " + job.output;
+        return false;
+    }
+    result->outputs.push_back(job.output);
+    return true;
+}
+
+// One of the write commands through the C ABI, reading inputs instead of job.inputs
+static bool run_core_job(const BatchJob& job, const std::vector<std::string>& inputs, BatchResult* result) {
+    PdfErrorCode error_code = PdfErrorCode_Success;
+    char* error_message = nullptr;
+    // The call must complete before check() reads error_code, so it is not made inside the argument list
+    bool called = false;
+    switch (job.kind) {
+        case BatchJob::Kind::Merge: {
+            std::vector<const char*> paths;
+            for (const auto& input : inputs) {
+                paths.push_back(input.c_str());
+            }
+            called = pdf_merge_files(paths.data(), paths.size(), job.output.c_str(), &error_code, &error_message);
+            result->outputs.push_back(job.output);
+            break;
+        }
+        case BatchJob::Kind::Split:
+            called = pdf_split_by_pages(inputs[0].c_str(), job.pages.data(), job.pages.size(), job.output.c_str(),
+                                        &error_code, &error_message);
+            result->outputs.push_back(job.output);
+            break;
+        case BatchJob::Kind::SplitAt:
+            called = pdf_split_at_page(inputs[0].c_str(), job.page, job.output.c_str(), &error_code, &error_message);
+            result->outputs.push_back(job.output + "_part1.pdf");
+            result->outputs.push_back(job.output + "_part2.pdf");
+            break;
+        case BatchJob::Kind::Extract:
+            called = pdf_extract_page(inputs[0].c_str(), job.page, job.output.c_str(), &error_code, &error_message);
+            result->outputs.push_back(job.output);
+            break;
+        default:
+            break;
+    }
+    if (!check(called, error_code, error_message, result)) {
+        result->outputs.clear();
+        return false;
+    }
+    return true;
+}
+
+// Rewrites the inputs the native reader could only open through its recovery
+// scan next to the job's output; intact inputs are used as they are. False
+// when nothing was repaired, so a retry would fail the same way.
+static bool repair_inputs(const BatchJob& job, std::vector<std::string>* inputs, std::vector<std::string>* temporary) {
+    bool repaired = false;
+    for (size_t i = 0; i < job.inputs.size(); i++) {
+        PdfDocument document;
+        std::string error;
+        if (!document.open(job.inputs[i], &error) || document.locked() || !document.recovered()) {
+            inputs->push_back(job.inputs[i]);
+            continue;
+        }
+        std::string path = job.output + ".repaired" + std::to_string(i) + ".pdf";
+        WriteOptions options;
+        options.security = document.security();
+        if (!write_document(document, path, options, &error)) {
+            inputs->push_back(job.inputs[i]);
+            continue;
+        }
+        temporary->push_back(path);
+        inputs->push_back(path);
+        repaired = true;
+    }
+    return repaired;
+}
+
+// Shared by every parallel merge of the process, so covers and terms pages that
+// recur across a manifest (or daemon requests) are parsed once
+static MergeSession& merge_session() {
+    static MergeSession session;
+    return session;
+}
+
+BatchResult run_batch_job(const BatchJob& job) {
+    BatchResult result;
+    auto start = std::chrono::steady_clock::now();
+
+    switch (job.kind) {
+        case BatchJob::Kind::Info:
+            result.ok = run_info(job.inputs[0], &result);
+            break;
+
+        case BatchJob::Kind::Merge:
+            if (job.estimate) {
+                // The native merge's first pass: exact, so the band is empty
+                CompressEstimate merged;
+                result.ok = estimate_merge(job.inputs, 0, &merged.bytes, &result.error_code, &result.error_message);
+                merged.low = merged.high = merged.bytes;
+                result.estimates.push_back(merged);
+                break;
+            }
+            if (job.skip_duplicates) {
+                DuplicateOptions options;
+                options.similarity = job.similarity;
+                size_t dropped = 0;
+                result.ok = merge_without_duplicates(job.inputs, job.output, options, &dropped, &result.error_code,
+                                                     &result.error_message);
+                if (result.ok) {
+                    result.pages_dropped = (int32_t)dropped;
+                    result.outputs.push_back(job.output);
+                }
+                break;
+            }
+            if (job.parallel) {
+                // Reads damaged inputs through the recovery scan itself, no retry needed
+                result.ok = merge_session().merge(job.inputs, job.output, 0, &result.error_code, &result.error_message);
+                if (result.ok) {
+                    result.outputs.push_back(job.output);
+                }
+                break;
+            }
+            // fall through
+        case BatchJob::Kind::Split:
+        case BatchJob::Kind::SplitAt:
+        case BatchJob::Kind::Extract: {
+            result.ok = run_core_job(job, job.inputs, &result);
+            if (result.ok ||
+                (result.error_code != PdfErrorCode_ParseError && result.error_code != PdfErrorCode_InvalidPdf)) {
+                break;
+            }
+            // Damaged input (typically an interrupted download): retry once with repaired copies
+            std::vector<std::string> inputs;
+            std::vector<std::string> temporary;
+            if (repair_inputs(job, &inputs, &temporary)) {
+                BatchResult retry;
+                if (run_core_job(job, inputs, &retry)) {
+                    result = retry;
+                    result.ok = true;
+                    result.repaired = true;
+                }
+            }
+            for (const auto& path : temporary) {
+                remove(path.c_str());
+            }
+            break;
+        }
+
+        case BatchJob::Kind::Compress: {
+            // Native: oversized images are downsampled and re-encoded, see spdf_compress.h
+            CompressOptions options;
+            options.target_dpi = job.dpi;
+            options.bilevel = job.bilevel;
+            if (job.estimate) {
+                std::vector<CompressOptions> presets;
+                for (int32_t dpi : job.dpis) {
+                    options.target_dpi = dpi;
+                    presets.push_back(options);
+                }
+                result.ok = estimate_compression(job.inputs[0], presets, &result.estimates, &result.error_code,
+                                                 &result.error_message);
+                break;
+            }
+            CompressStats stats;
+            result.ok = compress_file(job.inputs[0], job.output, options, &result.error_code, &result.error_message,
+                                      &stats);
+            if (result.ok) {
+                result.images = (int32_t)stats.resampled;
+                result.bilevel_images = (int32_t)stats.bilevel;
+                result.unreadable_images = (int32_t)stats.unreadable;
+                result.outputs.push_back(job.output);
+            }
+            break;
+        }
+
+        case BatchJob::Kind::Text:
+        case BatchJob::Kind::Index:
+            result.ok = run_text(job, &result);
+            break;
+
+        case BatchJob::Kind::Assemble: {
+            // One plan is one batch: its sources are shared by all of its outputs
+            std::ifstream file(job.inputs[0]);
+            std::stringstream text;
+            text << file.rdbuf();
+            std::vector<AssemblyOutput> outputs;
+            if (!file) {
+                result.error_code = PdfErrorCode_FileNotFound;
+                result.error_message = "cannot read " + job.inputs[0];
+            } else if (!parse_assembly_plan(text.str(), &outputs, &result.error_message)) {
+                result.error_code = PdfErrorCode_InvalidParameter;
+                result.error_message = job.inputs[0] + ": " + result.error_message;
+            } else {
+                result.ok = assemble_documents(outputs, 0, &result.error_code, &result.error_message);
+            }
+            if (result.ok) {
+                for (const auto& output : outputs) {
+                    result.outputs.push_back(output.path);
+                }
+            }
+            break;
+        }
+
+        case BatchJob::Kind::Duplicates: {
+            DuplicateOptions options;
+            options.similarity = job.similarity;
+            result.ok = find_duplicate_pages(job.inputs, options, &result.duplicates, &result.error_code,
+                                             &result.error_message);
+            break;
+        }
+
+        case BatchJob::Kind::Edit: {
+            // Damaged inputs are rewritten from the recovery scan by the edit itself
+            PageEditScript edits;
+            result.ok = parse_page_edit_script(job.script, &edits, &result.error_message) &&
+                        edit_pages(job.inputs[0], job.output, edits, &result.error_code, &result.error_message);
+            if (result.ok) {
+                result.outputs.push_back(job.output);
+            } else if (result.error_code == PdfErrorCode_Success) {
+                result.error_code = PdfErrorCode_InvalidParameter;
+            }
+            break;
+        }
+
+        case BatchJob::Kind::Fill: {
+            // One template, parsed once, filled once per data row
+            std::ifstream file(job.data);
+            std::stringstream text;
+            text << file.rdbuf();
+            std::vector<FormValues> rows;
+            if (!file) {
+                result.error_code = PdfErrorCode_FileNotFound;
+                result.error_message = "cannot read " + job.data;
+            } else if (!parse_form_data(text.str(), &rows, &result.error_message)) {
+                result.error_code = PdfErrorCode_InvalidParameter;
+                result.error_message = job.data + ": " + result.error_message;
+            } else {
+                result.ok = fill_forms(job.inputs[0], rows, job.output, 0, &result.outputs, &result.error_code,
+                                       &result.error_message);
+            }
+            break;
+        }
+    }
+
+    if (result.ok && (job.linearize || job.object_streams || job.prune || job.subset_fonts)) {
+        WriteOptions layout;
+        layout.linearize = job.linearize;
+        layout.object_streams = job.object_streams;
+        layout.prune = job.prune;
+        layout.subset_fonts = job.subset_fonts;
+        for (const auto& output : result.outputs) {
+            if (!rewrite_file(output, output, layout, &result.error_code, &result.error_message)) {
+                result.ok = false;
+                break;
+            }
+        }
+    }
+
+    result.elapsed_ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    return result;
+}
+
+std::string absolute_path(const std::string& path) {
+    char* resolved = realpath(path.c_str(), nullptr);
+    if (!resolved) {
+        return path;
+    }
+    std::string result = resolved;
+    free(resolved);
+    return result;
+}
+
+BatchResult run_index_job(const BatchJob& job, SearchIndex* index) {
+    std::string path = absolute_path(job.inputs[0]);
+    FileIdentity identity;
+    uint32_t page_count = 0;
+    bool exists = FileIdentity::of(path, &identity);
+    if (exists && index->contains(path, identity, &page_count)) {
+        BatchResult result;
+        result.ok = true;
+        result.page_count = (int32_t)page_count;
+        return result;
+    }
+    BatchResult result = run_batch_job(job);
+    FileIdentity after;
+    // A file rewritten while it was being read is left for the next run
+    if (result.ok && exists && FileIdentity::of(path, &after) && after == identity) {
+        index->add_document(path, identity, result.page_texts);
+    } else if (!result.ok) {
+        index->remove_document(path);
+    }
+    result.page_texts.clear();
+    return result;
+}
+
+bool parse_search_command(const std::vector<std::string>& args, std::string* query, size_t* limit,
+                          std::string* error) {
+    query->clear();
+    *limit = 20;
+    for (size_t i = 1; i < args.size(); i++) {
+        if (args[i] == "--limit" && i + 1 < args.size()) {
+            long value = strtol(args[++i].c_str(), nullptr, 10);
+            if (value <= 0) {
+                *error = "search: --limit must be positive";
+                return false;
+            }
+            *limit = (size_t)value;
+        } else {
+            if (!query->empty()) {
+                *query += ' ';
+            }
+            *query += args[i];
+        }
+    }
+    if (query->empty()) {
+        *error = "search: no query words";
+        return false;
+    }
+    return true;
+}
+
+std::string search_hit_json(const SearchIndex::Hit& hit) {
+    JsonWriter json;
+    json.begin_object()
+        .field("path", hit.path)
+        .field("page", hit.page)
+        .field("score", (int64_t)hit.score)
+        .end_object();
+    return json.str();
+}
+
+std::string batch_result_json(size_t index, const BatchJob& job, const BatchResult& result) {
+    JsonWriter json;
+    json.begin_object()
+        .field("index", (int64_t)index)
+        .field("command", batch_kind_name(job.kind))
+        .field("ok", result.ok);
+    json.begin_array("inputs");
+    for (const auto& input : job.inputs) {
+        json.value(input);
+    }
+    json.end_array();
+    if (job.kind == BatchJob::Kind::Info) {
+        json.field("pageCount", result.page_count).field("fileSize", result.file_size).field("isValid", result.is_valid);
+    } else if ((job.kind == BatchJob::Kind::Text || job.kind == BatchJob::Kind::Index) && result.ok) {
+        json.field("pageCount", result.page_count);
+    } else if (job.estimate && result.ok) {
+        json.begin_array("estimates");
+        for (size_t i = 0; i < result.estimates.size(); i++) {
+            const CompressEstimate& estimate = result.estimates[i];
+            JsonWriter item;
+            item.begin_object();
+            if (job.kind == BatchJob::Kind::Compress) {
+                item.field("dpi", job.dpis[i]);
+            }
+            item.field("bytes", estimate.bytes).field("low", estimate.low).field("high", estimate.high);
+            if (job.kind == BatchJob::Kind::Compress) {
+                item.field("images", (int64_t)estimate.images).field("sampled", (int64_t)estimate.sampled);
+                item.field("unreadable", (int64_t)estimate.unreadable);
+            }
+            item.end_object();
+            json.raw_value(item.str());
+        }
+        json.end_array();
+    } else if (job.kind == BatchJob::Kind::Compress && result.ok) {
+        json.field("imagesDownsampled", result.images).field("imagesBilevel", result.bilevel_images);
+        json.field("imagesUnreadable", result.unreadable_images);
+    } else if (job.kind == BatchJob::Kind::Duplicates && result.ok) {
+        // Each group as [{"path":...,"page":N}, ...], the page kept by merge --skip-duplicates first
+        json.begin_array("duplicates");
+        for (const auto& group : result.duplicates) {
+            std::string pages = "[";
+            for (const auto& location : group) {
+                JsonWriter item;
+                item.begin_object().field("path", job.inputs[location.input]).field("page", location.page).end_object();
+                pages += (pages.size() > 1 ? "," : "") + item.str();
+            }
+            json.raw_value(pages + "]");
+        }
+        json.end_array();
+    } else if (job.skip_duplicates && result.ok) {
+        json.field("pagesDropped", result.pages_dropped);
+    }
+    if (result.repaired) {
+        json.field("repaired", true);
+    } else if (job.kind == BatchJob::Kind::Info && result.recoverable) {
+        json.field("recoverable", true);
+    }
+    if (!result.outputs.empty()) {
+        json.begin_array("outputs");
+        for (const auto& output : result.outputs) {
+            json.value(output);
+        }
+        json.end_array();
+    }
+    if (!result.ok) {
+        json.field("errorCode", (int32_t)result.error_code).field("error", result.error_message);
+    }
+    json.field("elapsedMs", result.elapsed_ms).end_object();
+    return json.str();
+}
+
+} // namespace spdf
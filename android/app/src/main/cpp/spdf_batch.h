@@ -0,0 +1,94 @@
+#ifndef SPDF_BATCH_H
+#define SPDF_BATCH_H
+
+#include <cstdint>
+#include <string>
+#include <vector>
+#include "spdf_compress.h"
+#include "spdf_duplicates.h"
+#include "spdf_search_index.h"
+#include "spdfcore.h"
+
+namespace spdf {
+
+// One unit of work for the headless tools, executed against the spdfcore C ABI
+struct BatchJob {
+    enum class Kind { Info, Merge, Split, SplitAt, Extract, Compress, Text, Index, Edit, Assemble, Duplicates, Fill };
+
+    Kind kind = Kind::Info;
+    std::vector<std::string> inputs;  // Assemble: the plan file
+    std::string output;          // output file, output prefix for SplitAt, output pattern for Fill
+    std::vector<int32_t> pages;  // Split: 1-based pages to keep
+    int32_t page = 0;            // SplitAt / Extract: 1-based page
+    bool linearize = false;      // rewrite the outputs in the linearized layout
+    bool object_streams = false; // rewrite the outputs with object and cross-reference streams
+    bool prune = false;          // rewrite the outputs without the objects their pages do not use
+    bool subset_fonts = false;   // rewrite the outputs with fonts cut down to the glyphs shown
+    bool parallel = false;       // Merge: native two-pass merge on every core, not the core's
+    bool skip_duplicates = false;  // Merge: natively, without the pages find_duplicate_pages() reports
+    double similarity = 1.0;     // Duplicates / skip_duplicates: see DuplicateOptions
+    std::string script;          // Edit: page edit script, see spdf_edit.h
+    std::string data;            // Fill: CSV file of field values, see parse_form_data()
+    int32_t dpi = 150;           // Compress: resolution images are downsampled to
+    bool bilevel = true;         // Compress: store black-and-white scans as 1-bit CCITT G4 images
+    bool estimate = false;       // Compress / Merge: predict the output size instead of writing it
+    std::vector<int32_t> dpis;   // Compress with estimate: every resolution to predict
+};
+
+struct BatchResult {
+    bool ok = false;
+    PdfErrorCode error_code = PdfErrorCode_Success;
+    std::string error_message;
+    int32_t page_count = -1;
+    uint64_t file_size = 0;
+    bool is_valid = false;
+    bool recoverable = false;  // Info: invalid, but the recovery scan finds its pages
+    bool repaired = false;     // written from inputs rebuilt by the recovery scan
+    int32_t images = 0;        // Compress: images downsampled
+    int32_t bilevel_images = 0;  // Compress: of those, stored as 1-bit images
+    int32_t unreadable_images = 0;  // Compress: oversized images kept because they could not be decoded
+    std::vector<CompressEstimate> estimates;  // estimate: one per resolution, or the merged size
+    std::vector<std::string> outputs;
+    std::vector<std::string> page_texts;  // Index: text of each page, for the caller's search index
+    std::vector<std::vector<PageLocation>> duplicates;  // Duplicates: groups of repeated pages
+    int32_t pages_dropped = 0;   // Merge with skip_duplicates
+    double elapsed_ms = 0;
+};
+
+const char* batch_kind_name(BatchJob::Kind kind);
+
+// Splits a manifest line into arguments; double quotes group, '#' starts a comment
+std::vector<std::string> tokenize_command_line(const std::string& line);
+
+// Expands shell-style patterns (glob(3)); patterns without matches are kept verbatim
+std::vector<std::string> expand_globs(const std::vector<std::string>& patterns);
+
+// Turns one command ("merge -o out.pdf a.pdf b.pdf", "info *.pdf", ...) into jobs.
+// Per-file commands produce one job per matched input. Returns false with a
+// message in *error on bad usage.
+bool build_jobs(const std::vector<std::string>& args, const std::string& default_out_dir,
+                std::vector<BatchJob>* jobs, std::string* error);
+
+BatchResult run_batch_job(const BatchJob& job);
+
+// realpath() of path, or path itself when it cannot be resolved
+std::string absolute_path(const std::string& path);
+
+// Index jobs against a search index: files already indexed with the same
+// identity are skipped, others are extracted and (re)added. Documents are
+// keyed by absolute_path() so hits stay valid from any working directory.
+BatchResult run_index_job(const BatchJob& job, SearchIndex* index);
+
+// Parses "search [--limit N] words..." (args[0] is "search") into a query
+bool parse_search_command(const std::vector<std::string>& args, std::string* query, size_t* limit,
+                          std::string* error);
+
+// JSON object for one search hit: {"path":...,"page":N,"score":N}
+std::string search_hit_json(const SearchIndex::Hit& hit);
+
+// Single-line JSON object describing a finished job
+std::string batch_result_json(size_t index, const BatchJob& job, const BatchResult& result);
+
+} // namespace spdf
+
+#endif // SPDF_BATCH_H
@@ -0,0 +1,184 @@
+#include "spdf_ccitt.h"
+#include <vector>
+
+namespace spdf {
+
+namespace {
+
+struct CcittCode {
+    uint16_t bits;
+    uint8_t length;
+};
+
+} // namespace
+
+// T.4 run-length codes: terminating codes for 0-63, make-up codes for
+// multiples of 64 up to 1728, and the extended make-up codes for 1792-2560
+// both colours share
+static const CcittCode WHITE_TERMINATING[64] = {
+    {0x035, 8}, {0x007, 6}, {0x007, 4}, {0x008, 4}, {0x00b, 4}, {0x00c, 4}, {0x00e, 4}, {0x00f, 4},
+    {0x013, 5}, {0x014, 5}, {0x007, 5}, {0x008, 5}, {0x008, 6}, {0x003, 6}, {0x034, 6}, {0x035, 6},
+    {0x02a, 6}, {0x02b, 6}, {0x027, 7}, {0x00c, 7}, {0x008, 7}, {0x017, 7}, {0x003, 7}, {0x004, 7},
+    {0x028, 7}, {0x02b, 7}, {0x013, 7}, {0x024, 7}, {0x018, 7}, {0x002, 8}, {0x003, 8}, {0x01a, 8},
+    {0x01b, 8}, {0x012, 8}, {0x013, 8}, {0x014, 8}, {0x015, 8}, {0x016, 8}, {0x017, 8}, {0x028, 8},
+    {0x029, 8}, {0x02a, 8}, {0x02b, 8}, {0x02c, 8}, {0x02d, 8}, {0x004, 8}, {0x005, 8}, {0x00a, 8},
+    {0x00b, 8}, {0x052, 8}, {0x053, 8}, {0x054, 8}, {0x055, 8}, {0x024, 8}, {0x025, 8}, {0x058, 8},
+    {0x059, 8}, {0x05a, 8}, {0x05b, 8}, {0x04a, 8}, {0x04b, 8}, {0x032, 8}, {0x033, 8}, {0x034, 8}
+};
+static const CcittCode WHITE_MAKEUP[27] = {
+    {0x01b, 5}, {0x012, 5}, {0x017, 6}, {0x037, 7}, {0x036, 8}, {0x037, 8}, {0x064, 8}, {0x065, 8},
+    {0x068, 8}, {0x067, 8}, {0x0cc, 9}, {0x0cd, 9}, {0x0d2, 9}, {0x0d3, 9}, {0x0d4, 9}, {0x0d5, 9},
+    {0x0d6, 9}, {0x0d7, 9}, {0x0d8, 9}, {0x0d9, 9}, {0x0da, 9}, {0x0db, 9}, {0x098, 9}, {0x099, 9},
+    {0x09a, 9}, {0x018, 6}, {0x09b, 9}
+};
+static const CcittCode BLACK_TERMINATING[64] = {
+    {0x037, 10}, {0x002, 3}, {0x003, 2}, {0x002, 2}, {0x003, 3}, {0x003, 4}, {0x002, 4}, {0x003, 5},
+    {0x005, 6}, {0x004, 6}, {0x004, 7}, {0x005, 7}, {0x007, 7}, {0x004, 8}, {0x007, 8}, {0x018, 9},
+    {0x017, 10}, {0x018, 10}, {0x008, 10}, {0x067, 11}, {0x068, 11}, {0x06c, 11}, {0x037, 11}, {0x028, 11},
+    {0x017, 11}, {0x018, 11}, {0x0ca, 12}, {0x0cb, 12}, {0x0cc, 12}, {0x0cd, 12}, {0x068, 12}, {0x069, 12},
+    {0x06a, 12}, {0x06b, 12}, {0x0d2, 12}, {0x0d3, 12}, {0x0d4, 12}, {0x0d5, 12}, {0x0d6, 12}, {0x0d7, 12},
+    {0x06c, 12}, {0x06d, 12}, {0x0da, 12}, {0x0db, 12}, {0x054, 12}, {0x055, 12}, {0x056, 12}, {0x057, 12},
+    {0x064, 12}, {0x065, 12}, {0x052, 12}, {0x053, 12}, {0x024, 12}, {0x037, 12}, {0x038, 12}, {0x027, 12},
+    {0x028, 12}, {0x058, 12}, {0x059, 12}, {0x02b, 12}, {0x02c, 12}, {0x05a, 12}, {0x066, 12}, {0x067, 12}
+};
+static const CcittCode BLACK_MAKEUP[27] = {
+    {0x00f, 10}, {0x0c8, 12}, {0x0c9, 12}, {0x05b, 12}, {0x033, 12}, {0x034, 12}, {0x035, 12}, {0x06c, 13},
+    {0x06d, 13}, {0x04a, 13}, {0x04b, 13}, {0x04c, 13}, {0x04d, 13}, {0x072, 13}, {0x073, 13}, {0x074, 13},
+    {0x075, 13}, {0x076, 13}, {0x077, 13}, {0x052, 13}, {0x053, 13}, {0x054, 13}, {0x055, 13}, {0x05a, 13},
+    {0x05b, 13}, {0x064, 13}, {0x065, 13}
+};
+static const CcittCode EXTENDED_MAKEUP[13] = {
+    {0x008, 11}, {0x00c, 11}, {0x00d, 11}, {0x012, 12}, {0x013, 12}, {0x014, 12}, {0x015, 12}, {0x016, 12},
+    {0x017, 12}, {0x01c, 12}, {0x01d, 12}, {0x01e, 12}, {0x01f, 12}
+};
+
+// Two-dimensional mode codes
+static const CcittCode PASS = {0x1, 4};
+static const CcittCode HORIZONTAL = {0x1, 3};
+// Vertical mode by a1 - b1, from -3 to 3
+static const CcittCode VERTICAL[7] = {{0x02, 7}, {0x02, 6}, {0x2, 3}, {0x1, 1}, {0x3, 3}, {0x03, 6}, {0x03, 7}};
+// End of facsimile block: EOL twice
+static const CcittCode EOL = {0x001, 12};
+
+namespace {
+
+// Packs codes most significant bit first; the last byte is padded with zeros
+class CodeWriter {
+public:
+    explicit CodeWriter(std::string* out) : out_(out) {}
+
+    void put(CcittCode code) {
+        acc_ = (acc_ << code.length) | code.bits;
+        bits_ += code.length;
+        while (bits_ >= 8) {
+            out_->push_back((char)(acc_ >> (bits_ - 8)));
+            bits_ -= 8;
+        }
+    }
+    void flush() {
+        if (bits_ > 0) {
+            out_->push_back((char)(acc_ << (8 - bits_)));
+            bits_ = 0;
+        }
+    }
+
+private:
+    std::string* out_;
+    uint32_t acc_ = 0;
+    int bits_ = 0;
+};
+
+} // namespace
+
+static void put_run(CodeWriter& writer, int run, bool black) {
+    const CcittCode* terminating = black ? BLACK_TERMINATING : WHITE_TERMINATING;
+    const CcittCode* makeup = black ? BLACK_MAKEUP : WHITE_MAKEUP;
+    while (run >= 2560) {
+        writer.put(EXTENDED_MAKEUP[12]);
+        run -= 2560;
+    }
+    if (run >= 1792) {
+        writer.put(EXTENDED_MAKEUP[(run - 1792) / 64]);
+        run %= 64;
+    } else if (run >= 64) {
+        writer.put(makeup[run / 64 - 1]);
+        run %= 64;
+    }
+    writer.put(terminating[run]);
+}
+
+// Positions where the colour differs from the pixel before, starting from
+// white; two width entries follow as the "past the end" changing elements
+static void find_changes(const uint8_t* row, int width, std::vector<int>* changes) {
+    changes->clear();
+    bool black = false;
+    int x = 0;
+    while (x < width) {
+        uint8_t byte = row[x >> 3];
+        // Whole bytes of the current colour (white is 1) hold no change
+        if ((x & 7) == 0 && x + 8 <= width && byte == (black ? 0x00 : 0xFF)) {
+            x += 8;
+            continue;
+        }
+        bool pixel_black = ((byte >> (7 - (x & 7))) & 1) == 0;
+        if (pixel_black != black) {
+            changes->push_back(x);
+            black = pixel_black;
+        }
+        x++;
+    }
+    changes->push_back(width);
+    changes->push_back(width);
+}
+
+void ccitt_g4_encode(const uint8_t* rows, int width, int height, size_t row_bytes, std::string* output) {
+    output->clear();
+    CodeWriter writer(output);
+    // The line above the first one is all white
+    std::vector<int> reference = {width, width};
+    std::vector<int> coding;
+    for (int y = 0; y < height; y++) {
+        find_changes(rows + (size_t)y * row_bytes, width, &coding);
+        int a0 = -1;
+        bool black = false;
+        size_t a1_index = 0;  // coding[a1_index] is a1
+        size_t b_index = 0;
+        while (a0 < width) {
+            while (a1_index < coding.size() - 2 && coding[a1_index] <= a0) {
+                a1_index++;
+            }
+            int a1 = coding[a1_index];
+            // b1: first change right of a0 to the colour opposite a0's; changes to black sit at even indices.
+            // After a vertical step a0 can land left of the last b1, so the search may back up
+            while (b_index > 0 && reference[b_index - 1] > a0) {
+                b_index--;
+            }
+            while (b_index < reference.size() - 2 &&
+                   (reference[b_index] <= a0 || (b_index % 2 == 0) == black)) {
+                b_index++;
+            }
+            int b1 = reference[b_index];
+            int b2 = reference[std::min(b_index + 1, reference.size() - 1)];
+            if (b2 < a1) {
+                writer.put(PASS);
+                a0 = b2;
+            } else if (a1 - b1 >= -3 && a1 - b1 <= 3) {
+                writer.put(VERTICAL[a1 - b1 + 3]);
+                a0 = a1;
+                black = !black;
+            } else {
+                int a2 = coding[std::min(a1_index + 1, coding.size() - 1)];
+                writer.put(HORIZONTAL);
+                put_run(writer, a1 - (a0 < 0 ? 0 : a0), black);
+                put_run(writer, a2 - a1, !black);
+                a0 = a2;
+            }
+        }
+        reference.swap(coding);
+    }
+    writer.put(EOL);
+    writer.put(EOL);
+    writer.flush();
+}
+
+} // namespace spdf
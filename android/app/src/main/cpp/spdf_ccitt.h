@@ -0,0 +1,20 @@
+#ifndef SPDF_CCITT_H
+#define SPDF_CCITT_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+namespace spdf {
+
+// CCITT T.6 (Group 4) coding of 1-bit images, as read by /CCITTFaxDecode
+// with /K -1. Rows are packed most significant bit first, row_bytes apart,
+// with 0 for black and 1 for white: the samples of a 1-bit /DeviceGray
+// image, which is what the default /BlackIs1 false expects. Each row is
+// coded against the one above it, so the rows are coded in order; the
+// output ends with EOFB.
+void ccitt_g4_encode(const uint8_t* rows, int width, int height, size_t row_bytes, std::string* output);
+
+} // namespace spdf
+
+#endif // SPDF_CCITT_H
@@ -0,0 +1,646 @@
+#include "spdf_compress.h"
+#include <algorithm>
+#include <cerrno>
+#include <cmath>
+#include <thread>
+#include <unistd.h>
+#include <unordered_map>
+#include <vector>
+#include "spdf_ccitt.h"
+#include "spdf_document.h"
+#include "spdf_filters.h"
+#include "spdf_jpeg.h"
+#include "spdf_memory.h"
+#include "spdf_parser.h"
+#include "spdf_writer.h"
+
+namespace spdf {
+
+// Same bound as the text extractor
+static const int MAX_FORM_DEPTH = 8;
+// Source and resampled pixels held at once by the images processed side by side
+static const uint64_t PIXEL_BUDGET = 512ull << 20;
+// Under a memory budget the images side by side take at most this share of
+// it, each reserving its pixels before it is decoded
+static const unsigned PIXEL_SHARE = 2;
+// Images shown smaller than this along either side, in points, are never
+// made bilevel: logos and icons, where a lost gray level shows
+static const double BILEVEL_MIN_POINTS = 144;
+// Images the estimate decodes and encodes for each preset: this share of
+// the ones the preset would work on, within the bounds below. The sample is
+// doubled while the band is wider than BAND_TARGET of the prediction either
+// way, up to MAX_SAMPLE_SHARE of the images or MAX_SAMPLED_IMAGES.
+static const double SAMPLE_SHARE = 0.1;
+static const double MAX_SAMPLE_SHARE = 0.25;
+static const size_t MIN_SAMPLED_IMAGES = 6;
+static const size_t MAX_SAMPLED_IMAGES = 32;
+static const double BAND_TARGET = 0.1;
+// Allowance per image for what the estimate does not model: the changed
+// image dictionary and encryption padding
+static const uint64_t IMAGE_OVERHEAD_BYTES = 64;
+
+namespace {
+
+// Largest size an image is shown at, in points along its own axes
+struct Placement {
+    double width = 0;
+    double height = 0;
+};
+
+// Walks page contents and the forms they run for the images they show
+class PlacementScanner {
+public:
+    explicit PlacementScanner(PdfDocument& document) : document_(document) {}
+
+    void scan_page(const PdfPage& page);
+
+    std::unordered_map<uint32_t, Placement> placements;  // by image object number
+
+private:
+    void run(const std::string& content, const PdfDict& resources, const Matrix& ctm, int depth);
+
+    PdfDocument& document_;
+    std::vector<uint32_t> forms_;  // forms being run, to stop recursion
+};
+
+struct ImageJob {
+    uint32_t num = 0;
+    PdfObject image;
+    PdfDict filters;  // /Filter and /DecodeParms made direct
+    int width = 0;
+    int height = 0;
+    int components = 0;
+    int color_transform = -1;
+    int target_width = 0;   // 0 when the image is not oversized
+    int target_height = 0;
+    int bilevel_width = 0;  // 0 when the image cannot become bilevel
+    int bilevel_height = 0;
+    PdfObject replacement;  // null when the image stays
+    bool bilevel = false;   // replacement is a 1-bit image
+    bool unreadable = false;  // the stored image could not be decoded
+};
+
+// An image estimate_compression() may sample
+struct EstimateImage {
+    uint32_t num = 0;
+    uint64_t bytes = 0;            // stored stream bytes
+    std::vector<int64_t> written;  // by preset: bytes once compressed, -1 when the preset leaves it alone
+    bool sampled = false;
+    bool unreadable = false;       // sampled but could not be decoded, so written is its stored size
+};
+
+} // namespace
+
+void PlacementScanner::scan_page(const PdfPage& page) {
+    std::string content;
+    std::string error;
+    if (!document_.decode_contents(document_.lookup(page.dict, "Contents"), &content, &error)) {
+        return;
+    }
+    PdfObject resources = document_.lookup(page.dict, "Resources");
+    forms_.clear();
+    run(content, resources.as_dict(), Matrix(), 0);
+}
+
+void PlacementScanner::run(const std::string& content, const PdfDict& resources, const Matrix& initial_ctm,
+                           int depth) {
+    Matrix ctm = initial_ctm;
+    std::vector<Matrix> saved;
+    ContentParser parser(content.data(), content.size());
+    std::vector<PdfObject> operands;
+    std::string_view op;
+    while (parser.next(&operands, &op)) {
+        size_t n = operands.size();
+        if (op == "q") {
+            saved.push_back(ctm);
+        } else if (op == "Q") {
+            if (!saved.empty()) {
+                ctm = saved.back();
+                saved.pop_back();
+            }
+        } else if (op == "cm" && n >= 6) {
+            ctm = Matrix::of(operands).multiply(ctm);
+        } else if (op == "Do" && n >= 1) {
+            PdfObject xobjects = document_.lookup(resources, "XObject");
+            const PdfObject& entry = xobjects.as_dict().get(operands[0].as_name());
+            uint32_t num = entry.is_ref() ? entry.as_ref().num : 0;
+            PdfObject xobject = document_.resolve(entry);
+            const PdfObject& subtype = xobject.as_dict().get("Subtype");
+            if (!xobject.is_stream() || num == 0) {
+                continue;
+            }
+            if (subtype.is_name("Image")) {
+                // The unit square of image space, in points
+                Placement& placement = placements[num];
+                placement.width = std::max(placement.width, std::hypot(ctm.a, ctm.b));
+                placement.height = std::max(placement.height, std::hypot(ctm.c, ctm.d));
+                document_.evict(num);
+                continue;
+            }
+            if (!subtype.is_name("Form") || depth >= MAX_FORM_DEPTH ||
+                std::find(forms_.begin(), forms_.end(), num) != forms_.end()) {
+                continue;
+            }
+            std::string form_content;
+            std::string error;
+            if (!document_.decode_contents(xobject, &form_content, &error)) {
+                continue;
+            }
+            Matrix form_ctm = Matrix::of(document_.lookup(xobject.as_dict(), "Matrix").as_array()).multiply(ctm);
+            PdfObject form_resources = document_.lookup(xobject.as_dict(), "Resources");
+            forms_.push_back(num);
+            run(form_content, form_resources.is_dict() ? form_resources.as_dict() : resources, form_ctm, depth + 1);
+            forms_.pop_back();
+        }
+    }
+}
+
+// Components of the colour spaces whose samples can be resampled and stored as
+// JPEG: gray and RGB ones; 0 for the others
+static int color_components(PdfDocument& document, const PdfObject& space) {
+    PdfObject resolved = document.resolve(space);
+    const PdfObject& family = resolved.is_array() ? resolved.as_array().empty() ? PdfObject() : resolved.as_array()[0]
+                                                  : resolved;
+    if (family.is_name("DeviceGray") || family.is_name("G") || family.is_name("CalGray")) {
+        return 1;
+    }
+    if (family.is_name("DeviceRGB") || family.is_name("RGB") || family.is_name("CalRGB")) {
+        return 3;
+    }
+    if (family.is_name("ICCBased") && resolved.as_array().size() >= 2) {
+        PdfObject profile = document.resolve(resolved.as_array()[1]);
+        int64_t count = document.lookup(profile.as_dict(), "N").as_int();
+        return count == 1 || count == 3 ? (int)count : 0;
+    }
+    return 0;
+}
+
+// Sets up job for the image when it is worth resampling or may be a
+// black-and-white scan; false to leave it alone
+static bool plan_image(PdfDocument& document, uint32_t num, const Placement& placement,
+                       const CompressOptions& options, ImageJob* job) {
+    ObjectRef ref;
+    if (!document.object_ref(num, &ref) || placement.width <= 0 || placement.height <= 0) {
+        return false;
+    }
+    PdfObject image = document.get(ref);
+    document.evict(num);
+    const PdfDict& dict = image.as_dict();
+    if (!image.is_stream() || document.lookup(dict, "ImageMask").as_bool() || dict.has("Mask") || dict.has("F") ||
+        document.lookup(dict, "BitsPerComponent").as_int() != 8) {
+        return false;
+    }
+    job->num = num;
+    job->image = image;
+    job->width = (int)document.lookup(dict, "Width").as_int();
+    job->height = (int)document.lookup(dict, "Height").as_int();
+    job->components = color_components(document, dict.get("ColorSpace"));
+    if (job->width <= 0 || job->height <= 0 || job->components == 0) {
+        return false;
+    }
+    double target_width = std::ceil(placement.width / 72 * options.target_dpi);
+    double target_height = std::ceil(placement.height / 72 * options.target_dpi);
+    if (job->width > target_width * options.threshold || job->height > target_height * options.threshold) {
+        job->target_width = (int)std::max(1.0, std::min<double>(job->width, target_width));
+        job->target_height = (int)std::max(1.0, std::min<double>(job->height, target_height));
+    }
+    // A 1-bit image cannot carry an RGB /Decode; a gray one keeps its own
+    if (options.bilevel && placement.width >= BILEVEL_MIN_POINTS && placement.height >= BILEVEL_MIN_POINTS &&
+        (job->components == 1 || !dict.has("Decode"))) {
+        job->bilevel_width = (int)std::min<double>(job->width, std::ceil(placement.width / 72 * options.bilevel_dpi));
+        job->bilevel_height =
+            (int)std::min<double>(job->height, std::ceil(placement.height / 72 * options.bilevel_dpi));
+    }
+    if (job->target_width == 0 && job->bilevel_width == 0) {
+        return false;
+    }
+
+    // Lossless filters are undone by the workers; of the image codecs only JPEG is read
+    std::vector<PdfObject> names;
+    std::vector<PdfObject> params;
+    PdfObject filter = document.lookup(dict, "Filter");
+    PdfObject parms = document.lookup(dict, "DecodeParms");
+    if (filter.is_array()) {
+        for (size_t i = 0; i < filter.as_array().size(); i++) {
+            names.push_back(document.resolve(filter.as_array()[i]));
+            params.push_back(parms.is_array() && i < parms.as_array().size()
+                                 ? document.resolve(parms.as_array()[i])
+                                 : PdfObject());
+        }
+        job->filters.set("Filter", PdfObject::array(names));
+        job->filters.set("DecodeParms", PdfObject::array(params));
+    } else if (filter.is_name()) {
+        names.push_back(filter);
+        params.push_back(parms);
+        job->filters.set("Filter", filter);
+        job->filters.set("DecodeParms", parms);
+    }
+    for (size_t i = 0; i < names.size(); i++) {
+        const std::string& name = names[i].as_name();
+        bool jpeg = name == "DCTDecode" || name == "DCT";
+        if ((jpeg && i + 1 != names.size()) || name == "JPXDecode" || name == "CCITTFaxDecode" || name == "CCF" ||
+            name == "JBIG2Decode") {
+            return false;
+        }
+        if (jpeg) {
+            job->color_transform = (int)params[i].as_dict().get("ColorTransform").as_int(-1);
+        }
+    }
+    return true;
+}
+
+// Decodes the image of job to 8-bit samples; false when it cannot be read
+static bool decode_image(const PdfDocument& document, unsigned threads, const ImageJob& job, Bitmap* source) {
+    std::string raw;
+    std::string decoded;
+    std::string error;
+    std::string image_filter;
+    document.stream_data(job.image, &raw);
+    if (!decode_stream_data(job.filters, raw, &decoded, &error, &image_filter)) {
+        return false;
+    }
+    if (!image_filter.empty()) {
+        return jpeg_decode(decoded, source, &error, threads, job.color_transform) && source->width == job.width &&
+               source->height == job.height && source->components == job.components;
+    }
+    size_t size = (size_t)job.width * (size_t)job.height * (size_t)job.components;
+    if (decoded.size() < size) {
+        return false;
+    }
+    source->width = job.width;
+    source->height = job.height;
+    source->components = job.components;
+    source->pixels.assign(decoded.begin(), decoded.begin() + (ptrdiff_t)size);
+    return true;
+}
+
+// Sets job->replacement to the bilevel or resampled image made from source,
+// when it is smaller than the stored one. release frees source as soon as
+// it is no longer needed; the estimate keeps it for the next preset.
+static void encode_image(const CompressOptions& options, unsigned threads, Bitmap* source, bool release,
+                         ImageJob* job) {
+    if (job->bilevel_width > 0) {
+        LumaHistogram histogram;
+        luma_histogram(*source, threads, &histogram);
+        int threshold = bilevel_threshold(histogram);
+        std::vector<uint8_t> bits;
+        std::string g4;
+        if (threshold >= 0 &&
+            binarize_bitmap(*source, job->bilevel_width, job->bilevel_height, threshold, threads, &bits)) {
+            ccitt_g4_encode(bits.data(), job->bilevel_width, job->bilevel_height,
+                            ((size_t)job->bilevel_width + 7) / 8, &g4);
+        }
+        if (!g4.empty() && g4.size() < job->image.as_stream().data.size()) {
+            PdfDict parms;
+            parms.set("K", PdfObject::integer(-1));
+            parms.set("Columns", PdfObject::integer(job->bilevel_width));
+            parms.set("Rows", PdfObject::integer(job->bilevel_height));
+            PdfDict dict = job->image.as_dict();
+            dict.set("Width", PdfObject::integer(job->bilevel_width));
+            dict.set("Height", PdfObject::integer(job->bilevel_height));
+            dict.set("BitsPerComponent", PdfObject::integer(1));
+            dict.set("ColorSpace", PdfObject::name("DeviceGray"));
+            dict.set("Filter", PdfObject::name("CCITTFaxDecode"));
+            dict.set("DecodeParms", PdfObject::dict(std::move(parms)));
+            dict.erase("DL");
+            job->replacement = PdfObject::stream(std::move(dict), std::move(g4));
+            job->bilevel = true;
+            return;
+        }
+    }
+    if (job->target_width == 0) {
+        return;
+    }
+
+    Bitmap resampled;
+    JpegResult jpeg;
+    if (!resample_bitmap(*source, job->target_width, job->target_height, options.filter, threads, &resampled)) {
+        return;
+    }
+    if (release) {
+        *source = Bitmap();
+    }
+    if (!encode_jpeg_to_target(resampled, options.jpeg, threads, &jpeg) ||
+        jpeg.data.size() >= job->image.as_stream().data.size()) {
+        return;
+    }
+    PdfDict dict = job->image.as_dict();
+    dict.set("Width", PdfObject::integer(job->target_width));
+    dict.set("Height", PdfObject::integer(job->target_height));
+    dict.set("BitsPerComponent", PdfObject::integer(8));
+    dict.set("Filter", PdfObject::name("DCTDecode"));
+    dict.erase("DecodeParms");
+    dict.erase("DL");
+    job->replacement = PdfObject::stream(std::move(dict), std::move(jpeg.data));
+}
+
+static void process_image(const PdfDocument& document, const CompressOptions& options, unsigned threads,
+                          ImageJob* job) {
+    Bitmap source;
+    if (decode_image(document, threads, *job, &source)) {
+        encode_image(options, threads, &source, true, job);
+    } else {
+        job->unreadable = true;
+    }
+}
+
+// Opens input for compress_file() and estimate_compression()
+static bool open_input(const std::string& input, PdfDocument* document, PdfErrorCode* error_code, std::string* error) {
+    if (access(input.c_str(), R_OK) != 0) {
+        *error_code = errno == ENOENT ? PdfErrorCode_FileNotFound : PdfErrorCode_PermissionDenied;
+        *error = "cannot open " + input;
+        return false;
+    }
+    if (!document->open(input, error)) {
+        *error_code = PdfErrorCode_InvalidPdf;
+        return false;
+    }
+    if (document->locked()) {
+        *error_code = PdfErrorCode_EncryptedPdf;
+        *error = "document is password protected";
+        return false;
+    }
+    return true;
+}
+
+// Source and resampled samples of job, for the pixel budget
+static uint64_t job_pixels(const ImageJob& job) {
+    return ((uint64_t)job.width * (uint64_t)job.height + (uint64_t)job.target_width * (uint64_t)job.target_height) *
+           (uint64_t)job.components;
+}
+
+static uint64_t pixel_budget() {
+    return memory_budget().share(PIXEL_BUDGET, PIXEL_SHARE);
+}
+
+bool compress_file(const std::string& input, const std::string& output, const CompressOptions& options,
+                   PdfErrorCode* error_code, std::string* error, CompressStats* stats) {
+    if (options.target_dpi <= 0) {
+        *error_code = PdfErrorCode_InvalidParameter;
+        *error = "target resolution must be positive";
+        return false;
+    }
+    PdfDocument document;
+    if (!open_input(input, &document, error_code, error)) {
+        return false;
+    }
+    unsigned threads = options.threads ? options.threads : std::max(1u, std::thread::hardware_concurrency());
+
+    PlacementScanner scanner(document);
+    for (const auto& page : document.pages()) {
+        scanner.scan_page(page);
+    }
+    std::vector<ImageJob> jobs;
+    uint64_t largest = 1;
+    for (const auto& entry : scanner.placements) {
+        ImageJob job;
+        if (plan_image(document, entry.first, entry.second, options, &job)) {
+            largest = std::max(largest, job_pixels(job));
+            jobs.push_back(std::move(job));
+        }
+    }
+    std::sort(jobs.begin(), jobs.end(), [](const ImageJob& a, const ImageJob& b) { return a.num < b.num; });
+
+    // As many images at a time as the pixel budget allows, the rest of the threads inside each
+    unsigned side_by_side = (unsigned)std::max<uint64_t>(1, std::min<uint64_t>(pixel_budget() / largest, threads));
+    side_by_side = std::min<unsigned>(side_by_side, (unsigned)std::max<size_t>(1, jobs.size()));
+    unsigned inner = std::max(1u, threads / side_by_side);
+    run_parallel(jobs.size(), side_by_side, [&](size_t i) {
+        MemoryReservation pixels(std::min(job_pixels(jobs[i]), pixel_budget()));
+        process_image(document, options, inner, &jobs[i]);
+    });
+
+    ObjectReplacements replacements;
+    CompressStats counted;
+    counted.images = scanner.placements.size();
+    for (auto& job : jobs) {
+        counted.unreadable += job.unreadable;
+        if (job.replacement.is_null()) {
+            continue;
+        }
+        counted.resampled++;
+        counted.bilevel += job.bilevel;
+        counted.bytes_before += job.image.as_stream().data.size();
+        counted.bytes_after += job.replacement.as_stream().data.size();
+        replacements[job.num] = std::move(job.replacement);
+        job.image = PdfObject();
+    }
+    if (stats) {
+        *stats = counted;
+    }
+
+    WriteOptions rewrite;
+    rewrite.threads = options.threads;
+    rewrite.security = document.security();
+    rewrite.replacements = &replacements;
+    if (!write_document(document, output, rewrite, error)) {
+        *error_code = PdfErrorCode_IoError;
+        return false;
+    }
+    *error_code = PdfErrorCode_Success;
+    return true;
+}
+
+// Predicted output size and band of one preset from the images sampled so far,
+// by a ratio estimate: the images not sampled are assumed to shrink like the
+// sampled ones did overall, and the band is two of its standard errors wide
+static CompressEstimate estimate_preset(uint64_t unchanged, const std::vector<EstimateImage>& images, size_t preset) {
+    CompressEstimate estimate;
+    double stored = 0;  // bytes of every image the preset plans
+    double sampled_stored = 0;
+    double sampled_written = 0;
+    std::vector<std::pair<double, double>> pairs;  // stored, written
+    for (const auto& image : images) {
+        if (image.written[preset] < 0) {
+            continue;
+        }
+        estimate.images++;
+        stored += (double)image.bytes;
+        if (image.sampled) {
+            estimate.unreadable += image.unreadable;
+            pairs.emplace_back((double)image.bytes, (double)image.written[preset]);
+            sampled_stored += (double)image.bytes;
+            sampled_written += (double)image.written[preset];
+        }
+    }
+    size_t n = pairs.size();
+    size_t total = estimate.images;
+    estimate.sampled = n;
+    double ratio = sampled_stored > 0 ? sampled_written / sampled_stored : 1;
+    double rest = stored - sampled_stored;
+    double predicted = (double)unchanged - stored + sampled_written + ratio * rest;
+    double margin = (double)IMAGE_OVERHEAD_BYTES * (double)total;
+    if (n >= 2 && n < total) {
+        double residuals = 0;
+        for (const auto& pair : pairs) {
+            double residual = pair.second - ratio * pair.first;
+            residuals += residual * residual;
+        }
+        double variance = residuals / (double)(n - 1);
+        margin += 2 * (double)total * std::sqrt((1 - (double)n / (double)total) * variance / (double)n);
+    } else if (n < total) {
+        // Nothing to go by: anywhere between no change and every image gone
+        margin += rest;
+    }
+    // Images are only ever replaced by smaller ones
+    double floor = (double)unchanged - stored + sampled_written;
+    estimate.bytes = (uint64_t)std::llround(std::max(floor, std::min((double)unchanged, predicted)));
+    estimate.low = std::min(estimate.bytes, (uint64_t)std::llround(std::max(floor, predicted - margin)));
+    estimate.high = std::max(estimate.bytes, (uint64_t)std::llround(std::min((double)unchanged, predicted + margin)));
+    return estimate;
+}
+
+bool estimate_compression(const std::string& input, const std::vector<CompressOptions>& presets,
+                          std::vector<CompressEstimate>* estimates, PdfErrorCode* error_code, std::string* error) {
+    if (presets.empty()) {
+        *error_code = PdfErrorCode_InvalidParameter;
+        *error = "no presets to estimate";
+        return false;
+    }
+    for (const auto& preset : presets) {
+        if (preset.target_dpi <= 0) {
+            *error_code = PdfErrorCode_InvalidParameter;
+            *error = "target resolution must be positive";
+            return false;
+        }
+    }
+    PdfDocument document;
+    if (!open_input(input, &document, error_code, error)) {
+        return false;
+    }
+    unsigned threads = presets[0].threads ? presets[0].threads : std::max(1u, std::thread::hardware_concurrency());
+
+    // What compress_file() writes when it replaces nothing
+    WriteOptions rewrite;
+    rewrite.threads = threads;
+    rewrite.security = document.security();
+    uint64_t unchanged = 0;
+    if (!measure_document(document, rewrite, &unchanged, error)) {
+        *error_code = PdfErrorCode_IoError;
+        return false;
+    }
+
+    PlacementScanner scanner(document);
+    for (const auto& page : document.pages()) {
+        scanner.scan_page(page);
+    }
+    // Images any preset would work on; written stays 0 (planned) or -1 until sampled
+    std::vector<EstimateImage> images;
+    for (const auto& entry : scanner.placements) {
+        EstimateImage image;
+        image.num = entry.first;
+        image.written.assign(presets.size(), -1);
+        for (size_t p = 0; p < presets.size(); p++) {
+            ImageJob job;
+            if (plan_image(document, entry.first, entry.second, presets[p], &job)) {
+                image.written[p] = 0;
+                image.bytes = job.image.as_stream().data.size();
+            }
+        }
+        if (image.bytes > 0) {
+            images.push_back(std::move(image));
+        }
+    }
+    // Smallest first, so evenly spaced picks cover every size of image
+    std::sort(images.begin(), images.end(), [](const EstimateImage& a, const EstimateImage& b) {
+        return a.bytes != b.bytes ? a.bytes < b.bytes : a.num < b.num;
+    });
+
+    std::vector<size_t> wanted(presets.size(), 0);
+    for (size_t p = 0; p < presets.size(); p++) {
+        size_t planned = 0;
+        for (const auto& image : images) {
+            planned += image.written[p] >= 0;
+        }
+        size_t count = (size_t)std::ceil((double)planned * SAMPLE_SHARE);
+        wanted[p] = std::min(planned, std::max(MIN_SAMPLED_IMAGES, std::min(MAX_SAMPLED_IMAGES, count)));
+    }
+    estimates->assign(presets.size(), CompressEstimate());
+    for (;;) {
+        // Evenly spaced picks among the images each preset plans
+        std::vector<size_t> picked;
+        for (size_t p = 0; p < presets.size(); p++) {
+            std::vector<size_t> planned;
+            for (size_t i = 0; i < images.size(); i++) {
+                if (images[i].written[p] >= 0) {
+                    planned.push_back(i);
+                }
+            }
+            for (size_t k = 0; k < wanted[p]; k++) {
+                size_t i = planned[(size_t)(((double)k + 0.5) * (double)planned.size() / (double)wanted[p])];
+                if (!images[i].sampled) {
+                    images[i].sampled = true;
+                    picked.push_back(i);
+                }
+            }
+        }
+        std::sort(picked.begin(), picked.end());
+        picked.erase(std::unique(picked.begin(), picked.end()), picked.end());
+
+        // Each picked image is decoded once and encoded the way every preset that plans it would
+        std::vector<std::vector<ImageJob>> jobs(picked.size(), std::vector<ImageJob>(presets.size()));
+        uint64_t largest = 1;
+        for (size_t k = 0; k < picked.size(); k++) {
+            EstimateImage& image = images[picked[k]];
+            for (size_t p = 0; p < presets.size(); p++) {
+                if (image.written[p] < 0) {
+                    continue;
+                }
+                image.written[p] = (int64_t)image.bytes;
+                if (plan_image(document, image.num, scanner.placements[image.num], presets[p], &jobs[k][p])) {
+                    largest = std::max(largest, job_pixels(jobs[k][p]));
+                } else {
+                    jobs[k][p] = ImageJob();
+                }
+            }
+        }
+        unsigned side_by_side = (unsigned)std::max<uint64_t>(1, std::min<uint64_t>(pixel_budget() / largest, threads));
+        side_by_side = std::min<unsigned>(side_by_side, (unsigned)std::max<size_t>(1, picked.size()));
+        unsigned inner = std::max(1u, threads / side_by_side);
+        run_parallel(picked.size(), side_by_side, [&](size_t k) {
+            uint64_t most = 0;
+            for (const auto& job : jobs[k]) {
+                most = std::max(most, job.num ? job_pixels(job) : 0);
+            }
+            MemoryReservation pixels(std::min(most, pixel_budget()));
+            Bitmap source;
+            bool decoded = false;
+            for (size_t p = 0; p < presets.size(); p++) {
+                ImageJob& job = jobs[k][p];
+                if (job.num == 0) {
+                    continue;
+                }
+                if (!decoded && !(decoded = decode_image(document, inner, job, &source))) {
+                    images[picked[k]].unreadable = true;
+                    break;
+                }
+                encode_image(presets[p], inner, &source, false, &job);
+                if (!job.replacement.is_null()) {
+                    images[picked[k]].written[p] = (int64_t)job.replacement.as_stream().data.size();
+                }
+                job = ImageJob();
+            }
+        });
+
+        // More samples for the presets whose band is still wide, while there are any to take
+        bool more = false;
+        for (size_t p = 0; p < presets.size(); p++) {
+            CompressEstimate& estimate = (*estimates)[p];
+            estimate = estimate_preset(unchanged, images, p);
+            size_t share = (size_t)std::ceil((double)estimate.images * MAX_SAMPLE_SHARE);
+            size_t limit = std::min(estimate.images, std::min(MAX_SAMPLED_IMAGES, std::max(MIN_SAMPLED_IMAGES, share)));
+            if ((double)(estimate.high - estimate.low) > 2 * BAND_TARGET * (double)estimate.bytes &&
+                wanted[p] < limit) {
+                wanted[p] = std::min(limit, wanted[p] * 2);
+                more = true;
+            }
+        }
+        if (!more) {
+            break;
+        }
+    }
+    *error_code = PdfErrorCode_Success;
+    return true;
+}
+
+} // namespace spdf
@@ -0,0 +1,84 @@
+#ifndef SPDF_COMPRESS_H
+#define SPDF_COMPRESS_H
+
+#include <cstdint>
+#include <string>
+#include <vector>
+#include "spdf_image.h"
+#include "spdfcore.h"
+
+namespace spdf {
+
+struct CompressOptions {
+    // Resolution images are resampled to, from the largest size they are
+    // shown at on any page
+    double target_dpi = 150;
+    // Images are only touched when they have this many times the pixels the
+    // target needs along one axis
+    double threshold = 1.5;
+    ResampleFilter filter = ResampleFilter::Lanczos3;
+    JpegTarget jpeg;
+    // Images of black-and-white pages (see bilevel_threshold()) are stored
+    // as 1-bit CCITT G4 at bilevel_dpi, which keeps small print legible
+    bool bilevel = true;
+    double bilevel_dpi = 300;
+    // 0 uses every core
+    unsigned threads = 0;
+};
+
+struct CompressStats {
+    size_t images = 0;          // image XObjects shown by the pages
+    size_t resampled = 0;       // replaced by a smaller JPEG or 1-bit image
+    size_t bilevel = 0;         // of those, the 1-bit ones
+    size_t unreadable = 0;      // oversized but kept because they could not be decoded
+    uint64_t bytes_before = 0;  // stream bytes of the replaced images
+    uint64_t bytes_after = 0;
+};
+
+struct CompressEstimate {
+    uint64_t bytes = 0;  // predicted size of the compressed file
+    uint64_t low = 0;    // the size should fall within [low, high], about 19 times in 20
+    uint64_t high = 0;
+    size_t images = 0;   // images the preset would try to shrink
+    size_t sampled = 0;  // of those, decoded and encoded to measure it
+    size_t unreadable = 0;  // of the sampled, those that could not be decoded and stay as stored
+};
+
+// Rewrites input to output with its oversized images downsampled. The page
+// contents (and the forms they run) are interpreted for the transformation
+// matrix at every image XObject they show, which gives the resolution each
+// image is displayed at. 8-bit gray and RGB images stored as JPEG
+// (/DCTDecode) or with lossless filters are decoded, resampled to
+// target_dpi and re-encoded as JPEG at the quality options.jpeg asks for;
+// the result replaces the image only when it is smaller. Page-sized images
+// whose luma histogram is that of black text on white paper become 1-bit
+// /CCITTFaxDecode images instead, whatever their resolution. Images are
+// processed side by side, as many at a time as memory allows, and each one
+// spreads its resampling and coding over the remaining threads. Image masks,
+// indexed, CMYK and colour-keyed images, inline images and images only used
+// by patterns or annotations are left alone, and so are images the decoders
+// cannot read (progressive JPEG among them); stats counts those apart.
+//
+// Encrypted input that opens with the empty password keeps its encryption.
+// output may be input. Failures are reported with the spdfcore C ABI error
+// codes.
+bool compress_file(const std::string& input, const std::string& output, const CompressOptions& options,
+                   PdfErrorCode* error_code, std::string* error, CompressStats* stats = nullptr);
+
+// Predicts the size compress_file() would write for each of presets without
+// writing anything, so a choice of presets can be shown with their results.
+// The file without any image replaced is measured exactly (see
+// measure_document()). Of the images a preset would try to shrink, a sample
+// spread evenly over their stored sizes is decoded once and encoded the way
+// every preset that plans it would; the rest are assumed to shrink by the
+// sample's overall ratio, and the band around the prediction is about two
+// standard errors of that ratio estimate wide. Documents without oversized
+// images are measured exactly; the cost otherwise is a decode of at most a
+// few dozen images, whatever the document's length. presets[0].threads is
+// used throughout.
+bool estimate_compression(const std::string& input, const std::vector<CompressOptions>& presets,
+                          std::vector<CompressEstimate>* estimates, PdfErrorCode* error_code, std::string* error);
+
+} // namespace spdf
+
+#endif // SPDF_COMPRESS_H
@@ -0,0 +1,67 @@
+#ifndef SPDF_DIGEST_H
+#define SPDF_DIGEST_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+namespace spdf {
+
+// Message digests used by the PDF standard security handler (ISO 32000-2 7.6.4).
+// Portable implementations: key derivation hashes a few hundred bytes per
+// document, so they are never on the bulk data path.
+
+class Md5 {
+public:
+    Md5();
+    void update(const void* data, size_t size);
+    void final(uint8_t digest[16]);
+
+private:
+    void block(const uint8_t* data);
+
+    uint32_t state_[4];
+    uint64_t length_ = 0;
+    uint8_t buffer_[64];
+};
+
+class Sha256 {
+public:
+    Sha256();
+    void update(const void* data, size_t size);
+    void final(uint8_t digest[32]);
+
+private:
+    void block(const uint8_t* data);
+
+    uint32_t state_[8];
+    uint64_t length_ = 0;
+    uint8_t buffer_[64];
+};
+
+// SHA-512, or SHA-384 when constructed with bits = 384
+class Sha512 {
+public:
+    explicit Sha512(int bits = 512);
+    void update(const void* data, size_t size);
+    // Writes 48 bytes for SHA-384, 64 for SHA-512
+    void final(uint8_t* digest);
+
+private:
+    void block(const uint8_t* data);
+
+    uint64_t state_[8];
+    uint64_t length_ = 0;
+    uint8_t buffer_[128];
+    int bits_;
+};
+
+// One-shot helpers returning the raw digest bytes
+std::string md5(const std::string& data);
+std::string sha256(const std::string& data);
+std::string sha384(const std::string& data);
+std::string sha512(const std::string& data);
+
+} // namespace spdf
+
+#endif // SPDF_DIGEST_H
@@ -0,0 +1,790 @@
+#include "spdf_document.h"
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <unordered_set>
+#include "spdf_file_identity.h"
+#include "spdf_filters.h"
+#include "spdf_io.h"
+#include "spdf_parser.h"
+#include "spdf_recovery.h"
+
+namespace spdf {
+
+// Object numbers above this are treated as corrupt rather than allocated for
+static const uint64_t MAX_OBJECT_NUMBER = 8u << 20;
+static const int MAX_REFERENCE_CHAIN = 32;
+static const int MAX_PAGE_TREE_DEPTH = 64;
+static const char* const INHERITABLE_PAGE_KEYS[] = {"Resources", "MediaBox", "CropBox", "Rotate"};
+
+bool PdfDocument::open(const std::string& path, std::string* error, const std::string& password) {
+    // The previous file goes before room is waited for, the whole file is read in once there is room
+    data_ = std::string();
+    memory_ = MemoryReservation();
+    FileIdentity identity;
+    MemoryReservation reserved(FileIdentity::of(path, &identity) ? identity.size : 0);
+    std::string data;
+    if (!read_file(path, &data, error)) {
+        return false;
+    }
+    memory_ = std::move(reserved);
+    return open_memory(std::move(data), error, password);
+}
+
+bool PdfDocument::open_memory(std::string data, std::string* error, const std::string& password) {
+    data_ = std::move(data);
+    memory_.resize(data_.size());
+    xref_.clear();
+    xref_set_.clear();
+    trailer_ = PdfDict();
+    pages_.clear();
+    cache_.clear();
+    object_streams_.clear();
+    security_.reset();
+    encrypt_num_ = 0;
+    recovered_ = false;
+    return load(password, error);
+}
+
+bool PdfDocument::load(const std::string& password, std::string* error) {
+    size_t header_window = std::min<size_t>(data_.size(), 1024);
+    const char* header = (const char*)memmem(data_.data(), header_window, "%PDF-", 5);
+    if (!header) {
+        *error = "missing %PDF- header";
+        return false;
+    }
+    size_t version_at = (size_t)(header - data_.data()) + 5;
+    version_ = data_.substr(version_at, 3);
+
+    if (read_xref(error)) {
+        if (trailer_.has("Encrypt")) {
+            load_security(password);
+        }
+        catalog_ = resolve(trailer_.get("Root"));
+        if (!catalog_.is_dict() && locked()) {
+            // A catalog inside an encrypted object stream cannot be read without the key
+            return true;
+        }
+        if (!catalog_.is_dict()) {
+            *error = "missing document catalog";
+        } else if (load_pages(error)) {
+            // An empty tree is fine when it says so; otherwise its pages were lost
+            if (!pages_.empty() || lookup(lookup(catalog(), "Pages").as_dict(), "Count").as_int() <= 0) {
+                return true;
+            }
+            *error = "page tree has no readable pages";
+        }
+    }
+
+    // Damaged cross-reference data, catalog or page tree: rebuild from the objects themselves
+    std::string damage = *error;
+    if (recover(password, error)) {
+        return true;
+    }
+    *error = damage;
+    return false;
+}
+
+bool PdfDocument::read_xref(std::string* error) {
+    // startxref sits in the last kilobyte or so; search backwards for the final one
+    size_t tail = data_.size() > 4096 ? data_.size() - 4096 : 0;
+    size_t startxref = std::string::npos;
+    for (size_t i = data_.size(); i-- > tail + 9;) {
+        if (memcmp(data_.data() + i - 9, "startxref", 9) == 0) {
+            startxref = i;
+            break;
+        }
+    }
+    if (startxref == std::string::npos) {
+        *error = "missing startxref";
+        return false;
+    }
+    int64_t first_section = strtoll(data_.c_str() + startxref, nullptr, 10);
+    if (first_section <= 0 || (uint64_t)first_section >= data_.size()) {
+        *error = "startxref points outside the file";
+        return false;
+    }
+
+    std::vector<size_t> pending{(size_t)first_section};
+    std::unordered_set<size_t> visited;
+    while (!pending.empty()) {
+        size_t offset = pending.back();
+        pending.pop_back();
+        if (!visited.insert(offset).second) {
+            continue;
+        }
+        if (!read_xref_section(offset, &pending, error)) {
+            // Only the newest section is essential; older ones may be stale
+            if (visited.size() == 1) {
+                return false;
+            }
+            error->clear();
+        }
+    }
+    return true;
+}
+
+void PdfDocument::load_security(const std::string& password) {
+    const PdfObject& reference = trailer_.get("Encrypt");
+    encrypt_num_ = reference.is_ref() ? reference.as_ref().num : 0;
+    PdfObject encrypt = resolve(reference);
+    const PdfArray& id = trailer_.get("ID").as_array();
+    auto handler = std::make_unique<SecurityHandler>();
+    bool authenticated = false;
+    std::string handler_error;
+    if (!encrypt.is_dict() ||
+        !handler->open(encrypt.as_dict(), id.empty() ? std::string() : id[0].as_string(), password, &authenticated,
+                       &handler_error)) {
+        // Unsupported handlers leave the document locked but still browsable
+        return;
+    }
+    if (authenticated) {
+        security_ = std::move(handler);
+        // Objects parsed while reading the cross-reference data were not decrypted
+        cache_.clear();
+        object_streams_.clear();
+    }
+}
+
+void PdfDocument::decrypt_strings(ObjectRef ref, PdfObject* object, int depth) const {
+    if (depth > 64) {
+        return;
+    }
+    switch (object->type()) {
+        case PdfType::String:
+            *object = PdfObject::string(security_->decrypt(ref, object->as_string(), false), object->hex_string());
+            break;
+        case PdfType::Array:
+            for (auto& item : object->mutable_array()) {
+                decrypt_strings(ref, &item, depth + 1);
+            }
+            break;
+        case PdfType::Dictionary:
+        case PdfType::Stream:
+            for (auto& entry : object->mutable_dict()) {
+                decrypt_strings(ref, &entry.second, depth + 1);
+            }
+            break;
+        default:
+            break;
+    }
+}
+
+bool PdfDocument::object_ref(uint32_t num, ObjectRef* ref) const {
+    if (num >= xref_.size() || xref_[num].type == 0) {
+        return false;
+    }
+    ref->num = num;
+    ref->gen = xref_[num].type == 1 ? xref_[num].gen : 0;
+    return true;
+}
+
+void PdfDocument::set_entry(uint32_t num, const XrefEntry& entry) {
+    if (num >= xref_.size()) {
+        xref_.resize(num + 1);
+        xref_set_.resize(num + 1, false);
+    }
+    if (!xref_set_[num]) {
+        xref_[num] = entry;
+        // Free entries don't shadow older sections, so hybrid files can supply
+        // the compressed objects through /XRefStm
+        xref_set_[num] = entry.type != 0;
+    }
+}
+
+bool PdfDocument::read_xref_section(size_t offset, std::vector<size_t>* pending, std::string* error) {
+    Lexer lexer(data_.data(), data_.size());
+    lexer.seek(offset);
+    Token token;
+    if (lexer.next(&token) && token.type == TokenType::Keyword && token.text == "xref") {
+        return read_xref_table(lexer.position(), pending, error);
+    }
+    return read_xref_stream(offset, pending, error);
+}
+
+// Merges a section's trailer into the document trailer; newer sections win
+static void merge_trailer(const PdfDict& section, PdfDict* trailer) {
+    static const char* const skipped[] = {"Prev", "XRefStm", "Type", "W", "Index", "Length", "Filter", "DecodeParms"};
+    for (const auto& entry : section) {
+        if (std::find_if(std::begin(skipped), std::end(skipped),
+                         [&](const char* key) { return entry.first == key; }) != std::end(skipped)) {
+            continue;
+        }
+        if (!trailer->has(entry.first)) {
+            trailer->set(entry.first, entry.second);
+        }
+    }
+}
+
+bool PdfDocument::read_xref_table(size_t offset, std::vector<size_t>* pending, std::string* error) {
+    ObjectParser parser(data_.data(), data_.size());
+    Lexer& lexer = parser.lexer();
+    lexer.seek(offset);
+    Token token;
+    while (true) {
+        if (!lexer.next(&token)) {
+            *error = "truncated cross-reference table";
+            return false;
+        }
+        if (token.type == TokenType::Keyword && token.text == "trailer") {
+            break;
+        }
+        Token count;
+        if (token.type != TokenType::Integer || !lexer.next(&count) || count.type != TokenType::Integer ||
+            token.integer < 0 || count.integer < 0 || (uint64_t)(token.integer + count.integer) > MAX_OBJECT_NUMBER) {
+            *error = "malformed cross-reference subsection";
+            return false;
+        }
+        for (int64_t i = 0; i < count.integer; i++) {
+            Token position;
+            Token generation;
+            Token kind;
+            if (!lexer.next(&position) || !lexer.next(&generation) || !lexer.next(&kind) ||
+                position.type != TokenType::Integer || generation.type != TokenType::Integer) {
+                *error = "malformed cross-reference entry";
+                return false;
+            }
+            XrefEntry entry;
+            entry.type = kind.text == "n" ? 1 : 0;
+            entry.gen = (uint16_t)generation.integer;
+            entry.offset = (uint64_t)position.integer;
+            // Object 0 is always free; some writers start subsections at 1 by mistake
+            if (entry.type == 1 && entry.offset == 0) {
+                entry.type = 0;
+            }
+            set_entry((uint32_t)(token.integer + i), entry);
+        }
+    }
+
+    PdfObject trailer;
+    if (!parser.parse(&trailer, error) || !trailer.is_dict()) {
+        if (error->empty()) {
+            *error = "malformed trailer";
+        }
+        return false;
+    }
+    merge_trailer(trailer.as_dict(), &trailer_);
+    // Process /XRefStm before /Prev: it belongs to this revision
+    const PdfObject& prev = trailer.as_dict().get("Prev");
+    if (prev.is_int() && prev.as_int() > 0) {
+        pending->push_back((size_t)prev.as_int());
+    }
+    const PdfObject& stream = trailer.as_dict().get("XRefStm");
+    if (stream.is_int() && stream.as_int() > 0) {
+        pending->push_back((size_t)stream.as_int());
+    }
+    return true;
+}
+
+bool PdfDocument::read_xref_stream(size_t offset, std::vector<size_t>* pending, std::string* error) {
+    ObjectParser parser(data_.data(), data_.size());
+    parser.lexer().seek(offset);
+    ObjectRef ref;
+    PdfObject object;
+    auto resolve_length = [this](ObjectRef length) { return this->resolve_length(length); };
+    if (!parser.parse_indirect(resolve_length, &ref, &object, error)) {
+        *error = "cross-reference data not found at offset " + std::to_string(offset);
+        return false;
+    }
+    const PdfDict& dict = object.as_dict();
+    if (!object.is_stream() || !dict.get("Type").is_name("XRef")) {
+        *error = "cross-reference data not found at offset " + std::to_string(offset);
+        return false;
+    }
+    std::string data;
+    if (!decode_stream_data(dict, object.as_stream().data, &data, error)) {
+        return false;
+    }
+
+    const PdfArray& w = dict.get("W").as_array();
+    if (w.size() < 3) {
+        *error = "cross-reference stream without /W";
+        return false;
+    }
+    int widths[3];
+    for (int i = 0; i < 3; i++) {
+        widths[i] = (int)w[i].as_int();
+        if (widths[i] < 0 || widths[i] > 8) {
+            *error = "invalid /W in cross-reference stream";
+            return false;
+        }
+    }
+    size_t entry_size = (size_t)(widths[0] + widths[1] + widths[2]);
+    if (entry_size == 0) {
+        *error = "invalid /W in cross-reference stream";
+        return false;
+    }
+
+    std::vector<int64_t> index;
+    for (const auto& value : dict.get("Index").as_array()) {
+        index.push_back(value.as_int());
+    }
+    if (index.size() < 2) {
+        index = {0, dict.get("Size").as_int()};
+    }
+
+    const unsigned char* p = (const unsigned char*)data.data();
+    size_t remaining = data.size();
+    auto field = [&](int width, uint64_t fallback) {
+        if (width == 0) {
+            return fallback;
+        }
+        uint64_t value = 0;
+        for (int i = 0; i < width; i++) {
+            value = value << 8 | *p++;
+        }
+        return value;
+    };
+    for (size_t s = 0; s + 1 < index.size(); s += 2) {
+        int64_t first = index[s];
+        int64_t count = index[s + 1];
+        if (first < 0 || count < 0 || (uint64_t)(first + count) > MAX_OBJECT_NUMBER) {
+            *error = "invalid /Index in cross-reference stream";
+            return false;
+        }
+        for (int64_t i = 0; i < count && remaining >= entry_size; i++) {
+            remaining -= entry_size;
+            XrefEntry entry;
+            uint64_t type = field(widths[0], 1);
+            uint64_t second = field(widths[1], 0);
+            uint64_t third = field(widths[2], 0);
+            if (type == 1) {
+                entry.type = 1;
+                entry.offset = second;
+                entry.gen = (uint16_t)third;
+            } else if (type == 2) {
+                entry.type = 2;
+                entry.offset = second;
+                entry.index = (uint32_t)third;
+            }
+            set_entry((uint32_t)(first + i), entry);
+        }
+    }
+
+    merge_trailer(dict, &trailer_);
+    const PdfObject& prev = dict.get("Prev");
+    if (prev.is_int() && prev.as_int() > 0) {
+        pending->push_back((size_t)prev.as_int());
+    }
+    return true;
+}
+
+int64_t PdfDocument::resolve_length(ObjectRef ref) {
+    PdfObject length = get(ref);
+    return length.is_int() ? length.as_int() : -1;
+}
+
+PdfObject PdfDocument::get(ObjectRef ref) {
+    if (ref.num >= xref_.size()) {
+        return PdfObject();
+    }
+    auto cached = cache_.find(ref.num);
+    if (cached != cache_.end()) {
+        return cached->second;
+    }
+    if (std::find(loading_.begin(), loading_.end(), ref.num) != loading_.end()) {
+        return PdfObject();
+    }
+    loading_.push_back(ref.num);
+    PdfObject object = load_object(ref.num);
+    loading_.pop_back();
+    cache_[ref.num] = object;
+    return object;
+}
+
+PdfObject PdfDocument::load_object(uint32_t num) {
+    const XrefEntry& entry = xref_[num];
+    if (entry.type == 2) {
+        return load_from_object_stream(num, entry);
+    }
+    if (entry.type != 1 || entry.offset >= data_.size()) {
+        return PdfObject();
+    }
+    ObjectParser parser(data_.data(), data_.size());
+    parser.lexer().seek((size_t)entry.offset);
+    ObjectRef ref;
+    PdfObject object;
+    std::string error;
+    auto resolve_length = [this](ObjectRef length) { return this->resolve_length(length); };
+    if (!parser.parse_indirect(resolve_length, &ref, &object, &error) || ref.num != num) {
+        return PdfObject();
+    }
+    // Objects inside object streams were decrypted along with their container
+    if (security_ && num != encrypt_num_) {
+        const PdfDict& dict = object.as_dict();
+        bool clear_stream = object.is_stream() && (dict.get("Type").is_name("XRef") ||
+                            (!security_->encrypt_metadata() && dict.get("Type").is_name("Metadata")));
+        if (!dict.get("Type").is_name("XRef")) {
+            decrypt_strings(ref, &object, 0);
+        }
+        if (object.is_stream() && !clear_stream) {
+            object.mutable_stream().encrypted = true;
+            object.mutable_stream().crypt_ref = ref;
+        }
+    }
+    return object;
+}
+
+std::shared_ptr<PdfDocument::ObjectStream> PdfDocument::object_stream(uint32_t stream_num) {
+    auto found = object_streams_.find(stream_num);
+    if (found != object_streams_.end()) {
+        return found->second;
+    }
+    ObjectRef stream_ref;
+    stream_ref.num = stream_num;
+    PdfObject container = get(stream_ref);
+    if (!container.is_stream()) {
+        return nullptr;
+    }
+    auto stream = std::make_shared<ObjectStream>();
+    std::string error;
+    if (!decode_stream(container, &stream->data, &error)) {
+        return nullptr;
+    }
+    int64_t count = lookup(container.as_dict(), "N").as_int();
+    int64_t first = lookup(container.as_dict(), "First").as_int();
+    if (count < 0 || first < 0 || (uint64_t)first > stream->data.size()) {
+        return nullptr;
+    }
+    Lexer header(stream->data.data(), (size_t)first);
+    for (int64_t i = 0; i < count; i++) {
+        Token object_num;
+        Token offset;
+        if (!header.next(&object_num) || !header.next(&offset) || object_num.type != TokenType::Integer ||
+            offset.type != TokenType::Integer) {
+            break;
+        }
+        stream->objects.emplace_back((uint32_t)object_num.integer, (size_t)(first + offset.integer));
+    }
+    object_streams_[stream_num] = stream;
+    return stream;
+}
+
+PdfObject PdfDocument::load_from_object_stream(uint32_t num, const XrefEntry& entry) {
+    std::shared_ptr<ObjectStream> stream = object_stream((uint32_t)entry.offset);
+    if (!stream) {
+        return PdfObject();
+    }
+
+    // Trust the index from the cross-reference entry, but fall back to a search
+    size_t position = std::string::npos;
+    if (entry.index < stream->objects.size() && stream->objects[entry.index].first == num) {
+        position = stream->objects[entry.index].second;
+    } else {
+        for (const auto& object : stream->objects) {
+            if (object.first == num) {
+                position = object.second;
+                break;
+            }
+        }
+    }
+    if (position >= stream->data.size()) {
+        return PdfObject();
+    }
+    ObjectParser parser(stream->data.data(), stream->data.size());
+    parser.lexer().seek(position);
+    PdfObject object;
+    std::string error;
+    if (!parser.parse(&object, &error)) {
+        return PdfObject();
+    }
+    return object;
+}
+
+PdfObject PdfDocument::resolve(const PdfObject& object) {
+    PdfObject current = object;
+    for (int i = 0; i < MAX_REFERENCE_CHAIN && current.is_ref(); i++) {
+        current = get(current.as_ref());
+    }
+    return current.is_ref() ? PdfObject() : current;
+}
+
+PdfObject PdfDocument::lookup(const PdfDict& dict, const std::string& key) {
+    return resolve(dict.get(key));
+}
+
+bool PdfDocument::decode_stream(const PdfObject& stream, std::string* output, std::string* error) {
+    if (!stream.is_stream()) {
+        *error = "not a stream";
+        return false;
+    }
+    const PdfDict& dict = stream.as_dict();
+    const std::string* raw = &stream.as_stream().data;
+    std::string decrypted;
+    if (stream.as_stream().encrypted) {
+        stream_data(stream, &decrypted);
+        raw = &decrypted;
+    }
+    const PdfObject* filter = dict.find("Filter");
+    const PdfObject* params = dict.find("DecodeParms");
+    if ((!filter || !filter->is_ref()) && (!params || !params->is_ref()) &&
+        !(filter && filter->is_array()) && !(params && params->is_array())) {
+        return decode_stream_data(dict, *raw, output, error);
+    }
+
+    // Make /Filter and /DecodeParms (and their array elements) direct
+    PdfDict direct;
+    for (const char* key : {"Filter", "DecodeParms"}) {
+        PdfObject value = lookup(dict, key);
+        if (value.is_array()) {
+            PdfArray items;
+            for (const auto& item : value.as_array()) {
+                items.push_back(resolve(item));
+            }
+            value = PdfObject::array(std::move(items));
+        }
+        if (!value.is_null()) {
+            direct.set(key, value);
+        }
+    }
+    return decode_stream_data(direct, *raw, output, error);
+}
+
+bool PdfDocument::decode_contents(const PdfObject& contents, std::string* output, std::string* error) {
+    output->clear();
+    if (contents.is_stream()) {
+        return decode_stream(contents, output, error);
+    }
+    bool complete = true;
+    std::string decoded;
+    for (const auto& part : contents.as_array()) {
+        PdfObject stream = resolve(part);
+        if (!decode_stream(stream, &decoded, error)) {
+            complete = false;
+            continue;
+        }
+        *output += decoded;
+        *output += '\n';
+    }
+    return complete;
+}
+
+void PdfDocument::stream_data(const PdfObject& stream, std::string* output) const {
+    const PdfStream& body = stream.as_stream();
+    if (body.encrypted && security_) {
+        *output = security_->decrypt(body.crypt_ref, body.data, true);
+    } else {
+        *output = body.data;
+    }
+}
+
+bool PdfDocument::recover(const std::string& password, std::string* error) {
+    RecoveryScan scan;
+    scan_objects(data_.data(), data_.size(), &scan);
+    xref_.clear();
+    xref_set_.clear();
+    trailer_ = PdfDict();
+    catalog_ = PdfObject();
+    pages_.clear();
+    cache_.clear();
+    object_streams_.clear();
+    security_.reset();
+    encrypt_num_ = 0;
+
+    // Later copies of an object replace earlier ones, as an incremental update would
+    for (const auto& object : scan.objects) {
+        if (object.num >= xref_.size()) {
+            xref_.resize(object.num + 1);
+        }
+        XrefEntry& entry = xref_[object.num];
+        entry.type = 1;
+        entry.gen = object.gen;
+        entry.offset = object.offset;
+    }
+    xref_set_.assign(xref_.size(), true);
+    auto newest = [&](const ScannedObject& object) { return xref_[object.num].offset == object.offset; };
+
+    // Trailers and cross-reference stream dictionaries that survived, newest first
+    std::vector<std::pair<size_t, uint32_t>> sections;  // offset, stream object number (0 for a trailer)
+    for (size_t offset : scan.trailers) {
+        sections.emplace_back(offset, 0);
+    }
+    for (const auto& object : scan.objects) {
+        if (object.kind == ScannedObject::Kind::XrefStream && newest(object)) {
+            sections.emplace_back(object.offset, object.num);
+        }
+    }
+    std::sort(sections.rbegin(), sections.rend());
+    ObjectParser parser(data_.data(), data_.size());
+    for (const auto& section : sections) {
+        PdfObject dict;
+        std::string ignored;
+        if (section.second) {
+            dict = get(ObjectRef{section.second, xref_[section.second].gen});
+        } else {
+            parser.lexer().seek(section.first + 7);
+            parser.parse(&dict, &ignored);
+        }
+        if (dict.is_dict()) {
+            merge_trailer(dict.as_dict(), &trailer_);
+        }
+    }
+    trailer_.erase("Size");
+
+    // Without a usable trailer, fall back to the newest security dictionary in the file
+    const ScannedObject* encrypt = nullptr;
+    for (const auto& object : scan.objects) {
+        if (object.kind == ScannedObject::Kind::Encrypt && newest(object)) {
+            encrypt = &object;
+        }
+    }
+    if (!trailer_.has("Encrypt") && encrypt) {
+        trailer_.set("Encrypt", PdfObject::reference(ObjectRef{encrypt->num, encrypt->gen}));
+    }
+    if (trailer_.has("Encrypt")) {
+        load_security(password);
+    }
+
+    // Members of object streams that have no copy of their own
+    std::vector<uint32_t> compressed;
+    for (auto object = scan.objects.rbegin(); object != scan.objects.rend(); ++object) {
+        if (object->kind != ScannedObject::Kind::ObjectStream || !newest(*object)) {
+            continue;
+        }
+        std::shared_ptr<ObjectStream> stream = object_stream(object->num);
+        for (size_t i = 0; stream && i < stream->objects.size(); i++) {
+            uint32_t num = stream->objects[i].first;
+            if (num == 0 || num > MAX_OBJECT_NUMBER) {
+                continue;
+            }
+            if (num >= xref_.size()) {
+                xref_.resize(num + 1);
+            }
+            if (xref_[num].type == 0) {
+                xref_[num].type = 2;
+                xref_[num].offset = object->num;
+                xref_[num].index = (uint32_t)i;
+                compressed.push_back(num);
+            }
+        }
+    }
+    xref_set_.assign(xref_.size(), true);
+
+    // The catalog and pages the fallbacks below need may be compressed too
+    std::sort(compressed.begin(), compressed.end());
+    for (uint32_t num : compressed) {
+        const PdfObject& type = get(ObjectRef{num, 0}).as_dict().get("Type");
+        if (type.is_name("Catalog") || type.is_name("Page")) {
+            ScannedObject object;
+            object.num = num;
+            object.kind = type.is_name("Catalog") ? ScannedObject::Kind::Catalog : ScannedObject::Kind::Page;
+            scan.objects.push_back(object);
+        }
+    }
+    auto live = [&](const ScannedObject& object) { return object.offset ? newest(object) : true; };
+    const ScannedObject* catalog = nullptr;
+    for (const auto& object : scan.objects) {
+        if (object.kind == ScannedObject::Kind::Catalog && live(object)) {
+            catalog = &object;
+        }
+    }
+    if (!resolve(trailer_.get("Root")).as_dict().get("Type").is_name("Catalog") && catalog) {
+        trailer_.set("Root", PdfObject::reference(ObjectRef{catalog->num, catalog->gen}));
+    }
+
+    catalog_ = resolve(trailer_.get("Root"));
+    if (!catalog_.is_dict()) {
+        if (locked()) {
+            error->clear();
+            recovered_ = true;
+            return true;
+        }
+        *error = "no document catalog found";
+        return false;
+    }
+
+    // A page tree with lost branches gives way to the page objects in file order
+    if (!load_pages(error) || pages_.empty()) {
+        pages_.clear();
+        for (const auto& object : scan.objects) {
+            if (object.kind != ScannedObject::Kind::Page || !live(object)) {
+                continue;
+            }
+            PdfPage page;
+            page.ref = ObjectRef{object.num, object.gen};
+            page.dict = get(page.ref).as_dict();
+            PdfObject parent = lookup(page.dict, "Parent");
+            for (int depth = 0; parent.is_dict() && depth < MAX_PAGE_TREE_DEPTH; depth++) {
+                for (const char* key : INHERITABLE_PAGE_KEYS) {
+                    const PdfObject* value = parent.as_dict().find(key);
+                    if (value && !page.dict.has(key)) {
+                        page.dict.set(key, *value);
+                    }
+                }
+                parent = lookup(parent.as_dict(), "Parent");
+            }
+            pages_.push_back(std::move(page));
+        }
+        if (pages_.empty()) {
+            *error = "no pages found";
+            return false;
+        }
+    }
+    error->clear();
+    recovered_ = true;
+    return true;
+}
+
+bool PdfDocument::load_pages(std::string* error) {
+    PdfObject root = lookup(catalog_.as_dict(), "Pages");
+    if (!root.is_dict()) {
+        *error = "missing page tree";
+        return false;
+    }
+
+    struct Node {
+        PdfObject dict;
+        ObjectRef ref;
+        PdfDict inherited;
+        int depth;
+    };
+    std::unordered_set<uint32_t> visited;
+    std::vector<Node> stack;
+    stack.push_back(Node{root, catalog_.as_dict().get("Pages").as_ref(), PdfDict(), 0});
+    while (!stack.empty()) {
+        Node node = std::move(stack.back());
+        stack.pop_back();
+        const PdfDict& dict = node.dict.as_dict();
+
+        PdfDict inherited = node.inherited;
+        for (const char* key : INHERITABLE_PAGE_KEYS) {
+            const PdfObject* value = dict.find(key);
+            if (value) {
+                inherited.set(key, *value);
+            }
+        }
+
+        PdfObject kids = lookup(dict, "Kids");
+        if (kids.is_array() && !dict.get("Type").is_name("Page")) {
+            if (node.depth >= MAX_PAGE_TREE_DEPTH) {
+                continue;
+            }
+            // Push in reverse so pages come off the stack in document order
+            const PdfArray& items = kids.as_array();
+            for (size_t i = items.size(); i-- > 0;) {
+                const PdfObject& kid = items[i];
+                if (kid.is_ref() && !visited.insert(kid.as_ref().num).second) {
+                    continue;
+                }
+                PdfObject child = resolve(kid);
+                if (child.is_dict()) {
+                    stack.push_back(Node{child, kid.as_ref(), inherited, node.depth + 1});
+                }
+            }
+            continue;
+        }
+
+        PdfPage page;
+        page.ref = node.ref;
+        page.dict = dict;
+        for (const auto& entry : inherited) {
+            if (!page.dict.has(entry.first)) {
+                page.dict.set(entry.first, entry.second);
+            }
+        }
+        pages_.push_back(std::move(page));
+    }
+    return true;
+}
+
+} // namespace spdf
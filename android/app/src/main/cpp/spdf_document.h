@@ -0,0 +1,131 @@
+#ifndef SPDF_DOCUMENT_H
+#define SPDF_DOCUMENT_H
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include "spdf_memory.h"
+#include "spdf_object.h"
+#include "spdf_security.h"
+
+namespace spdf {
+
+struct PdfPage {
+    ObjectRef ref;
+    // The page dictionary with inherited Resources, MediaBox, CropBox and
+    // Rotate copied in from its ancestors
+    PdfDict dict;
+};
+
+// Read-only view of a PDF file: cross-reference tables and streams (with
+// /Prev chains and hybrid files), object streams, and the flattened page tree.
+// Objects are parsed on first use and cached. Not thread-safe; open one
+// document per thread.
+// The file is read in whole and held in memory_budget(); open() waits for
+// room when the budget is short.
+//
+// Files whose cross-reference data, catalog or page tree is damaged (e.g.
+// truncated downloads) are opened by scanning for the objects instead; see
+// recovered().
+//
+// Encrypted files are opened with password (the empty password opens files
+// that only restrict permissions). Strings are decrypted as objects are
+// parsed; stream bytes stay encrypted until stream_data() or decode_stream().
+class PdfDocument {
+public:
+    bool open(const std::string& path, std::string* error, const std::string& password = std::string());
+    bool open_memory(std::string data, std::string* error, const std::string& password = std::string());
+
+    const PdfDict& trailer() const { return trailer_; }
+    const PdfDict& catalog() const { return catalog_.as_dict(); }
+    // Header version, e.g. "1.7"
+    const std::string& version() const { return version_; }
+    bool encrypted() const { return trailer_.has("Encrypt"); }
+    // Encrypted and the password did not unlock it: strings and streams are unreadable
+    bool locked() const { return encrypted() && !security_; }
+    // Opened from a scan of the objects because the file is damaged; objects
+    // and pages that did not survive are missing
+    bool recovered() const { return recovered_; }
+    // Handler of an unlocked encrypted document, otherwise null
+    const SecurityHandler* security() const { return security_.get(); }
+    // Highest object number + 1 according to the cross-reference data
+    uint32_t object_count() const { return (uint32_t)xref_.size(); }
+    // Number and generation of object num when the cross-reference data lists it as in use
+    bool object_ref(uint32_t num, ObjectRef* ref) const;
+
+    // The object with this number, or null when it is free or unreadable
+    PdfObject get(ObjectRef ref);
+    // Follows references (bounded) until a direct object is reached
+    PdfObject resolve(const PdfObject& object);
+    // resolve(dict.get(key))
+    PdfObject lookup(const PdfDict& dict, const std::string& key);
+
+    // Decoded stream bytes; resolves indirect /Filter and /DecodeParms first
+    bool decode_stream(const PdfObject& stream, std::string* output, std::string* error);
+    // Decoded content of a page's /Contents or of a form XObject: a stream, or
+    // an array of streams joined by newlines (operators may span the
+    // boundary); empty for null. Parts that cannot be decoded are left out
+    // and make it return false, for callers that need all of it.
+    bool decode_contents(const PdfObject& contents, std::string* output, std::string* error);
+    // Stream bytes decrypted but still encoded. Only reads the security
+    // handler, so unlike the rest of the class it may run on several threads.
+    void stream_data(const PdfObject& stream, std::string* output) const;
+
+    // Drops a parsed object from the cache, e.g. once it has been written out
+    void evict(uint32_t num) { cache_.erase(num); }
+
+    size_t page_count() const { return pages_.size(); }
+    const PdfPage& page(size_t index) const { return pages_[index]; }
+    const std::vector<PdfPage>& pages() const { return pages_; }
+
+    const std::string& data() const { return data_; }
+
+private:
+    struct XrefEntry {
+        uint8_t type = 0;        // 0 free, 1 at offset, 2 in an object stream
+        uint16_t gen = 0;
+        uint64_t offset = 0;     // type 1: byte offset; type 2: object stream number
+        uint32_t index = 0;      // type 2: index within the object stream
+    };
+
+    struct ObjectStream {
+        std::string data;
+        std::vector<std::pair<uint32_t, size_t>> objects;  // object number, offset into data
+    };
+
+    bool load(const std::string& password, std::string* error);
+    bool read_xref(std::string* error);
+    bool recover(const std::string& password, std::string* error);
+    void load_security(const std::string& password);
+    void decrypt_strings(ObjectRef ref, PdfObject* object, int depth) const;
+    bool read_xref_section(size_t offset, std::vector<size_t>* pending, std::string* error);
+    bool read_xref_table(size_t offset, std::vector<size_t>* pending, std::string* error);
+    bool read_xref_stream(size_t offset, std::vector<size_t>* pending, std::string* error);
+    void set_entry(uint32_t num, const XrefEntry& entry);
+    bool load_pages(std::string* error);
+    PdfObject load_object(uint32_t num);
+    std::shared_ptr<ObjectStream> object_stream(uint32_t stream_num);
+    PdfObject load_from_object_stream(uint32_t num, const XrefEntry& entry);
+    int64_t resolve_length(ObjectRef ref);
+
+    std::string data_;
+    MemoryReservation memory_;  // data_ in the memory budget
+    std::string version_;
+    std::vector<XrefEntry> xref_;
+    std::vector<bool> xref_set_;  // newer sections win over /Prev sections
+    PdfDict trailer_;
+    PdfObject catalog_;
+    std::vector<PdfPage> pages_;
+    std::unordered_map<uint32_t, PdfObject> cache_;
+    std::unordered_map<uint32_t, std::shared_ptr<ObjectStream>> object_streams_;
+    std::vector<uint32_t> loading_;  // objects being parsed, to break reference cycles
+    std::unique_ptr<SecurityHandler> security_;
+    uint32_t encrypt_num_ = 0;  // the /Encrypt dictionary itself is never encrypted
+    bool recovered_ = false;
+};
+
+} // namespace spdf
+
+#endif // SPDF_DOCUMENT_H
@@ -0,0 +1,574 @@
+#include "spdf_duplicates.h"
+#include <unistd.h>
+#include <algorithm>
+#include <cerrno>
+#include <cmath>
+#include <map>
+#include <string_view>
+#include <thread>
+#include <unordered_map>
+#include <unordered_set>
+#include "spdf_document.h"
+#include "spdf_filters.h"
+#include "spdf_lexer.h"
+#include "spdf_merge.h"
+#include "spdf_writer.h"
+
+namespace spdf {
+
+// Numbers are compared at this precision, so 1, 1.0 and 1.0001 match
+static const double NUMBER_SCALE = 1000;
+// Tokens per shingle of the sketch
+static const size_t SHINGLE_TOKENS = 4;
+// Sketch slots per band: pages agreeing on a whole band become candidates
+// for a near match
+static const size_t BAND_SLOTS = 4;
+// Candidates compared per band bucket, so boilerplate pages that many inputs
+// share do not make the grouping quadratic
+static const size_t BUCKET_COMPARISONS = 64;
+// How many references deep resource digests follow
+static const int MAX_DEPTH = 32;
+// Resource categories content operators refer to by name
+static const char* const RESOURCE_CATEGORIES[] = {"Font", "XObject", "ExtGState", "ColorSpace",
+                                                  "Pattern", "Shading", "Properties"};
+
+namespace {
+
+// One content stream of a page, ready to be decoded on any thread
+struct ContentPart {
+    PdfDict filters;  // /Filter and /DecodeParms made direct
+    std::string data; // decrypted, still encoded
+};
+
+// What phase one reads from a page for phase two to hash
+struct PageSource {
+    std::vector<ContentPart> contents;
+    // "Category/Name" of each resource the page has, to the digest of what it names
+    std::unordered_map<std::string, Digest128> resources;
+    uint64_t frame = 0;
+    Digest128 annotations;
+};
+
+struct InputPages {
+    std::vector<PageSource> pages;
+    PdfErrorCode error_code = PdfErrorCode_Success;
+    std::string error;
+};
+
+// Digests of the objects a document's resources and annotations reach,
+// memoised by object number for the whole document
+class ResourceHasher {
+public:
+    explicit ResourceHasher(PdfDocument& document) : document_(document) {}
+
+    void hash(const PdfObject& object, Hasher128* hasher, int depth);
+
+private:
+    void hash_dict(const PdfDict& dict, bool stream, Hasher128* hasher, int depth);
+
+    PdfDocument& document_;
+    std::unordered_map<uint32_t, Digest128> digests_;
+    std::unordered_set<uint32_t> visiting_;  // to break reference cycles
+};
+
+} // namespace
+
+static int64_t scaled(double value) {
+    double rounded = std::round(value * NUMBER_SCALE);
+    return rounded > 9e18 ? INT64_MAX : rounded < -9e18 ? INT64_MIN : (int64_t)rounded;
+}
+
+// Fonts embedded as subsets are named "ABCDEF+Name" with a prefix that
+// changes every time a file is written
+static std::string_view without_subset_prefix(std::string_view name) {
+    if (name.size() > 7 && name[6] == '+' &&
+        std::all_of(name.begin(), name.begin() + 6, [](char c) { return c >= 'A' && c <= 'Z'; })) {
+        return name.substr(7);
+    }
+    return name;
+}
+
+// Keys that change when a file is rewritten without changing what it shows
+static bool ignored_key(const std::string& key, bool stream) {
+    if (key == "Parent" || key == "StructParent" || key == "StructParents" || key == "Metadata") {
+        return true;
+    }
+    return stream && (key == "Length" || key == "Filter" || key == "DecodeParms" || key == "DL");
+}
+
+void ResourceHasher::hash(const PdfObject& object, Hasher128* hasher, int depth) {
+    // Whole numbers are integers to some writers and reals to others
+    hasher->update_value((uint8_t)(object.is_number() ? PdfType::Integer : object.type()));
+    switch (object.type()) {
+        case PdfType::Null:
+            break;
+        case PdfType::Boolean:
+            hasher->update_value((uint8_t)object.as_bool());
+            break;
+        case PdfType::Integer:
+        case PdfType::Real:
+            hasher->update_value(scaled(object.as_number()));
+            break;
+        case PdfType::String:
+            hasher->update(object.as_string());
+            break;
+        case PdfType::Name: {
+            std::string_view name = without_subset_prefix(object.as_name());
+            hasher->update_value((uint64_t)name.size());
+            hasher->update(name.data(), name.size());
+            break;
+        }
+        case PdfType::Array:
+            hasher->update_value((uint64_t)object.as_array().size());
+            for (const auto& item : object.as_array()) {
+                hash(item, hasher, depth + 1);
+            }
+            break;
+        case PdfType::Dictionary:
+            hash_dict(object.as_dict(), false, hasher, depth);
+            break;
+        case PdfType::Stream: {
+            hash_dict(object.as_dict(), true, hasher, depth);
+            // Decoded, so recompressing a stream changes nothing; image codecs stay encoded
+            std::string data;
+            std::string error;
+            if (!document_.decode_stream(object, &data, &error)) {
+                document_.stream_data(object, &data);
+                hash(document_.lookup(object.as_dict(), "Filter"), hasher, depth + 1);
+            }
+            hasher->update(data);
+            break;
+        }
+        case PdfType::Reference: {
+            uint32_t num = object.as_ref().num;
+            auto found = digests_.find(num);
+            if (found == digests_.end()) {
+                if (depth >= MAX_DEPTH || !visiting_.insert(num).second) {
+                    break;
+                }
+                Hasher128 target;
+                hash(document_.get(object.as_ref()), &target, depth + 1);
+                visiting_.erase(num);
+                found = digests_.emplace(num, target.digest()).first;
+            }
+            hasher->update_value(found->second.high);
+            hasher->update_value(found->second.low);
+            break;
+        }
+    }
+}
+
+// Entries in key order: writers do not agree on one
+void ResourceHasher::hash_dict(const PdfDict& dict, bool stream, Hasher128* hasher, int depth) {
+    std::vector<const PdfDict::Entry*> entries;
+    for (const auto& entry : dict) {
+        if (!ignored_key(entry.first, stream)) {
+            entries.push_back(&entry);
+        }
+    }
+    std::sort(entries.begin(), entries.end(),
+              [](const PdfDict::Entry* a, const PdfDict::Entry* b) { return a->first < b->first; });
+    hasher->update_value((uint64_t)entries.size());
+    for (const auto* entry : entries) {
+        hasher->update(entry->first);
+        hash(entry->second, hasher, depth + 1);
+    }
+}
+
+// /Filter and /DecodeParms of dict, and their array elements, made direct
+static PdfDict direct_filters(PdfDocument& document, const PdfDict& dict) {
+    PdfDict direct;
+    for (const char* key : {"Filter", "DecodeParms"}) {
+        PdfObject value = document.lookup(dict, key);
+        if (value.is_array()) {
+            PdfArray items;
+            for (const auto& item : value.as_array()) {
+                items.push_back(document.resolve(item));
+            }
+            value = PdfObject::array(std::move(items));
+        }
+        if (!value.is_null()) {
+            direct.set(key, std::move(value));
+        }
+    }
+    return direct;
+}
+
+static uint64_t page_frame(PdfDocument& document, const PdfDict& page) {
+    Xxh64 hasher;
+    for (const char* key : {"MediaBox", "CropBox"}) {
+        PdfObject box = document.lookup(page, key);
+        hasher.update_value((uint64_t)box.as_array().size());
+        for (const auto& value : box.as_array()) {
+            hasher.update_value(scaled(document.resolve(value).as_number()));
+        }
+    }
+    int64_t rotate = document.lookup(page, "Rotate").as_int() % 360;
+    hasher.update_value(rotate < 0 ? rotate + 360 : rotate);
+    return hasher.digest();
+}
+
+// What the annotations show: their kind, place, text and appearance
+static Digest128 annotation_digest(PdfDocument& document, ResourceHasher& resources, const PdfDict& page) {
+    Hasher128 hasher;
+    for (const auto& item : document.lookup(page, "Annots").as_array()) {
+        const PdfDict& annotation = document.resolve(item).as_dict();
+        for (const char* key : {"Subtype", "Rect", "Contents", "AP"}) {
+            resources.hash(annotation.get(key), &hasher, 0);
+        }
+    }
+    return hasher.digest();
+}
+
+static bool open_input(const std::string& path, PdfDocument* document, InputPages* input) {
+    if (access(path.c_str(), R_OK) != 0) {
+        input->error_code = errno == ENOENT ? PdfErrorCode_FileNotFound : PdfErrorCode_PermissionDenied;
+        input->error = "cannot open " + path;
+        return false;
+    }
+    std::string error;
+    if (!document->open(path, &error)) {
+        input->error_code = PdfErrorCode_InvalidPdf;
+        input->error = path + ": " + error;
+        return false;
+    }
+    if (document->locked()) {
+        input->error_code = PdfErrorCode_EncryptedPdf;
+        input->error = path + ": document is password protected";
+        return false;
+    }
+    return true;
+}
+
+// Phase one: everything that needs the document, which is then closed
+static void read_input(const std::string& path, InputPages* input) {
+    PdfDocument document;
+    if (!open_input(path, &document, input)) {
+        return;
+    }
+    ResourceHasher hasher(document);
+    input->pages.resize(document.page_count());
+    for (size_t i = 0; i < document.page_count(); i++) {
+        const PdfDict& page = document.page(i).dict;
+        PageSource& source = input->pages[i];
+        PdfObject contents = document.lookup(page, "Contents");
+        PdfArray parts = contents.is_array() ? contents.as_array() : PdfArray{contents};
+        for (const auto& part : parts) {
+            PdfObject stream = document.resolve(part);
+            if (stream.is_stream()) {
+                source.contents.emplace_back();
+                source.contents.back().filters = direct_filters(document, stream.as_dict());
+                document.stream_data(stream, &source.contents.back().data);
+            }
+        }
+        PdfObject resources = document.lookup(page, "Resources");
+        for (const char* category : RESOURCE_CATEGORIES) {
+            for (const auto& entry : document.lookup(resources.as_dict(), category).as_dict()) {
+                Hasher128 digest;
+                hasher.hash(entry.second, &digest, 0);
+                source.resources[std::string(category) + "/" + entry.first] = digest.digest();
+            }
+        }
+        source.frame = page_frame(document, page);
+        source.annotations = annotation_digest(document, hasher, page);
+    }
+}
+
+static uint64_t token_hash(const TokenBuffer& tokens, const PackedToken& token) {
+    Xxh64 hasher((uint64_t)token.type);
+    if (token.type == TokenType::Integer || token.type == TokenType::Real) {
+        hasher.reset((uint64_t)TokenType::Integer);
+        hasher.update_value(scaled(tokens.number(token)));
+    } else {
+        std::string_view text = tokens.text(token);
+        hasher.update(text.data(), text.size());
+    }
+    return hasher.digest();
+}
+
+static uint64_t digest_hash(const Digest128& digest) {
+    return digest.high ^ (digest.low * 0x9E3779B97F4A7C15ULL);
+}
+
+// Category of the name operands of op, or null when it takes none from the resources
+static const char* operand_category(std::string_view op) {
+    if (op == "Tf") {
+        return "Font";
+    } else if (op == "Do") {
+        return "XObject";
+    } else if (op == "gs") {
+        return "ExtGState";
+    } else if (op == "cs" || op == "CS") {
+        return "ColorSpace";
+    } else if (op == "scn" || op == "SCN") {
+        return "Pattern";
+    } else if (op == "sh") {
+        return "Shading";
+    } else if (op == "BDC" || op == "DP") {
+        return "Properties";
+    }
+    return nullptr;
+}
+
+static bool marked_content(std::string_view op) {
+    return op == "BMC" || op == "BDC" || op == "EMC" || op == "MP" || op == "DP";
+}
+
+// Slot values of one shingle: one multiply-shift hash per slot
+static void add_shingle(uint64_t shingle, std::array<uint32_t, SKETCH_SLOTS>* sketch) {
+    for (size_t slot = 0; slot < SKETCH_SLOTS; slot++) {
+        uint64_t a = 0x9E3779B97F4A7C15ULL * (2 * slot + 1);
+        uint64_t b = 0xD1B54A32D192ED03ULL * (slot + 1);
+        uint32_t value = (uint32_t)((shingle * a + b) >> 32);
+        (*sketch)[slot] = std::min((*sketch)[slot], value);
+    }
+}
+
+// Phase two: decodes and tokenizes the content, and hashes it with resource
+// names replaced by what they name
+static void fingerprint_page(const PageSource& source, PageFingerprint* fingerprint) {
+    std::string content;
+    std::string decoded;
+    std::string error;
+    for (const auto& part : source.contents) {
+        decoded.clear();
+        if (!decode_stream_data(part.filters, part.data, &decoded, &error)) {
+            // Compared as stored: still equal for equal bytes
+            decoded = part.data;
+        }
+        content += decoded;
+        content += '\n';
+    }
+    TokenBuffer tokens;
+    tokenize(content.data(), content.size(), &tokens);
+
+    std::vector<uint64_t> hashes;  // every token
+    std::vector<uint64_t> shown;   // without marked content, for the sketch
+    size_t operands = 0;           // first operand of the operator to come
+    for (size_t i = 0; i < tokens.size(); i++) {
+        const PackedToken& token = tokens[i];
+        if (token.type != TokenType::Keyword) {
+            continue;
+        }
+        std::string_view op = tokens.text(token);
+        const char* category = operand_category(op);
+        size_t first = hashes.size();
+        for (size_t k = operands; k < i; k++) {
+            uint64_t hash = token_hash(tokens, tokens[k]);
+            if (category && tokens[k].type == TokenType::Name) {
+                auto found = source.resources.find(std::string(category) + "/" + std::string(tokens.text(tokens[k])));
+                hash = found != source.resources.end() ? digest_hash(found->second) : hash;
+            }
+            hashes.push_back(hash);
+        }
+        hashes.push_back(token_hash(tokens, token));
+        if (op == "ID") {
+            // Inline image data runs from here to the next token, its "EI" included
+            size_t start = token.offset + 2;
+            size_t end = i + 1 < tokens.size() ? tokens[i + 1].offset : content.size();
+            hashes.push_back(end > start ? Xxh64::hash(content.data() + start, end - start) : 0);
+        }
+        if (!marked_content(op)) {
+            shown.insert(shown.end(), hashes.begin() + first, hashes.end());
+        }
+        operands = i + 1;
+    }
+
+    Hasher128 digest;
+    digest.update_value(source.frame);
+    digest.update_value(source.annotations.high);
+    digest.update_value(source.annotations.low);
+    digest.update_value((uint64_t)hashes.size());
+    digest.update(hashes.data(), hashes.size() * sizeof(uint64_t));
+    fingerprint->digest = digest.digest();
+    fingerprint->frame = source.frame;
+    fingerprint->blank = hashes.empty();
+    fingerprint->sketch.fill(UINT32_MAX);
+    size_t width = std::min(SHINGLE_TOKENS, shown.size());
+    for (size_t i = 0; width && i + width <= shown.size(); i++) {
+        add_shingle(Xxh64::hash(shown.data() + i, width * sizeof(uint64_t)), &fingerprint->sketch);
+    }
+}
+
+double sketch_similarity(const PageFingerprint& a, const PageFingerprint& b) {
+    size_t equal = 0;
+    for (size_t slot = 0; slot < SKETCH_SLOTS; slot++) {
+        equal += a.sketch[slot] == b.sketch[slot];
+    }
+    return (double)equal / SKETCH_SLOTS;
+}
+
+bool fingerprint_pages(const std::vector<std::string>& inputs, unsigned threads,
+                       std::vector<std::vector<PageFingerprint>>* fingerprints, PdfErrorCode* error_code,
+                       std::string* error) {
+    if (inputs.empty()) {
+        *error_code = PdfErrorCode_InvalidParameter;
+        *error = "no inputs";
+        return false;
+    }
+    threads = threads ? threads : std::max(1u, std::thread::hardware_concurrency());
+
+    std::vector<InputPages> sources(inputs.size());
+    run_parallel(inputs.size(), threads, [&](size_t i) { read_input(inputs[i], &sources[i]); });
+    std::vector<std::pair<uint32_t, uint32_t>> pages;  // input, page index
+    for (size_t i = 0; i < sources.size(); i++) {
+        if (sources[i].error_code != PdfErrorCode_Success) {
+            *error_code = sources[i].error_code;
+            *error = sources[i].error;
+            return false;
+        }
+        for (size_t page = 0; page < sources[i].pages.size(); page++) {
+            pages.emplace_back((uint32_t)i, (uint32_t)page);
+        }
+    }
+
+    fingerprints->assign(inputs.size(), std::vector<PageFingerprint>());
+    for (size_t i = 0; i < sources.size(); i++) {
+        (*fingerprints)[i].resize(sources[i].pages.size());
+    }
+    run_parallel(pages.size(), threads, [&](size_t i) {
+        fingerprint_page(sources[pages[i].first].pages[pages[i].second],
+                         &(*fingerprints)[pages[i].first][pages[i].second]);
+    });
+    *error_code = PdfErrorCode_Success;
+    return true;
+}
+
+static size_t find_root(std::vector<size_t>& parents, size_t i) {
+    while (parents[i] != i) {
+        parents[i] = parents[parents[i]];
+        i = parents[i];
+    }
+    return i;
+}
+
+// The earlier page becomes the root, so a group's root is its first page
+static void join(std::vector<size_t>& parents, size_t a, size_t b) {
+    a = find_root(parents, a);
+    b = find_root(parents, b);
+    if (a != b) {
+        parents[std::max(a, b)] = std::min(a, b);
+    }
+}
+
+// find_duplicate_pages() once the pages are fingerprinted
+static void group_pages(const std::vector<std::vector<PageFingerprint>>& fingerprints, double similarity,
+                        std::vector<std::vector<PageLocation>>* groups) {
+    std::vector<PageLocation> locations;
+    std::vector<const PageFingerprint*> pages;
+    for (size_t i = 0; i < fingerprints.size(); i++) {
+        for (size_t page = 0; page < fingerprints[i].size(); page++) {
+            locations.push_back(PageLocation{(uint32_t)i, (int32_t)page + 1});
+            pages.push_back(&fingerprints[i][page]);
+        }
+    }
+
+    std::vector<size_t> parents(pages.size());
+    for (size_t i = 0; i < parents.size(); i++) {
+        parents[i] = i;
+    }
+    std::map<Digest128, size_t> identical;
+    std::vector<size_t> representatives;  // first page of each digest
+    for (size_t i = 0; i < pages.size(); i++) {
+        if (pages[i]->blank) {
+            continue;
+        }
+        auto found = identical.emplace(pages[i]->digest, i);
+        if (found.second) {
+            representatives.push_back(i);
+        } else {
+            join(parents, found.first->second, i);
+        }
+    }
+    if (similarity < 1.0) {
+        // Candidates share a band of their sketch; only they are compared
+        std::unordered_map<uint64_t, std::vector<size_t>> buckets;
+        for (size_t i : representatives) {
+            for (size_t band = 0; band < SKETCH_SLOTS / BAND_SLOTS; band++) {
+                Xxh64 key(band);
+                key.update_value(pages[i]->frame);
+                key.update(pages[i]->sketch.data() + band * BAND_SLOTS, BAND_SLOTS * sizeof(uint32_t));
+                std::vector<size_t>& bucket = buckets[key.digest()];
+                for (size_t k = 0; k < bucket.size() && k < BUCKET_COMPARISONS; k++) {
+                    const PageFingerprint& other = *pages[bucket[k]];
+                    if (other.frame == pages[i]->frame && sketch_similarity(other, *pages[i]) >= similarity) {
+                        join(parents, bucket[k], i);
+                    }
+                }
+                bucket.push_back(i);
+            }
+        }
+    }
+
+    groups->clear();
+    std::unordered_map<size_t, size_t> group_of_root;
+    for (size_t i = 0; i < pages.size(); i++) {
+        size_t root = find_root(parents, i);
+        if (root == i) {
+            continue;
+        }
+        auto found = group_of_root.emplace(root, groups->size());
+        if (found.second) {
+            groups->push_back({locations[root]});
+        }
+        (*groups)[found.first->second].push_back(locations[i]);
+    }
+}
+
+bool find_duplicate_pages(const std::vector<std::string>& inputs, const DuplicateOptions& options,
+                          std::vector<std::vector<PageLocation>>* groups, PdfErrorCode* error_code,
+                          std::string* error) {
+    std::vector<std::vector<PageFingerprint>> fingerprints;
+    if (!fingerprint_pages(inputs, options.threads, &fingerprints, error_code, error)) {
+        return false;
+    }
+    group_pages(fingerprints, options.similarity, groups);
+    return true;
+}
+
+bool merge_without_duplicates(const std::vector<std::string>& inputs, const std::string& output,
+                              const DuplicateOptions& options, size_t* dropped, PdfErrorCode* error_code,
+                              std::string* error) {
+    std::vector<std::vector<PageFingerprint>> fingerprints;
+    if (!fingerprint_pages(inputs, options.threads, &fingerprints, error_code, error)) {
+        return false;
+    }
+    std::vector<std::vector<PageLocation>> groups;
+    group_pages(fingerprints, options.similarity, &groups);
+    std::vector<std::vector<bool>> skipped(inputs.size());
+    size_t count = 0;
+    for (size_t i = 0; i < inputs.size(); i++) {
+        skipped[i].assign(fingerprints[i].size(), false);
+    }
+    for (const auto& group : groups) {
+        for (size_t i = 1; i < group.size(); i++) {
+            skipped[group[i].input][group[i].page - 1] = true;
+            count++;
+        }
+    }
+
+    AssemblyOutput merged;
+    merged.path = output;
+    for (size_t i = 0; i < inputs.size(); i++) {
+        AssemblyPart part;
+        part.source = inputs[i];
+        for (size_t page = 0; page < skipped[i].size(); page++) {
+            if (!skipped[i][page]) {
+                part.pages.push_back((int32_t)page + 1);
+            }
+        }
+        // An empty list would take every page
+        if (!part.pages.empty()) {
+            merged.parts.push_back(std::move(part));
+        }
+    }
+    if (!assemble_documents({merged}, options.threads, error_code, error)) {
+        return false;
+    }
+    if (dropped) {
+        *dropped = count;
+    }
+    return true;
+}
+
+} // namespace spdf
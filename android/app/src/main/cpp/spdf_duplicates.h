@@ -0,0 +1,77 @@
+#ifndef SPDF_DUPLICATES_H
+#define SPDF_DUPLICATES_H
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+#include "spdf_hash.h"
+#include "spdfcore.h"
+
+namespace spdf {
+
+// Slots of PageFingerprint::sketch
+constexpr size_t SKETCH_SLOTS = 32;
+
+// What a page shows, independent of how its file stores it
+struct PageFingerprint {
+    // Equal for pages that show the same thing: content streams compared
+    // token by token (numbers to 1/1000, so "1" and "1.000" match), resource
+    // names replaced by digests of the resources they name, page size,
+    // rotation and annotations. Object numbers, stream filters, font subset
+    // prefixes and resources the content does not use make no difference.
+    Digest128 digest;
+    uint64_t frame = 0;  // page size and rotation alone
+    // MinHash of the content's token shingles, without marked content, for
+    // pages that differ in a few places (a date, a page number)
+    std::array<uint32_t, SKETCH_SLOTS> sketch{};
+    bool blank = false;  // no content at all
+};
+
+// Share of the sketch slots a and b agree on: an estimate of how much of
+// their content they have in common
+double sketch_similarity(const PageFingerprint& a, const PageFingerprint& b);
+
+// One page of a set of inputs
+struct PageLocation {
+    uint32_t input = 0;  // index into the inputs
+    int32_t page = 0;    // 1-based
+};
+
+struct DuplicateOptions {
+    // 1 groups identical pages only (equal digests). Lower values also group
+    // pages of the same size whose sketches agree on at least this share.
+    double similarity = 1.0;
+    unsigned threads = 0;  // 0: every core
+};
+
+// Fingerprints of every page of inputs, in one parallel pass: the inputs are
+// opened side by side, then the pages of all of them are hashed side by side.
+// Encrypted inputs must open with the empty password; damaged ones are read
+// through the recovery scan. Failures are reported with the spdfcore C ABI
+// error codes.
+bool fingerprint_pages(const std::vector<std::string>& inputs, unsigned threads,
+                       std::vector<std::vector<PageFingerprint>>* fingerprints, PdfErrorCode* error_code,
+                       std::string* error);
+
+// Pages of inputs that repeat, within an input or across them. Each group
+// has at least two pages in input and page order, and the groups are ordered
+// by their first page. Near matches are grouped transitively, so the ends of
+// a group may differ more than options.similarity allows. Blank pages are
+// never grouped: separators are not duplicates.
+bool find_duplicate_pages(const std::vector<std::string>& inputs, const DuplicateOptions& options,
+                          std::vector<std::vector<PageLocation>>* groups, PdfErrorCode* error_code,
+                          std::string* error);
+
+// Merges inputs keeping only the first page of each group find_duplicate_pages()
+// reports. Written by assemble_documents(), so outlines, forms and /Info are
+// not carried over and links to dropped pages become null. *dropped (when
+// given) receives the number of pages left out.
+bool merge_without_duplicates(const std::vector<std::string>& inputs, const std::string& output,
+                              const DuplicateOptions& options, size_t* dropped, PdfErrorCode* error_code,
+                              std::string* error);
+
+} // namespace spdf
+
+#endif // SPDF_DUPLICATES_H
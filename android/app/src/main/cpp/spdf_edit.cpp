@@ -0,0 +1,373 @@
+#include "spdf_edit.h"
+#include <algorithm>
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+#include <fcntl.h>
+#include <map>
+#include <unistd.h>
+#include "spdf_document.h"
+#include "spdf_io.h"
+#include "spdf_lexer.h"
+#include "spdf_writer.h"
+
+namespace spdf {
+
+// Bytes searched backwards from the end of the file for startxref
+static const size_t TAIL_WINDOW = 1024;
+// Highest page number, and most pages, a page list may name: the object limit
+// of PDF 1.7 (Annex C), so no document has more
+static const long MAX_LISTED_PAGES = 8388607;
+
+bool parse_page_list(const std::string& text, std::vector<int32_t>* pages) {
+    size_t pos = 0;
+    while (pos < text.size()) {
+        size_t comma = text.find(',', pos);
+        std::string part = text.substr(pos, comma == std::string::npos ? std::string::npos : comma - pos);
+        pos = comma == std::string::npos ? text.size() : comma + 1;
+        if (part.empty()) {
+            continue;
+        }
+        char* end = nullptr;
+        long first = strtol(part.c_str(), &end, 10);
+        long last = first;
+        if (*end == '-') {
+            last = strtol(end + 1, &end, 10);
+        }
+        if (*end != '\0' || first < 1 || last < first || last > MAX_LISTED_PAGES ||
+            last - first >= MAX_LISTED_PAGES - (long)pages->size()) {
+            return false;
+        }
+        for (long page = first; page <= last; page++) {
+            pages->push_back((int32_t)page);
+        }
+    }
+    return !pages->empty();
+}
+
+bool parse_page_edit_script(const std::string& text, PageEditScript* script, std::string* error) {
+    size_t pos = 0;
+    while (pos < text.size()) {
+        size_t end = text.find_first_of(";\n", pos);
+        std::string statement = text.substr(pos, end == std::string::npos ? std::string::npos : end - pos);
+        pos = end == std::string::npos ? text.size() : end + 1;
+
+        std::vector<std::string> words;
+        size_t start = statement.find_first_not_of(" \t\r");
+        while (start != std::string::npos) {
+            size_t stop = statement.find_first_of(" \t\r", start);
+            words.push_back(statement.substr(start, stop == std::string::npos ? std::string::npos : stop - start));
+            start = stop == std::string::npos ? stop : statement.find_first_not_of(" \t\r", stop);
+        }
+        if (words.empty()) {
+            continue;
+        }
+
+        std::vector<int32_t> pages;
+        if (words[0] == "order" && words.size() == 2 && parse_page_list(words[1], &pages)) {
+            script->order.insert(script->order.end(), pages.begin(), pages.end());
+        } else if (words[0] == "delete" && words.size() == 2 && parse_page_list(words[1], &pages)) {
+            script->deletions.insert(script->deletions.end(), pages.begin(), pages.end());
+        } else if (words[0] == "rotate" && words.size() == 3 && parse_page_list(words[2], &pages)) {
+            char* stop = nullptr;
+            long degrees = strtol(words[1].c_str(), &stop, 10);
+            if (*stop != '\0' || degrees % 90 != 0 || degrees < -3600 || degrees > 3600) {
+                *error = "rotation must be a multiple of 90 degrees: '" + words[1] + "'";
+                return false;
+            }
+            for (int32_t page : pages) {
+                script->rotations.emplace_back(page, (int32_t)degrees);
+            }
+        } else {
+            *error = "invalid edit statement '" + statement + "'";
+            return false;
+        }
+    }
+    return true;
+}
+
+// Offset in the last startxref, or -1
+static int64_t last_startxref(const std::string& data) {
+    size_t from = data.size() > TAIL_WINDOW ? data.size() - TAIL_WINDOW : 0;
+    size_t found = data.rfind("startxref");
+    if (found == std::string::npos || found < from) {
+        return -1;
+    }
+    int64_t offset = strtoll(data.c_str() + found + 9, nullptr, 10);
+    return offset > 0 && (uint64_t)offset < data.size() ? offset : -1;
+}
+
+static int bytes_for(uint64_t value) {
+    int bytes = 1;
+    while (value >>= 8) {
+        bytes++;
+    }
+    return bytes;
+}
+
+static bool fail(PdfErrorCode code, const std::string& message, PdfErrorCode* error_code, std::string* error) {
+    *error_code = code;
+    *error = message;
+    return false;
+}
+
+bool open_update_base(const std::string& input, const std::string& scratch, UpdateBase* base,
+                      PdfErrorCode* error_code, std::string* error) {
+    if (access(input.c_str(), R_OK) != 0) {
+        return fail(errno == ENOENT ? PdfErrorCode_FileNotFound : PdfErrorCode_PermissionDenied,
+                    "cannot open " + input, error_code, error);
+    }
+    PdfDocument& original = base->original;
+    if (!original.open(input, error)) {
+        *error_code = PdfErrorCode_InvalidPdf;
+        return false;
+    }
+    if (original.locked()) {
+        return fail(PdfErrorCode_EncryptedPdf, "document is password protected", error_code, error);
+    }
+
+    // A damaged file has no cross-reference data to chain to; update a clean rewrite of it instead
+    base->document = &original;
+    if (original.recovered()) {
+        WriteOptions options;
+        options.security = original.security();
+        std::string data;
+        bool ok = write_document(original, scratch, options, error) && read_file(scratch, &data, error);
+        remove(scratch.c_str());
+        if (!ok) {
+            *error_code = PdfErrorCode_IoError;
+            return false;
+        }
+        if (!base->repaired.open_memory(std::move(data), error)) {
+            *error_code = PdfErrorCode_InvalidPdf;
+            return false;
+        }
+        base->document = &base->repaired;
+    }
+    PdfDocument* document = base->document;
+    const std::string& data = document->data();
+    base->prev = last_startxref(data);
+    const PdfObject& root_ref = document->trailer().get("Root");
+    if (base->prev < 0 || !root_ref.is_ref() || !document->resolve(root_ref).is_dict()) {
+        return fail(PdfErrorCode_InvalidPdf, "cannot append to this file's cross-reference data", error_code, error);
+    }
+    Lexer lexer(data.data() + base->prev, data.size() - (size_t)base->prev);
+    Token token;
+    base->xref_table = lexer.next(&token) && token.type == TokenType::Keyword && token.text == "xref";
+
+    base->size = std::max<uint32_t>(document->object_count(), 1);
+    const PdfObject& size = document->trailer().get("Size");
+    if (size.as_int() > (int64_t)base->size && size.as_int() <= (int64_t)UINT32_MAX) {
+        base->size = (uint32_t)size.as_int();
+    }
+    return true;
+}
+
+std::string update_tail(const UpdateBase& base, const std::vector<PendingObject>& batch, uint32_t size) {
+    const std::string& file = base.document->data();
+    const PdfDict& trailer = base.document->trailer();
+    std::string tail;
+    uint64_t position = file.size();
+    if (!file.empty() && file.back() != '\n' && file.back() != '\r') {
+        tail += '\n';
+    }
+    std::map<uint32_t, std::pair<uint64_t, uint16_t>> entries;  // number -> offset, generation
+    for (const auto& object : batch) {
+        entries[object.ref.num] = std::make_pair(position + tail.size(), object.ref.gen);
+        tail += object.head;
+        tail += object.stream_bytes();
+        tail += object.tail;
+    }
+
+    PdfDict new_trailer;
+    for (const char* key : {"Root", "Info", "ID", "Encrypt"}) {
+        if (trailer.has(key)) {
+            new_trailer.set(key, trailer.get(key));
+        }
+    }
+    new_trailer.set("Prev", PdfObject::integer(base.prev));
+
+    uint64_t xref_offset = position + tail.size();
+    if (base.xref_table) {
+        new_trailer.set("Size", PdfObject::integer(size));
+        tail += "xref\n";
+        for (auto it = entries.begin(); it != entries.end();) {
+            auto run = it;
+            uint32_t count = 0;
+            while (run != entries.end() && run->first == it->first + count) {
+                ++run;
+                count++;
+            }
+            tail += std::to_string(it->first) + " " + std::to_string(count) + "\n";
+            for (; it != run; ++it) {
+                append_xref_entry(it->second.first, it->second.second, 'n', &tail);
+            }
+        }
+        tail += "trailer\n";
+        write_object(PdfObject::dict(std::move(new_trailer)), &tail);
+        tail += "\n";
+    } else {
+        // Cross-reference stream: type 1 entries, its own included
+        uint32_t xref_num = size++;
+        entries[xref_num] = std::make_pair(xref_offset, 0);
+        new_trailer.set("Size", PdfObject::integer(size));
+        int width = bytes_for(xref_offset);
+        int last_width = 2;
+        PdfArray index;
+        std::string data;
+        for (const auto& entry : entries) {
+            index.push_back(PdfObject::integer(entry.first));
+            index.push_back(PdfObject::integer(1));
+            data += (char)1;
+            for (int i = width - 1; i >= 0; i--) {
+                data += (char)(entry.second.first >> (8 * i));
+            }
+            for (int i = last_width - 1; i >= 0; i--) {
+                data += (char)(entry.second.second >> (8 * i));
+            }
+        }
+        PdfDict dict;
+        dict.set("Type", PdfObject::name("XRef"));
+        for (const auto& entry : new_trailer) {
+            dict.set(entry.first, entry.second);
+        }
+        dict.set("Index", PdfObject::array(std::move(index)));
+        dict.set("W", PdfObject::array({PdfObject::integer(1), PdfObject::integer(width),
+                                        PdfObject::integer(last_width)}));
+        // The cross-reference stream itself is never encrypted
+        tail += std::to_string(xref_num) + " 0 obj\n";
+        write_object(PdfObject::stream(std::move(dict), std::move(data)), &tail);
+        tail += "\nendobj\n";
+    }
+    tail += "startxref\n" + std::to_string(xref_offset) + "\n%%EOF\n";
+    return tail;
+}
+
+bool write_update(const std::string& data, const std::string& tail, const std::string& output,
+                  PdfErrorCode* error_code, std::string* error) {
+    std::string temp = output + ".tmp";
+    int fd = ::open(temp.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (fd < 0) {
+        return fail(PdfErrorCode_IoError, "cannot create " + temp, error_code, error);
+    }
+    IoBackend& io = thread_io_backend();
+    io.write(fd, data.data(), data.size(), 0);
+    io.write(fd, tail.data(), tail.size(), data.size());
+    bool ok = io.wait();
+    ok = close(fd) == 0 && ok;
+    if (!ok || rename(temp.c_str(), output.c_str()) != 0) {
+        remove(temp.c_str());
+        return fail(PdfErrorCode_IoError, "cannot write " + output, error_code, error);
+    }
+    *error_code = PdfErrorCode_Success;
+    return true;
+}
+
+bool edit_pages(const std::string& input, const std::string& output, const PageEditScript& script,
+                PdfErrorCode* error_code, std::string* error) {
+    UpdateBase base;
+    if (!open_update_base(input, output + ".repaired", &base, error_code, error)) {
+        return false;
+    }
+    PdfDocument* document = base.document;
+    const PdfObject& root_ref = document->trailer().get("Root");
+
+    // Resulting page sequence and rotation deltas, by input page index
+    size_t page_count = document->page_count();
+    std::vector<size_t> sequence;
+    std::vector<bool> listed(page_count, false);
+    std::vector<bool> deleted(page_count, false);
+    std::vector<int32_t> turn(page_count, 0);
+    auto out_of_range = [&](int32_t page) { return page < 1 || (size_t)page > page_count; };
+    for (int32_t page : script.order) {
+        if (out_of_range(page) || listed[page - 1]) {
+            return fail(PdfErrorCode_InvalidParameter, "page " + std::to_string(page) +
+                        (out_of_range(page) ? " is out of range" : " is ordered twice"), error_code, error);
+        }
+        listed[page - 1] = true;
+        sequence.push_back((size_t)page - 1);
+    }
+    for (size_t i = 0; i < page_count; i++) {
+        if (!listed[i]) {
+            sequence.push_back(i);
+        }
+    }
+    for (int32_t page : script.deletions) {
+        if (out_of_range(page)) {
+            return fail(PdfErrorCode_InvalidParameter, "page " + std::to_string(page) + " is out of range",
+                        error_code, error);
+        }
+        deleted[page - 1] = true;
+    }
+    for (const auto& rotation : script.rotations) {
+        if (out_of_range(rotation.first) || rotation.second % 90 != 0) {
+            return fail(PdfErrorCode_InvalidParameter, "invalid rotation of page " + std::to_string(rotation.first),
+                        error_code, error);
+        }
+        turn[rotation.first - 1] = (turn[rotation.first - 1] + rotation.second % 360) % 360;
+    }
+    sequence.erase(std::remove_if(sequence.begin(), sequence.end(), [&](size_t i) { return deleted[i]; }),
+                   sequence.end());
+    if (sequence.empty()) {
+        return fail(PdfErrorCode_InvalidParameter, "cannot delete every page", error_code, error);
+    }
+
+    // The page tree root keeps its number (and its inheritable attributes) when
+    // the catalog points at one; otherwise a new root is added and the catalog updated
+    uint32_t size = base.size;
+    std::vector<PendingObject> batch;
+    const PdfObject& pages_ref = document->catalog().get("Pages");
+    PdfObject old_root = document->resolve(pages_ref);
+    ObjectRef root;
+    PdfDict root_dict;
+    if (pages_ref.is_ref() && old_root.is_dict() && old_root.as_dict().get("Type").is_name("Pages")) {
+        root = pages_ref.as_ref();
+        root_dict = old_root.as_dict();
+        root_dict.erase("Parent");
+    } else {
+        root = ObjectRef{size++, 0};
+        root_dict.set("Type", PdfObject::name("Pages"));
+        PdfDict catalog = document->catalog();
+        catalog.set("Pages", PdfObject::reference(root));
+        PendingObject pending;
+        pending.ref = root_ref.as_ref();
+        pending.object = PdfObject::dict(std::move(catalog));
+        batch.push_back(std::move(pending));
+    }
+    PdfObject root_object = PdfObject::reference(root);
+
+    PdfArray kids;
+    for (size_t i : sequence) {
+        const PdfPage& page = document->page(i);
+        kids.push_back(PdfObject::reference(page.ref));
+        // page.dict carries the inherited attributes, so a page moved off an
+        // intermediate node looks the same under the root
+        const PdfObject& parent = page.dict.get("Parent");
+        if (turn[i] == 0 && parent.is_ref() && parent.as_ref() == root) {
+            continue;
+        }
+        PdfDict dict = page.dict;
+        dict.set("Parent", root_object);
+        if (turn[i] != 0) {
+            int64_t rotate = (page.dict.get("Rotate").as_int() % 360 + turn[i] + 720) % 360;
+            dict.set("Rotate", PdfObject::integer(rotate));
+        }
+        PendingObject pending;
+        pending.ref = page.ref;
+        pending.object = PdfObject::dict(std::move(dict));
+        batch.push_back(std::move(pending));
+    }
+    root_dict.set("Count", PdfObject::integer((int64_t)kids.size()));
+    root_dict.set("Kids", PdfObject::array(std::move(kids)));
+    PendingObject pending;
+    pending.ref = root;
+    pending.object = PdfObject::dict(std::move(root_dict));
+    batch.push_back(std::move(pending));
+    serialize_objects(*document, document->security(), Renumbering(), 1, &batch);
+
+    // The update: new object versions, then a cross-reference section of the
+    // same kind as the one it chains to
+    return write_update(document->data(), update_tail(base, batch, size), output, error_code, error);
+}
+
+} // namespace spdf
@@ -0,0 +1,81 @@
+#ifndef SPDF_EDIT_H
+#define SPDF_EDIT_H
+
+#include <cstdint>
+#include <string>
+#include <utility>
+#include <vector>
+#include "spdf_document.h"
+#include "spdf_writer.h"
+#include "spdfcore.h"
+
+namespace spdf {
+
+// Page reordering, rotation and deletion. Page numbers are 1-based and always
+// refer to the input document.
+struct PageEditScript {
+    // Pages in their new order; pages left out follow in their original order
+    std::vector<int32_t> order;
+    // Page, degrees clockwise (a multiple of 90) added to its /Rotate
+    std::vector<std::pair<int32_t, int32_t>> rotations;
+    std::vector<int32_t> deletions;
+};
+
+// Parses "1,3,5-7" into 1-based page numbers, skipping empty entries ("1,,3");
+// false on malformed input and on lists of more pages than a document can have
+bool parse_page_list(const std::string& text, std::vector<int32_t>* pages);
+
+// Parses statements separated by ';' or newlines, pages as in "1,3,5-7":
+//   order 3,1,2
+//   rotate 90 1,4-6
+//   delete 7
+bool parse_page_edit_script(const std::string& text, PageEditScript* script, std::string* error);
+
+// Applies script as an incremental update: the input's bytes are copied as
+// they are and followed by new versions of the page tree root (or the
+// catalog, when the root cannot be reused) and of the pages whose /Rotate or
+// /Parent changes, plus a cross-reference section chained to the input's
+// with /Prev. Content streams, resources and every other object are not
+// touched, so the cost is one file copy whatever the page count. Deleted
+// pages leave the page tree but their objects stay in the file.
+//
+// Encrypted input must open with the empty password; new objects are
+// encrypted with its key. Damaged input is rewritten from the recovery scan
+// first. output may be input. Failures are reported with the spdfcore C ABI
+// error codes.
+bool edit_pages(const std::string& input, const std::string& output, const PageEditScript& script,
+                PdfErrorCode* error_code, std::string* error);
+
+// Incremental updates, shared with form filling (spdf_form.h)
+
+// A file opened to have objects appended: the document read from it, or from
+// a clean rewrite of it when it is damaged, and what an update chains to
+struct UpdateBase {
+    PdfDocument original;
+    PdfDocument repaired;
+    PdfDocument* document = nullptr;  // original or repaired; its data() is what updates follow
+    int64_t prev = 0;                 // offset of the cross-reference section updates chain to
+    bool xref_table = true;           // that section is a table, not a stream
+    uint32_t size = 1;                // first object number free for new objects
+};
+
+// Opens input for updates. A damaged input is rewritten through scratch, a
+// path that is removed again. Failures are reported with the spdfcore C ABI
+// error codes.
+bool open_update_base(const std::string& input, const std::string& scratch, UpdateBase* base,
+                      PdfErrorCode* error_code, std::string* error);
+
+// What an update appends to base's data: batch (serialised) and a
+// cross-reference section of the same kind as the one it chains to, with
+// the trailer. size is the update's /Size; a cross-reference stream takes
+// the number size itself. Only reads base, so it may run on several threads.
+std::string update_tail(const UpdateBase& base, const std::vector<PendingObject>& batch, uint32_t size);
+
+// Writes data then tail to output through a temporary file and rename, with
+// the thread's I/O backend
+bool write_update(const std::string& data, const std::string& tail, const std::string& output,
+                  PdfErrorCode* error_code, std::string* error);
+
+} // namespace spdf
+
+#endif // SPDF_EDIT_H
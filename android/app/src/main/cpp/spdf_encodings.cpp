@@ -0,0 +1,266 @@
+#include "spdf_encodings.h"
+#include <cstdlib>
+#include <cstring>
+#include <unordered_map>
+
+namespace spdf {
+
+namespace {
+
+struct CodeMapping {
+    uint8_t code;
+    uint16_t unicode;
+};
+
+// StandardEncoding above ASCII (ISO 32000-1 Annex D)
+const CodeMapping standard_high[] = {
+    {0xA1, 0x00A1}, {0xA2, 0x00A2}, {0xA3, 0x00A3}, {0xA4, 0x2044}, {0xA5, 0x00A5}, {0xA6, 0x0192},
+    {0xA7, 0x00A7}, {0xA8, 0x00A4}, {0xA9, 0x0027}, {0xAA, 0x201C}, {0xAB, 0x00AB}, {0xAC, 0x2039},
+    {0xAD, 0x203A}, {0xAE, 0xFB01}, {0xAF, 0xFB02}, {0xB1, 0x2013}, {0xB2, 0x2020}, {0xB3, 0x2021},
+    {0xB4, 0x00B7}, {0xB6, 0x00B6}, {0xB7, 0x2022}, {0xB8, 0x201A}, {0xB9, 0x201E}, {0xBA, 0x201D},
+    {0xBB, 0x00BB}, {0xBC, 0x2026}, {0xBD, 0x2030}, {0xBF, 0x00BF}, {0xC1, 0x0060}, {0xC2, 0x00B4},
+    {0xC3, 0x02C6}, {0xC4, 0x02DC}, {0xC5, 0x00AF}, {0xC6, 0x02D8}, {0xC7, 0x02D9}, {0xC8, 0x00A8},
+    {0xCA, 0x02DA}, {0xCB, 0x00B8}, {0xCD, 0x02DD}, {0xCE, 0x02DB}, {0xCF, 0x02C7}, {0xD0, 0x2014},
+    {0xE1, 0x00C6}, {0xE3, 0x00AA}, {0xE8, 0x0141}, {0xE9, 0x00D8}, {0xEA, 0x0152}, {0xEB, 0x00BA},
+    {0xF1, 0x00E6}, {0xF5, 0x0131}, {0xF8, 0x0142}, {0xF9, 0x00F8}, {0xFA, 0x0153}, {0xFB, 0x00DF},
+};
+
+// WinAnsiEncoding 0x80-0x9F; the rest above 0x9F is Latin-1
+const uint16_t win_ansi_80[32] = {
+    0x20AC, 0,      0x201A, 0x0192, 0x201E, 0x2026, 0x2020, 0x2021, 0x02C6, 0x2030, 0x0160,
+    0x2039, 0x0152, 0,      0x017D, 0,      0,      0x2018, 0x2019, 0x201C, 0x201D, 0x2022,
+    0x2013, 0x2014, 0x02DC, 0x2122, 0x0161, 0x203A, 0x0153, 0,      0x017E, 0x0178,
+};
+
+const uint16_t mac_roman_80[128] = {
+    0x00C4, 0x00C5, 0x00C7, 0x00C9, 0x00D1, 0x00D6, 0x00DC, 0x00E1, 0x00E0, 0x00E2, 0x00E4, 0x00E3, 0x00E5,
+    0x00E7, 0x00E9, 0x00E8, 0x00EA, 0x00EB, 0x00ED, 0x00EC, 0x00EE, 0x00EF, 0x00F1, 0x00F3, 0x00F2, 0x00F4,
+    0x00F6, 0x00F5, 0x00FA, 0x00F9, 0x00FB, 0x00FC, 0x2020, 0x00B0, 0x00A2, 0x00A3, 0x00A7, 0x2022, 0x00B6,
+    0x00DF, 0x00AE, 0x00A9, 0x2122, 0x00B4, 0x00A8, 0x2260, 0x00C6, 0x00D8, 0x221E, 0x00B1, 0x2264, 0x2265,
+    0x00A5, 0x00B5, 0x2202, 0x2211, 0x220F, 0x03C0, 0x222B, 0x00AA, 0x00BA, 0x03A9, 0x00E6, 0x00F8, 0x00BF,
+    0x00A1, 0x00AC, 0x221A, 0x0192, 0x2248, 0x2206, 0x00AB, 0x00BB, 0x2026, 0x00A0, 0x00C0, 0x00C3, 0x00D5,
+    0x0152, 0x0153, 0x2013, 0x2014, 0x201C, 0x201D, 0x2018, 0x2019, 0x00F7, 0x25CA, 0x00FF, 0x0178, 0x2044,
+    0x00A4, 0x2039, 0x203A, 0xFB01, 0xFB02, 0x2021, 0x00B7, 0x201A, 0x201E, 0x2030, 0x00C2, 0x00CA, 0x00C1,
+    0x00CB, 0x00C8, 0x00CD, 0x00CE, 0x00CF, 0x00CC, 0x00D3, 0x00D4, 0,      0x00D2, 0x00DA, 0x00DB, 0x00D9,
+    0x0131, 0x02C6, 0x02DC, 0x00AF, 0x02D8, 0x02D9, 0x02DA, 0x00B8, 0x02DD, 0x02DB, 0x02C7,
+};
+
+// PDFDocEncoding 0x18-0x1F and 0x80-0xA0
+const uint16_t pdf_doc_18[8] = {0x02D8, 0x02C7, 0x02C6, 0x02D9, 0x02DD, 0x02DB, 0x02DA, 0x02DC};
+const uint16_t pdf_doc_80[33] = {
+    0x2022, 0x2020, 0x2021, 0x2026, 0x2014, 0x2013, 0x0192, 0x2044, 0x2039, 0x203A, 0x2212,
+    0x2030, 0x201E, 0x201C, 0x201D, 0x2018, 0x2019, 0x201A, 0x2122, 0xFB01, 0xFB02, 0x0141,
+    0x0152, 0x0160, 0x0178, 0x017D, 0x0131, 0x0142, 0x0153, 0x0161, 0x017E, 0,      0x20AC,
+};
+
+const char* const ascii_names[95] = {
+    "space", "exclam", "quotedbl", "numbersign", "dollar", "percent", "ampersand", "quotesingle",
+    "parenleft", "parenright", "asterisk", "plus", "comma", "hyphen", "period", "slash", "zero", "one", "two",
+    "three", "four", "five", "six", "seven", "eight", "nine", "colon", "semicolon", "less", "equal", "greater",
+    "question", "at", "A", "B", "C", "D", "E", "F", "G", "H", "I", "J", "K", "L", "M", "N", "O", "P", "Q", "R",
+    "S", "T", "U", "V", "W", "X", "Y", "Z", "bracketleft", "backslash", "bracketright", "asciicircum",
+    "underscore", "grave", "a", "b", "c", "d", "e", "f", "g", "h", "i", "j", "k", "l", "m", "n", "o", "p", "q",
+    "r", "s", "t", "u", "v", "w", "x", "y", "z", "braceleft", "bar", "braceright", "asciitilde",
+};
+
+const char* const latin1_names[96] = {
+    "nbspace", "exclamdown", "cent", "sterling", "currency", "yen", "brokenbar", "section", "dieresis",
+    "copyright", "ordfeminine", "guillemotleft", "logicalnot", "sfthyphen", "registered", "macron", "degree",
+    "plusminus", "twosuperior", "threesuperior", "acute", "mu", "paragraph", "periodcentered", "cedilla",
+    "onesuperior", "ordmasculine", "guillemotright", "onequarter", "onehalf", "threequarters", "questiondown",
+    "Agrave", "Aacute", "Acircumflex", "Atilde", "Adieresis", "Aring", "AE", "Ccedilla", "Egrave", "Eacute",
+    "Ecircumflex", "Edieresis", "Igrave", "Iacute", "Icircumflex", "Idieresis", "Eth", "Ntilde", "Ograve",
+    "Oacute", "Ocircumflex", "Otilde", "Odieresis", "multiply", "Oslash", "Ugrave", "Uacute", "Ucircumflex",
+    "Udieresis", "Yacute", "Thorn", "germandbls", "agrave", "aacute", "acircumflex", "atilde", "adieresis",
+    "aring", "ae", "ccedilla", "egrave", "eacute", "ecircumflex", "edieresis", "igrave", "iacute", "icircumflex",
+    "idieresis", "eth", "ntilde", "ograve", "oacute", "ocircumflex", "otilde", "odieresis", "divide", "oslash",
+    "ugrave", "uacute", "ucircumflex", "udieresis", "yacute", "thorn", "ydieresis",
+};
+
+struct NamedGlyph {
+    const char* name;
+    uint16_t unicode;
+};
+
+const NamedGlyph extra_names[] = {
+    {"quoteleft", 0x2018}, {"quoteright", 0x2019}, {"quotedblleft", 0x201C}, {"quotedblright", 0x201D},
+    {"quotesinglbase", 0x201A}, {"quotedblbase", 0x201E}, {"guilsinglleft", 0x2039}, {"guilsinglright", 0x203A},
+    {"dagger", 0x2020}, {"daggerdbl", 0x2021}, {"bullet", 0x2022}, {"ellipsis", 0x2026}, {"endash", 0x2013},
+    {"emdash", 0x2014}, {"perthousand", 0x2030}, {"trademark", 0x2122}, {"Euro", 0x20AC}, {"florin", 0x0192},
+    {"fraction", 0x2044}, {"fi", 0xFB01}, {"fl", 0xFB02}, {"ff", 0xFB00}, {"ffi", 0xFB03}, {"ffl", 0xFB04},
+    {"circumflex", 0x02C6}, {"tilde", 0x02DC}, {"breve", 0x02D8}, {"dotaccent", 0x02D9}, {"ring", 0x02DA},
+    {"hungarumlaut", 0x02DD}, {"ogonek", 0x02DB}, {"caron", 0x02C7}, {"dotlessi", 0x0131}, {"Lslash", 0x0141},
+    {"lslash", 0x0142}, {"OE", 0x0152}, {"oe", 0x0153}, {"Scaron", 0x0160}, {"scaron", 0x0161},
+    {"Zcaron", 0x017D}, {"zcaron", 0x017E}, {"Ydieresis", 0x0178}, {"minus", 0x2212}, {"notequal", 0x2260},
+    {"lessequal", 0x2264}, {"greaterequal", 0x2265}, {"infinity", 0x221E}, {"partialdiff", 0x2202},
+    {"summation", 0x2211}, {"product", 0x220F}, {"pi", 0x03C0}, {"integral", 0x222B}, {"Omega", 0x03A9},
+    {"radical", 0x221A}, {"approxequal", 0x2248}, {"Delta", 0x2206}, {"lozenge", 0x25CA}, {"space", 0x0020},
+    {"middot", 0x00B7}, {"softhyphen", 0x00AD}, {"Ohm", 0x2126}, {"mu1", 0x00B5}, {"degree", 0x00B0},
+};
+
+// Widths for codes 32..126 in StandardEncoding order
+const int16_t helvetica_widths[95] = {
+    278, 278, 355, 556, 556, 889, 667, 222, 333, 333, 389, 584, 278, 333, 278, 278, 556, 556, 556,
+    556, 556, 556, 556, 556, 556, 556, 278, 278, 584, 584, 584, 556, 1015, 667, 667, 722, 722, 667,
+    611, 778, 722, 278, 500, 667, 556, 833, 722, 778, 667, 778, 722, 667, 611, 722, 667, 944, 667,
+    667, 611, 278, 278, 278, 469, 556, 222, 556, 556, 500, 556, 556, 278, 556, 556, 222, 222, 500,
+    222, 833, 556, 556, 556, 556, 333, 500, 278, 556, 500, 722, 500, 500, 500, 334, 260, 334, 584,
+};
+
+const int16_t times_widths[95] = {
+    250, 333, 408, 500, 500, 833, 778, 333, 333, 333, 500, 564, 250, 333, 250, 278, 500, 500, 500,
+    500, 500, 500, 500, 500, 500, 500, 278, 278, 564, 564, 564, 444, 921, 722, 667, 667, 722, 611,
+    556, 722, 722, 333, 389, 722, 611, 889, 722, 722, 556, 722, 667, 556, 611, 722, 722, 944, 722,
+    722, 611, 333, 278, 333, 469, 500, 333, 444, 500, 444, 500, 444, 333, 500, 500, 278, 278, 500,
+    278, 778, 500, 500, 500, 500, 333, 389, 278, 500, 500, 722, 500, 500, 444, 480, 200, 480, 541,
+};
+
+struct EncodingTables {
+    uint16_t standard[256] = {};
+    uint16_t win_ansi[256] = {};
+    uint16_t mac_roman[256] = {};
+    uint16_t pdf_doc[256] = {};
+    int16_t courier[95];
+    std::unordered_map<std::string, uint16_t> names;
+
+    EncodingTables() {
+        for (int c = 0x20; c < 0x7F; c++) {
+            standard[c] = win_ansi[c] = mac_roman[c] = pdf_doc[c] = (uint16_t)c;
+        }
+        standard[0x27] = 0x2019;
+        standard[0x60] = 0x2018;
+        for (const auto& mapping : standard_high) {
+            standard[mapping.code] = mapping.unicode;
+        }
+        for (int c = 0; c < 32; c++) {
+            win_ansi[0x80 + c] = win_ansi_80[c];
+        }
+        for (int c = 0xA0; c < 0x100; c++) {
+            win_ansi[c] = (uint16_t)c;
+            pdf_doc[c] = (uint16_t)c;
+        }
+        for (int c = 0; c < 128; c++) {
+            mac_roman[0x80 + c] = mac_roman_80[c];
+        }
+        pdf_doc[0x09] = 0x09;
+        pdf_doc[0x0A] = 0x0A;
+        pdf_doc[0x0D] = 0x0D;
+        for (int c = 0; c < 8; c++) {
+            pdf_doc[0x18 + c] = pdf_doc_18[c];
+        }
+        for (int c = 0; c < 33; c++) {
+            pdf_doc[0x80 + c] = pdf_doc_80[c];
+        }
+        pdf_doc[0xAD] = 0;
+        for (auto& width : courier) {
+            width = 600;
+        }
+
+        for (int c = 0; c < 95; c++) {
+            names.emplace(ascii_names[c], (uint16_t)(0x20 + c));
+        }
+        for (int c = 0; c < 96; c++) {
+            names.emplace(latin1_names[c], (uint16_t)(0xA0 + c));
+        }
+        for (const auto& glyph : extra_names) {
+            names.emplace(glyph.name, glyph.unicode);
+        }
+    }
+};
+
+const EncodingTables& tables() {
+    static const EncodingTables instance;
+    return instance;
+}
+
+uint32_t parse_hex(const char* p, size_t length) {
+    uint32_t value = 0;
+    for (size_t i = 0; i < length; i++) {
+        char c = p[i];
+        int digit;
+        if (c >= '0' && c <= '9') {
+            digit = c - '0';
+        } else if (c >= 'A' && c <= 'F') {
+            digit = c - 'A' + 10;
+        } else if (c >= 'a' && c <= 'f') {
+            digit = c - 'a' + 10;
+        } else {
+            return 0;
+        }
+        value = value << 4 | (uint32_t)digit;
+    }
+    return value;
+}
+
+} // namespace
+
+const uint16_t* base_encoding_table(BaseEncoding encoding) {
+    switch (encoding) {
+        case BaseEncoding::WinAnsi: return tables().win_ansi;
+        case BaseEncoding::MacRoman: return tables().mac_roman;
+        case BaseEncoding::PdfDoc: return tables().pdf_doc;
+        case BaseEncoding::Standard: break;
+    }
+    return tables().standard;
+}
+
+uint32_t glyph_name_to_unicode(const std::string& name) {
+    if (name.empty()) {
+        return 0;
+    }
+    const auto& names = tables().names;
+    auto found = names.find(name);
+    if (found != names.end()) {
+        return found->second;
+    }
+    // "a.sc", "one.oldstyle": the part before the dot names the character
+    size_t dot = name.find('.');
+    if (dot != std::string::npos && dot > 0) {
+        return glyph_name_to_unicode(name.substr(0, dot));
+    }
+    if (name.size() == 7 && name.compare(0, 3, "uni") == 0) {
+        return parse_hex(name.data() + 3, 4);
+    }
+    if (name.size() >= 5 && name.size() <= 7 && name[0] == 'u') {
+        return parse_hex(name.data() + 1, name.size() - 1);
+    }
+    if (name.size() == 1) {
+        return (unsigned char)name[0];
+    }
+    return 0;
+}
+
+const int16_t* standard_font_widths(const std::string& base_font) {
+    // Subset prefixes ("ABCDEF+Helvetica") don't change the metrics
+    std::string font = base_font.size() > 7 && base_font[6] == '+' ? base_font.substr(7) : base_font;
+    if (font.compare(0, 9, "Helvetica") == 0 || font.compare(0, 5, "Arial") == 0) {
+        return helvetica_widths;
+    }
+    if (font.compare(0, 5, "Times") == 0) {
+        return times_widths;
+    }
+    if (font.compare(0, 7, "Courier") == 0) {
+        return tables().courier;
+    }
+    return nullptr;
+}
+
+void append_utf8(uint32_t code_point, std::string* out) {
+    if (code_point < 0x80) {
+        *out += (char)code_point;
+    } else if (code_point < 0x800) {
+        *out += (char)(0xC0 | code_point >> 6);
+        *out += (char)(0x80 | (code_point & 0x3F));
+    } else if (code_point < 0x10000) {
+        *out += (char)(0xE0 | code_point >> 12);
+        *out += (char)(0x80 | (code_point >> 6 & 0x3F));
+        *out += (char)(0x80 | (code_point & 0x3F));
+    } else if (code_point < 0x110000) {
+        *out += (char)(0xF0 | code_point >> 18);
+        *out += (char)(0x80 | (code_point >> 12 & 0x3F));
+        *out += (char)(0x80 | (code_point >> 6 & 0x3F));
+        *out += (char)(0x80 | (code_point & 0x3F));
+    }
+}
+
+} // namespace spdf
@@ -0,0 +1,26 @@
+#ifndef SPDF_ENCODINGS_H
+#define SPDF_ENCODINGS_H
+
+#include <cstdint>
+#include <string>
+
+namespace spdf {
+
+enum class BaseEncoding { Standard, WinAnsi, MacRoman, PdfDoc };
+
+// Unicode code point of each byte in a simple-font base encoding; 0 where undefined
+const uint16_t* base_encoding_table(BaseEncoding encoding);
+
+// Unicode for an Adobe glyph name: the common Latin names, "uniXXXX",
+// "uXXXX[XX]", single characters and "name.suffix" variants. 0 when unknown.
+uint32_t glyph_name_to_unicode(const std::string& name);
+
+// Glyph widths (1/1000 em) of codes 32..126 for the standard 14 fonts that
+// PDFs may use without /Widths; nullptr when the font isn't one of them
+const int16_t* standard_font_widths(const std::string& base_font);
+
+void append_utf8(uint32_t code_point, std::string* out);
+
+} // namespace spdf
+
+#endif // SPDF_ENCODINGS_H
@@ -0,0 +1,352 @@
+#include "spdf_executor.h"
+#include <sys/resource.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <algorithm>
+#include <chrono>
+#include <fstream>
+#include <memory>
+
+#if defined(__linux__)
+#include <sched.h>
+#include <sys/syscall.h>
+#endif
+
+namespace spdf {
+
+// Longest a bulk thread pauses at one chunk boundary for interactive work
+static const std::chrono::milliseconds MAX_YIELD(20);
+// Scheduling priority of bulk threads: Android's THREAD_PRIORITY_BACKGROUND
+static const int BULK_NICE = 10;
+
+static thread_local TaskClass thread_class = TaskClass::Bulk;
+
+namespace {
+
+// One parallel() call, shared with the tasks that help with it; they may
+// start after it returned and then find nothing left to do
+struct ParallelRun {
+    size_t count = 0;
+    const std::function<void(size_t)>* work = nullptr;
+    std::atomic<size_t> next{0};
+    std::mutex mutex;
+    std::condition_variable finished;
+    size_t done = 0;
+};
+
+} // namespace
+
+static uint64_t read_number(const std::string& path) {
+    std::ifstream file(path);
+    uint64_t value = 0;
+    return file >> value ? value : 0;
+}
+
+CpuTopology CpuTopology::read(const std::string& sysfs) {
+    std::vector<std::pair<int, uint64_t>> cpus;
+    for (int cpu = 0;; cpu++) {
+        std::string dir = sysfs + "/cpu" + std::to_string(cpu);
+        struct stat info;
+        if (stat(dir.c_str(), &info) != 0) {
+            break;
+        }
+        uint64_t capacity = read_number(dir + "/cpu_capacity");
+        if (!capacity) {
+            capacity = read_number(dir + "/cpufreq/cpuinfo_max_freq");
+        }
+        cpus.emplace_back(cpu, capacity);
+    }
+    CpuTopology topology;
+    if (cpus.empty()) {
+        unsigned count = std::max(1u, std::thread::hardware_concurrency());
+        for (unsigned cpu = 0; cpu < count; cpu++) {
+            topology.performance.push_back((int)cpu);
+        }
+        return topology;
+    }
+    uint64_t fastest = 0;
+    for (const auto& cpu : cpus) {
+        fastest = std::max(fastest, cpu.second);
+    }
+    // Cores of unknown speed are taken to be fast ones
+    for (const auto& cpu : cpus) {
+        (cpu.second == fastest || !cpu.second ? topology.performance : topology.efficiency).push_back(cpu.first);
+    }
+    return topology;
+}
+
+// Affinity and priority are hints: where the system refuses them, threads
+// run as they are
+static void pin_thread(const std::vector<int>& cpus) {
+#if defined(__linux__)
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    for (int cpu : cpus) {
+        if (cpu < CPU_SETSIZE) {
+            CPU_SET(cpu, &set);
+        }
+    }
+    sched_setaffinity(0, sizeof(set), &set);
+#else
+    (void)cpus;
+#endif
+}
+
+static void lower_thread_priority() {
+#if defined(__linux__)
+    // Linux applies this to the thread rather than the whole process
+    setpriority(PRIO_PROCESS, (id_t)syscall(SYS_gettid), BULK_NICE);
+#endif
+}
+
+Executor::~Executor() {
+    stop();
+}
+
+void Executor::configure(const ExecutorOptions& options) {
+    stop();
+    std::lock_guard<std::mutex> lock(mutex_);
+    options_ = options;
+    stopping_ = false;
+}
+
+const CpuTopology& Executor::topology() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return topology_locked();
+}
+
+const CpuTopology& Executor::topology_locked() {
+    if (!topology_read_) {
+        topology_ = CpuTopology::read();
+        topology_read_ = true;
+    }
+    return topology_;
+}
+
+void Executor::start_locked(TaskClass task_class) {
+    Pool& pool = pools_[(int)task_class];
+    if (options_.deterministic || !pool.threads.empty()) {
+        return;
+    }
+    const CpuTopology& cpus = topology_locked();
+    unsigned count = task_class == TaskClass::Interactive ? options_.interactive_threads : options_.bulk_threads;
+    if (!count) {
+        count = (unsigned)std::max<size_t>(1, task_class == TaskClass::Interactive ? cpus.performance.size()
+                                                                                   : cpus.cores());
+    }
+    for (unsigned i = 0; i < count; i++) {
+        pool.threads.emplace_back(&Executor::worker, this, task_class, (size_t)i);
+    }
+}
+
+void Executor::worker(TaskClass task_class, size_t index) {
+    // The topology and options stay as they are while threads run
+    if (options_.affinity && !topology_.efficiency.empty()) {
+        if (task_class == TaskClass::Interactive) {
+            pin_thread(topology_.performance);
+        } else if (index < topology_.efficiency.size()) {
+            pin_thread(topology_.efficiency);
+        }
+    }
+    if (task_class == TaskClass::Bulk) {
+        lower_thread_priority();
+    }
+    Pool& pool = pools_[(int)task_class];
+    for (;;) {
+        std::function<void()> task;
+        {
+            std::unique_lock<std::mutex> lock(mutex_);
+            ready_.wait(lock, [&]() { return stopping_ || !pool.queue.empty(); });
+            if (pool.queue.empty()) {
+                return;
+            }
+            task = std::move(pool.queue.front());
+            pool.queue.pop_front();
+        }
+        run_task(task_class, task);
+    }
+}
+
+void Executor::run_task(TaskClass task_class, const std::function<void()>& task) {
+    TaskClass previous = thread_class;
+    thread_class = task_class;
+    task();
+    thread_class = previous;
+    if (task_class == TaskClass::Interactive) {
+        interactive_finished();
+    }
+    std::lock_guard<std::mutex> lock(mutex_);
+    (task_class == TaskClass::Interactive ? stats_.interactive_tasks : stats_.bulk_tasks)++;
+}
+
+void Executor::stop() {
+    bool deterministic;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        stopping_ = true;
+        deterministic = options_.deterministic;
+        ready_.notify_all();
+    }
+    if (deterministic) {
+        run_pending();
+    }
+    for (Pool& pool : pools_) {
+        for (auto& thread : pool.threads) {
+            thread.join();
+        }
+        pool.threads.clear();
+    }
+}
+
+void Executor::submit(TaskClass task_class, std::function<void()> task) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (task_class == TaskClass::Interactive) {
+        interactive_active_++;
+    }
+    pools_[(int)task_class].queue.push_back(std::move(task));
+    start_locked(task_class);
+    ready_.notify_all();
+}
+
+void Executor::parallel(size_t count, unsigned threads, const std::function<void(size_t)>& work) {
+    TaskClass task_class = thread_class;
+    auto run_chunk = [&](size_t i) {
+        if (task_class != TaskClass::Bulk) {
+            work(i);
+            return;
+        }
+        yield();
+        bulk_running_++;
+        work(i);
+        bulk_running_--;
+    };
+    size_t workers = std::min<size_t>(std::max(1u, threads), count);
+    if (workers <= 1 || options_.deterministic) {
+        for (size_t i = 0; i < count; i++) {
+            run_chunk(i);
+        }
+        return;
+    }
+
+    auto run = std::make_shared<ParallelRun>();
+    run->count = count;
+    run->work = &work;
+    auto drain = [this, run, task_class]() {
+        while (run->next.load() < run->count) {
+            if (task_class == TaskClass::Bulk) {
+                yield();
+            }
+            size_t i = run->next.fetch_add(1);
+            if (i >= run->count) {
+                return;
+            }
+            bulk_running_ += task_class == TaskClass::Bulk;
+            (*run->work)(i);
+            bulk_running_ -= task_class == TaskClass::Bulk;
+            std::lock_guard<std::mutex> lock(run->mutex);
+            if (++run->done == run->count) {
+                run->finished.notify_all();
+            }
+        }
+    };
+    for (size_t i = 1; i < workers; i++) {
+        submit(task_class, drain);
+    }
+    drain();
+    std::unique_lock<std::mutex> lock(run->mutex);
+    run->finished.wait(lock, [&]() { return run->done == run->count; });
+}
+
+void Executor::yield() {
+    if (thread_class != TaskClass::Bulk || !interactive_active_.load()) {
+        return;
+    }
+    if (options_.deterministic) {
+        // Interactive tasks queued so far run here, in order
+        for (;;) {
+            std::function<void()> task;
+            {
+                std::lock_guard<std::mutex> lock(mutex_);
+                auto& queue = pools_[(int)TaskClass::Interactive].queue;
+                if (queue.empty()) {
+                    return;
+                }
+                task = std::move(queue.front());
+                queue.pop_front();
+                stats_.yields++;
+            }
+            run_task(TaskClass::Interactive, task);
+        }
+    }
+    std::unique_lock<std::mutex> lock(mutex_);
+    size_t cores = topology_locked().cores();
+    auto deadline = std::chrono::steady_clock::now() + MAX_YIELD;
+    bool paused = false;
+    // This thread would be one more inside a bulk chunk
+    while (interactive_active_ && bulk_running_ + 1 + interactive_active_ > cores) {
+        paused = true;
+        if (interactive_done_.wait_until(lock, deadline) == std::cv_status::timeout) {
+            break;
+        }
+    }
+    stats_.yields += paused;
+}
+
+size_t Executor::run_pending() {
+    size_t ran = 0;
+    for (;;) {
+        std::function<void()> task;
+        TaskClass task_class = TaskClass::Interactive;
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            auto& interactive = pools_[(int)TaskClass::Interactive].queue;
+            auto& bulk = pools_[(int)TaskClass::Bulk].queue;
+            auto& queue = !interactive.empty() ? interactive : bulk;
+            if (queue.empty()) {
+                return ran;
+            }
+            task_class = &queue == &interactive ? TaskClass::Interactive : TaskClass::Bulk;
+            task = std::move(queue.front());
+            queue.pop_front();
+        }
+        run_task(task_class, task);
+        ran++;
+    }
+}
+
+void Executor::interactive_finished() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    interactive_active_--;
+    interactive_done_.notify_all();
+}
+
+Executor::Stats Executor::stats() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return stats_;
+}
+
+Executor& executor() {
+    static Executor instance;
+    return instance;
+}
+
+TaskClassScope::TaskClassScope(TaskClass task_class) : previous_(thread_class) {
+    thread_class = task_class;
+    if (task_class == TaskClass::Interactive && previous_ != TaskClass::Interactive) {
+        counted_ = true;
+        executor().interactive_active_++;
+    }
+}
+
+TaskClassScope::~TaskClassScope() {
+    thread_class = previous_;
+    if (counted_) {
+        executor().interactive_finished();
+    }
+}
+
+TaskClass current_task_class() {
+    return thread_class;
+}
+
+} // namespace spdf
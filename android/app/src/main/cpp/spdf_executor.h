@@ -0,0 +1,130 @@
+#ifndef SPDF_EXECUTOR_H
+#define SPDF_EXECUTOR_H
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace spdf {
+
+// What a task is for, which decides the threads it runs on and who waits
+enum class TaskClass {
+    Interactive,  // the user is waiting: page counts, validation, text
+    Bulk,         // whole-file work: merge, compress, rewrite
+};
+
+// Cores by speed, from sysfs: cpu_capacity where the kernel exposes it (arm64
+// big.LITTLE), else cpufreq/cpuinfo_max_freq. On CPUs whose cores are all
+// alike every core counts as a performance core.
+struct CpuTopology {
+    std::vector<int> performance;  // the fastest cores
+    std::vector<int> efficiency;   // the others
+
+    static CpuTopology read(const std::string& sysfs = "/sys/devices/system/cpu");
+    size_t cores() const { return performance.size() + efficiency.size(); }
+};
+
+struct ExecutorOptions {
+    unsigned interactive_threads = 0;  // 0: one per performance core
+    unsigned bulk_threads = 0;         // 0: one per core
+    bool affinity = true;              // pin threads as described below
+    // No threads at all: parallel() runs on the caller in order, and submitted
+    // tasks wait for run_pending() or for a chunk boundary (interactive ones)
+    bool deterministic = false;
+};
+
+// Process-wide worker pool shared by all parallel native work. Each class has
+// its own threads: interactive ones are pinned to the performance cores, bulk
+// ones run at background priority, the first as many of them as there are
+// efficiency cores pinned to those and the rest anywhere. Work is split into
+// chunks (the items of parallel()), and bulk work checks between chunks
+// whether interactive work is short of cores: if it is, bulk threads pause
+// until it is done, for at most a moment each, so a long compress does not
+// hold up a page count. Thread-safe.
+class Executor {
+public:
+    struct Stats {
+        uint64_t interactive_tasks = 0;
+        uint64_t bulk_tasks = 0;
+        uint64_t yields = 0;  // chunk boundaries at which bulk work paused
+    };
+
+    Executor() = default;
+    ~Executor();
+    Executor(const Executor&) = delete;
+    Executor& operator=(const Executor&) = delete;
+
+    // Waits for the queued tasks, stops the threads and starts over with
+    // options; threads are started again on demand
+    void configure(const ExecutorOptions& options);
+    const CpuTopology& topology();
+
+    void submit(TaskClass task_class, std::function<void()> task);
+    // Runs work(0) .. work(count - 1) on up to threads threads of the calling
+    // thread's class (see TaskClassScope), the caller included
+    void parallel(size_t count, unsigned threads, const std::function<void(size_t)>& work);
+    // Chunk boundary of bulk work on the calling thread; see above
+    void yield();
+    // Deterministic mode: runs the queued tasks on the calling thread,
+    // interactive ones first; returns how many ran
+    size_t run_pending();
+
+    Stats stats() const;
+
+private:
+    struct Pool {
+        std::deque<std::function<void()>> queue;
+        std::vector<std::thread> threads;
+    };
+    friend class TaskClassScope;
+
+    const CpuTopology& topology_locked();
+    void start_locked(TaskClass task_class);
+    void worker(TaskClass task_class, size_t index);
+    void run_task(TaskClass task_class, const std::function<void()>& task);
+    void stop();
+    void interactive_finished();
+
+    mutable std::mutex mutex_;
+    std::condition_variable ready_;
+    std::condition_variable interactive_done_;
+    ExecutorOptions options_;
+    bool topology_read_ = false;
+    CpuTopology topology_;
+    Pool pools_[2];
+    bool stopping_ = false;
+    std::atomic<unsigned> interactive_active_{0};  // interactive tasks queued or running
+    std::atomic<unsigned> bulk_running_{0};        // threads inside a bulk chunk
+    Stats stats_;
+};
+
+// Process-wide instance
+Executor& executor();
+
+// Class of the work on the calling thread for as long as it lives; threads
+// without one do bulk work. Interactive scopes count as interactive work
+// waiting for cores, see Executor.
+class TaskClassScope {
+public:
+    explicit TaskClassScope(TaskClass task_class);
+    ~TaskClassScope();
+    TaskClassScope(const TaskClassScope&) = delete;
+    TaskClassScope& operator=(const TaskClassScope&) = delete;
+
+private:
+    TaskClass previous_;
+    bool counted_ = false;
+};
+
+TaskClass current_task_class();
+
+} // namespace spdf
+
+#endif // SPDF_EXECUTOR_H
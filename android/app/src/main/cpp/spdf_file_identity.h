@@ -0,0 +1,38 @@
+#ifndef SPDF_FILE_IDENTITY_H
+#define SPDF_FILE_IDENTITY_H
+
+#include <sys/stat.h>
+#include <cstdint>
+#include <string>
+
+namespace spdf {
+
+// Cheap stand-in for file contents: a file whose device, inode, size and
+// mtime are unchanged is treated as unchanged.
+struct FileIdentity {
+    uint64_t device = 0;
+    uint64_t inode = 0;
+    uint64_t size = 0;
+    int64_t mtime_ns = 0;
+
+    bool operator==(const FileIdentity& other) const {
+        return device == other.device && inode == other.inode && size == other.size && mtime_ns == other.mtime_ns;
+    }
+    bool operator!=(const FileIdentity& other) const { return !(*this == other); }
+
+    static bool of(const std::string& path, FileIdentity* identity) {
+        struct stat st;
+        if (stat(path.c_str(), &st) != 0 || !S_ISREG(st.st_mode)) {
+            return false;
+        }
+        identity->device = (uint64_t)st.st_dev;
+        identity->inode = (uint64_t)st.st_ino;
+        identity->size = (uint64_t)st.st_size;
+        identity->mtime_ns = (int64_t)st.st_mtim.tv_sec * 1000000000LL + st.st_mtim.tv_nsec;
+        return true;
+    }
+};
+
+} // namespace spdf
+
+#endif // SPDF_FILE_IDENTITY_H
@@ -0,0 +1,338 @@
+#include "spdf_filters.h"
+#include <zlib.h>
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+#include "spdf_memory.h"
+
+namespace spdf {
+
+// Under a memory budget, inflated output grows by at most this share of it
+// per step, and slack above a quarter of its size is given back
+static const unsigned INFLATE_SHARE = 16;
+
+bool flate_decode(const char* data, size_t size, std::string* output, std::string* error) {
+    output->clear();
+    z_stream stream;
+    memset(&stream, 0, sizeof(stream));
+    if (inflateInit(&stream) != Z_OK) {
+        *error = "inflateInit failed";
+        return false;
+    }
+    stream.next_in = (Bytef*)data;
+    stream.avail_in = (uInt)size;
+
+    size_t chunk = memory_budget().share(size < 16384 ? 65536 : size * 4, INFLATE_SHARE);
+    int status = Z_OK;
+    while (status == Z_OK) {
+        size_t used = output->size();
+        output->resize(used + chunk);
+        stream.next_out = (Bytef*)&(*output)[used];
+        stream.avail_out = (uInt)chunk;
+        status = inflate(&stream, Z_NO_FLUSH);
+        output->resize(used + (chunk - stream.avail_out));
+        if (status == Z_BUF_ERROR && stream.avail_in == 0) {
+            // Input ended without a final block: keep what was produced
+            break;
+        }
+    }
+    inflateEnd(&stream);
+    if (memory_budget().limit() && output->capacity() - output->size() > output->size() / 4) {
+        output->shrink_to_fit();
+    }
+
+    if (status == Z_STREAM_END || status == Z_BUF_ERROR) {
+        return true;
+    }
+    if (!output->empty()) {
+        // Corruption after some output; readers conventionally use the prefix
+        return true;
+    }
+    *error = std::string("FlateDecode: ") + (stream.msg ? stream.msg : "corrupt data");
+    return false;
+}
+
+bool flate_encode(const char* data, size_t size, std::string* output, int level) {
+    uLongf length = compressBound((uLong)size);
+    output->resize(length);
+    if (compress2((Bytef*)&(*output)[0], &length, (const Bytef*)data, (uLong)size, level) != Z_OK) {
+        output->clear();
+        return false;
+    }
+    output->resize(length);
+    return true;
+}
+
+static bool lzw_decode(const std::string& input, bool early_change, std::string* output) {
+    output->clear();
+    std::vector<std::string> table;
+    table.reserve(4096);
+    auto reset = [&]() {
+        table.clear();
+        for (int i = 0; i < 256; i++) {
+            table.emplace_back(1, (char)i);
+        }
+        table.emplace_back();  // 256: clear
+        table.emplace_back();  // 257: end of data
+    };
+    reset();
+
+    uint32_t buffer = 0;
+    int bits = 0;
+    int code_length = 9;
+    int previous = -1;
+    for (unsigned char byte : input) {
+        buffer = buffer << 8 | byte;
+        bits += 8;
+        while (bits >= code_length) {
+            int code = (int)(buffer >> (bits - code_length)) & ((1 << code_length) - 1);
+            bits -= code_length;
+            if (code == 256) {
+                reset();
+                code_length = 9;
+                previous = -1;
+                continue;
+            }
+            if (code == 257) {
+                return true;
+            }
+            std::string entry;
+            if (code < (int)table.size()) {
+                entry = table[code];
+            } else if (previous >= 0 && code == (int)table.size()) {
+                entry = table[previous] + table[previous][0];
+            } else {
+                return !output->empty();
+            }
+            output->append(entry);
+            if (previous >= 0 && table.size() < 4096) {
+                table.push_back(table[previous] + entry[0]);
+            }
+            previous = code;
+            size_t next_size = table.size() + (early_change ? 1 : 0);
+            code_length = next_size >= 2048 ? 12 : next_size >= 1024 ? 11 : next_size >= 512 ? 10 : 9;
+        }
+    }
+    return true;
+}
+
+static bool ascii_hex_decode(const std::string& input, std::string* output) {
+    output->clear();
+    int high = -1;
+    for (unsigned char c : input) {
+        if (c == '>') {
+            break;
+        }
+        int value;
+        if (c >= '0' && c <= '9') {
+            value = c - '0';
+        } else if (c >= 'a' && c <= 'f') {
+            value = c - 'a' + 10;
+        } else if (c >= 'A' && c <= 'F') {
+            value = c - 'A' + 10;
+        } else {
+            continue;
+        }
+        if (high < 0) {
+            high = value;
+        } else {
+            *output += (char)(high << 4 | value);
+            high = -1;
+        }
+    }
+    if (high >= 0) {
+        *output += (char)(high << 4);
+    }
+    return true;
+}
+
+static bool ascii85_decode(const std::string& input, std::string* output) {
+    output->clear();
+    uint32_t group = 0;
+    int count = 0;
+    for (size_t i = 0; i < input.size(); i++) {
+        unsigned char c = (unsigned char)input[i];
+        if (c == '~') {
+            break;
+        }
+        if (c == 'z' && count == 0) {
+            output->append(4, '\0');
+            continue;
+        }
+        if (c < '!' || c > 'u') {
+            continue;
+        }
+        group = group * 85 + (c - '!');
+        if (++count == 5) {
+            for (int shift = 24; shift >= 0; shift -= 8) {
+                *output += (char)(group >> shift);
+            }
+            group = 0;
+            count = 0;
+        }
+    }
+    if (count > 1) {
+        // Partial final group: pad with 'u' and keep count - 1 bytes
+        for (int i = count; i < 5; i++) {
+            group = group * 85 + 84;
+        }
+        for (int i = 0; i < count - 1; i++) {
+            *output += (char)(group >> (24 - 8 * i));
+        }
+    }
+    return true;
+}
+
+static bool run_length_decode(const std::string& input, std::string* output) {
+    output->clear();
+    size_t i = 0;
+    while (i < input.size()) {
+        int length = (unsigned char)input[i++];
+        if (length == 128) {
+            break;
+        }
+        if (length < 128) {
+            size_t count = std::min((size_t)length + 1, input.size() - i);
+            output->append(input, i, count);
+            i += count;
+        } else if (i < input.size()) {
+            output->append((size_t)(257 - length), input[i++]);
+        }
+    }
+    return true;
+}
+
+// PNG (10-15) and TIFF (2) predictors from /DecodeParms
+static bool apply_predictor(const PdfDict& params, std::string* data, std::string* error) {
+    int predictor = (int)params.get("Predictor").as_int(1);
+    if (predictor <= 1) {
+        return true;
+    }
+    int colors = (int)params.get("Colors").as_int(1);
+    int bits = (int)params.get("BitsPerComponent").as_int(8);
+    int columns = (int)params.get("Columns").as_int(1);
+    if (colors < 1 || colors > 32 || bits < 1 || bits > 16 || columns < 1 || columns > (1 << 24)) {
+        *error = "invalid predictor parameters";
+        return false;
+    }
+    size_t bytes_per_pixel = (size_t)(colors * bits + 7) / 8;
+    size_t row_length = ((size_t)columns * colors * bits + 7) / 8;
+
+    if (predictor == 2) {
+        if (bits != 8) {
+            return true;
+        }
+        for (size_t row = 0; row + row_length <= data->size(); row += row_length) {
+            for (size_t i = bytes_per_pixel; i < row_length; i++) {
+                (*data)[row + i] = (char)((unsigned char)(*data)[row + i] + (unsigned char)(*data)[row + i - bytes_per_pixel]);
+            }
+        }
+        return true;
+    }
+
+    std::string output;
+    output.reserve(data->size());
+    std::vector<unsigned char> previous(row_length, 0);
+    std::vector<unsigned char> current(row_length);
+    const unsigned char* in = (const unsigned char*)data->data();
+    size_t remaining = data->size();
+    while (remaining > 0) {
+        int type = *in++;
+        remaining--;
+        size_t length = std::min(row_length, remaining);
+        memcpy(current.data(), in, length);
+        memset(current.data() + length, 0, row_length - length);
+        in += length;
+        remaining -= length;
+        for (size_t i = 0; i < row_length; i++) {
+            unsigned left = i >= bytes_per_pixel ? current[i - bytes_per_pixel] : 0;
+            unsigned up = previous[i];
+            unsigned up_left = i >= bytes_per_pixel ? previous[i - bytes_per_pixel] : 0;
+            switch (type) {
+                case 1: current[i] = (unsigned char)(current[i] + left); break;
+                case 2: current[i] = (unsigned char)(current[i] + up); break;
+                case 3: current[i] = (unsigned char)(current[i] + (left + up) / 2); break;
+                case 4: {
+                    int p = (int)left + (int)up - (int)up_left;
+                    int pa = abs(p - (int)left);
+                    int pb = abs(p - (int)up);
+                    int pc = abs(p - (int)up_left);
+                    unsigned predicted = pa <= pb && pa <= pc ? left : pb <= pc ? up : up_left;
+                    current[i] = (unsigned char)(current[i] + predicted);
+                    break;
+                }
+                default: break;
+            }
+        }
+        output.append((const char*)current.data(), length);
+        previous.swap(current);
+    }
+    data->swap(output);
+    return true;
+}
+
+static bool is_image_filter(const std::string& name) {
+    return name == "DCTDecode" || name == "DCT" || name == "JPXDecode" || name == "CCITTFaxDecode" ||
+           name == "CCF" || name == "JBIG2Decode";
+}
+
+bool decode_stream_data(const PdfDict& dict, const std::string& raw, std::string* output, std::string* error,
+                        std::string* image_filter) {
+    std::vector<std::string> filters;
+    std::vector<const PdfDict*> params;
+    static const PdfDict no_params;
+    const PdfObject& filter = dict.has("Filter") ? dict.get("Filter") : dict.get("F");
+    const PdfObject& parms = dict.has("DecodeParms") ? dict.get("DecodeParms") : dict.get("DP");
+    if (filter.is_name()) {
+        filters.push_back(filter.as_name());
+        params.push_back(parms.is_dict() ? &parms.as_dict() : &no_params);
+    } else if (filter.is_array()) {
+        for (size_t i = 0; i < filter.as_array().size(); i++) {
+            filters.push_back(filter.as_array()[i].as_name());
+            const PdfObject* p = parms.is_array() && i < parms.as_array().size() ? &parms.as_array()[i] : nullptr;
+            params.push_back(p && p->is_dict() ? &p->as_dict() : &no_params);
+        }
+    }
+
+    *output = raw;
+    std::string scratch;
+    for (size_t i = 0; i < filters.size(); i++) {
+        const std::string& name = filters[i];
+        bool ok;
+        if (name == "FlateDecode" || name == "Fl") {
+            ok = flate_decode(output->data(), output->size(), &scratch, error) &&
+                 apply_predictor(*params[i], &scratch, error);
+        } else if (name == "LZWDecode" || name == "LZW") {
+            ok = lzw_decode(*output, params[i]->get("EarlyChange").as_int(1) != 0, &scratch) &&
+                 apply_predictor(*params[i], &scratch, error);
+        } else if (name == "ASCIIHexDecode" || name == "AHx") {
+            ok = ascii_hex_decode(*output, &scratch);
+        } else if (name == "ASCII85Decode" || name == "A85") {
+            ok = ascii85_decode(*output, &scratch);
+        } else if (name == "RunLengthDecode" || name == "RL") {
+            ok = run_length_decode(*output, &scratch);
+        } else if (is_image_filter(name)) {
+            if (image_filter) {
+                *image_filter = name;
+            }
+            return true;
+        } else if (name == "Crypt") {
+            // Identity crypt filter; real decryption happens before the chain
+            continue;
+        } else {
+            *error = "unsupported filter " + name;
+            return false;
+        }
+        if (!ok) {
+            if (error->empty()) {
+                *error = name + ": corrupt data";
+            }
+            return false;
+        }
+        output->swap(scratch);
+    }
+    return true;
+}
+
+} // namespace spdf
@@ -0,0 +1,24 @@
+#ifndef SPDF_FILTERS_H
+#define SPDF_FILTERS_H
+
+#include <string>
+#include "spdf_object.h"
+
+namespace spdf {
+
+// Applies the /Filter chain of a stream dictionary to its raw bytes. /Filter
+// and /DecodeParms must already be direct objects. Image codecs (DCTDecode,
+// JPXDecode, CCITTFaxDecode, JBIG2Decode) are not decoded here: the chain
+// stops in front of them and *image_filter, when given, receives the name.
+bool decode_stream_data(const PdfDict& dict, const std::string& raw, std::string* output, std::string* error,
+                        std::string* image_filter = nullptr);
+
+// zlib/deflate; truncated or slightly corrupt data yields what could be inflated
+bool flate_decode(const char* data, size_t size, std::string* output, std::string* error);
+
+// zlib stream for /FlateDecode at the given zlib compression level
+bool flate_encode(const char* data, size_t size, std::string* output, int level = 6);
+
+} // namespace spdf
+
+#endif // SPDF_FILTERS_H
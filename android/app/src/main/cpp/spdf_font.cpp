@@ -0,0 +1,401 @@
+#include "spdf_font.h"
+#include <algorithm>
+#include <cstdlib>
+#include "spdf_document.h"
+#include "spdf_encodings.h"
+#include "spdf_lexer.h"
+
+namespace spdf {
+
+static uint32_t code_value(std::string_view bytes) {
+    uint32_t value = 0;
+    for (size_t i = 0; i < bytes.size() && i < 4; i++) {
+        value = value << 8 | (unsigned char)bytes[i];
+    }
+    return value;
+}
+
+static std::u16string utf16_units(std::string_view bytes) {
+    std::u16string units;
+    for (size_t i = 0; i + 1 < bytes.size(); i += 2) {
+        units += (char16_t)((unsigned char)bytes[i] << 8 | (unsigned char)bytes[i + 1]);
+    }
+    if (bytes.size() == 1) {
+        // Some producers write single-byte destinations
+        units += (char16_t)(unsigned char)bytes[0];
+    }
+    return units;
+}
+
+static void append_utf16(const std::u16string& units, std::string* utf8) {
+    for (size_t i = 0; i < units.size(); i++) {
+        uint32_t unit = units[i];
+        if (unit >= 0xD800 && unit < 0xDC00 && i + 1 < units.size() && units[i + 1] >= 0xDC00 &&
+            units[i + 1] < 0xE000) {
+            unit = 0x10000 + ((unit - 0xD800) << 10) + (units[i + 1] - 0xDC00);
+            i++;
+        }
+        append_utf8(unit, utf8);
+    }
+}
+
+bool CMap::parse(const std::string& program) {
+    Lexer lexer(program.data(), program.size());
+    Token token;
+    enum class Section { None, Codespace, BfChar, BfRange, CidChar, CidRange } section = Section::None;
+    std::vector<std::string> operands;
+    std::vector<std::string> array;
+    bool in_array = false;
+
+    while (lexer.next(&token)) {
+        if (token.type == TokenType::Keyword) {
+            std::string_view keyword = token.text;
+            if (keyword == "begincodespacerange") {
+                section = Section::Codespace;
+            } else if (keyword == "beginbfchar") {
+                section = Section::BfChar;
+            } else if (keyword == "beginbfrange") {
+                section = Section::BfRange;
+            } else if (keyword == "begincidchar") {
+                section = Section::CidChar;
+            } else if (keyword == "begincidrange") {
+                section = Section::CidRange;
+            } else if (keyword.compare(0, 3, "end") == 0) {
+                section = Section::None;
+            }
+            operands.clear();
+            continue;
+        }
+        if (section == Section::None) {
+            continue;
+        }
+        if (token.type == TokenType::ArrayOpen) {
+            in_array = true;
+            array.clear();
+            continue;
+        }
+        if (token.type == TokenType::ArrayClose) {
+            in_array = false;
+        } else if (in_array) {
+            array.emplace_back(token.text);
+            continue;
+        } else if (token.type == TokenType::Integer) {
+            operands.push_back(std::to_string(token.integer));
+        } else if (token.type == TokenType::Name) {
+            operands.push_back("/" + std::string(token.text));
+        } else {
+            operands.emplace_back(token.text);
+        }
+
+        switch (section) {
+            case Section::Codespace:
+                if (operands.size() == 2) {
+                    Codespace range;
+                    range.low = code_value(operands[0]);
+                    range.high = code_value(operands[1]);
+                    range.bytes = (uint8_t)std::min<size_t>(std::max<size_t>(operands[0].size(), 1), 4);
+                    codespaces_.push_back(range);
+                    operands.clear();
+                }
+                break;
+            case Section::BfChar:
+                if (operands.size() == 2) {
+                    uint32_t code = code_value(operands[0]);
+                    if (!operands[1].empty() && operands[1][0] == '/') {
+                        uint32_t unicode = glyph_name_to_unicode(operands[1].substr(1));
+                        if (unicode) {
+                            unicode_[code] = std::u16string(1, (char16_t)unicode);
+                        }
+                    } else {
+                        unicode_[code] = utf16_units(operands[1]);
+                    }
+                    operands.clear();
+                }
+                break;
+            case Section::BfRange:
+                if (token.type == TokenType::ArrayClose && operands.size() == 2) {
+                    // <low> <high> [<dst> <dst> ...]
+                    uint32_t low = code_value(operands[0]);
+                    uint32_t high = code_value(operands[1]);
+                    for (size_t i = 0; i < array.size() && low + i <= high; i++) {
+                        unicode_[low + (uint32_t)i] = utf16_units(array[i]);
+                    }
+                    operands.clear();
+                } else if (operands.size() == 3) {
+                    UnicodeRange range;
+                    range.low = code_value(operands[0]);
+                    range.high = code_value(operands[1]);
+                    range.start = utf16_units(operands[2]);
+                    if (range.low <= range.high && !range.start.empty()) {
+                        unicode_ranges_.push_back(std::move(range));
+                    }
+                    operands.clear();
+                }
+                break;
+            case Section::CidChar:
+                if (operands.size() == 2) {
+                    uint32_t code = code_value(operands[0]);
+                    cid_ranges_.push_back(CidRange{code, code, (uint32_t)strtoul(operands[1].c_str(), nullptr, 10)});
+                    operands.clear();
+                }
+                break;
+            case Section::CidRange:
+                if (operands.size() == 3) {
+                    cid_ranges_.push_back(CidRange{code_value(operands[0]), code_value(operands[1]),
+                                                   (uint32_t)strtoul(operands[2].c_str(), nullptr, 10)});
+                    operands.clear();
+                }
+                break;
+            case Section::None:
+                break;
+        }
+    }
+    return !empty() || !cid_ranges_.empty();
+}
+
+size_t CMap::next_code(const unsigned char* p, size_t size, uint32_t* code) const {
+    if (codespaces_.empty()) {
+        *code = p[0];
+        return 1;
+    }
+    uint32_t value = 0;
+    for (size_t length = 1; length <= 4 && length <= size; length++) {
+        value = value << 8 | p[length - 1];
+        for (const auto& range : codespaces_) {
+            if (range.bytes == length && value >= range.low && value <= range.high) {
+                *code = value;
+                return length;
+            }
+        }
+    }
+    // No range matched: consume the shortest codespace length
+    size_t length = 4;
+    for (const auto& range : codespaces_) {
+        length = std::min<size_t>(length, range.bytes);
+    }
+    length = std::min(length, size);
+    value = 0;
+    for (size_t i = 0; i < length; i++) {
+        value = value << 8 | p[i];
+    }
+    *code = value;
+    return length;
+}
+
+bool CMap::to_unicode(uint32_t code, std::string* utf8) const {
+    auto found = unicode_.find(code);
+    if (found != unicode_.end()) {
+        append_utf16(found->second, utf8);
+        return true;
+    }
+    for (const auto& range : unicode_ranges_) {
+        if (code >= range.low && code <= range.high) {
+            std::u16string units = range.start;
+            units.back() = (char16_t)(units.back() + (code - range.low));
+            append_utf16(units, utf8);
+            return true;
+        }
+    }
+    return false;
+}
+
+bool CMap::to_cid(uint32_t code, uint32_t* cid) const {
+    for (const auto& range : cid_ranges_) {
+        if (code >= range.low && code <= range.high) {
+            *cid = range.cid + (code - range.low);
+            return true;
+        }
+    }
+    return false;
+}
+
+std::shared_ptr<PdfFont> PdfFont::load(PdfDocument& document, const PdfObject& font) {
+    PdfObject resolved = document.resolve(font);
+    auto result = std::make_shared<PdfFont>();
+    // A missing font resource is read as a StandardEncoding font without metrics
+    const PdfDict& dict = resolved.as_dict();
+
+    PdfObject to_unicode = document.lookup(dict, "ToUnicode");
+    std::string program;
+    std::string error;
+    if (to_unicode.is_stream() && document.decode_stream(to_unicode, &program, &error)) {
+        result->has_to_unicode_ = result->to_unicode_.parse(program);
+    }
+
+    if (dict.get("Subtype").is_name("Type0")) {
+        result->load_composite(document, dict);
+    } else {
+        result->load_simple(document, dict);
+    }
+    return result;
+}
+
+void PdfFont::load_simple(PdfDocument& document, const PdfDict& dict) {
+    std::string base_font = document.lookup(dict, "BaseFont").as_name();
+    bool type3 = dict.get("Subtype").is_name("Type3");
+    if (type3) {
+        PdfObject matrix = document.lookup(dict, "FontMatrix");
+        if (matrix.is_array() && matrix.as_array().size() >= 1) {
+            width_scale_ = document.resolve(matrix.as_array()[0]).as_number(0.001);
+        }
+    }
+
+    // Base encoding, then /Differences on top
+    BaseEncoding base = dict.get("Subtype").is_name("TrueType") ? BaseEncoding::WinAnsi : BaseEncoding::Standard;
+    PdfObject encoding = document.lookup(dict, "Encoding");
+    PdfObject base_name = encoding.is_dict() ? document.lookup(encoding.as_dict(), "BaseEncoding") : encoding;
+    if (base_name.is_name("WinAnsiEncoding")) {
+        base = BaseEncoding::WinAnsi;
+    } else if (base_name.is_name("MacRomanEncoding")) {
+        base = BaseEncoding::MacRoman;
+    } else if (base_name.is_name("StandardEncoding")) {
+        base = BaseEncoding::Standard;
+    }
+    const uint16_t* table = base_encoding_table(base);
+    for (int c = 0; c < 256; c++) {
+        simple_unicode_[c] = table[c];
+    }
+    if (encoding.is_dict()) {
+        PdfObject differences = document.lookup(encoding.as_dict(), "Differences");
+        uint32_t code = 0;
+        for (const auto& item : differences.as_array()) {
+            if (item.is_number()) {
+                code = (uint32_t)item.as_int();
+            } else if (item.is_name() && code < 256) {
+                simple_unicode_[code++] = glyph_name_to_unicode(item.as_name());
+            }
+        }
+    }
+
+    PdfObject widths = document.lookup(dict, "Widths");
+    if (widths.is_array()) {
+        first_char_ = (uint32_t)document.lookup(dict, "FirstChar").as_int();
+        for (const auto& width : widths.as_array()) {
+            simple_widths_.push_back(document.resolve(width).as_number() * width_scale_);
+        }
+    } else if (const int16_t* standard = standard_font_widths(base_font)) {
+        first_char_ = 32;
+        for (int c = 0; c < 95; c++) {
+            simple_widths_.push_back(standard[c] * width_scale_);
+        }
+    }
+    PdfObject descriptor = document.lookup(dict, "FontDescriptor");
+    default_width_ = document.lookup(descriptor.as_dict(), "MissingWidth").as_number() * width_scale_;
+    if (default_width_ <= 0) {
+        // Unknown metrics: half an em keeps word spacing heuristics usable
+        default_width_ = 0.5;
+    }
+}
+
+void PdfFont::load_composite(PdfDocument& document, const PdfDict& dict) {
+    composite_ = true;
+    PdfObject encoding = document.lookup(dict, "Encoding");
+    if (encoding.is_stream()) {
+        std::string program;
+        std::string error;
+        if (document.decode_stream(encoding, &program, &error) && encoding_.parse(program)) {
+            identity_encoding_ = false;
+        }
+    } else if (encoding.is_name()) {
+        // Predefined UCS-2/UTF-16 CMaps use Unicode values as codes
+        const std::string& name = encoding.as_name();
+        unicode_codes_ = name.find("UCS2") != std::string::npos || name.find("UTF16") != std::string::npos;
+    }
+
+    PdfObject descendants = document.lookup(dict, "DescendantFonts");
+    PdfObject cid_font = descendants.is_array() && !descendants.as_array().empty()
+                             ? document.resolve(descendants.as_array()[0])
+                             : PdfObject();
+    const PdfDict& cid_dict = cid_font.as_dict();
+    PdfObject default_width = document.lookup(cid_dict, "DW");
+    default_width_ = (default_width.is_number() ? default_width.as_number() : 1000) * width_scale_;
+
+    // /W: c [w1 w2 ...] or c_first c_last w
+    PdfObject widths = document.lookup(cid_dict, "W");
+    const PdfArray& items = widths.as_array();
+    for (size_t i = 0; i < items.size();) {
+        uint32_t first = (uint32_t)document.resolve(items[i]).as_int();
+        if (i + 1 < items.size()) {
+            PdfObject next = document.resolve(items[i + 1]);
+            if (next.is_array()) {
+                uint32_t cid = first;
+                for (const auto& width : next.as_array()) {
+                    cid_widths_[cid++] = document.resolve(width).as_number() * width_scale_;
+                }
+                i += 2;
+                continue;
+            }
+            if (i + 2 < items.size()) {
+                WidthRange range;
+                range.first = first;
+                range.last = (uint32_t)next.as_int();
+                range.width = document.resolve(items[i + 2]).as_number() * width_scale_;
+                cid_width_ranges_.push_back(range);
+                i += 3;
+                continue;
+            }
+        }
+        break;
+    }
+}
+
+double PdfFont::code_width(uint32_t code) const {
+    if (composite_) {
+        auto found = cid_widths_.find(code);
+        if (found != cid_widths_.end()) {
+            return found->second;
+        }
+        for (const auto& range : cid_width_ranges_) {
+            if (code >= range.first && code <= range.last) {
+                return range.width;
+            }
+        }
+        return default_width_;
+    }
+    if (code >= first_char_ && code - first_char_ < simple_widths_.size()) {
+        double width = simple_widths_[code - first_char_];
+        return width > 0 ? width : default_width_;
+    }
+    return default_width_;
+}
+
+void PdfFont::decode(const std::string& bytes, std::vector<Glyph>* glyphs) const {
+    glyphs->clear();
+    const unsigned char* p = (const unsigned char*)bytes.data();
+    size_t size = bytes.size();
+    size_t i = 0;
+    while (i < size) {
+        Glyph glyph;
+        if (composite_) {
+            uint32_t code;
+            size_t length;
+            if (identity_encoding_) {
+                length = std::min<size_t>(2, size - i);
+                code = length == 2 ? (uint32_t)(p[i] << 8 | p[i + 1]) : p[i];
+            } else {
+                length = encoding_.next_code(p + i, size - i, &code);
+            }
+            uint32_t cid = code;
+            if (!identity_encoding_) {
+                encoding_.to_cid(code, &cid);
+            }
+            glyph.code = code;
+            glyph.width = code_width(cid);
+            if (!(has_to_unicode_ && to_unicode_.to_unicode(code, &glyph.text)) && unicode_codes_) {
+                append_utf8(code, &glyph.text);
+            }
+            i += length;
+        } else {
+            uint32_t code = p[i++];
+            glyph.code = code;
+            glyph.width = code_width(code);
+            glyph.word_space = code == 32;
+            if (!(has_to_unicode_ && to_unicode_.to_unicode(code, &glyph.text)) && simple_unicode_[code]) {
+                append_utf8(simple_unicode_[code], &glyph.text);
+            }
+        }
+        glyphs->push_back(std::move(glyph));
+    }
+}
+
+} // namespace spdf
@@ -0,0 +1,98 @@
+#ifndef SPDF_FONT_H
+#define SPDF_FONT_H
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include "spdf_object.h"
+
+namespace spdf {
+
+class PdfDocument;
+
+// Parsed CMap program: codespace ranges plus code-to-Unicode (ToUnicode) or
+// code-to-CID (encoding CMap) mappings
+class CMap {
+public:
+    bool parse(const std::string& program);
+
+    bool empty() const { return codespaces_.empty() && unicode_.empty() && unicode_ranges_.empty(); }
+
+    // Length in bytes of the code starting at p, from the codespace ranges
+    // (one byte when there are none); the code value goes to *code
+    size_t next_code(const unsigned char* p, size_t size, uint32_t* code) const;
+
+    bool to_unicode(uint32_t code, std::string* utf8) const;
+    bool to_cid(uint32_t code, uint32_t* cid) const;
+
+private:
+    struct Codespace {
+        uint32_t low;
+        uint32_t high;
+        uint8_t bytes;
+    };
+    struct UnicodeRange {
+        uint32_t low;
+        uint32_t high;
+        std::u16string start;  // UTF-16 of low; the last unit counts up through the range
+    };
+    struct CidRange {
+        uint32_t low;
+        uint32_t high;
+        uint32_t cid;
+    };
+
+    std::vector<Codespace> codespaces_;
+    std::unordered_map<uint32_t, std::u16string> unicode_;
+    std::vector<UnicodeRange> unicode_ranges_;
+    std::vector<CidRange> cid_ranges_;
+};
+
+struct Glyph {
+    uint32_t code = 0;
+    std::string text;    // UTF-8, empty when the font gives no Unicode mapping
+    double width = 0;    // horizontal advance in text space units (1 = font size)
+    bool word_space = false;  // single-byte code 32, which Tw applies to
+};
+
+// Font resource reduced to what text extraction needs: splitting strings into
+// character codes, mapping codes to Unicode and looking up advance widths
+class PdfFont {
+public:
+    static std::shared_ptr<PdfFont> load(PdfDocument& document, const PdfObject& font);
+
+    void decode(const std::string& bytes, std::vector<Glyph>* glyphs) const;
+
+    bool composite() const { return composite_; }
+
+private:
+    void load_simple(PdfDocument& document, const PdfDict& dict);
+    void load_composite(PdfDocument& document, const PdfDict& dict);
+    double code_width(uint32_t code) const;
+
+    bool composite_ = false;
+    bool has_to_unicode_ = false;
+    bool identity_encoding_ = true;  // composite: 2-byte codes equal to CIDs
+    bool unicode_codes_ = false;     // composite: codes are UCS-2 values
+    CMap to_unicode_;
+    CMap encoding_;
+    uint32_t simple_unicode_[256] = {};
+
+    double width_scale_ = 0.001;
+    double default_width_ = 0;
+    std::vector<double> simple_widths_;  // indexed by code - first_char_
+    uint32_t first_char_ = 0;
+    std::unordered_map<uint32_t, double> cid_widths_;
+    struct WidthRange {
+        uint32_t first;
+        uint32_t last;
+        double width;
+    };
+    std::vector<WidthRange> cid_width_ranges_;
+};
+
+} // namespace spdf
+
+#endif // SPDF_FONT_H
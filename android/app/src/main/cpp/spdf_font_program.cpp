@@ -0,0 +1,1150 @@
+#include "spdf_font_program.h"
+#include <algorithm>
+#include <cstdlib>
+#include <map>
+#include <string_view>
+#include "spdf_encodings.h"
+
+namespace spdf {
+
+// Type 2 charstrings nest subroutine calls at most 10 deep
+static const int MAX_SUBR_DEPTH = 10;
+
+// sfnt tables a PDF renderer has no use for: OpenType and AAT layout,
+// kerning, device metrics, tool stamps and the signature the rewrite invalidates
+static const char* const DROPPED_TABLES[] = {"DSIG", "GSUB", "GPOS", "GDEF", "BASE", "JSTF", "MATH", "kern",
+                                             "morx", "mort", "feat", "hdmx", "LTSH", "VDMX", "FFTM"};
+
+// An emptied CFF glyph: a lone Type 2 endchar
+static const char EMPTY_CHARSTRING[] = {14};
+
+// CFF DICT operators; two-byte operators are 1200 + their second byte
+static const int OP_ESCAPE = 1200;
+static const int OP_CHARSET = 15;
+static const int OP_ENCODING = 16;
+static const int OP_CHARSTRINGS = 17;
+static const int OP_PRIVATE = 18;
+static const int OP_SUBRS = 19;
+static const int OP_CHARSTRING_TYPE = OP_ESCAPE + 6;
+static const int OP_ROS = OP_ESCAPE + 30;
+static const int OP_FDARRAY = OP_ESCAPE + 36;
+static const int OP_FDSELECT = OP_ESCAPE + 37;
+
+// Glyphs of the predefined ISOAdobe charset, whose SIDs equal their glyph ids
+static const uint32_t ISO_ADOBE_GLYPHS = 229;
+
+// CFF standard strings: SIDs below 391 name these
+static const char* const CFF_STANDARD_STRINGS[] = {
+    ".notdef", "space", "exclam", "quotedbl", "numbersign", "dollar", "percent", "ampersand", "quoteright",
+    "parenleft", "parenright", "asterisk", "plus", "comma", "hyphen", "period", "slash", "zero", "one", "two",
+    "three", "four", "five", "six", "seven", "eight", "nine", "colon", "semicolon", "less", "equal",
+    "greater", "question", "at", "A", "B", "C", "D", "E", "F", "G", "H", "I", "J", "K", "L", "M", "N", "O",
+    "P", "Q", "R", "S", "T", "U", "V", "W", "X", "Y", "Z", "bracketleft", "backslash", "bracketright",
+    "asciicircum", "underscore", "quoteleft", "a", "b", "c", "d", "e", "f", "g", "h", "i", "j", "k", "l", "m",
+    "n", "o", "p", "q", "r", "s", "t", "u", "v", "w", "x", "y", "z", "braceleft", "bar", "braceright",
+    "asciitilde", "exclamdown", "cent", "sterling", "fraction", "yen", "florin", "section", "currency",
+    "quotesingle", "quotedblleft", "guillemotleft", "guilsinglleft", "guilsinglright", "fi", "fl", "endash",
+    "dagger", "daggerdbl", "periodcentered", "paragraph", "bullet", "quotesinglbase", "quotedblbase",
+    "quotedblright", "guillemotright", "ellipsis", "perthousand", "questiondown", "grave", "acute",
+    "circumflex", "tilde", "macron", "breve", "dotaccent", "dieresis", "ring", "cedilla", "hungarumlaut",
+    "ogonek", "caron", "emdash", "AE", "ordfeminine", "Lslash", "Oslash", "OE", "ordmasculine", "ae",
+    "dotlessi", "lslash", "oslash", "oe", "germandbls", "onesuperior", "logicalnot", "mu", "trademark", "Eth",
+    "onehalf", "plusminus", "Thorn", "onequarter", "divide", "brokenbar", "degree", "thorn", "threequarters",
+    "twosuperior", "registered", "minus", "eth", "multiply", "threesuperior", "copyright", "Aacute",
+    "Acircumflex", "Adieresis", "Agrave", "Aring", "Atilde", "Ccedilla", "Eacute", "Ecircumflex", "Edieresis",
+    "Egrave", "Iacute", "Icircumflex", "Idieresis", "Igrave", "Ntilde", "Oacute", "Ocircumflex", "Odieresis",
+    "Ograve", "Otilde", "Scaron", "Uacute", "Ucircumflex", "Udieresis", "Ugrave", "Yacute", "Ydieresis",
+    "Zcaron", "aacute", "acircumflex", "adieresis", "agrave", "aring", "atilde", "ccedilla", "eacute",
+    "ecircumflex", "edieresis", "egrave", "iacute", "icircumflex", "idieresis", "igrave", "ntilde", "oacute",
+    "ocircumflex", "odieresis", "ograve", "otilde", "scaron", "uacute", "ucircumflex", "udieresis", "ugrave",
+    "yacute", "ydieresis", "zcaron", "exclamsmall", "Hungarumlautsmall", "dollaroldstyle", "dollarsuperior",
+    "ampersandsmall", "Acutesmall", "parenleftsuperior", "parenrightsuperior", "twodotenleader",
+    "onedotenleader", "zerooldstyle", "oneoldstyle", "twooldstyle", "threeoldstyle", "fouroldstyle",
+    "fiveoldstyle", "sixoldstyle", "sevenoldstyle", "eightoldstyle", "nineoldstyle", "commasuperior",
+    "threequartersemdash", "periodsuperior", "questionsmall", "asuperior", "bsuperior", "centsuperior",
+    "dsuperior", "esuperior", "isuperior", "lsuperior", "msuperior", "nsuperior", "osuperior", "rsuperior",
+    "ssuperior", "tsuperior", "ff", "ffi", "ffl", "parenleftinferior", "parenrightinferior",
+    "Circumflexsmall", "hyphensuperior", "Gravesmall", "Asmall", "Bsmall", "Csmall", "Dsmall", "Esmall",
+    "Fsmall", "Gsmall", "Hsmall", "Ismall", "Jsmall", "Ksmall", "Lsmall", "Msmall", "Nsmall", "Osmall",
+    "Psmall", "Qsmall", "Rsmall", "Ssmall", "Tsmall", "Usmall", "Vsmall", "Wsmall", "Xsmall", "Ysmall",
+    "Zsmall", "colonmonetary", "onefitted", "rupiah", "Tildesmall", "exclamdownsmall", "centoldstyle",
+    "Lslashsmall", "Scaronsmall", "Zcaronsmall", "Dieresissmall", "Brevesmall", "Caronsmall",
+    "Dotaccentsmall", "Macronsmall", "figuredash", "hypheninferior", "Ogoneksmall", "Ringsmall",
+    "Cedillasmall", "questiondownsmall", "oneeighth", "threeeighths", "fiveeighths", "seveneighths",
+    "onethird", "twothirds", "zerosuperior", "foursuperior", "fivesuperior", "sixsuperior", "sevensuperior",
+    "eightsuperior", "ninesuperior", "zeroinferior", "oneinferior", "twoinferior", "threeinferior",
+    "fourinferior", "fiveinferior", "sixinferior", "seveninferior", "eightinferior", "nineinferior",
+    "centinferior", "dollarinferior", "periodinferior", "commainferior", "Agravesmall", "Aacutesmall",
+    "Acircumflexsmall", "Atildesmall", "Adieresissmall", "Aringsmall", "AEsmall", "Ccedillasmall",
+    "Egravesmall", "Eacutesmall", "Ecircumflexsmall", "Edieresissmall", "Igravesmall", "Iacutesmall",
+    "Icircumflexsmall", "Idieresissmall", "Ethsmall", "Ntildesmall", "Ogravesmall", "Oacutesmall",
+    "Ocircumflexsmall", "Otildesmall", "Odieresissmall", "OEsmall", "Oslashsmall", "Ugravesmall",
+    "Uacutesmall", "Ucircumflexsmall", "Udieresissmall", "Yacutesmall", "Thornsmall", "Ydieresissmall",
+    "001.000", "001.001", "001.002", "001.003", "Black", "Bold", "Book", "Light", "Medium", "Regular",
+    "Roman", "Semibold"
+};
+static const uint32_t CFF_STANDARD_STRING_COUNT = 391;
+
+// ----------------------------------------------------------------------------
+// Big-endian fields; reads past the end yield zero bytes, so truncated
+// programs fail their consistency checks instead of reading out of bounds
+// ----------------------------------------------------------------------------
+
+static uint32_t read_be(std::string_view data, size_t pos, int bytes) {
+    uint32_t value = 0;
+    for (int i = 0; i < bytes; i++) {
+        value = value << 8 | (pos + i < data.size() ? (uint8_t)data[pos + i] : 0);
+    }
+    return value;
+}
+
+static uint32_t be16(std::string_view data, size_t pos) { return read_be(data, pos, 2); }
+static uint32_t be32(std::string_view data, size_t pos) { return read_be(data, pos, 4); }
+
+static void put_be(uint32_t value, int bytes, std::string* out) {
+    for (int i = bytes - 1; i >= 0; i--) {
+        out->push_back((char)(value >> (8 * i)));
+    }
+}
+
+static void set_be32(uint32_t value, size_t pos, std::string* out) {
+    for (int i = 0; i < 4; i++) {
+        (*out)[pos + i] = (char)(value >> (24 - 8 * i));
+    }
+}
+
+static uint32_t tag_value(const char* tag) {
+    return (uint32_t)(uint8_t)tag[0] << 24 | (uint32_t)(uint8_t)tag[1] << 16 | (uint32_t)(uint8_t)tag[2] << 8 |
+           (uint8_t)tag[3];
+}
+
+// ----------------------------------------------------------------------------
+// CFF
+// ----------------------------------------------------------------------------
+
+namespace {
+
+struct CffIndex {
+    size_t start = 0;
+    size_t end = 0;
+    std::vector<size_t> offsets;  // of each item and of the end of the last, from the start of the font
+
+    size_t count() const { return offsets.empty() ? 0 : offsets.size() - 1; }
+    std::string_view item(std::string_view data, size_t i) const {
+        return data.substr(offsets[i], offsets[i + 1] - offsets[i]);
+    }
+};
+
+struct DictEntry {
+    int op;
+    std::vector<double> operands;
+    std::string_view bytes;  // operands and operator as stored
+};
+
+using CffDict = std::vector<DictEntry>;
+
+struct CffPrivate {
+    size_t offset = 0;
+    size_t size = 0;
+    CffDict dict;
+    CffIndex subrs;
+};
+
+struct CharstringState {
+    std::vector<double> stack;
+    size_t stems = 0;
+    bool seac = false;
+    uint8_t base = 0;
+    uint8_t accent = 0;
+};
+
+} // namespace
+
+struct CffFont {
+    std::string_view data;
+    size_t header_size = 0;
+    CffIndex names;
+    CffIndex top_dicts;
+    CffIndex strings;
+    CffIndex global_subrs;
+    CffIndex charstrings;
+    CffDict top;
+    bool cid = false;
+    size_t charset = 0;
+    size_t charset_end = 0;
+    size_t encoding = 0;
+    size_t encoding_end = 0;
+    size_t fd_select = 0;
+    size_t fd_select_end = 0;
+    std::vector<uint32_t> sids;  // glyph name SID, or CID when CID-keyed, by glyph id
+    int32_t codes[256];          // built-in encoding, when it is not StandardEncoding
+    bool standard_encoding = true;
+    CffPrivate private_dict;
+    CffIndex fd_array;
+    std::vector<CffDict> fonts;
+    std::vector<CffPrivate> privates;  // of fonts
+
+    bool parse(std::string_view font);
+    std::string name(uint32_t sid) const;
+    bool seac(uint32_t gid, uint8_t* base, uint8_t* accent) const;
+    bool subset(const std::vector<bool>& keep, std::string* output) const;
+
+private:
+    bool read_private(const CffDict& dict, CffPrivate* result) const;
+    bool run(std::string_view charstring, int depth, CharstringState* state) const;
+};
+
+static bool read_index(std::string_view data, size_t pos, CffIndex* index) {
+    index->start = pos;
+    index->offsets.clear();
+    if (pos + 2 > data.size()) {
+        return false;
+    }
+    uint32_t count = be16(data, pos);
+    if (count == 0) {
+        index->end = pos + 2;
+        return true;
+    }
+    int offset_size = (uint8_t)read_be(data, pos + 2, 1);
+    if (offset_size < 1 || offset_size > 4) {
+        return false;
+    }
+    size_t table = pos + 3;
+    size_t base = table + (size_t)(count + 1) * offset_size - 1;
+    if (base >= data.size()) {
+        return false;
+    }
+    index->offsets.resize(count + 1);
+    uint32_t previous = 1;
+    for (uint32_t i = 0; i <= count; i++) {
+        uint32_t offset = read_be(data, table + (size_t)i * offset_size, offset_size);
+        if (offset < previous || offset > data.size() - base) {
+            return false;
+        }
+        index->offsets[i] = base + offset;
+        previous = offset;
+    }
+    index->end = index->offsets[count];
+    return true;
+}
+
+static bool read_real(std::string_view dict, size_t* pos, double* value) {
+    static const char* const NIBBLES[] = {"0", "1", "2", "3", "4", "5", "6", "7",
+                                          "8", "9", ".", "E", "E-", "", "-", ""};
+    std::string text;
+    for (;;) {
+        if (*pos >= dict.size()) {
+            return false;
+        }
+        uint8_t byte = (uint8_t)dict[(*pos)++];
+        for (int nibble : {byte >> 4, byte & 15}) {
+            if (nibble == 15) {
+                *value = strtod(text.c_str(), nullptr);
+                return true;
+            }
+            text += NIBBLES[nibble];
+        }
+    }
+}
+
+static bool read_dict(std::string_view dict, CffDict* entries) {
+    entries->clear();
+    std::vector<double> operands;
+    size_t start = 0;
+    size_t pos = 0;
+    while (pos < dict.size()) {
+        uint8_t b = (uint8_t)dict[pos];
+        if (b <= 21) {
+            int op = b;
+            pos++;
+            if (b == 12) {
+                if (pos >= dict.size()) {
+                    return false;
+                }
+                op = OP_ESCAPE + (uint8_t)dict[pos++];
+            }
+            entries->push_back(DictEntry{op, std::move(operands), dict.substr(start, pos - start)});
+            operands.clear();
+            start = pos;
+        } else if (b == 28 || b == 29) {
+            int bytes = b == 28 ? 2 : 4;
+            if (pos + 1 + bytes > dict.size()) {
+                return false;
+            }
+            uint32_t raw = read_be(dict, pos + 1, bytes);
+            operands.push_back(b == 28 ? (double)(int16_t)raw : (double)(int32_t)raw);
+            pos += 1 + bytes;
+        } else if (b == 30) {
+            double value = 0;
+            pos++;
+            if (!read_real(dict, &pos, &value)) {
+                return false;
+            }
+            operands.push_back(value);
+        } else if (b >= 32 && b <= 246) {
+            operands.push_back(b - 139);
+            pos++;
+        } else if (b >= 247 && b <= 254) {
+            if (pos + 2 > dict.size()) {
+                return false;
+            }
+            int magnitude = ((b - 247) & 3) * 256 + (uint8_t)dict[pos + 1] + 108;
+            operands.push_back(b <= 250 ? magnitude : -magnitude);
+            pos += 2;
+        } else {
+            return false;
+        }
+    }
+    return true;
+}
+
+static const DictEntry* dict_entry(const CffDict& dict, int op) {
+    for (const auto& entry : dict) {
+        if (entry.op == op) {
+            return &entry;
+        }
+    }
+    return nullptr;
+}
+
+static double dict_value(const CffDict& dict, int op, size_t operand, double fallback) {
+    const DictEntry* entry = dict_entry(dict, op);
+    return entry && operand < entry->operands.size() ? entry->operands[operand] : fallback;
+}
+
+// Offset operands of a DICT entry, positive and inside the font
+static bool dict_offset(const CffDict& dict, int op, size_t operand, size_t limit, size_t* offset) {
+    double value = dict_value(dict, op, operand, -1);
+    if (value < 0 || value > (double)limit) {
+        return false;
+    }
+    *offset = (size_t)value;
+    return true;
+}
+
+bool CffFont::read_private(const CffDict& dict, CffPrivate* result) const {
+    if (!dict_entry(dict, OP_PRIVATE)) {
+        return true;
+    }
+    if (!dict_offset(dict, OP_PRIVATE, 0, data.size(), &result->size) ||
+        !dict_offset(dict, OP_PRIVATE, 1, data.size() - result->size, &result->offset) ||
+        !read_dict(data.substr(result->offset, result->size), &result->dict)) {
+        return false;
+    }
+    size_t subrs = 0;
+    if (dict_entry(result->dict, OP_SUBRS) &&
+        (!dict_offset(result->dict, OP_SUBRS, 0, data.size() - result->offset, &subrs) ||
+         !read_index(data, result->offset + subrs, &result->subrs))) {
+        return false;
+    }
+    return true;
+}
+
+bool CffFont::parse(std::string_view font) {
+    data = font;
+    // Version 1 only: CFF2 is for variable OpenType fonts, which PDF does not embed
+    if (data.size() < 4 || data[0] != 1) {
+        return false;
+    }
+    header_size = (uint8_t)data[2];
+    if (!read_index(data, header_size, &names) || !read_index(data, names.end, &top_dicts) ||
+        top_dicts.count() != 1 || !read_index(data, top_dicts.end, &strings) ||
+        !read_index(data, strings.end, &global_subrs) || !read_dict(top_dicts.item(data, 0), &top)) {
+        return false;
+    }
+    size_t offset = 0;
+    if (dict_value(top, OP_CHARSTRING_TYPE, 0, 2) != 2 || !dict_offset(top, OP_CHARSTRINGS, 0, data.size(), &offset) ||
+        !read_index(data, offset, &charstrings) || charstrings.count() == 0 || charstrings.count() > 65535) {
+        return false;
+    }
+    cid = dict_entry(top, OP_ROS) != nullptr;
+    uint32_t glyphs = (uint32_t)charstrings.count();
+
+    // charset: glyph names, or CIDs
+    sids.assign(glyphs, 0);
+    if (!dict_offset(top, OP_CHARSET, 0, data.size(), &charset)) {
+        charset = 0;
+    }
+    if (charset > 2) {
+        size_t pos = charset + 1;
+        uint8_t format = (uint8_t)read_be(data, charset, 1);
+        for (uint32_t gid = 1; gid < glyphs;) {
+            if (pos >= data.size() || format > 2) {
+                return false;
+            }
+            if (format == 0) {
+                sids[gid++] = be16(data, pos);
+                pos += 2;
+                continue;
+            }
+            uint32_t first = be16(data, pos);
+            uint32_t left = format == 1 ? read_be(data, pos + 2, 1) : be16(data, pos + 2);
+            pos += format == 1 ? 3 : 4;
+            for (uint32_t k = 0; k <= left && gid < glyphs; k++) {
+                sids[gid++] = first + k;
+            }
+        }
+        charset_end = pos;
+    } else if (charset == 0 || cid) {
+        for (uint32_t gid = 0; gid < glyphs && (cid || gid < ISO_ADOBE_GLYPHS); gid++) {
+            sids[gid] = gid;
+        }
+    }
+
+    // Built-in encoding of name-keyed fonts
+    std::fill(codes, codes + 256, -1);
+    if (!cid && dict_offset(top, OP_ENCODING, 0, data.size(), &encoding) && encoding > 1) {
+        standard_encoding = false;
+        uint8_t format = (uint8_t)read_be(data, encoding, 1);
+        size_t pos = encoding + 1;
+        uint32_t gid = 1;
+        if ((format & 0x7F) == 0) {
+            uint32_t count = read_be(data, pos++, 1);
+            for (uint32_t i = 0; i < count && gid < glyphs; i++) {
+                codes[(uint8_t)read_be(data, pos++, 1)] = (int32_t)gid++;
+            }
+        } else if ((format & 0x7F) == 1) {
+            uint32_t ranges = read_be(data, pos++, 1);
+            for (uint32_t i = 0; i < ranges; i++, pos += 2) {
+                uint32_t first = read_be(data, pos, 1);
+                uint32_t left = read_be(data, pos + 1, 1);
+                for (uint32_t k = 0; k <= left && first + k < 256 && gid < glyphs; k++) {
+                    codes[first + k] = (int32_t)gid++;
+                }
+            }
+        } else {
+            return false;
+        }
+        if (format & 0x80) {
+            uint32_t supplements = read_be(data, pos++, 1);
+            for (uint32_t i = 0; i < supplements; i++, pos += 3) {
+                uint32_t sid = be16(data, pos + 1);
+                auto found = std::find(sids.begin(), sids.end(), sid);
+                if (found != sids.end()) {
+                    codes[(uint8_t)read_be(data, pos, 1)] = (int32_t)(found - sids.begin());
+                }
+            }
+        }
+        if (pos > data.size()) {
+            return false;
+        }
+        encoding_end = pos;
+    } else {
+        encoding = 0;
+        standard_encoding = dict_value(top, OP_ENCODING, 0, 0) == 0;
+    }
+
+    if (!read_private(top, &private_dict)) {
+        return false;
+    }
+    if (!cid) {
+        return true;
+    }
+    // CID-keyed: one font DICT (with its own Private DICT) per glyph group
+    if (!dict_offset(top, OP_FDARRAY, 0, data.size(), &offset) || !read_index(data, offset, &fd_array) ||
+        !dict_offset(top, OP_FDSELECT, 0, data.size(), &fd_select)) {
+        return false;
+    }
+    fonts.resize(fd_array.count());
+    privates.resize(fd_array.count());
+    for (size_t i = 0; i < fonts.size(); i++) {
+        if (!read_dict(fd_array.item(data, i), &fonts[i]) || !read_private(fonts[i], &privates[i])) {
+            return false;
+        }
+    }
+    uint8_t format = (uint8_t)read_be(data, fd_select, 1);
+    if (format == 0) {
+        fd_select_end = fd_select + 1 + glyphs;
+    } else if (format == 3) {
+        fd_select_end = fd_select + 3 + 3 * (size_t)be16(data, fd_select + 1) + 2;
+    } else {
+        return false;
+    }
+    return fd_select_end <= data.size();
+}
+
+std::string CffFont::name(uint32_t sid) const {
+    if (sid < CFF_STANDARD_STRING_COUNT) {
+        return CFF_STANDARD_STRINGS[sid];
+    }
+    sid -= CFF_STANDARD_STRING_COUNT;
+    return sid < strings.count() ? std::string(strings.item(data, sid)) : std::string();
+}
+
+static int32_t subr_bias(size_t count) {
+    return count < 1240 ? 107 : count < 33900 ? 1131 : 32768;
+}
+
+// Interprets a charstring just far enough to follow its subroutine calls and
+// count its stem hints (hintmask bytes depend on them) up to endchar. True
+// once endchar is reached.
+bool CffFont::run(std::string_view charstring, int depth, CharstringState* state) const {
+    if (depth > MAX_SUBR_DEPTH) {
+        return true;
+    }
+    std::vector<double>& stack = state->stack;
+    size_t pos = 0;
+    while (pos < charstring.size()) {
+        uint8_t b = (uint8_t)charstring[pos++];
+        if (b >= 32 && b <= 246) {
+            stack.push_back(b - 139);
+        } else if (b >= 247 && b <= 254) {
+            int magnitude = ((b - 247) & 3) * 256 + (uint8_t)read_be(charstring, pos++, 1) + 108;
+            stack.push_back(b <= 250 ? magnitude : -magnitude);
+        } else if (b == 28) {
+            stack.push_back((int16_t)be16(charstring, pos));
+            pos += 2;
+        } else if (b == 255) {
+            stack.push_back((int32_t)be32(charstring, pos) / 65536.0);
+            pos += 4;
+        } else if (b == 1 || b == 3 || b == 18 || b == 23) {
+            // hstem, vstem, hstemhm, vstemhm: pairs of edges, maybe after the width
+            state->stems += stack.size() / 2;
+            stack.clear();
+        } else if (b == 19 || b == 20) {
+            // hintmask, cntrmask: operands left on the stack are an implicit vstem
+            state->stems += stack.size() / 2;
+            stack.clear();
+            pos += (state->stems + 7) / 8;
+        } else if (b == 10 || b == 29) {
+            const CffIndex& subrs = b == 10 ? private_dict.subrs : global_subrs;
+            if (stack.empty()) {
+                return true;
+            }
+            int64_t index = (int64_t)stack.back() + subr_bias(subrs.count());
+            stack.pop_back();
+            if (index < 0 || (size_t)index >= subrs.count() ||
+                run(subrs.item(data, (size_t)index), depth + 1, state)) {
+                return true;
+            }
+        } else if (b == 11) {
+            return false;
+        } else if (b == 14) {
+            // endchar with four operands (after an optional width) is the old seac
+            if (stack.size() >= 4) {
+                state->seac = true;
+                state->base = (uint8_t)stack[stack.size() - 2];
+                state->accent = (uint8_t)stack[stack.size() - 1];
+            }
+            return true;
+        } else {
+            if (b == 12) {
+                pos++;
+            }
+            stack.clear();
+        }
+    }
+    return false;
+}
+
+// Standard-encoding codes of the base and accent glyphs gid is composed of,
+// when its charstring ends in the seac form of endchar
+bool CffFont::seac(uint32_t gid, uint8_t* base, uint8_t* accent) const {
+    CharstringState state;
+    run(charstrings.item(data, gid), 0, &state);
+    *base = state.base;
+    *accent = state.accent;
+    return state.seac;
+}
+
+static void write_index(const std::vector<std::string_view>& items, std::string* out) {
+    put_be((uint32_t)items.size(), 2, out);
+    if (items.empty()) {
+        return;
+    }
+    size_t total = 1;
+    for (const auto& item : items) {
+        total += item.size();
+    }
+    int offset_size = total <= 0xFF ? 1 : total <= 0xFFFF ? 2 : total <= 0xFFFFFF ? 3 : 4;
+    out->push_back((char)offset_size);
+    uint32_t offset = 1;
+    put_be(offset, offset_size, out);
+    for (const auto& item : items) {
+        offset += (uint32_t)item.size();
+        put_be(offset, offset_size, out);
+    }
+    for (const auto& item : items) {
+        out->append(item.data(), item.size());
+    }
+}
+
+// DICT entries to rewrite, with their new operands
+using DictChanges = std::vector<std::pair<int, std::vector<size_t>>>;
+
+// Copies dict with the operands of changes rewritten as five-byte integers,
+// so the size does not depend on the values and offsets can be filled in
+// once the layout is known
+static std::string write_dict(const CffDict& dict, const DictChanges& changes) {
+    std::string out;
+    for (const auto& entry : dict) {
+        auto change = std::find_if(changes.begin(), changes.end(),
+                                   [&](const std::pair<int, std::vector<size_t>>& c) { return c.first == entry.op; });
+        if (change == changes.end()) {
+            out.append(entry.bytes.data(), entry.bytes.size());
+            continue;
+        }
+        for (size_t value : change->second) {
+            out.push_back(29);
+            put_be((uint32_t)value, 4, &out);
+        }
+        if (entry.op >= OP_ESCAPE) {
+            out.push_back(12);
+            out.push_back((char)(entry.op - OP_ESCAPE));
+        } else {
+            out.push_back((char)entry.op);
+        }
+    }
+    return out;
+}
+
+namespace {
+
+// A Private DICT as rewritten, with the local subroutines placed right after it
+struct PrivateData {
+    std::string dict;
+    std::string_view subrs;
+};
+
+} // namespace
+
+static PrivateData write_private(std::string_view data, const CffPrivate& source) {
+    PrivateData result;
+    if (!dict_entry(source.dict, OP_SUBRS)) {
+        result.dict = write_dict(source.dict, {});
+        return result;
+    }
+    // Subrs is relative to the start of the Private DICT
+    size_t size = write_dict(source.dict, {{OP_SUBRS, {0}}}).size();
+    result.dict = write_dict(source.dict, {{OP_SUBRS, {size}}});
+    result.subrs = data.substr(source.subrs.start, source.subrs.end - source.subrs.start);
+    return result;
+}
+
+// Lays the font out again: header, Name INDEX, String INDEX and global
+// subroutines as they were, then the charset, encoding and FDSelect data as
+// they were, the new CharStrings, the font DICTs and the Private DICTs with
+// their subroutines. The offsets in the Top DICT and font DICTs are written
+// with a fixed width, so a first pass with zeros gives every size.
+bool CffFont::subset(const std::vector<bool>& keep, std::string* output) const {
+    std::vector<std::string_view> glyphs(charstrings.count());
+    for (size_t gid = 0; gid < glyphs.size(); gid++) {
+        glyphs[gid] = keep[gid] ? charstrings.item(data, gid) : std::string_view(EMPTY_CHARSTRING, 1);
+    }
+    std::string charstrings_index;
+    write_index(glyphs, &charstrings_index);
+
+    bool has_private = dict_entry(top, OP_PRIVATE) != nullptr;
+    std::vector<PrivateData> private_data;
+    if (cid) {
+        for (const auto& font_private : privates) {
+            private_data.push_back(write_private(data, font_private));
+        }
+    } else if (has_private) {
+        private_data.push_back(write_private(data, private_dict));
+    }
+
+    size_t charset_at = 0;
+    size_t encoding_at = 0;
+    size_t fd_select_at = 0;
+    size_t charstrings_at = 0;
+    size_t fd_array_at = 0;
+    std::vector<size_t> private_at(private_data.size(), 0);
+    std::string top_index;
+    std::string fd_array_index;
+    for (int pass = 0; pass < 2; pass++) {
+        DictChanges changes = {{OP_CHARSTRINGS, {charstrings_at}}};
+        if (charset > 2) {
+            changes.push_back({OP_CHARSET, {charset_at}});
+        }
+        if (encoding > 1) {
+            changes.push_back({OP_ENCODING, {encoding_at}});
+        }
+        if (cid) {
+            changes.push_back({OP_FDSELECT, {fd_select_at}});
+            changes.push_back({OP_FDARRAY, {fd_array_at}});
+        } else if (has_private) {
+            changes.push_back({OP_PRIVATE, {private_data[0].dict.size(), private_at[0]}});
+        }
+        std::string top_dict = write_dict(top, changes);
+        top_index.clear();
+        write_index({top_dict}, &top_index);
+
+        std::vector<std::string> font_dicts;
+        for (size_t i = 0; cid && i < fonts.size(); i++) {
+            font_dicts.push_back(write_dict(fonts[i], {{OP_PRIVATE, {private_data[i].dict.size(), private_at[i]}}}));
+        }
+        fd_array_index.clear();
+        if (cid) {
+            write_index(std::vector<std::string_view>(font_dicts.begin(), font_dicts.end()), &fd_array_index);
+        }
+
+        size_t pos = names.end + top_index.size() + (global_subrs.end - strings.start);
+        charset_at = pos;
+        pos += charset > 2 ? charset_end - charset : 0;
+        encoding_at = pos;
+        pos += encoding > 1 ? encoding_end - encoding : 0;
+        fd_select_at = pos;
+        pos += cid ? fd_select_end - fd_select : 0;
+        charstrings_at = pos;
+        pos += charstrings_index.size();
+        fd_array_at = pos;
+        pos += fd_array_index.size();
+        for (size_t i = 0; i < private_data.size(); i++) {
+            private_at[i] = pos;
+            pos += private_data[i].dict.size() + private_data[i].subrs.size();
+        }
+    }
+
+    output->assign(data.data(), names.end);
+    *output += top_index;
+    output->append(data.substr(strings.start, global_subrs.end - strings.start));
+    if (charset > 2) {
+        output->append(data.substr(charset, charset_end - charset));
+    }
+    if (encoding > 1) {
+        output->append(data.substr(encoding, encoding_end - encoding));
+    }
+    if (cid) {
+        output->append(data.substr(fd_select, fd_select_end - fd_select));
+    }
+    *output += charstrings_index;
+    *output += fd_array_index;
+    for (const auto& item : private_data) {
+        *output += item.dict;
+        output->append(item.subrs);
+    }
+    return true;
+}
+
+// ----------------------------------------------------------------------------
+// FontProgram
+// ----------------------------------------------------------------------------
+
+FontProgram::FontProgram() = default;
+FontProgram::~FontProgram() = default;
+
+bool FontProgram::parse(std::string data) {
+    data_ = std::move(data);
+    uint32_t version = be32(data_, 0);
+    sfnt_ = version == 0x00010000 || version == tag_value("true") || version == tag_value("OTTO");
+    if (sfnt_) {
+        return parse_sfnt();
+    }
+    cff_.reset(new CffFont());
+    if (!cff_->parse(data_)) {
+        cff_.reset();
+        return false;
+    }
+    glyph_count_ = (uint32_t)cff_->charstrings.count();
+    index_cff();
+    return true;
+}
+
+bool FontProgram::table(uint32_t tag, Table* result) const {
+    auto found = tables_.find(tag);
+    if (found == tables_.end()) {
+        return false;
+    }
+    *result = found->second;
+    return true;
+}
+
+bool FontProgram::parse_sfnt() {
+    uint32_t count = be16(data_, 4);
+    if (12 + 16 * (size_t)count > data_.size()) {
+        return false;
+    }
+    for (uint32_t i = 0; i < count; i++) {
+        size_t entry = 12 + 16 * (size_t)i;
+        Table table{be32(data_, entry + 8), be32(data_, entry + 12)};
+        if (table.offset > data_.size() || table.length > data_.size() - table.offset) {
+            return false;
+        }
+        tables_[be32(data_, entry)] = table;
+    }
+    Table maxp;
+    Table head;
+    if (!table(tag_value("maxp"), &maxp) || !table(tag_value("head"), &head) || head.length < 54) {
+        return false;
+    }
+    glyph_count_ = be16(data_, maxp.offset + 4);
+    Table cff;
+    if (table(tag_value("CFF "), &cff)) {
+        cff_.reset(new CffFont());
+        if (!cff_->parse(std::string_view(data_).substr(cff.offset, cff.length)) ||
+            cff_->charstrings.count() != glyph_count_) {
+            cff_.reset();
+            return false;
+        }
+    } else if (!tables_.count(tag_value("glyf")) || !tables_.count(tag_value("loca"))) {
+        return false;
+    }
+    parse_cmap();
+    if (cff_) {
+        index_cff();
+    } else {
+        parse_post();
+    }
+    return glyph_count_ > 0;
+}
+
+void FontProgram::parse_cmap() {
+    Table cmap;
+    if (!table(tag_value("cmap"), &cmap)) {
+        return;
+    }
+    uint32_t count = be16(data_, cmap.offset + 2);
+    for (uint32_t i = 0; i < count; i++) {
+        size_t record = cmap.offset + 4 + 8 * (size_t)i;
+        uint32_t offset = be32(data_, record + 4);
+        if (record + 8 > cmap.offset + cmap.length || offset >= cmap.length) {
+            break;
+        }
+        uint32_t format = be16(data_, cmap.offset + offset);
+        if (format == 0 || format == 4 || format == 6 || format == 12) {
+            cmaps_.push_back(Cmap{(uint16_t)be16(data_, record), (uint16_t)be16(data_, record + 2),
+                                  cmap.offset + offset});
+        }
+    }
+}
+
+// Custom glyph names of a version 2 'post' table; the standard Macintosh
+// names it can refer to by number are not needed to find glyphs
+void FontProgram::parse_post() {
+    Table post;
+    if (!table(tag_value("post"), &post) || be32(data_, post.offset) != 0x00020000) {
+        return;
+    }
+    uint32_t count = std::min<uint32_t>(be16(data_, post.offset + 32), glyph_count_);
+    size_t pos = post.offset + 34 + 2 * (size_t)count;
+    size_t end = post.offset + post.length;
+    std::vector<std::string> custom;
+    while (pos < end) {
+        size_t length = (uint8_t)data_[pos];
+        if (pos + 1 + length > end) {
+            break;
+        }
+        custom.push_back(data_.substr(pos + 1, length));
+        pos += 1 + length;
+    }
+    std::vector<std::string> names(glyph_count_);
+    for (uint32_t gid = 0; gid < count; gid++) {
+        uint32_t index = be16(data_, post.offset + 34 + 2 * (size_t)gid);
+        if (index >= 258 && index - 258 < custom.size()) {
+            names[gid] = custom[index - 258];
+        }
+    }
+    index_names(names);
+}
+
+// Glyph names of a name-keyed CFF font, CIDs of a CID-keyed one
+void FontProgram::index_cff() {
+    if (cff_->cid) {
+        for (uint32_t gid = 0; gid < glyph_count_; gid++) {
+            cids_.emplace(cff_->sids[gid], gid);
+        }
+        return;
+    }
+    std::vector<std::string> names(glyph_count_);
+    for (uint32_t gid = 0; gid < glyph_count_; gid++) {
+        names[gid] = cff_->name(cff_->sids[gid]);
+    }
+    index_names(names);
+}
+
+void FontProgram::index_names(const std::vector<std::string>& names) {
+    for (uint32_t gid = 0; gid < names.size(); gid++) {
+        if (names[gid].empty()) {
+            continue;
+        }
+        names_.emplace(names[gid], gid);
+        uint32_t unicode = glyph_name_to_unicode(names[gid]);
+        if (unicode != 0) {
+            unicodes_.emplace(unicode, gid);
+        }
+    }
+}
+
+bool FontProgram::cid_keyed() const {
+    return cff_ && cff_->cid;
+}
+
+bool FontProgram::has_cmap(uint16_t platform, uint16_t encoding) const {
+    for (const auto& cmap : cmaps_) {
+        if (cmap.platform == platform && cmap.encoding == encoding) {
+            return true;
+        }
+    }
+    return false;
+}
+
+uint32_t FontProgram::cmap_glyph(uint16_t platform, uint16_t encoding, uint32_t code) const {
+    for (const auto& cmap : cmaps_) {
+        if (cmap.platform != platform || cmap.encoding != encoding) {
+            continue;
+        }
+        size_t at = cmap.offset;
+        uint32_t gid = 0;
+        switch (be16(data_, at)) {
+            case 0:
+                gid = code < 256 ? read_be(data_, at + 6 + code, 1) : 0;
+                break;
+            case 4: {
+                if (code > 0xFFFF) {
+                    break;
+                }
+                uint32_t segments_x2 = be16(data_, at + 6);
+                size_t ends = at + 14;
+                size_t starts = ends + segments_x2 + 2;
+                size_t deltas = starts + segments_x2;
+                size_t ranges = deltas + segments_x2;
+                for (size_t i = 0; i < segments_x2 / 2; i++) {
+                    if (code > be16(data_, ends + 2 * i)) {
+                        continue;
+                    }
+                    uint32_t start = be16(data_, starts + 2 * i);
+                    uint32_t delta = be16(data_, deltas + 2 * i);
+                    uint32_t range = be16(data_, ranges + 2 * i);
+                    if (code < start) {
+                        break;
+                    }
+                    if (range == 0) {
+                        gid = (code + delta) & 0xFFFF;
+                    } else {
+                        uint32_t glyph = be16(data_, ranges + 2 * i + range + 2 * (code - start));
+                        gid = glyph ? (glyph + delta) & 0xFFFF : 0;
+                    }
+                    break;
+                }
+                break;
+            }
+            case 6: {
+                uint32_t first = be16(data_, at + 6);
+                uint32_t count = be16(data_, at + 8);
+                gid = code >= first && code - first < count ? be16(data_, at + 10 + 2 * (code - first)) : 0;
+                break;
+            }
+            case 12: {
+                uint32_t groups = be32(data_, at + 12);
+                for (uint32_t i = 0; i < groups && at + 16 + 12 * (size_t)i < data_.size(); i++) {
+                    size_t group = at + 16 + 12 * (size_t)i;
+                    uint32_t start = be32(data_, group);
+                    if (code >= start && code <= be32(data_, group + 4)) {
+                        gid = be32(data_, group + 8) + (code - start);
+                        break;
+                    }
+                }
+                break;
+            }
+        }
+        if (gid != 0 && gid < glyph_count_) {
+            return gid;
+        }
+    }
+    return 0;
+}
+
+int32_t FontProgram::glyph_named(const std::string& name) const {
+    auto found = names_.find(name);
+    return found != names_.end() ? (int32_t)found->second : -1;
+}
+
+int32_t FontProgram::glyph_for_unicode(uint32_t unicode) const {
+    auto found = unicodes_.find(unicode);
+    return found != unicodes_.end() ? (int32_t)found->second : -1;
+}
+
+int32_t FontProgram::glyph_for_cid(uint32_t cid) const {
+    if (!cid_keyed()) {
+        return -1;
+    }
+    auto found = cids_.find(cid);
+    return found != cids_.end() ? (int32_t)found->second : -1;
+}
+
+int32_t FontProgram::encoding_glyph(uint8_t code) const {
+    if (!cff_ || cff_->cid) {
+        return -1;
+    }
+    if (cff_->standard_encoding) {
+        uint32_t unicode = base_encoding_table(BaseEncoding::Standard)[code];
+        return unicode ? glyph_for_unicode(unicode) : -1;
+    }
+    return cff_->codes[code];
+}
+
+// Adds the components of kept composite glyphs to keep, then writes the kept
+// glyphs back to back (4-byte aligned) with the others empty. loca becomes
+// the long format when the short one cannot address the result.
+bool FontProgram::subset_glyf(std::vector<bool>* keep, std::string* glyf, std::string* loca,
+                              bool* long_loca) const {
+    Table head;
+    Table loca_table;
+    Table glyf_table;
+    if (!table(tag_value("head"), &head) || !table(tag_value("loca"), &loca_table) ||
+        !table(tag_value("glyf"), &glyf_table)) {
+        return false;
+    }
+    bool long_format = be16(data_, head.offset + 50) == 1;
+    if (loca_table.length < ((size_t)glyph_count_ + 1) * (long_format ? 4 : 2)) {
+        return false;
+    }
+    auto location = [&](uint32_t gid) -> uint32_t {
+        return long_format ? be32(data_, loca_table.offset + 4 * (size_t)gid)
+                           : 2 * be16(data_, loca_table.offset + 2 * (size_t)gid);
+    };
+    std::string_view glyphs = std::string_view(data_).substr(glyf_table.offset, glyf_table.length);
+
+    std::vector<uint32_t> queue;
+    for (uint32_t gid = 0; gid < glyph_count_; gid++) {
+        if ((*keep)[gid]) {
+            queue.push_back(gid);
+        }
+    }
+    while (!queue.empty()) {
+        uint32_t gid = queue.back();
+        queue.pop_back();
+        uint32_t start = location(gid);
+        uint32_t end = location(gid + 1);
+        if (end <= start || end > glyphs.size() || (int16_t)be16(glyphs, start) >= 0) {
+            continue;
+        }
+        // Composite: flags, glyph index, then arguments and transform sized by the flags
+        for (size_t pos = start + 10; pos + 4 <= end;) {
+            uint32_t flags = be16(glyphs, pos);
+            uint32_t component = be16(glyphs, pos + 2);
+            pos += 4 + ((flags & 0x0001) ? 4 : 2);
+            pos += (flags & 0x0008) ? 2 : (flags & 0x0040) ? 4 : (flags & 0x0080) ? 8 : 0;
+            if (component < glyph_count_ && !(*keep)[component]) {
+                (*keep)[component] = true;
+                queue.push_back(component);
+            }
+            if (!(flags & 0x0020)) {
+                break;
+            }
+        }
+    }
+
+    std::vector<uint32_t> offsets(glyph_count_ + 1);
+    glyf->clear();
+    for (uint32_t gid = 0; gid < glyph_count_; gid++) {
+        offsets[gid] = (uint32_t)glyf->size();
+        uint32_t start = location(gid);
+        uint32_t end = location(gid + 1);
+        if ((*keep)[gid] && start < end && end <= glyphs.size()) {
+            glyf->append(glyphs.substr(start, end - start));
+            glyf->resize((glyf->size() + 3) & ~(size_t)3, '\0');
+        }
+    }
+    offsets[glyph_count_] = (uint32_t)glyf->size();
+    *long_loca = long_format || glyf->size() > 0x1FFFE;
+    loca->clear();
+    for (uint32_t offset : offsets) {
+        put_be(*long_loca ? offset : offset / 2, *long_loca ? 4 : 2, loca);
+    }
+    return true;
+}
+
+static uint32_t table_checksum(std::string_view table) {
+    uint32_t sum = 0;
+    for (size_t i = 0; i < table.size(); i += 4) {
+        sum += read_be(table, i, 4);
+    }
+    return sum;
+}
+
+bool FontProgram::write_sfnt(const std::vector<bool>& keep, bool names, std::string* output) const {
+    std::map<uint32_t, std::string> tables;
+    for (const auto& entry : tables_) {
+        bool dropped = false;
+        for (const char* tag : DROPPED_TABLES) {
+            dropped = dropped || entry.first == tag_value(tag);
+        }
+        if (!dropped) {
+            tables[entry.first] = data_.substr(entry.second.offset, entry.second.length);
+        }
+    }
+    auto post = tables.find(tag_value("post"));
+    if (!names && post != tables.end() && post->second.size() >= 32) {
+        // Version 3: the metrics without glyph names
+        post->second.resize(32);
+        set_be32(0x00030000, 0, &post->second);
+    }
+    std::string& head = tables[tag_value("head")];
+    set_be32(0, 8, &head);  // checkSumAdjustment, filled in last
+    if (cff_) {
+        if (!cff_->subset(keep, &tables[tag_value("CFF ")])) {
+            return false;
+        }
+    } else {
+        std::vector<bool> glyphs = keep;
+        bool long_loca = false;
+        if (!subset_glyf(&glyphs, &tables[tag_value("glyf")], &tables[tag_value("loca")], &long_loca)) {
+            return false;
+        }
+        head[50] = 0;
+        head[51] = long_loca ? 1 : 0;
+    }
+
+    uint32_t count = (uint32_t)tables.size();
+    uint32_t selector = 0;
+    while ((2u << selector) <= count) {
+        selector++;
+    }
+    output->clear();
+    put_be(be32(data_, 0), 4, output);
+    put_be(count, 2, output);
+    put_be(16u << selector, 2, output);
+    put_be(selector, 2, output);
+    put_be(count * 16 - (16u << selector), 2, output);
+    size_t offset = 12 + 16 * (size_t)count;
+    size_t head_offset = 0;
+    for (const auto& entry : tables) {
+        put_be(entry.first, 4, output);
+        put_be(table_checksum(entry.second), 4, output);
+        put_be((uint32_t)offset, 4, output);
+        put_be((uint32_t)entry.second.size(), 4, output);
+        if (entry.first == tag_value("head")) {
+            head_offset = offset;
+        }
+        offset += (entry.second.size() + 3) & ~(size_t)3;
+    }
+    for (const auto& entry : tables) {
+        *output += entry.second;
+        output->resize((output->size() + 3) & ~(size_t)3, '\0');
+    }
+    set_be32(0xB1B0AFBA - table_checksum(*output), head_offset + 8, output);
+    return true;
+}
+
+bool FontProgram::subset(std::vector<bool> keep, bool names, std::string* output) const {
+    if (glyph_count_ == 0) {
+        return false;
+    }
+    keep.resize(glyph_count_, false);
+    keep[0] = true;
+    if (cff_ && !cff_->cid) {
+        // seac names its parts by StandardEncoding code
+        const uint16_t* standard = base_encoding_table(BaseEncoding::Standard);
+        for (uint32_t gid = 1; gid < glyph_count_; gid++) {
+            uint8_t base = 0;
+            uint8_t accent = 0;
+            if (!keep[gid] || !cff_->seac(gid, &base, &accent)) {
+                continue;
+            }
+            for (uint8_t code : {base, accent}) {
+                int32_t part = standard[code] ? glyph_for_unicode(standard[code]) : -1;
+                if (part > 0) {
+                    keep[part] = true;
+                }
+            }
+        }
+    }
+    if (!sfnt_) {
+        return cff_->subset(keep, output);
+    }
+    return write_sfnt(keep, names, output);
+}
+
+} // namespace spdf
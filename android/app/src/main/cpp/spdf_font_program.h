@@ -0,0 +1,88 @@
+#ifndef SPDF_FONT_PROGRAM_H
+#define SPDF_FONT_PROGRAM_H
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace spdf {
+
+struct CffFont;
+
+// Embedded font program (/FontFile2 TrueType, /FontFile3 bare CFF or
+// OpenType) reduced to what subsetting needs: how the font maps codes, CIDs
+// and glyph names to glyph ids, and a rewrite that keeps only some glyphs.
+// Type 1 (/FontFile) programs are not handled.
+class FontProgram {
+public:
+    FontProgram();
+    ~FontProgram();
+
+    bool parse(std::string data);
+
+    uint32_t glyph_count() const { return glyph_count_; }
+    // Outlines are CFF charstrings (bare CFF, or the OpenType 'CFF ' table)
+    bool cff() const { return cff_ != nullptr; }
+    // CID-keyed CFF, whose charset maps CIDs rather than glyph names
+    bool cid_keyed() const;
+
+    // sfnt 'cmap' lookup in the (platform, encoding) subtable; 0 when the
+    // subtable is missing or leaves the code unmapped
+    bool has_cmap() const { return !cmaps_.empty(); }
+    bool has_cmap(uint16_t platform, uint16_t encoding) const;
+    uint32_t cmap_glyph(uint16_t platform, uint16_t encoding, uint32_t code) const;
+
+    // Glyph ids by CFF charset or TrueType 'post' glyph name, by the Unicode
+    // value of that name, by CID (CID-keyed CFF) and by code in the CFF
+    // built-in encoding; -1 when there is none
+    int32_t glyph_named(const std::string& name) const;
+    int32_t glyph_for_unicode(uint32_t unicode) const;
+    int32_t glyph_for_cid(uint32_t cid) const;
+    int32_t encoding_glyph(uint8_t code) const;
+
+    // Writes the program with every glyph not in keep (by glyph id) emptied.
+    // Glyph ids do not change, so content streams, widths and CIDToGIDMaps
+    // stay valid. .notdef and the glyphs that kept composite glyphs (TrueType)
+    // or accented glyphs (CFF seac) are built from are kept too. Tables PDF
+    // renderers do not read (layout, kerning, hinting metrics, signatures)
+    // are dropped, and so are TrueType glyph names unless names is set (only
+    // simple fonts are looked up by name). False when the program cannot be
+    // rewritten.
+    bool subset(std::vector<bool> keep, bool names, std::string* output) const;
+
+private:
+    struct Table {
+        uint32_t offset;
+        uint32_t length;
+    };
+    struct Cmap {
+        uint16_t platform;
+        uint16_t encoding;
+        uint32_t offset;
+    };
+
+    bool parse_sfnt();
+    void parse_cmap();
+    void parse_post();
+    void index_cff();
+    void index_names(const std::vector<std::string>& names);
+    bool table(uint32_t tag, Table* result) const;
+    bool subset_glyf(std::vector<bool>* keep, std::string* glyf, std::string* loca, bool* long_loca) const;
+    bool write_sfnt(const std::vector<bool>& keep, bool names, std::string* output) const;
+
+    std::string data_;
+    bool sfnt_ = false;
+    uint32_t glyph_count_ = 0;
+    std::unordered_map<uint32_t, Table> tables_;
+    std::vector<Cmap> cmaps_;
+    std::unique_ptr<CffFont> cff_;
+    std::unordered_map<std::string, uint32_t> names_;
+    std::unordered_map<uint32_t, uint32_t> unicodes_;
+    std::unordered_map<uint32_t, uint32_t> cids_;
+};
+
+} // namespace spdf
+
+#endif // SPDF_FONT_PROGRAM_H
@@ -0,0 +1,639 @@
+#include "spdf_font_subset.h"
+#include <algorithm>
+#include <bitset>
+#include <deque>
+#include <set>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <utility>
+#include <vector>
+#include "spdf_encodings.h"
+#include "spdf_filters.h"
+#include "spdf_font.h"
+#include "spdf_font_program.h"
+#include "spdf_hash.h"
+#include "spdf_parser.h"
+
+namespace spdf {
+
+// Same bound as the text extractor and the pruner
+static const int MAX_FORM_DEPTH = 8;
+
+// zlib level of the rewritten programs: written once, read on every open
+static const int PROGRAM_COMPRESSION = 9;
+
+// Appearance streams of an annotation: normal, rollover, down
+static const char* const APPEARANCES[] = {"N", "R", "D"};
+
+// Font descriptor keys of the programs that can be subset
+static const char* const PROGRAM_KEYS[] = {"FontFile2", "FontFile3"};
+
+static const size_t NO_FONT = (size_t)-1;
+
+namespace {
+
+// A font resource and the text the content streams show with it
+struct FontUse {
+    PdfObject dict;
+    uint32_t num = 0;       // of the font dictionary, 0 when it is direct
+    bool composite = false;
+    bool full = false;      // shown where the codes cannot be followed: keeps every glyph
+    bool identity = true;   // composite: 2-byte codes equal to CIDs
+    CMap cmap;              // composite: otherwise codes map to CIDs through this
+    std::bitset<256> codes;             // simple
+    std::unordered_set<uint32_t> cids;  // composite
+    PdfObject cid_font;     // composite: the descendant font
+    size_t program = NO_FONT;
+};
+
+// An embedded font program, and for the first of a set of identical ones
+// (its leader) the union of the glyphs all their fonts show
+struct Program {
+    ObjectRef ref;
+    PdfObject stream;
+    PdfDict filters;     // /Filter and /DecodeParms made direct
+    std::vector<uint32_t> descriptors;
+    bool pinned = false;  // named by a direct font descriptor, which cannot be pointed elsewhere
+    std::string data;
+    uint64_t hash = 0;
+    bool decoded = false;
+    size_t leader = 0;
+
+    FontProgram font;
+    bool parsed = false;
+    bool full = false;
+    bool names = false;  // used by a simple font, which may look glyphs up by name
+    std::vector<bool> glyphs;
+    std::string subset;  // Flate-compressed; empty when the program is kept as it is
+    size_t subset_size = 0;
+    std::string tag;
+};
+
+class FontScanner {
+public:
+    explicit FontScanner(PdfDocument& document) : document_(document) {}
+
+    void scan_page(const PdfPage& page);
+    void mark_full(const PdfObject& resources);
+
+    std::vector<FontUse> uses;
+
+private:
+    void scan(const std::string& content, const PdfDict& resources, int depth, size_t font);
+    void scan_form(const PdfObject& entry, const PdfDict& inherited, int depth, size_t font);
+    size_t use(const PdfObject& entry);
+    size_t use(const PdfDict& resources, const char* category, const PdfObject& name);
+    void show(size_t font, const PdfObject& text);
+
+    PdfDocument& document_;
+    std::unordered_map<uint32_t, size_t> fonts_;     // uses by font dictionary number
+    std::set<std::pair<uint32_t, size_t>> forms_;  // forms scanned, with the font they started with
+};
+
+} // namespace
+
+// ----------------------------------------------------------------------------
+// Which codes each font shows
+// ----------------------------------------------------------------------------
+
+size_t FontScanner::use(const PdfObject& entry) {
+    uint32_t num = entry.is_ref() ? entry.as_ref().num : 0;
+    auto found = fonts_.find(num);
+    if (num != 0 && found != fonts_.end()) {
+        return found->second;
+    }
+    PdfObject dict = document_.resolve(entry);
+    if (!dict.is_dict()) {
+        return NO_FONT;
+    }
+    FontUse font;
+    font.dict = dict;
+    font.num = num;
+    const PdfObject& subtype = dict.as_dict().get("Subtype");
+    if (subtype.is_name("Type0")) {
+        font.composite = true;
+        PdfObject encoding = document_.lookup(dict.as_dict(), "Encoding");
+        if (encoding.is_stream()) {
+            std::string program;
+            std::string error;
+            font.identity = false;
+            font.full = !document_.decode_stream(encoding, &program, &error) || !font.cmap.parse(program);
+        } else {
+            // Other predefined CMaps would need their tables
+            font.full = !encoding.is_name("Identity-H") && !encoding.is_name("Identity-V");
+        }
+    }
+    size_t index = uses.size();
+    uses.push_back(std::move(font));
+    if (num != 0) {
+        fonts_[num] = index;
+    }
+    if (subtype.is_name("Type3")) {
+        // Glyph procedures may show any text in the fonts of their own resources
+        mark_full(document_.lookup(dict.as_dict(), "Resources"));
+    }
+    return index;
+}
+
+size_t FontScanner::use(const PdfDict& resources, const char* category, const PdfObject& name) {
+    if (!name.is_name()) {
+        return NO_FONT;
+    }
+    PdfObject members = document_.lookup(resources, category);
+    const PdfObject& entry = members.as_dict().get(name.as_name());
+    return entry.is_null() ? NO_FONT : use(entry);
+}
+
+void FontScanner::mark_full(const PdfObject& resources) {
+    PdfObject fonts = document_.lookup(document_.resolve(resources).as_dict(), "Font");
+    for (const auto& entry : fonts.as_dict()) {
+        size_t font = use(entry.second);
+        if (font != NO_FONT) {
+            uses[font].full = true;
+        }
+    }
+}
+
+void FontScanner::show(size_t font, const PdfObject& text) {
+    if (font == NO_FONT || !text.is_string() || uses[font].full) {
+        return;
+    }
+    FontUse& use = uses[font];
+    const std::string& bytes = text.as_string();
+    if (!use.composite) {
+        for (unsigned char c : bytes) {
+            use.codes.set(c);
+        }
+        return;
+    }
+    const unsigned char* p = (const unsigned char*)bytes.data();
+    size_t left = bytes.size();
+    while (left > 0) {
+        uint32_t code = 0;
+        size_t length = 2;
+        if (use.identity) {
+            code = left >= 2 ? (uint32_t)p[0] << 8 | p[1] : p[0];
+        } else {
+            length = use.cmap.next_code(p, left, &code);
+        }
+        if (length == 0 || length > left) {
+            break;
+        }
+        uint32_t cid = code;
+        if (!use.identity && !use.cmap.to_cid(code, &cid)) {
+            cid = 0;
+        }
+        use.cids.insert(cid);
+        p += length;
+        left -= length;
+    }
+}
+
+// The current font is part of the graphics state: q/Q save and restore it,
+// forms start with the one in effect where they run
+void FontScanner::scan(const std::string& content, const PdfDict& resources, int depth, size_t font) {
+    ContentParser parser(content.data(), content.size());
+    std::vector<PdfObject> operands;
+    std::vector<size_t> saved;
+    std::string_view op;
+    while (parser.next(&operands, &op)) {
+        size_t n = operands.size();
+        if (op == "q") {
+            saved.push_back(font);
+        } else if (op == "Q") {
+            if (!saved.empty()) {
+                font = saved.back();
+                saved.pop_back();
+            }
+        } else if (n == 0) {
+            continue;
+        } else if (op == "Tf") {
+            font = use(resources, "Font", operands[0]);
+        } else if (op == "Tj" || op == "'" || op == "\"") {
+            show(font, operands[n - 1]);
+        } else if (op == "TJ") {
+            for (const auto& item : operands[0].as_array()) {
+                show(font, item);
+            }
+        } else if (op == "Do") {
+            PdfObject xobjects = document_.lookup(resources, "XObject");
+            scan_form(xobjects.as_dict().get(operands[0].as_name()), resources, depth + 1, font);
+        } else if (op == "scn" || op == "SCN") {
+            PdfObject patterns = document_.lookup(resources, "Pattern");
+            scan_form(patterns.as_dict().get(operands[n - 1].as_name()), resources, depth + 1, NO_FONT);
+        } else if (op == "gs") {
+            PdfObject states = document_.lookup(resources, "ExtGState");
+            PdfObject state = document_.resolve(states.as_dict().get(operands[0].as_name()));
+            PdfObject font_entry = document_.lookup(state.as_dict(), "Font");
+            if (font_entry.is_array() && !font_entry.as_array().empty()) {
+                font = use(font_entry.as_array()[0]);
+            }
+            PdfObject mask = document_.lookup(state.as_dict(), "SMask");
+            scan_form(mask.as_dict().get("G"), resources, depth + 1, NO_FONT);
+        }
+    }
+}
+
+// Form XObjects, tiling patterns and soft mask groups: content streams that
+// use their own resources, or those of whatever runs them
+void FontScanner::scan_form(const PdfObject& entry, const PdfDict& inherited, int depth, size_t font) {
+    PdfObject form = document_.resolve(entry);
+    if (depth > MAX_FORM_DEPTH || !form.is_stream() || form.as_dict().get("Subtype").is_name("Image") ||
+        (entry.is_ref() && !forms_.insert(std::make_pair(entry.as_ref().num, font)).second)) {
+        return;
+    }
+    PdfObject own = document_.lookup(form.as_dict(), "Resources");
+    const PdfDict& resources = own.is_dict() ? own.as_dict() : inherited;
+    std::string content;
+    std::string error;
+    if (!document_.decode_contents(form, &content, &error)) {
+        mark_full(PdfObject::dict(resources));
+        return;
+    }
+    scan(content, resources, depth, font);
+}
+
+void FontScanner::scan_page(const PdfPage& page) {
+    // page.dict holds the inherited /Resources too
+    PdfObject resources = document_.resolve(page.dict.get("Resources"));
+    std::string content;
+    std::string error;
+    if (document_.decode_contents(document_.lookup(page.dict, "Contents"), &content, &error)) {
+        scan(content, resources.as_dict(), 0, NO_FONT);
+    } else {
+        mark_full(resources);
+    }
+    PdfObject annotations = document_.lookup(page.dict, "Annots");
+    PdfDict none;
+    for (const auto& item : annotations.as_array()) {
+        PdfObject annotation = document_.resolve(item);
+        PdfObject appearance = document_.lookup(annotation.as_dict(), "AP");
+        for (const char* key : APPEARANCES) {
+            const PdfObject& entry = appearance.as_dict().get(key);
+            PdfObject states = document_.resolve(entry);
+            if (states.is_stream()) {
+                scan_form(entry, none, 1, NO_FONT);
+                continue;
+            }
+            for (const auto& state : states.as_dict()) {
+                scan_form(state.second, none, 1, NO_FONT);
+            }
+        }
+    }
+}
+
+// ----------------------------------------------------------------------------
+// From codes to glyph ids
+// ----------------------------------------------------------------------------
+
+static void keep_glyph(int64_t gid, Program* program) {
+    if (gid > 0 && (uint64_t)gid < program->glyphs.size()) {
+        program->glyphs[(size_t)gid] = true;
+    }
+}
+
+static void add_cid_glyphs(PdfDocument& document, const FontUse& use, Program* program) {
+    const FontProgram& font = program->font;
+    std::string map;
+    bool mapped = false;
+    if (!font.cid_keyed() && use.cid_font.as_dict().get("Subtype").is_name("CIDFontType2")) {
+        PdfObject gid_map = document.lookup(use.cid_font.as_dict(), "CIDToGIDMap");
+        std::string error;
+        if (gid_map.is_stream()) {
+            if (!document.decode_stream(gid_map, &map, &error)) {
+                program->full = true;
+                return;
+            }
+            mapped = true;
+        }
+    }
+    for (uint32_t cid : use.cids) {
+        if (font.cid_keyed()) {
+            keep_glyph(font.glyph_for_cid(cid), program);
+        } else if (mapped) {
+            size_t at = 2 * (size_t)cid;
+            keep_glyph(at + 1 < map.size() ? (unsigned char)map[at] << 8 | (unsigned char)map[at + 1] : 0, program);
+        } else {
+            keep_glyph(cid, program);
+        }
+    }
+}
+
+// Simple fonts reach their glyphs in ways that depend on the font type, the
+// symbolic flag and which cmap subtables exist, and renderers differ in the
+// order they try them. Every glyph any of those ways reaches is kept.
+static void add_simple_glyphs(PdfDocument& document, const FontUse& use, Program* program) {
+    const FontProgram& font = program->font;
+    const PdfDict& dict = use.dict.as_dict();
+    BaseEncoding base = dict.get("Subtype").is_name("TrueType") ? BaseEncoding::WinAnsi : BaseEncoding::Standard;
+    PdfObject encoding = document.lookup(dict, "Encoding");
+    PdfObject base_name = encoding.is_dict() ? document.lookup(encoding.as_dict(), "BaseEncoding") : encoding;
+    if (base_name.is_name("WinAnsiEncoding")) {
+        base = BaseEncoding::WinAnsi;
+    } else if (base_name.is_name("MacRomanEncoding")) {
+        base = BaseEncoding::MacRoman;
+    } else if (base_name.is_name("StandardEncoding")) {
+        base = BaseEncoding::Standard;
+    }
+    uint32_t unicode[256];
+    std::string names[256];
+    const uint16_t* table = base_encoding_table(base);
+    for (int c = 0; c < 256; c++) {
+        unicode[c] = table[c];
+    }
+    PdfObject differences = document.lookup(encoding.as_dict(), "Differences");
+    uint32_t code = 0;
+    for (const auto& item : differences.as_array()) {
+        if (item.is_number()) {
+            code = (uint32_t)item.as_int();
+        } else if (item.is_name() && code < 256) {
+            names[code] = item.as_name();
+            unicode[code++] = glyph_name_to_unicode(item.as_name());
+        }
+    }
+    // (1,0) subtables are indexed by Mac Roman code
+    std::unordered_map<uint32_t, uint32_t> mac_codes;
+    const uint16_t* mac = base_encoding_table(BaseEncoding::MacRoman);
+    for (uint32_t c = 0; c < 256; c++) {
+        if (mac[c] != 0) {
+            mac_codes.emplace(mac[c], c);
+        }
+    }
+
+    for (uint32_t c = 0; c < 256; c++) {
+        if (!use.codes.test(c)) {
+            continue;
+        }
+        if (font.has_cmap()) {
+            for (uint32_t page : {0x0000u, 0xF000u, 0xF100u, 0xF200u}) {
+                keep_glyph(font.cmap_glyph(3, 0, page + c), program);
+            }
+            keep_glyph(font.cmap_glyph(1, 0, c), program);
+            keep_glyph(font.cmap_glyph(3, 1, c), program);
+            if (unicode[c] != 0) {
+                keep_glyph(font.cmap_glyph(3, 1, unicode[c]), program);
+                keep_glyph(font.cmap_glyph(0, 3, unicode[c]), program);
+                auto found = mac_codes.find(unicode[c]);
+                if (found != mac_codes.end()) {
+                    keep_glyph(font.cmap_glyph(1, 0, found->second), program);
+                }
+            }
+        } else if (!font.cff()) {
+            keep_glyph(c, program);
+        }
+        if (!names[c].empty()) {
+            keep_glyph(font.glyph_named(names[c]), program);
+        }
+        if (unicode[c] != 0) {
+            keep_glyph(font.glyph_for_unicode(unicode[c]), program);
+        }
+        keep_glyph(font.encoding_glyph((uint8_t)c), program);
+    }
+}
+
+// ----------------------------------------------------------------------------
+// Planning
+// ----------------------------------------------------------------------------
+
+// Finds the embedded program of a font and registers the use with it
+static void locate_program(PdfDocument& document, FontUse* use, std::deque<Program>* programs,
+                           std::unordered_map<uint32_t, size_t>* by_num) {
+    PdfObject font = use->dict;
+    if (use->composite) {
+        PdfObject descendants = document.lookup(use->dict.as_dict(), "DescendantFonts");
+        if (descendants.as_array().empty()) {
+            return;
+        }
+        font = document.resolve(descendants.as_array()[0]);
+        use->cid_font = font;
+    }
+    const PdfObject& descriptor_entry = font.as_dict().get("FontDescriptor");
+    PdfObject descriptor = document.resolve(descriptor_entry);
+    for (const char* key : PROGRAM_KEYS) {
+        const PdfObject& entry = descriptor.as_dict().get(key);
+        if (!entry.is_ref()) {
+            continue;
+        }
+        PdfObject stream = document.resolve(entry);
+        const PdfObject& subtype = stream.as_dict().get("Subtype");
+        if (!stream.is_stream() || (std::string(key) == "FontFile3" && !subtype.is_name("Type1C") &&
+                                    !subtype.is_name("CIDFontType0C") && !subtype.is_name("OpenType"))) {
+            return;
+        }
+        uint32_t num = entry.as_ref().num;
+        auto found = by_num->find(num);
+        if (found == by_num->end()) {
+            found = by_num->emplace(num, programs->size()).first;
+            Program& program = programs->emplace_back();
+            program.ref = entry.as_ref();
+            program.stream = stream;
+            program.filters.set("Filter", document.lookup(stream.as_dict(), "Filter"));
+            program.filters.set("DecodeParms", document.lookup(stream.as_dict(), "DecodeParms"));
+        }
+        Program& program = (*programs)[found->second];
+        if (descriptor_entry.is_ref()) {
+            program.descriptors.push_back(descriptor_entry.as_ref().num);
+        } else {
+            program.pinned = true;
+        }
+        use->program = found->second;
+        return;
+    }
+}
+
+// Six capital letters derived from the new program, so different subsets get different tags
+static std::string subset_tag(const std::string& program) {
+    Xxh64 hash;
+    hash.update(program);
+    uint64_t value = hash.digest();
+    std::string tag;
+    for (int i = 0; i < 6; i++) {
+        tag += (char)('A' + value % 26);
+        value /= 26;
+    }
+    return tag;
+}
+
+// name with its subset tag replaced by tag
+static PdfObject tagged(const PdfObject& name, const std::string& tag) {
+    if (!name.is_name()) {
+        return name;
+    }
+    std::string base = name.as_name();
+    if (base.size() > 7 && base[6] == '+' &&
+        std::all_of(base.begin(), base.begin() + 6, [](char c) { return c >= 'A' && c <= 'Z'; })) {
+        base.erase(0, 7);
+    }
+    return PdfObject::name(tag + "+" + base);
+}
+
+// Copy of the dictionary of num (or of object when it is direct) with key renamed to carry tag
+static PdfObject tagged_dict(const PdfObject& object, const char* key, const std::string& tag) {
+    PdfDict dict = object.as_dict();
+    if (dict.has(key)) {
+        dict.set(key, tagged(dict.get(key), tag));
+    }
+    return PdfObject::dict(std::move(dict));
+}
+
+void plan_font_subsetting(PdfDocument& document, unsigned threads, ObjectReplacements* replacements,
+                          FontSubsetStats* stats) {
+    FontScanner scanner(document);
+    for (const auto& page : document.pages()) {
+        scanner.scan_page(page);
+    }
+    // Form fields can have their appearances regenerated with any text
+    PdfObject form = document.lookup(document.catalog(), "AcroForm");
+    scanner.mark_full(document.lookup(form.as_dict(), "DR"));
+
+    std::vector<FontUse>& uses = scanner.uses;
+    // Never moved once filled in: parsed programs refer to their own data
+    std::deque<Program> programs;
+    std::unordered_map<uint32_t, size_t> by_num;
+    for (auto& use : uses) {
+        locate_program(document, &use, &programs, &by_num);
+    }
+
+    // Decode and hash every program; identical ones follow the first as their leader
+    run_parallel(programs.size(), threads, [&](size_t i) {
+        Program& program = programs[i];
+        std::string raw;
+        std::string error;
+        document.stream_data(program.stream, &raw);
+        program.decoded = decode_stream_data(program.filters, raw, &program.data, &error);
+        Xxh64 hash;
+        hash.update(program.data);
+        program.hash = hash.digest();
+    });
+    std::unordered_map<uint64_t, std::vector<size_t>> leaders;
+    for (size_t i = 0; i < programs.size(); i++) {
+        Program& program = programs[i];
+        program.leader = i;
+        if (!program.decoded || program.pinned) {
+            continue;
+        }
+        std::vector<size_t>& same_hash = leaders[program.hash];
+        for (size_t leader : same_hash) {
+            if (programs[leader].data == program.data) {
+                program.leader = leader;
+                break;
+            }
+        }
+        if (program.leader == i) {
+            same_hash.push_back(i);
+        } else {
+            std::string().swap(program.data);
+        }
+    }
+    run_parallel(programs.size(), threads, [&](size_t i) {
+        Program& program = programs[i];
+        if (program.leader == i && program.decoded) {
+            program.parsed = program.font.parse(std::move(program.data));
+            program.glyphs.assign(program.font.glyph_count(), false);
+        }
+    });
+
+    for (const auto& use : uses) {
+        if (use.program == NO_FONT) {
+            continue;
+        }
+        Program& program = programs[programs[use.program].leader];
+        if (!program.parsed) {
+            continue;
+        }
+        if (use.full) {
+            program.full = true;
+        } else if (use.composite) {
+            add_cid_glyphs(document, use, &program);
+        } else {
+            program.names = true;
+            add_simple_glyphs(document, use, &program);
+        }
+    }
+
+    run_parallel(programs.size(), threads, [&](size_t i) {
+        Program& program = programs[i];
+        std::string subset;
+        if (program.leader != i || !program.parsed || program.full ||
+            !program.font.subset(program.glyphs, program.names, &subset) ||
+            !flate_encode(subset.data(), subset.size(), &program.subset, PROGRAM_COMPRESSION) ||
+            program.subset.size() >= program.stream.as_stream().data.size()) {
+            program.subset.clear();
+            return;
+        }
+        program.subset_size = subset.size();
+        program.tag = subset_tag(subset);
+    });
+
+    FontSubsetStats counted;
+    for (size_t i = 0; i < programs.size(); i++) {
+        Program& program = programs[i];
+        const Program& leader = programs[program.leader];
+        counted.programs += program.decoded;
+        if (program.leader != i) {
+            // Dropped; its descriptors name the leader instead
+            counted.merged++;
+            counted.bytes_before += program.stream.as_stream().data.size();
+            replacements->emplace(program.ref.num, PdfObject());
+        } else if (!program.subset.empty()) {
+            counted.subset++;
+            counted.bytes_before += program.stream.as_stream().data.size();
+            counted.bytes_after += program.subset.size();
+            PdfDict dict = program.stream.as_dict();
+            dict.set("Filter", PdfObject::name("FlateDecode"));
+            dict.erase("DecodeParms");
+            dict.erase("DL");
+            if (dict.has("Length1")) {
+                dict.set("Length1", PdfObject::integer((int64_t)program.subset_size));
+            }
+            replacements->emplace(program.ref.num, PdfObject::stream(std::move(dict), std::move(program.subset)));
+        }
+        if (program.leader == i && leader.tag.empty()) {
+            continue;
+        }
+        for (uint32_t num : program.descriptors) {
+            ObjectRef ref;
+            if (replacements->count(num) || !document.object_ref(num, &ref)) {
+                continue;
+            }
+            PdfObject descriptor = document.get(ref);
+            PdfDict dict = leader.tag.empty() ? descriptor.as_dict() : tagged_dict(descriptor, "FontName", leader.tag).as_dict();
+            for (const char* key : PROGRAM_KEYS) {
+                if (dict.get(key).is_ref() && dict.get(key).as_ref().num == program.ref.num) {
+                    dict.set(key, PdfObject::reference(leader.ref));
+                }
+            }
+            (*replacements)[num] = PdfObject::dict(std::move(dict));
+        }
+    }
+
+    // Font dictionaries carry the tag in /BaseFont, composite ones in their descendant too
+    for (const auto& use : uses) {
+        if (use.program == NO_FONT || use.num == 0) {
+            continue;
+        }
+        const std::string& tag = programs[programs[use.program].leader].tag;
+        if (tag.empty() || replacements->count(use.num)) {
+            continue;
+        }
+        PdfObject font = tagged_dict(use.dict, "BaseFont", tag);
+        if (use.composite) {
+            PdfDict& dict = font.mutable_dict();
+            PdfArray descendants = document.lookup(dict, "DescendantFonts").as_array();
+            const PdfObject& entry = descendants[0];
+            if (entry.is_ref()) {
+                replacements->emplace(entry.as_ref().num, tagged_dict(use.cid_font, "BaseFont", tag));
+            } else {
+                descendants[0] = tagged_dict(use.cid_font, "BaseFont", tag);
+                dict.set("DescendantFonts", PdfObject::array(std::move(descendants)));
+            }
+        }
+        (*replacements)[use.num] = std::move(font);
+    }
+    if (stats) {
+        *stats = counted;
+    }
+}
+
+} // namespace spdf
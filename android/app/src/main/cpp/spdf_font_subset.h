@@ -0,0 +1,39 @@
+#ifndef SPDF_FONT_SUBSET_H
+#define SPDF_FONT_SUBSET_H
+
+#include <cstddef>
+#include <cstdint>
+#include "spdf_document.h"
+#include "spdf_writer.h"
+
+namespace spdf {
+
+struct FontSubsetStats {
+    size_t programs = 0;        // embedded font programs the pages use
+    size_t subset = 0;          // rewritten with only the glyphs shown
+    size_t merged = 0;          // dropped for an identical program kept elsewhere
+    uint64_t bytes_before = 0;  // stream bytes of the subset and merged programs
+    uint64_t bytes_after = 0;
+};
+
+// Plans the font stage of a rewrite (WriteOptions::subset_fonts). The page
+// contents, the forms and tiling patterns they run and the appearance
+// streams of their annotations are walked for the text each font shows, and
+// the codes are mapped through the font's encoding (CMap and CIDToGIDMap for
+// composite fonts, the encoding, cmap subtables and glyph names for simple
+// ones) to glyph ids. Embedded TrueType, CFF and OpenType programs are then
+// cut down to those glyphs (see FontProgram::subset()) and get a new subset
+// tag on their font names. Programs that decode to the same bytes, such as
+// one font embedded by every input of a merge, are subset once for the union
+// of their glyphs and every font descriptor is pointed at the one kept.
+//
+// Fonts of the interactive form's default resources and of Type 3 glyph
+// procedures keep all their glyphs (they can draw any text); Type 1 programs
+// are left alone. The new programs, descriptors and font dictionaries are
+// added to replacements, leaving objects it already replaces untouched.
+void plan_font_subsetting(PdfDocument& document, unsigned threads, ObjectReplacements* replacements,
+                          FontSubsetStats* stats = nullptr);
+
+} // namespace spdf
+
+#endif // SPDF_FONT_SUBSET_H
@@ -0,0 +1,856 @@
+#include "spdf_form.h"
+#include <algorithm>
+#include <cctype>
+#include <cmath>
+#include <cstdio>
+#include <map>
+#include <thread>
+#include "spdf_encodings.h"
+#include "spdf_lexer.h"
+
+namespace spdf {
+
+// Deepest field tree walked; deeper nodes are taken to be a reference cycle
+static const int MAX_FIELD_DEPTH = 32;
+// Font size of text fields whose /DA asks for auto size (0) that are multiline
+static const double AUTO_SIZE = 12;
+// Smallest font size auto size shrinks text to
+static const double MIN_AUTO_SIZE = 4;
+// Distance between the baselines of multiline text, in font sizes
+static const double LEADING = 1.15;
+// Width of characters with no metrics in the font, 1/1000 em
+static const float DEFAULT_WIDTH = 500;
+
+// Field flags (ISO 32000-1 tables 226, 228, 230)
+static const int64_t FLAG_MULTILINE = 1 << 12;
+static const int64_t FLAG_PASSWORD = 1 << 13;
+static const int64_t FLAG_RADIO = 1 << 15;
+static const int64_t FLAG_PUSHBUTTON = 1 << 16;
+static const int64_t FLAG_COMB = 1 << 24;
+
+struct FormTemplate::Font {
+    std::string key;      // name in /DR /Font
+    PdfObject object;     // as /DR lists it, usually a reference
+    bool simple = false;  // one byte per character, so text can be encoded here
+    float widths[256];    // 1/1000 em
+    std::unordered_map<uint32_t, uint8_t> codes;  // Unicode -> character code
+};
+
+struct FormTemplate::Widget {
+    ObjectRef ref;
+    PdfDict dict;
+    // Size of the appearance, with /MK /R applied, and the matrix turning it
+    // (null when it is not turned)
+    double width = 0;
+    double height = 0;
+    PdfObject matrix;
+    double inset = 2;   // border width plus padding, around the text
+    std::string frame;  // operators drawing /MK /BG and /BC
+    std::vector<std::string> on_states;  // buttons: the /AP /N states other than Off
+};
+
+struct FormTemplate::Field {
+    enum class Kind { Text, Choice, CheckBox, Radio };
+
+    std::string name;
+    Kind kind = Kind::Text;
+    ObjectRef ref;
+    PdfDict dict;
+    int64_t flags = 0;
+    int64_t quadding = 0;
+    int64_t max_len = 0;
+    // /DA around its Tf operator, the font name as written there and the size
+    std::string da_head;
+    std::string da_tail;
+    std::string font_name;
+    double font_size = 0;
+    int font = -1;  // into fonts_, -1 when the /DA names no usable font
+    std::vector<std::pair<std::string, std::string>> options;  // /Opt: export value, text shown
+    std::vector<Widget> widgets;
+};
+
+static bool fail(PdfErrorCode code, const std::string& message, PdfErrorCode* error_code, std::string* error) {
+    *error_code = code;
+    *error = message;
+    return false;
+}
+
+// Code points of UTF-8 text; malformed bytes become U+FFFD
+static std::vector<uint32_t> decode_utf8(const std::string& text) {
+    std::vector<uint32_t> out;
+    for (size_t i = 0; i < text.size();) {
+        unsigned char c = (unsigned char)text[i];
+        int extra = c < 0x80 ? 0 : (c >> 5) == 6 ? 1 : (c >> 4) == 14 ? 2 : (c >> 3) == 30 ? 3 : -1;
+        uint32_t code = extra == 0 ? c : extra == 1 ? c & 0x1F : extra == 2 ? c & 0x0F : c & 0x07;
+        bool ok = extra >= 0 && i + extra < text.size();
+        for (int k = 1; ok && k <= extra; k++) {
+            unsigned char next = (unsigned char)text[i + k];
+            ok = (next & 0xC0) == 0x80;
+            code = code << 6 | (next & 0x3F);
+        }
+        out.push_back(ok ? code : 0xFFFD);
+        i += ok ? extra + 1 : 1;
+    }
+    return out;
+}
+
+// PDF text string (UTF-16BE with a byte order mark, or PDFDocEncoding) as UTF-8
+static std::string text_string_to_utf8(const std::string& bytes) {
+    std::string out;
+    if (bytes.size() >= 2 && (unsigned char)bytes[0] == 0xFE && (unsigned char)bytes[1] == 0xFF) {
+        for (size_t i = 2; i + 1 < bytes.size(); i += 2) {
+            uint32_t unit = (unsigned char)bytes[i] << 8 | (unsigned char)bytes[i + 1];
+            if (unit >= 0xD800 && unit < 0xDC00 && i + 3 < bytes.size()) {
+                uint32_t low = (unsigned char)bytes[i + 2] << 8 | (unsigned char)bytes[i + 3];
+                unit = 0x10000 + ((unit - 0xD800) << 10) + (low - 0xDC00);
+                i += 2;
+            }
+            append_utf8(unit, &out);
+        }
+        return out;
+    }
+    const uint16_t* table = base_encoding_table(BaseEncoding::PdfDoc);
+    for (unsigned char c : bytes) {
+        append_utf8(c < 0x80 ? c : table[c] ? table[c] : 0xFFFD, &out);
+    }
+    return out;
+}
+
+// UTF-8 as a PDF text string: ASCII as it is, anything else as UTF-16BE
+static std::string utf8_to_text_string(const std::string& text) {
+    if (std::all_of(text.begin(), text.end(), [](char c) { return (unsigned char)c < 0x80; })) {
+        return text;
+    }
+    std::string out = "\xFE\xFF";
+    for (uint32_t code : decode_utf8(text)) {
+        if (code >= 0x10000) {
+            code -= 0x10000;
+            uint32_t high = 0xD800 + (code >> 10);
+            uint32_t low = 0xDC00 + (code & 0x3FF);
+            out += {(char)(high >> 8), (char)high, (char)(low >> 8), (char)low};
+        } else {
+            out += {(char)(code >> 8), (char)code};
+        }
+    }
+    return out;
+}
+
+static std::string lower(std::string text) {
+    std::transform(text.begin(), text.end(), text.begin(), [](unsigned char c) { return (char)tolower(c); });
+    return text;
+}
+
+// Content stream number: at most 3 decimals, no trailing zeros
+static std::string number(double value) {
+    char buffer[32];
+    snprintf(buffer, sizeof(buffer), "%.3f", std::fabs(value) < 0.0005 ? 0.0 : value);
+    std::string text = buffer;
+    text.erase(text.find_last_not_of('0') + 1);
+    if (text.back() == '.') {
+        text.pop_back();
+    }
+    return text;
+}
+
+static std::string hex_string(const std::string& bytes) {
+    static const char digits[] = "0123456789ABCDEF";
+    std::string out = "<";
+    for (unsigned char c : bytes) {
+        out += digits[c >> 4];
+        out += digits[c & 15];
+    }
+    return out + ">";
+}
+
+// Colour operator for a /MK colour array (gray, RGB or CMYK); empty for none
+static std::string color_operator(const PdfArray& color, bool stroke) {
+    static const char* fill_ops[] = {"", "g", "", "rg", "k"};
+    static const char* stroke_ops[] = {"", "G", "", "RG", "K"};
+    if (color.size() != 1 && color.size() != 3 && color.size() != 4) {
+        return std::string();
+    }
+    std::string out;
+    for (const auto& component : color) {
+        out += number(component.as_number()) + " ";
+    }
+    return out + (stroke ? stroke_ops : fill_ops)[color.size()] + "\n";
+}
+
+static const char* kind_name(int kind) {
+    static const char* names[] = {"text field", "choice field", "check box", "radio button"};
+    return names[kind];
+}
+
+bool parse_form_data(const std::string& csv, std::vector<FormValues>* rows, std::string* error) {
+    std::vector<std::vector<std::string>> records;
+    std::vector<std::string> record;
+    std::string value;
+    bool quoted = false;
+    bool was_quoted = false;
+    size_t start = csv.compare(0, 3, "\xEF\xBB\xBF") == 0 ? 3 : 0;
+    for (size_t i = start; i <= csv.size(); i++) {
+        char c = i < csv.size() ? csv[i] : '\n';
+        if (quoted) {
+            if (i == csv.size()) {
+                *error = "unterminated quoted value";
+                return false;
+            }
+            if (c == '"' && i + 1 < csv.size() && csv[i + 1] == '"') {
+                value += '"';
+                i++;
+            } else if (c == '"') {
+                quoted = false;
+            } else {
+                value += c;
+            }
+        } else if (c == '"' && value.empty() && !was_quoted) {
+            quoted = was_quoted = true;
+        } else if (c == ',') {
+            record.push_back(std::move(value));
+            value.clear();
+            was_quoted = false;
+        } else if (c == '\n' || c == '\r') {
+            if (c == '\r' && i + 1 < csv.size() && csv[i + 1] == '\n') {
+                i++;
+            }
+            bool blank = record.empty() && value.empty() && !was_quoted;
+            record.push_back(std::move(value));
+            value.clear();
+            was_quoted = false;
+            if (!blank) {
+                records.push_back(std::move(record));
+            }
+            record.clear();
+        } else {
+            value += c;
+        }
+    }
+    if (records.empty()) {
+        *error = "no header naming the fields";
+        return false;
+    }
+    const std::vector<std::string>& names = records[0];
+    for (const auto& name : names) {
+        if (name.empty()) {
+            *error = "empty field name in the header";
+            return false;
+        }
+    }
+    for (size_t r = 1; r < records.size(); r++) {
+        if (records[r].size() > names.size()) {
+            *error = "row " + std::to_string(r) + " has " + std::to_string(records[r].size()) +
+                     " values for " + std::to_string(names.size()) + " fields";
+            return false;
+        }
+        FormValues row;
+        for (size_t k = 0; k < records[r].size(); k++) {
+            row.emplace_back(names[k], std::move(records[r][k]));
+        }
+        rows->push_back(std::move(row));
+    }
+    return true;
+}
+
+std::string form_output_path(const std::string& pattern, size_t row, const FormValues& values) {
+    std::string out;
+    for (size_t i = 0; i < pattern.size(); i++) {
+        size_t close = pattern[i] == '{' ? pattern.find('}', i) : std::string::npos;
+        if (close == std::string::npos) {
+            out += pattern[i];
+            continue;
+        }
+        std::string key = pattern.substr(i + 1, close - i - 1);
+        auto found = std::find_if(values.begin(), values.end(),
+                                  [&](const std::pair<std::string, std::string>& value) { return value.first == key; });
+        if (key == "row") {
+            out += std::to_string(row);
+        } else if (found != values.end()) {
+            for (char c : found->second) {
+                out += c == '/' || (unsigned char)c < 0x20 ? '_' : c;
+            }
+        } else {
+            out += pattern.substr(i, close - i + 1);
+        }
+        i = close;
+    }
+    return out;
+}
+
+FormTemplate::FormTemplate() = default;
+FormTemplate::~FormTemplate() = default;
+
+bool FormTemplate::open(const std::string& path, const std::string& scratch, PdfErrorCode* error_code,
+                        std::string* error) {
+    if (!open_update_base(path, scratch, &base_, error_code, error)) {
+        return false;
+    }
+    PdfDocument* document = base_.document;
+    const PdfObject& acroform = document->catalog().get("AcroForm");
+    acroform_ = document->resolve(acroform).as_dict();
+    acroform_direct_ = !acroform.is_ref();
+    acroform_ref_ = acroform_direct_ ? document->trailer().get("Root").as_ref() : acroform.as_ref();
+    PdfDict dr = document->lookup(acroform_, "DR").as_dict();
+    dr_fonts_ = document->lookup(dr, "Font").as_dict();
+
+    PdfDict inherited;
+    if (acroform_.has("DA")) {
+        inherited.set("DA", acroform_.get("DA"));
+    }
+    if (acroform_.has("Q")) {
+        inherited.set("Q", acroform_.get("Q"));
+    }
+    std::vector<uint32_t> seen;
+    for (const auto& field : document->lookup(acroform_, "Fields").as_array()) {
+        compile_field(field, std::string(), inherited, 0, &seen);
+    }
+    if (fields_.empty()) {
+        return fail(PdfErrorCode_InvalidParameter, path + " has no fillable form fields", error_code, error);
+    }
+    *error_code = PdfErrorCode_Success;
+    return true;
+}
+
+bool FormTemplate::compile_field(const PdfObject& node, const std::string& parent_name, const PdfDict& inherited,
+                                 int depth, std::vector<uint32_t>* seen) {
+    if (!node.is_ref() || depth > MAX_FIELD_DEPTH ||
+        std::find(seen->begin(), seen->end(), node.as_ref().num) != seen->end()) {
+        return false;
+    }
+    seen->push_back(node.as_ref().num);
+    PdfDocument* document = base_.document;
+    PdfDict dict = document->resolve(node).as_dict();
+    if (dict.empty()) {
+        return false;
+    }
+    PdfDict attributes = inherited;
+    for (const char* key : {"FT", "Ff", "DA", "Q", "Opt", "MaxLen"}) {
+        if (dict.has(key)) {
+            attributes.set(key, document->lookup(dict, key));
+        }
+    }
+    std::string name = parent_name;
+    if (dict.has("T")) {
+        std::string partial = text_string_to_utf8(document->lookup(dict, "T").as_string());
+        name = name.empty() ? partial : name + "." + partial;
+    }
+
+    // Kids with /T are fields of their own; the others are this field's widgets
+    std::vector<PdfObject> widgets;
+    bool has_fields = false;
+    for (const auto& kid : document->lookup(dict, "Kids").as_array()) {
+        if (document->resolve(kid).as_dict().has("T")) {
+            has_fields = compile_field(kid, name, attributes, depth + 1, seen) || has_fields;
+        } else {
+            widgets.push_back(kid);
+        }
+    }
+    if (has_fields || name.empty()) {
+        return true;
+    }
+    if (!dict.has("Kids")) {
+        widgets.push_back(node);
+    }
+
+    Field field;
+    field.name = name;
+    field.ref = node.as_ref();
+    field.dict = dict;
+    field.flags = attributes.get("Ff").as_int();
+    field.quadding = attributes.get("Q").as_int();
+    field.max_len = attributes.get("MaxLen").as_int();
+    const PdfObject& type = attributes.get("FT");
+    if (type.is_name("Tx")) {
+        field.kind = Field::Kind::Text;
+    } else if (type.is_name("Ch")) {
+        field.kind = Field::Kind::Choice;
+    } else if (type.is_name("Btn") && !(field.flags & FLAG_PUSHBUTTON)) {
+        field.kind = field.flags & FLAG_RADIO ? Field::Kind::Radio : Field::Kind::CheckBox;
+    } else {
+        return true;
+    }
+    for (const auto& option : document->resolve(attributes.get("Opt")).as_array()) {
+        PdfObject entry = document->resolve(option);
+        const PdfArray& pair = entry.as_array();
+        std::string exported = text_string_to_utf8((pair.size() == 2 ? document->resolve(pair[0]) : entry).as_string());
+        std::string shown = pair.size() == 2 ? text_string_to_utf8(document->resolve(pair[1]).as_string()) : exported;
+        field.options.emplace_back(exported, shown);
+    }
+
+    // The font operator of /DA: "0 g /Helv 0 Tf" -> "0 g ", "/Helv", 0, ""
+    const std::string& da = attributes.get("DA").as_string();
+    Lexer lexer(da.data(), da.size());
+    Token token;
+    Token font_token;
+    Token size_token;
+    std::string font_key;
+    while (lexer.next(&token)) {
+        if (token.type == TokenType::Keyword && token.text == "Tf" && font_token.type == TokenType::Name &&
+            (size_token.type == TokenType::Integer || size_token.type == TokenType::Real)) {
+            std::string raw = da.substr(font_token.offset, size_token.offset - font_token.offset);
+            field.da_head = da.substr(0, font_token.offset);
+            field.da_tail = da.substr(lexer.position());
+            field.font_name = raw.substr(0, raw.find_last_not_of(" \t\r\n") + 1);
+            field.font_size = size_token.type == TokenType::Integer ? (double)size_token.integer : size_token.real;
+            font_key = std::string(font_token.text);
+        }
+        font_token = size_token;
+        size_token = token;
+    }
+
+    for (const auto& kid : widgets) {
+        if (!kid.is_ref()) {
+            continue;
+        }
+        Widget widget;
+        widget.ref = kid.as_ref();
+        widget.dict = widget.ref == field.ref ? dict : document->resolve(kid).as_dict();
+        const PdfArray& rect = document->lookup(widget.dict, "Rect").as_array();
+        if (rect.size() != 4) {
+            continue;
+        }
+        widget.width = std::fabs(document->resolve(rect[2]).as_number() - document->resolve(rect[0]).as_number());
+        widget.height = std::fabs(document->resolve(rect[3]).as_number() - document->resolve(rect[1]).as_number());
+        PdfDict mk = document->lookup(widget.dict, "MK").as_dict();
+        int64_t rotation = (mk.get("R").as_int() % 360 + 360) % 360;
+        if (rotation == 90 || rotation == 270) {
+            std::swap(widget.width, widget.height);
+        }
+        double w = widget.width;
+        double h = widget.height;
+        if (rotation == 90) {
+            widget.matrix = PdfObject::array({PdfObject::integer(0), PdfObject::integer(1), PdfObject::integer(-1),
+                                              PdfObject::integer(0), PdfObject::real(h), PdfObject::integer(0)});
+        } else if (rotation == 180) {
+            widget.matrix = PdfObject::array({PdfObject::integer(-1), PdfObject::integer(0), PdfObject::integer(0),
+                                              PdfObject::integer(-1), PdfObject::real(w), PdfObject::real(h)});
+        } else if (rotation == 270) {
+            widget.matrix = PdfObject::array({PdfObject::integer(0), PdfObject::integer(-1), PdfObject::integer(1),
+                                              PdfObject::integer(0), PdfObject::integer(0), PdfObject::real(w)});
+        }
+
+        // Background and border, as viewers draw them from /MK
+        PdfArray background = document->lookup(mk, "BG").as_array();
+        PdfArray border = document->lookup(mk, "BC").as_array();
+        double border_width = 1;
+        PdfDict bs = document->lookup(widget.dict, "BS").as_dict();
+        if (bs.has("W")) {
+            border_width = bs.get("W").as_number(1);
+        } else if (document->lookup(widget.dict, "Border").as_array().size() >= 3) {
+            border_width = document->lookup(widget.dict, "Border").as_array()[2].as_number(1);
+        }
+        std::string fill = color_operator(background, false);
+        if (!fill.empty()) {
+            widget.frame += fill + "0 0 " + number(w) + " " + number(h) + " re f\n";
+        }
+        std::string stroke = color_operator(border, true);
+        if (stroke.empty() || border_width <= 0) {
+            border_width = 0;
+        } else {
+            double half = border_width / 2;
+            widget.frame += stroke + number(border_width) + " w " + number(half) + " " + number(half) + " " +
+                            number(w - border_width) + " " + number(h - border_width) + " re S\n";
+        }
+        widget.inset = border_width + 2;
+
+        PdfDict appearance = document->lookup(widget.dict, "AP").as_dict();
+        for (const auto& state : document->lookup(appearance, "N").as_dict()) {
+            if (state.first != "Off") {
+                widget.on_states.push_back(state.first);
+            }
+        }
+        field.widgets.push_back(std::move(widget));
+    }
+    if (field.widgets.empty()) {
+        return true;
+    }
+
+    // The /DA font from /DR, or else from the fonts of an appearance the template has
+    if (!font_key.empty()) {
+        PdfDict fonts = dr_fonts_;
+        for (size_t i = 0; i < field.widgets.size() && !fonts.has(font_key); i++) {
+            PdfObject normal = document->lookup(document->lookup(field.widgets[i].dict, "AP").as_dict(), "N");
+            fonts = document->lookup(document->lookup(normal.as_dict(), "Resources").as_dict(), "Font").as_dict();
+        }
+        if (fonts.has(font_key)) {
+            field.font = compile_font(font_key, fonts.get(font_key));
+        }
+    }
+    field_index_[field.name].push_back(fields_.size());
+    fields_.push_back(std::move(field));
+    return true;
+}
+
+int FormTemplate::compile_font(const std::string& name, const PdfObject& object) {
+    // Fonts are shared by object; direct ones are compiled for each field
+    std::string id = name + "@" + (object.is_ref() ? std::to_string(object.as_ref().num) : std::string());
+    auto found = font_index_.find(id);
+    if (found != font_index_.end() && object.is_ref()) {
+        return found->second;
+    }
+    PdfDocument* document = base_.document;
+    Font font;
+    font.key = name;
+    font.object = object;
+    PdfDict dict = document->resolve(font.object).as_dict();
+    const PdfObject& subtype = dict.get("Subtype");
+    font.simple = !dict.empty() && !subtype.is_name("Type0") && !subtype.is_name("Type3");
+    if (font.simple) {
+        // Code -> Unicode from the base encoding and /Differences, then reversed
+        PdfObject encoding = document->lookup(dict, "Encoding");
+        const PdfObject& base = encoding.is_dict() ? encoding.as_dict().get("BaseEncoding") : encoding;
+        BaseEncoding table_kind = base.is_name("WinAnsiEncoding")    ? BaseEncoding::WinAnsi
+                                  : base.is_name("MacRomanEncoding") ? BaseEncoding::MacRoman
+                                                                     : BaseEncoding::Standard;
+        const uint16_t* table = base_encoding_table(table_kind);
+        uint32_t unicode[256];
+        for (int code = 0; code < 256; code++) {
+            unicode[code] = table[code];
+        }
+        int64_t code = 0;
+        for (const auto& item : document->lookup(encoding.as_dict(), "Differences").as_array()) {
+            if (item.is_int()) {
+                code = item.as_int();
+            } else if (item.is_name() && code >= 0 && code < 256) {
+                unicode[code++] = glyph_name_to_unicode(item.as_name());
+            }
+        }
+        for (int c = 255; c > 0; c--) {
+            if (unicode[c]) {
+                font.codes[unicode[c]] = (uint8_t)c;  // lowest code wins
+            }
+        }
+
+        std::string base_font = document->lookup(dict, "BaseFont").as_name();
+        const int16_t* standard = standard_font_widths(base_font);
+        int64_t first = document->lookup(dict, "FirstChar").as_int();
+        PdfArray widths = document->lookup(dict, "Widths").as_array();
+        for (int c = 0; c < 256; c++) {
+            int64_t index = c - first;
+            if (index >= 0 && index < (int64_t)widths.size()) {
+                font.widths[c] = (float)document->resolve(widths[index]).as_number();
+            } else {
+                font.widths[c] = standard && c >= 32 && c <= 126 ? standard[c - 32] : DEFAULT_WIDTH;
+            }
+        }
+    }
+    int index = (int)fonts_.size();
+    fonts_.push_back(std::move(font));
+    font_index_[id] = index;
+    return index;
+}
+
+std::vector<std::string> FormTemplate::field_names() const {
+    std::vector<std::string> names;
+    for (const auto& field : fields_) {
+        names.push_back(field.name);
+    }
+    return names;
+}
+
+bool FormTemplate::check_names(const FormValues& values, PdfErrorCode* error_code, std::string* error) const {
+    for (const auto& value : values) {
+        if (!field_index_.count(value.first)) {
+            return fail(PdfErrorCode_InvalidParameter, "no fillable field named '" + value.first + "'", error_code,
+                        error);
+        }
+    }
+    return true;
+}
+
+// Appearance stream content for text in a text or choice field widget. False
+// when the font cannot show it.
+bool FormTemplate::draw(const Field& field, const Widget& widget, const std::string& text,
+                        std::string* content) const {
+    if (field.font < 0 || !fonts_[field.font].simple) {
+        return false;
+    }
+    const Font& font = fonts_[field.font];
+    bool multiline = field.kind == Field::Kind::Text && (field.flags & FLAG_MULTILINE);
+    bool password = field.kind == Field::Kind::Text && (field.flags & FLAG_PASSWORD);
+    bool comb = field.kind == Field::Kind::Text && (field.flags & FLAG_COMB) && field.max_len > 0 && !multiline &&
+                !password;
+
+    // Encoded paragraphs: line breaks only count in multiline fields
+    std::vector<std::string> paragraphs(1);
+    std::vector<uint32_t> chars = decode_utf8(text);
+    for (size_t i = 0; i < chars.size(); i++) {
+        uint32_t c = chars[i];
+        if (c == '\r' || c == '\n') {
+            if (c == '\r' && i + 1 < chars.size() && chars[i + 1] == '\n') {
+                i++;
+            }
+            if (multiline) {
+                paragraphs.emplace_back();
+                continue;
+            }
+            c = ' ';
+        }
+        auto code = font.codes.find(password ? '*' : c);
+        if (code == font.codes.end()) {
+            return false;
+        }
+        paragraphs.back() += (char)code->second;
+    }
+    auto units = [&](const std::string& codes) {
+        double total = 0;
+        for (unsigned char c : codes) {
+            total += font.widths[c];
+        }
+        return total;
+    };
+
+    double w = widget.width;
+    double h = widget.height;
+    double inset = widget.inset;
+    double room = std::max(0.0, w - 2 * inset);
+    double size = field.font_size;
+    if (size <= 0) {
+        size = multiline ? AUTO_SIZE : (h - 2 * inset) / LEADING;
+        if (!multiline && units(paragraphs[0]) > 0) {
+            size = std::min(size, room * 1000 / units(paragraphs[0]));
+        }
+        size = std::max(size, MIN_AUTO_SIZE);
+    }
+
+    // Lines of (x, y, codes)
+    std::vector<std::pair<std::pair<double, double>, std::string>> lines;
+    auto place = [&](const std::string& codes, double y) {
+        double width = units(codes) * size / 1000;
+        double x = field.quadding == 1 ? (w - width) / 2 : field.quadding == 2 ? w - inset - width : inset;
+        lines.push_back({{x, y}, codes});
+    };
+    if (comb) {
+        double cell = w / (double)field.max_len;
+        double y = (h - size) / 2 + 0.22 * size;
+        const std::string& codes = paragraphs[0];
+        for (size_t i = 0; i < codes.size() && i < (size_t)field.max_len; i++) {
+            double width = font.widths[(unsigned char)codes[i]] * size / 1000;
+            lines.push_back({{cell * (double)i + (cell - width) / 2, y}, codes.substr(i, 1)});
+        }
+    } else if (!multiline) {
+        place(paragraphs[0], (h - size) / 2 + 0.22 * size);
+    } else {
+        // Greedy word wrap; words wider than the field are broken anywhere
+        double y = h - inset - 0.9 * size;
+        double limit = room * 1000 / size;
+        for (const auto& paragraph : paragraphs) {
+            std::string line;
+            size_t i = 0;
+            do {
+                size_t end = paragraph.find(' ', i);
+                end = end == std::string::npos ? paragraph.size() : end;
+                std::string word = paragraph.substr(i, end - i);
+                std::string joined = line.empty() ? word : line + " " + word;
+                if (units(joined) <= limit || joined.empty()) {
+                    line = joined;
+                } else {
+                    if (!line.empty()) {
+                        place(line, y);
+                        y -= LEADING * size;
+                    }
+                    line.clear();
+                    for (char c : word) {
+                        if (!line.empty() && units(line + c) > limit) {
+                            place(line, y);
+                            y -= LEADING * size;
+                            line.clear();
+                        }
+                        line += c;
+                    }
+                }
+                i = end + 1;
+            } while (i <= paragraph.size());
+            place(line, y);
+            y -= LEADING * size;
+        }
+    }
+
+    std::string& out = *content;
+    out = "/Tx BMC\nq\n" + widget.frame;
+    out += number(inset) + " " + number(inset) + " " + number(room) + " " + number(std::max(0.0, h - 2 * inset)) +
+           " re W n\nBT\n";
+    out += field.da_head + field.font_name + " " + number(size) + " Tf" + field.da_tail + "\n";
+    for (const auto& line : lines) {
+        if (!line.second.empty()) {
+            out += "1 0 0 1 " + number(line.first.first) + " " + number(line.first.second) + " Tm " +
+                   hex_string(line.second) + " Tj\n";
+        }
+    }
+    out += "ET\nQ\nEMC\n";
+    return true;
+}
+
+bool FormTemplate::fill(const FormValues& values, const std::string& output, PdfErrorCode* error_code,
+                        std::string* error) const {
+    // New versions of the fields and widgets by object number (a field may be its own widget),
+    // and new appearance streams
+    std::map<uint32_t, std::pair<ObjectRef, PdfDict>> changed;
+    auto version = [&](ObjectRef ref, const PdfDict& dict) -> PdfDict& {
+        auto found = changed.find(ref.num);
+        if (found == changed.end()) {
+            found = changed.emplace(ref.num, std::make_pair(ref, dict)).first;
+        }
+        return found->second.second;
+    };
+    std::vector<PendingObject> batch;
+    uint32_t size = base_.size;
+    bool need_appearances = false;
+
+    for (const auto& value : values) {
+        auto found = field_index_.find(value.first);
+        if (found == field_index_.end()) {
+            return fail(PdfErrorCode_InvalidParameter, "no fillable field named '" + value.first + "'", error_code,
+                        error);
+        }
+        if (value.second.empty()) {
+            continue;
+        }
+        for (size_t index : found->second) {
+            const Field& field = fields_[index];
+
+            if (field.kind == Field::Kind::Text || field.kind == Field::Kind::Choice) {
+                std::string exported = value.second;
+                std::string shown = value.second;
+                for (const auto& option : field.options) {
+                    if (option.first == value.second || option.second == value.second) {
+                        exported = option.first;
+                        shown = option.second;
+                        break;
+                    }
+                }
+                PdfDict& dict = version(field.ref, field.dict);
+                dict.set("V", PdfObject::string(utf8_to_text_string(exported)));
+                dict.erase("I");
+                for (const auto& widget : field.widgets) {
+                    PdfDict& widget_dict = version(widget.ref, widget.dict);
+                    std::string content;
+                    if (!draw(field, widget, shown, &content)) {
+                        widget_dict.erase("AP");
+                        need_appearances = true;
+                        continue;
+                    }
+                    PdfDict fonts;
+                    fonts.set(fonts_[field.font].key, fonts_[field.font].object);
+                    PdfDict resources;
+                    resources.set("Font", PdfObject::dict(std::move(fonts)));
+                    PdfDict stream;
+                    stream.set("Type", PdfObject::name("XObject"));
+                    stream.set("Subtype", PdfObject::name("Form"));
+                    PdfArray box = {PdfObject::integer(0), PdfObject::integer(0), PdfObject::real(widget.width),
+                                    PdfObject::real(widget.height)};
+                    stream.set("BBox", PdfObject::array(std::move(box)));
+                    if (!widget.matrix.is_null()) {
+                        stream.set("Matrix", widget.matrix);
+                    }
+                    stream.set("Resources", PdfObject::dict(std::move(resources)));
+                    PendingObject pending;
+                    pending.ref = ObjectRef{size++, 0};
+                    pending.object = PdfObject::stream(std::move(stream), std::move(content));
+                    PdfDict appearance;
+                    appearance.set("N", PdfObject::reference(pending.ref));
+                    widget_dict.set("AP", PdfObject::dict(std::move(appearance)));
+                    batch.push_back(std::move(pending));
+                }
+                continue;
+            }
+
+            // Buttons: the value names a state (or an /Opt export value, by widget), or switches a check box
+            std::string state;
+            for (size_t i = 0; i < field.widgets.size() && state.empty(); i++) {
+                const auto& on = field.widgets[i].on_states;
+                if (std::find(on.begin(), on.end(), value.second) != on.end()) {
+                    state = value.second;
+                } else if (i < field.options.size() && field.options[i].first == value.second && !on.empty()) {
+                    state = on[0];
+                }
+            }
+            std::string word = lower(value.second);
+            bool off = word == "0" || word == "false" || word == "no" || word == "off";
+            bool on = word == "1" || word == "true" || word == "yes" || word == "on" || word == "x";
+            if (state.empty() && off) {
+                state = "Off";
+            } else if (state.empty() && on && field.kind == Field::Kind::CheckBox) {
+                for (const auto& widget : field.widgets) {
+                    if (!widget.on_states.empty()) {
+                        state = widget.on_states[0];
+                        break;
+                    }
+                }
+            }
+            if (state.empty()) {
+                return fail(PdfErrorCode_InvalidParameter, "'" + value.second + "' is not a state of " +
+                            kind_name((int)field.kind) + " '" + field.name + "'", error_code, error);
+            }
+            version(field.ref, field.dict).set("V", PdfObject::name(state));
+            for (const auto& widget : field.widgets) {
+                const auto& on = widget.on_states;
+                bool shows = std::find(on.begin(), on.end(), state) != on.end();
+                version(widget.ref, widget.dict).set("AS", PdfObject::name(shows ? state : "Off"));
+            }
+        }
+    }
+
+    if (need_appearances && !acroform_.get("NeedAppearances").as_bool()) {
+        PdfDict acroform = acroform_;
+        acroform.set("NeedAppearances", PdfObject::boolean(true));
+        if (acroform_direct_) {
+            PdfDict catalog = base_.document->catalog();
+            catalog.set("AcroForm", PdfObject::dict(std::move(acroform)));
+            acroform = std::move(catalog);
+        }
+        version(acroform_ref_, acroform) = acroform;
+    }
+    for (auto& object : changed) {
+        PendingObject pending;
+        pending.ref = object.second.first;
+        pending.object = PdfObject::dict(std::move(object.second.second));
+        batch.push_back(std::move(pending));
+    }
+    serialize_objects(*base_.document, base_.document->security(), Renumbering(), 1, &batch);
+    return write_update(base_.document->data(), update_tail(base_, batch, size), output, error_code, error);
+}
+
+bool fill_forms(const std::string& template_path, const std::vector<FormValues>& rows,
+                const std::string& output_pattern, unsigned threads, std::vector<std::string>* outputs,
+                PdfErrorCode* error_code, std::string* error) {
+    if (rows.empty()) {
+        return fail(PdfErrorCode_InvalidParameter, "no rows to fill", error_code, error);
+    }
+    std::vector<std::string> paths;
+    std::unordered_map<std::string, size_t> rows_by_path;
+    for (size_t i = 0; i < rows.size(); i++) {
+        paths.push_back(form_output_path(output_pattern, i + 1, rows[i]));
+        auto inserted = rows_by_path.emplace(paths.back(), i);
+        if (!inserted.second) {
+            return fail(PdfErrorCode_InvalidParameter, "rows " + std::to_string(inserted.first->second + 1) +
+                        " and " + std::to_string(i + 1) + " both write " + paths.back(), error_code, error);
+        }
+    }
+
+    FormTemplate form;
+    if (!form.open(template_path, paths[0] + ".repaired", error_code, error)) {
+        return false;
+    }
+    for (size_t i = 0; i < rows.size(); i++) {
+        if (!form.check_names(rows[i], error_code, error)) {
+            *error = "row " + std::to_string(i + 1) + ": " + *error;
+            return false;
+        }
+    }
+
+    threads = threads ? threads : std::max(1u, std::thread::hardware_concurrency());
+    std::vector<PdfErrorCode> codes(rows.size(), PdfErrorCode_Success);
+    std::vector<std::string> errors(rows.size());
+    run_parallel(rows.size(), threads, [&](size_t i) { form.fill(rows[i], paths[i], &codes[i], &errors[i]); });
+    *error_code = PdfErrorCode_Success;
+    for (size_t i = 0; i < rows.size(); i++) {
+        if (codes[i] != PdfErrorCode_Success && *error_code == PdfErrorCode_Success) {
+            fail(codes[i], "row " + std::to_string(i + 1) + ": " + errors[i], error_code, error);
+        } else if (codes[i] == PdfErrorCode_Success && outputs) {
+            outputs->push_back(paths[i]);
+        }
+    }
+    return *error_code == PdfErrorCode_Success;
+}
+
+} // namespace spdf
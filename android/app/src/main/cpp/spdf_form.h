@@ -0,0 +1,108 @@
+#ifndef SPDF_FORM_H
+#define SPDF_FORM_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+#include "spdf_edit.h"
+#include "spdfcore.h"
+
+namespace spdf {
+
+// Values for one filled copy of a form: fully qualified field name ("a.b.c")
+// and value. Text and choice fields take text (UTF-8); check boxes and radio
+// buttons take the name of a state or export value, and check boxes also
+// "1"/"0", "true"/"false", "yes"/"no", "on"/"off". Empty values leave the
+// field as the template has it.
+using FormValues = std::vector<std::pair<std::string, std::string>>;
+
+// Parses CSV data (RFC 4180: comma-separated, double quotes around values
+// with commas, quotes or line breaks) whose first record names the fields
+// into one FormValues per further record. Blank lines are skipped.
+bool parse_form_data(const std::string& csv, std::vector<FormValues>* rows, std::string* error);
+
+// Output path for row (1-based) of rows: "{row}" in pattern is replaced by the
+// row number and "{Field name}" by that field's value in the row, with '/'
+// and control characters replaced by '_'
+std::string form_output_path(const std::string& pattern, size_t row, const FormValues& values);
+
+// An AcroForm template parsed once for filling many copies of it. open()
+// walks the field tree and compiles each fillable field (text, choice, check
+// box, radio button) to the objects a value changes: the field, its widget
+// annotations, and the font and layout its appearance is drawn with.
+// fill() then only builds those objects for the values given and writes
+// them as an incremental update after the template's bytes, which are
+// copied as they are. Push buttons and signature fields are not fillable.
+//
+// Text and choice values get a new appearance stream (single line, comb or
+// multiline, aligned by /Q, in the font and colour of the field's /DA; size
+// 0 fits the text to the widget). Characters the font cannot show, or a
+// composite font, leave the appearance to the viewer: the widget's /AP is
+// dropped and /NeedAppearances set. Check boxes and radio buttons switch
+// between the appearance states the template already has.
+//
+// Encrypted templates must open with the empty password; new objects are
+// encrypted with its key. Damaged templates are rewritten from the recovery
+// scan first.
+class FormTemplate {
+public:
+    FormTemplate();
+    ~FormTemplate();
+    FormTemplate(const FormTemplate&) = delete;
+    FormTemplate& operator=(const FormTemplate&) = delete;
+
+    // A damaged template is rewritten through scratch, a path that is removed
+    // again. Fails with PdfErrorCode_InvalidParameter when the document has no
+    // fillable fields.
+    bool open(const std::string& path, const std::string& scratch, PdfErrorCode* error_code, std::string* error);
+
+    // Fully qualified names of the fillable fields, in the order of the form
+    std::vector<std::string> field_names() const;
+
+    // Fails with PdfErrorCode_InvalidParameter for names that are not fillable fields
+    bool check_names(const FormValues& values, PdfErrorCode* error_code, std::string* error) const;
+
+    // Writes the template with values filled in to output. Only reads the
+    // compiled template, so copies may be filled on several threads at once.
+    bool fill(const FormValues& values, const std::string& output, PdfErrorCode* error_code,
+              std::string* error) const;
+
+private:
+    struct Font;
+    struct Widget;
+    struct Field;
+
+    bool compile_field(const PdfObject& node, const std::string& parent_name, const PdfDict& inherited, int depth,
+                       std::vector<uint32_t>* seen);
+    int compile_font(const std::string& name, const PdfObject& object);
+    bool draw(const Field& field, const Widget& widget, const std::string& text, std::string* content) const;
+
+    UpdateBase base_;
+    PdfDict dr_fonts_;          // /DR /Font of the AcroForm
+    PdfDict acroform_;          // the AcroForm dictionary
+    ObjectRef acroform_ref_;    // its object, or the catalog's when it is direct
+    bool acroform_direct_ = false;
+    std::vector<Font> fonts_;
+    std::unordered_map<std::string, int> font_index_;  // font name and object number -> fonts_
+    std::vector<Field> fields_;
+    // name -> fields_; files may have several fields of one name, filled alike
+    std::unordered_map<std::string, std::vector<size_t>> field_index_;
+};
+
+// Fills template_path once per row on up to threads threads (0: every
+// core), writing row i to form_output_path(output_pattern, i + 1, rows[i]).
+// The template is parsed once; each copy costs its template bytes plus the
+// changed objects, so the run is bound by the storage rather than the CPU.
+// Outputs must be distinct. *outputs (when given) receives the paths written;
+// when rows fail the others are still written and the first failure is
+// reported.
+bool fill_forms(const std::string& template_path, const std::vector<FormValues>& rows,
+                const std::string& output_pattern, unsigned threads, std::vector<std::string>* outputs,
+                PdfErrorCode* error_code, std::string* error);
+
+} // namespace spdf
+
+#endif // SPDF_FORM_H
@@ -0,0 +1,197 @@
+#ifndef SPDF_HASH_H
+#define SPDF_HASH_H
+
+#include <cstdint>
+#include <cstring>
+#include <string>
+
+namespace spdf {
+
+// Streaming XXH64 (non-cryptographic). Used for cache keys and fingerprints,
+// where speed matters and inputs are not adversarial.
+class Xxh64 {
+public:
+    explicit Xxh64(uint64_t seed = 0) { reset(seed); }
+
+    void reset(uint64_t seed) {
+        seed_ = seed;
+        acc_[0] = seed + P1 + P2;
+        acc_[1] = seed + P2;
+        acc_[2] = seed;
+        acc_[3] = seed - P1;
+        total_ = 0;
+        buffered_ = 0;
+    }
+
+    void update(const void* data, size_t size) {
+        const uint8_t* p = (const uint8_t*)data;
+        total_ += size;
+        if (buffered_ + size < 32) {
+            memcpy(buffer_ + buffered_, p, size);
+            buffered_ += size;
+            return;
+        }
+        if (buffered_ > 0) {
+            size_t fill = 32 - buffered_;
+            memcpy(buffer_ + buffered_, p, fill);
+            consume(buffer_);
+            p += fill;
+            size -= fill;
+            buffered_ = 0;
+        }
+        while (size >= 32) {
+            consume(p);
+            p += 32;
+            size -= 32;
+        }
+        memcpy(buffer_, p, size);
+        buffered_ = size;
+    }
+
+    void update(const std::string& data) { update(data.data(), data.size()); }
+
+    template <typename T>
+    void update_value(const T& value) {
+        update(&value, sizeof(value));
+    }
+
+    uint64_t digest() const {
+        uint64_t h;
+        if (total_ >= 32) {
+            h = rotl(acc_[0], 1) + rotl(acc_[1], 7) + rotl(acc_[2], 12) + rotl(acc_[3], 18);
+            for (int i = 0; i < 4; i++) {
+                h = (h ^ round(0, acc_[i])) * P1 + P4;
+            }
+        } else {
+            h = seed_ + P5;
+        }
+        h += total_;
+
+        const uint8_t* p = buffer_;
+        size_t remaining = buffered_;
+        while (remaining >= 8) {
+            h ^= round(0, read64(p));
+            h = rotl(h, 27) * P1 + P4;
+            p += 8;
+            remaining -= 8;
+        }
+        if (remaining >= 4) {
+            h ^= (uint64_t)read32(p) * P1;
+            h = rotl(h, 23) * P2 + P3;
+            p += 4;
+            remaining -= 4;
+        }
+        while (remaining > 0) {
+            h ^= (*p++) * P5;
+            h = rotl(h, 11) * P1;
+            remaining--;
+        }
+
+        h ^= h >> 33;
+        h *= P2;
+        h ^= h >> 29;
+        h *= P3;
+        h ^= h >> 32;
+        return h;
+    }
+
+    static uint64_t hash(const void* data, size_t size, uint64_t seed = 0) {
+        Xxh64 hasher(seed);
+        hasher.update(data, size);
+        return hasher.digest();
+    }
+
+private:
+    static constexpr uint64_t P1 = 0x9E3779B185EBCA87ULL;
+    static constexpr uint64_t P2 = 0xC2B2AE3D27D4EB4FULL;
+    static constexpr uint64_t P3 = 0x165667B19E3779F9ULL;
+    static constexpr uint64_t P4 = 0x85EBCA77C2B2AE63ULL;
+    static constexpr uint64_t P5 = 0x27D4EB2F165667C5ULL;
+
+    static uint64_t rotl(uint64_t x, int r) { return (x << r) | (x >> (64 - r)); }
+    static uint64_t read64(const uint8_t* p) {
+        uint64_t v;
+        memcpy(&v, p, 8);
+        return v;
+    }
+    static uint32_t read32(const uint8_t* p) {
+        uint32_t v;
+        memcpy(&v, p, 4);
+        return v;
+    }
+    static uint64_t round(uint64_t acc, uint64_t input) {
+        acc += input * P2;
+        acc = rotl(acc, 31);
+        return acc * P1;
+    }
+
+    void consume(const uint8_t* block) {
+        for (int i = 0; i < 4; i++) {
+            acc_[i] = round(acc_[i], read64(block + i * 8));
+        }
+    }
+
+    uint64_t seed_;
+    uint64_t acc_[4];
+    uint64_t total_;
+    uint8_t buffer_[32];
+    size_t buffered_;
+};
+
+// 128-bit digest from two independently seeded XXH64 streams
+struct Digest128 {
+    uint64_t high = 0;
+    uint64_t low = 0;
+
+    bool operator==(const Digest128& other) const { return high == other.high && low == other.low; }
+    bool operator!=(const Digest128& other) const { return !(*this == other); }
+    bool operator<(const Digest128& other) const {
+        return high != other.high ? high < other.high : low < other.low;
+    }
+
+    std::string hex() const {
+        static const char digits[] = "0123456789abcdef";
+        std::string out(32, '0');
+        for (int i = 0; i < 16; i++) {
+            out[15 - i] = digits[(high >> (i * 4)) & 0xF];
+            out[31 - i] = digits[(low >> (i * 4)) & 0xF];
+        }
+        return out;
+    }
+};
+
+class Hasher128 {
+public:
+    Hasher128() : high_(0x5350444643414348ULL), low_(0x6A09E667F3BCC908ULL) {}
+
+    void update(const void* data, size_t size) {
+        high_.update(data, size);
+        low_.update(data, size);
+    }
+
+    void update(const std::string& data) {
+        // Length prefix keeps ("ab","c") and ("a","bc") apart
+        update_value((uint64_t)data.size());
+        update(data.data(), data.size());
+    }
+
+    template <typename T>
+    void update_value(const T& value) {
+        update(&value, sizeof(value));
+    }
+
+    Digest128 digest() const {
+        Digest128 d;
+        d.high = high_.digest();
+        d.low = low_.digest();
+        return d;
+    }
+
+private:
+    Xxh64 high_;
+    Xxh64 low_;
+};
+
+} // namespace spdf
+
+#endif // SPDF_HASH_H
@@ -0,0 +1,677 @@
+#include "spdf_image.h"
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <vector>
+#include "spdf_jpeg.h"
+#include "spdf_simd.h"
+#include "spdf_writer.h"
+
+#if defined(__x86_64__) || (defined(__i386__) && defined(__SSE2__))
+#include <immintrin.h>
+#define SPDF_SIMD_X86 1
+#elif defined(__aarch64__)
+#include <arm_neon.h>
+#define SPDF_SIMD_NEON 1
+#endif
+
+namespace spdf {
+
+// Output rows resampled per work item
+static const int BAND_ROWS = 16;
+// Lanczos lobes on each side of the centre
+static const double LANCZOS_LOBES = 3;
+// SSIM stabilisers for 8-bit samples: (0.01 * 255)^2 and (0.03 * 255)^2
+static const double SSIM_C1 = 6.5025;
+static const double SSIM_C2 = 58.5225;
+// Spread between the channels of a pixel above which it counts as coloured;
+// JPEG chroma noise and the tint of yellowed paper stay below it
+static const int CHROMA_LIMIT = 48;
+// Two-toned means at most this share of coloured pixels (a stamp or a
+// highlighter mark is more) and of pixels far from both the ink and the
+// paper level, ink and paper at least this far apart and no more than this
+// share of ink
+static const double BILEVEL_MAX_COLOURED = 0.002;
+static const double BILEVEL_MAX_MIDTONES = 0.06;
+static const double BILEVEL_MIN_CONTRAST = 96;
+static const double BILEVEL_MAX_INK = 0.4;
+
+namespace {
+
+// Source taps of every output pixel along one axis
+struct FilterTaps {
+    std::vector<int> start;       // first source pixel
+    std::vector<int> count;
+    std::vector<size_t> offset;   // into weights
+    std::vector<float> weights;   // normalised to sum 1
+};
+
+} // namespace
+
+// ---------------------------------------------------------------------------
+// Scalar
+
+// acc[i] += weight * row[i]
+static void scalar_accumulate(float* acc, const uint8_t* row, float weight, size_t n) {
+    for (size_t i = 0; i < n; i++) {
+        acc[i] += weight * (float)row[i];
+    }
+}
+
+static float scalar_dot(const float* a, const float* b, size_t n) {
+    float sum = 0;
+    for (size_t i = 0; i < n; i++) {
+        sum += a[i] * b[i];
+    }
+    return sum;
+}
+
+// luma[i] of n RGB pixels; returns how many of them are coloured
+static size_t scalar_luma(const uint8_t* rgb, size_t n, uint8_t* luma) {
+    size_t coloured = 0;
+    for (size_t i = 0; i < n; i++, rgb += 3) {
+        luma[i] = (uint8_t)((77 * rgb[0] + 150 * rgb[1] + 29 * rgb[2] + 128) >> 8);
+        int high = std::max(rgb[0], std::max(rgb[1], rgb[2]));
+        int low = std::min(rgb[0], std::min(rgb[1], rgb[2]));
+        coloured += high - low > CHROMA_LIMIT;
+    }
+    return coloured;
+}
+
+#if SPDF_SIMD_X86
+
+// ---------------------------------------------------------------------------
+// SSE2
+
+static void sse2_accumulate(float* acc, const uint8_t* row, float weight, size_t n) {
+    const __m128i zero = _mm_setzero_si128();
+    const __m128 w = _mm_set1_ps(weight);
+    size_t i = 0;
+    for (; i + 16 <= n; i += 16) {
+        __m128i bytes = _mm_loadu_si128((const __m128i*)(row + i));
+        __m128i low = _mm_unpacklo_epi8(bytes, zero);
+        __m128i high = _mm_unpackhi_epi8(bytes, zero);
+        __m128 f0 = _mm_cvtepi32_ps(_mm_unpacklo_epi16(low, zero));
+        __m128 f1 = _mm_cvtepi32_ps(_mm_unpackhi_epi16(low, zero));
+        __m128 f2 = _mm_cvtepi32_ps(_mm_unpacklo_epi16(high, zero));
+        __m128 f3 = _mm_cvtepi32_ps(_mm_unpackhi_epi16(high, zero));
+        _mm_storeu_ps(acc + i, _mm_add_ps(_mm_loadu_ps(acc + i), _mm_mul_ps(f0, w)));
+        _mm_storeu_ps(acc + i + 4, _mm_add_ps(_mm_loadu_ps(acc + i + 4), _mm_mul_ps(f1, w)));
+        _mm_storeu_ps(acc + i + 8, _mm_add_ps(_mm_loadu_ps(acc + i + 8), _mm_mul_ps(f2, w)));
+        _mm_storeu_ps(acc + i + 12, _mm_add_ps(_mm_loadu_ps(acc + i + 12), _mm_mul_ps(f3, w)));
+    }
+    scalar_accumulate(acc + i, row + i, weight, n - i);
+}
+
+static float sse2_dot(const float* a, const float* b, size_t n) {
+    __m128 sum = _mm_setzero_ps();
+    size_t i = 0;
+    for (; i + 4 <= n; i += 4) {
+        sum = _mm_add_ps(sum, _mm_mul_ps(_mm_loadu_ps(a + i), _mm_loadu_ps(b + i)));
+    }
+    float lanes[4];
+    _mm_storeu_ps(lanes, sum);
+    return lanes[0] + lanes[1] + lanes[2] + lanes[3] + scalar_dot(a + i, b + i, n - i);
+}
+
+// ---------------------------------------------------------------------------
+// AVX2
+
+#define SPDF_AVX2 __attribute__((target("avx2")))
+
+SPDF_AVX2 static void avx2_accumulate(float* acc, const uint8_t* row, float weight, size_t n) {
+    const __m256 w = _mm256_set1_ps(weight);
+    size_t i = 0;
+    for (; i + 16 <= n; i += 16) {
+        __m256 f0 = _mm256_cvtepi32_ps(_mm256_cvtepu8_epi32(_mm_loadl_epi64((const __m128i*)(row + i))));
+        __m256 f1 = _mm256_cvtepi32_ps(_mm256_cvtepu8_epi32(_mm_loadl_epi64((const __m128i*)(row + i + 8))));
+        _mm256_storeu_ps(acc + i, _mm256_add_ps(_mm256_loadu_ps(acc + i), _mm256_mul_ps(f0, w)));
+        _mm256_storeu_ps(acc + i + 8, _mm256_add_ps(_mm256_loadu_ps(acc + i + 8), _mm256_mul_ps(f1, w)));
+    }
+    scalar_accumulate(acc + i, row + i, weight, n - i);
+}
+
+SPDF_AVX2 static float avx2_dot(const float* a, const float* b, size_t n) {
+    __m256 sum = _mm256_setzero_ps();
+    size_t i = 0;
+    for (; i + 8 <= n; i += 8) {
+        sum = _mm256_add_ps(sum, _mm256_mul_ps(_mm256_loadu_ps(a + i), _mm256_loadu_ps(b + i)));
+    }
+    __m128 half = _mm_add_ps(_mm256_castps256_ps128(sum), _mm256_extractf128_ps(sum, 1));
+    float lanes[4];
+    _mm_storeu_ps(lanes, half);
+    return lanes[0] + lanes[1] + lanes[2] + lanes[3] + scalar_dot(a + i, b + i, n - i);
+}
+
+// 16 pixels at a time: byte shuffles pull each channel out of three 16-byte
+// loads, then luma is summed in 16-bit lanes (at most 255 * 256 + 128)
+SPDF_AVX2 static size_t avx2_luma(const uint8_t* rgb, size_t n, uint8_t* luma) {
+    const __m128i r0 = _mm_setr_epi8(0, 3, 6, 9, 12, 15, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1);
+    const __m128i r1 = _mm_setr_epi8(-1, -1, -1, -1, -1, -1, 2, 5, 8, 11, 14, -1, -1, -1, -1, -1);
+    const __m128i r2 = _mm_setr_epi8(-1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, 1, 4, 7, 10, 13);
+    const __m128i g0 = _mm_setr_epi8(1, 4, 7, 10, 13, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1);
+    const __m128i g1 = _mm_setr_epi8(-1, -1, -1, -1, -1, 0, 3, 6, 9, 12, 15, -1, -1, -1, -1, -1);
+    const __m128i g2 = _mm_setr_epi8(-1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, 2, 5, 8, 11, 14);
+    const __m128i b0 = _mm_setr_epi8(2, 5, 8, 11, 14, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1);
+    const __m128i b1 = _mm_setr_epi8(-1, -1, -1, -1, -1, 1, 4, 7, 10, 13, -1, -1, -1, -1, -1, -1);
+    const __m128i b2 = _mm_setr_epi8(-1, -1, -1, -1, -1, -1, -1, -1, -1, -1, 0, 3, 6, 9, 12, 15);
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i limit = _mm_set1_epi8((char)CHROMA_LIMIT);
+    const __m256i weights_r = _mm256_set1_epi16(77);
+    const __m256i weights_g = _mm256_set1_epi16(150);
+    const __m256i weights_b = _mm256_set1_epi16(29);
+    const __m256i rounding = _mm256_set1_epi16(128);
+    size_t coloured = 0;
+    size_t i = 0;
+    for (; i + 16 <= n; i += 16) {
+        const uint8_t* p = rgb + i * 3;
+        __m128i a = _mm_loadu_si128((const __m128i*)p);
+        __m128i b = _mm_loadu_si128((const __m128i*)(p + 16));
+        __m128i c = _mm_loadu_si128((const __m128i*)(p + 32));
+        __m128i red = _mm_or_si128(_mm_or_si128(_mm_shuffle_epi8(a, r0), _mm_shuffle_epi8(b, r1)),
+                                   _mm_shuffle_epi8(c, r2));
+        __m128i green = _mm_or_si128(_mm_or_si128(_mm_shuffle_epi8(a, g0), _mm_shuffle_epi8(b, g1)),
+                                     _mm_shuffle_epi8(c, g2));
+        __m128i blue = _mm_or_si128(_mm_or_si128(_mm_shuffle_epi8(a, b0), _mm_shuffle_epi8(b, b1)),
+                                    _mm_shuffle_epi8(c, b2));
+        __m256i sum = _mm256_add_epi16(_mm256_mullo_epi16(_mm256_cvtepu8_epi16(red), weights_r),
+                                       _mm256_mullo_epi16(_mm256_cvtepu8_epi16(green), weights_g));
+        sum = _mm256_add_epi16(sum, _mm256_mullo_epi16(_mm256_cvtepu8_epi16(blue), weights_b));
+        sum = _mm256_srli_epi16(_mm256_add_epi16(sum, rounding), 8);
+        __m128i packed = _mm_packus_epi16(_mm256_castsi256_si128(sum), _mm256_extracti128_si256(sum, 1));
+        _mm_storeu_si128((__m128i*)(luma + i), packed);
+
+        __m128i high = _mm_max_epu8(_mm_max_epu8(red, green), blue);
+        __m128i low = _mm_min_epu8(_mm_min_epu8(red, green), blue);
+        __m128i gray = _mm_cmpeq_epi8(_mm_subs_epu8(_mm_subs_epu8(high, low), limit), zero);
+        coloured += 16 - (size_t)__builtin_popcount((unsigned)_mm_movemask_epi8(gray));
+    }
+    return coloured + scalar_luma(rgb + i * 3, n - i, luma + i);
+}
+
+#endif // SPDF_SIMD_X86
+
+#if SPDF_SIMD_NEON
+
+// ---------------------------------------------------------------------------
+// NEON
+
+static void neon_accumulate(float* acc, const uint8_t* row, float weight, size_t n) {
+    size_t i = 0;
+    for (; i + 16 <= n; i += 16) {
+        uint8x16_t bytes = vld1q_u8(row + i);
+        uint16x8_t low = vmovl_u8(vget_low_u8(bytes));
+        uint16x8_t high = vmovl_u8(vget_high_u8(bytes));
+        float32x4_t f0 = vcvtq_f32_u32(vmovl_u16(vget_low_u16(low)));
+        float32x4_t f1 = vcvtq_f32_u32(vmovl_u16(vget_high_u16(low)));
+        float32x4_t f2 = vcvtq_f32_u32(vmovl_u16(vget_low_u16(high)));
+        float32x4_t f3 = vcvtq_f32_u32(vmovl_u16(vget_high_u16(high)));
+        vst1q_f32(acc + i, vmlaq_n_f32(vld1q_f32(acc + i), f0, weight));
+        vst1q_f32(acc + i + 4, vmlaq_n_f32(vld1q_f32(acc + i + 4), f1, weight));
+        vst1q_f32(acc + i + 8, vmlaq_n_f32(vld1q_f32(acc + i + 8), f2, weight));
+        vst1q_f32(acc + i + 12, vmlaq_n_f32(vld1q_f32(acc + i + 12), f3, weight));
+    }
+    scalar_accumulate(acc + i, row + i, weight, n - i);
+}
+
+static float neon_dot(const float* a, const float* b, size_t n) {
+    float32x4_t sum = vdupq_n_f32(0);
+    size_t i = 0;
+    for (; i + 4 <= n; i += 4) {
+        sum = vmlaq_f32(sum, vld1q_f32(a + i), vld1q_f32(b + i));
+    }
+    return vaddvq_f32(sum) + scalar_dot(a + i, b + i, n - i);
+}
+
+// vld3 splits the channels; vrshrn rounds (sum + 128) >> 8
+static size_t neon_luma(const uint8_t* rgb, size_t n, uint8_t* luma) {
+    const uint8x8_t weight_r = vdup_n_u8(77);
+    const uint8x8_t weight_g = vdup_n_u8(150);
+    const uint8x8_t weight_b = vdup_n_u8(29);
+    const uint8x16_t limit = vdupq_n_u8(CHROMA_LIMIT);
+    size_t coloured = 0;
+    size_t i = 0;
+    for (; i + 16 <= n; i += 16) {
+        uint8x16x3_t pixels = vld3q_u8(rgb + i * 3);
+        uint16x8_t low_sum = vmull_u8(vget_low_u8(pixels.val[0]), weight_r);
+        low_sum = vmlal_u8(low_sum, vget_low_u8(pixels.val[1]), weight_g);
+        low_sum = vmlal_u8(low_sum, vget_low_u8(pixels.val[2]), weight_b);
+        uint16x8_t high_sum = vmull_u8(vget_high_u8(pixels.val[0]), weight_r);
+        high_sum = vmlal_u8(high_sum, vget_high_u8(pixels.val[1]), weight_g);
+        high_sum = vmlal_u8(high_sum, vget_high_u8(pixels.val[2]), weight_b);
+        vst1q_u8(luma + i, vcombine_u8(vrshrn_n_u16(low_sum, 8), vrshrn_n_u16(high_sum, 8)));
+
+        uint8x16_t high = vmaxq_u8(vmaxq_u8(pixels.val[0], pixels.val[1]), pixels.val[2]);
+        uint8x16_t low = vminq_u8(vminq_u8(pixels.val[0], pixels.val[1]), pixels.val[2]);
+        uint8x16_t over = vcgtq_u8(vsubq_u8(high, low), limit);
+        coloured += vaddvq_u8(vshrq_n_u8(over, 7));
+    }
+    return coloured + scalar_luma(rgb + i * 3, n - i, luma + i);
+}
+
+#endif // SPDF_SIMD_NEON
+
+// ---------------------------------------------------------------------------
+// Dispatch
+
+namespace {
+
+struct ImageKernels {
+    void (*accumulate)(float*, const uint8_t*, float, size_t);
+    float (*dot)(const float*, const float*, size_t);
+    size_t (*luma)(const uint8_t*, size_t, uint8_t*);
+};
+
+} // namespace
+
+// Follows the level of the character-class scanners, so set_simd_level() switches both
+// SSE2 has no byte shuffle to split RGB with, so its luma stays scalar
+static ImageKernels kernels_for(SimdLevel level) {
+    switch (level) {
+#if SPDF_SIMD_X86
+        case SimdLevel::Sse2:
+            return ImageKernels{sse2_accumulate, sse2_dot, scalar_luma};
+        case SimdLevel::Avx2:
+            return ImageKernels{avx2_accumulate, avx2_dot, avx2_luma};
+#endif
+#if SPDF_SIMD_NEON
+        case SimdLevel::Neon:
+            return ImageKernels{neon_accumulate, neon_dot, neon_luma};
+#endif
+        default:
+            return ImageKernels{scalar_accumulate, scalar_dot, scalar_luma};
+    }
+}
+
+// ---------------------------------------------------------------------------
+// Resampling
+
+static double lanczos(double x) {
+    x = std::fabs(x);
+    if (x < 1e-9) {
+        return 1;
+    }
+    if (x >= LANCZOS_LOBES) {
+        return 0;
+    }
+    double px = M_PI * x;
+    return LANCZOS_LOBES * std::sin(px) * std::sin(px / LANCZOS_LOBES) / (px * px);
+}
+
+static void build_taps(int source, int target, ResampleFilter filter, FilterTaps* taps) {
+    double scale = (double)source / target;
+    // Upsampling interpolates between neighbours; downsampling widens the kernel
+    double width = std::max(scale, 1.0);
+    double support = filter == ResampleFilter::Area ? width / 2 : LANCZOS_LOBES * width;
+    std::vector<double> weights;
+    for (int i = 0; i < target; i++) {
+        double center = (i + 0.5) * scale;
+        int first = std::max(0, (int)std::floor(center - support));
+        int last = std::min(source - 1, (int)std::ceil(center + support));
+        weights.clear();
+        double sum = 0;
+        for (int j = first; j <= last; j++) {
+            double weight;
+            if (filter == ResampleFilter::Area) {
+                double low = std::max<double>(j, center - width / 2);
+                double high = std::min<double>(j + 1, center + width / 2);
+                weight = std::max(0.0, high - low);
+            } else {
+                weight = lanczos((j + 0.5 - center) / width);
+            }
+            weights.push_back(weight);
+            sum += weight;
+        }
+        // Drop the zero taps at either end
+        size_t begin = 0;
+        size_t end = weights.size();
+        while (begin < end && weights[begin] == 0) {
+            begin++;
+        }
+        while (end > begin && weights[end - 1] == 0) {
+            end--;
+        }
+        if (begin == end || sum == 0) {
+            begin = 0;
+            end = 1;
+            weights.assign(1, 1);
+            first = std::min(source - 1, (int)center);
+            sum = 1;
+        }
+        taps->start.push_back(first + (int)begin);
+        taps->count.push_back((int)(end - begin));
+        taps->offset.push_back(taps->weights.size());
+        for (size_t k = begin; k < end; k++) {
+            taps->weights.push_back((float)(weights[k] / sum));
+        }
+    }
+}
+
+static inline uint8_t to_sample(float value) {
+    return (uint8_t)std::min(255.0f, std::max(0.0f, value + 0.5f));
+}
+
+bool resample_bitmap(const Bitmap& source, int width, int height, ResampleFilter filter, unsigned threads,
+                     Bitmap* output) {
+    int components = source.components;
+    if (width < 1 || height < 1 || source.width < 1 || source.height < 1 || components < 1 ||
+        source.pixels.size() < source.stride() * (size_t)source.height) {
+        return false;
+    }
+    FilterTaps rows;
+    FilterTaps columns;
+    build_taps(source.height, height, filter, &rows);
+    build_taps(source.width, width, filter, &columns);
+    output->width = width;
+    output->height = height;
+    output->components = components;
+    output->pixels.resize(output->stride() * (size_t)height);
+
+    ImageKernels kernels = kernels_for(simd_level());
+    size_t source_width = (size_t)source.width;
+    size_t span = source.stride();
+    size_t bands = ((size_t)height + BAND_ROWS - 1) / BAND_ROWS;
+    run_parallel(bands, threads, [&](size_t band) {
+        std::vector<float> row(span);
+        std::vector<float> planes(components > 1 ? span : 0);
+        int last = std::min(height, (int)(band + 1) * BAND_ROWS);
+        for (int y = (int)band * BAND_ROWS; y < last; y++) {
+            // Vertical pass: a weighted sum of whole interleaved source rows
+            std::fill(row.begin(), row.end(), 0.0f);
+            const float* weights = rows.weights.data() + rows.offset[(size_t)y];
+            for (int k = 0; k < rows.count[(size_t)y]; k++) {
+                const uint8_t* line = source.pixels.data() + (size_t)(rows.start[(size_t)y] + k) * span;
+                kernels.accumulate(row.data(), line, weights[k], span);
+            }
+            // Horizontal pass on one plane per component, so every tap run is contiguous
+            const float* plane = row.data();
+            if (components > 1) {
+                for (size_t x = 0; x < source_width; x++) {
+                    for (int c = 0; c < components; c++) {
+                        planes[(size_t)c * source_width + x] = row[x * (size_t)components + (size_t)c];
+                    }
+                }
+                plane = planes.data();
+            }
+            uint8_t* out = output->pixels.data() + (size_t)y * output->stride();
+            for (int x = 0; x < width; x++) {
+                const float* taps = columns.weights.data() + columns.offset[(size_t)x];
+                size_t start = (size_t)columns.start[(size_t)x];
+                size_t count = (size_t)columns.count[(size_t)x];
+                for (int c = 0; c < components; c++) {
+                    float value = kernels.dot(plane + (size_t)c * source_width + start, taps, count);
+                    out[(size_t)x * (size_t)components + (size_t)c] = to_sample(value);
+                }
+            }
+        }
+    });
+    return true;
+}
+
+// ---------------------------------------------------------------------------
+// Bilevel detection
+
+void luma_histogram(const Bitmap& bitmap, unsigned threads, LumaHistogram* histogram) {
+    *histogram = LumaHistogram();
+    if (bitmap.width < 1 || bitmap.height < 1 || (bitmap.components != 1 && bitmap.components != 3) ||
+        bitmap.pixels.size() < bitmap.stride() * (size_t)bitmap.height) {
+        return;
+    }
+    ImageKernels kernels = kernels_for(simd_level());
+    size_t width = (size_t)bitmap.width;
+    size_t bands = ((size_t)bitmap.height + BAND_ROWS - 1) / BAND_ROWS;
+    std::vector<LumaHistogram> partial(bands);
+    run_parallel(bands, threads, [&](size_t band) {
+        LumaHistogram& counts = partial[band];
+        std::vector<uint8_t> row(bitmap.components == 3 ? width : 0);
+        int last = std::min(bitmap.height, (int)(band + 1) * BAND_ROWS);
+        for (int y = (int)band * BAND_ROWS; y < last; y++) {
+            const uint8_t* line = bitmap.pixels.data() + (size_t)y * bitmap.stride();
+            if (bitmap.components == 3) {
+                counts.coloured += kernels.luma(line, width, row.data());
+                line = row.data();
+            }
+            for (size_t x = 0; x < width; x++) {
+                counts.counts[line[x]]++;
+            }
+        }
+    });
+    for (const auto& counts : partial) {
+        for (int i = 0; i < 256; i++) {
+            histogram->counts[i] += counts.counts[i];
+        }
+        histogram->coloured += counts.coloured;
+    }
+    histogram->pixels = (uint64_t)bitmap.width * (uint64_t)bitmap.height;
+}
+
+int bilevel_threshold(const LumaHistogram& histogram) {
+    double total = (double)histogram.pixels;
+    if (total == 0 || histogram.coloured > total * BILEVEL_MAX_COLOURED) {
+        return -1;
+    }
+    // Otsu: the cut that maximises the variance between the two classes. Every
+    // cut through an empty stretch between ink and paper scores the same;
+    // the middle one keeps faint strokes and clean paper alike
+    double weighted_total = 0;
+    for (int i = 0; i < 256; i++) {
+        weighted_total += (double)i * (double)histogram.counts[i];
+    }
+    int threshold = -1;
+    int last_best = -1;
+    double best = -1;
+    double below = 0;
+    double weighted_below = 0;
+    for (int t = 0; t < 255; t++) {
+        below += (double)histogram.counts[t];
+        weighted_below += (double)t * (double)histogram.counts[t];
+        double above = total - below;
+        if (below == 0 || above == 0) {
+            continue;
+        }
+        double difference = weighted_below / below - (weighted_total - weighted_below) / above;
+        double variance = below * above * difference * difference;
+        if (variance > best) {
+            best = variance;
+            threshold = t;
+            last_best = t;
+        } else if (variance == best && last_best == t - 1) {
+            last_best = t;
+        }
+    }
+    if (threshold < 0) {
+        return -1;
+    }
+    threshold = (threshold + last_best) / 2;
+    double ink = 0;
+    double weighted_ink = 0;
+    for (int i = 0; i <= threshold; i++) {
+        ink += (double)histogram.counts[i];
+        weighted_ink += (double)i * (double)histogram.counts[i];
+    }
+    double ink_level = weighted_ink / ink;
+    double paper_level = (weighted_total - weighted_ink) / (total - ink);
+    double contrast = paper_level - ink_level;
+    if (contrast < BILEVEL_MIN_CONTRAST || ink > total * BILEVEL_MAX_INK) {
+        return -1;
+    }
+    // Antialiased and blurred edges sit between the levels; photographs fill the whole range
+    double midtones = 0;
+    for (int i = (int)std::ceil(ink_level + contrast / 4); i <= (int)(paper_level - contrast / 4); i++) {
+        midtones += (double)histogram.counts[i];
+    }
+    return midtones > total * BILEVEL_MAX_MIDTONES ? -1 : threshold;
+}
+
+bool binarize_bitmap(const Bitmap& source, int width, int height, int threshold, unsigned threads,
+                     std::vector<uint8_t>* bits) {
+    if (width < 1 || height < 1 || source.width < 1 || source.height < 1 ||
+        (source.components != 1 && source.components != 3) ||
+        source.pixels.size() < source.stride() * (size_t)source.height) {
+        return false;
+    }
+    ImageKernels kernels = kernels_for(simd_level());
+    Bitmap luma;
+    const Bitmap* gray = &source;
+    if (source.components == 3) {
+        luma.width = source.width;
+        luma.height = source.height;
+        luma.components = 1;
+        luma.pixels.resize((size_t)source.width * (size_t)source.height);
+        size_t bands = ((size_t)source.height + BAND_ROWS - 1) / BAND_ROWS;
+        run_parallel(bands, threads, [&](size_t band) {
+            int last = std::min(source.height, (int)(band + 1) * BAND_ROWS);
+            for (int y = (int)band * BAND_ROWS; y < last; y++) {
+                kernels.luma(source.pixels.data() + (size_t)y * source.stride(), (size_t)source.width,
+                             luma.pixels.data() + (size_t)y * (size_t)source.width);
+            }
+        });
+        gray = &luma;
+    }
+    Bitmap resampled;
+    if (width != gray->width || height != gray->height) {
+        if (!resample_bitmap(*gray, width, height, ResampleFilter::Area, threads, &resampled)) {
+            return false;
+        }
+        gray = &resampled;
+    }
+    size_t row_bytes = ((size_t)width + 7) / 8;
+    bits->assign(row_bytes * (size_t)height, 0);
+    size_t bands = ((size_t)height + BAND_ROWS - 1) / BAND_ROWS;
+    run_parallel(bands, threads, [&](size_t band) {
+        int last = std::min(height, (int)(band + 1) * BAND_ROWS);
+        for (int y = (int)band * BAND_ROWS; y < last; y++) {
+            const uint8_t* line = gray->pixels.data() + (size_t)y * (size_t)width;
+            uint8_t* out = bits->data() + (size_t)y * row_bytes;
+            for (int x = 0; x < width; x++) {
+                if (line[x] > threshold) {
+                    out[x >> 3] |= (uint8_t)(0x80 >> (x & 7));
+                }
+            }
+        }
+    });
+    return true;
+}
+
+// ---------------------------------------------------------------------------
+// Similarity
+
+static inline int luma_at(const Bitmap& bitmap, const uint8_t* line, int x) {
+    if (bitmap.components < 3) {
+        return line[(size_t)x * (size_t)bitmap.components];
+    }
+    const uint8_t* rgb = line + (size_t)x * (size_t)bitmap.components;
+    return (77 * rgb[0] + 150 * rgb[1] + 29 * rgb[2] + 128) >> 8;
+}
+
+double bitmap_ssim(const Bitmap& a, const Bitmap& b, unsigned threads) {
+    if (a.width != b.width || a.height != b.height || a.components != b.components || a.width < 1 ||
+        a.height < 1) {
+        return 0;
+    }
+    int window_w = std::min(8, a.width);
+    int window_h = std::min(8, a.height);
+    size_t across = (size_t)(a.width / window_w);
+    size_t down = (size_t)(a.height / window_h);
+    std::vector<double> sums(down);
+    run_parallel(down, threads, [&](size_t wy) {
+        double total = 0;
+        double n = (double)window_w * window_h;
+        for (size_t wx = 0; wx < across; wx++) {
+            int64_t sa = 0, sb = 0, saa = 0, sbb = 0, sab = 0;
+            for (int y = 0; y < window_h; y++) {
+                size_t line = wy * (size_t)window_h + (size_t)y;
+                const uint8_t* la = a.pixels.data() + line * a.stride();
+                const uint8_t* lb = b.pixels.data() + line * b.stride();
+                for (int x = 0; x < window_w; x++) {
+                    int column = (int)wx * window_w + x;
+                    int va = luma_at(a, la, column);
+                    int vb = luma_at(b, lb, column);
+                    sa += va, sb += vb;
+                    saa += va * va, sbb += vb * vb, sab += va * vb;
+                }
+            }
+            double mean_a = sa / n;
+            double mean_b = sb / n;
+            double var_a = saa / n - mean_a * mean_a;
+            double var_b = sbb / n - mean_b * mean_b;
+            double cov = sab / n - mean_a * mean_b;
+            total += ((2 * mean_a * mean_b + SSIM_C1) * (2 * cov + SSIM_C2)) /
+                     ((mean_a * mean_a + mean_b * mean_b + SSIM_C1) * (var_a + var_b + SSIM_C2));
+        }
+        sums[wy] = total;
+    });
+    double total = 0;
+    for (double sum : sums) {
+        total += sum;
+    }
+    return total / (double)(across * down);
+}
+
+// ---------------------------------------------------------------------------
+// Quality search
+
+bool encode_jpeg_to_target(const Bitmap& image, const JpegTarget& target, unsigned threads, JpegResult* result) {
+    auto probe = [&](int quality, JpegResult* out) {
+        Bitmap decoded;
+        std::string error;
+        if (!jpeg_encode(image, quality, threads, &out->data) || !jpeg_decode(out->data, &decoded, &error, threads)) {
+            return false;
+        }
+        out->quality = quality;
+        out->ssim = bitmap_ssim(image, decoded, threads);
+        return true;
+    };
+    int low = std::min(100, std::max(1, target.min_quality));
+    int high = std::min(100, std::max(low, target.max_quality));
+    JpegResult best;
+    if (!probe(high, &best)) {
+        return false;
+    }
+    // SSIM grows with quality: find the lowest quality still meeting the target
+    if (best.ssim >= target.ssim) {
+        while (low < high) {
+            int middle = (low + high) / 2;
+            JpegResult candidate;
+            if (!probe(middle, &candidate)) {
+                return false;
+            }
+            if (candidate.ssim >= target.ssim) {
+                high = middle;
+                best = std::move(candidate);
+            } else {
+                low = middle + 1;
+            }
+        }
+    }
+    // The size budget wins: the highest quality that fits it, or the lowest allowed
+    double budget = target.max_bits_per_pixel * image.width * image.height / 8;
+    if (target.max_bits_per_pixel > 0 && (double)best.data.size() > budget) {
+        int floor = std::min(100, std::max(1, target.min_quality));
+        low = floor;
+        high = best.quality - 1;
+        JpegResult fit;
+        while (low <= high) {
+            int middle = (low + high + 1) / 2;
+            JpegResult candidate;
+            if (!probe(middle, &candidate)) {
+                return false;
+            }
+            if ((double)candidate.data.size() <= budget) {
+                low = middle + 1;
+                fit = std::move(candidate);
+            } else {
+                high = middle - 1;
+            }
+        }
+        if (!fit.data.empty()) {
+            best = std::move(fit);
+        } else if (best.quality != floor && !probe(floor, &best)) {
+            return false;
+        }
+    }
+    *result = std::move(best);
+    return true;
+}
+
+} // namespace spdf
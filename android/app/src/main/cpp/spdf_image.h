@@ -0,0 +1,82 @@
+#ifndef SPDF_IMAGE_H
+#define SPDF_IMAGE_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace spdf {
+
+// 8-bit pixels, rows top to bottom, components interleaved (1 gray, 3 RGB)
+struct Bitmap {
+    int width = 0;
+    int height = 0;
+    int components = 0;
+    std::vector<uint8_t> pixels;
+
+    size_t stride() const { return (size_t)width * (size_t)components; }
+};
+
+enum class ResampleFilter {
+    Area,      // average of the source pixels each output pixel covers
+    Lanczos3,  // sharper, for photographs and greyscale scans
+};
+
+// Separable resampling to width x height. Rows are filtered vertically into a
+// float row, then horizontally, with the inner loops dispatched to the SIMD
+// level of spdf_simd.h; bands of output rows run on up to threads threads.
+bool resample_bitmap(const Bitmap& source, int width, int height, ResampleFilter filter, unsigned threads,
+                     Bitmap* output);
+
+// Luma distribution of a bitmap, for telling scanned text from photographs
+struct LumaHistogram {
+    uint64_t counts[256] = {};
+    uint64_t coloured = 0;  // RGB pixels whose channels spread wider than a gray scan's
+    uint64_t pixels = 0;
+};
+
+// Fills histogram from bitmap. RGB is turned into luma (and checked for
+// colour) with the SIMD level of spdf_simd.h, bands of rows on up to threads
+// threads.
+void luma_histogram(const Bitmap& bitmap, unsigned threads, LumaHistogram* histogram);
+
+// The luma that separates ink from paper (Otsu's threshold) when the
+// histogram is that of a black-and-white page: hardly any colour, ink and
+// paper far apart, few pixels in between and less ink than paper. -1 for
+// anything else.
+int bilevel_threshold(const LumaHistogram& histogram);
+
+// Luma of source, area-resampled to width x height and cut at threshold, as
+// the samples of a 1-bit gray image: (width + 7) / 8 bytes per row, most
+// significant bit first, 0 for ink
+bool binarize_bitmap(const Bitmap& source, int width, int height, int threshold, unsigned threads,
+                     std::vector<uint8_t>* bits);
+
+// Mean structural similarity of the luma of two bitmaps of the same size,
+// over 8x8 windows; 1 for identical images
+double bitmap_ssim(const Bitmap& a, const Bitmap& b, unsigned threads);
+
+// What the JPEG quality search aims for
+struct JpegTarget {
+    double ssim = 0.95;              // lowest acceptable bitmap_ssim() against the source
+    double max_bits_per_pixel = 0;   // size budget, wins over ssim; 0 for none
+    int min_quality = 30;
+    int max_quality = 90;
+};
+
+struct JpegResult {
+    std::string data;
+    int quality = 0;
+    double ssim = 0;
+};
+
+// Encodes image at the lowest quality whose round trip still meets
+// target.ssim (the highest quality when none does), then lowers it further
+// while the output exceeds the size budget. Each probe is an encode, a
+// decode and an SSIM pass, all spread over threads.
+bool encode_jpeg_to_target(const Bitmap& image, const JpegTarget& target, unsigned threads, JpegResult* result);
+
+} // namespace spdf
+
+#endif // SPDF_IMAGE_H
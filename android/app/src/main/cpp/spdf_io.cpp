@@ -0,0 +1,404 @@
+#include "spdf_io.h"
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <vector>
+
+#if defined(__linux__) && !defined(__ANDROID__) && __has_include(<linux/io_uring.h>)
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#define SPDF_HAVE_IO_URING 1
+#endif
+
+namespace spdf {
+
+// Reads of a whole file are split into requests of this size
+static const size_t READ_CHUNK = 1u << 20;
+// One request never moves more than this; the kernel takes 32-bit lengths
+static const size_t MAX_REQUEST = 1u << 30;
+
+static std::atomic<IoBackendKind> configured_kind{IoBackendKind::Auto};
+
+namespace {
+
+class BlockingBackend : public IoBackend {
+public:
+    const char* name() const override { return "blocking"; }
+
+    void read(int fd, char* data, size_t size, uint64_t offset, size_t* done) override {
+        size_t total = 0;
+        while (total < size) {
+            ssize_t n = pread(fd, data + total, size - total, (off_t)(offset + total));
+            if (n < 0 && errno == EINTR) {
+                continue;
+            }
+            if (n < 0) {
+                failed_ = true;
+            }
+            if (n <= 0) {
+                break;
+            }
+            total += (size_t)n;
+        }
+        if (done) {
+            *done = total;
+        }
+    }
+
+    void write(int fd, const char* data, size_t size, uint64_t offset) override {
+        while (size > 0 && !failed_) {
+            ssize_t n = pwrite(fd, data, size, (off_t)offset);
+            if (n < 0 && errno == EINTR) {
+                continue;
+            }
+            if (n <= 0) {
+                failed_ = true;
+                break;
+            }
+            data += n;
+            size -= (size_t)n;
+            offset += (uint64_t)n;
+        }
+    }
+
+    bool wait() override {
+        bool ok = !failed_;
+        failed_ = false;
+        return ok;
+    }
+
+private:
+    bool failed_ = false;
+};
+
+#ifdef SPDF_HAVE_IO_URING
+
+// io_uring through the raw system calls (no liburing): requests become
+// submission queue entries, submitted in groups and reaped from the
+// completion queue; short transfers are resubmitted for the remainder
+class UringBackend : public IoBackend {
+public:
+    ~UringBackend() override;
+    const char* name() const override { return "io_uring"; }
+    bool setup(unsigned entries);
+
+    void read(int fd, char* data, size_t size, uint64_t offset, size_t* done) override;
+    void write(int fd, const char* data, size_t size, uint64_t offset) override;
+    bool wait() override;
+
+private:
+    struct Request {
+        int fd = -1;
+        bool write = false;
+        char* data = nullptr;
+        size_t size = 0;
+        uint64_t offset = 0;
+        size_t done = 0;
+        size_t* report = nullptr;
+    };
+
+    void queue(const Request& request);
+    void push(uint32_t slot);
+    bool enter(unsigned min_complete);
+    void reap();
+
+    int ring_fd_ = -1;
+    void* sq_ring_ = MAP_FAILED;
+    size_t sq_ring_size_ = 0;
+    void* cq_ring_ = MAP_FAILED;
+    size_t cq_ring_size_ = 0;
+    io_uring_sqe* sqes_ = static_cast<io_uring_sqe*>(MAP_FAILED);
+    size_t sqes_size_ = 0;
+
+    unsigned* sq_tail_ = nullptr;
+    unsigned sq_mask_ = 0;
+    unsigned* sq_array_ = nullptr;
+    unsigned* cq_head_ = nullptr;
+    unsigned* cq_tail_ = nullptr;
+    unsigned cq_mask_ = 0;
+    io_uring_cqe* cqes_ = nullptr;
+
+    unsigned entries_ = 0;
+    unsigned unsubmitted_ = 0;
+    unsigned in_flight_ = 0;
+    std::vector<Request> slots_;
+    std::vector<uint32_t> free_slots_;
+    bool failed_ = false;
+};
+
+UringBackend::~UringBackend() {
+    if (sqes_ != MAP_FAILED) {
+        munmap(sqes_, sqes_size_);
+    }
+    if (cq_ring_ != MAP_FAILED && cq_ring_ != sq_ring_) {
+        munmap(cq_ring_, cq_ring_size_);
+    }
+    if (sq_ring_ != MAP_FAILED) {
+        munmap(sq_ring_, sq_ring_size_);
+    }
+    if (ring_fd_ >= 0) {
+        close(ring_fd_);
+    }
+}
+
+bool UringBackend::setup(unsigned entries) {
+    io_uring_params params = {};
+    ring_fd_ = (int)syscall(__NR_io_uring_setup, entries, &params);
+    // Plain READ/WRITE opcodes arrived in 5.6; FAST_POLL (5.7) is the oldest feature bit that implies them
+    if (ring_fd_ < 0 || !(params.features & IORING_FEAT_FAST_POLL)) {
+        return false;
+    }
+    sq_ring_size_ = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+    cq_ring_size_ = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+    bool single = (params.features & IORING_FEAT_SINGLE_MMAP) != 0;
+    if (single) {
+        sq_ring_size_ = cq_ring_size_ = std::max(sq_ring_size_, cq_ring_size_);
+    }
+    sq_ring_ = mmap(nullptr, sq_ring_size_, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring_fd_,
+                    IORING_OFF_SQ_RING);
+    if (sq_ring_ == MAP_FAILED) {
+        return false;
+    }
+    cq_ring_ = single ? sq_ring_
+                      : mmap(nullptr, cq_ring_size_, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring_fd_,
+                             IORING_OFF_CQ_RING);
+    if (cq_ring_ == MAP_FAILED) {
+        return false;
+    }
+    sqes_size_ = params.sq_entries * sizeof(io_uring_sqe);
+    sqes_ = static_cast<io_uring_sqe*>(mmap(nullptr, sqes_size_, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                                            ring_fd_, IORING_OFF_SQES));
+    if (sqes_ == MAP_FAILED) {
+        return false;
+    }
+
+    char* sq = static_cast<char*>(sq_ring_);
+    sq_tail_ = reinterpret_cast<unsigned*>(sq + params.sq_off.tail);
+    sq_mask_ = *reinterpret_cast<unsigned*>(sq + params.sq_off.ring_mask);
+    sq_array_ = reinterpret_cast<unsigned*>(sq + params.sq_off.array);
+    char* cq = static_cast<char*>(cq_ring_);
+    cq_head_ = reinterpret_cast<unsigned*>(cq + params.cq_off.head);
+    cq_tail_ = reinterpret_cast<unsigned*>(cq + params.cq_off.tail);
+    cq_mask_ = *reinterpret_cast<unsigned*>(cq + params.cq_off.ring_mask);
+    cqes_ = reinterpret_cast<io_uring_cqe*>(cq + params.cq_off.cqes);
+    // Never more requests in flight than the submission queue holds, so the completion queue cannot overflow
+    entries_ = params.sq_entries;
+    return true;
+}
+
+void UringBackend::read(int fd, char* data, size_t size, uint64_t offset, size_t* done) {
+    if (done) {
+        *done = 0;
+    }
+    Request request;
+    request.fd = fd;
+    request.data = data;
+    request.size = size;
+    request.offset = offset;
+    request.report = done;
+    queue(request);
+}
+
+void UringBackend::write(int fd, const char* data, size_t size, uint64_t offset) {
+    Request request;
+    request.fd = fd;
+    request.write = true;
+    request.data = const_cast<char*>(data);
+    request.size = size;
+    request.offset = offset;
+    queue(request);
+}
+
+void UringBackend::queue(const Request& request) {
+    if (request.size == 0) {
+        return;
+    }
+    while (in_flight_ == entries_) {
+        if (!enter(1)) {
+            failed_ = true;
+            return;
+        }
+        reap();
+    }
+    uint32_t slot;
+    if (free_slots_.empty()) {
+        slot = (uint32_t)slots_.size();
+        slots_.push_back(request);
+    } else {
+        slot = free_slots_.back();
+        free_slots_.pop_back();
+        slots_[slot] = request;
+    }
+    in_flight_++;
+    push(slot);
+    // Submit in groups: one system call for several requests
+    if (unsubmitted_ >= 8) {
+        enter(0);
+    }
+}
+
+// Fills a submission queue entry for what remains of the request in slot
+void UringBackend::push(uint32_t slot) {
+    const Request& request = slots_[slot];
+    unsigned tail = *sq_tail_;
+    unsigned index = tail & sq_mask_;
+    io_uring_sqe* sqe = &sqes_[index];
+    *sqe = io_uring_sqe{};
+    sqe->opcode = request.write ? IORING_OP_WRITE : IORING_OP_READ;
+    sqe->fd = request.fd;
+    sqe->off = request.offset + request.done;
+    sqe->addr = (uint64_t)(uintptr_t)(request.data + request.done);
+    sqe->len = (uint32_t)std::min(request.size - request.done, MAX_REQUEST);
+    sqe->user_data = slot;
+    sq_array_[index] = index;
+    __atomic_store_n(sq_tail_, tail + 1, __ATOMIC_RELEASE);
+    unsubmitted_++;
+}
+
+bool UringBackend::enter(unsigned min_complete) {
+    for (;;) {
+        int submitted = (int)syscall(__NR_io_uring_enter, ring_fd_, unsubmitted_, min_complete,
+                                     min_complete ? IORING_ENTER_GETEVENTS : 0, nullptr, 0);
+        if (submitted >= 0) {
+            unsubmitted_ -= std::min(unsubmitted_, (unsigned)submitted);
+            return true;
+        }
+        if (errno != EINTR && errno != EAGAIN && errno != EBUSY) {
+            return false;
+        }
+    }
+}
+
+void UringBackend::reap() {
+    unsigned head = *cq_head_;
+    unsigned tail = __atomic_load_n(cq_tail_, __ATOMIC_ACQUIRE);
+    for (; head != tail; head++) {
+        const io_uring_cqe& cqe = cqes_[head & cq_mask_];
+        uint32_t slot = (uint32_t)cqe.user_data;
+        Request& request = slots_[slot];
+        int result = cqe.res;
+        bool finished = true;
+        if (result == -EINTR || result == -EAGAIN) {
+            finished = false;
+        } else if (result < 0 || (result == 0 && request.write)) {
+            failed_ = true;
+        } else if (result > 0) {
+            request.done += (size_t)result;
+            finished = request.done == request.size;
+        }
+        if (finished) {
+            if (request.report) {
+                *request.report = request.done;
+            }
+            free_slots_.push_back(slot);
+            in_flight_--;
+        } else {
+            // The entry just consumed frees a place in the submission queue
+            push(slot);
+        }
+    }
+    __atomic_store_n(cq_head_, head, __ATOMIC_RELEASE);
+}
+
+bool UringBackend::wait() {
+    while (in_flight_ > 0) {
+        if (!enter(1)) {
+            // The ring is unusable; the requests still queued in it cannot be trusted
+            failed_ = true;
+            break;
+        }
+        reap();
+    }
+    bool ok = !failed_;
+    failed_ = false;
+    return ok;
+}
+
+#endif // SPDF_HAVE_IO_URING
+
+} // namespace
+
+void set_io_backend_kind(IoBackendKind kind) {
+    configured_kind = kind;
+}
+
+bool parse_io_backend_kind(const std::string& name, IoBackendKind* kind) {
+    if (name == "auto") {
+        *kind = IoBackendKind::Auto;
+    } else if (name == "blocking") {
+        *kind = IoBackendKind::Blocking;
+    } else if (name == "io_uring") {
+        *kind = IoBackendKind::IoUring;
+    } else {
+        return false;
+    }
+    return true;
+}
+
+std::unique_ptr<IoBackend> make_io_backend(IoBackendKind kind) {
+#ifdef SPDF_HAVE_IO_URING
+    if (kind != IoBackendKind::Blocking) {
+        std::unique_ptr<UringBackend> ring(new UringBackend());
+        if (ring->setup(64)) {
+            return ring;
+        }
+    }
+#else
+    (void)kind;
+#endif
+    return std::unique_ptr<IoBackend>(new BlockingBackend());
+}
+
+IoBackend& thread_io_backend() {
+    thread_local std::unique_ptr<IoBackend> backend = make_io_backend(configured_kind);
+    return *backend;
+}
+
+bool read_file(const std::string& path, std::string* data, std::string* error) {
+    int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        *error = "cannot open " + path;
+        return false;
+    }
+    struct stat st;
+    size_t size = fstat(fd, &st) == 0 && st.st_size > 0 ? (size_t)st.st_size : 0;
+    data->resize(size);
+    IoBackend& io = thread_io_backend();
+    size_t chunks = (size + READ_CHUNK - 1) / READ_CHUNK;
+    std::vector<size_t> done(chunks);
+    for (size_t i = 0; i < chunks; i++) {
+        size_t offset = i * READ_CHUNK;
+        io.read(fd, &(*data)[offset], std::min(READ_CHUNK, size - offset), offset, &done[i]);
+    }
+    bool ok = io.wait();
+    // A file that shrank since fstat() ends at its first short chunk
+    for (size_t i = 0; i < chunks && ok; i++) {
+        if (done[i] < std::min(READ_CHUNK, size - i * READ_CHUNK)) {
+            data->resize(i * READ_CHUNK + done[i]);
+            break;
+        }
+    }
+    // Pick up anything appended since
+    char buffer[65536];
+    ssize_t n;
+    while (ok && (n = pread(fd, buffer, sizeof(buffer), (off_t)data->size())) != 0) {
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        ok = n > 0;
+        if (ok) {
+            data->append(buffer, (size_t)n);
+        }
+    }
+    close(fd);
+    if (!ok) {
+        *error = "cannot read " + path;
+    }
+    return ok;
+}
+
+} // namespace spdf
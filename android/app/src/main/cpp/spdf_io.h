@@ -0,0 +1,49 @@
+#ifndef SPDF_IO_H
+#define SPDF_IO_H
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+
+namespace spdf {
+
+// Positional file I/O with queued requests, so many reads or writes can be in
+// flight at once. A request's buffer must stay untouched until wait() has
+// returned. Not thread-safe: each thread uses its own backend.
+class IoBackend {
+public:
+    virtual ~IoBackend() = default;
+    virtual const char* name() const = 0;
+
+    // Reads up to size bytes at offset into data; *done (optional) receives the
+    // count, which is short only at the end of the file
+    virtual void read(int fd, char* data, size_t size, uint64_t offset, size_t* done) = 0;
+    // Writes all size bytes at offset
+    virtual void write(int fd, const char* data, size_t size, uint64_t offset) = 0;
+    // Completes every queued request; false when any of them failed
+    virtual bool wait() = 0;
+};
+
+enum class IoBackendKind {
+    Auto,      // io_uring where the kernel offers it, blocking otherwise
+    Blocking,  // pread()/pwrite() as requests are queued
+    IoUring,   // Linux io_uring; falls back to blocking when it cannot be set up
+};
+
+// Backend used by threads that have not made one yet. Android apps always get
+// the blocking backend: their seccomp policy kills the process on io_uring.
+void set_io_backend_kind(IoBackendKind kind);
+// "auto", "blocking" or "io_uring"; false for anything else
+bool parse_io_backend_kind(const std::string& name, IoBackendKind* kind);
+
+std::unique_ptr<IoBackend> make_io_backend(IoBackendKind kind);
+// The calling thread's backend, made on first use with the configured kind
+IoBackend& thread_io_backend();
+
+// Reads the whole file, its chunks queued together on the thread's backend
+bool read_file(const std::string& path, std::string* data, std::string* error);
+
+} // namespace spdf
+
+#endif // SPDF_IO_H
@@ -0,0 +1,943 @@
+#include "spdf_jpeg.h"
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <vector>
+#include "spdf_writer.h"
+
+namespace spdf {
+
+// Bits resolved by one table lookup when decoding Huffman codes
+static const int FAST_BITS = 9;
+// Largest frame the decoder allocates, in samples per component
+static const uint64_t MAX_SAMPLES = 1ull << 28;
+
+// Zig-zag position -> natural (row-major) position
+static const uint8_t ZIGZAG[64] = {0,  1,  8,  16, 9,  2,  3,  10, 17, 24, 32, 25, 18, 11, 4,  5,
+                                   12, 19, 26, 33, 40, 48, 41, 34, 27, 20, 13, 6,  7,  14, 21, 28,
+                                   35, 42, 49, 56, 57, 50, 43, 36, 29, 22, 15, 23, 30, 37, 44, 51,
+                                   58, 59, 52, 45, 38, 31, 39, 46, 53, 60, 61, 54, 47, 55, 62, 63};
+
+// Annex K.1 quantisation tables, natural order
+static const uint8_t LUMA_QUANT[64] = {16, 11, 10, 16, 24,  40,  51,  61,  12, 12, 14, 19, 26,  58,  60,  55,
+                                       14, 13, 16, 24, 40,  57,  69,  56,  14, 17, 22, 29, 51,  87,  80,  62,
+                                       18, 22, 37, 56, 68,  109, 103, 77,  24, 35, 55, 64, 81,  104, 113, 92,
+                                       49, 64, 78, 87, 103, 121, 120, 101, 72, 92, 95, 98, 112, 100, 103, 99};
+static const uint8_t CHROMA_QUANT[64] = {17, 18, 24, 47, 99, 99, 99, 99, 18, 21, 26, 66, 99, 99, 99, 99,
+                                         24, 26, 56, 99, 99, 99, 99, 99, 47, 66, 99, 99, 99, 99, 99, 99,
+                                         99, 99, 99, 99, 99, 99, 99, 99, 99, 99, 99, 99, 99, 99, 99, 99,
+                                         99, 99, 99, 99, 99, 99, 99, 99, 99, 99, 99, 99, 99, 99, 99, 99};
+
+// Annex K.3 Huffman tables: code counts by length 1-16, then the symbols
+static const uint8_t DC_LUMA_COUNTS[16] = {0, 1, 5, 1, 1, 1, 1, 1, 1, 0, 0, 0, 0, 0, 0, 0};
+static const uint8_t DC_CHROMA_COUNTS[16] = {0, 3, 1, 1, 1, 1, 1, 1, 1, 1, 1, 0, 0, 0, 0, 0};
+static const uint8_t DC_SYMBOLS[12] = {0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11};
+static const uint8_t AC_LUMA_COUNTS[16] = {0, 2, 1, 3, 3, 2, 4, 3, 5, 5, 4, 4, 0, 0, 1, 0x7d};
+static const uint8_t AC_LUMA_SYMBOLS[162] = {
+    0x01, 0x02, 0x03, 0x00, 0x04, 0x11, 0x05, 0x12, 0x21, 0x31, 0x41, 0x06, 0x13, 0x51, 0x61, 0x07, 0x22, 0x71,
+    0x14, 0x32, 0x81, 0x91, 0xa1, 0x08, 0x23, 0x42, 0xb1, 0xc1, 0x15, 0x52, 0xd1, 0xf0, 0x24, 0x33, 0x62, 0x72,
+    0x82, 0x09, 0x0a, 0x16, 0x17, 0x18, 0x19, 0x1a, 0x25, 0x26, 0x27, 0x28, 0x29, 0x2a, 0x34, 0x35, 0x36, 0x37,
+    0x38, 0x39, 0x3a, 0x43, 0x44, 0x45, 0x46, 0x47, 0x48, 0x49, 0x4a, 0x53, 0x54, 0x55, 0x56, 0x57, 0x58, 0x59,
+    0x5a, 0x63, 0x64, 0x65, 0x66, 0x67, 0x68, 0x69, 0x6a, 0x73, 0x74, 0x75, 0x76, 0x77, 0x78, 0x79, 0x7a, 0x83,
+    0x84, 0x85, 0x86, 0x87, 0x88, 0x89, 0x8a, 0x92, 0x93, 0x94, 0x95, 0x96, 0x97, 0x98, 0x99, 0x9a, 0xa2, 0xa3,
+    0xa4, 0xa5, 0xa6, 0xa7, 0xa8, 0xa9, 0xaa, 0xb2, 0xb3, 0xb4, 0xb5, 0xb6, 0xb7, 0xb8, 0xb9, 0xba, 0xc2, 0xc3,
+    0xc4, 0xc5, 0xc6, 0xc7, 0xc8, 0xc9, 0xca, 0xd2, 0xd3, 0xd4, 0xd5, 0xd6, 0xd7, 0xd8, 0xd9, 0xda, 0xe1, 0xe2,
+    0xe3, 0xe4, 0xe5, 0xe6, 0xe7, 0xe8, 0xe9, 0xea, 0xf1, 0xf2, 0xf3, 0xf4, 0xf5, 0xf6, 0xf7, 0xf8, 0xf9, 0xfa};
+static const uint8_t AC_CHROMA_COUNTS[16] = {0, 2, 1, 2, 4, 4, 3, 4, 7, 5, 4, 4, 0, 1, 2, 0x77};
+static const uint8_t AC_CHROMA_SYMBOLS[162] = {
+    0x00, 0x01, 0x02, 0x03, 0x11, 0x04, 0x05, 0x21, 0x31, 0x06, 0x12, 0x41, 0x51, 0x07, 0x61, 0x71, 0x13, 0x22,
+    0x32, 0x81, 0x08, 0x14, 0x42, 0x91, 0xa1, 0xb1, 0xc1, 0x09, 0x23, 0x33, 0x52, 0xf0, 0x15, 0x62, 0x72, 0xd1,
+    0x0a, 0x16, 0x24, 0x34, 0xe1, 0x25, 0xf1, 0x17, 0x18, 0x19, 0x1a, 0x26, 0x27, 0x28, 0x29, 0x2a, 0x35, 0x36,
+    0x37, 0x38, 0x39, 0x3a, 0x43, 0x44, 0x45, 0x46, 0x47, 0x48, 0x49, 0x4a, 0x53, 0x54, 0x55, 0x56, 0x57, 0x58,
+    0x59, 0x5a, 0x63, 0x64, 0x65, 0x66, 0x67, 0x68, 0x69, 0x6a, 0x73, 0x74, 0x75, 0x76, 0x77, 0x78, 0x79, 0x7a,
+    0x82, 0x83, 0x84, 0x85, 0x86, 0x87, 0x88, 0x89, 0x8a, 0x92, 0x93, 0x94, 0x95, 0x96, 0x97, 0x98, 0x99, 0x9a,
+    0xa2, 0xa3, 0xa4, 0xa5, 0xa6, 0xa7, 0xa8, 0xa9, 0xaa, 0xb2, 0xb3, 0xb4, 0xb5, 0xb6, 0xb7, 0xb8, 0xb9, 0xba,
+    0xc2, 0xc3, 0xc4, 0xc5, 0xc6, 0xc7, 0xc8, 0xc9, 0xca, 0xd2, 0xd3, 0xd4, 0xd5, 0xd6, 0xd7, 0xd8, 0xd9, 0xda,
+    0xe2, 0xe3, 0xe4, 0xe5, 0xe6, 0xe7, 0xe8, 0xe9, 0xea, 0xf2, 0xf3, 0xf4, 0xf5, 0xf6, 0xf7, 0xf8, 0xf9, 0xfa};
+
+namespace {
+
+// Orthonormal 8-point DCT-II basis: BASIS[u][x] = c(u) cos((2x + 1) u pi / 16)
+struct DctBasis {
+    float m[8][8];
+
+    DctBasis() {
+        for (int u = 0; u < 8; u++) {
+            float scale = u == 0 ? std::sqrt(0.125f) : 0.5f;
+            for (int x = 0; x < 8; x++) {
+                m[u][x] = scale * (float)std::cos((2 * x + 1) * u * M_PI / 16);
+            }
+        }
+    }
+};
+
+const DctBasis BASIS;
+
+struct HuffmanTable {
+    bool defined = false;
+    uint8_t fast_length[1 << FAST_BITS];  // 0: code longer than FAST_BITS
+    uint8_t fast_value[1 << FAST_BITS];
+    int32_t max_code[17];  // -1 when no code has this length
+    int32_t min_code[17];
+    int32_t offset[17];    // index into values of the first code of each length
+    uint8_t values[256];
+};
+
+struct Component {
+    int id = 0;
+    int h = 1;
+    int v = 1;
+    int quant = 0;
+    int dc_table = 0;
+    int ac_table = 0;
+    int width = 0;        // samples
+    int height = 0;
+    int blocks_wide = 0;  // of the plane, whole MCUs
+    int blocks_high = 0;
+    size_t stride = 0;
+    std::vector<uint8_t> plane;
+};
+
+struct Frame {
+    int width = 0;
+    int height = 0;
+    int h_max = 1;
+    int v_max = 1;
+    int mcus_wide = 0;
+    int mcus_high = 0;
+    std::vector<Component> components;
+    uint16_t quant[4][64] = {};  // natural order
+    bool quant_defined[4] = {};
+    HuffmanTable dc[4];
+    HuffmanTable ac[4];
+    int restart_interval = 0;
+    int adobe_transform = -1;
+};
+
+struct ScanComponent {
+    Component* component;
+    const HuffmanTable* dc;
+    const HuffmanTable* ac;
+    const uint16_t* quant;
+};
+
+// Entropy-coded bits; a marker or the end of the data reads as zeros
+class BitReader {
+public:
+    BitReader(const uint8_t* data, const uint8_t* end) : p_(data), end_(end) {}
+
+    uint32_t peek(int n) {
+        if (bits_ < n) {
+            fill();
+        }
+        return (uint32_t)(acc_ >> (64 - n));
+    }
+    void skip(int n) {
+        acc_ <<= n;
+        bits_ -= n;
+    }
+    int receive(int n) {
+        if (n == 0) {
+            return 0;
+        }
+        int value = (int)peek(n);
+        skip(n);
+        return value;
+    }
+
+private:
+    void fill() {
+        while (bits_ <= 56) {
+            uint64_t byte = 0;
+            if (p_ < end_) {
+                byte = *p_++;
+                if (byte == 0xFF) {
+                    if (p_ < end_ && *p_ == 0) {
+                        p_++;
+                    } else {
+                        byte = 0;
+                        p_ = end_;
+                    }
+                }
+            }
+            acc_ |= byte << (56 - bits_);
+            bits_ += 8;
+        }
+    }
+
+    const uint8_t* p_;
+    const uint8_t* end_;
+    uint64_t acc_ = 0;
+    int bits_ = 0;
+};
+
+// Appends entropy-coded bits with 0xFF bytes stuffed
+class BitWriter {
+public:
+    explicit BitWriter(std::string* out) : out_(out) {}
+
+    void put(uint32_t code, int length) {
+        acc_ = (acc_ << length) | (code & ((1u << length) - 1));
+        bits_ += length;
+        while (bits_ >= 8) {
+            char byte = (char)(acc_ >> (bits_ - 8));
+            out_->push_back(byte);
+            if (byte == '\xFF') {
+                out_->push_back('\0');
+            }
+            bits_ -= 8;
+        }
+    }
+    // Pads the last byte with ones, as restart markers and EOI require
+    void flush() {
+        if (bits_ > 0) {
+            put((1u << (8 - bits_)) - 1, 8 - bits_);
+        }
+    }
+
+private:
+    std::string* out_;
+    uint32_t acc_ = 0;
+    int bits_ = 0;
+};
+
+struct HuffmanCodes {
+    uint16_t code[256] = {};
+    uint8_t length[256] = {};
+};
+
+} // namespace
+
+static bool build_table(const uint8_t* counts, const uint8_t* values, HuffmanTable* table) {
+    memset(table->fast_length, 0, sizeof(table->fast_length));
+    int32_t code = 0;
+    int k = 0;
+    for (int length = 1; length <= 16; length++) {
+        table->offset[length] = k;
+        table->min_code[length] = code;
+        for (int i = 0; i < counts[length - 1]; i++, k++, code++) {
+            if (length <= FAST_BITS) {
+                int shift = FAST_BITS - length;
+                for (int s = 0; s < (1 << shift); s++) {
+                    table->fast_length[(code << shift) | s] = (uint8_t)length;
+                    table->fast_value[(code << shift) | s] = values[k];
+                }
+            }
+        }
+        table->max_code[length] = counts[length - 1] ? code - 1 : -1;
+        if (code > (1 << length)) {
+            return false;
+        }
+        code <<= 1;
+    }
+    memcpy(table->values, values, (size_t)k);
+    table->defined = true;
+    return true;
+}
+
+static int decode_symbol(BitReader& bits, const HuffmanTable& table) {
+    uint32_t look = bits.peek(FAST_BITS);
+    if (int length = table.fast_length[look]) {
+        bits.skip(length);
+        return table.fast_value[look];
+    }
+    int32_t code = (int32_t)bits.peek(16);
+    for (int length = FAST_BITS + 1; length <= 16; length++) {
+        int32_t prefix = code >> (16 - length);
+        if (prefix <= table.max_code[length]) {
+            bits.skip(length);
+            return table.values[table.offset[length] + prefix - table.min_code[length]];
+        }
+    }
+    return -1;
+}
+
+// Sign extension of an n-bit magnitude category value
+static int extend(int value, int n) {
+    return n && value < (1 << (n - 1)) ? value - (1 << n) + 1 : value;
+}
+
+static inline uint8_t clamp_sample(float value) {
+    int rounded = (int)std::lround(value);
+    return (uint8_t)std::min(255, std::max(0, rounded));
+}
+
+static void inverse_dct(const float* coefficients, uint8_t* out, size_t stride) {
+    bool flat = true;
+    for (int i = 1; i < 64 && flat; i++) {
+        flat = coefficients[i] == 0;
+    }
+    if (flat) {
+        uint8_t value = clamp_sample(coefficients[0] / 8 + 128);
+        for (int y = 0; y < 8; y++) {
+            memset(out + y * stride, value, 8);
+        }
+        return;
+    }
+    float rows[64];
+    for (int v = 0; v < 8; v++) {
+        for (int x = 0; x < 8; x++) {
+            float sum = 0;
+            for (int u = 0; u < 8; u++) {
+                sum += coefficients[v * 8 + u] * BASIS.m[u][x];
+            }
+            rows[v * 8 + x] = sum;
+        }
+    }
+    for (int y = 0; y < 8; y++) {
+        for (int x = 0; x < 8; x++) {
+            float sum = 128;
+            for (int v = 0; v < 8; v++) {
+                sum += BASIS.m[v][y] * rows[v * 8 + x];
+            }
+            out[y * stride + x] = clamp_sample(sum);
+        }
+    }
+}
+
+static void forward_dct(const float* samples, float* coefficients) {
+    float rows[64];
+    for (int y = 0; y < 8; y++) {
+        for (int u = 0; u < 8; u++) {
+            float sum = 0;
+            for (int x = 0; x < 8; x++) {
+                sum += samples[y * 8 + x] * BASIS.m[u][x];
+            }
+            rows[y * 8 + u] = sum;
+        }
+    }
+    for (int v = 0; v < 8; v++) {
+        for (int u = 0; u < 8; u++) {
+            float sum = 0;
+            for (int y = 0; y < 8; y++) {
+                sum += BASIS.m[v][y] * rows[y * 8 + u];
+            }
+            coefficients[v * 8 + u] = sum;
+        }
+    }
+}
+
+// ---------------------------------------------------------------------------
+// Decoder
+
+static bool decode_block(BitReader& bits, const ScanComponent& scan, int* predictor, uint8_t* out) {
+    float coefficients[64] = {};
+    int category = decode_symbol(bits, *scan.dc);
+    if (category < 0 || category > 11) {
+        return false;
+    }
+    *predictor += extend(bits.receive(category), category);
+    coefficients[0] = (float)(*predictor * scan.quant[0]);
+    for (int k = 1; k < 64;) {
+        int symbol = decode_symbol(bits, *scan.ac);
+        if (symbol < 0) {
+            return false;
+        }
+        int run = symbol >> 4;
+        int size = symbol & 15;
+        if (size == 0) {
+            if (run != 15) {
+                break;  // end of block
+            }
+            k += 16;
+            continue;
+        }
+        k += run;
+        if (k > 63) {
+            return false;
+        }
+        int position = ZIGZAG[k++];
+        coefficients[position] = (float)(extend(bits.receive(size), size) * scan.quant[position]);
+    }
+    const Component& component = *scan.component;
+    inverse_dct(coefficients, out, component.stride);
+    return true;
+}
+
+// Decodes count MCUs from first on, one restart interval (or the whole scan)
+static bool decode_mcus(const Frame& frame, const std::vector<ScanComponent>& scan, const uint8_t* begin,
+                        const uint8_t* end, size_t first, size_t count) {
+    BitReader bits(begin, end);
+    int predictors[4] = {};
+    for (size_t m = first; m < first + count; m++) {
+        if (scan.size() == 1) {
+            // Non-interleaved: one block per MCU, over the component's own extent
+            Component& component = *scan[0].component;
+            size_t wide = ((size_t)component.width + 7) / 8;
+            size_t bx = m % wide;
+            size_t by = m / wide;
+            uint8_t* out = component.plane.data() + by * 8 * component.stride + bx * 8;
+            if (!decode_block(bits, scan[0], &predictors[0], out)) {
+                return false;
+            }
+            continue;
+        }
+        size_t mx = m % (size_t)frame.mcus_wide;
+        size_t my = m / (size_t)frame.mcus_wide;
+        for (size_t i = 0; i < scan.size(); i++) {
+            Component& component = *scan[i].component;
+            for (int v = 0; v < component.v; v++) {
+                for (int h = 0; h < component.h; h++) {
+                    size_t bx = mx * component.h + h;
+                    size_t by = my * component.v + v;
+                    uint8_t* out = component.plane.data() + by * 8 * component.stride + bx * 8;
+                    if (!decode_block(bits, scan[i], &predictors[i], out)) {
+                        return false;
+                    }
+                }
+            }
+        }
+    }
+    return true;
+}
+
+static bool decode_scan(Frame& frame, const std::vector<ScanComponent>& scan, const uint8_t* begin,
+                        const uint8_t* end, unsigned threads, std::string* error) {
+    size_t total;
+    if (scan.size() == 1) {
+        const Component& component = *scan[0].component;
+        total = (((size_t)component.width + 7) / 8) * (((size_t)component.height + 7) / 8);
+    } else {
+        total = (size_t)frame.mcus_wide * (size_t)frame.mcus_high;
+    }
+    if (frame.restart_interval == 0) {
+        if (!decode_mcus(frame, scan, begin, end, 0, total)) {
+            *error = "corrupt JPEG data";
+            return false;
+        }
+        return true;
+    }
+
+    // Restart intervals are independent: find them and decode them side by side
+    std::vector<const uint8_t*> starts(1, begin);
+    for (const uint8_t* p = begin; p + 1 < end; p++) {
+        if (p[0] == 0xFF && p[1] >= 0xD0 && p[1] <= 0xD7) {
+            starts.push_back(p + 2);
+            p++;
+        }
+    }
+    size_t interval = (size_t)frame.restart_interval;
+    if (starts.size() != (total + interval - 1) / interval) {
+        *error = "JPEG restart markers do not match the restart interval";
+        return false;
+    }
+    std::vector<char> failed(starts.size(), 0);
+    run_parallel(starts.size(), threads, [&](size_t i) {
+        const uint8_t* segment_end = i + 1 < starts.size() ? starts[i + 1] - 2 : end;
+        size_t first = i * interval;
+        failed[i] = !decode_mcus(frame, scan, starts[i], segment_end, first, std::min(interval, total - first));
+    });
+    if (std::find(failed.begin(), failed.end(), 1) != failed.end()) {
+        *error = "corrupt JPEG data";
+        return false;
+    }
+    return true;
+}
+
+static bool read_frame(const uint8_t* segment, size_t length, Frame* frame, std::string* error) {
+    if (length < 6 || segment[0] != 8) {
+        *error = "JPEG sample precision is not 8 bits";
+        return false;
+    }
+    frame->height = (segment[1] << 8) | segment[2];
+    frame->width = (segment[3] << 8) | segment[4];
+    int count = segment[5];
+    if (frame->height == 0 || frame->width == 0) {
+        *error = "JPEG without frame dimensions";
+        return false;
+    }
+    if ((count != 1 && count != 3) || length < 6 + 3 * (size_t)count) {
+        *error = "unsupported JPEG component count";
+        return false;
+    }
+    if ((uint64_t)frame->width * (uint64_t)frame->height > MAX_SAMPLES) {
+        *error = "JPEG too large";
+        return false;
+    }
+    frame->components.resize((size_t)count);
+    for (int i = 0; i < count; i++) {
+        Component& component = frame->components[(size_t)i];
+        const uint8_t* spec = segment + 6 + 3 * i;
+        component.id = spec[0];
+        component.h = spec[1] >> 4;
+        component.v = spec[1] & 15;
+        component.quant = spec[2];
+        if (component.h < 1 || component.h > 4 || component.v < 1 || component.v > 4 || component.quant > 3) {
+            *error = "invalid JPEG component";
+            return false;
+        }
+        frame->h_max = std::max(frame->h_max, component.h);
+        frame->v_max = std::max(frame->v_max, component.v);
+    }
+    frame->mcus_wide = (frame->width + 8 * frame->h_max - 1) / (8 * frame->h_max);
+    frame->mcus_high = (frame->height + 8 * frame->v_max - 1) / (8 * frame->v_max);
+    for (auto& component : frame->components) {
+        component.width = (frame->width * component.h + frame->h_max - 1) / frame->h_max;
+        component.height = (frame->height * component.v + frame->v_max - 1) / frame->v_max;
+        component.blocks_wide = frame->mcus_wide * component.h;
+        component.blocks_high = frame->mcus_high * component.v;
+        component.stride = (size_t)component.blocks_wide * 8;
+        component.plane.assign(component.stride * (size_t)component.blocks_high * 8, 0);
+    }
+    return true;
+}
+
+static bool read_huffman_tables(const uint8_t* segment, size_t length, Frame* frame, std::string* error) {
+    size_t pos = 0;
+    while (pos + 17 <= length) {
+        int table_class = segment[pos] >> 4;
+        int id = segment[pos] & 15;
+        const uint8_t* counts = segment + pos + 1;
+        size_t total = 0;
+        for (int i = 0; i < 16; i++) {
+            total += counts[i];
+        }
+        pos += 17;
+        if (table_class > 1 || id > 3 || total > 256 || pos + total > length) {
+            *error = "invalid JPEG Huffman table";
+            return false;
+        }
+        HuffmanTable* table = table_class == 0 ? &frame->dc[id] : &frame->ac[id];
+        if (!build_table(counts, segment + pos, table)) {
+            *error = "invalid JPEG Huffman table";
+            return false;
+        }
+        pos += total;
+    }
+    return true;
+}
+
+static bool read_quant_tables(const uint8_t* segment, size_t length, Frame* frame, std::string* error) {
+    size_t pos = 0;
+    while (pos < length) {
+        int precision = segment[pos] >> 4;
+        int id = segment[pos] & 15;
+        size_t size = precision ? 128 : 64;
+        if (precision > 1 || id > 3 || pos + 1 + size > length) {
+            *error = "invalid JPEG quantisation table";
+            return false;
+        }
+        const uint8_t* values = segment + pos + 1;
+        for (int k = 0; k < 64; k++) {
+            frame->quant[id][ZIGZAG[k]] = precision ? (uint16_t)((values[2 * k] << 8) | values[2 * k + 1]) : values[k];
+        }
+        frame->quant_defined[id] = true;
+        pos += 1 + size;
+    }
+    return true;
+}
+
+static bool read_scan_header(const uint8_t* segment, size_t length, Frame* frame, std::vector<ScanComponent>* scan,
+                             std::string* error) {
+    size_t count = length ? segment[0] : 0;
+    if (frame->components.empty() || count < 1 || count > frame->components.size() || length < 1 + 2 * count + 3) {
+        *error = "invalid JPEG scan header";
+        return false;
+    }
+    for (size_t i = 0; i < count; i++) {
+        int id = segment[1 + 2 * i];
+        int dc = segment[2 + 2 * i] >> 4;
+        int ac = segment[2 + 2 * i] & 15;
+        auto component = std::find_if(frame->components.begin(), frame->components.end(),
+                                      [&](const Component& c) { return c.id == id; });
+        if (component == frame->components.end() || dc > 3 || ac > 3 || !frame->dc[dc].defined ||
+            !frame->ac[ac].defined || !frame->quant_defined[component->quant]) {
+            *error = "JPEG scan refers to undefined tables";
+            return false;
+        }
+        scan->push_back(ScanComponent{&*component, &frame->dc[dc], &frame->ac[ac], frame->quant[component->quant]});
+    }
+    return true;
+}
+
+// Upsamples the planes to full resolution and converts YCbCr to RGB
+static void convert_frame(const Frame& frame, bool transform, unsigned threads, Bitmap* bitmap) {
+    int count = (int)frame.components.size();
+    bitmap->width = frame.width;
+    bitmap->height = frame.height;
+    bitmap->components = count;
+    bitmap->pixels.resize(bitmap->stride() * (size_t)frame.height);
+    std::vector<std::vector<int>> columns((size_t)count);
+    for (int c = 0; c < count; c++) {
+        const Component& component = frame.components[(size_t)c];
+        columns[(size_t)c].resize((size_t)frame.width);
+        for (int x = 0; x < frame.width; x++) {
+            columns[(size_t)c][(size_t)x] = x * component.h / frame.h_max;
+        }
+    }
+    static const int SCALE = 16;
+    static const int HALF = 1 << (SCALE - 1);
+    static const int CR_R = 91881;   // 1.402
+    static const int CB_G = 22554;   // 0.344136
+    static const int CR_G = 46802;   // 0.714136
+    static const int CB_B = 116130;  // 1.772
+    run_parallel((size_t)frame.height, threads, [&](size_t y) {
+        uint8_t* out = bitmap->pixels.data() + y * bitmap->stride();
+        const uint8_t* rows[3];
+        for (int c = 0; c < count; c++) {
+            const Component& component = frame.components[(size_t)c];
+            rows[c] = component.plane.data() + (y * (size_t)component.v / (size_t)frame.v_max) * component.stride;
+        }
+        if (count == 1) {
+            for (int x = 0; x < frame.width; x++) {
+                out[x] = rows[0][columns[0][(size_t)x]];
+            }
+            return;
+        }
+        for (int x = 0; x < frame.width; x++, out += 3) {
+            int luma = rows[0][columns[0][(size_t)x]];
+            int cb = rows[1][columns[1][(size_t)x]];
+            int cr = rows[2][columns[2][(size_t)x]];
+            if (!transform) {
+                out[0] = (uint8_t)luma, out[1] = (uint8_t)cb, out[2] = (uint8_t)cr;
+                continue;
+            }
+            cb -= 128;
+            cr -= 128;
+            int r = luma + ((CR_R * cr + HALF) >> SCALE);
+            int g = luma + ((-CB_G * cb - CR_G * cr + HALF) >> SCALE);
+            int b = luma + ((CB_B * cb + HALF) >> SCALE);
+            out[0] = (uint8_t)std::min(255, std::max(0, r));
+            out[1] = (uint8_t)std::min(255, std::max(0, g));
+            out[2] = (uint8_t)std::min(255, std::max(0, b));
+        }
+    });
+}
+
+bool jpeg_decode(const std::string& data, Bitmap* bitmap, std::string* error, unsigned threads, int color_transform) {
+    const uint8_t* bytes = (const uint8_t*)data.data();
+    size_t size = data.size();
+    if (size < 4 || bytes[0] != 0xFF || bytes[1] != 0xD8) {
+        *error = "not a JPEG file";
+        return false;
+    }
+    Frame frame;
+    bool scanned = false;
+    size_t pos = 2;
+    while (pos + 1 < size) {
+        if (bytes[pos] != 0xFF) {
+            pos++;
+            continue;
+        }
+        int marker = bytes[pos + 1];
+        pos += 2;
+        if (marker == 0xFF) {
+            pos--;  // fill byte
+            continue;
+        }
+        if (marker == 0xD9) {
+            break;
+        }
+        if (marker == 0x01 || (marker >= 0xD0 && marker <= 0xD7) || marker == 0x00) {
+            continue;
+        }
+        if (pos + 2 > size) {
+            break;
+        }
+        size_t length = ((size_t)bytes[pos] << 8) | bytes[pos + 1];
+        if (length < 2 || pos + length > size) {
+            *error = "truncated JPEG segment";
+            return false;
+        }
+        const uint8_t* segment = bytes + pos + 2;
+        size_t segment_length = length - 2;
+        pos += length;
+        bool ok = true;
+        if (marker == 0xC0 || marker == 0xC1) {
+            ok = frame.components.empty() && read_frame(segment, segment_length, &frame, error);
+            if (!ok && error->empty()) {
+                *error = "JPEG with several frames";
+            }
+        } else if (marker >= 0xC2 && marker <= 0xCF && marker != 0xC4 && marker != 0xC8 && marker != 0xCC) {
+            *error = marker == 0xC2 ? "progressive JPEG is not supported" : "unsupported JPEG coding process";
+            return false;
+        } else if (marker == 0xC4) {
+            ok = read_huffman_tables(segment, segment_length, &frame, error);
+        } else if (marker == 0xDB) {
+            ok = read_quant_tables(segment, segment_length, &frame, error);
+        } else if (marker == 0xDD) {
+            frame.restart_interval = segment_length >= 2 ? (segment[0] << 8) | segment[1] : 0;
+        } else if (marker == 0xEE && segment_length >= 12 && memcmp(segment, "Adobe", 5) == 0) {
+            frame.adobe_transform = segment[11];
+        } else if (marker == 0xDA) {
+            std::vector<ScanComponent> scan;
+            if (!read_scan_header(segment, segment_length, &frame, &scan, error)) {
+                return false;
+            }
+            // The entropy-coded data runs to the next marker other than a restart
+            size_t end = pos;
+            while (end + 1 < size &&
+                   !(bytes[end] == 0xFF && bytes[end + 1] != 0 && (bytes[end + 1] < 0xD0 || bytes[end + 1] > 0xD7))) {
+                end++;
+            }
+            if (end + 1 >= size) {
+                end = size;  // truncated: decode what is there
+            }
+            ok = decode_scan(frame, scan, bytes + pos, bytes + end, threads, error);
+            scanned = true;
+            pos = end;
+        }
+        if (!ok) {
+            return false;
+        }
+    }
+    if (!scanned) {
+        *error = "JPEG without image data";
+        return false;
+    }
+    bool transform = frame.components.size() == 3;
+    if (color_transform >= 0) {
+        transform = transform && color_transform != 0;
+    } else if (frame.adobe_transform >= 0) {
+        transform = transform && frame.adobe_transform != 0;
+    } else if (transform && frame.components[0].id == 'R' && frame.components[1].id == 'G' &&
+               frame.components[2].id == 'B') {
+        transform = false;
+    }
+    convert_frame(frame, transform, threads, bitmap);
+    return true;
+}
+
+// ---------------------------------------------------------------------------
+// Encoder
+
+static void build_codes(const uint8_t* counts, const uint8_t* values, HuffmanCodes* codes) {
+    uint16_t code = 0;
+    int k = 0;
+    for (int length = 1; length <= 16; length++) {
+        for (int i = 0; i < counts[length - 1]; i++, k++) {
+            codes->code[values[k]] = code++;
+            codes->length[values[k]] = (uint8_t)length;
+        }
+        code <<= 1;
+    }
+}
+
+static void scale_quant(const uint8_t* base, int quality, uint8_t* table) {
+    quality = std::min(100, std::max(1, quality));
+    int scale = quality < 50 ? 5000 / quality : 200 - quality * 2;
+    for (int i = 0; i < 64; i++) {
+        table[i] = (uint8_t)std::min(255, std::max(1, (base[i] * scale + 50) / 100));
+    }
+}
+
+static int magnitude_bits(int value) {
+    int bits = 0;
+    for (value = std::abs(value); value; value >>= 1) {
+        bits++;
+    }
+    return bits;
+}
+
+namespace {
+
+struct EncoderTables {
+    uint8_t quant[2][64];           // natural order, as written
+    float reciprocal[2][64];
+    HuffmanCodes dc[2];
+    HuffmanCodes ac[2];
+};
+
+} // namespace
+
+static void encode_block(BitWriter& bits, const EncoderTables& tables, int table, const float* samples,
+                         int* predictor) {
+    float coefficients[64];
+    forward_dct(samples, coefficients);
+    int quantized[64];
+    for (int k = 0; k < 64; k++) {
+        int position = ZIGZAG[k];
+        quantized[k] = (int)std::lround(coefficients[position] * tables.reciprocal[table][position]);
+    }
+    int diff = quantized[0] - *predictor;
+    *predictor = quantized[0];
+    int size = magnitude_bits(diff);
+    const HuffmanCodes& dc = tables.dc[table];
+    bits.put(dc.code[size], dc.length[size]);
+    if (size) {
+        bits.put((uint32_t)(diff < 0 ? diff - 1 : diff), size);
+    }
+    const HuffmanCodes& ac = tables.ac[table];
+    int run = 0;
+    for (int k = 1; k < 64; k++) {
+        int value = quantized[k];
+        if (value == 0) {
+            run++;
+            continue;
+        }
+        for (; run > 15; run -= 16) {
+            bits.put(ac.code[0xF0], ac.length[0xF0]);
+        }
+        size = magnitude_bits(value);
+        int symbol = (run << 4) | size;
+        bits.put(ac.code[symbol], ac.length[symbol]);
+        bits.put((uint32_t)(value < 0 ? value - 1 : value), size);
+        run = 0;
+    }
+    if (run) {
+        bits.put(ac.code[0], ac.length[0]);
+    }
+}
+
+// One MCU row: 8 pixel rows of gray, or 16 of colour as four Y blocks plus one
+// averaged Cb and Cr block per MCU
+static void encode_row(const Bitmap& bitmap, const EncoderTables& tables, int row, std::string* out) {
+    BitWriter bits(out);
+    int predictors[3] = {};
+    int last_x = bitmap.width - 1;
+    int last_y = bitmap.height - 1;
+    size_t stride = bitmap.stride();
+    const uint8_t* pixels = bitmap.pixels.data();
+    if (bitmap.components == 1) {
+        float block[64];
+        for (int x0 = 0; x0 < bitmap.width; x0 += 8) {
+            for (int y = 0; y < 8; y++) {
+                const uint8_t* line = pixels + (size_t)std::min(row * 8 + y, last_y) * stride;
+                for (int x = 0; x < 8; x++) {
+                    block[y * 8 + x] = (float)line[std::min(x0 + x, last_x)] - 128;
+                }
+            }
+            encode_block(bits, tables, 0, block, &predictors[0]);
+        }
+        bits.flush();
+        return;
+    }
+    float luma[256];
+    float cb[256];
+    float cr[256];
+    float block[64];
+    for (int x0 = 0; x0 < bitmap.width; x0 += 16) {
+        for (int y = 0; y < 16; y++) {
+            const uint8_t* line = pixels + (size_t)std::min(row * 16 + y, last_y) * stride;
+            for (int x = 0; x < 16; x++) {
+                const uint8_t* rgb = line + (size_t)std::min(x0 + x, last_x) * 3;
+                float r = rgb[0], g = rgb[1], b = rgb[2];
+                luma[y * 16 + x] = 0.299f * r + 0.587f * g + 0.114f * b - 128;
+                cb[y * 16 + x] = -0.168736f * r - 0.331264f * g + 0.5f * b;
+                cr[y * 16 + x] = 0.5f * r - 0.418688f * g - 0.081312f * b;
+            }
+        }
+        for (int by = 0; by < 2; by++) {
+            for (int bx = 0; bx < 2; bx++) {
+                for (int y = 0; y < 8; y++) {
+                    memcpy(block + y * 8, luma + (by * 8 + y) * 16 + bx * 8, 8 * sizeof(float));
+                }
+                encode_block(bits, tables, 0, block, &predictors[0]);
+            }
+        }
+        const float* planes[2] = {cb, cr};
+        for (int c = 0; c < 2; c++) {
+            const float* plane = planes[c];
+            for (int y = 0; y < 8; y++) {
+                for (int x = 0; x < 8; x++) {
+                    const float* p = plane + y * 32 + x * 2;
+                    block[y * 8 + x] = (p[0] + p[1] + p[16] + p[17]) * 0.25f;
+                }
+            }
+            encode_block(bits, tables, 1, block, &predictors[c + 1]);
+        }
+    }
+    bits.flush();
+}
+
+static void put_marker(std::string* out, int marker, size_t length) {
+    out->push_back('\xFF');
+    out->push_back((char)marker);
+    if (length) {
+        out->push_back((char)(length >> 8));
+        out->push_back((char)length);
+    }
+}
+
+static void put_huffman_table(std::string* out, int id, const uint8_t* counts, const uint8_t* values, size_t total) {
+    out->push_back((char)id);
+    out->append((const char*)counts, 16);
+    out->append((const char*)values, total);
+}
+
+bool jpeg_encode(const Bitmap& bitmap, int quality, unsigned threads, std::string* output) {
+    bool color = bitmap.components == 3;
+    if ((bitmap.components != 1 && !color) || bitmap.width < 1 || bitmap.height < 1 || bitmap.width > 0xFFFF ||
+        bitmap.height > 0xFFFF || bitmap.pixels.size() < bitmap.stride() * (size_t)bitmap.height) {
+        return false;
+    }
+    EncoderTables tables;
+    scale_quant(LUMA_QUANT, quality, tables.quant[0]);
+    scale_quant(CHROMA_QUANT, quality, tables.quant[1]);
+    for (int t = 0; t < 2; t++) {
+        for (int i = 0; i < 64; i++) {
+            tables.reciprocal[t][i] = 1.0f / tables.quant[t][i];
+        }
+    }
+    build_codes(DC_LUMA_COUNTS, DC_SYMBOLS, &tables.dc[0]);
+    build_codes(AC_LUMA_COUNTS, AC_LUMA_SYMBOLS, &tables.ac[0]);
+    build_codes(DC_CHROMA_COUNTS, DC_SYMBOLS, &tables.dc[1]);
+    build_codes(AC_CHROMA_COUNTS, AC_CHROMA_SYMBOLS, &tables.ac[1]);
+
+    int mcu = color ? 16 : 8;
+    int mcus_wide = (bitmap.width + mcu - 1) / mcu;
+    int mcus_high = (bitmap.height + mcu - 1) / mcu;
+    std::vector<std::string> rows((size_t)mcus_high);
+    run_parallel(rows.size(), threads, [&](size_t i) { encode_row(bitmap, tables, (int)i, &rows[i]); });
+
+    std::string& out = *output;
+    out.clear();
+    put_marker(&out, 0xD8, 0);
+    put_marker(&out, 0xE0, 16);
+    out.append("JFIF\0\x01\x01\0\0\x01\0\x01\0\0", 14);
+    int tables_used = color ? 2 : 1;
+    put_marker(&out, 0xDB, 2 + 65 * (size_t)tables_used);
+    for (int t = 0; t < tables_used; t++) {
+        out.push_back((char)t);
+        for (int k = 0; k < 64; k++) {
+            out.push_back((char)tables.quant[t][ZIGZAG[k]]);
+        }
+    }
+    int components = bitmap.components;
+    put_marker(&out, 0xC0, 8 + 3 * (size_t)components);
+    out.push_back(8);
+    out.push_back((char)(bitmap.height >> 8));
+    out.push_back((char)bitmap.height);
+    out.push_back((char)(bitmap.width >> 8));
+    out.push_back((char)bitmap.width);
+    out.push_back((char)components);
+    for (int c = 0; c < components; c++) {
+        out.push_back((char)(c + 1));
+        out.push_back(color && c == 0 ? 0x22 : 0x11);
+        out.push_back((char)(c == 0 ? 0 : 1));
+    }
+    put_marker(&out, 0xC4, 2 + (17 + 12 + 17 + 162) * (size_t)tables_used);
+    put_huffman_table(&out, 0x00, DC_LUMA_COUNTS, DC_SYMBOLS, 12);
+    put_huffman_table(&out, 0x10, AC_LUMA_COUNTS, AC_LUMA_SYMBOLS, 162);
+    if (color) {
+        put_huffman_table(&out, 0x01, DC_CHROMA_COUNTS, DC_SYMBOLS, 12);
+        put_huffman_table(&out, 0x11, AC_CHROMA_COUNTS, AC_CHROMA_SYMBOLS, 162);
+    }
+    put_marker(&out, 0xDD, 4);
+    out.push_back((char)(mcus_wide >> 8));
+    out.push_back((char)mcus_wide);
+    put_marker(&out, 0xDA, 6 + 2 * (size_t)components);
+    out.push_back((char)components);
+    for (int c = 0; c < components; c++) {
+        out.push_back((char)(c + 1));
+        out.push_back(c == 0 ? 0x00 : 0x11);
+    }
+    out.push_back(0);
+    out.push_back(63);
+    out.push_back(0);
+    size_t total = out.size() + 2;
+    for (const auto& row : rows) {
+        total += row.size() + 2;
+    }
+    out.reserve(total);
+    for (size_t i = 0; i < rows.size(); i++) {
+        if (i > 0) {
+            put_marker(&out, 0xD0 + (int)((i - 1) % 8), 0);
+        }
+        out += rows[i];
+    }
+    put_marker(&out, 0xD9, 0);
+    return true;
+}
+
+} // namespace spdf
@@ -0,0 +1,26 @@
+#ifndef SPDF_JPEG_H
+#define SPDF_JPEG_H
+
+#include <string>
+#include "spdf_image.h"
+
+namespace spdf {
+
+// Baseline JPEG, as found in /DCTDecode streams. The decoder reads 8-bit
+// sequential (SOF0/SOF1) Huffman-coded files with one or three components
+// and any sampling factors up to 4; progressive, arithmetic-coded, 12-bit and
+// CMYK files are refused so their images are left alone. Restart intervals
+// are decoded in parallel on up to threads threads. color_transform follows
+// /DecodeParms /ColorTransform: -1 takes it from the Adobe marker (YCbCr for
+// three components without one), 0 keeps RGB, 1 converts from YCbCr.
+bool jpeg_decode(const std::string& data, Bitmap* bitmap, std::string* error, unsigned threads = 1,
+                 int color_transform = -1);
+
+// Encodes gray or RGB pixels with the Annex K tables scaled to quality
+// (1-100, as in libjpeg), colour as YCbCr with 4:2:0 chroma. Every MCU row is
+// a restart interval, so rows are encoded (and decoded again) in parallel.
+bool jpeg_encode(const Bitmap& bitmap, int quality, unsigned threads, std::string* output);
+
+} // namespace spdf
+
+#endif // SPDF_JPEG_H
@@ -0,0 +1,145 @@
+#ifndef SPDF_JSON_H
+#define SPDF_JSON_H
+
+#include <cstdint>
+#include <cstdio>
+#include <string>
+
+namespace spdf {
+
+// Minimal JSON object builder for tool output (one flat or nested object per line)
+class JsonWriter {
+public:
+    JsonWriter& begin_object() {
+        separator();
+        out_ += '{';
+        first_ = true;
+        return *this;
+    }
+
+    JsonWriter& end_object() {
+        out_ += '}';
+        first_ = false;
+        return *this;
+    }
+
+    JsonWriter& begin_array(const char* key) {
+        write_key(key);
+        out_ += '[';
+        first_ = true;
+        return *this;
+    }
+
+    JsonWriter& end_array() {
+        out_ += ']';
+        first_ = false;
+        return *this;
+    }
+
+    JsonWriter& key(const char* key) {
+        write_key(key);
+        pending_value_ = true;
+        return *this;
+    }
+
+    JsonWriter& field(const char* key, const std::string& value) {
+        write_key(key);
+        write_string(value);
+        return *this;
+    }
+
+    JsonWriter& field(const char* key, const char* value) { return field(key, std::string(value ? value : "")); }
+
+    JsonWriter& field(const char* key, bool value) {
+        write_key(key);
+        out_ += value ? "true" : "false";
+        return *this;
+    }
+
+    JsonWriter& field(const char* key, int64_t value) {
+        write_key(key);
+        out_ += std::to_string(value);
+        return *this;
+    }
+
+    JsonWriter& field(const char* key, int32_t value) { return field(key, (int64_t)value); }
+    JsonWriter& field(const char* key, uint64_t value) { return field(key, (int64_t)value); }
+
+    JsonWriter& field(const char* key, double value) {
+        write_key(key);
+        char buffer[32];
+        snprintf(buffer, sizeof(buffer), "%.3f", value);
+        out_ += buffer;
+        return *this;
+    }
+
+    // Array elements
+    JsonWriter& value(const std::string& value) {
+        separator();
+        write_string(value);
+        return *this;
+    }
+
+    JsonWriter& value(int64_t value) {
+        separator();
+        out_ += std::to_string(value);
+        return *this;
+    }
+
+    // Pre-serialized JSON (e.g. a nested object built by another writer)
+    JsonWriter& raw_value(const std::string& json) {
+        separator();
+        out_ += json;
+        return *this;
+    }
+
+    const std::string& str() const { return out_; }
+
+private:
+    void separator() {
+        if (pending_value_) {
+            pending_value_ = false;
+            return;
+        }
+        if (!first_) {
+            out_ += ',';
+        }
+        first_ = false;
+    }
+
+    void write_key(const char* key) {
+        separator();
+        write_string(key);
+        out_ += ':';
+    }
+
+    void write_string(const std::string& value) {
+        out_ += '"';
+        for (unsigned char c : value) {
+            switch (c) {
+                case '"': out_ += "\\\""; break;
+                case '\\': out_ += "\\\\"; break;
+                case '\n': out_ += "\\n"; break;
+                case '\r': out_ += "\\r"; break;
+                case '\t': out_ += "\\t"; break;
+                default:
+                    if (c < 0x20) {
+                        char escape[8];
+                        snprintf(escape, sizeof(escape), "\\u%04x", c);
+                        out_ += escape;
+                    } else {
+                        out_ += (char)c;
+                    }
+            }
+        }
+        out_ += '"';
+    }
+
+    std::string out_;
+    bool first_ = true;
+    bool pending_value_ = false;
+};
+
+} // namespace spdf
+
+#endif // SPDF_JSON_H
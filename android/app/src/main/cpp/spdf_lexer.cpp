@@ -0,0 +1,429 @@
+#include "spdf_lexer.h"
+#include <cstring>
+#include "spdf_simd.h"
+
+namespace spdf {
+
+#define W CHAR_WHITESPACE
+#define D CHAR_DELIMITER
+const uint8_t pdf_char_class[256] = {
+    W, 0, 0, 0, 0, 0, 0, 0, 0, W, W, 0, W, W, 0, 0,  // 0x00
+    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,  // 0x10
+    W, 0, 0, 0, 0, D, 0, 0, D, D, 0, 0, 0, 0, 0, D,  // 0x20  space % ( ) /
+    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, D, 0, D, 0,  // 0x30  < >
+    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,  // 0x40
+    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, D, 0, D, 0, 0,  // 0x50  [ ]
+    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,  // 0x60
+    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, D, 0, D, 0, 0,  // 0x70  { }
+};
+#undef W
+#undef D
+
+static int hex_value(unsigned char c) {
+    if (c >= '0' && c <= '9') {
+        return c - '0';
+    }
+    if (c >= 'a' && c <= 'f') {
+        return c - 'a' + 10;
+    }
+    if (c >= 'A' && c <= 'F') {
+        return c - 'A' + 10;
+    }
+    return -1;
+}
+
+void Lexer::skip_whitespace() {
+    while (pos_ < size_) {
+        pos_ += scan_whitespace(data_ + pos_, size_ - pos_);
+        if (pos_ >= size_ || data_[pos_] != '%') {
+            return;
+        }
+        while (pos_ < size_ && data_[pos_] != '\n' && data_[pos_] != '\r') {
+            pos_++;
+        }
+    }
+}
+
+bool Lexer::next(Token* token) {
+    skip_whitespace();
+    token->offset = pos_;
+    if (pos_ >= size_) {
+        token->type = TokenType::End;
+        token->text = std::string_view();
+        return false;
+    }
+
+    char c = data_[pos_];
+    switch (c) {
+        case '(':
+            read_literal_string(token);
+            return true;
+        case '<':
+            if (pos_ + 1 < size_ && data_[pos_ + 1] == '<') {
+                pos_ += 2;
+                token->type = TokenType::DictOpen;
+                token->text = std::string_view(data_ + token->offset, 2);
+            } else {
+                read_hex_string(token);
+            }
+            return true;
+        case '>':
+            // A lone '>' is malformed; consume it as a dictionary close either way
+            pos_ += pos_ + 1 < size_ && data_[pos_ + 1] == '>' ? 2 : 1;
+            token->type = TokenType::DictClose;
+            token->text = std::string_view(data_ + token->offset, pos_ - token->offset);
+            return true;
+        case '[':
+        case ']':
+            pos_++;
+            token->type = c == '[' ? TokenType::ArrayOpen : TokenType::ArrayClose;
+            token->text = std::string_view(data_ + token->offset, 1);
+            return true;
+        case '{':
+        case '}':
+        case ')':
+            // PostScript calculator braces, or a stray ')': single-character keywords
+            pos_++;
+            token->type = TokenType::Keyword;
+            token->text = std::string_view(data_ + token->offset, 1);
+            return true;
+        case '/':
+            read_name(token);
+            return true;
+        default:
+            read_regular(token);
+            return true;
+    }
+}
+
+void Lexer::read_literal_string(Token* token) {
+    pos_++;
+    token->type = TokenType::String;
+    // Strings without escapes, nesting or CRs are returned in place
+    size_t plain = scan_string_plain(data_ + pos_, size_ - pos_);
+    if (pos_ + plain < size_ && data_[pos_ + plain] == ')') {
+        token->text = std::string_view(data_ + pos_, plain);
+        pos_ += plain + 1;
+        return;
+    }
+    scratch_.assign(data_ + pos_, plain);
+    pos_ += plain;
+    int depth = 1;
+    while (pos_ < size_) {
+        char c = data_[pos_++];
+        if (c == '\\') {
+            if (pos_ >= size_) {
+                break;
+            }
+            char e = data_[pos_++];
+            switch (e) {
+                case 'n': scratch_ += '\n'; break;
+                case 'r': scratch_ += '\r'; break;
+                case 't': scratch_ += '\t'; break;
+                case 'b': scratch_ += '\b'; break;
+                case 'f': scratch_ += '\f'; break;
+                case '\r':
+                    // Line continuation
+                    if (pos_ < size_ && data_[pos_] == '\n') {
+                        pos_++;
+                    }
+                    break;
+                case '\n':
+                    break;
+                default:
+                    if (e >= '0' && e <= '7') {
+                        int value = e - '0';
+                        for (int i = 0; i < 2 && pos_ < size_ && data_[pos_] >= '0' && data_[pos_] <= '7'; i++) {
+                            value = value * 8 + (data_[pos_++] - '0');
+                        }
+                        scratch_ += (char)(value & 0xFF);
+                    } else {
+                        // \( \) \\ and unknown escapes keep the character
+                        scratch_ += e;
+                    }
+                    break;
+            }
+        } else if (c == '(') {
+            depth++;
+            scratch_ += c;
+        } else if (c == ')') {
+            if (--depth == 0) {
+                break;
+            }
+            scratch_ += c;
+        } else if (c == '\r') {
+            // An unescaped end-of-line is read as a single newline
+            if (pos_ < size_ && data_[pos_] == '\n') {
+                pos_++;
+            }
+            scratch_ += '\n';
+        } else {
+            scratch_ += c;
+        }
+    }
+    token->text = scratch_;
+}
+
+void Lexer::read_hex_string(Token* token) {
+    scratch_.clear();
+    pos_++;
+    int high = -1;
+    while (pos_ < size_) {
+        unsigned char c = (unsigned char)data_[pos_++];
+        if (c == '>') {
+            break;
+        }
+        int value = hex_value(c);
+        if (value < 0) {
+            continue;
+        }
+        if (high < 0) {
+            high = value;
+        } else {
+            scratch_ += (char)(high << 4 | value);
+            high = -1;
+        }
+    }
+    if (high >= 0) {
+        // Odd digit count: the missing final digit is zero
+        scratch_ += (char)(high << 4);
+    }
+    token->type = TokenType::HexString;
+    token->text = scratch_;
+}
+
+void Lexer::read_name(Token* token) {
+    pos_++;
+    token->type = TokenType::Name;
+    size_t length = scan_regular(data_ + pos_, size_ - pos_);
+    // Names without #xx escapes are returned in place
+    if (!memchr(data_ + pos_, '#', length)) {
+        token->text = std::string_view(data_ + pos_, length);
+        pos_ += length;
+        return;
+    }
+    scratch_.clear();
+    size_t end = pos_ + length;
+    while (pos_ < end) {
+        char c = data_[pos_++];
+        if (c == '#' && pos_ + 1 < end) {
+            int high = hex_value((unsigned char)data_[pos_]);
+            int low = hex_value((unsigned char)data_[pos_ + 1]);
+            if (high >= 0 && low >= 0) {
+                scratch_ += (char)(high << 4 | low);
+                pos_ += 2;
+                continue;
+            }
+        }
+        scratch_ += c;
+    }
+    token->text = scratch_;
+}
+
+// Numbers: [+-]digits[.digits] or [+-].digits; anything else is a keyword
+static inline void parse_regular(const char* p, const char* end, Token* token) {
+    bool negative = false;
+    if (p < end && (*p == '+' || *p == '-')) {
+        negative = *p == '-';
+        p++;
+    }
+    uint64_t integer = 0;
+    int digits = 0;
+    while (p < end && *p >= '0' && *p <= '9') {
+        integer = integer * 10 + (uint64_t)(*p++ - '0');
+        digits++;
+    }
+    if (p == end && digits > 0 && digits <= 18) {
+        token->type = TokenType::Integer;
+        token->integer = negative ? -(int64_t)integer : (int64_t)integer;
+        token->real = (double)token->integer;
+        return;
+    }
+    static const double powers_of_ten[] = {1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9,
+                                           1e10, 1e11, 1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18};
+    double value = (double)integer;
+    if (p < end && *p == '.') {
+        p++;
+        uint64_t fraction = 0;
+        int fraction_digits = 0;
+        while (p < end && *p >= '0' && *p <= '9') {
+            if (fraction_digits < 18) {
+                fraction = fraction * 10 + (uint64_t)(*p - '0');
+                fraction_digits++;
+            }
+            p++;
+            digits++;
+        }
+        value += (double)fraction / powers_of_ten[fraction_digits];
+    }
+    if (p == end && digits > 0) {
+        token->type = TokenType::Real;
+        token->real = negative ? -value : value;
+        token->integer = (int64_t)token->real;
+        return;
+    }
+    token->type = TokenType::Keyword;
+}
+
+void Lexer::read_regular(Token* token) {
+    size_t start = pos_;
+    pos_ += scan_regular(data_ + pos_, size_ - pos_);
+    token->text = std::string_view(data_ + start, pos_ - start);
+    parse_regular(data_ + start, data_ + pos_, token);
+}
+
+bool Lexer::skip_inline_image() {
+    // One whitespace byte separates ID from the data
+    if (pos_ < size_ && is_pdf_whitespace((unsigned char)data_[pos_])) {
+        pos_++;
+    }
+    for (size_t i = pos_; i + 1 < size_; i++) {
+        const char* e = (const char*)memchr(data_ + i, 'E', size_ - 1 - i);
+        if (!e) {
+            break;
+        }
+        i = (size_t)(e - data_);
+        if (data_[i + 1] == 'I' && (i == pos_ || is_pdf_whitespace((unsigned char)data_[i - 1])) &&
+            (i + 2 == size_ || is_pdf_whitespace((unsigned char)data_[i + 2]) ||
+             is_pdf_delimiter((unsigned char)data_[i + 2]))) {
+            pos_ = i + 2;
+            return true;
+        }
+    }
+    pos_ = size_;
+    return false;
+}
+
+// Whitespace and regular-character bitmasks of the 64-byte block holding the
+// scan position; positions only move forward
+class BlockScanner {
+public:
+    BlockScanner(const char* data, size_t size) : data_(data), size_(size) { load(0); }
+
+    // First non-whitespace position at or after pos, or size
+    size_t skip_whitespace(size_t pos) { return skip(pos, &whitespace_); }
+
+    // End of the run of regular characters starting at pos
+    size_t skip_regular(size_t pos) { return skip(pos, &regular_); }
+
+private:
+    size_t skip(size_t pos, const uint64_t* mask) {
+        while (pos < size_) {
+            if (pos - base_ >= 64) {
+                load(pos);
+            }
+            uint64_t stop = ~*mask >> (pos - base_);
+            if (stop) {
+                pos += (size_t)__builtin_ctzll(stop);
+                return pos < size_ ? pos : size_;
+            }
+            pos = base_ + 64;
+        }
+        return size_;
+    }
+
+    void load(size_t pos) {
+        base_ = pos & ~(size_t)63;
+        if (base_ + 64 <= size_) {
+            classify_block(data_ + base_, &whitespace_, &regular_);
+        } else {
+            // Pad the final block with spaces, which end every run at size
+            char padded[64];
+            memset(padded, ' ', sizeof(padded));
+            if (base_ < size_) {
+                memcpy(padded, data_ + base_, size_ - base_);
+            }
+            classify_block(padded, &whitespace_, &regular_);
+        }
+    }
+
+    const char* data_;
+    size_t size_;
+    size_t base_ = 0;
+    uint64_t whitespace_ = 0;
+    uint64_t regular_ = 0;
+};
+
+bool tokenize(const char* data, size_t size, TokenBuffer* out) {
+    out->clear();
+    if (size > UINT32_MAX) {
+        return false;
+    }
+    out->input_ = data;
+    // Content streams average roughly one token per four bytes
+    out->tokens_.reserve(size / 4 + 16);
+
+    // Keywords, numbers, names, arrays and comments are scanned here from the
+    // block masks; strings, hex strings and dictionaries go through the Lexer
+    BlockScanner scanner(data, size);
+    Lexer lexer(data, size);
+    Token token;
+    size_t pos = 0;
+    while ((pos = scanner.skip_whitespace(pos)) < size) {
+        PackedToken packed;
+        packed.offset = (uint32_t)pos;
+        char c = data[pos];
+        if (is_pdf_regular((unsigned char)c)) {
+            size_t end = scanner.skip_regular(pos);
+            parse_regular(data + pos, data + end, &token);
+            packed.type = token.type;
+            packed.text = (uint32_t)pos;
+            packed.text_size = (uint32_t)(end - pos);
+            if (token.type == TokenType::Real) {
+                packed.real = token.real;
+            } else {
+                packed.integer = token.type == TokenType::Integer ? token.integer : 0;
+            }
+            out->tokens_.push_back(packed);
+            pos = end;
+            if (token.type == TokenType::Keyword && end - packed.text == 2 && data[packed.text] == 'I' &&
+                data[packed.text + 1] == 'D') {
+                lexer.seek(pos);
+                lexer.skip_inline_image();
+                pos = lexer.position();
+            }
+            continue;
+        }
+        if (c == '/') {
+            size_t end = scanner.skip_regular(pos + 1);
+            if (!memchr(data + pos + 1, '#', end - pos - 1)) {
+                packed.type = TokenType::Name;
+                packed.text = (uint32_t)(pos + 1);
+                packed.text_size = (uint32_t)(end - pos - 1);
+                out->tokens_.push_back(packed);
+                pos = end;
+                continue;
+            }
+        } else if (c == '[' || c == ']') {
+            packed.type = c == '[' ? TokenType::ArrayOpen : TokenType::ArrayClose;
+            packed.text = (uint32_t)pos;
+            packed.text_size = 1;
+            out->tokens_.push_back(packed);
+            pos++;
+            continue;
+        } else if (c == '%') {
+            while (pos < size && data[pos] != '\n' && data[pos] != '\r') {
+                pos++;
+            }
+            continue;
+        }
+
+        lexer.seek(pos);
+        lexer.next(&token);
+        packed.type = token.type;
+        packed.text_size = (uint32_t)token.text.size();
+        const char* text = token.text.data();
+        if (text >= data && text <= data + size) {
+            packed.text = (uint32_t)(text - data);
+        } else {
+            packed.decoded = true;
+            packed.text = (uint32_t)out->arena_.size();
+            out->arena_.append(token.text.data(), token.text.size());
+        }
+        out->tokens_.push_back(packed);
+        pos = lexer.position();
+    }
+    return true;
+}
+
+} // namespace spdf
@@ -0,0 +1,134 @@
+#ifndef SPDF_LEXER_H
+#define SPDF_LEXER_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace spdf {
+
+enum class TokenType : uint8_t {
+    End,
+    Integer,
+    Real,
+    String,
+    HexString,
+    Name,
+    Keyword,  // true/false/null/obj/R/stream/... and content operators
+    ArrayOpen,
+    ArrayClose,
+    DictOpen,
+    DictClose,
+};
+
+struct Token {
+    TokenType type = TokenType::End;
+    int64_t integer = 0;
+    double real = 0;
+    // Decoded bytes of strings and names, or the keyword. Points into the input
+    // when no decoding was needed, otherwise into the lexer; valid until the next call.
+    std::string_view text;
+    size_t offset = 0;
+};
+
+// Character classes from ISO 32000-1 7.2.2
+enum : uint8_t { CHAR_REGULAR = 0, CHAR_WHITESPACE = 1, CHAR_DELIMITER = 2 };
+extern const uint8_t pdf_char_class[256];
+
+inline bool is_pdf_whitespace(unsigned char c) {
+    return pdf_char_class[c] == CHAR_WHITESPACE;
+}
+inline bool is_pdf_delimiter(unsigned char c) {
+    return pdf_char_class[c] == CHAR_DELIMITER;
+}
+inline bool is_pdf_regular(unsigned char c) {
+    return pdf_char_class[c] == CHAR_REGULAR;
+}
+
+// Tokenizer for PDF object and content-stream syntax over a caller-owned buffer
+class Lexer {
+public:
+    Lexer(const char* data, size_t size) : data_(data), size_(size) {}
+
+    // False at end of input; malformed input degrades to keywords rather than failing
+    bool next(Token* token);
+
+    // Skips whitespace and comments
+    void skip_whitespace();
+
+    // Called after the "ID" operator: moves past the inline image data and its
+    // "EI". False when no terminating EI is found.
+    bool skip_inline_image();
+
+    size_t position() const { return pos_; }
+    void seek(size_t position) { pos_ = position < size_ ? position : size_; }
+    const char* data() const { return data_; }
+    size_t size() const { return size_; }
+
+private:
+    void read_literal_string(Token* token);
+    void read_hex_string(Token* token);
+    void read_name(Token* token);
+    void read_regular(Token* token);
+
+    const char* data_;
+    size_t size_;
+    size_t pos_ = 0;
+    std::string scratch_;
+};
+
+// One token of a TokenBuffer: 24 bytes, no owned memory
+struct PackedToken {
+    TokenType type = TokenType::End;
+    bool decoded = false;    // text lives in the buffer's arena rather than the input
+    uint32_t offset = 0;     // of the token in the input
+    uint32_t text = 0;       // offset of the text in the input or the arena
+    uint32_t text_size = 0;
+    union {
+        int64_t integer;     // Integer tokens
+        double real;         // Real tokens
+    };
+    PackedToken() : integer(0) {}
+};
+
+// Flat token list for a whole content stream. Decoded strings and names share
+// one arena, so after the first use tokenizing allocates nothing. Tokens refer
+// to the input, which must outlive the buffer's use.
+class TokenBuffer {
+public:
+    void clear() {
+        tokens_.clear();
+        arena_.clear();
+        input_ = nullptr;
+    }
+
+    size_t size() const { return tokens_.size(); }
+    bool empty() const { return tokens_.empty(); }
+    const PackedToken& operator[](size_t i) const { return tokens_[i]; }
+    const PackedToken* begin() const { return tokens_.data(); }
+    const PackedToken* end() const { return tokens_.data() + tokens_.size(); }
+
+    std::string_view text(const PackedToken& token) const {
+        return std::string_view((token.decoded ? arena_.data() : input_) + token.text, token.text_size);
+    }
+    double number(const PackedToken& token) const {
+        return token.type == TokenType::Integer ? (double)token.integer : token.type == TokenType::Real ? token.real : 0;
+    }
+
+private:
+    friend bool tokenize(const char* data, size_t size, TokenBuffer* out);
+
+    std::vector<PackedToken> tokens_;
+    std::string arena_;
+    const char* input_ = nullptr;
+};
+
+// Tokenizes data into *out, replacing its contents. Inline image data after
+// "ID" is skipped up to its "EI". False for inputs of 4 GB or more.
+bool tokenize(const char* data, size_t size, TokenBuffer* out);
+
+} // namespace spdf
+
+#endif // SPDF_LEXER_H
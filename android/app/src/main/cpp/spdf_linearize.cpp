@@ -0,0 +1,625 @@
+#include "spdf_linearize.h"
+#include <algorithm>
+#include <cstdio>
+#include <thread>
+#include "spdf_font_subset.h"
+#include "spdf_memory.h"
+#include "spdf_prune.h"
+
+namespace spdf {
+
+static const size_t BATCH_OBJECTS = 4096;
+static const size_t BATCH_BYTES = 32u << 20;
+// Same share of a memory budget as write_document() batches
+static const unsigned BATCH_SHARE = 4;
+static const int MAX_REF_DEPTH = 64;
+// Numbers patched into the head of the file once the layout is known are
+// space-padded to this width so the head's size is fixed up front
+static const size_t FIELD_WIDTH = 10;
+
+namespace {
+
+// MSB-first bit packing for the hint tables
+class BitWriter {
+public:
+    void write(uint64_t value, int bits) {
+        for (int i = bits - 1; i >= 0; i--) {
+            current_ = (uint8_t)(current_ << 1 | ((value >> i) & 1));
+            if (++used_ == 8) {
+                out_ += (char)current_;
+                current_ = 0;
+                used_ = 0;
+            }
+        }
+    }
+
+    // Every item group of a hint table starts on a byte boundary
+    void align() {
+        if (used_) {
+            out_ += (char)(current_ << (8 - used_));
+            current_ = 0;
+            used_ = 0;
+        }
+    }
+
+    size_t size() const { return out_.size(); }
+    std::string take() {
+        align();
+        return std::move(out_);
+    }
+
+private:
+    std::string out_;
+    uint8_t current_ = 0;
+    int used_ = 0;
+};
+
+// Input object numbers in file order, per part of Annex F
+struct Plan {
+    uint32_t catalog = 0;               // part 4
+    std::vector<uint32_t> first_page;   // part 6: page 1 and everything it uses
+    std::vector<uint32_t> pages;        // part 7: later pages, each followed by its private objects
+    std::vector<uint32_t> shared;       // part 8: objects shared by later pages only
+    std::vector<uint32_t> other;        // part 9: page tree nodes, outlines, info, ...
+    std::vector<size_t> section_objects;            // objects in each page's section
+    std::vector<std::vector<uint32_t>> page_shared;  // shared objects used by each later page
+};
+
+struct Layout {
+    std::vector<uint64_t> offsets;  // by output object number
+    std::vector<uint64_t> sizes;
+    uint64_t hint_offset = 0;
+    uint64_t hint_length = 0;
+
+    // Hint table offsets are given as if the hint stream were absent
+    uint64_t adjusted(uint64_t offset) const { return offset > hint_offset ? offset - hint_length : offset; }
+};
+
+} // namespace
+
+static int bits_for(uint64_t value) {
+    int bits = 0;
+    for (; value; value >>= 1) {
+        bits++;
+    }
+    return bits;
+}
+
+static size_t group_bytes(uint64_t bits) {
+    return (size_t)((bits + 7) / 8);
+}
+
+static std::string field(uint64_t value) {
+    std::string text = std::to_string(value);
+    text.resize(std::max(text.size(), FIELD_WIDTH), ' ');
+    return text;
+}
+
+static void collect_refs(const PdfObject& object, bool skip_parent, std::vector<uint32_t>* refs, int depth) {
+    if (depth > MAX_REF_DEPTH) {
+        return;
+    }
+    switch (object.type()) {
+        case PdfType::Reference:
+            refs->push_back(object.as_ref().num);
+            break;
+        case PdfType::Array:
+            for (const auto& item : object.as_array()) {
+                collect_refs(item, false, refs, depth + 1);
+            }
+            break;
+        case PdfType::Dictionary:
+        case PdfType::Stream:
+            for (const auto& entry : object.as_dict()) {
+                if (!skip_parent || entry.first != "Parent") {
+                    collect_refs(entry.second, false, refs, depth + 1);
+                }
+            }
+            break;
+        default:
+            break;
+    }
+}
+
+// Page i as written: its dictionary with the inherited attributes copied in,
+// and with pruned resources when pruning
+static PdfObject page_object(const PdfDocument& document, size_t i, const PrunePlan* prune) {
+    const PdfPage& page = document.page(i);
+    PdfObject object = PdfObject::dict(page.dict);
+    return prune ? prune->apply(page.ref.num, std::move(object)) : object;
+}
+
+// Walks the objects each page uses, stopping at other pages, page tree nodes
+// and the catalog, and assigns every object to its part. False when the page
+// tree cannot be laid out (direct or repeated page objects).
+static bool plan_layout(PdfDocument& document, const SecurityHandler* security, const PrunePlan* prune,
+                        const ObjectReplacements* replacements, Plan* plan) {
+    enum : uint8_t { Unknown, Kept, Dropped, Boundary };
+    uint32_t count = document.object_count();
+    uint32_t root = document.trailer().get("Root").as_ref().num;
+    size_t page_count = document.page_count();
+    if (root == 0 || root >= count) {
+        return false;
+    }
+
+    std::vector<uint8_t> kind(count, Unknown);
+    std::vector<std::vector<uint32_t>> children(count);
+    auto load = [&](uint32_t num) {
+        ObjectRef ref;
+        PdfObject object;
+        if (document.object_ref(num, &ref)) {
+            object = load_for_write(document, ref, security, prune, replacements);
+        }
+        const PdfObject& type = object.as_dict().get("Type");
+        if (object.is_null()) {
+            kind[num] = Dropped;
+        } else if (type.is_name("Page") || type.is_name("Pages") || type.is_name("Catalog")) {
+            kind[num] = Boundary;
+        } else {
+            kind[num] = Kept;
+            collect_refs(object, false, &children[num], 0);
+        }
+    };
+
+    kind[root] = Boundary;
+    for (const auto& page : document.pages()) {
+        ObjectRef ref;
+        if (page.ref.num == 0 || page.ref.num >= count || kind[page.ref.num] == Boundary ||
+            !document.object_ref(page.ref.num, &ref)) {
+            return false;
+        }
+        kind[page.ref.num] = Boundary;
+    }
+
+    std::vector<uint32_t> seen_by(count, UINT32_MAX);
+    std::vector<uint8_t> users(count, 0);
+    std::vector<std::vector<uint32_t>> closures(page_count);
+    std::vector<uint32_t> queue;
+    for (size_t i = 0; i < page_count; i++) {
+        uint32_t page = document.page(i).ref.num;
+        std::vector<uint32_t>& closure = closures[i];
+        closure.push_back(page);
+        seen_by[page] = (uint32_t)i;
+        queue.clear();
+        collect_refs(page_object(document, i, prune), true, &queue, 0);
+        for (size_t head = 0; head < queue.size(); head++) {
+            uint32_t num = queue[head];
+            if (num == 0 || num >= count || seen_by[num] == i) {
+                continue;
+            }
+            seen_by[num] = (uint32_t)i;
+            if (kind[num] == Unknown) {
+                load(num);
+            }
+            if (kind[num] != Kept) {
+                continue;
+            }
+            closure.push_back(num);
+            users[num] = (uint8_t)std::min(users[num] + 1, 2);
+            queue.insert(queue.end(), children[num].begin(), children[num].end());
+        }
+    }
+
+    std::vector<bool> placed(count, false);
+    plan->catalog = root;
+    placed[root] = true;
+    plan->first_page = closures.empty() ? std::vector<uint32_t>() : closures[0];
+    for (uint32_t num : plan->first_page) {
+        placed[num] = true;
+    }
+    plan->section_objects.assign(page_count, 0);
+    plan->page_shared.assign(page_count, std::vector<uint32_t>());
+    if (page_count > 0) {
+        plan->section_objects[0] = plan->first_page.size();
+    }
+    for (size_t i = 1; i < page_count; i++) {
+        plan->pages.push_back(closures[i][0]);
+        placed[closures[i][0]] = true;
+        size_t objects = 1;
+        for (size_t j = 1; j < closures[i].size(); j++) {
+            uint32_t num = closures[i][j];
+            if (users[num] > 1) {
+                plan->page_shared[i].push_back(num);
+            } else if (!placed[num]) {
+                plan->pages.push_back(num);
+                placed[num] = true;
+                objects++;
+            }
+        }
+        plan->section_objects[i] = objects;
+    }
+    for (size_t i = 1; i < page_count; i++) {
+        for (uint32_t num : plan->page_shared[i]) {
+            if (!placed[num]) {
+                plan->shared.push_back(num);
+                placed[num] = true;
+            }
+        }
+    }
+    for (uint32_t num = 1; num < count; num++) {
+        ObjectRef ref;
+        if (placed[num] || !document.object_ref(num, &ref)) {
+            continue;
+        }
+        if (kind[num] == Unknown) {
+            load(num);
+            children[num] = std::vector<uint32_t>();
+        }
+        if (kind[num] != Dropped) {
+            plan->other.push_back(num);
+        }
+    }
+    return true;
+}
+
+// Linearization dictionary and first-page cross-reference section. The size
+// does not depend on the values, so it can be reserved before they are known.
+struct Head {
+    std::string version;
+    uint32_t linearization_num = 0;
+    uint32_t first_page_object = 0;
+    size_t page_count = 0;
+    uint32_t size = 0;
+    PdfDict trailer;  // without /Prev
+
+    uint64_t file_length = 0;
+    uint64_t hint_offset = 0;
+    uint64_t hint_length = 0;
+    uint64_t first_page_end = 0;
+    uint64_t main_xref_entries = 0;
+    uint64_t main_xref = 0;
+    std::vector<uint64_t> offsets;  // objects linearization_num .. size - 1
+
+    std::string build() const {
+        std::string out = "%PDF-" + version + "\n%\xE2\xE3\xCF\xD3\n";
+        out += std::to_string(linearization_num) + " 0 obj\n<</Linearized 1/L " + field(file_length) + "/H [" +
+               field(hint_offset) + " " + field(hint_length) + "]/O " + std::to_string(first_page_object) + "/E " +
+               field(first_page_end) + "/N " + std::to_string(page_count) + "/T " + field(main_xref_entries) +
+               ">>\nendobj\n";
+        out += "xref\n" + std::to_string(linearization_num) + " " + std::to_string(size - linearization_num) + "\n";
+        for (uint64_t offset : offsets) {
+            append_xref_entry(offset, 0, 'n', &out);
+        }
+        out += "trailer\n";
+        std::string dict;
+        write_object(PdfObject::dict(trailer), &dict);
+        dict.resize(dict.size() - 2);
+        out += dict + "/Prev " + field(main_xref) + ">>\nstartxref\n0\n%%EOF\n";
+        return out;
+    }
+
+    // Offset of the linearization dictionary
+    uint64_t linearization_offset() const { return ("%PDF-" + version + "\n%\xE2\xE3\xCF\xD3\n").size(); }
+};
+
+// Upper bound of the hint stream for this plan: everything whose value
+// depends on the layout is counted at its full 32 bits
+static uint64_t hint_bound(const Plan& plan, bool encrypted) {
+    size_t pages = plan.section_objects.size();
+    size_t entries = plan.first_page.size() + plan.shared.size();
+    size_t least = *std::min_element(plan.section_objects.begin(), plan.section_objects.end());
+    size_t most = *std::max_element(plan.section_objects.begin(), plan.section_objects.end());
+    size_t references = 0;
+    size_t most_shared = 0;
+    for (const auto& shared : plan.page_shared) {
+        references += shared.size();
+        most_shared = std::max(most_shared, shared.size());
+    }
+    uint64_t bytes = 36 + 24;
+    bytes += group_bytes((uint64_t)pages * bits_for(most - least));
+    bytes += 2 * group_bytes((uint64_t)pages * 32);
+    bytes += group_bytes((uint64_t)pages * bits_for(most_shared));
+    bytes += group_bytes((uint64_t)references * bits_for(entries));
+    bytes += group_bytes((uint64_t)entries * 32) + group_bytes(entries);
+    // Object framing with /S and /Length, plus AES's IV and padding
+    return bytes + 96 + (encrypted ? 32 : 0);
+}
+
+// Page offset and shared object hint tables (Annex F.4); *shared_offset is /S
+static std::string build_hints(const Plan& plan, const Renumbering& renumbering, const Layout& layout,
+                               size_t* shared_offset) {
+    auto offset_of = [&](uint32_t num) { return layout.offsets[renumbering[num]]; };
+    auto size_of = [&](uint32_t num) { return layout.sizes[renumbering[num]]; };
+
+    // Sections of the pages in file order
+    size_t page_count = plan.section_objects.size();
+    std::vector<uint64_t> lengths(page_count, 0);
+    for (uint32_t num : plan.first_page) {
+        lengths[0] += size_of(num);
+    }
+    size_t next = 0;
+    for (size_t i = 1; i < page_count; i++) {
+        for (size_t j = 0; j < plan.section_objects[i]; j++) {
+            lengths[i] += size_of(plan.pages[next++]);
+        }
+    }
+
+    std::vector<uint32_t> shared_index(renumbering.size(), 0);
+    std::vector<uint64_t> entry_lengths;
+    for (uint32_t num : plan.first_page) {
+        shared_index[num] = (uint32_t)entry_lengths.size();
+        entry_lengths.push_back(size_of(num));
+    }
+    for (uint32_t num : plan.shared) {
+        shared_index[num] = (uint32_t)entry_lengths.size();
+        entry_lengths.push_back(size_of(num));
+    }
+
+    size_t least_objects = *std::min_element(plan.section_objects.begin(), plan.section_objects.end());
+    size_t most_objects = *std::max_element(plan.section_objects.begin(), plan.section_objects.end());
+    uint64_t least_length = *std::min_element(lengths.begin(), lengths.end());
+    uint64_t most_length = *std::max_element(lengths.begin(), lengths.end());
+    size_t most_shared = 0;
+    for (const auto& shared : plan.page_shared) {
+        most_shared = std::max(most_shared, shared.size());
+    }
+    int object_bits = bits_for(most_objects - least_objects);
+    int length_bits = bits_for(most_length - least_length);
+    int count_bits = bits_for(most_shared);
+    int id_bits = bits_for(entry_lengths.size());
+
+    BitWriter hints;
+    hints.write(least_objects, 32);
+    hints.write(layout.adjusted(offset_of(plan.first_page[0])), 32);
+    hints.write(object_bits, 16);
+    hints.write(least_length, 32);
+    hints.write(length_bits, 16);
+    // Content streams are not located separately: offset 0, length of the whole page
+    hints.write(0, 32);
+    hints.write(0, 16);
+    hints.write(least_length, 32);
+    hints.write(length_bits, 16);
+    hints.write(count_bits, 16);
+    hints.write(id_bits, 16);
+    hints.write(0, 16);
+    hints.write(1, 16);
+    for (size_t i = 0; i < page_count; i++) {
+        hints.write(plan.section_objects[i] - least_objects, object_bits);
+    }
+    hints.align();
+    for (size_t i = 0; i < page_count; i++) {
+        hints.write(lengths[i] - least_length, length_bits);
+    }
+    hints.align();
+    for (size_t i = 0; i < page_count; i++) {
+        hints.write(plan.page_shared[i].size(), count_bits);
+    }
+    hints.align();
+    for (size_t i = 0; i < page_count; i++) {
+        for (uint32_t num : plan.page_shared[i]) {
+            hints.write(shared_index[num], id_bits);
+        }
+    }
+    hints.align();
+    for (size_t i = 0; i < page_count; i++) {
+        hints.write(lengths[i] - least_length, length_bits);
+    }
+    hints.align();
+
+    *shared_offset = hints.size();
+    uint64_t least_entry = *std::min_element(entry_lengths.begin(), entry_lengths.end());
+    uint64_t most_entry = *std::max_element(entry_lengths.begin(), entry_lengths.end());
+    int entry_bits = bits_for(most_entry - least_entry);
+    bool has_shared = !plan.shared.empty();
+    hints.write(has_shared ? renumbering[plan.shared[0]] : 0, 32);
+    hints.write(has_shared ? layout.adjusted(offset_of(plan.shared[0])) : 0, 32);
+    hints.write(plan.first_page.size(), 32);
+    hints.write(entry_lengths.size(), 32);
+    hints.write(0, 16);
+    hints.write(least_entry, 32);
+    hints.write(entry_bits, 16);
+    for (uint64_t length : entry_lengths) {
+        hints.write(length - least_entry, entry_bits);
+    }
+    hints.align();
+    // No group carries an MD5 signature, and every group is a single object
+    for (size_t i = 0; i < entry_lengths.size(); i++) {
+        hints.write(0, 1);
+    }
+    return hints.take();
+}
+
+bool write_linearized(PdfDocument& document, const std::string& path, const WriteOptions& options,
+                      std::string* error) {
+    PrunePlan prune;
+    const PrunePlan* pruning = nullptr;
+    if (options.prune) {
+        plan_pruning(document, &prune);
+        pruning = &prune;
+    }
+    unsigned threads = options.threads ? options.threads : std::max(1u, std::thread::hardware_concurrency());
+    ObjectReplacements subset;
+    const ObjectReplacements* replacements = options.replacements;
+    if (options.subset_fonts) {
+        if (replacements) {
+            subset = *replacements;
+        }
+        plan_font_subsetting(document, threads, &subset);
+        replacements = &subset;
+    }
+    Plan plan;
+    if (document.page_count() == 0 || !plan_layout(document, options.security, pruning, replacements, &plan)) {
+        WriteOptions plain = options;
+        plain.linearize = false;
+        plain.subset_fonts = false;
+        plain.replacements = replacements;
+        return write_document(document, path, plain, error);
+    }
+    const SecurityHandler* security = options.security;
+    const PdfDict& trailer = document.trailer();
+
+    // Main section first (parts 7-9), then the first-page section in file order
+    Renumbering renumbering(document.object_count(), 0);
+    uint32_t next = 1;
+    for (const auto* part : {&plan.pages, &plan.shared, &plan.other}) {
+        for (uint32_t num : *part) {
+            renumbering[num] = next++;
+        }
+    }
+    uint32_t main_size = next;
+    Head head;
+    head.linearization_num = next++;
+    renumbering[plan.catalog] = next++;
+    uint32_t encrypt_num = security ? next++ : 0;
+    uint32_t hint_num = next++;
+    for (uint32_t num : plan.first_page) {
+        renumbering[num] = next++;
+    }
+    uint32_t size = next;
+
+    head.version = output_version(document, security);
+    head.first_page_object = renumbering[plan.first_page[0]];
+    head.page_count = document.page_count();
+    head.size = size;
+    head.offsets.assign(size - head.linearization_num, 0);
+    head.trailer.set("Size", PdfObject::integer(size));
+    head.trailer.set("Root", PdfObject::reference(ObjectRef{renumbering[plan.catalog], 0}));
+    const PdfObject& info = trailer.get("Info");
+    if (info.is_ref() && info.as_ref().num < renumbering.size() && renumbering[info.as_ref().num]) {
+        head.trailer.set("Info", PdfObject::reference(ObjectRef{renumbering[info.as_ref().num], 0}));
+    }
+    PdfObject id = output_id(trailer, security);
+    if (id.is_array()) {
+        head.trailer.set("ID", id);
+    }
+    if (security) {
+        head.trailer.set("Encrypt", PdfObject::reference(ObjectRef{encrypt_num, 0}));
+    }
+
+    std::string temp = path + ".tmp";
+    FILE* file = fopen(temp.c_str(), "wb");
+    if (!file) {
+        *error = "cannot create " + temp;
+        return false;
+    }
+    Layout layout;
+    layout.offsets.assign(size, 0);
+    layout.sizes.assign(size, 0);
+    uint64_t position = 0;
+    bool ok = true;
+    auto emit = [&](const std::string& bytes) {
+        ok = ok && fwrite(bytes.data(), 1, bytes.size(), file) == bytes.size();
+        position += bytes.size();
+    };
+
+    // Page objects are rebuilt from the flattened page tree so each carries its inherited attributes
+    std::vector<uint32_t> page_index(document.object_count(), UINT32_MAX);
+    for (size_t i = 0; i < document.page_count(); i++) {
+        page_index[document.page(i).ref.num] = (uint32_t)i;
+    }
+    std::vector<PendingObject> batch;
+    size_t batch_bytes = 0;
+    size_t batch_limit = memory_budget().share(BATCH_BYTES, BATCH_SHARE);
+    auto flush = [&]() {
+        serialize_objects(document, security, renumbering, threads, &batch);
+        for (const auto& pending : batch) {
+            layout.offsets[pending.ref.num] = position;
+            layout.sizes[pending.ref.num] = pending.size();
+            emit(pending.head);
+            emit(pending.stream_bytes());
+            emit(pending.tail);
+        }
+        batch.clear();
+        batch_bytes = 0;
+    };
+    auto add = [&](uint32_t num) {
+        PendingObject pending;
+        pending.ref = ObjectRef{renumbering[num], 0};
+        ObjectRef ref;
+        if (page_index[num] != UINT32_MAX) {
+            pending.object = page_object(document, page_index[num], pruning);
+        } else if (document.object_ref(num, &ref)) {
+            pending.object = load_for_write(document, ref, security, pruning, replacements);
+        }
+        batch_bytes += pending.object.is_stream() ? pending.object.as_stream().data.size() : 64;
+        batch.push_back(std::move(pending));
+        if (batch.size() >= BATCH_OBJECTS || batch_bytes >= batch_limit) {
+            flush();
+        }
+    };
+
+    // The head and the hint stream are written last, into space reserved here
+    std::string reserved = head.build();
+    uint64_t first_xref = reserved.find("xref\n");
+    emit(std::string(reserved.size(), ' '));
+    add(plan.catalog);
+    flush();
+    if (security) {
+        std::string bytes = std::to_string(encrypt_num) + " 0 obj\n";
+        write_object(PdfObject::dict(security->encrypt_dict()), &bytes);
+        bytes += "\nendobj\n";
+        layout.offsets[encrypt_num] = position;
+        emit(bytes);
+    }
+    layout.hint_offset = position;
+    layout.hint_length = hint_bound(plan, security != nullptr);
+    layout.offsets[hint_num] = position;
+    emit(std::string(layout.hint_length, ' '));
+
+    for (uint32_t num : plan.first_page) {
+        add(num);
+    }
+    flush();
+    head.first_page_end = position;
+    for (const auto* part : {&plan.pages, &plan.shared, &plan.other}) {
+        for (uint32_t num : *part) {
+            add(num);
+        }
+    }
+    flush();
+
+    head.main_xref = position;
+    std::string xref = "xref\n0 " + std::to_string(main_size);
+    head.main_xref_entries = position + xref.size();
+    xref += "\n";
+    append_xref_entry(0, 65535, 'f', &xref);
+    for (uint32_t num = 1; num < main_size; num++) {
+        append_xref_entry(layout.offsets[num], 0, 'n', &xref);
+    }
+    PdfDict main_trailer;
+    main_trailer.set("Size", PdfObject::integer(main_size));
+    xref += "trailer\n";
+    write_object(PdfObject::dict(std::move(main_trailer)), &xref);
+    // Readers start from the first-page section, whose trailer points back here with /Prev
+    xref += "\nstartxref\n" + std::to_string(first_xref) + "\n%%EOF\n";
+    emit(xref);
+    head.file_length = position;
+
+    // Hint stream, padded to the reserved length
+    size_t shared_offset = 0;
+    std::string hints = build_hints(plan, renumbering, layout, &shared_offset);
+    PdfDict hint_dict;
+    hint_dict.set("S", PdfObject::integer((int64_t)shared_offset));
+    std::vector<PendingObject> hint(1);
+    hint[0].ref = ObjectRef{hint_num, 0};
+    hint[0].object = PdfObject::stream(std::move(hint_dict), std::move(hints));
+    serialize_objects(document, security, renumbering, 1, &hint);
+    std::string hint_bytes = hint[0].head + hint[0].stream_bytes() + hint[0].tail;
+    if (hint_bytes.size() > layout.hint_length) {
+        ok = false;
+    }
+    hint_bytes.resize(layout.hint_length, ' ');
+    hint_bytes.back() = '\n';
+
+    head.hint_offset = layout.hint_offset;
+    head.hint_length = layout.hint_length;
+    head.offsets[0] = head.linearization_offset();
+    for (uint32_t num = head.linearization_num + 1; num < size; num++) {
+        head.offsets[num - head.linearization_num] = layout.offsets[num];
+    }
+    std::string head_bytes = head.build();
+    ok = ok && fseeko(file, (off_t)layout.hint_offset, SEEK_SET) == 0 &&
+         fwrite(hint_bytes.data(), 1, hint_bytes.size(), file) == hint_bytes.size();
+    ok = ok && fseeko(file, 0, SEEK_SET) == 0 &&
+         fwrite(head_bytes.data(), 1, head_bytes.size(), file) == head_bytes.size();
+
+    ok = fclose(file) == 0 && ok;
+    if (!ok || rename(temp.c_str(), path.c_str()) != 0) {
+        remove(temp.c_str());
+        *error = "cannot write " + path;
+        return false;
+    }
+    return true;
+}
+
+} // namespace spdf
@@ -0,0 +1,25 @@
+#ifndef SPDF_LINEARIZE_H
+#define SPDF_LINEARIZE_H
+
+#include <string>
+#include "spdf_document.h"
+#include "spdf_writer.h"
+
+namespace spdf {
+
+// Linearized ("fast web view") layout, PDF 32000-1 Annex F. The file starts
+// with the linearization dictionary and a cross-reference section for the
+// first page, followed by the catalog, the hint tables and every object the
+// first page needs, so a viewer can show page 1 before the rest has arrived.
+// The remaining pages follow in order, each with its private objects, then
+// the objects shared between pages and finally everything else. Objects are
+// renumbered to match that order.
+//
+// Called by write_document() when WriteOptions::linearize is set. Documents
+// without pages are written with the normal layout.
+bool write_linearized(PdfDocument& document, const std::string& path, const WriteOptions& options,
+                      std::string* error);
+
+} // namespace spdf
+
+#endif // SPDF_LINEARIZE_H
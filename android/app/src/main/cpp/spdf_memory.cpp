@@ -0,0 +1,235 @@
+#include "spdf_memory.h"
+#include <fcntl.h>
+#include <unistd.h>
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cstdlib>
+
+namespace spdf {
+
+// How often a waiting reservation checks whether anything was released
+static const std::chrono::milliseconds RECHECK_INTERVAL(50);
+// A reservation that sees nothing released for this long goes ahead over the
+// limit: whatever holds the memory is not going to let go of it soon
+static const std::chrono::milliseconds PATIENCE(2000);
+// Smallest working buffer share() hands out
+static const uint64_t MIN_SHARE = 1u << 20;
+
+void MemoryBudget::configure(uint64_t limit, const std::string& spill_dir) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    limit_ = limit;
+    spill_dir_ = spill_dir;
+    // A raised or removed limit may let waiters through
+    released_.notify_all();
+}
+
+uint64_t MemoryBudget::limit() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return limit_;
+}
+
+std::string MemoryBudget::spill_dir() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return spill_dir_;
+}
+
+bool MemoryBudget::over() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return limit_ && held_ > limit_;
+}
+
+uint64_t MemoryBudget::share(uint64_t fallback, unsigned parts) const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (!limit_ || !parts) {
+        return fallback;
+    }
+    return std::min(fallback, std::max(MIN_SHARE, limit_ / parts));
+}
+
+void MemoryBudget::acquire(uint64_t bytes) {
+    std::unique_lock<std::mutex> lock(mutex_);
+    uint64_t seen = release_count_;
+    auto idle_since = std::chrono::steady_clock::now();
+    bool asked = false;
+    bool waited = false;
+    while (limit_ && operations_ && held_ + bytes > limit_) {
+        if (!asked) {
+            // Caches give memory back before anyone waits for it
+            uint64_t wanted = held_ + bytes - limit_;
+            asked = true;
+            lock.unlock();
+            reclaim(wanted);
+            lock.lock();
+            continue;
+        }
+        waited = true;
+        released_.wait_for(lock, RECHECK_INTERVAL);
+        auto now = std::chrono::steady_clock::now();
+        if (release_count_ != seen) {
+            seen = release_count_;
+            idle_since = now;
+            asked = false;
+        } else if (now - idle_since >= PATIENCE) {
+            overcommits_++;
+            break;
+        }
+    }
+    waits_ += waited;
+    held_ += bytes;
+    operations_ += bytes;
+    peak_ = std::max(peak_, held_);
+}
+
+void MemoryBudget::account(uint64_t bytes, bool operation) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    held_ += bytes;
+    operations_ += operation ? bytes : 0;
+    peak_ = std::max(peak_, held_);
+}
+
+void MemoryBudget::release(uint64_t bytes, bool operation) {
+    if (!bytes) {
+        return;
+    }
+    std::lock_guard<std::mutex> lock(mutex_);
+    held_ -= std::min(held_, bytes);
+    operations_ -= operation ? std::min(operations_, bytes) : 0;
+    release_count_++;
+    released_.notify_all();
+}
+
+void MemoryBudget::count_spilled(uint64_t bytes) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    spilled_ += bytes;
+}
+
+int MemoryBudget::add_reclaimer(Reclaimer reclaimer) {
+    std::lock_guard<std::mutex> lock(reclaim_mutex_);
+    int id = next_reclaimer_++;
+    reclaimers_.emplace_back(id, std::move(reclaimer));
+    return id;
+}
+
+void MemoryBudget::remove_reclaimer(int id) {
+    std::lock_guard<std::mutex> lock(reclaim_mutex_);
+    reclaimers_.remove_if([id](const std::pair<int, Reclaimer>& entry) { return entry.first == id; });
+}
+
+uint64_t MemoryBudget::reclaim(uint64_t wanted) {
+    std::lock_guard<std::mutex> lock(reclaim_mutex_);
+    uint64_t freed = 0;
+    for (auto& entry : reclaimers_) {
+        if (freed >= wanted) {
+            break;
+        }
+        freed += entry.second(wanted - freed);
+    }
+    return freed;
+}
+
+MemoryBudget::Stats MemoryBudget::stats() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    Stats stats;
+    stats.limit = limit_;
+    stats.held = held_;
+    stats.peak = peak_;
+    stats.waits = waits_;
+    stats.overcommits = overcommits_;
+    stats.spilled = spilled_;
+    return stats;
+}
+
+MemoryBudget& memory_budget() {
+    static MemoryBudget budget;
+    return budget;
+}
+
+MemoryReservation::MemoryReservation(uint64_t bytes) : bytes_(bytes), operation_(true) {
+    memory_budget().acquire(bytes);
+}
+
+MemoryReservation::~MemoryReservation() {
+    memory_budget().release(bytes_, operation_);
+}
+
+MemoryReservation::MemoryReservation(MemoryReservation&& other) noexcept
+    : bytes_(other.bytes_), operation_(other.operation_) {
+    other.bytes_ = 0;
+}
+
+MemoryReservation& MemoryReservation::operator=(MemoryReservation&& other) noexcept {
+    if (this != &other) {
+        memory_budget().release(bytes_, operation_);
+        bytes_ = other.bytes_;
+        operation_ = other.operation_;
+        other.bytes_ = 0;
+    }
+    return *this;
+}
+
+void MemoryReservation::resize(uint64_t bytes) {
+    if (bytes > bytes_) {
+        memory_budget().account(bytes - bytes_, operation_);
+    } else {
+        memory_budget().release(bytes_ - bytes, operation_);
+    }
+    bytes_ = bytes;
+}
+
+SpillFile::~SpillFile() {
+    if (fd_ >= 0) {
+        close(fd_);
+    }
+}
+
+bool SpillFile::open() {
+    std::string dir = memory_budget().spill_dir();
+    if (dir.empty()) {
+        const char* tmp = getenv("TMPDIR");
+        dir = tmp && *tmp ? tmp : "/tmp";
+    }
+    std::string path = dir + "/spdf-spill-XXXXXX";
+    fd_ = mkostemp(&path[0], O_CLOEXEC);
+    if (fd_ < 0) {
+        return false;
+    }
+    unlink(path.c_str());
+    return true;
+}
+
+bool SpillFile::append(const char* data, size_t size, uint64_t* offset) {
+    *offset = size_;
+    size_t done = 0;
+    while (done < size) {
+        ssize_t written = pwrite(fd_, data + done, size - done, (off_t)(size_ + done));
+        if (written < 0 && errno == EINTR) {
+            continue;
+        }
+        if (written <= 0) {
+            return false;
+        }
+        done += (size_t)written;
+    }
+    size_ += size;
+    memory_budget().count_spilled(size);
+    return true;
+}
+
+bool SpillFile::read(uint64_t offset, size_t size, std::string* data) const {
+    data->resize(size);
+    size_t done = 0;
+    while (done < size) {
+        ssize_t got = pread(fd_, &(*data)[done], size - done, (off_t)(offset + done));
+        if (got < 0 && errno == EINTR) {
+            continue;
+        }
+        if (got <= 0) {
+            return false;
+        }
+        done += (size_t)got;
+    }
+    return true;
+}
+
+} // namespace spdf
@@ -0,0 +1,134 @@
+#ifndef SPDF_MEMORY_H
+#define SPDF_MEMORY_H
+
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <list>
+#include <mutex>
+#include <string>
+
+namespace spdf {
+
+// Process-wide memory budget for devices with little RAM
+//
+// Operations reserve the large allocations they are about to hold (a
+// document's bytes, decoded pixels) and account for the ones they keep
+// (prepared objects). Without a limit, reservations are only counted. With
+// one, a reservation that does not fit first asks the reclaimers (caches that
+// can move what they hold to disk) for room, then waits for others to be
+// released, so work slows down near the limit instead of running out of
+// memory. Only what operations hold is waited for: a reservation goes ahead
+// once no other operation holds anything, however much the caches kept, and
+// one that sees nothing released for a while goes ahead over the limit
+// rather than waiting forever. Thread-safe.
+class MemoryBudget {
+public:
+    struct Stats {
+        uint64_t limit = 0;
+        uint64_t held = 0;
+        uint64_t peak = 0;
+        uint64_t waits = 0;        // reservations that had to wait
+        uint64_t overcommits = 0;  // reservations that went ahead over the limit
+        uint64_t spilled = 0;      // bytes moved to spill files
+    };
+    using Reclaimer = std::function<uint64_t(uint64_t wanted)>;
+
+    // limit == 0 removes the limit; spill files go to spill_dir (empty: $TMPDIR or /tmp)
+    void configure(uint64_t limit, const std::string& spill_dir);
+    uint64_t limit() const;
+    std::string spill_dir() const;
+    // More is held than the limit allows
+    bool over() const;
+    // fallback, or the parts-th share of the limit when that is smaller, for
+    // sizing working buffers; never below 1 MB
+    uint64_t share(uint64_t fallback, unsigned parts) const;
+
+    // Waits for room as described above; the bytes are held by an operation
+    void acquire(uint64_t bytes);
+    // Counts memory already allocated, held by an operation or kept by a
+    // cache; never waits
+    void account(uint64_t bytes, bool operation);
+    void release(uint64_t bytes, bool operation);
+    void count_spilled(uint64_t bytes);
+
+    // Registers a callback asked to free about wanted bytes; returns what it
+    // expects to free. It may be called on any thread that acquires.
+    int add_reclaimer(Reclaimer reclaimer);
+    // Returns once no call of it is running
+    void remove_reclaimer(int id);
+
+    Stats stats() const;
+
+private:
+    uint64_t reclaim(uint64_t wanted);
+
+    mutable std::mutex mutex_;
+    std::condition_variable released_;
+    uint64_t limit_ = 0;
+    std::string spill_dir_;
+    uint64_t held_ = 0;
+    uint64_t operations_ = 0;  // the part of held_ operations hold
+    uint64_t peak_ = 0;
+    uint64_t waits_ = 0;
+    uint64_t overcommits_ = 0;
+    uint64_t spilled_ = 0;
+    uint64_t release_count_ = 0;
+
+    // Held while reclaimers run, so removal waits for them
+    std::mutex reclaim_mutex_;
+    std::list<std::pair<int, Reclaimer>> reclaimers_;
+    int next_reclaimer_ = 1;
+};
+
+// Process-wide instance every operation reserves from
+MemoryBudget& memory_budget();
+
+// Bytes of memory_budget() held for as long as it lives: by an operation
+// when it was made with a size, else kept by a cache. Move-only.
+class MemoryReservation {
+public:
+    MemoryReservation() = default;
+    // Waits for room, see MemoryBudget::acquire()
+    explicit MemoryReservation(uint64_t bytes);
+    ~MemoryReservation();
+    MemoryReservation(MemoryReservation&& other) noexcept;
+    MemoryReservation& operator=(MemoryReservation&& other) noexcept;
+    MemoryReservation(const MemoryReservation&) = delete;
+    MemoryReservation& operator=(const MemoryReservation&) = delete;
+
+    // Accounts for memory already allocated or freed; never waits
+    void resize(uint64_t bytes);
+    uint64_t bytes() const { return bytes_; }
+
+private:
+    uint64_t bytes_ = 0;
+    bool operation_ = false;
+};
+
+// Anonymous file in the spill directory, removed as soon as it is created so
+// nothing is left behind; written once by appending, then read from any
+// thread
+class SpillFile {
+public:
+    SpillFile() = default;
+    ~SpillFile();
+    SpillFile(const SpillFile&) = delete;
+    SpillFile& operator=(const SpillFile&) = delete;
+
+    bool open();
+    // Appends size bytes; *offset receives where they start
+    bool append(const char* data, size_t size, uint64_t* offset);
+    // Replaces *data with size bytes at offset
+    bool read(uint64_t offset, size_t size, std::string* data) const;
+    uint64_t size() const { return size_; }
+
+private:
+    int fd_ = -1;
+    uint64_t size_ = 0;
+};
+
+} // namespace spdf
+
+#endif // SPDF_MEMORY_H
@@ -0,0 +1,1338 @@
+#include "spdf_merge.h"
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <cstdio>
+#include <deque>
+#include <fcntl.h>
+#include <functional>
+#include <list>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string_view>
+#include <thread>
+#include <unistd.h>
+#include <unordered_map>
+#include "spdf_document.h"
+#include "spdf_edit.h"
+#include "spdf_file_identity.h"
+#include "spdf_io.h"
+#include "spdf_memory.h"
+#include "spdf_writer.h"
+
+namespace spdf {
+
+// Same batching as write_document()
+static const size_t BATCH_OBJECTS = 4096;
+static const size_t BATCH_BYTES = 32u << 20;
+// Under a memory budget a batch takes at most this share of it, as several
+// inputs are serialised side by side
+static const unsigned BATCH_SHARE = 16;
+// Writes smaller than this are gathered into one request
+static const size_t WRITE_BUFFER = 1u << 20;
+// Same bound as the cross-reference reader, so the output can be read back
+static const uint64_t MAX_OBJECT_NUMBER = 8u << 20;
+// Output numbers of the merged catalog and page tree root; the inputs follow
+static const uint32_t CATALOG_NUM = 1;
+static const uint32_t PAGES_NUM = 2;
+// Session memory held per kept number: its entry in numbers and number_offsets
+static const uint64_t NUMBER_BYTES = 2 * sizeof(uint32_t);
+// What follows the number of a reference serialised under a renumbering: " 0 R"
+static const size_t REF_SUFFIX = 4;
+
+namespace {
+
+// Where the bytes of a spilled object went: head, stream bytes and tail, in
+// that order
+struct SpillSpan {
+    uint64_t offset = 0;
+    uint64_t head = 0;
+    uint64_t body = 0;
+    uint64_t tail = 0;
+};
+
+// The objects of one input serialised under their own numbers, with every
+// number located so they can be written under any other (renumber_head()).
+// Once spilled (spill_objects()) the objects keep only their numbers and
+// their bytes are read back from the spill file.
+struct PreparedObjects {
+    std::vector<PendingObject> objects;
+    uint64_t memory = 0;             // bytes of the objects, in memory or not
+    MemoryReservation reservation;   // the part of them held in memory
+    std::unique_ptr<SpillFile> spill;
+    std::vector<SpillSpan> spans;    // by object, when spilled
+};
+
+// Keeps a reclaimer registered with memory_budget() while in scope
+struct ReclaimerScope {
+    int id;
+    explicit ReclaimerScope(MemoryBudget::Reclaimer reclaimer) : id(memory_budget().add_reclaimer(std::move(reclaimer))) {}
+    ~ReclaimerScope() { memory_budget().remove_reclaimer(id); }
+    ReclaimerScope(const ReclaimerScope&) = delete;
+    ReclaimerScope& operator=(const ReclaimerScope&) = delete;
+};
+
+// One input as seen by the first pass, and where it goes in the output
+struct MergeInput {
+    std::string path;
+    FileIdentity identity;
+    std::string version;
+    uint32_t object_count = 0;
+    uint32_t info = 0;
+    std::vector<uint32_t> pages;  // object numbers in page order
+    // Size of its objects written with their own numbers, and how often each
+    // number was written; uses[object_count] counts the references to the
+    // page tree root
+    uint64_t own_size = 0;
+    std::vector<uint32_t> uses;
+
+    // Kept by the first pass when the input is merged through a MergeSession:
+    // the second pass writes these instead of reopening the file
+    std::shared_ptr<const PreparedObjects> prepared;
+
+    uint32_t base = 0;    // output number = base + input number
+    uint64_t offset = 0;  // of its first object in the output
+    uint64_t size = 0;    // of its objects in the output
+};
+
+// The first failure of any worker is reported; the others stop early
+struct MergeStatus {
+    std::mutex mutex;
+    std::atomic<bool> failed{false};
+    PdfErrorCode error_code = PdfErrorCode_Success;
+    std::string error;
+
+    void fail(PdfErrorCode code, const std::string& message) {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (!failed) {
+            error_code = code;
+            error = message;
+            failed = true;
+        }
+    }
+};
+
+// The output as planned by the first pass
+struct MergeLayout {
+    std::string header;
+    uint32_t size = 0;         // cross-reference entries
+    size_t page_count = 0;
+    uint64_t tail_offset = 0;  // where the catalog and the page tree root go, after the inputs
+    unsigned workers = 1;      // inputs handled side by side
+    unsigned inner = 1;        // threads serialising each of them
+};
+
+// A source of assemble_documents(): the objects its requested pages use,
+// serialised once under their own numbers
+struct AssemblySource {
+    std::string path;
+    std::string version;
+    uint32_t object_count = 0;
+    std::vector<uint32_t> wanted;     // 0-based indices of the pages some output uses
+    bool every_page = false;          // some output uses all of them
+    std::vector<uint32_t> page_nums;  // object number of every page
+    // Replaced by a spilled copy under the batch's lock when memory runs short
+    std::shared_ptr<const PreparedObjects> prepared;
+    std::vector<int32_t> slots;       // index in prepared->objects by object number, -1 when not written
+    // For each wanted page, its object number followed by those of the
+    // objects it uses; other pages are not followed
+    std::vector<std::vector<uint32_t>> closures;
+};
+
+// Writes a contiguous region of the output from one thread: small pieces are
+// gathered into buffers, stream bodies that fill a buffer are written from
+// where they are. Everything is queued on the thread's I/O backend so the
+// writes overlap; the pieces must stay alive until wait().
+struct PositionalWriter {
+    IoBackend* io = nullptr;
+    int fd = -1;
+    uint64_t position = 0;  // output offset of the buffer
+    std::string buffer;
+    std::deque<std::string> queued;  // buffers in flight; a deque never moves them
+    bool ok = true;
+
+    // Output offset of the next byte written
+    uint64_t end() const { return position + buffer.size(); }
+    void write(std::string_view bytes);
+    void flush();
+    // Completes every queued write
+    void wait();
+};
+
+} // namespace
+
+void PositionalWriter::write(std::string_view bytes) {
+    if (buffer.size() + bytes.size() > WRITE_BUFFER) {
+        flush();
+    }
+    if (bytes.size() >= WRITE_BUFFER) {
+        io->write(fd, bytes.data(), bytes.size(), position);
+        position += bytes.size();
+        return;
+    }
+    buffer += bytes;
+}
+
+void PositionalWriter::flush() {
+    if (buffer.empty()) {
+        return;
+    }
+    queued.push_back(std::move(buffer));
+    buffer = std::string();
+    io->write(fd, queued.back().data(), queued.back().size(), position);
+    position += queued.back().size();
+}
+
+void PositionalWriter::wait() {
+    flush();
+    ok = io->wait() && ok;
+    queued.clear();
+}
+
+static int decimal_digits(uint64_t value) {
+    int digits = 1;
+    while (value >= 10) {
+        value /= 10;
+        digits++;
+    }
+    return digits;
+}
+
+static bool open_input(const std::string& path, PdfDocument* document, MergeStatus* status) {
+    std::string error;
+    if (access(path.c_str(), R_OK) != 0) {
+        status->fail(errno == ENOENT ? PdfErrorCode_FileNotFound : PdfErrorCode_PermissionDenied,
+                     "cannot open " + path);
+        return false;
+    }
+    if (!document->open(path, &error)) {
+        status->fail(PdfErrorCode_InvalidPdf, path + ": " + error);
+        return false;
+    }
+    if (document->locked()) {
+        status->fail(PdfErrorCode_EncryptedPdf, path + ": document is password protected");
+        return false;
+    }
+    return true;
+}
+
+// Serialises the objects of one input with renumbering and hands them to sink
+// batch by batch. Its catalog, page tree nodes and (unless keep_info) /Info
+// are left out; pages are written with their inherited attributes and
+// renumbering[count] as /Parent.
+static void serialize_input(PdfDocument& document, uint32_t count, bool keep_info, const Renumbering& renumbering,
+                            unsigned threads, bool record_numbers, const MergeStatus& status,
+                            const std::function<void(std::vector<PendingObject>&)>& sink) {
+    std::unordered_map<uint32_t, const PdfPage*> pages;
+    for (const auto& page : document.pages()) {
+        pages.emplace(page.ref.num, &page);
+    }
+    uint32_t catalog = document.trailer().get("Root").as_ref().num;
+    const PdfObject& info = document.trailer().get("Info");
+    uint32_t skipped_info = info.is_ref() && !keep_info ? info.as_ref().num : 0;
+
+    std::vector<PendingObject> batch;
+    size_t batch_bytes = 0;
+    size_t batch_limit = memory_budget().share(BATCH_BYTES, BATCH_SHARE);
+    auto flush = [&]() {
+        serialize_objects(document, nullptr, renumbering, threads, &batch, record_numbers);
+        sink(batch);
+        batch.clear();
+        batch_bytes = 0;
+    };
+    for (uint32_t num = 1; num < count && !status.failed; num++) {
+        ObjectRef ref;
+        if (num == catalog || num == skipped_info || !document.object_ref(num, &ref)) {
+            continue;
+        }
+        PdfObject object;
+        auto page = pages.find(num);
+        if (page != pages.end()) {
+            PdfDict dict = page->second->dict;
+            dict.set("Parent", PdfObject::reference(ObjectRef{count, 0}));
+            object = PdfObject::dict(std::move(dict));
+        } else {
+            object = load_for_write(document, ref, nullptr);
+            if (object.is_null() || (object.is_dict() && object.as_dict().get("Type").is_name("Pages"))) {
+                continue;
+            }
+        }
+        batch_bytes += object.is_stream() ? object.as_stream().data.size() : 64;
+        PendingObject pending;
+        pending.ref = ObjectRef{renumbering[num], 0};
+        pending.object = std::move(object);
+        batch.push_back(std::move(pending));
+        if (batch.size() >= BATCH_OBJECTS || batch_bytes >= batch_limit) {
+            flush();
+        }
+    }
+    if (!batch.empty() && !status.failed) {
+        flush();
+    }
+}
+
+// First pass: what the input contains and how large it is under its own
+// numbers. With prepare the serialised objects are kept in input->prepared.
+static void measure_input(MergeInput* input, bool keep_info, unsigned threads, bool prepare, MergeStatus* status) {
+    PdfDocument document;
+    if (!FileIdentity::of(input->path, &input->identity) || !open_input(input->path, &document, status)) {
+        if (!status->failed) {
+            status->fail(PdfErrorCode_FileNotFound, "cannot open " + input->path);
+        }
+        return;
+    }
+    input->version = document.version();
+    input->object_count = std::max<uint32_t>(document.object_count(), 1);
+    const PdfObject& info = document.trailer().get("Info");
+    if (keep_info && info.is_ref() && info.as_ref().num < input->object_count) {
+        input->info = info.as_ref().num;
+    }
+    for (const auto& page : document.pages()) {
+        input->pages.push_back(page.ref.num);
+    }
+
+    uint32_t count = input->object_count;
+    Renumbering own(count + 1);
+    for (uint32_t num = 1; num <= count; num++) {
+        own[num] = num;
+    }
+    input->uses.assign(count + 1, 0);
+    bool info_written = false;
+    std::shared_ptr<PreparedObjects> prepared = prepare ? std::make_shared<PreparedObjects>() : nullptr;
+    serialize_input(document, count, keep_info, own, threads, true, *status, [&](std::vector<PendingObject>& batch) {
+        for (auto& pending : batch) {
+            input->own_size += pending.size();
+            for (uint32_t num : pending.numbers) {
+                input->uses[num]++;
+            }
+            info_written = info_written || pending.ref.num == input->info;
+            if (prepared) {
+                // Only stream bodies written from the source still need the parsed object
+                if (!pending.body_is_source) {
+                    pending.object = PdfObject();
+                }
+                prepared->memory += pending.size() + pending.numbers.size() * NUMBER_BYTES;
+                prepared->objects.push_back(std::move(pending));
+            }
+        }
+    });
+    if (!info_written) {
+        input->info = 0;
+    }
+    if (prepared) {
+        prepared->reservation.resize(prepared->memory);
+    }
+    input->prepared = std::move(prepared);
+}
+
+// Output size once the numbers are known: only the digits of the numbers change
+static uint64_t renumbered_size(const MergeInput& input) {
+    int64_t size = (int64_t)input.own_size;
+    uint32_t count = input.object_count;
+    for (uint32_t num = 1; num < count; num++) {
+        if (input.uses[num]) {
+            size += (int64_t)input.uses[num] * (decimal_digits(input.base + num) - decimal_digits(num));
+        }
+    }
+    size += (int64_t)input.uses[count] * (decimal_digits(PAGES_NUM) - decimal_digits(count));
+    return (uint64_t)size;
+}
+
+// Output numbers of an input's objects; its page tree root becomes the merged one
+static Renumbering output_numbers(const MergeInput& input) {
+    uint32_t count = input.object_count;
+    Renumbering renumbering(count + 1);
+    for (uint32_t num = 1; num < count; num++) {
+        renumbering[num] = input.base + num;
+    }
+    renumbering[count] = PAGES_NUM;
+    return renumbering;
+}
+
+// Checks that the second pass wrote exactly what the first one measured
+static void finish_input(const MergeInput& input, PositionalWriter* writer, MergeStatus* status) {
+    writer->wait();
+    if (!writer->ok) {
+        status->fail(PdfErrorCode_IoError, "cannot write the merged file");
+    } else if (!status->failed && writer->position != input.offset + input.size) {
+        // The first pass measured something else, e.g. the file was replaced in between
+        status->fail(PdfErrorCode_IoError, input.path + " changed during the merge");
+    }
+}
+
+// Second pass: the same objects, renumbered and written at the input's offset
+static void write_input(const MergeInput& input, bool keep_info, int fd, unsigned threads,
+                        std::vector<uint64_t>* offsets, MergeStatus* status) {
+    FileIdentity identity;
+    PdfDocument document;
+    if (!FileIdentity::of(input.path, &identity) || identity != input.identity) {
+        status->fail(PdfErrorCode_IoError, input.path + " changed during the merge");
+        return;
+    }
+    if (!open_input(input.path, &document, status)) {
+        return;
+    }
+    uint32_t count = input.object_count;
+    Renumbering renumbering = output_numbers(input);
+
+    PositionalWriter writer;
+    writer.io = &thread_io_backend();
+    writer.fd = fd;
+    writer.position = input.offset;
+    serialize_input(document, count, keep_info, renumbering, threads, false, *status, [&](std::vector<PendingObject>& batch) {
+        for (const auto& pending : batch) {
+            // Each input owns its own range of numbers, so workers never share an entry
+            (*offsets)[pending.ref.num] = writer.end();
+            writer.write(pending.head);
+            writer.write(pending.stream_bytes());
+            writer.write(pending.tail);
+        }
+        // The batch is released once the sink returns
+        writer.wait();
+    });
+    finish_input(input, &writer, status);
+}
+
+// A copy of prepared with the bytes of its objects moved to a spill file;
+// null when the file cannot be written
+static std::shared_ptr<PreparedObjects> spill_objects(const PreparedObjects& prepared) {
+    auto spilled = std::make_shared<PreparedObjects>();
+    spilled->spill.reset(new SpillFile);
+    if (!spilled->spill->open()) {
+        return nullptr;
+    }
+    spilled->memory = prepared.memory;
+    spilled->objects.reserve(prepared.objects.size());
+    spilled->spans.reserve(prepared.objects.size());
+    // Small pieces are gathered, stream bodies that fill the buffer go as they are
+    std::string buffer;
+    uint64_t offset = 0;
+    auto append = [&](const std::string& bytes) {
+        if (buffer.size() + bytes.size() > WRITE_BUFFER) {
+            if (!spilled->spill->append(buffer.data(), buffer.size(), &offset)) {
+                return false;
+            }
+            buffer.clear();
+        }
+        if (bytes.size() >= WRITE_BUFFER) {
+            return spilled->spill->append(bytes.data(), bytes.size(), &offset);
+        }
+        buffer += bytes;
+        return true;
+    };
+    uint64_t kept = 0;
+    for (const auto& pending : prepared.objects) {
+        SpillSpan span;
+        span.offset = spilled->spill->size() + buffer.size();
+        span.head = pending.head.size();
+        span.body = pending.stream_bytes().size();
+        span.tail = pending.tail.size();
+        if (!append(pending.head) || !append(pending.stream_bytes()) || !append(pending.tail)) {
+            return nullptr;
+        }
+        PendingObject numbers;
+        numbers.ref = pending.ref;
+        numbers.numbers = pending.numbers;
+        numbers.number_offsets = pending.number_offsets;
+        kept += sizeof(PendingObject) + sizeof(SpillSpan) + pending.numbers.size() * NUMBER_BYTES;
+        spilled->objects.push_back(std::move(numbers));
+        spilled->spans.push_back(span);
+    }
+    if (!buffer.empty() && !spilled->spill->append(buffer.data(), buffer.size(), &offset)) {
+        return nullptr;
+    }
+    spilled->reservation.resize(kept);
+    return spilled;
+}
+
+// Replaces *prepared with a spilled copy; returns the bytes this frees, which
+// is nothing while another owner still holds the copy in memory
+static uint64_t spill_in_place(std::shared_ptr<const PreparedObjects>* prepared) {
+    if (!*prepared || (*prepared)->spill) {
+        return 0;
+    }
+    std::shared_ptr<PreparedObjects> spilled = spill_objects(**prepared);
+    if (!spilled) {
+        return 0;
+    }
+    uint64_t freed = prepared->use_count() == 1 ? (*prepared)->reservation.bytes() - spilled->reservation.bytes() : 0;
+    *prepared = std::move(spilled);
+    return freed;
+}
+
+// Head, stream bytes and tail of object i of prepared: views of the object
+// itself, or of *buffer when it was spilled and is read back into it
+static bool object_bytes(const PreparedObjects& prepared, size_t i, std::string* buffer, std::string_view* head,
+                         std::string_view* body, std::string_view* tail) {
+    const PendingObject& pending = prepared.objects[i];
+    if (!prepared.spill) {
+        *head = pending.head;
+        *body = pending.stream_bytes();
+        *tail = pending.tail;
+        return true;
+    }
+    const SpillSpan& span = prepared.spans[i];
+    if (!prepared.spill->read(span.offset, span.head + span.body + span.tail, buffer)) {
+        return false;
+    }
+    std::string_view bytes(*buffer);
+    *head = bytes.substr(0, span.head);
+    *body = bytes.substr(span.head, span.body);
+    *tail = bytes.substr(span.head + span.body);
+    return true;
+}
+
+// Stored size of object i of prepared, wherever it is
+static uint64_t object_size(const PreparedObjects& prepared, size_t i) {
+    if (!prepared.spill) {
+        return prepared.objects[i].size();
+    }
+    const SpillSpan& span = prepared.spans[i];
+    return span.head + span.body + span.tail;
+}
+
+// head of an object serialised under its own numbers (those of pending),
+// written as object number with every reference replaced by its output
+// number, or by null where that is 0
+static void renumber_head(std::string_view head, const PendingObject& pending, const Renumbering& renumbering,
+                          uint32_t number, std::string* renumbered) {
+    renumbered->clear();
+    size_t from = 0;
+    for (size_t i = 0; i < pending.numbers.size(); i++) {
+        uint32_t num = pending.numbers[i];
+        uint32_t to = i == 0 ? number : renumbering[num];
+        renumbered->append(head.substr(from, pending.number_offsets[i] - from));
+        from = pending.number_offsets[i] + decimal_digits(num);
+        if (to) {
+            *renumbered += std::to_string(to);
+        } else {
+            *renumbered += "null";
+            from += REF_SUFFIX;
+        }
+    }
+    renumbered->append(head.substr(from));
+}
+
+// Second pass for an input the first pass kept: nothing is parsed again, only
+// the numbers in each object's head are rewritten. Spilled objects are read
+// back a batch at a time.
+static void write_prepared(const MergeInput& input, int fd, unsigned threads, std::vector<uint64_t>* offsets,
+                           MergeStatus* status) {
+    Renumbering renumbering = output_numbers(input);
+    const PreparedObjects& prepared = *input.prepared;
+    size_t batch_limit = memory_budget().share(BATCH_BYTES, BATCH_SHARE);
+
+    PositionalWriter writer;
+    writer.io = &thread_io_backend();
+    writer.fd = fd;
+    writer.position = input.offset;
+    std::vector<std::string> heads;
+    std::vector<std::string> buffers;
+    std::vector<std::string_view> bodies;
+    std::vector<std::string_view> tails;
+    std::atomic<bool> unreadable{false};
+    size_t first = 0;
+    while (first < prepared.objects.size() && !status->failed) {
+        size_t count = 0;
+        uint64_t bytes = 0;
+        while (first + count < prepared.objects.size() && count < BATCH_OBJECTS && (!count || bytes < batch_limit)) {
+            bytes += prepared.spill ? object_size(prepared, first + count) : 0;
+            count++;
+        }
+        heads.assign(count, std::string());
+        buffers.assign(count, std::string());
+        bodies.assign(count, std::string_view());
+        tails.assign(count, std::string_view());
+        run_parallel(count, threads, [&](size_t i) {
+            const PendingObject& pending = prepared.objects[first + i];
+            std::string_view head;
+            if (!object_bytes(prepared, first + i, &buffers[i], &head, &bodies[i], &tails[i])) {
+                unreadable = true;
+                return;
+            }
+            renumber_head(head, pending, renumbering, renumbering[pending.ref.num], &heads[i]);
+        });
+        if (unreadable) {
+            status->fail(PdfErrorCode_IoError, "cannot read back the spilled objects of " + input.path);
+            break;
+        }
+        for (size_t i = 0; i < count; i++) {
+            (*offsets)[renumbering[prepared.objects[first + i].ref.num]] = writer.end();
+            writer.write(heads[i]);
+            writer.write(bodies[i]);
+            writer.write(tails[i]);
+        }
+        // heads and buffers are reused for the next batch
+        writer.wait();
+        first += count;
+    }
+    finish_input(input, &writer, status);
+}
+
+// LRU of first-pass results with their objects, keyed by path and by whether
+// the input came first (only the first input writes its /Info)
+struct MergeSession::State {
+    struct Entry {
+        std::string path;
+        bool first = false;
+        MergeInput input;  // measured and prepared, not yet placed
+    };
+
+    uint64_t max_bytes = 0;
+    mutable std::mutex mutex;
+    std::list<Entry> lru;  // most recently used first
+    std::map<std::pair<std::string, bool>, std::list<Entry>::iterator> index;
+    uint64_t bytes = 0;
+    uint64_t hits = 0;
+    uint64_t misses = 0;
+
+    int reclaimer = 0;  // registered with memory_budget()
+
+    bool lookup(const std::string& path, bool first, const FileIdentity& identity, MergeInput* input);
+    void store(const MergeInput& input, bool first);
+    void erase_locked(std::list<Entry>::iterator it);
+    uint64_t reclaim(uint64_t wanted);
+};
+
+bool MergeSession::State::lookup(const std::string& path, bool first, const FileIdentity& identity,
+                                 MergeInput* input) {
+    std::lock_guard<std::mutex> lock(mutex);
+    auto it = index.find(std::make_pair(path, first));
+    if (it == index.end() || it->second->input.identity != identity) {
+        // A changed file is parsed again; its old objects are of no further use
+        if (it != index.end()) {
+            erase_locked(it->second);
+        }
+        misses++;
+        return false;
+    }
+    lru.splice(lru.begin(), lru, it->second);
+    *input = it->second->input;
+    hits++;
+    return true;
+}
+
+void MergeSession::State::store(const MergeInput& input, bool first) {
+    std::lock_guard<std::mutex> lock(mutex);
+    auto it = index.find(std::make_pair(input.path, first));
+    if (it != index.end()) {
+        erase_locked(it->second);
+    }
+    lru.push_front(Entry{input.path, first, input});
+    index[std::make_pair(input.path, first)] = lru.begin();
+    bytes += input.prepared->memory;
+    while (bytes > max_bytes && !lru.empty()) {
+        erase_locked(std::prev(lru.end()));
+    }
+}
+
+void MergeSession::State::erase_locked(std::list<Entry>::iterator it) {
+    bytes -= it->input.prepared->memory;
+    index.erase(std::make_pair(it->path, it->first));
+    lru.erase(it);
+}
+
+// Spills the least recently used inputs still in memory. Merges using one
+// keep their copy until they finish; later ones read it back.
+uint64_t MergeSession::State::reclaim(uint64_t wanted) {
+    std::lock_guard<std::mutex> lock(mutex);
+    uint64_t freed = 0;
+    for (auto it = lru.rbegin(); it != lru.rend() && freed < wanted; ++it) {
+        freed += spill_in_place(&it->input.prepared);
+    }
+    return freed;
+}
+
+// First pass over every input, then the output numbers and offsets of each.
+// With a session, inputs it holds are taken from it and the others are kept
+// in memory for the second pass (as many as its budget allows) and added to it.
+static bool plan_merge(const std::vector<std::string>& inputs, unsigned threads, MergeSession::State* session,
+                       std::vector<MergeInput>* plan, MergeLayout* layout, MergeStatus* status) {
+    threads = threads ? threads : std::max(1u, std::thread::hardware_concurrency());
+    // Inputs run side by side; cores left over serialise within an input
+    layout->workers = (unsigned)std::min<size_t>(threads, inputs.size());
+    layout->inner = std::max(1u, threads / layout->workers);
+
+    plan->resize(inputs.size());
+    std::vector<bool> prepare(inputs.size(), false);
+    uint64_t budget = session ? session->max_bytes : 0;
+    for (size_t i = 0; i < inputs.size(); i++) {
+        FileIdentity identity;
+        if (session && FileIdentity::of(inputs[i], &identity) &&
+            !session->lookup(inputs[i], i == 0, identity, &(*plan)[i]) && identity.size <= budget) {
+            prepare[i] = true;
+            budget -= identity.size;
+        }
+        (*plan)[i].path = inputs[i];
+    }
+    // Inputs kept for the second pass wait for it on disk when memory runs
+    // short, either right away or when someone asks for room
+    std::vector<std::shared_ptr<const PreparedObjects>> measured(inputs.size());
+    std::mutex measured_mutex;
+    {
+        ReclaimerScope reclaimer([&](uint64_t wanted) {
+            std::lock_guard<std::mutex> lock(measured_mutex);
+            uint64_t freed = 0;
+            for (size_t i = 0; i < measured.size() && freed < wanted; i++) {
+                freed += spill_in_place(&measured[i]);
+            }
+            return freed;
+        });
+        run_parallel(plan->size(), layout->workers, [&](size_t i) {
+            MergeInput& input = (*plan)[i];
+            if (status->failed || input.prepared) {
+                return;
+            }
+            measure_input(&input, i == 0, layout->inner, prepare[i], status);
+            std::lock_guard<std::mutex> lock(measured_mutex);
+            measured[i] = std::move(input.prepared);
+            if (memory_budget().over()) {
+                spill_in_place(&measured[i]);
+            }
+        });
+    }
+    for (size_t i = 0; i < inputs.size(); i++) {
+        if (measured[i]) {
+            (*plan)[i].prepared = std::move(measured[i]);
+        }
+    }
+    if (status->failed) {
+        return false;
+    }
+    for (size_t i = 0; i < inputs.size(); i++) {
+        if (prepare[i]) {
+            session->store((*plan)[i], i == 0);
+        }
+    }
+
+    // Numbers and offsets for every input, now that their sizes are known
+    std::string version = "1.4";
+    for (const auto& input : *plan) {
+        version = std::max(version, input.version);
+    }
+    layout->header = "%PDF-" + version + "\n%\xE2\xE3\xCF\xD3\n";
+    uint64_t next_num = PAGES_NUM + 1;
+    uint64_t position = layout->header.size();
+    for (auto& input : *plan) {
+        input.base = (uint32_t)(next_num - 1);
+        input.offset = position;
+        next_num += input.object_count - 1;
+        if (next_num > MAX_OBJECT_NUMBER) {
+            status->fail(PdfErrorCode_UnsupportedFeature, "too many objects to merge");
+            return false;
+        }
+        input.size = renumbered_size(input);
+        position += input.size;
+        layout->page_count += input.pages.size();
+        input.uses = std::vector<uint32_t>();
+    }
+    layout->size = (uint32_t)next_num;
+    layout->tail_offset = position;
+    return true;
+}
+
+// The catalog, a page tree root over kids, the cross-reference table and
+// the trailer (with info as /Info unless 0), written at tail_offset after
+// the other objects; offsets gets the first two. Every entry has the same
+// width, so the size does not depend on the offsets.
+static std::string document_tail(const std::vector<uint32_t>& kids, uint32_t size, uint32_t info,
+                                 uint64_t tail_offset, std::vector<uint64_t>* offsets) {
+    std::vector<uint64_t>& at = *offsets;
+    std::string tail;
+    at[CATALOG_NUM] = tail_offset + tail.size();
+    tail += std::to_string(CATALOG_NUM) + " 0 obj\n<</Type /Catalog /Pages " + std::to_string(PAGES_NUM) +
+            " 0 R>>\nendobj\n";
+    at[PAGES_NUM] = tail_offset + tail.size();
+    tail += std::to_string(PAGES_NUM) + " 0 obj\n<</Type /Pages /Kids [";
+    for (uint32_t num : kids) {
+        tail += std::to_string(num) + " 0 R ";
+    }
+    if (!kids.empty()) {
+        tail.pop_back();
+    }
+    tail += "] /Count " + std::to_string(kids.size()) + ">>\nendobj\n";
+
+    uint64_t xref_offset = tail_offset + tail.size();
+    tail += "xref\n0 " + std::to_string(size) + "\n";
+    // Free entries form a linked list headed by object 0
+    std::vector<uint32_t> next_free(size, 0);
+    uint32_t following = 0;
+    for (uint32_t num = size - 1; num > 0; num--) {
+        if (!at[num]) {
+            next_free[num] = following;
+            following = num;
+        }
+    }
+    append_xref_entry(following, 65535, 'f', &tail);
+    for (uint32_t num = 1; num < size; num++) {
+        if (at[num]) {
+            append_xref_entry(at[num], 0, 'n', &tail);
+        } else {
+            append_xref_entry(next_free[num], 1, 'f', &tail);
+        }
+    }
+    PdfDict trailer;
+    trailer.set("Size", PdfObject::integer(size));
+    trailer.set("Root", PdfObject::reference(ObjectRef{CATALOG_NUM, 0}));
+    if (info) {
+        trailer.set("Info", PdfObject::reference(ObjectRef{info, 0}));
+    }
+    tail += "trailer\n";
+    write_object(PdfObject::dict(std::move(trailer)), &tail);
+    tail += "\nstartxref\n" + std::to_string(xref_offset) + "\n%%EOF\n";
+    return tail;
+}
+
+// The end of a merged file, after the inputs
+static std::string merge_tail(const std::vector<MergeInput>& plan, const MergeLayout& layout,
+                              std::vector<uint64_t>* offsets) {
+    std::vector<uint32_t> kids;
+    kids.reserve(layout.page_count);
+    for (const auto& input : plan) {
+        for (uint32_t num : input.pages) {
+            kids.push_back(input.base + num);
+        }
+    }
+    // measure_input() cleared info when it was not written
+    uint32_t info = plan[0].info ? plan[0].base + plan[0].info : 0;
+    return document_tail(kids, layout.size, info, layout.tail_offset, offsets);
+}
+
+static bool run_merge(const std::vector<std::string>& inputs, const std::string& output, unsigned threads,
+                      MergeSession::State* session, PdfErrorCode* error_code, std::string* error) {
+    if (inputs.empty()) {
+        *error_code = PdfErrorCode_InvalidParameter;
+        *error = "no input files";
+        return false;
+    }
+    MergeStatus status;
+    std::vector<MergeInput> plan;
+    MergeLayout layout;
+    if (!plan_merge(inputs, threads, session, &plan, &layout, &status)) {
+        *error_code = status.error_code;
+        *error = status.error;
+        return false;
+    }
+    uint64_t tail_offset = layout.tail_offset;
+
+    std::string temp = output + ".tmp";
+    int fd = ::open(temp.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (fd < 0) {
+        *error_code = PdfErrorCode_IoError;
+        *error = "cannot create " + temp;
+        return false;
+    }
+    // Allocate the whole body before the workers scatter their writes over it
+    IoBackend& io = thread_io_backend();
+    bool ok = posix_fallocate(fd, 0, (off_t)tail_offset) == 0 || ftruncate(fd, (off_t)tail_offset) == 0;
+    if (ok) {
+        io.write(fd, layout.header.data(), layout.header.size(), 0);
+        ok = io.wait();
+    }
+
+    std::vector<uint64_t> offsets(layout.size, 0);
+    if (ok) {
+        run_parallel(plan.size(), layout.workers, [&](size_t i) {
+            if (status.failed) {
+                return;
+            }
+            if (plan[i].prepared) {
+                write_prepared(plan[i], fd, layout.inner, &offsets, &status);
+            } else {
+                write_input(plan[i], i == 0, fd, layout.inner, &offsets, &status);
+            }
+        });
+    } else {
+        status.fail(PdfErrorCode_IoError, "cannot allocate " + temp);
+    }
+
+    if (!status.failed) {
+        std::string tail = merge_tail(plan, layout, &offsets);
+        io.write(fd, tail.data(), tail.size(), tail_offset);
+        if (!io.wait()) {
+            status.fail(PdfErrorCode_IoError, "cannot write " + output);
+        }
+    }
+
+    ok = close(fd) == 0 && !status.failed;
+    if (!ok || rename(temp.c_str(), output.c_str()) != 0) {
+        remove(temp.c_str());
+        if (!status.failed) {
+            status.fail(PdfErrorCode_IoError, "cannot write " + output);
+        }
+        *error_code = status.error_code;
+        *error = status.error;
+        return false;
+    }
+    *error_code = PdfErrorCode_Success;
+    return true;
+}
+
+bool merge_documents(const std::vector<std::string>& inputs, const std::string& output, unsigned threads,
+                     PdfErrorCode* error_code, std::string* error) {
+    return run_merge(inputs, output, threads, nullptr, error_code, error);
+}
+
+bool estimate_merge(const std::vector<std::string>& inputs, unsigned threads, uint64_t* size,
+                    PdfErrorCode* error_code, std::string* error) {
+    if (inputs.empty()) {
+        *error_code = PdfErrorCode_InvalidParameter;
+        *error = "no input files";
+        return false;
+    }
+    MergeStatus status;
+    std::vector<MergeInput> plan;
+    MergeLayout layout;
+    if (!plan_merge(inputs, threads, nullptr, &plan, &layout, &status)) {
+        *error_code = status.error_code;
+        *error = status.error;
+        return false;
+    }
+    std::vector<uint64_t> offsets(layout.size, 0);
+    *size = layout.tail_offset + merge_tail(plan, layout, &offsets).size();
+    *error_code = PdfErrorCode_Success;
+    return true;
+}
+
+// Opens a source once and serialises its wanted pages and everything they
+// reach, breadth first: objects are parsed serially and serialised in
+// parallel, and the numbers recorded by the serialiser are the edges followed.
+// Returns the objects, for source->prepared.
+static std::shared_ptr<PreparedObjects> prepare_source(AssemblySource* source, unsigned threads, MergeStatus* status) {
+    auto prepared = std::make_shared<PreparedObjects>();
+    PdfDocument document;
+    if (!open_input(source->path, &document, status)) {
+        return prepared;
+    }
+    source->version = document.version();
+    uint32_t count = std::max<uint32_t>(document.object_count(), 1);
+    source->object_count = count;
+    std::vector<uint8_t> seen(count + 1, 0);
+    std::unordered_map<uint32_t, const PdfPage*> pages;
+    for (const auto& page : document.pages()) {
+        source->page_nums.push_back(page.ref.num);
+        if (page.ref.num < count) {
+            pages.emplace(page.ref.num, &page);
+            // Pages are only written where an output asks for them
+            seen[page.ref.num] = 1;
+        }
+    }
+    const PdfObject& root = document.trailer().get("Root");
+    if (root.is_ref() && root.as_ref().num < count) {
+        seen[root.as_ref().num] = 1;
+    }
+
+    if (source->every_page) {
+        source->wanted.clear();
+        for (uint32_t index = 0; index < source->page_nums.size(); index++) {
+            source->wanted.push_back(index);
+        }
+    }
+    std::vector<uint32_t> frontier;
+    for (uint32_t index : source->wanted) {
+        if (index >= source->page_nums.size()) {
+            status->fail(PdfErrorCode_InvalidParameter, source->path + " has no page " + std::to_string(index + 1) +
+                                                            " (" + std::to_string(source->page_nums.size()) +
+                                                            " pages)");
+            return prepared;
+        }
+        if (source->page_nums[index] < count) {
+            frontier.push_back(source->page_nums[index]);
+        }
+    }
+    std::sort(frontier.begin(), frontier.end());
+    frontier.erase(std::unique(frontier.begin(), frontier.end()), frontier.end());
+
+    Renumbering own(count + 1);
+    for (uint32_t num = 1; num <= count; num++) {
+        own[num] = num;
+    }
+    source->slots.assign(count + 1, -1);
+    std::vector<uint32_t> next;
+    std::vector<PendingObject> batch;
+    while (!frontier.empty() && !status->failed) {
+        next.clear();
+        for (size_t first = 0; first < frontier.size(); first += BATCH_OBJECTS) {
+            batch.clear();
+            for (size_t i = first; i < std::min(frontier.size(), first + BATCH_OBJECTS); i++) {
+                uint32_t num = frontier[i];
+                ObjectRef ref;
+                if (!document.object_ref(num, &ref)) {
+                    continue;
+                }
+                PdfObject object;
+                auto page = pages.find(num);
+                if (page != pages.end()) {
+                    PdfDict dict = page->second->dict;
+                    dict.set("Parent", PdfObject::reference(ObjectRef{count, 0}));
+                    object = PdfObject::dict(std::move(dict));
+                } else {
+                    object = load_for_write(document, ref, nullptr);
+                    if (object.is_null() || (object.is_dict() && object.as_dict().get("Type").is_name("Pages"))) {
+                        continue;
+                    }
+                }
+                PendingObject pending;
+                pending.ref = ObjectRef{num, 0};
+                pending.object = std::move(object);
+                batch.push_back(std::move(pending));
+            }
+            serialize_objects(document, nullptr, own, threads, &batch, true);
+            for (auto& pending : batch) {
+                for (size_t i = 1; i < pending.numbers.size(); i++) {
+                    uint32_t num = pending.numbers[i];
+                    if (num < count && !seen[num]) {
+                        seen[num] = 1;
+                        next.push_back(num);
+                    }
+                }
+                if (!pending.body_is_source) {
+                    pending.object = PdfObject();
+                }
+                source->slots[pending.ref.num] = (int32_t)prepared->objects.size();
+                prepared->memory += pending.size() + pending.numbers.size() * NUMBER_BYTES;
+                prepared->objects.push_back(std::move(pending));
+            }
+        }
+        frontier.swap(next);
+    }
+
+    // What each wanted page uses, for the outputs to number
+    std::vector<uint32_t> stamp(count + 1, 0);
+    source->closures.assign(source->page_nums.size(), std::vector<uint32_t>());
+    for (uint32_t index : source->wanted) {
+        uint32_t page = source->page_nums[index];
+        std::vector<uint32_t>& closure = source->closures[index];
+        if (page >= count || source->slots[page] < 0) {
+            continue;
+        }
+        closure.push_back(page);
+        stamp[page] = index + 1;
+        for (size_t i = 0; i < closure.size(); i++) {
+            const PendingObject& pending = prepared->objects[source->slots[closure[i]]];
+            for (size_t k = 1; k < pending.numbers.size(); k++) {
+                uint32_t num = pending.numbers[k];
+                if (num < count && stamp[num] != index + 1 && source->slots[num] >= 0 && !pages.count(num)) {
+                    stamp[num] = index + 1;
+                    closure.push_back(num);
+                }
+            }
+        }
+    }
+    prepared->reservation.resize(prepared->memory);
+    return prepared;
+}
+
+// Numbers one output and writes it through a temporary file: each page
+// occurrence gets an object of its own, the objects its pages use are
+// written once per output. prepared holds the objects of every source.
+static void write_assembly(const AssemblyOutput& output, const std::vector<AssemblySource>& sources,
+                           const std::vector<std::shared_ptr<const PreparedObjects>>& prepared,
+                           const std::unordered_map<std::string, size_t>& source_index, MergeStatus* status) {
+    // An object as it goes into the output
+    struct Placed {
+        const PreparedObjects* objects;
+        size_t index;
+        const Renumbering* renumbering;
+        uint32_t num;
+    };
+    std::vector<Renumbering> renumberings(sources.size());
+    std::vector<Placed> placed;
+    std::vector<uint32_t> kids;
+    uint64_t next_num = PAGES_NUM + 1;
+    std::string version = "1.4";
+    for (const auto& part : output.parts) {
+        size_t source_number = source_index.at(part.source);
+        const AssemblySource& source = sources[source_number];
+        const PreparedObjects* objects = prepared[source_number].get();
+        Renumbering& renumbering = renumberings[source_number];
+        if (renumbering.empty()) {
+            renumbering.assign(source.object_count + 1, 0);
+            renumbering[source.object_count] = PAGES_NUM;
+            version = std::max(version, source.version);
+        }
+        auto place = [&](uint32_t num) {
+            placed.push_back(Placed{objects, (size_t)source.slots[num], &renumbering, (uint32_t)next_num});
+            return (uint32_t)next_num++;
+        };
+        size_t page_count = part.pages.empty() ? source.page_nums.size() : part.pages.size();
+        for (size_t i = 0; i < page_count; i++) {
+            const std::vector<uint32_t>& closure =
+                source.closures[part.pages.empty() ? i : (size_t)part.pages[i] - 1];
+            if (closure.empty()) {
+                continue;
+            }
+            // A page repeated in the output is written again; references to it go to the first copy
+            uint32_t page = place(closure[0]);
+            kids.push_back(page);
+            if (!renumbering[closure[0]]) {
+                renumbering[closure[0]] = page;
+            }
+            for (size_t k = 1; k < closure.size(); k++) {
+                if (!renumbering[closure[k]]) {
+                    renumbering[closure[k]] = place(closure[k]);
+                }
+            }
+        }
+    }
+    if (next_num > MAX_OBJECT_NUMBER) {
+        status->fail(PdfErrorCode_UnsupportedFeature, output.path + ": too many objects");
+        return;
+    }
+    uint32_t size = (uint32_t)next_num;
+
+    std::string temp = output.path + ".tmp";
+    int fd = ::open(temp.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (fd < 0) {
+        status->fail(PdfErrorCode_IoError, "cannot create " + temp);
+        return;
+    }
+    PositionalWriter writer;
+    writer.io = &thread_io_backend();
+    writer.fd = fd;
+    writer.write("%PDF-" + version + "\n%\xE2\xE3\xCF\xD3\n");
+    std::vector<uint64_t> offsets(size, 0);
+    size_t batch_limit = memory_budget().share(BATCH_BYTES, BATCH_SHARE);
+    std::vector<std::string> heads;
+    std::vector<std::string> buffers;
+    size_t first = 0;
+    while (first < placed.size() && !status->failed) {
+        size_t count = 0;
+        uint64_t bytes = 0;
+        while (first + count < placed.size() && count < BATCH_OBJECTS && (!count || bytes < batch_limit)) {
+            const Placed& object = placed[first + count];
+            bytes += object.objects->spill ? object_size(*object.objects, object.index) : 0;
+            count++;
+        }
+        heads.resize(count);
+        buffers.resize(count);
+        for (size_t i = 0; i < count; i++) {
+            const Placed& object = placed[first + i];
+            std::string_view head, body, tail;
+            if (!object_bytes(*object.objects, object.index, &buffers[i], &head, &body, &tail)) {
+                status->fail(PdfErrorCode_IoError, "cannot read back spilled objects for " + output.path);
+                break;
+            }
+            renumber_head(head, object.objects->objects[object.index], *object.renumbering, object.num, &heads[i]);
+            offsets[object.num] = writer.end();
+            writer.write(heads[i]);
+            writer.write(body);
+            writer.write(tail);
+        }
+        // heads and buffers are reused for the next batch
+        writer.wait();
+        first += count;
+    }
+    std::string tail = document_tail(kids, size, 0, writer.end(), &offsets);
+    writer.write(tail);
+    writer.wait();
+
+    bool ok = close(fd) == 0 && writer.ok && !status->failed;
+    if (!ok || rename(temp.c_str(), output.path.c_str()) != 0) {
+        remove(temp.c_str());
+        status->fail(PdfErrorCode_IoError, "cannot write " + output.path);
+    }
+}
+
+// Splits a plan line at whitespace; double quotes keep spaces in a token,
+// and a '#' that starts a token ends the line
+static std::vector<std::string> plan_tokens(const std::string& line) {
+    std::vector<std::string> tokens;
+    std::string current;
+    bool in_token = false;
+    bool quoted = false;
+    for (char c : line) {
+        if (quoted) {
+            if (c == '"') {
+                quoted = false;
+            } else {
+                current += c;
+            }
+        } else if (c == '"') {
+            quoted = in_token = true;
+        } else if (c == '#' && !in_token) {
+            break;
+        } else if (c == ' ' || c == '\t' || c == '\r') {
+            if (in_token) {
+                tokens.push_back(current);
+                current.clear();
+                in_token = false;
+            }
+        } else {
+            current += c;
+            in_token = true;
+        }
+    }
+    if (in_token) {
+        tokens.push_back(current);
+    }
+    return tokens;
+}
+
+bool parse_assembly_plan(const std::string& text, std::vector<AssemblyOutput>* outputs, std::string* error) {
+    size_t start = 0;
+    int line_number = 0;
+    while (start < text.size()) {
+        size_t end = text.find('\n', start);
+        std::string line = text.substr(start, end == std::string::npos ? std::string::npos : end - start);
+        start = end == std::string::npos ? text.size() : end + 1;
+        line_number++;
+
+        std::vector<std::string> tokens = plan_tokens(line);
+        if (tokens.empty()) {
+            continue;
+        }
+        if (tokens.size() < 2) {
+            *error = "line " + std::to_string(line_number) + ": " + tokens[0] + " has no sources";
+            return false;
+        }
+        AssemblyOutput output;
+        output.path = tokens[0];
+        for (size_t i = 1; i < tokens.size(); i++) {
+            // Paths may contain ':' themselves, so only a page list after
+            // the last one splits the token
+            AssemblyPart part;
+            size_t colon = tokens[i].rfind(':');
+            if (colon != std::string::npos && colon > 0 &&
+                parse_page_list(tokens[i].substr(colon + 1), &part.pages)) {
+                part.source = tokens[i].substr(0, colon);
+            } else {
+                part.pages.clear();
+                part.source = tokens[i];
+            }
+            output.parts.push_back(std::move(part));
+        }
+        outputs->push_back(std::move(output));
+    }
+    if (outputs->empty()) {
+        *error = "no outputs";
+        return false;
+    }
+    return true;
+}
+
+bool assemble_documents(const std::vector<AssemblyOutput>& outputs, unsigned threads, PdfErrorCode* error_code,
+                        std::string* error) {
+    if (outputs.empty()) {
+        *error_code = PdfErrorCode_InvalidParameter;
+        *error = "no outputs";
+        return false;
+    }
+    threads = threads ? threads : std::max(1u, std::thread::hardware_concurrency());
+
+    // Every source once, with the union of the pages asked of it
+    std::vector<AssemblySource> sources;
+    std::unordered_map<std::string, size_t> source_index;
+    for (const auto& output : outputs) {
+        if (output.parts.empty()) {
+            *error_code = PdfErrorCode_InvalidParameter;
+            *error = output.path + ": no pages";
+            return false;
+        }
+        for (const auto& part : output.parts) {
+            auto found = source_index.emplace(part.source, sources.size());
+            if (found.second) {
+                sources.emplace_back();
+                sources.back().path = part.source;
+            }
+            AssemblySource& source = sources[found.first->second];
+            source.every_page = source.every_page || part.pages.empty();
+            for (int32_t page : part.pages) {
+                if (page < 1) {
+                    *error_code = PdfErrorCode_InvalidParameter;
+                    *error = part.source + ": invalid page " + std::to_string(page);
+                    return false;
+                }
+                source.wanted.push_back((uint32_t)page - 1);
+            }
+        }
+    }
+    MergeStatus status;
+    // Sources prepared so far go to disk when memory runs short, the
+    // outputs being written keep the copies they started with
+    std::mutex prepared_mutex;
+    ReclaimerScope reclaimer([&](uint64_t wanted) {
+        std::lock_guard<std::mutex> lock(prepared_mutex);
+        uint64_t freed = 0;
+        for (size_t i = 0; i < sources.size() && freed < wanted; i++) {
+            freed += spill_in_place(&sources[i].prepared);
+        }
+        return freed;
+    });
+    unsigned workers = (unsigned)std::min<size_t>(threads, sources.size());
+    run_parallel(sources.size(), workers, [&](size_t i) {
+        AssemblySource& source = sources[i];
+        std::sort(source.wanted.begin(), source.wanted.end());
+        source.wanted.erase(std::unique(source.wanted.begin(), source.wanted.end()), source.wanted.end());
+        if (!status.failed) {
+            std::shared_ptr<const PreparedObjects> prepared =
+                prepare_source(&source, std::max(1u, threads / workers), &status);
+            std::lock_guard<std::mutex> lock(prepared_mutex);
+            source.prepared = std::move(prepared);
+        }
+    });
+    if (status.failed) {
+        *error_code = status.error_code;
+        *error = status.error;
+        return false;
+    }
+
+    run_parallel(outputs.size(), threads, [&](size_t i) {
+        if (status.failed) {
+            return;
+        }
+        std::vector<std::shared_ptr<const PreparedObjects>> prepared;
+        {
+            std::lock_guard<std::mutex> lock(prepared_mutex);
+            for (const auto& source : sources) {
+                prepared.push_back(source.prepared);
+            }
+        }
+        write_assembly(outputs[i], sources, prepared, source_index, &status);
+    });
+    if (status.failed) {
+        *error_code = status.error_code;
+        *error = status.error;
+        return false;
+    }
+    *error_code = PdfErrorCode_Success;
+    return true;
+}
+
+MergeSession::MergeSession(uint64_t max_bytes) : state_(new State) {
+    state_->max_bytes = max_bytes;
+    State* state = state_.get();
+    state_->reclaimer = memory_budget().add_reclaimer([state](uint64_t wanted) { return state->reclaim(wanted); });
+}
+
+MergeSession::~MergeSession() {
+    memory_budget().remove_reclaimer(state_->reclaimer);
+}
+
+bool MergeSession::merge(const std::vector<std::string>& inputs, const std::string& output, unsigned threads,
+                         PdfErrorCode* error_code, std::string* error) {
+    return run_merge(inputs, output, threads, state_.get(), error_code, error);
+}
+
+MergeSession::Stats MergeSession::stats() const {
+    std::lock_guard<std::mutex> lock(state_->mutex);
+    Stats stats;
+    stats.hits = state_->hits;
+    stats.misses = state_->misses;
+    stats.entries = state_->lru.size();
+    stats.bytes = state_->bytes;
+    for (const auto& entry : state_->lru) {
+        stats.spilled += entry.input.prepared->spill ? entry.input.prepared->memory : 0;
+    }
+    return stats;
+}
+
+void MergeSession::clear() {
+    std::lock_guard<std::mutex> lock(state_->mutex);
+    state_->lru.clear();
+    state_->index.clear();
+    state_->bytes = 0;
+}
+
+} // namespace spdf
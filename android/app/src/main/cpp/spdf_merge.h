@@ -0,0 +1,113 @@
+#ifndef SPDF_MERGE_H
+#define SPDF_MERGE_H
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+#include "spdfcore.h"
+
+namespace spdf {
+
+// Native merge that scales with cores and storage bandwidth. A first pass
+// opens the inputs on worker threads and measures exactly how many bytes
+// each one's objects take in the output, so every input gets its output
+// offset (and its object numbers) up front and the file is allocated at its
+// final size. The second pass reopens the inputs in parallel, serialises
+// them again and writes each batch at its known offset (positional writes
+// queued on the I/O backend, see spdf_io.h); the catalog, the page tree and
+// the cross-reference table are appended once all workers are done.
+//
+// Pages keep their order and inherited attributes and become kids of a
+// single page tree root. Document-level structure of the inputs (outlines,
+// forms, name trees) is not carried over; the first input's /Info is.
+// Encrypted inputs must open with the empty password and the output is
+// written in the clear. Damaged inputs are read through the recovery scan.
+// threads 0 uses every core. Failures are reported with the spdfcore C ABI
+// error codes.
+bool merge_documents(const std::vector<std::string>& inputs, const std::string& output, unsigned threads,
+                     PdfErrorCode* error_code, std::string* error);
+
+// Size in bytes merge_documents() would write for inputs, exactly: its first
+// pass, without the second one or any output file.
+bool estimate_merge(const std::vector<std::string>& inputs, unsigned threads, uint64_t* size,
+                    PdfErrorCode* error_code, std::string* error);
+
+// Pages of one source of an assembled document, in order
+struct AssemblyPart {
+    std::string source;
+    std::vector<int32_t> pages;  // 1-based; empty takes every page
+};
+
+// One document written by assemble_documents()
+struct AssemblyOutput {
+    std::string path;
+    std::vector<AssemblyPart> parts;
+};
+
+// Writes a batch of documents, each assembled from pages of a few sources,
+// in place of a split and a merge per document. The whole batch is planned
+// first: every source is opened once, and the pages any output asks of it
+// are serialised once with everything they use, under the source's own
+// numbers (see MergeSession). The outputs are then written side by side on
+// threads threads (0: every core), each with the objects its pages use and
+// only their numbers rewritten; all of it stays in memory until the batch
+// is done, or is spilled to disk when memory_budget() runs short. Each page of an output is a kid of a single page tree root, and
+// references to pages the output does not contain are written as null.
+// Document-level structure (outlines, forms, /Info) is not carried over.
+// Encrypted sources must open with the empty password. Stops at the first
+// failure; outputs finished by then are kept.
+bool assemble_documents(const std::vector<AssemblyOutput>& outputs, unsigned threads, PdfErrorCode* error_code,
+                        std::string* error);
+
+// Parses an assembly plan: one output per line, "OUTPUT SOURCE[:PAGES]...",
+// e.g. packet1.pdf cover.pdf body1.pdf:2-5 terms.pdf:1,3. Sources without
+// pages contribute all of them; quote paths that contain spaces, and '#'
+// starts a comment.
+bool parse_assembly_plan(const std::string& text, std::vector<AssemblyOutput>* outputs, std::string* error);
+
+// Merges that keep their inputs between calls, for workflows that merge the
+// same cover or terms pages with many different bodies. The first pass of
+// merge_documents() serialises every object of an input anyway; a session
+// keeps those bytes (under the input's own numbers, with each number
+// located) together with what the pass measured. A later merge using the
+// same file neither parses nor reads it again: its objects are written with
+// only their numbers rewritten. Files are keyed by path and checked against
+// their FileIdentity on every use, so a changed file is parsed again.
+// New inputs, kept for the second pass instead of being reopened, count
+// against max_bytes per merge; larger ones are merged as by merge_documents().
+// The least recently used inputs are dropped beyond max_bytes. When
+// memory_budget() runs short, the least recently used inputs still in memory
+// are spilled to disk and read back by the merges that use them; merges keep
+// the inputs they took from the session in memory until they finish, so a
+// merge needs room for those plus twice its largest new input. Thread-safe.
+class MergeSession {
+public:
+    struct Stats {
+        uint64_t hits = 0;    // inputs taken from the session
+        uint64_t misses = 0;  // inputs parsed
+        size_t entries = 0;
+        uint64_t bytes = 0;   // held for the inputs kept
+        uint64_t spilled = 0; // of bytes, on disk rather than in memory
+    };
+
+    explicit MergeSession(uint64_t max_bytes = 64u << 20);
+    ~MergeSession();
+    MergeSession(const MergeSession&) = delete;
+    MergeSession& operator=(const MergeSession&) = delete;
+
+    // Same output and errors as merge_documents()
+    bool merge(const std::vector<std::string>& inputs, const std::string& output, unsigned threads,
+               PdfErrorCode* error_code, std::string* error);
+    Stats stats() const;
+    void clear();
+
+    struct State;
+
+private:
+    std::unique_ptr<State> state_;
+};
+
+} // namespace spdf
+
+#endif // SPDF_MERGE_H
@@ -0,0 +1,111 @@
+#include "spdf_metadata_cache.h"
+#include <cinttypes>
+#include <cstdio>
+#include <cstring>
+#include <vector>
+
+namespace spdf {
+
+bool MetadataCache::lookup(const std::string& path, const FileIdentity& identity, CachedMetadata* metadata) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto it = index_.find(path);
+    if (it == index_.end() || it->second->identity != identity) {
+        misses_++;
+        return false;
+    }
+    lru_.splice(lru_.begin(), lru_, it->second);
+    *metadata = it->second->metadata;
+    hits_++;
+    return true;
+}
+
+void MetadataCache::store(const std::string& path, const FileIdentity& identity, const CachedMetadata& metadata) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    insert_locked(Entry{path, identity, metadata});
+}
+
+void MetadataCache::insert_locked(Entry entry) {
+    auto it = index_.find(entry.path);
+    if (it != index_.end()) {
+        lru_.erase(it->second);
+        index_.erase(it);
+    }
+    lru_.push_front(std::move(entry));
+    index_[lru_.front().path] = lru_.begin();
+    while (lru_.size() > capacity_) {
+        index_.erase(lru_.back().path);
+        lru_.pop_back();
+    }
+}
+
+void MetadataCache::invalidate(const std::string& path) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto it = index_.find(path);
+    if (it != index_.end()) {
+        lru_.erase(it->second);
+        index_.erase(it);
+    }
+}
+
+MetadataCache::Stats MetadataCache::stats() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    Stats stats;
+    stats.hits = hits_;
+    stats.misses = misses_;
+    stats.entries = lru_.size();
+    return stats;
+}
+
+// Format: one entry per line, least recently used first so a reload keeps the order
+// dev \t inode \t size \t mtime_ns \t page_count \t is_valid \t path
+bool MetadataCache::load(const std::string& file) {
+    FILE* in = fopen(file.c_str(), "r");
+    if (!in) {
+        return false;
+    }
+    std::lock_guard<std::mutex> lock(mutex_);
+    std::vector<char> line(8192);
+    while (fgets(line.data(), (int)line.size(), in)) {
+        Entry entry;
+        unsigned valid = 0;
+        int path_offset = 0;
+        if (sscanf(line.data(), "%" SCNu64 "\t%" SCNu64 "\t%" SCNu64 "\t%" SCNd64 "\t%" SCNd32 "\t%u\t%n",
+                   &entry.identity.device, &entry.identity.inode, &entry.identity.size, &entry.identity.mtime_ns,
+                   &entry.metadata.page_count, &valid, &path_offset) != 6 ||
+            path_offset == 0) {
+            continue;
+        }
+        entry.path = line.data() + path_offset;
+        if (!entry.path.empty() && entry.path.back() == '\n') {
+            entry.path.pop_back();
+        }
+        entry.metadata.is_valid = valid != 0;
+        entry.metadata.file_size = entry.identity.size;
+        insert_locked(std::move(entry));
+    }
+    fclose(in);
+    return true;
+}
+
+bool MetadataCache::save(const std::string& file) const {
+    std::string temp = file + ".tmp";
+    FILE* out = fopen(temp.c_str(), "w");
+    if (!out) {
+        return false;
+    }
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        for (auto it = lru_.rbegin(); it != lru_.rend(); ++it) {
+            if (it->path.find_first_of("\t\n") != std::string::npos) {
+                continue;
+            }
+            fprintf(out, "%" PRIu64 "\t%" PRIu64 "\t%" PRIu64 "\t%" PRId64 "\t%" PRId32 "\t%u\t%s\n", it->identity.device,
+                    it->identity.inode, it->identity.size, it->identity.mtime_ns, it->metadata.page_count,
+                    it->metadata.is_valid ? 1u : 0u, it->path.c_str());
+        }
+    }
+    bool ok = fclose(out) == 0;
+    return ok && rename(temp.c_str(), file.c_str()) == 0;
+}
+
+} // namespace spdf
@@ -0,0 +1,59 @@
+#ifndef SPDF_METADATA_CACHE_H
+#define SPDF_METADATA_CACHE_H
+
+#include <cstdint>
+#include <list>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include "spdf_file_identity.h"
+
+namespace spdf {
+
+struct CachedMetadata {
+    int32_t page_count = -1;
+    bool is_valid = false;
+    uint64_t file_size = 0;
+};
+
+// Thread-safe LRU of per-file parse results keyed by path and validated
+// against the file's identity on every lookup. Can be persisted to a small
+// text file so a restarted process starts warm.
+class MetadataCache {
+public:
+    struct Stats {
+        uint64_t hits = 0;
+        uint64_t misses = 0;
+        size_t entries = 0;
+    };
+
+    explicit MetadataCache(size_t capacity = 4096) : capacity_(capacity) {}
+
+    bool lookup(const std::string& path, const FileIdentity& identity, CachedMetadata* metadata);
+    void store(const std::string& path, const FileIdentity& identity, const CachedMetadata& metadata);
+    void invalidate(const std::string& path);
+    Stats stats() const;
+
+    bool load(const std::string& file);
+    bool save(const std::string& file) const;
+
+private:
+    struct Entry {
+        std::string path;
+        FileIdentity identity;
+        CachedMetadata metadata;
+    };
+
+    void insert_locked(Entry entry);
+
+    size_t capacity_;
+    mutable std::mutex mutex_;
+    std::list<Entry> lru_;  // most recently used first
+    std::unordered_map<std::string, std::list<Entry>::iterator> index_;
+    uint64_t hits_ = 0;
+    uint64_t misses_ = 0;
+};
+
+} // namespace spdf
+
+#endif // SPDF_METADATA_CACHE_H
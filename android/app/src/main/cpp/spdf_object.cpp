@@ -0,0 +1,204 @@
+#include "spdf_object.h"
+
+namespace spdf {
+
+PdfObject PdfObject::boolean(bool value) {
+    PdfObject object;
+    object.type_ = PdfType::Boolean;
+    object.scalar_.boolean = value;
+    return object;
+}
+
+PdfObject PdfObject::integer(int64_t value) {
+    PdfObject object;
+    object.type_ = PdfType::Integer;
+    object.scalar_.integer = value;
+    return object;
+}
+
+PdfObject PdfObject::real(double value) {
+    PdfObject object;
+    object.type_ = PdfType::Real;
+    object.scalar_.real = value;
+    return object;
+}
+
+PdfObject PdfObject::string(std::string bytes, bool hex) {
+    PdfObject object;
+    object.type_ = PdfType::String;
+    object.text_ = std::move(bytes);
+    object.hex_ = hex;
+    return object;
+}
+
+PdfObject PdfObject::name(std::string name) {
+    PdfObject object;
+    object.type_ = PdfType::Name;
+    object.text_ = std::move(name);
+    return object;
+}
+
+PdfObject PdfObject::array(PdfArray items) {
+    PdfObject object;
+    object.type_ = PdfType::Array;
+    object.container_ = std::make_shared<PdfArray>(std::move(items));
+    return object;
+}
+
+PdfObject PdfObject::dict(PdfDict entries) {
+    PdfObject object;
+    object.type_ = PdfType::Dictionary;
+    object.container_ = std::make_shared<PdfDict>(std::move(entries));
+    return object;
+}
+
+PdfObject PdfObject::dict() {
+    return dict(PdfDict());
+}
+
+PdfObject PdfObject::stream(PdfDict dict, std::string data) {
+    PdfObject object;
+    object.type_ = PdfType::Stream;
+    auto stream = std::make_shared<PdfStream>();
+    stream->dict = std::move(dict);
+    stream->data = std::move(data);
+    object.container_ = std::move(stream);
+    return object;
+}
+
+PdfObject PdfObject::reference(ObjectRef ref) {
+    PdfObject object;
+    object.type_ = PdfType::Reference;
+    object.scalar_.ref = ref;
+    return object;
+}
+
+int64_t PdfObject::as_int(int64_t fallback) const {
+    if (type_ == PdfType::Integer) {
+        return scalar_.integer;
+    }
+    if (type_ == PdfType::Real) {
+        return (int64_t)scalar_.real;
+    }
+    return fallback;
+}
+
+double PdfObject::as_number(double fallback) const {
+    if (type_ == PdfType::Integer) {
+        return (double)scalar_.integer;
+    }
+    if (type_ == PdfType::Real) {
+        return scalar_.real;
+    }
+    return fallback;
+}
+
+const PdfArray& PdfObject::as_array() const {
+    static const PdfArray empty;
+    return type_ == PdfType::Array ? *static_cast<const PdfArray*>(container_.get()) : empty;
+}
+
+const PdfDict& PdfObject::as_dict() const {
+    static const PdfDict empty;
+    if (type_ == PdfType::Dictionary) {
+        return *static_cast<const PdfDict*>(container_.get());
+    }
+    if (type_ == PdfType::Stream) {
+        return static_cast<const PdfStream*>(container_.get())->dict;
+    }
+    return empty;
+}
+
+const PdfStream& PdfObject::as_stream() const {
+    static const PdfStream empty;
+    return type_ == PdfType::Stream ? *static_cast<const PdfStream*>(container_.get()) : empty;
+}
+
+PdfArray& PdfObject::mutable_array() {
+    return *static_cast<PdfArray*>(container_.get());
+}
+
+PdfDict& PdfObject::mutable_dict() {
+    if (type_ == PdfType::Stream) {
+        return static_cast<PdfStream*>(container_.get())->dict;
+    }
+    return *static_cast<PdfDict*>(container_.get());
+}
+
+PdfStream& PdfObject::mutable_stream() {
+    return *static_cast<PdfStream*>(container_.get());
+}
+
+PdfObject PdfObject::clone() const {
+    switch (type_) {
+        case PdfType::Array: {
+            PdfArray items;
+            items.reserve(as_array().size());
+            for (const auto& item : as_array()) {
+                items.push_back(item.clone());
+            }
+            return array(std::move(items));
+        }
+        case PdfType::Dictionary:
+        case PdfType::Stream: {
+            PdfDict entries;
+            for (const auto& entry : as_dict()) {
+                entries.set(entry.first, entry.second.clone());
+            }
+            if (type_ == PdfType::Stream) {
+                PdfObject copy = stream(std::move(entries), as_stream().data);
+                copy.mutable_stream().encrypted = as_stream().encrypted;
+                copy.mutable_stream().crypt_ref = as_stream().crypt_ref;
+                return copy;
+            }
+            return dict(std::move(entries));
+        }
+        default:
+            return *this;
+    }
+}
+
+const PdfObject* PdfDict::find(const std::string& key) const {
+    for (const auto& entry : entries_) {
+        if (entry.first == key) {
+            return &entry.second;
+        }
+    }
+    return nullptr;
+}
+
+PdfObject* PdfDict::find(const std::string& key) {
+    for (auto& entry : entries_) {
+        if (entry.first == key) {
+            return &entry.second;
+        }
+    }
+    return nullptr;
+}
+
+const PdfObject& PdfDict::get(const std::string& key) const {
+    static const PdfObject null_object;
+    const PdfObject* value = find(key);
+    return value ? *value : null_object;
+}
+
+void PdfDict::set(const std::string& key, PdfObject value) {
+    PdfObject* existing = find(key);
+    if (existing) {
+        *existing = std::move(value);
+    } else {
+        entries_.emplace_back(key, std::move(value));
+    }
+}
+
+bool PdfDict::erase(const std::string& key) {
+    for (auto it = entries_.begin(); it != entries_.end(); ++it) {
+        if (it->first == key) {
+            entries_.erase(it);
+            return true;
+        }
+    }
+    return false;
+}
+
+} // namespace spdf
@@ -0,0 +1,130 @@
+#ifndef SPDF_OBJECT_H
+#define SPDF_OBJECT_H
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace spdf {
+
+struct ObjectRef {
+    uint32_t num = 0;
+    uint16_t gen = 0;
+
+    bool operator==(const ObjectRef& other) const { return num == other.num && gen == other.gen; }
+    bool operator!=(const ObjectRef& other) const { return !(*this == other); }
+    bool operator<(const ObjectRef& other) const { return num != other.num ? num < other.num : gen < other.gen; }
+};
+
+enum class PdfType : uint8_t { Null, Boolean, Integer, Real, String, Name, Array, Dictionary, Stream, Reference };
+
+class PdfObject;
+class PdfDict;
+struct PdfStream;
+using PdfArray = std::vector<PdfObject>;
+
+// One PDF value. Scalars are held inline; arrays, dictionaries and streams are
+// reference counted, so copying an object is cheap and copies share those
+// containers. Accessors are lenient in the way PDF readers have to be: asking
+// a value for the wrong type yields a neutral default instead of failing.
+class PdfObject {
+public:
+    PdfObject() = default;
+
+    static PdfObject boolean(bool value);
+    static PdfObject integer(int64_t value);
+    static PdfObject real(double value);
+    static PdfObject string(std::string bytes, bool hex = false);
+    static PdfObject name(std::string name);
+    static PdfObject array(PdfArray items = PdfArray());
+    static PdfObject dict(PdfDict entries);
+    static PdfObject dict();
+    static PdfObject stream(PdfDict dict, std::string data);
+    static PdfObject reference(ObjectRef ref);
+
+    PdfType type() const { return type_; }
+    bool is_null() const { return type_ == PdfType::Null; }
+    bool is_bool() const { return type_ == PdfType::Boolean; }
+    bool is_int() const { return type_ == PdfType::Integer; }
+    bool is_number() const { return type_ == PdfType::Integer || type_ == PdfType::Real; }
+    bool is_string() const { return type_ == PdfType::String; }
+    bool is_name() const { return type_ == PdfType::Name; }
+    bool is_name(const char* name) const { return type_ == PdfType::Name && text_ == name; }
+    bool is_array() const { return type_ == PdfType::Array; }
+    bool is_dict() const { return type_ == PdfType::Dictionary; }
+    bool is_stream() const { return type_ == PdfType::Stream; }
+    bool is_ref() const { return type_ == PdfType::Reference; }
+
+    bool as_bool(bool fallback = false) const { return type_ == PdfType::Boolean ? scalar_.boolean : fallback; }
+    int64_t as_int(int64_t fallback = 0) const;
+    double as_number(double fallback = 0) const;
+    // String bytes or name characters; empty for other types
+    const std::string& as_string() const { return text_; }
+    const std::string& as_name() const { return text_; }
+    bool hex_string() const { return hex_; }
+    ObjectRef as_ref() const { return type_ == PdfType::Reference ? scalar_.ref : ObjectRef(); }
+
+    // Empty containers for other types; a stream answers as_dict() with its dictionary
+    const PdfArray& as_array() const;
+    const PdfDict& as_dict() const;
+    const PdfStream& as_stream() const;
+    // Mutable access requires the matching type
+    PdfArray& mutable_array();
+    PdfDict& mutable_dict();
+    PdfStream& mutable_stream();
+
+    // Copy that shares nothing with the original
+    PdfObject clone() const;
+
+private:
+    PdfType type_ = PdfType::Null;
+    bool hex_ = false;
+    union Scalar {
+        bool boolean;
+        int64_t integer;
+        double real;
+        ObjectRef ref;
+        Scalar() : integer(0) {}
+    } scalar_;
+    std::string text_;
+    std::shared_ptr<void> container_;
+};
+
+// Dictionary that keeps insertion order so rewritten files stay close to the input
+class PdfDict {
+public:
+    using Entry = std::pair<std::string, PdfObject>;
+
+    const PdfObject* find(const std::string& key) const;
+    PdfObject* find(const std::string& key);
+    // Null object when absent
+    const PdfObject& get(const std::string& key) const;
+    bool has(const std::string& key) const { return find(key) != nullptr; }
+    void set(const std::string& key, PdfObject value);
+    bool erase(const std::string& key);
+
+    size_t size() const { return entries_.size(); }
+    bool empty() const { return entries_.empty(); }
+    std::vector<Entry>::const_iterator begin() const { return entries_.begin(); }
+    std::vector<Entry>::const_iterator end() const { return entries_.end(); }
+    std::vector<Entry>::iterator begin() { return entries_.begin(); }
+    std::vector<Entry>::iterator end() { return entries_.end(); }
+
+private:
+    std::vector<Entry> entries_;
+};
+
+// Stream dictionary plus the stream bytes as stored in the file (still encoded)
+struct PdfStream {
+    PdfDict dict;
+    std::string data;
+    // Set while data is still encrypted with the key of object crypt_ref
+    bool encrypted = false;
+    ObjectRef crypt_ref;
+};
+
+} // namespace spdf
+
+#endif // SPDF_OBJECT_H
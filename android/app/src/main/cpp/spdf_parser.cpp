@@ -0,0 +1,320 @@
+#include "spdf_parser.h"
+#include <cstring>
+#include "spdf_simd.h"
+
+namespace spdf {
+
+// Deeper nesting than this only shows up in hostile files
+static const int MAX_NESTING = 256;
+
+bool ObjectParser::parse(PdfObject* object, std::string* error) {
+    Token token;
+    if (!lexer_.next(&token)) {
+        *error = "unexpected end of data";
+        return false;
+    }
+    return parse_value(token, 0, object, error);
+}
+
+bool ObjectParser::parse_value(const Token& token, int depth, PdfObject* object, std::string* error) {
+    if (depth > MAX_NESTING) {
+        *error = "objects nested too deeply";
+        return false;
+    }
+    switch (token.type) {
+        case TokenType::Integer: {
+            // "n g R" is a reference; anything else leaves the lexer where it was
+            size_t after = lexer_.position();
+            Token generation;
+            Token keyword;
+            if (token.integer >= 0 && lexer_.next(&generation) && generation.type == TokenType::Integer &&
+                lexer_.next(&keyword) && keyword.type == TokenType::Keyword && keyword.text == "R") {
+                ObjectRef ref;
+                ref.num = (uint32_t)token.integer;
+                ref.gen = (uint16_t)generation.integer;
+                *object = PdfObject::reference(ref);
+                return true;
+            }
+            lexer_.seek(after);
+            *object = PdfObject::integer(token.integer);
+            return true;
+        }
+        case TokenType::Real:
+            *object = PdfObject::real(token.real);
+            return true;
+        case TokenType::String:
+        case TokenType::HexString:
+            *object = PdfObject::string(std::string(token.text), token.type == TokenType::HexString);
+            return true;
+        case TokenType::Name:
+            *object = PdfObject::name(std::string(token.text));
+            return true;
+        case TokenType::ArrayOpen: {
+            PdfArray items;
+            Token item;
+            while (lexer_.next(&item) && item.type != TokenType::ArrayClose) {
+                PdfObject value;
+                if (!parse_value(item, depth + 1, &value, error)) {
+                    return false;
+                }
+                items.push_back(std::move(value));
+            }
+            *object = PdfObject::array(std::move(items));
+            return true;
+        }
+        case TokenType::DictOpen: {
+            PdfDict dict;
+            Token key;
+            while (lexer_.next(&key) && key.type != TokenType::DictClose) {
+                if (key.type != TokenType::Name) {
+                    // Stray token where a key belongs: drop it and resynchronise
+                    continue;
+                }
+                std::string name(key.text);
+                Token value_token;
+                if (!lexer_.next(&value_token) || value_token.type == TokenType::DictClose) {
+                    dict.set(name, PdfObject());
+                    break;
+                }
+                PdfObject value;
+                if (!parse_value(value_token, depth + 1, &value, error)) {
+                    return false;
+                }
+                // A null value is equivalent to the key being absent
+                if (!value.is_null()) {
+                    dict.set(name, std::move(value));
+                }
+            }
+            *object = PdfObject::dict(std::move(dict));
+            return true;
+        }
+        case TokenType::Keyword:
+            if (token.text == "true" || token.text == "false") {
+                *object = PdfObject::boolean(token.text == "true");
+                return true;
+            }
+            if (token.text == "null") {
+                *object = PdfObject();
+                return true;
+            }
+            *error = "unexpected keyword '" + std::string(token.text) + "'";
+            return false;
+        case TokenType::ArrayClose:
+        case TokenType::DictClose:
+            *error = "unbalanced '" + std::string(token.text) + "'";
+            return false;
+        case TokenType::End:
+            break;
+    }
+    *error = "unexpected end of data";
+    return false;
+}
+
+bool ObjectParser::parse_indirect(const LengthResolver& resolve_length, ObjectRef* ref, PdfObject* object,
+                                  std::string* error) {
+    Token num;
+    Token gen;
+    Token keyword;
+    if (!lexer_.next(&num) || num.type != TokenType::Integer || !lexer_.next(&gen) ||
+        gen.type != TokenType::Integer || !lexer_.next(&keyword) || keyword.text != "obj") {
+        *error = "expected 'n g obj'";
+        return false;
+    }
+    ref->num = (uint32_t)num.integer;
+    ref->gen = (uint16_t)gen.integer;
+
+    if (!parse(object, error)) {
+        return false;
+    }
+    size_t after_object = lexer_.position();
+    Token next;
+    if (lexer_.next(&next) && next.type == TokenType::Keyword && next.text == "stream" && object->is_dict()) {
+        return read_stream(resolve_length, object, error);
+    }
+    // "endobj" is optional in practice; leave anything else for the caller
+    if (!(next.type == TokenType::Keyword && next.text == "endobj")) {
+        lexer_.seek(after_object);
+    }
+    return true;
+}
+
+bool ObjectParser::read_stream(const LengthResolver& resolve_length, PdfObject* object, std::string* error) {
+    const char* data = lexer_.data();
+    size_t size = lexer_.size();
+    size_t start = lexer_.position();
+    // The keyword is followed by CRLF or LF (a lone CR is tolerated)
+    if (start < size && data[start] == '\r') {
+        start++;
+    }
+    if (start < size && data[start] == '\n') {
+        start++;
+    }
+
+    const PdfObject& length_object = object->as_dict().get("Length");
+    int64_t length = -1;
+    if (length_object.is_int()) {
+        length = length_object.as_int();
+    } else if (length_object.is_ref() && resolve_length) {
+        length = resolve_length(length_object.as_ref());
+    }
+
+    auto endstream_at = [&](size_t position) {
+        while (position < size && is_pdf_whitespace((unsigned char)data[position])) {
+            position++;
+        }
+        return position + 9 <= size && memcmp(data + position, "endstream", 9) == 0;
+    };
+
+    size_t end;
+    if (length >= 0 && (uint64_t)length <= size - start && endstream_at(start + (size_t)length)) {
+        end = start + (size_t)length;
+    } else {
+        // Missing or wrong /Length: take everything up to the next "endstream"
+        end = start + find_bytes(data + start, size - start, "endstream", 9);
+        if (end >= size) {
+            *error = "stream without endstream";
+            return false;
+        }
+        if (end > start && data[end - 1] == '\n') {
+            end--;
+        }
+        if (end > start && data[end - 1] == '\r') {
+            end--;
+        }
+    }
+
+    PdfDict dict = object->as_dict();
+    *object = PdfObject::stream(std::move(dict), std::string(data + start, end - start));
+
+    lexer_.seek(end);
+    Token keyword;
+    lexer_.next(&keyword);  // endstream
+    size_t after = lexer_.position();
+    if (!lexer_.next(&keyword) || keyword.text != "endobj") {
+        lexer_.seek(after);
+    }
+    return true;
+}
+
+bool ContentParser::next(std::vector<PdfObject>* operands, std::string_view* op) {
+    operands->clear();
+    Token token;
+    while (lexer_.next(&token)) {
+        if (token.type == TokenType::Keyword && token.text != "true" && token.text != "false" &&
+            token.text != "null") {
+            *op = token.text;
+            if (token.text == "BI") {
+                // Inline image: key/value pairs up to ID, then raw data up to EI
+                PdfDict dict;
+                Token key;
+                while (lexer_.next(&key) && !(key.type == TokenType::Keyword && key.text == "ID")) {
+                    if (key.type != TokenType::Name) {
+                        continue;
+                    }
+                    std::string name(key.text);
+                    Token value_token;
+                    PdfObject value;
+                    if (!lexer_.next(&value_token) || !parse_operand(value_token, 0, &value)) {
+                        break;
+                    }
+                    dict.set(name, std::move(value));
+                }
+                lexer_.skip_inline_image();
+                operands->push_back(PdfObject::dict(std::move(dict)));
+            }
+            return true;
+        }
+        PdfObject operand;
+        if (parse_operand(token, 0, &operand)) {
+            operands->push_back(std::move(operand));
+        }
+    }
+    return false;
+}
+
+bool ContentParser::parse_operand(const Token& token, int depth, PdfObject* object) {
+    if (depth > MAX_NESTING) {
+        return false;
+    }
+    switch (token.type) {
+        case TokenType::Integer:
+            *object = PdfObject::integer(token.integer);
+            return true;
+        case TokenType::Real:
+            *object = PdfObject::real(token.real);
+            return true;
+        case TokenType::String:
+        case TokenType::HexString:
+            *object = PdfObject::string(std::string(token.text), token.type == TokenType::HexString);
+            return true;
+        case TokenType::Name:
+            *object = PdfObject::name(std::string(token.text));
+            return true;
+        case TokenType::ArrayOpen: {
+            PdfArray items;
+            Token item;
+            while (lexer_.next(&item) && item.type != TokenType::ArrayClose) {
+                PdfObject value;
+                if (parse_operand(item, depth + 1, &value)) {
+                    items.push_back(std::move(value));
+                }
+            }
+            *object = PdfObject::array(std::move(items));
+            return true;
+        }
+        case TokenType::DictOpen: {
+            PdfDict dict;
+            Token key;
+            while (lexer_.next(&key) && key.type != TokenType::DictClose) {
+                if (key.type != TokenType::Name) {
+                    continue;
+                }
+                std::string name(key.text);
+                Token value_token;
+                PdfObject value;
+                if (!lexer_.next(&value_token) || value_token.type == TokenType::DictClose) {
+                    break;
+                }
+                if (parse_operand(value_token, depth + 1, &value)) {
+                    dict.set(name, std::move(value));
+                }
+            }
+            *object = PdfObject::dict(std::move(dict));
+            return true;
+        }
+        case TokenType::Keyword:
+            if (token.text == "true" || token.text == "false") {
+                *object = PdfObject::boolean(token.text == "true");
+                return true;
+            }
+            if (token.text == "null") {
+                *object = PdfObject();
+                return true;
+            }
+            return false;
+        default:
+            return false;
+    }
+}
+
+Matrix Matrix::of(const std::vector<PdfObject>& values) {
+    Matrix m;
+    if (values.size() >= 6) {
+        m.a = values[0].as_number(), m.b = values[1].as_number(), m.c = values[2].as_number();
+        m.d = values[3].as_number(), m.e = values[4].as_number(), m.f = values[5].as_number();
+    }
+    return m;
+}
+
+Matrix Matrix::multiply(const Matrix& other) const {
+    Matrix result;
+    result.a = a * other.a + b * other.c;
+    result.b = a * other.b + b * other.d;
+    result.c = c * other.a + d * other.c;
+    result.d = c * other.b + d * other.d;
+    result.e = e * other.a + f * other.c + other.e;
+    result.f = e * other.b + f * other.d + other.f;
+    return result;
+}
+
+} // namespace spdf
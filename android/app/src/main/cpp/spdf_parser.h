@@ -0,0 +1,66 @@
+#ifndef SPDF_PARSER_H
+#define SPDF_PARSER_H
+
+#include <functional>
+#include <string>
+#include <string_view>
+#include <vector>
+#include "spdf_lexer.h"
+#include "spdf_object.h"
+
+namespace spdf {
+
+// Builds PdfObjects from the tokens of file-level object syntax
+class ObjectParser {
+public:
+    // Returns the value of an indirect /Length, or -1 when it cannot be resolved
+    using LengthResolver = std::function<int64_t(ObjectRef)>;
+
+    ObjectParser(const char* data, size_t size) : lexer_(data, size) {}
+
+    // One direct object at the current position, folding "n g R" into references
+    bool parse(PdfObject* object, std::string* error);
+
+    // "n g obj <object> [stream ... endstream] endobj" at the current position.
+    // Stream bytes are located with /Length and re-synchronised on "endstream"
+    // when the length is missing or wrong.
+    bool parse_indirect(const LengthResolver& resolve_length, ObjectRef* ref, PdfObject* object, std::string* error);
+
+    Lexer& lexer() { return lexer_; }
+
+private:
+    bool parse_value(const Token& token, int depth, PdfObject* object, std::string* error);
+    bool read_stream(const LengthResolver& resolve_length, PdfObject* object, std::string* error);
+
+    Lexer lexer_;
+};
+
+// Walks a content stream one operation (operands, then operator) at a time
+class ContentParser {
+public:
+    ContentParser(const char* data, size_t size) : lexer_(data, size) {}
+
+    // False at the end of the stream. Inline images are reported as operator
+    // "BI" with the image dictionary as the only operand; their data is skipped.
+    // The operator view stays valid as long as the stream buffer.
+    bool next(std::vector<PdfObject>* operands, std::string_view* op);
+
+private:
+    bool parse_operand(const Token& token, int depth, PdfObject* object);
+
+    Lexer lexer_;
+};
+
+// Affine transform [a b c d e f] of content streams: cm, Tm, a form's /Matrix
+struct Matrix {
+    double a = 1, b = 0, c = 0, d = 1, e = 0, f = 0;
+
+    // The first six numbers of values; the identity when there are fewer
+    static Matrix of(const std::vector<PdfObject>& values);
+    // This transform followed by other
+    Matrix multiply(const Matrix& other) const;
+};
+
+} // namespace spdf
+
+#endif // SPDF_PARSER_H
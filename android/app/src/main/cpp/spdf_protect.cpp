@@ -0,0 +1,188 @@
+#include "spdf_protect.h"
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "spdf_document.h"
+#include "spdf_parser.h"
+#include "spdf_security.h"
+#include "spdf_writer.h"
+
+namespace spdf {
+
+// Bytes read from the end of the file and at the last cross-reference section
+static const size_t TAIL_WINDOW = 8192;
+
+static bool check_readable(const std::string& path, PdfErrorCode* error_code, std::string* error) {
+    if (access(path.c_str(), R_OK) != 0) {
+        *error_code = errno == ENOENT ? PdfErrorCode_FileNotFound : PdfErrorCode_PermissionDenied;
+        *error = "cannot open " + path;
+        return false;
+    }
+    return true;
+}
+
+static bool read_at(int fd, uint64_t offset, size_t size, std::string* out) {
+    out->resize(size);
+    size_t done = 0;
+    while (done < size) {
+        ssize_t n = pread(fd, &(*out)[done], size - done, (off_t)(offset + done));
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n <= 0) {
+            break;
+        }
+        done += (size_t)n;
+    }
+    out->resize(done);
+    return done > 0;
+}
+
+// 1 or 0 when the newest trailer does or does not name /Encrypt, -1 when it
+// cannot be located cheaply
+static int trailer_names_encrypt(const std::string& path) {
+    int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        return -1;
+    }
+    struct stat st;
+    std::string tail;
+    std::string section;
+    int result = -1;
+    if (fstat(fd, &st) == 0 && st.st_size > 0) {
+        uint64_t size = (uint64_t)st.st_size;
+        uint64_t tail_at = size > TAIL_WINDOW ? size - TAIL_WINDOW : 0;
+        if (read_at(fd, tail_at, (size_t)(size - tail_at), &tail)) {
+            size_t startxref = tail.rfind("startxref");
+            int64_t offset = startxref == std::string::npos ? -1 : strtoll(tail.c_str() + startxref + 9, nullptr, 10);
+            if (offset > 0 && (uint64_t)offset < size &&
+                read_at(fd, (uint64_t)offset, (size_t)std::min<uint64_t>(TAIL_WINDOW, size - offset), &section)) {
+                Lexer lexer(section.data(), section.size());
+                Token token;
+                PdfObject dict;
+                std::string error;
+                if (lexer.next(&token) && token.type == TokenType::Keyword && token.text == "xref") {
+                    // Classic table: the trailer dictionary follows the table, which may run
+                    // past the window; then the file's last trailer stands in for it. That
+                    // is not the one to use in a linearized file, whose startxref points at
+                    // the short first-page section.
+                    size_t trailer = section.find("trailer");
+                    const std::string& source = trailer != std::string::npos ? section : tail;
+                    if (trailer == std::string::npos) {
+                        trailer = tail.rfind("trailer");
+                    }
+                    if (trailer != std::string::npos) {
+                        ObjectParser parser(source.data(), source.size());
+                        parser.lexer().seek(trailer + 7);
+                        if (parser.parse(&dict, &error) && dict.is_dict()) {
+                            result = dict.as_dict().has("Encrypt") ? 1 : 0;
+                        }
+                    }
+                } else {
+                    // Cross-reference stream: "n g obj << ... >>" at the offset
+                    Token gen;
+                    Token keyword;
+                    ObjectParser parser(section.data(), section.size());
+                    Lexer& header = parser.lexer();
+                    if (header.next(&token) && header.next(&gen) && header.next(&keyword) &&
+                        keyword.type == TokenType::Keyword && keyword.text == "obj" && parser.parse(&dict, &error) &&
+                        dict.as_dict().get("Type").is_name("XRef")) {
+                        result = dict.as_dict().has("Encrypt") ? 1 : 0;
+                    }
+                }
+            }
+        }
+    }
+    close(fd);
+    return result;
+}
+
+bool is_document_encrypted(const std::string& path, bool* encrypted, PdfErrorCode* error_code, std::string* error) {
+    if (!check_readable(path, error_code, error)) {
+        return false;
+    }
+    int named = trailer_names_encrypt(path);
+    if (named >= 0) {
+        *encrypted = named == 1;
+        *error_code = PdfErrorCode_Success;
+        return true;
+    }
+    PdfDocument document;
+    if (!document.open(path, error)) {
+        *error_code = PdfErrorCode_InvalidPdf;
+        return false;
+    }
+    *encrypted = document.encrypted();
+    *error_code = PdfErrorCode_Success;
+    return true;
+}
+
+// Opens input with password; a document that stays locked is an error
+static bool open_unlocked(PdfDocument* document, const std::string& input, const std::string& password,
+                          PdfErrorCode* error_code, std::string* error) {
+    if (!check_readable(input, error_code, error)) {
+        return false;
+    }
+    if (!document->open(input, error, password)) {
+        *error_code = PdfErrorCode_InvalidPdf;
+        return false;
+    }
+    if (document->locked()) {
+        PdfObject encrypt = document->resolve(document->trailer().get("Encrypt"));
+        if (!encrypt.as_dict().get("Filter").is_name("Standard")) {
+            *error_code = PdfErrorCode_EncryptionError;
+            *error = "unsupported security handler";
+        } else {
+            *error_code = PdfErrorCode_EncryptedPdf;
+            *error = password.empty() ? "document is password protected" : "incorrect password";
+        }
+        return false;
+    }
+    return true;
+}
+
+bool lock_document(const std::string& input, const std::string& password, const std::string& output,
+                   const WriteOptions& layout, PdfErrorCode* error_code, std::string* error) {
+    if (password.empty()) {
+        *error_code = PdfErrorCode_InvalidParameter;
+        *error = "password must not be empty";
+        return false;
+    }
+    PdfDocument document;
+    if (!open_unlocked(&document, input, std::string(), error_code, error)) {
+        return false;
+    }
+    SecurityHandler security;
+    if (!security.create(password, password, error)) {
+        *error_code = PdfErrorCode_EncryptionError;
+        return false;
+    }
+    WriteOptions options = layout;
+    options.security = &security;
+    if (!write_document(document, output, options, error)) {
+        *error_code = PdfErrorCode_IoError;
+        return false;
+    }
+    *error_code = PdfErrorCode_Success;
+    return true;
+}
+
+bool unlock_document(const std::string& input, const std::string& password, const std::string& output,
+                     const WriteOptions& layout, PdfErrorCode* error_code, std::string* error) {
+    PdfDocument document;
+    if (!open_unlocked(&document, input, password, error_code, error)) {
+        return false;
+    }
+    WriteOptions options = layout;
+    options.security = nullptr;
+    if (!write_document(document, output, options, error)) {
+        *error_code = PdfErrorCode_IoError;
+        return false;
+    }
+    *error_code = PdfErrorCode_Success;
+    return true;
+}
+
+} // namespace spdf
@@ -0,0 +1,33 @@
+#ifndef SPDF_PROTECT_H
+#define SPDF_PROTECT_H
+
+#include <string>
+#include "spdf_writer.h"
+#include "spdfcore.h"
+
+namespace spdf {
+
+// Password protection on top of the native reader and writer. Failures are
+// reported with the spdfcore C ABI error codes: a wrong password is
+// PdfErrorCode_EncryptedPdf, an unsupported security handler
+// PdfErrorCode_EncryptionError.
+
+// Whether the file has an /Encrypt entry, answered from the last trailer (or
+// cross-reference stream dictionary) alone without reading the whole file.
+// Falls back to a full parse when the tail is damaged.
+bool is_document_encrypted(const std::string& path, bool* encrypted, PdfErrorCode* error_code, std::string* error);
+
+// Writes input encrypted with AES-256 (security handler revision 6) and
+// password as the user and owner password. Encrypted input must be openable
+// with the empty password. layout selects the file layout (its security is
+// ignored).
+bool lock_document(const std::string& input, const std::string& password, const std::string& output,
+                   const WriteOptions& layout, PdfErrorCode* error_code, std::string* error);
+
+// Writes input decrypted with password (user or owner) in layout
+bool unlock_document(const std::string& input, const std::string& password, const std::string& output,
+                     const WriteOptions& layout, PdfErrorCode* error_code, std::string* error);
+
+} // namespace spdf
+
+#endif // SPDF_PROTECT_H
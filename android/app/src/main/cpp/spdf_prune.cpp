@@ -0,0 +1,253 @@
+#include "spdf_prune.h"
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include "spdf_parser.h"
+
+namespace spdf {
+
+// Same bounds as the text extractor and the linearizer
+static const int MAX_FORM_DEPTH = 8;
+static const int MAX_REF_DEPTH = 64;
+
+// Resource categories content streams refer to by name; other entries (ProcSet) are kept
+static const char* const NAMED_CATEGORIES[] = {"Font",    "XObject", "ExtGState", "ColorSpace",
+                                               "Pattern", "Shading", "Properties"};
+
+namespace {
+
+// Names a content stream uses, by resource category
+using UsedNames = std::unordered_map<std::string, std::unordered_set<std::string>>;
+
+class Pruner {
+public:
+    Pruner(PdfDocument& document, PrunePlan* plan) : document_(document), plan_(plan) {}
+
+    void plan_page(const PdfPage& page);
+    void mark_reachable();
+
+private:
+    bool scan(const std::string& content, const PdfDict& resources, int depth, UsedNames* used);
+    void plan_form(uint32_t num, const PdfObject& form, int depth);
+    PdfObject pruned(const PdfDict& resources, const UsedNames& used);
+
+    PdfDocument& document_;
+    PrunePlan* plan_;
+    std::unordered_set<uint32_t> forms_;  // form XObjects already planned
+};
+
+} // namespace
+
+static void use(UsedNames* used, const char* category, const PdfObject& name) {
+    if (name.is_name()) {
+        (*used)[category].insert(name.as_name());
+    }
+}
+
+static void collect_refs(const PdfObject& object, std::vector<uint32_t>* refs, int depth) {
+    if (depth > MAX_REF_DEPTH) {
+        return;
+    }
+    switch (object.type()) {
+        case PdfType::Reference:
+            refs->push_back(object.as_ref().num);
+            break;
+        case PdfType::Array:
+            for (const auto& item : object.as_array()) {
+                collect_refs(item, refs, depth + 1);
+            }
+            break;
+        case PdfType::Dictionary:
+        case PdfType::Stream:
+            for (const auto& entry : object.as_dict()) {
+                collect_refs(entry.second, refs, depth + 1);
+            }
+            break;
+        default:
+            break;
+    }
+}
+
+bool Pruner::scan(const std::string& content, const PdfDict& resources, int depth, UsedNames* used) {
+    ContentParser parser(content.data(), content.size());
+    std::vector<PdfObject> operands;
+    std::string_view op;
+    while (parser.next(&operands, &op)) {
+        size_t n = operands.size();
+        if (n == 0) {
+            continue;
+        }
+        if (op == "Tf") {
+            use(used, "Font", operands[0]);
+        } else if (op == "gs") {
+            use(used, "ExtGState", operands[0]);
+        } else if (op == "cs" || op == "CS") {
+            use(used, "ColorSpace", operands[0]);
+        } else if (op == "scn" || op == "SCN") {
+            use(used, "Pattern", operands[n - 1]);
+        } else if (op == "sh") {
+            use(used, "Shading", operands[0]);
+        } else if ((op == "BDC" || op == "DP") && n >= 2) {
+            use(used, "Properties", operands[1]);
+        } else if (op == "BI") {
+            const PdfDict& image = operands[0].as_dict();
+            use(used, "ColorSpace", image.has("CS") ? image.get("CS") : image.get("ColorSpace"));
+        } else if (op == "Do") {
+            use(used, "XObject", operands[0]);
+            PdfObject xobjects = document_.lookup(resources, "XObject");
+            const PdfObject& entry = xobjects.as_dict().get(operands[0].as_name());
+            PdfObject form = document_.resolve(entry);
+            if (!form.is_stream() || !form.as_dict().get("Subtype").is_name("Form")) {
+                continue;
+            }
+            if (document_.lookup(form.as_dict(), "Resources").is_dict()) {
+                plan_form(entry.as_ref().num, form, depth + 1);
+                continue;
+            }
+            // A form without resources of its own uses those of whatever runs it
+            std::string form_content;
+            std::string error;
+            if (depth >= MAX_FORM_DEPTH || !document_.decode_contents(form, &form_content, &error) ||
+                !scan(form_content, resources, depth + 1, used)) {
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+void Pruner::plan_form(uint32_t num, const PdfObject& form, int depth) {
+    if (num == 0 || depth > MAX_FORM_DEPTH || !forms_.insert(num).second) {
+        return;
+    }
+    std::string content;
+    std::string error;
+    UsedNames used;
+    PdfObject resources = document_.lookup(form.as_dict(), "Resources");
+    if (document_.decode_contents(form, &content, &error) && scan(content, resources.as_dict(), depth, &used)) {
+        plan_->resources[num] = pruned(resources.as_dict(), used);
+    }
+}
+
+PdfObject Pruner::pruned(const PdfDict& resources, const UsedNames& used) {
+    PdfDict result;
+    for (const auto& entry : resources) {
+        bool named = false;
+        for (const char* category : NAMED_CATEGORIES) {
+            named = named || entry.first == category;
+        }
+        if (!named) {
+            result.set(entry.first, entry.second);
+            continue;
+        }
+        auto names = used.find(entry.first);
+        PdfObject members = document_.resolve(entry.second);
+        if (names == used.end() || !members.is_dict()) {
+            continue;
+        }
+        PdfDict kept;
+        for (const auto& member : members.as_dict()) {
+            if (names->second.count(member.first)) {
+                kept.set(member.first, member.second);
+            }
+        }
+        if (!kept.empty()) {
+            result.set(entry.first, PdfObject::dict(std::move(kept)));
+        }
+    }
+    return PdfObject::dict(std::move(result));
+}
+
+void Pruner::plan_page(const PdfPage& page) {
+    // page.dict holds the inherited /Resources too, so every page ends up with its own
+    const PdfObject& inherited = page.dict.get("Resources");
+    if (inherited.is_null()) {
+        return;
+    }
+    std::string content;
+    std::string error;
+    UsedNames used;
+    PdfObject resources = document_.resolve(inherited);
+    if (document_.decode_contents(document_.lookup(page.dict, "Contents"), &content, &error) &&
+        scan(content, resources.as_dict(), 0, &used)) {
+        plan_->resources[page.ref.num] = pruned(resources.as_dict(), used);
+    } else {
+        plan_->resources[page.ref.num] = inherited;
+    }
+}
+
+// Marks what the trailer reaches through the pruned objects. Pages that have
+// left the page tree are not followed, so links and outline entries pointing
+// at them do not keep them alive.
+void Pruner::mark_reachable() {
+    std::unordered_set<uint32_t> pages;
+    for (const auto& page : document_.pages()) {
+        pages.insert(page.ref.num);
+    }
+    const PdfDict& trailer = document_.trailer();
+    std::vector<uint32_t> queue;
+    collect_refs(trailer.get("Root"), &queue, 0);
+    collect_refs(trailer.get("Info"), &queue, 0);
+    for (size_t head = 0; head < queue.size(); head++) {
+        uint32_t num = queue[head];
+        ObjectRef ref;
+        if (num >= plan_->keep.size() || plan_->keep[num] || !document_.object_ref(num, &ref)) {
+            continue;
+        }
+        PdfObject object = document_.get(ref);
+        document_.evict(num);
+        const PdfObject& type = object.as_dict().get("Type");
+        if (object.is_null() || (type.is_name("Page") && !pages.count(num))) {
+            continue;
+        }
+        if (object.is_dict() && type.is_name("Pages")) {
+            plan_->tree_nodes.insert(num);
+        }
+        plan_->keep[num] = true;
+        collect_refs(plan_->apply(num, std::move(object)), &queue, 0);
+    }
+}
+
+PdfObject PrunePlan::apply(uint32_t num, PdfObject object) const {
+    if (!keeps(num)) {
+        return PdfObject();
+    }
+    auto replacement = resources.find(num);
+    bool node = tree_nodes.count(num) > 0;
+    if (replacement == resources.end() && !node) {
+        return object;
+    }
+    if (object.is_stream()) {
+        // Copied rather than changed in place: the document may still share the original
+        const PdfStream& original = object.as_stream();
+        PdfDict dict = original.dict;
+        if (replacement != resources.end()) {
+            dict.set("Resources", replacement->second);
+        }
+        PdfObject copy = PdfObject::stream(std::move(dict), original.data);
+        copy.mutable_stream().encrypted = original.encrypted;
+        copy.mutable_stream().crypt_ref = original.crypt_ref;
+        return copy;
+    }
+    PdfDict dict = object.as_dict();
+    if (replacement != resources.end()) {
+        dict.set("Resources", replacement->second);
+    }
+    if (node) {
+        dict.erase("Resources");
+    }
+    return PdfObject::dict(std::move(dict));
+}
+
+void plan_pruning(PdfDocument& document, PrunePlan* plan) {
+    plan->keep.assign(document.object_count(), false);
+    plan->resources.clear();
+    plan->tree_nodes.clear();
+    Pruner pruner(document, plan);
+    for (const auto& page : document.pages()) {
+        pruner.plan_page(page);
+    }
+    pruner.mark_reachable();
+}
+
+} // namespace spdf
@@ -0,0 +1,37 @@
+#ifndef SPDF_PRUNE_H
+#define SPDF_PRUNE_H
+
+#include <cstdint>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+#include "spdf_document.h"
+#include "spdf_object.h"
+
+namespace spdf {
+
+// What a rewrite keeps when it drops everything the pages do not need, e.g.
+// for split and extract outputs that still carry the whole document's
+// objects. Every page gets its own /Resources holding only the fonts,
+// images, graphics states, colour spaces, patterns, shadings and marked
+// content properties its content streams name (form XObjects with their own
+// /Resources are trimmed the same way), page tree nodes lose the inherited
+// /Resources, and only objects reachable from the trailer afterwards are
+// kept. Pages whose content cannot be decoded keep their full resources.
+struct PrunePlan {
+    std::vector<bool> keep;  // by object number
+    // Replacement /Resources of pages and form XObjects, by object number
+    std::unordered_map<uint32_t, PdfObject> resources;
+    // Page tree nodes whose /Resources is dropped
+    std::unordered_set<uint32_t> tree_nodes;
+
+    bool keeps(uint32_t num) const { return num < keep.size() && keep[num]; }
+    // Applies the plan to object num as loaded for writing; null when it is dropped
+    PdfObject apply(uint32_t num, PdfObject object) const;
+};
+
+void plan_pruning(PdfDocument& document, PrunePlan* plan);
+
+} // namespace spdf
+
+#endif // SPDF_PRUNE_H
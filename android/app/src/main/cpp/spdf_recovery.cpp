@@ -0,0 +1,154 @@
+#include "spdf_recovery.h"
+#include <cstring>
+#include <string>
+#include "spdf_lexer.h"
+#include "spdf_parser.h"
+#include "spdf_simd.h"
+
+namespace spdf {
+
+// Same bound as the cross-reference reader
+static const uint64_t MAX_OBJECT_NUMBER = 8u << 20;
+
+// Parses the "n g " in front of the "obj" at keyword; false unless it is a
+// complete header that starts at a token boundary
+static bool object_header(const char* data, size_t keyword, size_t* start, uint32_t* num, uint16_t* gen) {
+    size_t i = keyword;
+    auto skip_whitespace = [&]() {
+        size_t end = i;
+        while (i > 0 && is_pdf_whitespace((unsigned char)data[i - 1])) {
+            i--;
+        }
+        return i < end;
+    };
+    auto read_digits = [&](uint64_t* value) {
+        size_t end = i;
+        while (i > 0 && end - i < 10 && data[i - 1] >= '0' && data[i - 1] <= '9') {
+            i--;
+        }
+        if (i == end) {
+            return false;
+        }
+        *value = 0;
+        for (size_t k = i; k < end; k++) {
+            *value = *value * 10 + (uint64_t)(data[k] - '0');
+        }
+        return true;
+    };
+    uint64_t generation = 0;
+    uint64_t number = 0;
+    if (!skip_whitespace() || !read_digits(&generation) || !skip_whitespace() || !read_digits(&number)) {
+        return false;
+    }
+    if (i > 0 && is_pdf_regular((unsigned char)data[i - 1])) {
+        return false;
+    }
+    if (number == 0 || number > MAX_OBJECT_NUMBER || generation > 65535) {
+        return false;
+    }
+    *start = i;
+    *num = (uint32_t)number;
+    *gen = (uint16_t)generation;
+    return true;
+}
+
+static ScannedObject::Kind kind_of(const PdfDict& dict, bool stream) {
+    const PdfObject& type = dict.get("Type");
+    if (type.is_name("Catalog")) {
+        return ScannedObject::Kind::Catalog;
+    }
+    if (type.is_name("Page")) {
+        return ScannedObject::Kind::Page;
+    }
+    if (stream && type.is_name("ObjStm")) {
+        return ScannedObject::Kind::ObjectStream;
+    }
+    if (stream && type.is_name("XRef")) {
+        return ScannedObject::Kind::XrefStream;
+    }
+    if (dict.get("Filter").is_name("Standard") && dict.has("O") && dict.has("U")) {
+        return ScannedObject::Kind::Encrypt;
+    }
+    return ScannedObject::Kind::Other;
+}
+
+// Records the "trailer" keywords between two objects
+static void scan_trailers(const char* data, size_t from, size_t to, RecoveryScan* scan) {
+    while (from < to) {
+        size_t found = from + find_bytes(data + from, to - from, "trailer", 7);
+        if (found >= to) {
+            break;
+        }
+        scan->trailers.push_back(found);
+        from = found + 7;
+    }
+}
+
+void scan_objects(const char* data, size_t size, RecoveryScan* scan) {
+    scan->objects.clear();
+    scan->trailers.clear();
+    ObjectParser parser(data, size);
+    Lexer& lexer = parser.lexer();
+    size_t position = 0;
+    size_t gap = 0;  // end of the last object, where trailers may start
+    while (position < size) {
+        size_t keyword = position + find_bytes(data + position, size - position, "obj", 3);
+        if (keyword >= size) {
+            break;
+        }
+        position = keyword + 3;
+        ScannedObject object;
+        if ((position < size && is_pdf_regular((unsigned char)data[position])) ||
+            !object_header(data, keyword, &object.offset, &object.num, &object.gen)) {
+            continue;
+        }
+
+        lexer.seek(position);
+        PdfObject value;
+        std::string error;
+        if (!parser.parse(&value, &error)) {
+            continue;
+        }
+        Token token;
+        size_t after = lexer.position();
+        if (!lexer.next(&token) || token.type != TokenType::Keyword || token.text != "stream") {
+            object.kind = kind_of(value.as_dict(), false);
+            scan_trailers(data, gap, object.offset, scan);
+            scan->objects.push_back(object);
+            position = gap = after;
+            continue;
+        }
+
+        // Skip the stream body without parsing it; a direct /Length is trusted when "endstream" follows
+        size_t start = lexer.position();
+        if (start < size && data[start] == '\r') {
+            start++;
+        }
+        if (start < size && data[start] == '\n') {
+            start++;
+        }
+        size_t end = size;
+        const PdfObject& length = value.as_dict().get("Length");
+        if (length.is_int() && length.as_int() >= 0 && (uint64_t)length.as_int() <= size - start) {
+            size_t candidate = start + (size_t)length.as_int();
+            candidate += scan_whitespace(data + candidate, size - candidate);
+            if (candidate + 9 <= size && memcmp(data + candidate, "endstream", 9) == 0) {
+                end = candidate;
+            }
+        }
+        if (end == size) {
+            end = start + find_bytes(data + start, size - start, "endstream", 9);
+        }
+        if (end >= size) {
+            // Truncated inside the stream; anything after it is stream bytes too
+            break;
+        }
+        object.kind = kind_of(value.as_dict(), true);
+        scan_trailers(data, gap, object.offset, scan);
+        scan->objects.push_back(object);
+        position = gap = end + 9;
+    }
+    scan_trailers(data, gap, size, scan);
+}
+
+} // namespace spdf
@@ -0,0 +1,36 @@
+#ifndef SPDF_RECOVERY_H
+#define SPDF_RECOVERY_H
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace spdf {
+
+// An "n g obj" found by scanning the file rather than through its
+// cross-reference data
+struct ScannedObject {
+    enum class Kind : uint8_t { Other, Catalog, Page, ObjectStream, XrefStream, Encrypt };
+
+    uint32_t num = 0;
+    uint16_t gen = 0;
+    size_t offset = 0;  // of the object number
+    Kind kind = Kind::Other;
+};
+
+struct RecoveryScan {
+    std::vector<ScannedObject> objects;  // in file order
+    std::vector<size_t> trailers;        // offsets of "trailer" keywords, in file order
+};
+
+// Rebuilds the object map of a damaged file in one pass: "obj" markers are
+// found with the SIMD byte search, each object's value is parsed to learn its
+// type, and stream bodies are skipped through /Length (or a search for
+// "endstream") so their bytes are only touched by the search itself. Objects
+// cut off by truncation are left out. Later copies of an object follow
+// earlier ones, so an incremental update's version wins when applied in order.
+void scan_objects(const char* data, size_t size, RecoveryScan* scan);
+
+} // namespace spdf
+
+#endif // SPDF_RECOVERY_H
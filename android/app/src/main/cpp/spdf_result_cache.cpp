@@ -0,0 +1,322 @@
+#include "spdf_result_cache.h"
+#include <dirent.h>
+#include <fcntl.h>
+#include <sys/ioctl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <algorithm>
+#include <cctype>
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+#if defined(__linux__)
+#include <linux/fs.h>
+#endif
+
+namespace spdf {
+
+static const size_t MAX_MEMOIZED_DIGESTS = 4096;
+
+ResultCache& result_cache() {
+    static ResultCache cache;
+    return cache;
+}
+
+static bool make_directories(const std::string& dir) {
+    for (size_t pos = 1; pos <= dir.size(); pos++) {
+        if (pos == dir.size() || dir[pos] == '/') {
+            std::string prefix = dir.substr(0, pos);
+            if (mkdir(prefix.c_str(), 0700) != 0 && errno != EEXIST) {
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+bool clone_or_copy_file(const std::string& source, const std::string& destination) {
+    int in = open(source.c_str(), O_RDONLY | O_CLOEXEC);
+    if (in < 0) {
+        return false;
+    }
+    // Unique per call: copies to one path may run side by side
+    std::string temp = destination + ".XXXXXX";
+    int out = mkostemp(&temp[0], O_CLOEXEC);
+    if (out < 0) {
+        close(in);
+        return false;
+    }
+    bool ok = true;
+#if defined(FICLONE)
+    if (ioctl(out, FICLONE, in) != 0)
+#endif
+    {
+        std::vector<char> buffer(1 << 20);
+        ssize_t n;
+        while (ok && (n = read(in, buffer.data(), buffer.size())) != 0) {
+            if (n < 0) {
+                ok = errno == EINTR;
+                continue;
+            }
+            ok = write(out, buffer.data(), (size_t)n) == n;
+        }
+    }
+    close(in);
+    ok = close(out) == 0 && ok;
+    if (!ok || rename(temp.c_str(), destination.c_str()) != 0) {
+        unlink(temp.c_str());
+        return false;
+    }
+    return true;
+}
+
+static bool parse_entry_name(const char* name, std::string* key, size_t* index) {
+    // <32 hex digits>.<index>.pdf
+    size_t length = strlen(name);
+    if (length < 38 || name[32] != '.' || strcmp(name + length - 4, ".pdf") != 0) {
+        return false;
+    }
+    for (int i = 0; i < 32; i++) {
+        if (!isxdigit((unsigned char)name[i])) {
+            return false;
+        }
+    }
+    char* end = nullptr;
+    unsigned long value = strtoul(name + 33, &end, 10);
+    if (end != name + length - 4) {
+        return false;
+    }
+    key->assign(name, 32);
+    *index = (size_t)value;
+    return true;
+}
+
+bool ResultCache::configure(const std::string& dir, uint64_t max_bytes) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    entries_.clear();
+    total_bytes_ = 0;
+    dir_.clear();
+    max_bytes_ = 0;
+    if (max_bytes == 0 || dir.empty() || !make_directories(dir)) {
+        return max_bytes == 0;
+    }
+
+    // Rebuild the index from disk; file mtimes carry recency across restarts
+    DIR* listing = opendir(dir.c_str());
+    if (!listing) {
+        return false;
+    }
+    std::map<std::string, int64_t> newest;
+    while (struct dirent* item = readdir(listing)) {
+        std::string key;
+        size_t index = 0;
+        struct stat st;
+        std::string path = dir + "/" + item->d_name;
+        if (!parse_entry_name(item->d_name, &key, &index) || stat(path.c_str(), &st) != 0) {
+            continue;
+        }
+        Entry& entry = entries_[key];
+        entry.bytes += (uint64_t)st.st_size;
+        entry.files = std::max(entry.files, index + 1);
+        newest[key] = std::max(newest[key], (int64_t)st.st_mtime);
+        total_bytes_ += (uint64_t)st.st_size;
+    }
+    closedir(listing);
+
+    std::vector<std::pair<int64_t, std::string>> order;
+    for (const auto& item : newest) {
+        order.emplace_back(item.second, item.first);
+    }
+    std::sort(order.begin(), order.end());
+    clock_ = 0;
+    for (const auto& item : order) {
+        entries_[item.second].last_used = ++clock_;
+    }
+
+    dir_ = dir;
+    max_bytes_ = max_bytes;
+    evict_locked();
+    return true;
+}
+
+bool ResultCache::enabled() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return max_bytes_ > 0;
+}
+
+bool ResultCache::content_digest(const std::string& path, Digest128* digest) {
+    FileIdentity identity;
+    if (!FileIdentity::of(path, &identity)) {
+        return false;
+    }
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        auto it = digests_.find(path);
+        if (it != digests_.end() && it->second.first == identity) {
+            *digest = it->second.second;
+            return true;
+        }
+    }
+
+    int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        return false;
+    }
+    Hasher128 hasher;
+    std::vector<char> buffer(1 << 20);
+    ssize_t n;
+    bool ok = true;
+    while ((n = read(fd, buffer.data(), buffer.size())) != 0) {
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            ok = false;
+            break;
+        }
+        hasher.update(buffer.data(), (size_t)n);
+    }
+    close(fd);
+    if (!ok) {
+        return false;
+    }
+    *digest = hasher.digest();
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (digests_.size() >= MAX_MEMOIZED_DIGESTS) {
+        digests_.clear();
+    }
+    digests_[path] = std::make_pair(identity, *digest);
+    return true;
+}
+
+bool ResultCache::make_key(const char* operation, const std::vector<std::string>& inputs, const std::string& params,
+                           std::string* key) {
+    Hasher128 hasher;
+    hasher.update(std::string(operation));
+    hasher.update(params);
+    hasher.update_value((uint64_t)inputs.size());
+    for (const auto& input : inputs) {
+        Digest128 digest;
+        if (!content_digest(input, &digest)) {
+            return false;
+        }
+        hasher.update_value(digest.high);
+        hasher.update_value(digest.low);
+    }
+    *key = hasher.digest().hex();
+    return true;
+}
+
+std::string ResultCache::entry_path(const std::string& key, size_t index) const {
+    return dir_ + "/" + key + "." + std::to_string(index) + ".pdf";
+}
+
+// Files are copied outside the lock, so a large copy does not hold up other
+// lookups. An entry evicted meanwhile fails its copy and counts as a miss.
+bool ResultCache::fetch(const std::string& key, const std::vector<std::string>& outputs) {
+    std::vector<std::string> paths;
+    uint64_t used = 0;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        auto it = entries_.find(key);
+        if (max_bytes_ == 0 || it == entries_.end() || it->second.files != outputs.size()) {
+            misses_++;
+            return false;
+        }
+        for (size_t i = 0; i < outputs.size(); i++) {
+            paths.push_back(entry_path(key, i));
+        }
+        used = it->second.last_used = ++clock_;
+    }
+    for (size_t i = 0; i < outputs.size(); i++) {
+        if (!clone_or_copy_file(paths[i], outputs[i])) {
+            // Entry vanished or is unreadable; drop it, unless it was stored
+            // again meanwhile, and let the caller recompute
+            std::lock_guard<std::mutex> lock(mutex_);
+            auto it = entries_.find(key);
+            if (it != entries_.end() && it->second.last_used == used) {
+                remove_entry_locked(key);
+            }
+            misses_++;
+            return false;
+        }
+        utimensat(AT_FDCWD, paths[i].c_str(), nullptr, 0);
+    }
+    std::lock_guard<std::mutex> lock(mutex_);
+    hits_++;
+    return true;
+}
+
+void ResultCache::store(const std::string& key, const std::vector<std::string>& outputs) {
+    std::vector<std::string> paths;
+    uint64_t max_bytes = 0;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (max_bytes_ == 0 || outputs.empty()) {
+            return;
+        }
+        // Not found while its files are replaced
+        remove_entry_locked(key);
+        for (size_t i = 0; i < outputs.size(); i++) {
+            paths.push_back(entry_path(key, i));
+        }
+        max_bytes = max_bytes_;
+    }
+    Entry entry;
+    for (size_t i = 0; i < outputs.size(); i++) {
+        struct stat st;
+        if (stat(outputs[i].c_str(), &st) != 0 || (uint64_t)st.st_size > max_bytes ||
+            !clone_or_copy_file(outputs[i], paths[i])) {
+            for (size_t j = 0; j < i; j++) {
+                unlink(paths[j].c_str());
+            }
+            return;
+        }
+        entry.bytes += (uint64_t)st.st_size;
+    }
+    entry.files = outputs.size();
+    std::lock_guard<std::mutex> lock(mutex_);
+    // A store of the same key that finished first wrote the same content
+    if (max_bytes_ == 0 || entries_.count(key)) {
+        return;
+    }
+    entry.last_used = ++clock_;
+    total_bytes_ += entry.bytes;
+    entries_[key] = entry;
+    evict_locked();
+}
+
+void ResultCache::remove_entry_locked(const std::string& key) {
+    auto it = entries_.find(key);
+    if (it == entries_.end()) {
+        return;
+    }
+    for (size_t i = 0; i < it->second.files; i++) {
+        unlink(entry_path(key, i).c_str());
+    }
+    total_bytes_ -= std::min(total_bytes_, it->second.bytes);
+    entries_.erase(it);
+}
+
+void ResultCache::evict_locked() {
+    while (total_bytes_ > max_bytes_ && !entries_.empty()) {
+        auto oldest = std::min_element(entries_.begin(), entries_.end(), [](const auto& a, const auto& b) {
+            return a.second.last_used < b.second.last_used;
+        });
+        remove_entry_locked(oldest->first);
+    }
+}
+
+ResultCache::Stats ResultCache::stats() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    Stats stats;
+    stats.hits = hits_;
+    stats.misses = misses_;
+    stats.bytes = total_bytes_;
+    stats.entries = entries_.size();
+    return stats;
+}
+
+} // namespace spdf
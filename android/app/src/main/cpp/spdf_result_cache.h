@@ -0,0 +1,80 @@
+#ifndef SPDF_RESULT_CACHE_H
+#define SPDF_RESULT_CACHE_H
+
+#include <cstdint>
+#include <map>
+#include <mutex>
+#include <string>
+#include <vector>
+#include "spdf_file_identity.h"
+#include "spdf_hash.h"
+
+namespace spdf {
+
+// Content-addressed cache of operation outputs
+//
+// Keys hash the operation name, its parameters and the content digest of
+// every input, so a re-picked copy of the same document still hits. Entries
+// are files under <dir>/<key>.<n>.pdf, evicted least-recently-used once the
+// directory exceeds its byte budget. Outputs go into the cache, and hits come
+// out of it, as private copies (reflinks where the filesystem has them), so
+// writing to an output later never changes an entry.
+class ResultCache {
+public:
+    struct Stats {
+        uint64_t hits = 0;
+        uint64_t misses = 0;
+        uint64_t bytes = 0;
+        size_t entries = 0;
+    };
+
+    // Enables the cache in |dir| (created if needed); max_bytes == 0 disables it
+    bool configure(const std::string& dir, uint64_t max_bytes);
+    bool enabled() const;
+
+    // Builds the key for |operation| over |inputs|; false if an input is unreadable
+    bool make_key(const char* operation, const std::vector<std::string>& inputs, const std::string& params,
+                  std::string* key);
+
+    // Materializes a cached result at |outputs|; false on miss
+    bool fetch(const std::string& key, const std::vector<std::string>& outputs);
+
+    // Records freshly written |outputs| under |key|
+    void store(const std::string& key, const std::vector<std::string>& outputs);
+
+    Stats stats() const;
+
+private:
+    struct Entry {
+        uint64_t bytes = 0;
+        uint64_t last_used = 0;
+        size_t files = 0;
+    };
+
+    bool content_digest(const std::string& path, Digest128* digest);
+    std::string entry_path(const std::string& key, size_t index) const;
+    void evict_locked();
+    void remove_entry_locked(const std::string& key);
+
+    mutable std::mutex mutex_;
+    std::string dir_;
+    uint64_t max_bytes_ = 0;
+    uint64_t total_bytes_ = 0;
+    uint64_t clock_ = 0;
+    std::map<std::string, Entry> entries_;
+    // Content digests memoized per path while the file identity is unchanged
+    std::map<std::string, std::pair<FileIdentity, Digest128>> digests_;
+    uint64_t hits_ = 0;
+    uint64_t misses_ = 0;
+};
+
+// Process-wide instance used by the JNI layer
+ResultCache& result_cache();
+
+// Places a private copy of |source| at |destination|: a reflink when the
+// filesystem allows it, otherwise a byte copy
+bool clone_or_copy_file(const std::string& source, const std::string& destination);
+
+} // namespace spdf
+
+#endif // SPDF_RESULT_CACHE_H
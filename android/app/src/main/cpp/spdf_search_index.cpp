@@ -0,0 +1,460 @@
+#include "spdf_search_index.h"
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <unordered_set>
+#include "spdf_hash.h"
+
+namespace spdf {
+
+static const size_t MAX_TERM_BYTES = 64;
+static const char INDEX_MAGIC[8] = {'S', 'P', 'D', 'F', 'I', 'D', 'X', '1'};
+
+std::vector<std::string> search_terms(const std::string& text) {
+    std::vector<std::string> terms;
+    std::string term;
+    auto flush = [&]() {
+        if (!term.empty()) {
+            if (term.size() > MAX_TERM_BYTES) {
+                // Cut at a character boundary
+                size_t cut = MAX_TERM_BYTES;
+                while (cut > 0 && ((unsigned char)term[cut] & 0xC0) == 0x80) {
+                    cut--;
+                }
+                term.resize(cut);
+            }
+            terms.push_back(term);
+            term.clear();
+        }
+    };
+    for (size_t i = 0; i < text.size(); i++) {
+        unsigned char c = (unsigned char)text[i];
+        if (c >= 'A' && c <= 'Z') {
+            term += (char)(c + 32);
+        } else if ((c >= 'a' && c <= 'z') || (c >= '0' && c <= '9')) {
+            term += (char)c;
+        } else if (c == 0xC3 && i + 1 < text.size() && (unsigned char)text[i + 1] >= 0x80 &&
+                   (unsigned char)text[i + 1] <= 0x9E && (unsigned char)text[i + 1] != 0x97) {
+            // Latin-1 capitals À..Þ (except ×) fold to their lower-case forms
+            term += (char)c;
+            term += (char)((unsigned char)text[++i] + 0x20);
+        } else if (c >= 0x80) {
+            term += (char)c;
+        } else {
+            flush();
+        }
+    }
+    flush();
+    return terms;
+}
+
+bool SearchIndex::contains(const std::string& path, const FileIdentity& identity, uint32_t* page_count) const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto found = document_ids_.find(path);
+    if (found == document_ids_.end() || documents_[found->second].identity != identity) {
+        return false;
+    }
+    if (page_count) {
+        *page_count = documents_[found->second].page_count;
+    }
+    return true;
+}
+
+void SearchIndex::add_document(const std::string& path, const FileIdentity& identity,
+                               const std::vector<std::string>& pages) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    add_locked(path, identity, pages);
+}
+
+void SearchIndex::add_locked(const std::string& path, const FileIdentity& identity,
+                             const std::vector<std::string>& pages) {
+    remove_locked(path);
+    uint32_t id = (uint32_t)documents_.size();
+    Document document;
+    document.path = path;
+    document.identity = identity;
+    document.page_count = (uint32_t)pages.size();
+    documents_.push_back(document);
+    document_ids_[path] = id;
+
+    // New ids are the largest and pages ascend, so every list stays sorted
+    std::unordered_map<std::string, uint32_t> counts;
+    for (uint32_t page = 0; page < pages.size(); page++) {
+        counts.clear();
+        for (auto& term : search_terms(pages[page])) {
+            counts[term]++;
+        }
+        for (const auto& count : counts) {
+            postings_[count.first].push_back(Posting{id, page, count.second});
+        }
+    }
+}
+
+void SearchIndex::remove_document(const std::string& path) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    remove_locked(path);
+}
+
+void SearchIndex::remove_locked(const std::string& path) {
+    auto found = document_ids_.find(path);
+    if (found == document_ids_.end()) {
+        return;
+    }
+    documents_[found->second].live = false;
+    document_ids_.erase(found);
+    dead_documents_++;
+    if (dead_documents_ > 64 && dead_documents_ * 2 > documents_.size()) {
+        compact_locked();
+    }
+}
+
+// Drops postings of removed documents and renumbers the survivors
+void SearchIndex::compact_locked() {
+    std::vector<uint32_t> remap(documents_.size(), UINT32_MAX);
+    std::vector<Document> live;
+    for (uint32_t id = 0; id < documents_.size(); id++) {
+        if (documents_[id].live) {
+            remap[id] = (uint32_t)live.size();
+            live.push_back(std::move(documents_[id]));
+        }
+    }
+    for (auto it = postings_.begin(); it != postings_.end();) {
+        std::vector<Posting>& list = it->second;
+        size_t kept = 0;
+        for (const auto& posting : list) {
+            if (remap[posting.document] != UINT32_MAX) {
+                list[kept] = posting;
+                list[kept++].document = remap[posting.document];
+            }
+        }
+        list.resize(kept);
+        it = list.empty() ? postings_.erase(it) : std::next(it);
+    }
+    documents_.swap(live);
+    document_ids_.clear();
+    for (uint32_t id = 0; id < documents_.size(); id++) {
+        document_ids_[documents_[id].path] = id;
+    }
+    dead_documents_ = 0;
+}
+
+std::vector<SearchIndex::Hit> SearchIndex::search(const std::string& query, size_t limit,
+                                                  const std::vector<std::string>& paths) const {
+    // Split on whitespace first so a trailing '*' can mark a prefix term
+    struct QueryTerm {
+        std::string text;
+        bool prefix;
+    };
+    std::vector<QueryTerm> terms;
+    size_t pos = 0;
+    while (pos < query.size()) {
+        size_t end = query.find_first_of(" \t\r\n", pos);
+        std::string word = query.substr(pos, end == std::string::npos ? std::string::npos : end - pos);
+        pos = end == std::string::npos ? query.size() : end + 1;
+        bool prefix = !word.empty() && word.back() == '*';
+        std::vector<std::string> parts = search_terms(word);
+        for (size_t i = 0; i < parts.size(); i++) {
+            terms.push_back(QueryTerm{parts[i], prefix && i + 1 == parts.size()});
+        }
+    }
+    std::vector<Hit> hits;
+    if (terms.empty() || limit == 0) {
+        return hits;
+    }
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    std::unordered_set<uint32_t> allowed;
+    for (const auto& path : paths) {
+        auto found = document_ids_.find(path);
+        if (found != document_ids_.end()) {
+            allowed.insert(found->second);
+        }
+    }
+    if (!paths.empty() && allowed.empty()) {
+        return hits;
+    }
+
+    // (document << 32 | page) -> summed occurrences, intersected term by term
+    std::unordered_map<uint64_t, uint32_t> matches;
+    for (size_t t = 0; t < terms.size(); t++) {
+        std::unordered_map<uint64_t, uint32_t> term_matches;
+        auto collect = [&](const std::vector<Posting>& list) {
+            for (const auto& posting : list) {
+                if (!documents_[posting.document].live || (!allowed.empty() && !allowed.count(posting.document))) {
+                    continue;
+                }
+                term_matches[(uint64_t)posting.document << 32 | posting.page] += posting.count;
+            }
+        };
+        const std::string& text = terms[t].text;
+        if (terms[t].prefix) {
+            for (auto it = postings_.lower_bound(text); it != postings_.end() && it->first.compare(0, text.size(), text) == 0;
+                 ++it) {
+                collect(it->second);
+            }
+        } else {
+            auto found = postings_.find(text);
+            if (found != postings_.end()) {
+                collect(found->second);
+            }
+        }
+
+        if (t == 0) {
+            matches.swap(term_matches);
+        } else {
+            for (auto it = matches.begin(); it != matches.end();) {
+                auto other = term_matches.find(it->first);
+                if (other == term_matches.end()) {
+                    it = matches.erase(it);
+                } else {
+                    it->second += other->second;
+                    ++it;
+                }
+            }
+        }
+        if (matches.empty()) {
+            return hits;
+        }
+    }
+
+    for (const auto& match : matches) {
+        Hit hit;
+        hit.path = documents_[(uint32_t)(match.first >> 32)].path;
+        hit.page = (int32_t)(match.first & 0xFFFFFFFFu) + 1;
+        hit.score = match.second;
+        hits.push_back(std::move(hit));
+    }
+    std::sort(hits.begin(), hits.end(), [](const Hit& a, const Hit& b) {
+        if (a.score != b.score) {
+            return a.score > b.score;
+        }
+        return a.path != b.path ? a.path < b.path : a.page < b.page;
+    });
+    if (hits.size() > limit) {
+        hits.resize(limit);
+    }
+    return hits;
+}
+
+SearchIndex::Stats SearchIndex::stats() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    Stats stats;
+    stats.documents = document_ids_.size();
+    stats.terms = postings_.size();
+    for (const auto& entry : postings_) {
+        stats.postings += entry.second.size();
+    }
+    return stats;
+}
+
+static void put_varint(uint64_t value, std::string* out) {
+    while (value >= 0x80) {
+        *out += (char)(value | 0x80);
+        value >>= 7;
+    }
+    *out += (char)value;
+}
+
+static void put_fixed64(uint64_t value, std::string* out) {
+    for (int i = 0; i < 8; i++) {
+        *out += (char)(value >> (8 * i));
+    }
+}
+
+namespace {
+
+struct Reader {
+    const unsigned char* p;
+    const unsigned char* end;
+    bool ok = true;
+
+    uint64_t varint() {
+        uint64_t value = 0;
+        for (int shift = 0; shift < 64; shift += 7) {
+            if (p >= end) {
+                ok = false;
+                return 0;
+            }
+            unsigned char byte = *p++;
+            value |= (uint64_t)(byte & 0x7F) << shift;
+            if (!(byte & 0x80)) {
+                return value;
+            }
+        }
+        ok = false;
+        return 0;
+    }
+
+    uint64_t fixed64() {
+        if (end - p < 8) {
+            ok = false;
+            return 0;
+        }
+        uint64_t value = 0;
+        for (int i = 0; i < 8; i++) {
+            value |= (uint64_t)p[i] << (8 * i);
+        }
+        p += 8;
+        return value;
+    }
+
+    std::string bytes() {
+        uint64_t length = varint();
+        if (!ok || (uint64_t)(end - p) < length) {
+            ok = false;
+            return std::string();
+        }
+        std::string value((const char*)p, (size_t)length);
+        p += length;
+        return value;
+    }
+};
+
+} // namespace
+
+// Layout: magic, documents (path, identity, page count), then terms with
+// their postings as (document delta, page or page delta, count) varints,
+// and an XXH64 of everything before it
+bool SearchIndex::save(const std::string& file) const {
+    std::string out(INDEX_MAGIC, sizeof(INDEX_MAGIC));
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        std::vector<uint32_t> remap(documents_.size(), UINT32_MAX);
+        uint32_t live = 0;
+        for (uint32_t id = 0; id < documents_.size(); id++) {
+            if (documents_[id].live) {
+                remap[id] = live++;
+            }
+        }
+        put_varint(live, &out);
+        for (const auto& document : documents_) {
+            if (!document.live) {
+                continue;
+            }
+            put_varint(document.path.size(), &out);
+            out += document.path;
+            put_fixed64(document.identity.device, &out);
+            put_fixed64(document.identity.inode, &out);
+            put_fixed64(document.identity.size, &out);
+            put_fixed64((uint64_t)document.identity.mtime_ns, &out);
+            put_varint(document.page_count, &out);
+        }
+
+        std::string list;
+        size_t term_count = 0;
+        std::string terms;
+        for (const auto& entry : postings_) {
+            list.clear();
+            size_t count = 0;
+            uint32_t previous_document = 0;
+            uint32_t previous_page = 0;
+            for (const auto& posting : entry.second) {
+                uint32_t document = remap[posting.document];
+                if (document == UINT32_MAX) {
+                    continue;
+                }
+                uint32_t document_delta = document - previous_document;
+                put_varint(document_delta, &list);
+                put_varint(document_delta == 0 && count > 0 ? posting.page - previous_page : posting.page, &list);
+                put_varint(posting.count, &list);
+                previous_document = document;
+                previous_page = posting.page;
+                count++;
+            }
+            if (count == 0) {
+                continue;
+            }
+            put_varint(entry.first.size(), &terms);
+            terms += entry.first;
+            put_varint(count, &terms);
+            terms += list;
+            term_count++;
+        }
+        put_varint(term_count, &out);
+        out += terms;
+    }
+    Xxh64 checksum;
+    checksum.update(out);
+    put_fixed64(checksum.digest(), &out);
+
+    std::string temp = file + ".tmp";
+    FILE* f = fopen(temp.c_str(), "wb");
+    if (!f) {
+        return false;
+    }
+    bool ok = fwrite(out.data(), 1, out.size(), f) == out.size();
+    ok = fclose(f) == 0 && ok;
+    return ok && rename(temp.c_str(), file.c_str()) == 0;
+}
+
+bool SearchIndex::load(const std::string& file) {
+    FILE* f = fopen(file.c_str(), "rb");
+    if (!f) {
+        return false;
+    }
+    std::string data;
+    char buffer[65536];
+    size_t n;
+    while ((n = fread(buffer, 1, sizeof(buffer), f)) > 0) {
+        data.append(buffer, n);
+    }
+    fclose(f);
+    if (data.size() < sizeof(INDEX_MAGIC) + 8 || memcmp(data.data(), INDEX_MAGIC, sizeof(INDEX_MAGIC)) != 0) {
+        return false;
+    }
+    Xxh64 checksum;
+    checksum.update(data.data(), data.size() - 8);
+    Reader trailer{(const unsigned char*)data.data() + data.size() - 8, (const unsigned char*)data.data() + data.size()};
+    if (trailer.fixed64() != checksum.digest()) {
+        return false;
+    }
+
+    Reader in{(const unsigned char*)data.data() + sizeof(INDEX_MAGIC),
+              (const unsigned char*)data.data() + data.size() - 8};
+    std::vector<Document> documents((size_t)std::min<uint64_t>(in.varint(), data.size()));
+    for (auto& document : documents) {
+        document.path = in.bytes();
+        document.identity.device = in.fixed64();
+        document.identity.inode = in.fixed64();
+        document.identity.size = in.fixed64();
+        document.identity.mtime_ns = (int64_t)in.fixed64();
+        document.page_count = (uint32_t)in.varint();
+    }
+    std::map<std::string, std::vector<Posting>> postings;
+    uint64_t term_count = in.varint();
+    for (uint64_t t = 0; t < term_count && in.ok; t++) {
+        std::string term = in.bytes();
+        uint64_t count = in.varint();
+        std::vector<Posting> list;
+        uint32_t document = 0;
+        uint32_t page = 0;
+        for (uint64_t i = 0; i < count && in.ok; i++) {
+            uint32_t document_delta = (uint32_t)in.varint();
+            uint32_t page_value = (uint32_t)in.varint();
+            document += document_delta;
+            page = document_delta == 0 && i > 0 ? page + page_value : page_value;
+            uint32_t occurrences = (uint32_t)in.varint();
+            if (document >= documents.size()) {
+                in.ok = false;
+                break;
+            }
+            list.push_back(Posting{document, page, occurrences});
+        }
+        postings.emplace(std::move(term), std::move(list));
+    }
+    if (!in.ok) {
+        return false;
+    }
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    documents_.swap(documents);
+    postings_.swap(postings);
+    document_ids_.clear();
+    for (uint32_t id = 0; id < documents_.size(); id++) {
+        document_ids_[documents_[id].path] = id;
+    }
+    dead_documents_ = 0;
+    return true;
+}
+
+} // namespace spdf
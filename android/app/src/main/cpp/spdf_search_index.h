@@ -0,0 +1,80 @@
+#ifndef SPDF_SEARCH_INDEX_H
+#define SPDF_SEARCH_INDEX_H
+
+#include <cstdint>
+#include <map>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include "spdf_file_identity.h"
+
+namespace spdf {
+
+// Lower-cased words of UTF-8 text: runs of letters and digits, with every
+// non-ASCII character counted as a letter
+std::vector<std::string> search_terms(const std::string& text);
+
+// Thread-safe inverted index over the page text of many documents. Documents
+// are keyed by path and re-indexed when their FileIdentity changes. The index
+// is persisted as one compact binary file (delta and varint coded postings)
+// so a library stays searchable across restarts without re-parsing any PDF.
+class SearchIndex {
+public:
+    struct Hit {
+        std::string path;
+        int32_t page = 0;   // 1-based
+        uint32_t score = 0; // occurrences of the query terms on the page
+    };
+
+    struct Stats {
+        size_t documents = 0;
+        size_t terms = 0;
+        size_t postings = 0;
+    };
+
+    // True when path is indexed with this identity
+    bool contains(const std::string& path, const FileIdentity& identity, uint32_t* page_count = nullptr) const;
+
+    // Replaces any previous entry for path; pages[i] is the text of page i + 1
+    void add_document(const std::string& path, const FileIdentity& identity, const std::vector<std::string>& pages);
+    void remove_document(const std::string& path);
+
+    // Pages containing every query term, best first. A trailing '*' on a
+    // term matches it as a prefix. paths, when non-empty, restricts the search.
+    std::vector<Hit> search(const std::string& query, size_t limit,
+                            const std::vector<std::string>& paths = std::vector<std::string>()) const;
+
+    Stats stats() const;
+
+    bool load(const std::string& file);
+    bool save(const std::string& file) const;
+
+private:
+    struct Posting {
+        uint32_t document;
+        uint32_t page;  // 0-based
+        uint32_t count;
+    };
+    struct Document {
+        std::string path;
+        FileIdentity identity;
+        uint32_t page_count = 0;
+        bool live = true;
+    };
+
+    void add_locked(const std::string& path, const FileIdentity& identity, const std::vector<std::string>& pages);
+    void remove_locked(const std::string& path);
+    void compact_locked();
+
+    mutable std::mutex mutex_;
+    std::vector<Document> documents_;
+    std::unordered_map<std::string, uint32_t> document_ids_;
+    // Ordered so prefix queries are a range scan; postings sorted by (document, page)
+    std::map<std::string, std::vector<Posting>> postings_;
+    size_t dead_documents_ = 0;
+};
+
+} // namespace spdf
+
+#endif // SPDF_SEARCH_INDEX_H
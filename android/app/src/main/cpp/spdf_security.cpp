@@ -0,0 +1,404 @@
+#include "spdf_security.h"
+#include <algorithm>
+#include <cstring>
+#include <random>
+#include "spdf_digest.h"
+
+namespace spdf {
+
+// Algorithm 2: passwords are padded or truncated to 32 bytes with this string
+static const uint8_t password_padding[32] = {0x28, 0xBF, 0x4E, 0x5E, 0x4E, 0x75, 0x8A, 0x41, 0x64, 0x00, 0x4E,
+                                             0x56, 0xFF, 0xFA, 0x01, 0x08, 0x2E, 0x2E, 0x00, 0xB6, 0xD0, 0x68,
+                                             0x3E, 0x80, 0x2F, 0x0C, 0xA9, 0xFE, 0x64, 0x53, 0x69, 0x7A};
+
+static std::string pad_password(const std::string& password) {
+    std::string padded = password.substr(0, 32);
+    padded.append((const char*)password_padding, 32 - padded.size());
+    return padded;
+}
+
+static std::string le32(uint32_t value) {
+    char bytes[4] = {(char)value, (char)(value >> 8), (char)(value >> 16), (char)(value >> 24)};
+    return std::string(bytes, 4);
+}
+
+static std::string xor_key(const std::string& key, uint8_t value) {
+    std::string result = key;
+    for (auto& c : result) {
+        c = (char)(c ^ value);
+    }
+    return result;
+}
+
+std::string rc4(const std::string& key, const std::string& data) {
+    uint8_t s[256];
+    for (int i = 0; i < 256; i++) {
+        s[i] = (uint8_t)i;
+    }
+    if (!key.empty()) {
+        uint8_t j = 0;
+        for (int i = 0; i < 256; i++) {
+            j = (uint8_t)(j + s[i] + (uint8_t)key[i % key.size()]);
+            std::swap(s[i], s[j]);
+        }
+    }
+    std::string out(data.size(), '\0');
+    uint8_t i = 0;
+    uint8_t j = 0;
+    for (size_t n = 0; n < data.size(); n++) {
+        i++;
+        j = (uint8_t)(j + s[i]);
+        std::swap(s[i], s[j]);
+        out[n] = (char)(data[n] ^ s[(uint8_t)(s[i] + s[j])]);
+    }
+    return out;
+}
+
+std::string random_bytes(size_t size) {
+    thread_local std::random_device device;
+    std::string bytes(size, '\0');
+    for (size_t i = 0; i < size; i += 4) {
+        uint32_t value = device();
+        memcpy(&bytes[i], &value, std::min<size_t>(4, size - i));
+    }
+    return bytes;
+}
+
+// AES-256-CBC without padding and with a zero IV, as used for /UE, /OE
+static std::string aes256_wrap(const std::string& key, const std::string& data, bool encrypting) {
+    Aes aes;
+    aes.set_key((const uint8_t*)key.data(), 32);
+    uint8_t iv[16] = {0};
+    std::string out(data.size() & ~(size_t)15, '\0');
+    if (encrypting) {
+        aes.cbc_encrypt((const uint8_t*)data.data(), (uint8_t*)&out[0], out.size(), iv);
+    } else {
+        aes.cbc_decrypt((const uint8_t*)data.data(), (uint8_t*)&out[0], out.size(), iv);
+    }
+    return out;
+}
+
+static SecurityHandler::Cipher crypt_filter_cipher(const PdfDict& encrypt, const std::string& name) {
+    if (name.empty() || name == "Identity") {
+        return SecurityHandler::Cipher::Identity;
+    }
+    const PdfDict& filter = encrypt.get("CF").as_dict().get(name).as_dict();
+    const PdfObject& method = filter.get("CFM");
+    if (method.is_name("AESV2")) {
+        return SecurityHandler::Cipher::Aes128;
+    }
+    if (method.is_name("AESV3")) {
+        return SecurityHandler::Cipher::Aes256;
+    }
+    if (method.is_name("V2")) {
+        return SecurityHandler::Cipher::Rc4;
+    }
+    return SecurityHandler::Cipher::Identity;
+}
+
+bool SecurityHandler::open(const PdfDict& encrypt, const std::string& file_id, const std::string& password,
+                           bool* authenticated, std::string* error) {
+    *authenticated = false;
+    if (!encrypt.get("Filter").is_name("Standard")) {
+        *error = "unsupported security handler " + encrypt.get("Filter").as_name();
+        return false;
+    }
+    encrypt_dict_ = encrypt;
+    version_ = (int)encrypt.get("V").as_int();
+    revision_ = (int)encrypt.get("R").as_int();
+    permissions_ = (int32_t)encrypt.get("P").as_int();
+    encrypt_metadata_ = encrypt.get("EncryptMetadata").as_bool(true);
+    owner_ = encrypt.get("O").as_string();
+    user_ = encrypt.get("U").as_string();
+    owner_key_ = encrypt.get("OE").as_string();
+    user_key_ = encrypt.get("UE").as_string();
+    file_id_ = file_id;
+
+    switch (version_) {
+        case 1:
+        case 2:
+            key_length_ = version_ == 1 ? 5 : (int)encrypt.get("Length").as_int(40) / 8;
+            stream_cipher_ = string_cipher_ = Cipher::Rc4;
+            break;
+        case 4:
+            key_length_ = 16;
+            stream_cipher_ = crypt_filter_cipher(encrypt, encrypt.get("StmF").as_name());
+            string_cipher_ = crypt_filter_cipher(encrypt, encrypt.get("StrF").as_name());
+            break;
+        case 5:
+            key_length_ = 32;
+            stream_cipher_ = crypt_filter_cipher(encrypt, encrypt.get("StmF").as_name());
+            string_cipher_ = crypt_filter_cipher(encrypt, encrypt.get("StrF").as_name());
+            break;
+        default:
+            *error = "unsupported encryption version " + std::to_string(version_);
+            return false;
+    }
+    if (key_length_ < 5 || key_length_ > 32) {
+        *error = "invalid encryption key length";
+        return false;
+    }
+
+    if (revision_ >= 2 && revision_ <= 4) {
+        if (owner_.size() < 32 || user_.size() < 32) {
+            *error = "malformed /O or /U";
+            return false;
+        }
+        *authenticated = authenticate_r4(password, false) || authenticate_r4(password, true);
+    } else if (revision_ == 5 || revision_ == 6) {
+        if (owner_.size() < 48 || user_.size() < 48 || owner_key_.size() < 32 || user_key_.size() < 32) {
+            *error = "malformed /O, /U, /OE or /UE";
+            return false;
+        }
+        // UTF-8 passwords are used as given; SASLprep normalisation is not applied
+        std::string truncated = password.substr(0, 127);
+        *authenticated = authenticate_r6(truncated, false) || authenticate_r6(truncated, true);
+        if (*authenticated) {
+            file_aes_.set_key((const uint8_t*)file_key_.data(), 32);
+        }
+    } else {
+        *error = "unsupported security handler revision " + std::to_string(revision_);
+        return false;
+    }
+    return true;
+}
+
+// Algorithm 2
+std::string SecurityHandler::compute_r4_key(const std::string& password) const {
+    Md5 hash;
+    std::string padded = pad_password(password);
+    hash.update(padded.data(), padded.size());
+    hash.update(owner_.data(), 32);
+    std::string permissions = le32((uint32_t)permissions_);
+    hash.update(permissions.data(), 4);
+    hash.update(file_id_.data(), file_id_.size());
+    if (revision_ >= 4 && !encrypt_metadata_) {
+        hash.update("\xff\xff\xff\xff", 4);
+    }
+    uint8_t digest[16];
+    hash.final(digest);
+    size_t n = revision_ == 2 ? 5 : (size_t)std::min(key_length_, 16);
+    if (revision_ >= 3) {
+        for (int i = 0; i < 50; i++) {
+            Md5 again;
+            again.update(digest, n);
+            again.final(digest);
+        }
+    }
+    return std::string((const char*)digest, n);
+}
+
+// Algorithms 6 (user) and 7 (owner)
+bool SecurityHandler::authenticate_r4(const std::string& password, bool owner) {
+    if (owner) {
+        std::string digest = md5(pad_password(password));
+        size_t n = revision_ == 2 ? 5 : (size_t)std::min(key_length_, 16);
+        if (revision_ >= 3) {
+            for (int i = 0; i < 50; i++) {
+                digest = md5(digest);
+            }
+        }
+        std::string key = digest.substr(0, n);
+        std::string user_password = owner_.substr(0, 32);
+        if (revision_ == 2) {
+            user_password = rc4(key, user_password);
+        } else {
+            for (int i = 19; i >= 0; i--) {
+                user_password = rc4(xor_key(key, (uint8_t)i), user_password);
+            }
+        }
+        return authenticate_r4(user_password, false);
+    }
+
+    std::string key = compute_r4_key(password);
+    bool ok;
+    if (revision_ == 2) {
+        ok = rc4(key, std::string((const char*)password_padding, 32)) == user_.substr(0, 32);
+    } else {
+        std::string check = md5(std::string((const char*)password_padding, 32) + file_id_);
+        check = rc4(key, check);
+        for (int i = 1; i <= 19; i++) {
+            check = rc4(xor_key(key, (uint8_t)i), check);
+        }
+        ok = check == user_.substr(0, 16);
+    }
+    if (ok) {
+        file_key_ = key;
+    }
+    return ok;
+}
+
+// Algorithm 2.B (revision 6) or plain SHA-256 (revision 5)
+std::string SecurityHandler::r6_hash(const std::string& password, const std::string& salt,
+                                     const std::string& user_data) const {
+    std::string k = sha256(password + salt + user_data);
+    if (revision_ == 5) {
+        return k;
+    }
+    std::string block;
+    std::string e;
+    for (int round = 0; round < 64 || (uint8_t)e.back() > round - 32; round++) {
+        std::string sequence = password + k + user_data;
+        block.clear();
+        for (int i = 0; i < 64; i++) {
+            block += sequence;
+        }
+        Aes aes;
+        aes.set_key((const uint8_t*)k.data(), 16);
+        uint8_t iv[16];
+        memcpy(iv, k.data() + 16, 16);
+        e.resize(block.size());
+        aes.cbc_encrypt((const uint8_t*)block.data(), (uint8_t*)&e[0], block.size(), iv);
+        // The first 16 bytes as a 128-bit big-endian number mod 3
+        unsigned sum = 0;
+        for (int i = 0; i < 16; i++) {
+            sum += (uint8_t)e[i];
+        }
+        switch (sum % 3) {
+            case 0: k = sha256(e); break;
+            case 1: k = sha384(e); break;
+            default: k = sha512(e); break;
+        }
+    }
+    return k.substr(0, 32);
+}
+
+// Algorithms 2.A, 11 and 12
+bool SecurityHandler::authenticate_r6(const std::string& password, bool owner) {
+    std::string user_data = owner ? user_.substr(0, 48) : std::string();
+    const std::string& hashed = owner ? owner_ : user_;
+    if (r6_hash(password, hashed.substr(32, 8), user_data) != hashed.substr(0, 32)) {
+        return false;
+    }
+    std::string intermediate = r6_hash(password, hashed.substr(40, 8), user_data);
+    file_key_ = aes256_wrap(intermediate, (owner ? owner_key_ : user_key_).substr(0, 32), false);
+    return true;
+}
+
+bool SecurityHandler::create(const std::string& user_password, const std::string& owner_password,
+                             std::string* error) {
+    std::string user = user_password.substr(0, 127);
+    std::string owner = owner_password.empty() ? user : owner_password.substr(0, 127);
+    version_ = 5;
+    revision_ = 6;
+    key_length_ = 32;
+    permissions_ = -4;  // every operation allowed once the document is open
+    encrypt_metadata_ = true;
+    stream_cipher_ = string_cipher_ = Cipher::Aes256;
+    file_key_ = random_bytes(32);
+    if (!file_aes_.set_key((const uint8_t*)file_key_.data(), 32)) {
+        *error = "cannot set up the AES key";
+        return false;
+    }
+
+    // Algorithms 8 and 9
+    std::string salts = random_bytes(16);
+    user_ = r6_hash(user, salts.substr(0, 8), std::string()) + salts;
+    user_key_ = aes256_wrap(r6_hash(user, salts.substr(8, 8), std::string()), file_key_, true);
+    salts = random_bytes(16);
+    owner_ = r6_hash(owner, salts.substr(0, 8), user_) + salts;
+    owner_key_ = aes256_wrap(r6_hash(owner, salts.substr(8, 8), user_), file_key_, true);
+
+    // Algorithm 10
+    uint8_t perms[16];
+    memcpy(perms, le32((uint32_t)permissions_).data(), 4);
+    memset(perms + 4, 0xff, 4);
+    memcpy(perms + 8, encrypt_metadata_ ? "Tadb" : "Fadb", 4);
+    memcpy(perms + 12, random_bytes(4).data(), 4);
+    uint8_t perms_encrypted[16];
+    file_aes_.encrypt_block(perms, perms_encrypted);
+
+    PdfDict filter;
+    filter.set("AuthEvent", PdfObject::name("DocOpen"));
+    filter.set("CFM", PdfObject::name("AESV3"));
+    filter.set("Length", PdfObject::integer(32));
+    PdfDict filters;
+    filters.set("StdCF", PdfObject::dict(std::move(filter)));
+
+    encrypt_dict_ = PdfDict();
+    encrypt_dict_.set("Filter", PdfObject::name("Standard"));
+    encrypt_dict_.set("V", PdfObject::integer(version_));
+    encrypt_dict_.set("R", PdfObject::integer(revision_));
+    encrypt_dict_.set("Length", PdfObject::integer(256));
+    encrypt_dict_.set("CF", PdfObject::dict(std::move(filters)));
+    encrypt_dict_.set("StmF", PdfObject::name("StdCF"));
+    encrypt_dict_.set("StrF", PdfObject::name("StdCF"));
+    encrypt_dict_.set("O", PdfObject::string(owner_, true));
+    encrypt_dict_.set("U", PdfObject::string(user_, true));
+    encrypt_dict_.set("OE", PdfObject::string(owner_key_, true));
+    encrypt_dict_.set("UE", PdfObject::string(user_key_, true));
+    encrypt_dict_.set("P", PdfObject::integer(permissions_));
+    encrypt_dict_.set("Perms", PdfObject::string(std::string((const char*)perms_encrypted, 16), true));
+    return true;
+}
+
+// Algorithm 1: RC4 and AES-128 keys are salted with the object number
+std::string SecurityHandler::object_key(ObjectRef ref, Cipher cipher) const {
+    std::string input = file_key_;
+    input += (char)ref.num;
+    input += (char)(ref.num >> 8);
+    input += (char)(ref.num >> 16);
+    input += (char)ref.gen;
+    input += (char)(ref.gen >> 8);
+    if (cipher == Cipher::Aes128) {
+        input += "sAlT";
+    }
+    return md5(input).substr(0, std::min<size_t>(file_key_.size() + 5, 16));
+}
+
+std::string SecurityHandler::crypt(ObjectRef ref, const std::string& data, bool stream, bool encrypting) const {
+    Cipher cipher = stream ? stream_cipher_ : string_cipher_;
+    if (cipher == Cipher::Identity) {
+        return data;
+    }
+    if (cipher == Cipher::Rc4) {
+        return rc4(object_key(ref, cipher), data);
+    }
+
+    Aes object_aes;
+    const Aes* aes = &file_aes_;
+    if (cipher == Cipher::Aes128) {
+        std::string key = object_key(ref, cipher);
+        object_aes.set_key((const uint8_t*)key.data(), key.size());
+        aes = &object_aes;
+    }
+    uint8_t iv[16];
+    std::string out;
+    if (encrypting) {
+        // Random IV in front, PKCS#7 padding at the end
+        memcpy(iv, random_bytes(16).data(), 16);
+        size_t whole = data.size() & ~(size_t)15;
+        size_t padding = 16 - (data.size() - whole);
+        uint8_t last[16];
+        memcpy(last, data.data() + whole, 16 - padding);
+        memset(last + 16 - padding, (int)padding, padding);
+        out.resize(16 + whole + 16);
+        memcpy(&out[0], iv, 16);
+        aes->cbc_encrypt((const uint8_t*)data.data(), (uint8_t*)&out[16], whole, iv);
+        aes->cbc_encrypt(last, (uint8_t*)&out[16 + whole], 16, iv);
+        return out;
+    }
+    if (data.size() < 32) {
+        // Anything shorter than IV plus one block can only be an empty value
+        return std::string();
+    }
+    memcpy(iv, data.data(), 16);
+    out.resize((data.size() - 16) & ~(size_t)15);
+    aes->cbc_decrypt((const uint8_t*)data.data() + 16, (uint8_t*)&out[0], out.size(), iv);
+    uint8_t padding = (uint8_t)out.back();
+    if (padding >= 1 && padding <= 16 && padding <= out.size() &&
+        std::all_of(out.end() - padding, out.end(), [padding](char c) { return (uint8_t)c == padding; })) {
+        out.resize(out.size() - padding);
+    }
+    return out;
+}
+
+std::string SecurityHandler::decrypt(ObjectRef ref, const std::string& data, bool stream) const {
+    return crypt(ref, data, stream, false);
+}
+
+std::string SecurityHandler::encrypt(ObjectRef ref, const std::string& data, bool stream) const {
+    return crypt(ref, data, stream, true);
+}
+
+} // namespace spdf
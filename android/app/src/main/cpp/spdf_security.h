@@ -0,0 +1,77 @@
+#ifndef SPDF_SECURITY_H
+#define SPDF_SECURITY_H
+
+#include <cstdint>
+#include <string>
+#include "spdf_aes.h"
+#include "spdf_object.h"
+
+namespace spdf {
+
+// PDF standard security handler (ISO 32000-2 7.6): revisions 2-4 with RC4 or
+// AES-128 per-object keys, and revisions 5-6 with AES-256 and the file key.
+// After open() or create() the handler is immutable, so encrypt() and
+// decrypt() can run on many threads at once.
+class SecurityHandler {
+public:
+    enum class Cipher { Identity, Rc4, Aes128, Aes256 };
+
+    // Reads an /Encrypt dictionary and tries password as the user password,
+    // then as the owner password. Returns false when the dictionary is not a
+    // supported standard handler; *authenticated reports whether the password
+    // (possibly empty) unlocked the file key.
+    bool open(const PdfDict& encrypt, const std::string& file_id, const std::string& password, bool* authenticated,
+              std::string* error);
+
+    // New revision 6 (AES-256) handler for locking a document. The passwords
+    // are UTF-8; an empty owner password reuses the user password.
+    bool create(const std::string& user_password, const std::string& owner_password, std::string* error);
+
+    // The /Encrypt dictionary describing this handler
+    const PdfDict& encrypt_dict() const { return encrypt_dict_; }
+
+    int revision() const { return revision_; }
+    Cipher stream_cipher() const { return stream_cipher_; }
+    Cipher string_cipher() const { return string_cipher_; }
+    // False when /Metadata streams are stored in the clear
+    bool encrypt_metadata() const { return encrypt_metadata_; }
+
+    // Strings and streams of object ref. Decryption is lenient: bad padding or
+    // a truncated AES block yields the bytes that could be recovered.
+    std::string decrypt(ObjectRef ref, const std::string& data, bool stream) const;
+    std::string encrypt(ObjectRef ref, const std::string& data, bool stream) const;
+
+private:
+    bool authenticate_r4(const std::string& password, bool owner);
+    bool authenticate_r6(const std::string& password, bool owner);
+    std::string compute_r4_key(const std::string& password) const;
+    std::string r6_hash(const std::string& password, const std::string& salt, const std::string& user_data) const;
+    std::string object_key(ObjectRef ref, Cipher cipher) const;
+    std::string crypt(ObjectRef ref, const std::string& data, bool stream, bool encrypting) const;
+
+    PdfDict encrypt_dict_;
+    int version_ = 0;
+    int revision_ = 0;
+    int key_length_ = 5;  // bytes
+    int32_t permissions_ = 0;
+    bool encrypt_metadata_ = true;
+    Cipher stream_cipher_ = Cipher::Identity;
+    Cipher string_cipher_ = Cipher::Identity;
+    std::string owner_;      // /O
+    std::string user_;       // /U
+    std::string owner_key_;  // /OE
+    std::string user_key_;   // /UE
+    std::string file_id_;
+    std::string file_key_;
+    Aes file_aes_;           // revision 5-6: every object uses the file key
+};
+
+// RC4, symmetric; used by revision 2-4 handlers and their key derivation
+std::string rc4(const std::string& key, const std::string& data);
+
+// Cryptographically random bytes for keys, salts and IVs
+std::string random_bytes(size_t size);
+
+} // namespace spdf
+
+#endif // SPDF_SECURITY_H
@@ -0,0 +1,485 @@
+#include "spdf_simd.h"
+#include <atomic>
+#include <cstdint>
+#include <cstring>
+#include "spdf_lexer.h"
+
+#if defined(__x86_64__) || (defined(__i386__) && defined(__SSE2__))
+#include <immintrin.h>
+#define SPDF_SIMD_X86 1
+#elif defined(__aarch64__)
+#include <arm_neon.h>
+#define SPDF_SIMD_NEON 1
+#endif
+
+namespace spdf {
+
+// ---------------------------------------------------------------------------
+// Scalar
+
+static size_t scalar_whitespace(const char* data, size_t size) {
+    size_t i = 0;
+    while (i < size && is_pdf_whitespace((unsigned char)data[i])) {
+        i++;
+    }
+    return i;
+}
+
+static size_t scalar_regular(const char* data, size_t size) {
+    size_t i = 0;
+    while (i < size && is_pdf_regular((unsigned char)data[i])) {
+        i++;
+    }
+    return i;
+}
+
+static size_t scalar_string_plain(const char* data, size_t size) {
+    size_t i = 0;
+    while (i < size) {
+        char c = data[i];
+        if (c == '\\' || c == '(' || c == ')' || c == '\r') {
+            break;
+        }
+        i++;
+    }
+    return i;
+}
+
+static size_t scalar_find(const char* data, size_t size, const char* needle, size_t length) {
+    const char* found = (const char*)memmem(data, size, needle, length);
+    return found ? (size_t)(found - data) : size;
+}
+
+static void scalar_classify_block(const char* data, uint64_t* whitespace, uint64_t* regular) {
+    uint64_t w = 0;
+    uint64_t r = 0;
+    for (int i = 0; i < 64; i++) {
+        uint8_t c = pdf_char_class[(unsigned char)data[i]];
+        w |= (uint64_t)(c == CHAR_WHITESPACE) << i;
+        r |= (uint64_t)(c == CHAR_REGULAR) << i;
+    }
+    *whitespace = w;
+    *regular = r;
+}
+
+// Nibble lookup for the AVX2 and NEON classifiers: class = lo[c & 15] & hi[c >> 4]
+// is non-zero exactly for whitespace and delimiters, and bits 0-1 mark whitespace.
+//   bit 0: 00 09 0A 0C 0D   bit 1: 20   bit 2: % ( ) /   bit 3: < >   bit 4: [ ] { }
+alignas(16) static const uint8_t class_lo[16] = {0x03, 0, 0, 0, 0, 0x04, 0, 0,
+                                                 0x04, 0x05, 0x01, 0x10, 0x09, 0x11, 0x08, 0x04};
+alignas(16) static const uint8_t class_hi[16] = {0x01, 0, 0x06, 0x08, 0, 0x10, 0, 0x10,
+                                                 0, 0, 0, 0, 0, 0, 0, 0};
+static const uint8_t CLASS_WHITESPACE_BITS = 0x03;
+
+#if SPDF_SIMD_X86
+
+// ---------------------------------------------------------------------------
+// SSE2: byte compares against each member of the set
+
+static inline __m128i sse2_whitespace_mask(__m128i v) {
+    __m128i m = _mm_cmpeq_epi8(v, _mm_set1_epi8(' '));
+    m = _mm_or_si128(m, _mm_cmpeq_epi8(v, _mm_setzero_si128()));
+    m = _mm_or_si128(m, _mm_cmpeq_epi8(v, _mm_set1_epi8('\t')));
+    m = _mm_or_si128(m, _mm_cmpeq_epi8(v, _mm_set1_epi8('\n')));
+    m = _mm_or_si128(m, _mm_cmpeq_epi8(v, _mm_set1_epi8('\f')));
+    return _mm_or_si128(m, _mm_cmpeq_epi8(v, _mm_set1_epi8('\r')));
+}
+
+static inline __m128i sse2_delimiter_mask(__m128i v) {
+    __m128i m = _mm_cmpeq_epi8(v, _mm_set1_epi8('/'));
+    m = _mm_or_si128(m, _mm_cmpeq_epi8(v, _mm_set1_epi8('%')));
+    m = _mm_or_si128(m, _mm_cmpeq_epi8(v, _mm_set1_epi8('(')));
+    m = _mm_or_si128(m, _mm_cmpeq_epi8(v, _mm_set1_epi8(')')));
+    m = _mm_or_si128(m, _mm_cmpeq_epi8(v, _mm_set1_epi8('<')));
+    m = _mm_or_si128(m, _mm_cmpeq_epi8(v, _mm_set1_epi8('>')));
+    m = _mm_or_si128(m, _mm_cmpeq_epi8(v, _mm_set1_epi8('[')));
+    m = _mm_or_si128(m, _mm_cmpeq_epi8(v, _mm_set1_epi8(']')));
+    m = _mm_or_si128(m, _mm_cmpeq_epi8(v, _mm_set1_epi8('{')));
+    return _mm_or_si128(m, _mm_cmpeq_epi8(v, _mm_set1_epi8('}')));
+}
+
+static inline __m128i sse2_string_special_mask(__m128i v) {
+    __m128i m = _mm_cmpeq_epi8(v, _mm_set1_epi8('\\'));
+    m = _mm_or_si128(m, _mm_cmpeq_epi8(v, _mm_set1_epi8('(')));
+    m = _mm_or_si128(m, _mm_cmpeq_epi8(v, _mm_set1_epi8(')')));
+    return _mm_or_si128(m, _mm_cmpeq_epi8(v, _mm_set1_epi8('\r')));
+}
+
+static size_t sse2_whitespace(const char* data, size_t size) {
+    size_t i = 0;
+    for (; i + 16 <= size; i += 16) {
+        __m128i v = _mm_loadu_si128((const __m128i*)(data + i));
+        unsigned stop = ~(unsigned)_mm_movemask_epi8(sse2_whitespace_mask(v)) & 0xFFFF;
+        if (stop) {
+            return i + (size_t)__builtin_ctz(stop);
+        }
+    }
+    return i + scalar_whitespace(data + i, size - i);
+}
+
+static size_t sse2_regular(const char* data, size_t size) {
+    size_t i = 0;
+    for (; i + 16 <= size; i += 16) {
+        __m128i v = _mm_loadu_si128((const __m128i*)(data + i));
+        unsigned stop = (unsigned)_mm_movemask_epi8(_mm_or_si128(sse2_whitespace_mask(v), sse2_delimiter_mask(v)));
+        if (stop) {
+            return i + (size_t)__builtin_ctz(stop);
+        }
+    }
+    return i + scalar_regular(data + i, size - i);
+}
+
+static size_t sse2_string_plain(const char* data, size_t size) {
+    size_t i = 0;
+    for (; i + 16 <= size; i += 16) {
+        __m128i v = _mm_loadu_si128((const __m128i*)(data + i));
+        unsigned stop = (unsigned)_mm_movemask_epi8(sse2_string_special_mask(v));
+        if (stop) {
+            return i + (size_t)__builtin_ctz(stop);
+        }
+    }
+    return i + scalar_string_plain(data + i, size - i);
+}
+
+// Candidates are positions where both the first and the last needle byte
+// match; memcmp confirms the bytes in between
+static size_t sse2_find(const char* data, size_t size, const char* needle, size_t length) {
+    if (length < 2 || size < length) {
+        return scalar_find(data, size, needle, length);
+    }
+    const __m128i first = _mm_set1_epi8(needle[0]);
+    const __m128i last = _mm_set1_epi8(needle[length - 1]);
+    size_t i = 0;
+    for (; i + length - 1 + 16 <= size; i += 16) {
+        __m128i head = _mm_loadu_si128((const __m128i*)(data + i));
+        __m128i tail = _mm_loadu_si128((const __m128i*)(data + i + length - 1));
+        unsigned candidates =
+            (unsigned)_mm_movemask_epi8(_mm_and_si128(_mm_cmpeq_epi8(head, first), _mm_cmpeq_epi8(tail, last)));
+        while (candidates) {
+            size_t at = i + (size_t)__builtin_ctz(candidates);
+            if (memcmp(data + at + 1, needle + 1, length - 2) == 0) {
+                return at;
+            }
+            candidates &= candidates - 1;
+        }
+    }
+    return i + scalar_find(data + i, size - i, needle, length);
+}
+
+static void sse2_classify_block(const char* data, uint64_t* whitespace, uint64_t* regular) {
+    uint64_t w = 0;
+    uint64_t r = 0;
+    for (int i = 0; i < 64; i += 16) {
+        __m128i v = _mm_loadu_si128((const __m128i*)(data + i));
+        __m128i ws = sse2_whitespace_mask(v);
+        w |= (uint64_t)(unsigned)_mm_movemask_epi8(ws) << i;
+        r |= (uint64_t)(~(unsigned)_mm_movemask_epi8(_mm_or_si128(ws, sse2_delimiter_mask(v))) & 0xFFFF) << i;
+    }
+    *whitespace = w;
+    *regular = r;
+}
+
+// ---------------------------------------------------------------------------
+// AVX2: nibble table classification, 32 bytes per step
+
+#define SPDF_AVX2 __attribute__((target("avx2")))
+
+SPDF_AVX2 static inline __m256i avx2_classify(__m256i v) {
+    const __m256i lo_table = _mm256_broadcastsi128_si256(_mm_load_si128((const __m128i*)class_lo));
+    const __m256i hi_table = _mm256_broadcastsi128_si256(_mm_load_si128((const __m128i*)class_hi));
+    const __m256i nibble = _mm256_set1_epi8(0x0F);
+    __m256i lo = _mm256_shuffle_epi8(lo_table, _mm256_and_si256(v, nibble));
+    __m256i hi = _mm256_shuffle_epi8(hi_table, _mm256_and_si256(_mm256_srli_epi16(v, 4), nibble));
+    return _mm256_and_si256(lo, hi);
+}
+
+SPDF_AVX2 static size_t avx2_whitespace(const char* data, size_t size) {
+    const __m256i whitespace_bits = _mm256_set1_epi8(CLASS_WHITESPACE_BITS);
+    size_t i = 0;
+    for (; i + 32 <= size; i += 32) {
+        __m256i v = _mm256_loadu_si256((const __m256i*)(data + i));
+        __m256i not_whitespace =
+            _mm256_cmpeq_epi8(_mm256_and_si256(avx2_classify(v), whitespace_bits), _mm256_setzero_si256());
+        unsigned stop = (unsigned)_mm256_movemask_epi8(not_whitespace);
+        if (stop) {
+            return i + (size_t)__builtin_ctz(stop);
+        }
+    }
+    return i + sse2_whitespace(data + i, size - i);
+}
+
+SPDF_AVX2 static size_t avx2_regular(const char* data, size_t size) {
+    size_t i = 0;
+    for (; i + 32 <= size; i += 32) {
+        __m256i v = _mm256_loadu_si256((const __m256i*)(data + i));
+        __m256i regular = _mm256_cmpeq_epi8(avx2_classify(v), _mm256_setzero_si256());
+        unsigned stop = ~(unsigned)_mm256_movemask_epi8(regular);
+        if (stop) {
+            return i + (size_t)__builtin_ctz(stop);
+        }
+    }
+    return i + sse2_regular(data + i, size - i);
+}
+
+SPDF_AVX2 static size_t avx2_string_plain(const char* data, size_t size) {
+    size_t i = 0;
+    for (; i + 32 <= size; i += 32) {
+        __m256i v = _mm256_loadu_si256((const __m256i*)(data + i));
+        __m256i m = _mm256_cmpeq_epi8(v, _mm256_set1_epi8('\\'));
+        m = _mm256_or_si256(m, _mm256_cmpeq_epi8(v, _mm256_set1_epi8('(')));
+        m = _mm256_or_si256(m, _mm256_cmpeq_epi8(v, _mm256_set1_epi8(')')));
+        m = _mm256_or_si256(m, _mm256_cmpeq_epi8(v, _mm256_set1_epi8('\r')));
+        unsigned stop = (unsigned)_mm256_movemask_epi8(m);
+        if (stop) {
+            return i + (size_t)__builtin_ctz(stop);
+        }
+    }
+    return i + sse2_string_plain(data + i, size - i);
+}
+
+SPDF_AVX2 static size_t avx2_find(const char* data, size_t size, const char* needle, size_t length) {
+    if (length < 2 || size < length) {
+        return scalar_find(data, size, needle, length);
+    }
+    const __m256i first = _mm256_set1_epi8(needle[0]);
+    const __m256i last = _mm256_set1_epi8(needle[length - 1]);
+    size_t i = 0;
+    for (; i + length - 1 + 32 <= size; i += 32) {
+        __m256i head = _mm256_loadu_si256((const __m256i*)(data + i));
+        __m256i tail = _mm256_loadu_si256((const __m256i*)(data + i + length - 1));
+        unsigned candidates = (unsigned)_mm256_movemask_epi8(
+            _mm256_and_si256(_mm256_cmpeq_epi8(head, first), _mm256_cmpeq_epi8(tail, last)));
+        while (candidates) {
+            size_t at = i + (size_t)__builtin_ctz(candidates);
+            if (memcmp(data + at + 1, needle + 1, length - 2) == 0) {
+                return at;
+            }
+            candidates &= candidates - 1;
+        }
+    }
+    return i + sse2_find(data + i, size - i, needle, length);
+}
+
+SPDF_AVX2 static void avx2_classify_block(const char* data, uint64_t* whitespace, uint64_t* regular) {
+    const __m256i whitespace_bits = _mm256_set1_epi8(CLASS_WHITESPACE_BITS);
+    const __m256i zero = _mm256_setzero_si256();
+    __m256i lo = avx2_classify(_mm256_loadu_si256((const __m256i*)data));
+    __m256i hi = avx2_classify(_mm256_loadu_si256((const __m256i*)(data + 32)));
+    uint64_t lo_other = (uint32_t)_mm256_movemask_epi8(_mm256_cmpeq_epi8(_mm256_and_si256(lo, whitespace_bits), zero));
+    uint64_t hi_other = (uint32_t)_mm256_movemask_epi8(_mm256_cmpeq_epi8(_mm256_and_si256(hi, whitespace_bits), zero));
+    uint64_t lo_regular = (uint32_t)_mm256_movemask_epi8(_mm256_cmpeq_epi8(lo, zero));
+    uint64_t hi_regular = (uint32_t)_mm256_movemask_epi8(_mm256_cmpeq_epi8(hi, zero));
+    *whitespace = ~(lo_other | hi_other << 32);
+    *regular = lo_regular | hi_regular << 32;
+}
+
+#endif // SPDF_SIMD_X86
+
+#if SPDF_SIMD_NEON
+
+// ---------------------------------------------------------------------------
+// NEON: nibble table classification with TBL, 16 bytes per step
+
+static inline uint8x16_t neon_classify(uint8x16_t v) {
+    const uint8x16_t lo_table = vld1q_u8(class_lo);
+    const uint8x16_t hi_table = vld1q_u8(class_hi);
+    uint8x16_t lo = vqtbl1q_u8(lo_table, vandq_u8(v, vdupq_n_u8(0x0F)));
+    uint8x16_t hi = vqtbl1q_u8(hi_table, vshrq_n_u8(v, 4));
+    return vandq_u8(lo, hi);
+}
+
+// 0x00/0xFF byte mask to 4 bits per byte; the first set byte is ctz / 4
+static inline uint64_t neon_bitmask(uint8x16_t mask) {
+    uint8x8_t narrowed = vshrn_n_u16(vreinterpretq_u16_u8(mask), 4);
+    return vget_lane_u64(vreinterpret_u64_u8(narrowed), 0);
+}
+
+static size_t neon_whitespace(const char* data, size_t size) {
+    size_t i = 0;
+    for (; i + 16 <= size; i += 16) {
+        uint8x16_t v = vld1q_u8((const uint8_t*)data + i);
+        uint8x16_t whitespace = vtstq_u8(neon_classify(v), vdupq_n_u8(CLASS_WHITESPACE_BITS));
+        uint64_t stop = ~neon_bitmask(whitespace);
+        if (stop) {
+            return i + (size_t)(__builtin_ctzll(stop) >> 2);
+        }
+    }
+    return i + scalar_whitespace(data + i, size - i);
+}
+
+static size_t neon_regular(const char* data, size_t size) {
+    size_t i = 0;
+    for (; i + 16 <= size; i += 16) {
+        uint8x16_t v = vld1q_u8((const uint8_t*)data + i);
+        uint64_t stop = neon_bitmask(vtstq_u8(neon_classify(v), vdupq_n_u8(0xFF)));
+        if (stop) {
+            return i + (size_t)(__builtin_ctzll(stop) >> 2);
+        }
+    }
+    return i + scalar_regular(data + i, size - i);
+}
+
+static size_t neon_string_plain(const char* data, size_t size) {
+    size_t i = 0;
+    for (; i + 16 <= size; i += 16) {
+        uint8x16_t v = vld1q_u8((const uint8_t*)data + i);
+        uint8x16_t m = vceqq_u8(v, vdupq_n_u8('\\'));
+        m = vorrq_u8(m, vceqq_u8(v, vdupq_n_u8('(')));
+        m = vorrq_u8(m, vceqq_u8(v, vdupq_n_u8(')')));
+        m = vorrq_u8(m, vceqq_u8(v, vdupq_n_u8('\r')));
+        uint64_t stop = neon_bitmask(m);
+        if (stop) {
+            return i + (size_t)(__builtin_ctzll(stop) >> 2);
+        }
+    }
+    return i + scalar_string_plain(data + i, size - i);
+}
+
+static size_t neon_find(const char* data, size_t size, const char* needle, size_t length) {
+    if (length < 2 || size < length) {
+        return scalar_find(data, size, needle, length);
+    }
+    const uint8x16_t first = vdupq_n_u8((uint8_t)needle[0]);
+    const uint8x16_t last = vdupq_n_u8((uint8_t)needle[length - 1]);
+    size_t i = 0;
+    for (; i + length - 1 + 16 <= size; i += 16) {
+        uint8x16_t head = vld1q_u8((const uint8_t*)data + i);
+        uint8x16_t tail = vld1q_u8((const uint8_t*)data + i + length - 1);
+        uint64_t candidates = neon_bitmask(vandq_u8(vceqq_u8(head, first), vceqq_u8(tail, last)));
+        while (candidates) {
+            size_t at = i + (size_t)(__builtin_ctzll(candidates) >> 2);
+            if (memcmp(data + at + 1, needle + 1, length - 2) == 0) {
+                return at;
+            }
+            candidates &= ~(0xFull << (__builtin_ctzll(candidates) & ~3));
+        }
+    }
+    return i + scalar_find(data + i, size - i, needle, length);
+}
+
+static void neon_classify_block(const char* data, uint64_t* whitespace, uint64_t* regular) {
+    // One bit per byte: keep a single bit of each nibble pair from neon_bitmask
+    auto compress = [](uint64_t nibbles) {
+        uint64_t bits = 0;
+        for (int i = 0; i < 16; i++) {
+            bits |= ((nibbles >> (i * 4)) & 1) << i;
+        }
+        return bits;
+    };
+    uint64_t w = 0;
+    uint64_t r = 0;
+    for (int i = 0; i < 64; i += 16) {
+        uint8x16_t c = neon_classify(vld1q_u8((const uint8_t*)data + i));
+        w |= compress(neon_bitmask(vtstq_u8(c, vdupq_n_u8(CLASS_WHITESPACE_BITS)))) << i;
+        r |= compress(neon_bitmask(vceqq_u8(c, vdupq_n_u8(0)))) << i;
+    }
+    *whitespace = w;
+    *regular = r;
+}
+
+#endif // SPDF_SIMD_NEON
+
+// ---------------------------------------------------------------------------
+// Dispatch
+
+struct Scanners {
+    SimdLevel level;
+    void (*classify_block)(const char*, uint64_t*, uint64_t*);
+    size_t (*whitespace)(const char*, size_t);
+    size_t (*regular)(const char*, size_t);
+    size_t (*string_plain)(const char*, size_t);
+    size_t (*find)(const char*, size_t, const char*, size_t);
+};
+
+static const Scanners scalar_scanners = {SimdLevel::Scalar, scalar_classify_block, scalar_whitespace, scalar_regular,
+                                         scalar_string_plain, scalar_find};
+#if SPDF_SIMD_X86
+static const Scanners sse2_scanners = {SimdLevel::Sse2, sse2_classify_block, sse2_whitespace, sse2_regular,
+                                       sse2_string_plain, sse2_find};
+static const Scanners avx2_scanners = {SimdLevel::Avx2, avx2_classify_block, avx2_whitespace, avx2_regular,
+                                       avx2_string_plain, avx2_find};
+#endif
+#if SPDF_SIMD_NEON
+static const Scanners neon_scanners = {SimdLevel::Neon, neon_classify_block, neon_whitespace, neon_regular,
+                                       neon_string_plain, neon_find};
+#endif
+
+static const Scanners* scanners_for(SimdLevel level) {
+    switch (level) {
+#if SPDF_SIMD_X86
+        case SimdLevel::Sse2:
+            return &sse2_scanners;
+        case SimdLevel::Avx2:
+            // Also runs during static initialization, before the CPU model is set up
+            __builtin_cpu_init();
+            return __builtin_cpu_supports("avx2") ? &avx2_scanners : nullptr;
+#endif
+#if SPDF_SIMD_NEON
+        case SimdLevel::Neon:
+            return &neon_scanners;
+#endif
+        case SimdLevel::Scalar:
+            return &scalar_scanners;
+        default:
+            return nullptr;
+    }
+}
+
+static const Scanners* best_scanners() {
+    for (SimdLevel level : {SimdLevel::Avx2, SimdLevel::Neon, SimdLevel::Sse2}) {
+        if (const Scanners* scanners = scanners_for(level)) {
+            return scanners;
+        }
+    }
+    return &scalar_scanners;
+}
+
+static std::atomic<const Scanners*> active_scanners{best_scanners()};
+
+SimdLevel simd_level() {
+    return active_scanners.load(std::memory_order_relaxed)->level;
+}
+
+const char* simd_level_name(SimdLevel level) {
+    switch (level) {
+        case SimdLevel::Sse2: return "sse2";
+        case SimdLevel::Avx2: return "avx2";
+        case SimdLevel::Neon: return "neon";
+        default: return "scalar";
+    }
+}
+
+bool simd_level_supported(SimdLevel level) {
+    return scanners_for(level) != nullptr;
+}
+
+bool set_simd_level(SimdLevel level) {
+    const Scanners* scanners = scanners_for(level);
+    if (!scanners) {
+        return false;
+    }
+    active_scanners.store(scanners, std::memory_order_relaxed);
+    return true;
+}
+
+void classify_block(const char* data, uint64_t* whitespace, uint64_t* regular) {
+    active_scanners.load(std::memory_order_relaxed)->classify_block(data, whitespace, regular);
+}
+
+size_t scan_whitespace(const char* data, size_t size) {
+    return active_scanners.load(std::memory_order_relaxed)->whitespace(data, size);
+}
+
+size_t scan_regular(const char* data, size_t size) {
+    return active_scanners.load(std::memory_order_relaxed)->regular(data, size);
+}
+
+size_t scan_string_plain(const char* data, size_t size) {
+    return active_scanners.load(std::memory_order_relaxed)->string_plain(data, size);
+}
+
+size_t find_bytes(const char* data, size_t size, const char* needle, size_t length) {
+    return active_scanners.load(std::memory_order_relaxed)->find(data, size, needle, length);
+}
+
+} // namespace spdf
@@ -0,0 +1,44 @@
+#ifndef SPDF_SIMD_H
+#define SPDF_SIMD_H
+
+#include <cstddef>
+#include <cstdint>
+
+namespace spdf {
+
+// Instruction sets the character-class scanners and the image resampling
+// kernels can use. The best supported level is picked at startup (AVX2 is
+// detected at runtime); SSE2 and NEON are the baseline of x86-64 and AArch64.
+enum class SimdLevel { Scalar, Sse2, Avx2, Neon };
+
+SimdLevel simd_level();
+const char* simd_level_name(SimdLevel level);
+bool simd_level_supported(SimdLevel level);
+
+// Switches every scanner to level (benchmarks and cross-checks); false when unsupported
+bool set_simd_level(SimdLevel level);
+
+// Character classes of the 64 bytes at data as bitmasks: bit i of *whitespace
+// is set when data[i] is PDF whitespace, bit i of *regular when it is neither
+// whitespace nor a delimiter. Lets a tokenizer find token boundaries with bit
+// operations instead of testing one byte at a time.
+void classify_block(const char* data, uint64_t* whitespace, uint64_t* regular);
+
+// Length of the leading run of PDF whitespace (NUL, TAB, LF, FF, CR, space)
+size_t scan_whitespace(const char* data, size_t size);
+
+// Length of the leading run of regular characters: neither whitespace nor a
+// delimiter. This is the extent of a keyword, number or name body.
+size_t scan_regular(const char* data, size_t size);
+
+// Length of the leading run of literal-string bytes that need no decoding,
+// i.e. anything except '\\', '(', ')' and CR
+size_t scan_string_plain(const char* data, size_t size);
+
+// Offset of the first occurrence of needle (length bytes) in data, or size
+// when there is none. Used to find object and stream markers in bulk.
+size_t find_bytes(const char* data, size_t size, const char* needle, size_t length);
+
+} // namespace spdf
+
+#endif // SPDF_SIMD_H
@@ -0,0 +1,272 @@
+#include "spdf_text.h"
+#include <unistd.h>
+#include <algorithm>
+#include <cerrno>
+#include <cmath>
+#include "spdf_parser.h"
+
+namespace spdf {
+
+static const int MAX_FORM_DEPTH = 8;
+
+std::shared_ptr<PdfFont> TextExtractor::font_for(const PdfDict& resources, const std::string& name) {
+    PdfObject fonts = document_.lookup(resources, "Font");
+    const PdfObject& entry = fonts.as_dict().get(name);
+    if (entry.is_ref()) {
+        auto cached = fonts_.find(entry.as_ref().num);
+        if (cached != fonts_.end()) {
+            return cached->second;
+        }
+        auto font = PdfFont::load(document_, entry);
+        fonts_[entry.as_ref().num] = font;
+        return font;
+    }
+    return PdfFont::load(document_, entry);
+}
+
+bool TextExtractor::extract_page(size_t page_index, std::vector<GlyphRun>* runs, std::string* error) {
+    if (page_index >= document_.page_count()) {
+        *error = "page " + std::to_string(page_index + 1) + " out of range";
+        return false;
+    }
+    const PdfDict& page = document_.page(page_index).dict;
+    std::string content;
+    // Parts that cannot be decoded are skipped; the others still have their text
+    if (!document_.decode_contents(document_.lookup(page, "Contents"), &content, error) && content.empty()) {
+        return false;
+    }
+    error->clear();
+
+    PdfObject resources = document_.lookup(page, "Resources");
+    runs->clear();
+    forms_.clear();
+    run_content(content, resources.as_dict(), Matrix(), 0, (int32_t)page_index, runs);
+    return true;
+}
+
+void TextExtractor::run_content(const std::string& content, const PdfDict& resources, const Matrix& initial_ctm,
+                                int depth, int32_t page, std::vector<GlyphRun>* runs) {
+    struct State {
+        Matrix ctm;
+        double char_spacing = 0;
+        double word_spacing = 0;
+        double horizontal_scale = 1;
+        double leading = 0;
+        double rise = 0;
+        double font_size = 0;
+        std::shared_ptr<PdfFont> font;
+    };
+    State state;
+    state.ctm = initial_ctm;
+    std::vector<State> saved;
+    Matrix text_matrix;
+    Matrix line_matrix;
+    std::vector<Glyph> glyphs;
+
+    auto move_line = [&](double tx, double ty) {
+        Matrix translate;
+        translate.e = tx;
+        translate.f = ty;
+        line_matrix = translate.multiply(line_matrix);
+        text_matrix = line_matrix;
+    };
+
+    // Shows one string, appending to *run and advancing the text matrix
+    auto show = [&](const std::string& bytes, GlyphRun* run, bool* started) {
+        if (!state.font) {
+            state.font = PdfFont::load(document_, PdfObject());
+        }
+        state.font->decode(bytes, &glyphs);
+        for (const auto& glyph : glyphs) {
+            Matrix render;
+            render.a = state.font_size * state.horizontal_scale;
+            render.d = state.font_size;
+            render.f = state.rise;
+            Matrix device = render.multiply(text_matrix).multiply(state.ctm);
+            if (!*started) {
+                run->x = device.e;
+                run->y = device.f;
+                run->font_size = std::hypot(device.c, device.d);
+                *started = true;
+            }
+            run->text += glyph.text;
+            double advance = (glyph.width * state.font_size + state.char_spacing +
+                              (glyph.word_space ? state.word_spacing : 0)) *
+                             state.horizontal_scale;
+            text_matrix.e += advance * text_matrix.a;
+            text_matrix.f += advance * text_matrix.b;
+            Matrix end = render.multiply(text_matrix).multiply(state.ctm);
+            run->width = std::hypot(end.e - run->x, end.f - run->y);
+        }
+    };
+
+    auto emit = [&](GlyphRun run) {
+        if (!run.text.empty()) {
+            run.page = page;
+            runs->push_back(std::move(run));
+        }
+    };
+
+    ContentParser parser(content.data(), content.size());
+    std::vector<PdfObject> operands;
+    std::string_view op;
+    while (parser.next(&operands, &op)) {
+        size_t n = operands.size();
+        auto number = [&](size_t i) { return i < n ? operands[i].as_number() : 0.0; };
+
+        if (op == "q") {
+            saved.push_back(state);
+        } else if (op == "Q") {
+            if (!saved.empty()) {
+                state = saved.back();
+                saved.pop_back();
+            }
+        } else if (op == "cm" && n >= 6) {
+            state.ctm = Matrix::of(operands).multiply(state.ctm);
+        } else if (op == "BT") {
+            text_matrix = Matrix();
+            line_matrix = Matrix();
+        } else if (op == "Tc" && n >= 1) {
+            state.char_spacing = number(0);
+        } else if (op == "Tw" && n >= 1) {
+            state.word_spacing = number(0);
+        } else if (op == "Tz" && n >= 1) {
+            state.horizontal_scale = number(0) / 100;
+        } else if (op == "TL" && n >= 1) {
+            state.leading = number(0);
+        } else if (op == "Ts" && n >= 1) {
+            state.rise = number(0);
+        } else if (op == "Tf" && n >= 2) {
+            state.font = font_for(resources, operands[0].as_name());
+            state.font_size = number(1);
+        } else if (op == "Td" && n >= 2) {
+            move_line(number(0), number(1));
+        } else if (op == "TD" && n >= 2) {
+            state.leading = -number(1);
+            move_line(number(0), number(1));
+        } else if (op == "Tm" && n >= 6) {
+            text_matrix = line_matrix = Matrix::of(operands);
+        } else if (op == "T*") {
+            move_line(0, -state.leading);
+        } else if (op == "Tj" && n >= 1) {
+            GlyphRun run;
+            bool started = false;
+            show(operands[0].as_string(), &run, &started);
+            emit(std::move(run));
+        } else if ((op == "'" && n >= 1) || (op == "\"" && n >= 3)) {
+            if (op == "\"") {
+                state.word_spacing = number(0);
+                state.char_spacing = number(1);
+            }
+            move_line(0, -state.leading);
+            GlyphRun run;
+            bool started = false;
+            show(operands[n - 1].as_string(), &run, &started);
+            emit(std::move(run));
+        } else if (op == "TJ" && n >= 1) {
+            GlyphRun run;
+            bool started = false;
+            for (const auto& item : operands[0].as_array()) {
+                if (item.is_string()) {
+                    show(item.as_string(), &run, &started);
+                } else if (item.is_number()) {
+                    double adjustment = -item.as_number() / 1000;
+                    double advance = adjustment * state.font_size * state.horizontal_scale;
+                    text_matrix.e += advance * text_matrix.a;
+                    text_matrix.f += advance * text_matrix.b;
+                    // Kerning wider than a fifth of an em separates words
+                    if (adjustment > 0.2 && !run.text.empty() && run.text.back() != ' ') {
+                        run.text += ' ';
+                    }
+                }
+            }
+            emit(std::move(run));
+        } else if (op == "Do" && n >= 1 && depth < MAX_FORM_DEPTH) {
+            PdfObject xobjects = document_.lookup(resources, "XObject");
+            const PdfObject& entry = xobjects.as_dict().get(operands[0].as_name());
+            uint32_t form_num = entry.is_ref() ? entry.as_ref().num : 0;
+            if (form_num && std::find(forms_.begin(), forms_.end(), form_num) != forms_.end()) {
+                continue;
+            }
+            PdfObject form = document_.resolve(entry);
+            if (!form.is_stream() || !form.as_dict().get("Subtype").is_name("Form")) {
+                continue;
+            }
+            std::string form_content;
+            std::string error;
+            if (!document_.decode_contents(form, &form_content, &error)) {
+                continue;
+            }
+            Matrix form_ctm = Matrix::of(document_.lookup(form.as_dict(), "Matrix").as_array()).multiply(state.ctm);
+            PdfObject form_resources = document_.lookup(form.as_dict(), "Resources");
+            forms_.push_back(form_num);
+            run_content(form_content, form_resources.is_dict() ? form_resources.as_dict() : resources, form_ctm,
+                        depth + 1, page, runs);
+            forms_.pop_back();
+        }
+    }
+}
+
+bool TextExtractor::page_text(size_t page_index, std::string* text, std::string* error) {
+    std::vector<GlyphRun> runs;
+    if (!extract_page(page_index, &runs, error)) {
+        return false;
+    }
+    *text = layout_text(runs);
+    return true;
+}
+
+std::string layout_text(const std::vector<GlyphRun>& runs) {
+    std::string text;
+    const GlyphRun* previous = nullptr;
+    for (const auto& run : runs) {
+        if (previous) {
+            double size = std::max(1.0, std::min(run.font_size, previous->font_size));
+            double gap = run.x - (previous->x + previous->width);
+            if (std::fabs(run.y - previous->y) > size * 0.5) {
+                text += '\n';
+            } else if ((gap > size * 0.15 || gap < -size) && text.back() != ' ' && run.text[0] != ' ') {
+                text += ' ';
+            }
+        }
+        text += run.text;
+        previous = &run;
+    }
+    return text;
+}
+
+bool extract_document_text(const std::string& path, std::vector<std::string>* pages, PdfErrorCode* error_code,
+                           std::string* error, int32_t page_number) {
+    if (access(path.c_str(), R_OK) != 0) {
+        *error_code = errno == ENOENT ? PdfErrorCode_FileNotFound : PdfErrorCode_PermissionDenied;
+        *error = "cannot open " + path;
+        return false;
+    }
+    PdfDocument document;
+    if (!document.open(path, error)) {
+        *error_code = PdfErrorCode_InvalidPdf;
+        return false;
+    }
+    if (document.locked()) {
+        *error_code = PdfErrorCode_EncryptedPdf;
+        *error = "document is password protected";
+        return false;
+    }
+    if (page_number < 0 || (size_t)page_number > document.page_count()) {
+        *error_code = PdfErrorCode_InvalidParameter;
+        *error = "page " + std::to_string(page_number) + " out of range";
+        return false;
+    }
+    TextExtractor extractor(document);
+    pages->assign(document.page_count(), std::string());
+    for (size_t i = 0; i < document.page_count(); i++) {
+        if (page_number == 0 || i + 1 == (size_t)page_number) {
+            std::string page_error;
+            extractor.page_text(i, &(*pages)[i], &page_error);
+        }
+    }
+    *error_code = PdfErrorCode_Success;
+    return true;
+}
+
+} // namespace spdf
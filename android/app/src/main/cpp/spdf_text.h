@@ -0,0 +1,58 @@
+#ifndef SPDF_TEXT_H
+#define SPDF_TEXT_H
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include "spdf_document.h"
+#include "spdf_font.h"
+#include "spdf_parser.h"
+#include "spdfcore.h"
+
+namespace spdf {
+
+// Text shown by one Tj/TJ/'/" operation, positioned in default user space
+struct GlyphRun {
+    int32_t page = 0;        // 0-based
+    double x = 0;            // baseline origin of the first glyph
+    double y = 0;
+    double width = 0;        // advance of the whole run
+    double font_size = 0;    // effective size after the text and CTM scaling
+    std::string text;        // UTF-8
+};
+
+// Interprets page content streams (including form XObjects) for their text
+class TextExtractor {
+public:
+    explicit TextExtractor(PdfDocument& document) : document_(document) {}
+
+    bool extract_page(size_t page_index, std::vector<GlyphRun>* runs, std::string* error);
+
+    // Runs of the page joined into lines in content order
+    bool page_text(size_t page_index, std::string* text, std::string* error);
+
+private:
+    void run_content(const std::string& content, const PdfDict& resources, const Matrix& ctm, int depth,
+                     int32_t page, std::vector<GlyphRun>* runs);
+    std::shared_ptr<PdfFont> font_for(const PdfDict& resources, const std::string& name);
+
+    PdfDocument& document_;
+    std::unordered_map<uint32_t, std::shared_ptr<PdfFont>> fonts_;  // by font object number
+    std::vector<uint32_t> forms_;  // form XObjects being run, to stop recursion
+};
+
+// Joins runs into lines: a baseline change starts a new line and a visible gap
+// between runs on the same line becomes a space
+std::string layout_text(const std::vector<GlyphRun>& runs);
+
+// Text of every page of a file, or only of page_number (1-based) when it is
+// non-zero; other pages and pages that fail to interpret come back empty.
+// Failures are reported with the spdfcore C ABI error codes.
+bool extract_document_text(const std::string& path, std::vector<std::string>* pages, PdfErrorCode* error_code,
+                           std::string* error, int32_t page_number = 0);
+
+} // namespace spdf
+
+#endif // SPDF_TEXT_H
@@ -0,0 +1,651 @@
+#include "spdf_writer.h"
+#include <algorithm>
+#include <cerrno>
+#include <cinttypes>
+#include <cmath>
+#include <cstdio>
+#include <fcntl.h>
+#include <functional>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+#include "spdf_executor.h"
+#include "spdf_filters.h"
+#include "spdf_font_subset.h"
+#include "spdf_io.h"
+#include "spdf_lexer.h"
+#include "spdf_linearize.h"
+#include "spdf_memory.h"
+#include "spdf_prune.h"
+
+namespace spdf {
+
+// Objects parsed before the batch is handed to the workers
+static const size_t BATCH_OBJECTS = 4096;
+static const size_t BATCH_BYTES = 32u << 20;
+// Under a memory budget a batch takes at most this share of it: the parsed
+// objects and their serialised bytes are held together
+static const unsigned BATCH_SHARE = 4;
+static const int MAX_WRITE_DEPTH = 64;
+// Objects per object stream: large enough to compress well, small enough
+// that a reader needing one object does not inflate too much
+static const size_t OBJECT_STREAM_SIZE = 100;
+
+namespace {
+
+// Writes one object tree, encrypting strings with the key of ref when a
+// security handler is set
+struct Serializer {
+    const SecurityHandler* security = nullptr;
+    const Renumbering* renumbering = nullptr;
+    std::vector<uint32_t>* numbers = nullptr;  // records the number of each reference written
+    std::vector<uint32_t>* offsets = nullptr;  // and where it starts in out
+    ObjectRef ref;
+    std::string* out;
+
+    void write(const PdfObject& object, int depth);
+    void write_string(const std::string& bytes, bool hex);
+    void write_name(const std::string& name);
+    void write_dict(const PdfDict& dict, int depth, int64_t stream_length);
+};
+
+void Serializer::write_string(const std::string& bytes, bool hex) {
+    static const char digits[] = "0123456789ABCDEF";
+    if (hex) {
+        *out += '<';
+        for (unsigned char c : bytes) {
+            *out += digits[c >> 4];
+            *out += digits[c & 15];
+        }
+        *out += '>';
+        return;
+    }
+    *out += '(';
+    for (char c : bytes) {
+        switch (c) {
+            case '(':
+            case ')':
+            case '\\':
+                *out += '\\';
+                *out += c;
+                break;
+            case '\r':
+                // A raw CR would be read back as a line break
+                *out += "\\r";
+                break;
+            default:
+                *out += c;
+                break;
+        }
+    }
+    *out += ')';
+}
+
+void Serializer::write_name(const std::string& name) {
+    static const char digits[] = "0123456789ABCDEF";
+    *out += '/';
+    for (unsigned char c : name) {
+        if (c < 0x21 || c > 0x7e || c == '#' || pdf_char_class[c] != CHAR_REGULAR) {
+            *out += '#';
+            *out += digits[c >> 4];
+            *out += digits[c & 15];
+        } else {
+            *out += (char)c;
+        }
+    }
+}
+
+void Serializer::write_dict(const PdfDict& dict, int depth, int64_t stream_length) {
+    *out += "<<";
+    for (const auto& entry : dict) {
+        if (stream_length >= 0 && entry.first == "Length") {
+            continue;
+        }
+        write_name(entry.first);
+        *out += ' ';
+        write(entry.second, depth + 1);
+    }
+    if (stream_length >= 0) {
+        *out += "/Length ";
+        *out += std::to_string(stream_length);
+    }
+    *out += ">>";
+}
+
+void Serializer::write(const PdfObject& object, int depth) {
+    if (depth > MAX_WRITE_DEPTH) {
+        *out += "null";
+        return;
+    }
+    switch (object.type()) {
+        case PdfType::Null:
+            *out += "null";
+            break;
+        case PdfType::Boolean:
+            *out += object.as_bool() ? "true" : "false";
+            break;
+        case PdfType::Integer:
+            *out += std::to_string(object.as_int());
+            break;
+        case PdfType::Real: {
+            // PDF has no exponent syntax; trim the fixed-point form instead
+            double value = object.as_number();
+            char number[64];
+            snprintf(number, sizeof(number), "%.6f", std::isfinite(value) ? value : 0.0);
+            std::string text = number;
+            text.erase(text.find_last_not_of('0') + 1);
+            if (text.back() == '.') {
+                text.pop_back();
+            }
+            *out += text == "-0" ? "0" : text;
+            break;
+        }
+        case PdfType::String:
+            if (security) {
+                write_string(security->encrypt(ref, object.as_string(), false), true);
+            } else {
+                write_string(object.as_string(), object.hex_string());
+            }
+            break;
+        case PdfType::Name:
+            write_name(object.as_name());
+            break;
+        case PdfType::Array: {
+            *out += '[';
+            bool first = true;
+            for (const auto& item : object.as_array()) {
+                if (!first) {
+                    *out += ' ';
+                }
+                first = false;
+                write(item, depth + 1);
+            }
+            *out += ']';
+            break;
+        }
+        case PdfType::Dictionary:
+            write_dict(object.as_dict(), depth, -1);
+            break;
+        case PdfType::Stream:
+            write_dict(object.as_dict(), depth, (int64_t)object.as_stream().data.size());
+            *out += "\nstream\n";
+            *out += object.as_stream().data;
+            *out += "\nendstream";
+            break;
+        case PdfType::Reference: {
+            ObjectRef target = object.as_ref();
+            if (renumbering && !renumbering->empty()) {
+                uint32_t num = target.num < renumbering->size() ? (*renumbering)[target.num] : 0;
+                if (num == 0) {
+                    *out += "null";
+                    break;
+                }
+                target = ObjectRef{num, 0};
+            }
+            if (numbers) {
+                numbers->push_back(target.num);
+                offsets->push_back((uint32_t)out->size());
+            }
+            *out += std::to_string(target.num) + " " + std::to_string(target.gen) + " R";
+            break;
+        }
+    }
+}
+
+// Cross-reference entry by type: 0 free (next free object, generation),
+// 1 in use (offset, generation), 2 compressed (object stream, index)
+struct XrefRecord {
+    uint8_t type = 0;
+    uint64_t field = 0;
+    uint16_t last = 0;
+};
+
+// Where write_classic() puts the file: positional writes queued on the I/O
+// backend, or nowhere when only its size is wanted (measure_document())
+struct OutputSink {
+    IoBackend* io = nullptr;  // null counts the bytes
+    int fd = -1;
+    uint64_t position = 0;
+
+    void write(const std::string& bytes) {
+        if (io) {
+            io->write(fd, bytes.data(), bytes.size(), position);
+        }
+        position += bytes.size();
+    }
+    bool wait() { return !io || io->wait(); }
+};
+
+struct ObjectStreamGroup {
+    struct Member {
+        uint32_t num;
+        PdfObject object;
+    };
+    uint32_t num = 0;
+    std::vector<Member> members;
+    std::string bytes;  // the complete object stream, filled in by a worker
+};
+
+} // namespace
+
+void append_xref_entry(uint64_t offset, uint16_t generation, char type, std::string* out) {
+    char entry[32];
+    snprintf(entry, sizeof(entry), "%010" PRIu64 " %05u %c\r\n", offset, (unsigned)generation, type);
+    *out += entry;
+}
+
+void write_object(const PdfObject& object, std::string* out) {
+    Serializer serializer;
+    serializer.out = out;
+    serializer.write(object, 0);
+}
+
+// Decrypts (through the document) and re-encrypts one object, then frames it
+static void serialize_object(const PdfDocument& document, const SecurityHandler* security,
+                             const Renumbering& renumbering, bool record_numbers, PendingObject* pending) {
+    std::string& out = pending->head;
+    out = std::to_string(pending->ref.num) + " " + std::to_string(pending->ref.gen) + " obj\n";
+    Serializer serializer;
+    serializer.security = security;
+    serializer.renumbering = &renumbering;
+    if (record_numbers) {
+        pending->numbers.assign(1, pending->ref.num);
+        pending->number_offsets.assign(1, 0);
+        serializer.numbers = &pending->numbers;
+        serializer.offsets = &pending->number_offsets;
+    }
+    serializer.ref = pending->ref;
+    serializer.out = &out;
+    if (!pending->object.is_stream()) {
+        serializer.write(pending->object, 0);
+        out += "\nendobj\n";
+        return;
+    }
+
+    // Stream bytes are the bulk of a file: avoid copying them more than the crypto requires
+    const PdfStream& stream = pending->object.as_stream();
+    const std::string* data = &stream.data;
+    std::string decrypted;
+    if (stream.encrypted) {
+        document.stream_data(pending->object, &decrypted);
+        data = &decrypted;
+    }
+    bool clear = stream.dict.get("Type").is_name("Metadata") && security && !security->encrypt_metadata();
+    if (security && !clear) {
+        pending->body = security->encrypt(pending->ref, *data, true);
+    } else if (data == &decrypted) {
+        pending->body = std::move(decrypted);
+    } else {
+        pending->body_is_source = true;
+    }
+    serializer.write_dict(stream.dict, 0, (int64_t)pending->stream_bytes().size());
+    out += "\nstream\n";
+    pending->tail = "\nendstream\nendobj\n";
+}
+
+void run_parallel(size_t count, unsigned threads, const std::function<void(size_t)>& work) {
+    executor().parallel(count, threads, work);
+}
+
+void serialize_objects(const PdfDocument& document, const SecurityHandler* security, const Renumbering& renumbering,
+                       unsigned threads, std::vector<PendingObject>* batch, bool record_numbers) {
+    run_parallel(batch->size(), threads,
+                 [&](size_t i) { serialize_object(document, security, renumbering, record_numbers, &(*batch)[i]); });
+}
+
+std::string output_version(const PdfDocument& document, const SecurityHandler* security) {
+    // AES-256 is an extension level of PDF 1.7 and part of PDF 2.0
+    std::string version = document.version();
+    if (security && security->revision() >= 5 && version < "1.7") {
+        version = "1.7";
+    }
+    return version;
+}
+
+PdfObject output_id(const PdfDict& trailer, const SecurityHandler* security) {
+    PdfObject id = trailer.get("ID");
+    if (security && (!id.is_array() || id.as_array().size() < 2)) {
+        std::string fresh = random_bytes(16);
+        id = PdfObject::array({PdfObject::string(fresh, true), PdfObject::string(fresh, true)});
+    }
+    return id;
+}
+
+PdfObject load_for_write(PdfDocument& document, ObjectRef ref, const SecurityHandler* security,
+                         const PrunePlan* prune, const ObjectReplacements* replacements) {
+    const PdfObject& encrypt = document.trailer().get("Encrypt");
+    if (encrypt.is_ref() && encrypt.as_ref().num == ref.num) {
+        return PdfObject();
+    }
+    const PdfObject* replacement = nullptr;
+    if (replacements) {
+        auto found = replacements->find(ref.num);
+        replacement = found != replacements->end() ? &found->second : nullptr;
+    }
+    PdfObject object = replacement ? *replacement : document.get(ref);
+    document.evict(ref.num);
+    const PdfObject& type = object.as_dict().get("Type");
+    if (object.is_stream() && (type.is_name("ObjStm") || type.is_name("XRef"))) {
+        return PdfObject();
+    }
+    if (prune) {
+        object = prune->apply(ref.num, std::move(object));
+    }
+    bool aes256 = security && security->revision() >= 5;
+    if (aes256 && ref == document.trailer().get("Root").as_ref() && object.is_dict() &&
+        !object.as_dict().has("Extensions")) {
+        PdfDict level;
+        level.set("BaseVersion", PdfObject::name("1.7"));
+        level.set("ExtensionLevel", PdfObject::integer(8));
+        PdfDict extensions;
+        extensions.set("ADBE", PdfObject::dict(std::move(level)));
+        PdfDict catalog = object.as_dict();
+        catalog.set("Extensions", PdfObject::dict(std::move(extensions)));
+        object = PdfObject::dict(std::move(catalog));
+    }
+    return object;
+}
+
+// Serialises members into a compressed object stream numbered num. Member
+// strings stay in the clear: the stream is encrypted as a whole.
+static void pack_object_stream(const SecurityHandler* security, ObjectStreamGroup* group) {
+    std::string header;
+    std::string body;
+    Serializer serializer;
+    serializer.out = &body;
+    for (const auto& member : group->members) {
+        header += std::to_string(member.num) + " " + std::to_string(body.size()) + " ";
+        serializer.write(member.object, 0);
+        body += '\n';
+    }
+    header.back() = '\n';
+    std::string data;
+    flate_encode((header + body).data(), header.size() + body.size(), &data);
+    if (security) {
+        data = security->encrypt(ObjectRef{group->num, 0}, data, true);
+    }
+    PdfDict dict;
+    dict.set("Type", PdfObject::name("ObjStm"));
+    dict.set("N", PdfObject::integer((int64_t)group->members.size()));
+    dict.set("First", PdfObject::integer((int64_t)header.size()));
+    dict.set("Filter", PdfObject::name("FlateDecode"));
+    std::string& out = group->bytes;
+    out = std::to_string(group->num) + " 0 obj\n";
+    serializer.out = &out;
+    serializer.write_dict(dict, 0, (int64_t)data.size());
+    out += "\nstream\n";
+    out += data;
+    out += "\nendstream\nendobj\n";
+}
+
+static int bytes_for(uint64_t value) {
+    int bytes = 1;
+    while (value >>= 8) {
+        bytes++;
+    }
+    return bytes;
+}
+
+// The layouts with a cross-reference table or stream at the end; bytes passed
+// to the sink stay alive until its next wait()
+static bool write_classic(PdfDocument& document, const WriteOptions& options, OutputSink* sink) {
+    unsigned threads = options.threads ? options.threads : std::max(1u, std::thread::hardware_concurrency());
+    const SecurityHandler* security = options.security;
+    const PdfDict& trailer = document.trailer();
+    bool compact = options.object_streams;
+    PrunePlan prune;
+    const PrunePlan* pruning = nullptr;
+    if (options.prune) {
+        plan_pruning(document, &prune);
+        pruning = &prune;
+    }
+    ObjectReplacements subset;
+    const ObjectReplacements* replacements = options.replacements;
+    if (options.subset_fonts) {
+        if (replacements) {
+            subset = *replacements;
+        }
+        plan_font_subsetting(document, threads, &subset);
+        replacements = &subset;
+    }
+
+    // Object and cross-reference streams are PDF 1.5
+    std::string version = output_version(document, security);
+    if (compact && version < "1.5") {
+        version = "1.5";
+    }
+    std::string header = "%PDF-" + version + "\n%\xE2\xE3\xCF\xD3\n";
+    sink->write(header);
+    bool ok = true;
+    uint64_t& position = sink->position;
+
+    // Object streams, the /Encrypt dictionary and the cross-reference stream get new numbers past the input's
+    uint32_t size = std::max<uint32_t>(document.object_count(), 1);
+    std::vector<XrefRecord> xref(size);
+
+    std::vector<PendingObject> batch;
+    std::vector<ObjectStreamGroup::Member> packable;
+    size_t batch_bytes = 0;
+    size_t batch_limit = memory_budget().share(BATCH_BYTES, BATCH_SHARE);
+    auto emit = [&](const std::string& bytes) { sink->write(bytes); };
+    auto flush = [&]() {
+        std::vector<ObjectStreamGroup> groups((packable.size() + OBJECT_STREAM_SIZE - 1) / OBJECT_STREAM_SIZE);
+        for (size_t i = 0; i < packable.size(); i++) {
+            groups[i / OBJECT_STREAM_SIZE].members.push_back(std::move(packable[i]));
+        }
+        for (auto& group : groups) {
+            group.num = size++;
+        }
+        xref.resize(size);
+        packable.clear();
+        // Plain objects and object streams are serialised (and compressed) by the same workers
+        run_parallel(batch.size() + groups.size(), threads, [&](size_t i) {
+            if (i < batch.size()) {
+                serialize_object(document, security, Renumbering(), false, &batch[i]);
+            } else {
+                pack_object_stream(security, &groups[i - batch.size()]);
+            }
+        });
+        for (const auto& pending : batch) {
+            xref[pending.ref.num] = XrefRecord{1, position, pending.ref.gen};
+            emit(pending.head);
+            emit(pending.stream_bytes());
+            emit(pending.tail);
+        }
+        for (const auto& group : groups) {
+            xref[group.num] = XrefRecord{1, position, 0};
+            for (size_t i = 0; i < group.members.size(); i++) {
+                xref[group.members[i].num] = XrefRecord{2, group.num, (uint16_t)i};
+            }
+            emit(group.bytes);
+        }
+        ok = sink->wait() && ok;
+        batch.clear();
+        batch_bytes = 0;
+    };
+
+    for (uint32_t num = 1; num < document.object_count() && ok; num++) {
+        ObjectRef ref;
+        if (!document.object_ref(num, &ref)) {
+            continue;
+        }
+        PdfObject object = load_for_write(document, ref, security, pruning, replacements);
+        if (object.is_null()) {
+            continue;
+        }
+        if (compact && !object.is_stream() && ref.gen == 0) {
+            packable.push_back(ObjectStreamGroup::Member{num, std::move(object)});
+            batch_bytes += 64;
+        } else {
+            batch_bytes += object.is_stream() ? object.as_stream().data.size() : 64;
+            PendingObject pending;
+            pending.ref = ref;
+            pending.object = std::move(object);
+            batch.push_back(std::move(pending));
+        }
+        if (batch.size() + packable.size() >= BATCH_OBJECTS || batch_bytes >= batch_limit) {
+            flush();
+        }
+    }
+    if (ok) {
+        flush();
+    }
+
+    PdfDict new_trailer;
+    new_trailer.set("Size", PdfObject::integer(size));
+    new_trailer.set("Root", trailer.get("Root"));
+    const PdfObject& info = trailer.get("Info");
+    if (info.is_ref() && info.as_ref().num < xref.size() && xref[info.as_ref().num].type != 0) {
+        new_trailer.set("Info", info);
+    }
+    PdfObject id = output_id(trailer, security);
+    if (id.is_array()) {
+        new_trailer.set("ID", id);
+    }
+    if (security && ok) {
+        uint32_t encrypt_num = size++;
+        std::string bytes = std::to_string(encrypt_num) + " 0 obj\n";
+        write_object(PdfObject::dict(security->encrypt_dict()), &bytes);
+        bytes += "\nendobj\n";
+        xref.resize(size);
+        xref[encrypt_num] = XrefRecord{1, position, 0};
+        emit(bytes);
+        ok = sink->wait() && ok;
+        new_trailer.set("Encrypt", PdfObject::reference(ObjectRef{encrypt_num, 0}));
+    }
+
+    uint64_t xref_offset = position;
+    uint32_t xref_num = 0;
+    if (compact) {
+        xref_num = size++;
+        xref.resize(size);
+        xref[xref_num] = XrefRecord{1, xref_offset, 0};
+        new_trailer.set("Size", PdfObject::integer(size));
+    }
+    // Free entries form a linked list headed by object 0
+    uint32_t following = 0;
+    for (uint32_t num = size - 1; num < size; num--) {
+        if (xref[num].type == 0) {
+            xref[num] = XrefRecord{0, following, (uint16_t)(num == 0 ? 65535 : 1)};
+            following = num;
+        }
+    }
+
+    std::string tail;
+    if (compact) {
+        // Binary entries: type, offset or object stream, generation or index
+        uint64_t widest = 0;
+        uint16_t widest_last = 0;
+        for (const auto& record : xref) {
+            widest = std::max(widest, record.field);
+            widest_last = std::max(widest_last, record.last);
+        }
+        int width = bytes_for(widest);
+        int last_width = bytes_for(widest_last);
+        std::string entries;
+        entries.reserve(xref.size() * (1 + width + last_width));
+        for (const auto& record : xref) {
+            entries += (char)record.type;
+            for (int i = width - 1; i >= 0; i--) {
+                entries += (char)(record.field >> (8 * i));
+            }
+            for (int i = last_width - 1; i >= 0; i--) {
+                entries += (char)(record.last >> (8 * i));
+            }
+        }
+        std::string data;
+        flate_encode(entries.data(), entries.size(), &data);
+        PdfDict dict;
+        dict.set("Type", PdfObject::name("XRef"));
+        for (const auto& entry : new_trailer) {
+            dict.set(entry.first, entry.second);
+        }
+        dict.set("W", PdfObject::array({PdfObject::integer(1), PdfObject::integer(width),
+                                        PdfObject::integer(last_width)}));
+        dict.set("Filter", PdfObject::name("FlateDecode"));
+        // The cross-reference stream itself is never encrypted
+        tail = std::to_string(xref_num) + " 0 obj\n";
+        write_object(PdfObject::stream(std::move(dict), std::move(data)), &tail);
+        tail += "\nendobj\n";
+    } else {
+        tail = "xref\n0 " + std::to_string(size) + "\n";
+        for (uint32_t num = 0; num < size; num++) {
+            append_xref_entry(xref[num].field, xref[num].last, xref[num].type ? 'n' : 'f', &tail);
+        }
+        tail += "trailer\n";
+        write_object(PdfObject::dict(std::move(new_trailer)), &tail);
+        tail += "\n";
+    }
+    tail += "startxref\n" + std::to_string(xref_offset) + "\n%%EOF\n";
+    emit(tail);
+    return sink->wait() && ok;
+}
+
+bool write_document(PdfDocument& document, const std::string& path, const WriteOptions& options,
+                    std::string* error) {
+    if (document.locked()) {
+        *error = "document is encrypted and the password was not accepted";
+        return false;
+    }
+    if (options.linearize) {
+        return write_linearized(document, path, options, error);
+    }
+    std::string temp = path + ".tmp";
+    int fd = ::open(temp.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (fd < 0) {
+        *error = "cannot create " + temp;
+        return false;
+    }
+    // Writes are queued and completed once per batch, so they overlap
+    OutputSink sink;
+    sink.io = &thread_io_backend();
+    sink.fd = fd;
+    bool ok = write_classic(document, options, &sink);
+    ok = close(fd) == 0 && ok;
+    if (!ok || rename(temp.c_str(), path.c_str()) != 0) {
+        remove(temp.c_str());
+        *error = "cannot write " + path;
+        return false;
+    }
+    return true;
+}
+
+bool measure_document(PdfDocument& document, const WriteOptions& options, uint64_t* size, std::string* error) {
+    if (document.locked()) {
+        *error = "document is encrypted and the password was not accepted";
+        return false;
+    }
+    OutputSink sink;
+    write_classic(document, options, &sink);
+    *size = sink.position;
+    return true;
+}
+
+bool rewrite_file(const std::string& input, const std::string& output, const WriteOptions& options,
+                  PdfErrorCode* error_code, std::string* error) {
+    if (access(input.c_str(), R_OK) != 0) {
+        *error_code = errno == ENOENT ? PdfErrorCode_FileNotFound : PdfErrorCode_PermissionDenied;
+        *error = "cannot open " + input;
+        return false;
+    }
+    PdfDocument document;
+    if (!document.open(input, error)) {
+        *error_code = PdfErrorCode_InvalidPdf;
+        return false;
+    }
+    if (document.locked()) {
+        *error_code = PdfErrorCode_EncryptedPdf;
+        *error = "document is password protected";
+        return false;
+    }
+    WriteOptions rewrite = options;
+    rewrite.security = document.security();
+    if (!write_document(document, output, rewrite, error)) {
+        *error_code = PdfErrorCode_IoError;
+        return false;
+    }
+    *error_code = PdfErrorCode_Success;
+    return true;
+}
+
+} // namespace spdf
@@ -0,0 +1,124 @@
+#ifndef SPDF_WRITER_H
+#define SPDF_WRITER_H
+
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include "spdf_document.h"
+#include "spdf_object.h"
+#include "spdf_security.h"
+#include "spdfcore.h"
+
+namespace spdf {
+
+struct PrunePlan;
+
+// Appends object in file syntax (without the "obj" framing). Streams are
+// written with their dictionary, a direct /Length and the bytes as they are.
+void write_object(const PdfObject& object, std::string* out);
+
+// Objects written in place of the input's, by object number
+using ObjectReplacements = std::unordered_map<uint32_t, PdfObject>;
+
+struct WriteOptions {
+    // Encrypt the output with this handler; its /Encrypt dictionary is added
+    // as a new object. Null writes the document in the clear.
+    const SecurityHandler* security = nullptr;
+    // Worker threads for decrypting, encrypting and serialising; 0 uses every core
+    unsigned threads = 0;
+    // Linearized ("fast web view") layout, see spdf_linearize.h
+    bool linearize = false;
+    // PDF 1.5 compression: non-stream objects are packed into compressed
+    // object streams and the cross-reference table becomes a binary
+    // cross-reference stream. Ignored by the linearized layout.
+    bool object_streams = false;
+    // Drop the objects and resource entries the pages do not use, see spdf_prune.h
+    bool prune = false;
+    // Cut embedded fonts down to the glyphs the pages show and write identical
+    // font programs once, see spdf_font_subset.h
+    bool subset_fonts = false;
+    // Written instead of the input's objects with these numbers, e.g. images
+    // recompressed by spdf_compress.h; replacement streams are in the clear
+    const ObjectReplacements* replacements = nullptr;
+};
+
+// Rewrites every object of an opened document to path (through a temporary
+// file and rename) with a classic cross-reference table, or a cross-reference
+// stream when object_streams is set. Encrypted input is decrypted with the
+// document's handler; the input's object and cross-reference streams are
+// expanded and, with object_streams, repacked. Objects are parsed serially in
+// batches and the per-object crypto, serialisation and object-stream
+// compression of each batch runs in parallel, so large files are bound by
+// memory bandwidth rather than one core.
+bool write_document(PdfDocument& document, const std::string& path, const WriteOptions& options,
+                    std::string* error);
+
+// Size in bytes of what write_document() would write with options, found by
+// serialising (and, with object_streams, compressing) every object without
+// writing anything. The linearized layout is not measured: linearize is
+// ignored.
+bool measure_document(PdfDocument& document, const WriteOptions& options, uint64_t* size, std::string* error);
+
+// Rewrites input to output, which may be the same file, with options (except
+// security). Input that is encrypted but opens with the empty password keeps
+// its encryption.
+bool rewrite_file(const std::string& input, const std::string& output, const WriteOptions& options,
+                  PdfErrorCode* error_code, std::string* error);
+
+// Building blocks shared by the file layouts
+
+// An indirect object on its way to the file. The serialiser fills in head
+// ("n g obj" up to and including "stream"), body (the stream bytes, unless
+// the source bytes can be written as they are) and tail.
+struct PendingObject {
+    ObjectRef ref;  // number in the output
+    PdfObject object;
+    std::string head;
+    std::string body;
+    bool body_is_source = false;
+    std::string tail;
+    // Filled when asked for: the header's object number and that of every
+    // reference written, so the size under another numbering can be predicted,
+    // and where each of them starts in head, so it can be rewritten in place
+    std::vector<uint32_t> numbers;
+    std::vector<uint32_t> number_offsets;
+
+    const std::string& stream_bytes() const { return body_is_source ? object.as_stream().data : body; }
+    uint64_t size() const { return head.size() + stream_bytes().size() + tail.size(); }
+};
+
+// Output object number for each input object number. References to objects
+// mapped to 0 are written as null; an empty table keeps the input numbers.
+using Renumbering = std::vector<uint32_t>;
+
+// Serialises batch on up to threads threads, decrypting streams through the
+// document and encrypting strings and streams with security when it is set.
+// record_numbers fills PendingObject::numbers and number_offsets.
+void serialize_objects(const PdfDocument& document, const SecurityHandler* security, const Renumbering& renumbering,
+                       unsigned threads, std::vector<PendingObject>* batch, bool record_numbers = false);
+
+// Runs work(0) .. work(count - 1) on up to threads threads of executor(); bulk
+// work may pause between items for interactive work (see spdf_executor.h)
+void run_parallel(size_t count, unsigned threads, const std::function<void(size_t)>& work);
+
+// Loads an object for rewriting, or takes its replacement, and drops it from
+// the document's cache. Null for objects a rewrite leaves out: object and
+// cross-reference streams, the input's /Encrypt dictionary and whatever prune
+// drops. The catalog gains the AES-256 extension level when security needs it.
+PdfObject load_for_write(PdfDocument& document, ObjectRef ref, const SecurityHandler* security,
+                         const PrunePlan* prune = nullptr, const ObjectReplacements* replacements = nullptr);
+
+// Header version of the output: AES-256 needs at least 1.7
+std::string output_version(const PdfDocument& document, const SecurityHandler* security);
+
+// The input's /ID, or a fresh one when encrypting a file that has none
+PdfObject output_id(const PdfDict& trailer, const SecurityHandler* security);
+
+// One 20-byte cross-reference table entry; type is 'n' or 'f'
+void append_xref_entry(uint64_t offset, uint16_t generation, char type, std::string* out);
+
+} // namespace spdf
+
+#endif // SPDF_WRITER_H
@@ -0,0 +1,264 @@
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include "spdf_batch.h"
+#include "spdf_io.h"
+#include "spdf_json.h"
+#include "spdf_memory.h"
+#include "spdfcore.h"
+
+// Headless batch front end for the spdfcore C ABI
+//
+// Runs merge/split/extract/edit/fill/compress/info/text/index/duplicates jobs given on
+// the command line or in a manifest (one command per line) across a pool of worker threads,
+// printing one JSON object per finished job and a summary object at the end.
+// "search" queries an index built by earlier "index" runs and prints one JSON
+// object per hit.
+
+static void usage(const char* argv0) {
+    fprintf(stderr,
+            "Usage: %s [options] <command> [command options] <files or globs>...\n"
+            "       %s [options] --manifest FILE   (one command per line, '-' for stdin)\n"
+            "       %s --index FILE search [--limit N] <words>...\n"
+            "\n"
+            "Options:\n"
+            "  -j, --jobs N       worker threads (default: number of CPUs)\n"
+            "  --out-dir DIR      default directory for per-file outputs (default: .)\n"
+            "  --fail-fast        stop scheduling new jobs after the first failure\n"
+            "  --index FILE       search index used by index and search (default: spdf_search.idx)\n"
+            "  --io MODE          file I/O: auto (io_uring when available), io_uring or blocking\n"
+            "  --memory-budget MB native memory held at once; jobs wait for each other and spill\n"
+            "                     what they keep to disk near it instead of running out\n"
+            "  --spill-dir DIR    directory for spill files (default: $TMPDIR or /tmp)\n"
+            "\n"
+            "Commands:\n"
+            "  info <files>                        page count, size and validity\n"
+            "  merge -o OUT <files>                merge all inputs into OUT\n"
+            "  merge --estimate <files>            size of the merged file, without writing it\n"
+            "  merge --skip-duplicates -o OUT <files>\n"
+            "                                      merge natively, keeping the first of pages that repeat\n"
+            "  duplicates [--similarity F] <files> groups of pages that repeat within or across the\n"
+            "                                      inputs; F below 1 (e.g. 0.9) also groups near matches\n"
+            "  split --pages 1,3-5 <files>         keep the listed pages of each input\n"
+            "  split-at --page N <files>           write <stem>_part1.pdf / _part2.pdf\n"
+            "  extract --page N <files>            write <stem>_pageN.pdf\n"
+            "  edit --script SCRIPT <files>        write <stem>_edited.pdf with pages reordered, rotated\n"
+            "                                      or deleted, e.g. \"order 3,1; rotate 90 2; delete 4-5\"\n"
+            "  fill --data CSV [-o PATTERN] <templates>\n"
+            "                                      fill the form of each template once per CSV row (the\n"
+            "                                      header names the fields); writes <stem>_{row}.pdf, or\n"
+            "                                      PATTERN with {row} and {Field name} replaced\n"
+            "  compress [--dpi N] [--no-bilevel] <files>\n"
+            "                                      write <stem>_compressed.pdf with images shown above\n"
+            "                                      N dpi (default 150) downsampled and re-encoded, and\n"
+            "                                      black-and-white scans stored as 1-bit G4 images\n"
+            "  compress --estimate [--dpi N,N...] <files>\n"
+            "                                      predicted compressed size at each resolution, with\n"
+            "                                      the range it should fall in; nothing is written\n"
+            "  assemble <plans>                    write every output a plan lists, one per line as\n"
+            "                                      OUT SOURCE[:PAGES]..., opening each source once\n"
+            "  text <files>                        write <stem>.txt, pages separated by form feeds\n"
+            "  index <files>                       add the text of each input to the search index\n"
+            "  search [--limit N] <words>          pages containing every word; 'word*' matches a prefix\n"
+            "\n"
+            "merge, split, split-at, extract, edit, compress and assemble take\n"
+            "--linearize to write their outputs for fast web view, or --object-streams\n"
+            "to write them with compressed object and cross-reference streams, or\n"
+            "--prune to drop the objects and resources their pages do not use, or\n"
+            "--subset-fonts to cut embedded fonts down to the glyphs shown and keep\n"
+            "one copy of fonts the inputs share (both always on for split, split-at\n"
+            "and extract).\n"
+            "merge --parallel merges natively: inputs are measured first, then\n"
+            "written side by side at their final offsets. Inputs that recur across\n"
+            "a manifest are kept in memory and not parsed again.\n",
+            argv0, argv0, argv0);
+}
+
+static bool read_manifest(const std::string& path, const std::string& out_dir, std::vector<spdf::BatchJob>* jobs) {
+    std::ifstream file;
+    std::istream* in = &std::cin;
+    if (path != "-") {
+        file.open(path);
+        if (!file) {
+            fprintf(stderr, "cannot open manifest %s\n", path.c_str());
+            return false;
+        }
+        in = &file;
+    }
+    std::string line;
+    int line_number = 0;
+    while (std::getline(*in, line)) {
+        line_number++;
+        std::vector<std::string> args = spdf::tokenize_command_line(line);
+        if (args.empty()) {
+            continue;
+        }
+        std::string error;
+        if (!spdf::build_jobs(args, out_dir, jobs, &error)) {
+            fprintf(stderr, "%s:%d: %s\n", path.c_str(), line_number, error.c_str());
+            return false;
+        }
+    }
+    return true;
+}
+
+int main(int argc, char** argv) {
+    unsigned workers = std::thread::hardware_concurrency();
+    std::string out_dir = ".";
+    std::string manifest;
+    std::string index_file = "spdf_search.idx";
+    uint64_t memory_budget = 0;
+    std::string spill_dir;
+    bool fail_fast = false;
+
+    int i = 1;
+    for (; i < argc; i++) {
+        std::string arg = argv[i];
+        if ((arg == "-j" || arg == "--jobs") && i + 1 < argc) {
+            workers = (unsigned)std::max(1, atoi(argv[++i]));
+        } else if (arg == "--out-dir" && i + 1 < argc) {
+            out_dir = argv[++i];
+        } else if (arg == "--manifest" && i + 1 < argc) {
+            manifest = argv[++i];
+        } else if (arg == "--index" && i + 1 < argc) {
+            index_file = argv[++i];
+        } else if (arg == "--io" && i + 1 < argc) {
+            spdf::IoBackendKind kind;
+            if (!spdf::parse_io_backend_kind(argv[++i], &kind)) {
+                fprintf(stderr, "unknown I/O backend '%s'\n", argv[i]);
+                return 2;
+            }
+            spdf::set_io_backend_kind(kind);
+        } else if (arg == "--memory-budget" && i + 1 < argc) {
+            memory_budget = (uint64_t)std::max(0, atoi(argv[++i])) << 20;
+        } else if (arg == "--spill-dir" && i + 1 < argc) {
+            spill_dir = argv[++i];
+        } else if (arg == "--fail-fast") {
+            fail_fast = true;
+        } else if (arg == "-h" || arg == "--help") {
+            usage(argv[0]);
+            return 0;
+        } else {
+            break;
+        }
+    }
+
+    spdf::memory_budget().configure(memory_budget, spill_dir);
+
+    spdf::SearchIndex search_index;
+    if (i < argc && std::string(argv[i]) == "search") {
+        std::string query;
+        size_t limit = 0;
+        std::string error;
+        if (!spdf::parse_search_command(std::vector<std::string>(argv + i, argv + argc), &query, &limit, &error)) {
+            fprintf(stderr, "%s\n", error.c_str());
+            return 2;
+        }
+        if (!search_index.load(index_file)) {
+            fprintf(stderr, "cannot read search index %s\n", index_file.c_str());
+            return 1;
+        }
+        for (const auto& hit : search_index.search(query, limit)) {
+            printf("%s\n", spdf::search_hit_json(hit).c_str());
+        }
+        return 0;
+    }
+
+    std::vector<spdf::BatchJob> jobs;
+    if (!manifest.empty()) {
+        if (!read_manifest(manifest, out_dir, &jobs)) {
+            return 2;
+        }
+    }
+    if (i < argc) {
+        std::string error;
+        if (!spdf::build_jobs(std::vector<std::string>(argv + i, argv + argc), out_dir, &jobs, &error)) {
+            fprintf(stderr, "%s\n", error.c_str());
+            usage(argv[0]);
+            return 2;
+        }
+    }
+    if (jobs.empty()) {
+        usage(argv[0]);
+        return 2;
+    }
+
+    if (!spdfcore_init()) {
+        fprintf(stderr, "spdfcore_init failed\n");
+        return 1;
+    }
+
+    bool indexing = std::any_of(jobs.begin(), jobs.end(),
+                                [](const spdf::BatchJob& job) { return job.kind == spdf::BatchJob::Kind::Index; });
+    if (indexing) {
+        // A missing or unreadable index is rebuilt from scratch
+        search_index.load(index_file);
+    }
+
+    workers = std::max(1u, std::min(workers, (unsigned)jobs.size()));
+    std::atomic<size_t> next{0};
+    std::atomic<size_t> succeeded{0};
+    std::atomic<size_t> failed{0};
+    std::atomic<bool> stop{false};
+    std::mutex output_mutex;
+
+    auto start = std::chrono::steady_clock::now();
+    std::vector<std::thread> threads;
+    for (unsigned t = 0; t < workers; t++) {
+        threads.emplace_back([&]() {
+            for (size_t index = next++; index < jobs.size() && !stop; index = next++) {
+                const spdf::BatchJob& job = jobs[index];
+                spdf::BatchResult result = job.kind == spdf::BatchJob::Kind::Index
+                                               ? spdf::run_index_job(job, &search_index)
+                                               : spdf::run_batch_job(job);
+                (result.ok ? succeeded : failed)++;
+                if (!result.ok && fail_fast) {
+                    stop = true;
+                }
+                std::string line = spdf::batch_result_json(index, job, result);
+                std::lock_guard<std::mutex> lock(output_mutex);
+                fwrite(line.data(), 1, line.size(), stdout);
+                fputc('\n', stdout);
+            }
+        });
+    }
+    for (auto& thread : threads) {
+        thread.join();
+    }
+    double elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    if (indexing && !search_index.save(index_file)) {
+        fprintf(stderr, "cannot write search index %s\n", index_file.c_str());
+    }
+
+    spdf::JsonWriter summary;
+    summary.begin_object()
+        .field("summary", true)
+        .field("jobs", (int64_t)jobs.size())
+        .field("succeeded", (int64_t)succeeded.load())
+        .field("failed", (int64_t)failed.load())
+        .field("skipped", (int64_t)(jobs.size() - succeeded - failed))
+        .field("workers", (int64_t)workers)
+        .field("elapsedSeconds", elapsed);
+    if (memory_budget) {
+        spdf::MemoryBudget::Stats memory = spdf::memory_budget().stats();
+        summary.field("memoryBudget", memory.limit)
+            .field("memoryPeak", memory.peak)
+            .field("memoryWaits", memory.waits)
+            .field("memoryOvercommits", memory.overcommits)
+            .field("spilledBytes", memory.spilled);
+    }
+    summary.end_object();
+    printf("%s\n", summary.str().c_str());
+
+    spdfcore_cleanup();
+    return failed == 0 && succeeded == jobs.size() ? 0 : 1;
+}
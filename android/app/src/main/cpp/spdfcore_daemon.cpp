@@ -0,0 +1,606 @@
+#include <arpa/inet.h>
+#include <poll.h>
+#include <signal.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <condition_variable>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <deque>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include "spdf_batch.h"
+#include "spdf_executor.h"
+#include "spdf_io.h"
+#include "spdf_json.h"
+#include "spdf_memory.h"
+#include "spdf_metadata_cache.h"
+#include "spdfcore.h"
+
+// Long-running job server for bulk PDF processing
+//
+// Keeps the spdfcore library, a worker pool, a file metadata cache and a
+// full-text search index alive across requests. Clients connect over a Unix
+// domain socket and exchange frames of a 4-byte big-endian length followed
+// by the payload:
+//
+//   request:  "[--priority high|normal|low] <command>"  (spdfcore_cli syntax)
+//             "search [--limit N] <words>"
+//             "status"
+//   response: {"ok":true,"results":[<one object per job>]}
+//             {"ok":true,"hits":[{"path":...,"page":N,"score":N}],"elapsedMs":...}
+//             {"ok":false,"error":"..."}
+//
+// A request is queued as a whole or rejected with "queue full" when the
+// bounded queue cannot take all of its jobs, so producers see backpressure
+// instead of unbounded latency.
+
+static const uint32_t MAX_FRAME_SIZE = 16u << 20;
+
+static std::atomic<bool> shutting_down{false};
+
+static void handle_signal(int) {
+    shutting_down = true;
+}
+
+// ---------------------------------------------------------------------------
+// Framing
+
+static bool read_full(int fd, void* buffer, size_t size) {
+    char* p = (char*)buffer;
+    while (size > 0) {
+        ssize_t n = read(fd, p, size);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n <= 0) {
+            return false;
+        }
+        p += n;
+        size -= (size_t)n;
+    }
+    return true;
+}
+
+static bool write_full(int fd, const void* buffer, size_t size) {
+    const char* p = (const char*)buffer;
+    while (size > 0) {
+        ssize_t n = send(fd, p, size, MSG_NOSIGNAL);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n <= 0) {
+            return false;
+        }
+        p += n;
+        size -= (size_t)n;
+    }
+    return true;
+}
+
+static bool read_frame(int fd, std::string* payload) {
+    uint32_t length = 0;
+    if (!read_full(fd, &length, sizeof(length))) {
+        return false;
+    }
+    length = ntohl(length);
+    if (length > MAX_FRAME_SIZE) {
+        return false;
+    }
+    payload->resize(length);
+    return length == 0 || read_full(fd, &(*payload)[0], length);
+}
+
+static bool write_frame(int fd, const std::string& payload) {
+    uint32_t length = htonl((uint32_t)payload.size());
+    return write_full(fd, &length, sizeof(length)) && write_full(fd, payload.data(), payload.size());
+}
+
+static std::string error_response(const std::string& message) {
+    spdf::JsonWriter json;
+    json.begin_object().field("ok", false).field("error", message).end_object();
+    return json.str();
+}
+
+// ---------------------------------------------------------------------------
+// Job queue
+
+enum class Priority { High = 0, Normal = 1, Low = 2 };
+static const int PRIORITY_LEVELS = 3;
+
+// Completion state shared by all jobs of one request
+struct RequestState {
+    std::mutex mutex;
+    std::condition_variable done;
+    std::vector<spdf::BatchJob> jobs;
+    std::vector<spdf::BatchResult> results;
+    size_t remaining = 0;
+};
+
+struct QueuedJob {
+    std::shared_ptr<RequestState> request;
+    size_t index;
+    Priority priority = Priority::Normal;
+};
+
+class JobQueue {
+public:
+    explicit JobQueue(size_t capacity) : capacity_(capacity) {}
+
+    // All-or-nothing admission of a request's jobs
+    bool try_push(const std::shared_ptr<RequestState>& request, Priority priority) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (closed_ || size_ + request->jobs.size() > capacity_) {
+            rejected_++;
+            return false;
+        }
+        for (size_t i = 0; i < request->jobs.size(); i++) {
+            levels_[(int)priority].push_back(QueuedJob{request, i, priority});
+        }
+        size_ += request->jobs.size();
+        ready_.notify_all();
+        return true;
+    }
+
+    // Highest priority first, FIFO within a level; false once closed and drained
+    bool pop(QueuedJob* job) {
+        std::unique_lock<std::mutex> lock(mutex_);
+        ready_.wait(lock, [this]() { return closed_ || size_ > 0; });
+        for (auto& level : levels_) {
+            if (!level.empty()) {
+                *job = std::move(level.front());
+                level.pop_front();
+                size_--;
+                return true;
+            }
+        }
+        return false;
+    }
+
+    // Refuses further requests and hands back the jobs no worker has taken
+    void close(std::vector<QueuedJob>* dropped) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        closed_ = true;
+        for (auto& level : levels_) {
+            for (auto& job : level) {
+                dropped->push_back(std::move(job));
+            }
+            level.clear();
+        }
+        size_ = 0;
+        ready_.notify_all();
+    }
+
+    void stats(size_t depth[PRIORITY_LEVELS], uint64_t* rejected) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        for (int i = 0; i < PRIORITY_LEVELS; i++) {
+            depth[i] = levels_[i].size();
+        }
+        *rejected = rejected_;
+    }
+
+    size_t capacity() const { return capacity_; }
+
+private:
+    size_t capacity_;
+    std::mutex mutex_;
+    std::condition_variable ready_;
+    std::deque<QueuedJob> levels_[PRIORITY_LEVELS];
+    size_t size_ = 0;
+    uint64_t rejected_ = 0;
+    bool closed_ = false;
+};
+
+// ---------------------------------------------------------------------------
+// Server
+
+// A client and the thread serving it. The fd stays open until the thread is
+// joined, so shutdown() never reaches an fd number reused by a later accept.
+struct Connection {
+    int fd = -1;
+    std::thread thread;
+    std::atomic<bool> finished{false};
+};
+
+struct Server {
+    JobQueue queue;
+    spdf::MetadataCache cache;
+    std::string cache_file;
+    spdf::SearchIndex index;
+    std::string index_file;
+    unsigned workers;
+    std::atomic<uint64_t> jobs_completed{0};
+    std::list<Connection> connections;  // only touched by the accept loop
+
+    Server(size_t queue_depth, size_t cache_entries, unsigned workers)
+        : queue(queue_depth), cache(cache_entries), workers(workers) {}
+};
+
+// Info jobs are answered from the metadata cache while the file is unchanged
+static spdf::BatchResult run_job(Server& server, const spdf::BatchJob& job) {
+    if (job.kind == spdf::BatchJob::Kind::Info) {
+        const std::string& path = job.inputs[0];
+        spdf::FileIdentity identity;
+        spdf::CachedMetadata metadata;
+        if (spdf::FileIdentity::of(path, &identity) && server.cache.lookup(path, identity, &metadata)) {
+            spdf::BatchResult result;
+            result.ok = metadata.is_valid;
+            result.page_count = metadata.page_count;
+            result.file_size = metadata.file_size;
+            result.is_valid = metadata.is_valid;
+            if (!result.ok) {
+                result.error_code = PdfErrorCode_InvalidPdf;
+                result.error_message = "not a valid PDF (cached)";
+            }
+            return result;
+        }
+        spdf::BatchResult result = spdf::run_batch_job(job);
+        // Only cache verdicts about the file itself, not transient I/O failures
+        bool definitive = result.ok || result.error_code == PdfErrorCode_InvalidPdf ||
+                          result.error_code == PdfErrorCode_ParseError;
+        if (definitive && spdf::FileIdentity::of(path, &identity)) {
+            metadata.page_count = result.page_count;
+            metadata.is_valid = result.ok;
+            metadata.file_size = identity.size;
+            server.cache.store(path, identity, metadata);
+        }
+        return result;
+    }
+
+    if (job.kind == spdf::BatchJob::Kind::Index) {
+        return spdf::run_index_job(job, &server.index);
+    }
+
+    spdf::BatchResult result = spdf::run_batch_job(job);
+    for (const auto& output : result.outputs) {
+        server.cache.invalidate(output);
+        server.index.remove_document(spdf::absolute_path(output));
+    }
+    return result;
+}
+
+static void complete_job(const QueuedJob& queued, spdf::BatchResult result) {
+    RequestState& request = *queued.request;
+    std::lock_guard<std::mutex> lock(request.mutex);
+    request.results[queued.index] = std::move(result);
+    if (--request.remaining == 0) {
+        request.done.notify_all();
+    }
+}
+
+static void worker_loop(Server& server) {
+    QueuedJob queued;
+    while (server.queue.pop(&queued)) {
+        RequestState& request = *queued.request;
+        const spdf::BatchJob& job = request.jobs[queued.index];
+        // High priority and info jobs are interactive work for the shared executor
+        bool interactive = queued.priority == Priority::High || job.kind == spdf::BatchJob::Kind::Info;
+        spdf::TaskClassScope task_class(interactive ? spdf::TaskClass::Interactive : spdf::TaskClass::Bulk);
+        spdf::BatchResult result = run_job(server, job);
+        server.jobs_completed++;
+        complete_job(queued, std::move(result));
+    }
+}
+
+static std::string status_response(Server& server) {
+    size_t depth[PRIORITY_LEVELS];
+    uint64_t rejected = 0;
+    server.queue.stats(depth, &rejected);
+    spdf::MetadataCache::Stats cache = server.cache.stats();
+    spdf::SearchIndex::Stats index = server.index.stats();
+    spdf::Executor::Stats executor = spdf::executor().stats();
+
+    spdf::JsonWriter json;
+    json.begin_object()
+        .field("ok", true)
+        .field("workers", (int64_t)server.workers)
+        .field("queueCapacity", (int64_t)server.queue.capacity())
+        .field("queuedHigh", (int64_t)depth[0])
+        .field("queuedNormal", (int64_t)depth[1])
+        .field("queuedLow", (int64_t)depth[2])
+        .field("rejectedRequests", rejected)
+        .field("jobsCompleted", server.jobs_completed.load())
+        .field("cacheEntries", (int64_t)cache.entries)
+        .field("cacheHits", cache.hits)
+        .field("cacheMisses", cache.misses)
+        .field("indexedDocuments", (int64_t)index.documents)
+        .field("indexedTerms", (int64_t)index.terms)
+        .field("interactiveTasks", executor.interactive_tasks)
+        .field("bulkTasks", executor.bulk_tasks)
+        .field("bulkYields", executor.yields)
+        .end_object();
+    return json.str();
+}
+
+// Searches run on the connection thread: they only read the in-memory index
+static std::string search_response(Server& server, const std::vector<std::string>& args) {
+    std::string query;
+    size_t limit = 0;
+    std::string error;
+    if (!spdf::parse_search_command(args, &query, &limit, &error)) {
+        return error_response(error);
+    }
+    auto start = std::chrono::steady_clock::now();
+    std::vector<spdf::SearchIndex::Hit> hits = server.index.search(query, limit);
+    double elapsed = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+
+    spdf::JsonWriter json;
+    json.begin_object().field("ok", true);
+    json.begin_array("hits");
+    for (const auto& hit : hits) {
+        json.raw_value(spdf::search_hit_json(hit));
+    }
+    json.end_array().field("elapsedMs", elapsed).end_object();
+    return json.str();
+}
+
+static std::string handle_request(Server& server, const std::string& payload) {
+    std::vector<std::string> args = spdf::tokenize_command_line(payload);
+    if (args.size() == 1 && args[0] == "status") {
+        return status_response(server);
+    }
+    if (!args.empty() && args[0] == "search") {
+        return search_response(server, args);
+    }
+
+    Priority priority = Priority::Normal;
+    if (args.size() >= 2 && args[0] == "--priority") {
+        if (args[1] == "high") {
+            priority = Priority::High;
+        } else if (args[1] == "low") {
+            priority = Priority::Low;
+        } else if (args[1] != "normal") {
+            return error_response("unknown priority '" + args[1] + "'");
+        }
+        args.erase(args.begin(), args.begin() + 2);
+    }
+
+    auto request = std::make_shared<RequestState>();
+    std::string error;
+    if (!spdf::build_jobs(args, ".", &request->jobs, &error)) {
+        return error_response(error);
+    }
+    if (request->jobs.size() > server.queue.capacity()) {
+        return error_response("request has " + std::to_string(request->jobs.size()) +
+                              " jobs, more than the queue depth of " + std::to_string(server.queue.capacity()));
+    }
+    request->results.resize(request->jobs.size());
+    request->remaining = request->jobs.size();
+    if (!server.queue.try_push(request, priority)) {
+        return error_response(shutting_down ? "shutting down" : "queue full");
+    }
+
+    {
+        std::unique_lock<std::mutex> lock(request->mutex);
+        request->done.wait(lock, [&]() { return request->remaining == 0; });
+    }
+
+    bool all_ok = std::all_of(request->results.begin(), request->results.end(),
+                              [](const spdf::BatchResult& result) { return result.ok; });
+    spdf::JsonWriter json;
+    json.begin_object().field("ok", all_ok);
+    json.begin_array("results");
+    for (size_t i = 0; i < request->jobs.size(); i++) {
+        json.raw_value(spdf::batch_result_json(i, request->jobs[i], request->results[i]));
+    }
+    json.end_array().end_object();
+    return json.str();
+}
+
+static void serve_connection(Server& server, Connection& connection) {
+    std::string payload;
+    while (!shutting_down && read_frame(connection.fd, &payload)) {
+        if (!write_frame(connection.fd, handle_request(server, payload))) {
+            break;
+        }
+    }
+    connection.finished = true;
+}
+
+static void join_connection(Connection& connection) {
+    connection.thread.join();
+    close(connection.fd);
+}
+
+static int listen_on(const std::string& path) {
+    sockaddr_un address{};
+    if (path.size() >= sizeof(address.sun_path)) {
+        fprintf(stderr, "socket path too long: %s\n", path.c_str());
+        return -1;
+    }
+    int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (fd < 0) {
+        perror("socket");
+        return -1;
+    }
+    address.sun_family = AF_UNIX;
+    strncpy(address.sun_path, path.c_str(), sizeof(address.sun_path) - 1);
+    unlink(path.c_str());
+    if (bind(fd, (sockaddr*)&address, sizeof(address)) != 0 || listen(fd, 64) != 0) {
+        perror("bind/listen");
+        close(fd);
+        return -1;
+    }
+    chmod(path.c_str(), 0660);
+    return fd;
+}
+
+// Client mode: send one request and print the response
+static int send_request(const std::string& path, const std::string& request) {
+    sockaddr_un address{};
+    address.sun_family = AF_UNIX;
+    strncpy(address.sun_path, path.c_str(), sizeof(address.sun_path) - 1);
+    int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (fd < 0 || connect(fd, (sockaddr*)&address, sizeof(address)) != 0) {
+        perror("connect");
+        if (fd >= 0) {
+            close(fd);
+        }
+        return 1;
+    }
+    std::string response;
+    bool ok = write_frame(fd, request) && read_frame(fd, &response);
+    close(fd);
+    if (!ok) {
+        fprintf(stderr, "connection closed by server\n");
+        return 1;
+    }
+    printf("%s\n", response.c_str());
+    return response.compare(0, 10, "{\"ok\":true") == 0 ? 0 : 1;
+}
+
+static void usage(const char* argv0) {
+    fprintf(stderr,
+            "Usage: %s --socket PATH [--workers N] [--queue-depth N] [--cache-entries N] [--cache-dir DIR]\n"
+            "          [--io auto|io_uring|blocking] [--memory-budget MB]\n"
+            "       %s --socket PATH --request \"<command>\"\n"
+            "Requests use spdfcore_cli command syntax, optionally prefixed with --priority high|normal|low.\n"
+            "\"search [--limit N] <words>\" queries the index built by index requests (kept in --cache-dir).\n"
+            "--memory-budget caps the native memory held by requests at once; what they keep beyond it is\n"
+            "spilled to --cache-dir.\n",
+            argv0, argv0);
+}
+
+int main(int argc, char** argv) {
+    std::string socket_path;
+    std::string request;
+    std::string cache_dir;
+    unsigned workers = std::max(1u, std::thread::hardware_concurrency());
+    size_t queue_depth = 10000;
+    size_t cache_entries = 65536;
+    uint64_t memory_budget = 0;
+
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        bool has_value = i + 1 < argc;
+        if (arg == "--socket" && has_value) {
+            socket_path = argv[++i];
+        } else if (arg == "--request" && has_value) {
+            request = argv[++i];
+        } else if (arg == "--workers" && has_value) {
+            workers = (unsigned)std::max(1, atoi(argv[++i]));
+        } else if (arg == "--queue-depth" && has_value) {
+            queue_depth = (size_t)std::max(1, atoi(argv[++i]));
+        } else if (arg == "--cache-entries" && has_value) {
+            cache_entries = (size_t)std::max(1, atoi(argv[++i]));
+        } else if (arg == "--cache-dir" && has_value) {
+            cache_dir = argv[++i];
+        } else if (arg == "--memory-budget" && has_value) {
+            memory_budget = (uint64_t)std::max(0, atoi(argv[++i])) << 20;
+        } else if (arg == "--io" && has_value) {
+            spdf::IoBackendKind kind;
+            if (!spdf::parse_io_backend_kind(argv[++i], &kind)) {
+                usage(argv[0]);
+                return 2;
+            }
+            spdf::set_io_backend_kind(kind);
+        } else {
+            usage(argv[0]);
+            return 2;
+        }
+    }
+    if (socket_path.empty()) {
+        usage(argv[0]);
+        return 2;
+    }
+    if (!request.empty()) {
+        return send_request(socket_path, request);
+    }
+
+    if (!spdfcore_init()) {
+        fprintf(stderr, "spdfcore_init failed\n");
+        return 1;
+    }
+
+    spdf::memory_budget().configure(memory_budget, cache_dir);
+
+    Server server(queue_depth, cache_entries, workers);
+    if (!cache_dir.empty()) {
+        server.cache_file = cache_dir + "/metadata.tsv";
+        server.cache.load(server.cache_file);
+        server.index_file = cache_dir + "/search.idx";
+        server.index.load(server.index_file);
+    }
+
+    int listener = listen_on(socket_path);
+    if (listener < 0) {
+        return 1;
+    }
+
+    struct sigaction action {};
+    action.sa_handler = handle_signal;
+    sigaction(SIGINT, &action, nullptr);
+    sigaction(SIGTERM, &action, nullptr);
+
+    std::vector<std::thread> pool;
+    for (unsigned i = 0; i < workers; i++) {
+        pool.emplace_back(worker_loop, std::ref(server));
+    }
+    fprintf(stderr, "spdfcore_daemon listening on %s with %u workers\n", socket_path.c_str(), workers);
+
+    while (!shutting_down) {
+        pollfd pfd{listener, POLLIN, 0};
+        if (poll(&pfd, 1, 500) <= 0) {
+            continue;
+        }
+        for (auto it = server.connections.begin(); it != server.connections.end();) {
+            if (it->finished) {
+                join_connection(*it);
+                it = server.connections.erase(it);
+            } else {
+                ++it;
+            }
+        }
+        int client = accept4(listener, nullptr, nullptr, SOCK_CLOEXEC);
+        if (client < 0) {
+            continue;
+        }
+        server.connections.emplace_back();
+        Connection& connection = server.connections.back();
+        connection.fd = client;
+        connection.thread = std::thread(serve_connection, std::ref(server), std::ref(connection));
+    }
+
+    close(listener);
+    unlink(socket_path.c_str());
+    // Wake connection threads blocked on their clients, fail the jobs still
+    // queued and let running ones finish, so every request a connection
+    // thread waits on completes before those threads are joined
+    for (auto& connection : server.connections) {
+        shutdown(connection.fd, SHUT_RDWR);
+    }
+    std::vector<QueuedJob> dropped;
+    server.queue.close(&dropped);
+    for (const auto& queued : dropped) {
+        spdf::BatchResult result;
+        result.error_code = PdfErrorCode_UnknownError;
+        result.error_message = "daemon shutting down";
+        complete_job(queued, std::move(result));
+    }
+    for (auto& thread : pool) {
+        thread.join();
+    }
+    for (auto& connection : server.connections) {
+        join_connection(connection);
+    }
+    server.connections.clear();
+    if (!server.cache_file.empty() && !server.cache.save(server.cache_file)) {
+        fprintf(stderr, "cannot save metadata cache to %s\n", server.cache_file.c_str());
+    }
+    if (!server.index_file.empty() && !server.index.save(server.index_file)) {
+        fprintf(stderr, "cannot save search index to %s\n", server.index_file.c_str());
+    }
+    spdfcore_cleanup();
+    return 0;
+}
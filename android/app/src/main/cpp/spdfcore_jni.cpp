@@ -1,15 +1,37 @@
 #include <jni.h>
+#include <cstdio>
+#include <cstring>
 #include <string>
 #include <vector>
 #include <memory>
+#include <mutex>
 #include <android/log.h>
 #include <dlfcn.h>
+#include <unistd.h>
 #include "spdfcore.h"  // Include the official header
+#include "spdf_compress.h"
+#include "spdf_duplicates.h"
+#include "spdf_edit.h"
+#include "spdf_executor.h"
+#include "spdf_form.h"
+#include "spdf_json.h"
+#include "spdf_memory.h"
+#include "spdf_merge.h"
+#include "spdf_protect.h"
+#include "spdf_result_cache.h"
+#include "spdf_search_index.h"
+#include "spdf_text.h"
+#include "spdf_writer.h"
 
 #define LOG_TAG "SpdfcoreNative"
 #define LOGI(...) __android_log_print(ANDROID_LOG_INFO, LOG_TAG, __VA_ARGS__)
 #define LOGE(...) __android_log_print(ANDROID_LOG_ERROR, LOG_TAG, __VA_ARGS__)
 
+// Name passed to dlopen; host builds point this at the mock or a desktop build of the Rust core
+#ifndef SPDFCORE_FFI_LIBRARY
+#define SPDFCORE_FFI_LIBRARY "libspdfcore_ffi.so"
+#endif
+
 // Function pointer types matching the generated spdfcore.h
 typedef bool (*pdf_merge_files_func)(const char* const* input_paths, size_t path_count, const char* output_path, PdfErrorCode* error_code, char** error_message);
 typedef bool (*pdf_validate_func)(const char* file_path, bool* is_valid, PdfErrorCode* error_code, char** error_message);
@@ -40,7 +62,7 @@ static bool init_spdfcore_ffi() {
     }
     
     LOGI("Loading spdfcore_ffi library dynamically...");
-    spdfcore_ffi_handle = dlopen("libspdfcore_ffi.so", RTLD_LAZY);
+    spdfcore_ffi_handle = dlopen(SPDFCORE_FFI_LIBRARY, RTLD_LAZY);
     if (!spdfcore_ffi_handle) {
         LOGE("Cannot load spdfcore_ffi library: %s", dlerror());
         return false;
@@ -125,6 +147,60 @@ std::vector<std::string> jstringArrayToVector(JNIEnv* env, jobjectArray jarray)
     return result;
 }
 
+// NewStringUTF expects modified UTF-8: supplementary characters as surrogate
+// pairs and NUL as C0 80. Malformed input bytes become U+FFFD.
+static std::string toModifiedUtf8(const std::string& utf8) {
+    std::string out;
+    out.reserve(utf8.size());
+    auto append = [&out](uint32_t unit) {
+        if (unit != 0 && unit < 0x80) {
+            out += (char)unit;
+        } else if (unit < 0x800) {
+            out += (char)(0xC0 | (unit >> 6));
+            out += (char)(0x80 | (unit & 0x3F));
+        } else {
+            out += (char)(0xE0 | (unit >> 12));
+            out += (char)(0x80 | ((unit >> 6) & 0x3F));
+            out += (char)(0x80 | (unit & 0x3F));
+        }
+    };
+    const unsigned char* p = (const unsigned char*)utf8.data();
+    size_t size = utf8.size();
+    for (size_t i = 0; i < size;) {
+        unsigned char lead = p[i];
+        size_t length = lead < 0x80 ? 1 : (lead >> 5) == 0x6 ? 2 : (lead >> 4) == 0xE ? 3 : (lead >> 3) == 0x1E ? 4 : 0;
+        uint32_t code = length == 1 ? lead : length == 2 ? (lead & 0x1F) : length == 3 ? (lead & 0x0F) : (lead & 0x07);
+        bool valid = length > 0 && i + length <= size;
+        for (size_t k = 1; valid && k < length; k++) {
+            valid = (p[i + k] & 0xC0) == 0x80;
+            code = (code << 6) | (p[i + k] & 0x3F);
+        }
+        if (!valid || code > 0x10FFFF || (code >= 0xD800 && code <= 0xDFFF)) {
+            append(0xFFFD);
+            i++;
+            continue;
+        }
+        if (code >= 0x10000) {
+            code -= 0x10000;
+            append(0xD800 | (code >> 10));
+            append(0xDC00 | (code & 0x3FF));
+        } else {
+            append(code);
+        }
+        i += length;
+    }
+    return out;
+}
+
+// Library-wide text index, loaded by nativeConfigureSearchIndex
+static spdf::SearchIndex search_index;
+static std::mutex search_index_mutex;  // guards search_index_file and saving
+static std::string search_index_file;
+
+// The calls the UI waits on (page count, size, validation, encryption check,
+// text and search) run as interactive work, so parallel bulk work yields to
+// them; everything else is bulk work, see spdf_executor.h
+
 extern "C"
 JNIEXPORT jboolean JNICALL
 Java_com_example_smart_1pdf_SpdfcorePlugin_nativeInit(JNIEnv *env, jobject /* this */) {
@@ -159,6 +235,15 @@ Java_com_example_smart_1pdf_SpdfcorePlugin_nativeMergeFiles(JNIEnv *env, jobject
     LOGI("Output path: %s", outputPathStr);
     LOGI("Output path length: %zu", strlen(outputPathStr));
     
+    // Serve repeated merges of identical inputs from the result cache
+    std::string cacheKey;
+    bool cacheable = spdf::result_cache().enabled() &&
+                     spdf::result_cache().make_key("merge", inputPathsVec, "", &cacheKey);
+    if (cacheable && spdf::result_cache().fetch(cacheKey, {outputPathStr})) {
+        LOGI("Result cache hit for merge: %s", cacheKey.c_str());
+        env->ReleaseStringUTFChars(outputPath, outputPathStr);
+        return JNI_TRUE;
+    }
     // Convert vector to array of const char*
     std::vector<const char*> inputPathsArray;
     LOGI("====== INPUT FILES ANALYSIS ======");
@@ -269,10 +354,14 @@ Java_com_example_smart_1pdf_SpdfcorePlugin_nativeMergeFiles(JNIEnv *env, jobject
         }
     }
     
+    bool success = result && (error_code == PdfErrorCode_Success);
+    if (success && cacheable) {
+        spdf::result_cache().store(cacheKey, {outputPathStr});
+    }
+    
     // Clean up
     env->ReleaseStringUTFChars(outputPath, outputPathStr);
     
-    bool success = result && (error_code == PdfErrorCode_Success);
     LOGI("====== FINAL RESULT ======");
     LOGI("Function result: %s", result ? "true" : "false");
     LOGI("Error code: %d", error_code);
@@ -286,6 +375,7 @@ extern "C"
 JNIEXPORT jboolean JNICALL
 Java_com_example_smart_1pdf_SpdfcorePlugin_nativeValidateFile(JNIEnv *env, jobject /* this */,
                                                       jstring filePath) {
+    spdf::TaskClassScope interactive(spdf::TaskClass::Interactive);
     LOGI("nativeValidateFile called");
     
     if (!pdf_validate_ptr) {
@@ -334,6 +424,7 @@ extern "C"
 JNIEXPORT jint JNICALL
 Java_com_example_smart_1pdf_SpdfcorePlugin_nativeGetPageCount(JNIEnv *env, jobject /* this */,
                                                       jstring filePath) {
+    spdf::TaskClassScope interactive(spdf::TaskClass::Interactive);
     LOGI("nativeGetPageCount called");
     
     if (!pdf_get_page_count_ptr) {
@@ -375,6 +466,7 @@ extern "C"
 JNIEXPORT jlong JNICALL
 Java_com_example_smart_1pdf_SpdfcorePlugin_nativeGetFileSize(JNIEnv *env, jobject /* this */,
                                                       jstring filePath) {
+    spdf::TaskClassScope interactive(spdf::TaskClass::Interactive);
     LOGI("nativeGetFileSize called");
     
     if (!pdf_get_file_size_ptr) {
@@ -411,6 +503,62 @@ Java_com_example_smart_1pdf_SpdfcorePlugin_nativeGetFileSize(JNIEnv *env, jobjec
     }
 }
 
+extern "C"
+JNIEXPORT jboolean JNICALL
+Java_com_example_smart_1pdf_SpdfcorePlugin_nativeSplitByPages(JNIEnv *env, jobject /* this */,
+                                                      jstring inputPath, jintArray pages, jstring outputPath) {
+    LOGI("nativeSplitByPages called");
+    
+    if (!pdf_split_by_pages_ptr) {
+        LOGE("pdf_split_by_pages_ptr is null - function not available");
+        return JNI_FALSE;
+    }
+    
+    const char* inputPathStr = env->GetStringUTFChars(inputPath, nullptr);
+    const char* outputPathStr = env->GetStringUTFChars(outputPath, nullptr);
+    std::vector<int32_t> pageNumbers(env->GetArrayLength(pages));
+    env->GetIntArrayRegion(pages, 0, (jsize)pageNumbers.size(), (jint*)pageNumbers.data());
+    
+    LOGI("Splitting %zu pages from %s to %s", pageNumbers.size(), inputPathStr, outputPathStr);
+    
+    std::string pageList;
+    for (int32_t page : pageNumbers) {
+        pageList += (pageList.empty() ? "" : ",") + std::to_string(page);
+    }
+    std::string cacheKey;
+    bool cacheable = spdf::result_cache().enabled() &&
+                     spdf::result_cache().make_key("split", {inputPathStr}, pageList, &cacheKey);
+    if (cacheable && spdf::result_cache().fetch(cacheKey, {outputPathStr})) {
+        LOGI("Result cache hit for split: %s", cacheKey.c_str());
+        env->ReleaseStringUTFChars(inputPath, inputPathStr);
+        env->ReleaseStringUTFChars(outputPath, outputPathStr);
+        return JNI_TRUE;
+    }
+    
+    PdfErrorCode error_code = PdfErrorCode_Success;
+    char* error_message = nullptr;
+    
+    bool result = pdf_split_by_pages_ptr(inputPathStr, pageNumbers.data(), pageNumbers.size(), outputPathStr,
+                                         &error_code, &error_message);
+    if (result && error_code == PdfErrorCode_Success && cacheable) {
+        spdf::result_cache().store(cacheKey, {outputPathStr});
+    }
+    
+    LOGI("pdf_split_by_pages returned: %s, error_code: %d", 
+         result ? "true" : "false", 
+         error_code);
+    
+    if (error_message) {
+        LOGI("Error message: %s", error_message);
+        free_c_string_ptr(error_message);
+    }
+    
+    env->ReleaseStringUTFChars(inputPath, inputPathStr);
+    env->ReleaseStringUTFChars(outputPath, outputPathStr);
+    
+    return (result && error_code == PdfErrorCode_Success) ? JNI_TRUE : JNI_FALSE;
+}
+
 extern "C"
 JNIEXPORT jboolean JNICALL
 Java_com_example_smart_1pdf_SpdfcorePlugin_nativeExtractPage(JNIEnv *env, jobject /* this */,
@@ -427,10 +575,23 @@ Java_com_example_smart_1pdf_SpdfcorePlugin_nativeExtractPage(JNIEnv *env, jobjec
     
     LOGI("Extracting page %d from %s to %s", pageNumber, inputPathStr, outputPathStr);
     
+    std::string cacheKey;
+    bool cacheable = spdf::result_cache().enabled() &&
+                     spdf::result_cache().make_key("extract", {inputPathStr}, std::to_string(pageNumber), &cacheKey);
+    if (cacheable && spdf::result_cache().fetch(cacheKey, {outputPathStr})) {
+        LOGI("Result cache hit for extract: %s", cacheKey.c_str());
+        env->ReleaseStringUTFChars(inputPath, inputPathStr);
+        env->ReleaseStringUTFChars(outputPath, outputPathStr);
+        return JNI_TRUE;
+    }
+    
     PdfErrorCode error_code = PdfErrorCode_Success;
     char* error_message = nullptr;
     
     bool result = pdf_extract_page_ptr(inputPathStr, pageNumber, outputPathStr, &error_code, &error_message);
+    if (result && error_code == PdfErrorCode_Success && cacheable) {
+        spdf::result_cache().store(cacheKey, {outputPathStr});
+    }
     
     LOGI("pdf_extract_page returned: %s, error_code: %d", 
          result ? "true" : "false", 
@@ -463,10 +624,25 @@ Java_com_example_smart_1pdf_SpdfcorePlugin_nativeSplitAtPage(JNIEnv *env, jobjec
     
     LOGI("Splitting %s at page %d with prefix %s", inputPathStr, splitPage, outputPrefixStr);
     
+    std::vector<std::string> outputs = {std::string(outputPrefixStr) + "_part1.pdf",
+                                        std::string(outputPrefixStr) + "_part2.pdf"};
+    std::string cacheKey;
+    bool cacheable = spdf::result_cache().enabled() &&
+                     spdf::result_cache().make_key("split_at", {inputPathStr}, std::to_string(splitPage), &cacheKey);
+    if (cacheable && spdf::result_cache().fetch(cacheKey, outputs)) {
+        LOGI("Result cache hit for split: %s", cacheKey.c_str());
+        env->ReleaseStringUTFChars(inputPath, inputPathStr);
+        env->ReleaseStringUTFChars(outputPrefix, outputPrefixStr);
+        return JNI_TRUE;
+    }
+    
     PdfErrorCode error_code = PdfErrorCode_Success;
     char* error_message = nullptr;
     
     bool result = pdf_split_at_page_ptr(inputPathStr, splitPage, outputPrefixStr, &error_code, &error_message);
+    if (result && error_code == PdfErrorCode_Success && cacheable) {
+        spdf::result_cache().store(cacheKey, outputs);
+    }
     
     LOGI("pdf_split_at_page returned: %s, error_code: %d", 
          result ? "true" : "false", 
@@ -483,6 +659,590 @@ Java_com_example_smart_1pdf_SpdfcorePlugin_nativeSplitAtPage(JNIEnv *env, jobjec
     return (result && error_code == PdfErrorCode_Success) ? JNI_TRUE : JNI_FALSE;
 }
 
+extern "C"
+JNIEXPORT jboolean JNICALL
+Java_com_example_smart_1pdf_SpdfcorePlugin_nativeConfigureResultCache(JNIEnv *env, jobject /* this */,
+                                                      jstring cacheDir, jlong maxBytes) {
+    const char* cacheDirStr = env->GetStringUTFChars(cacheDir, nullptr);
+    LOGI("nativeConfigureResultCache called: %s, %lld bytes", cacheDirStr, (long long)maxBytes);
+    
+    bool success = spdf::result_cache().configure(cacheDirStr, maxBytes > 0 ? (uint64_t)maxBytes : 0);
+    if (success) {
+        spdf::ResultCache::Stats stats = spdf::result_cache().stats();
+        LOGI("Result cache ready: %zu entries, %llu bytes", stats.entries, (unsigned long long)stats.bytes);
+    } else {
+        LOGE("Failed to configure result cache in %s", cacheDirStr);
+    }
+    
+    env->ReleaseStringUTFChars(cacheDir, cacheDirStr);
+    return success ? JNI_TRUE : JNI_FALSE;
+}
+
+// Memory budget every native operation reserves from (see spdf_memory.h); maxBytes <= 0 removes it.
+// What does not fit is spilled to files in spillDir, which must exist and be writable.
+extern "C"
+JNIEXPORT jboolean JNICALL
+Java_com_example_smart_1pdf_SpdfcorePlugin_nativeConfigureMemoryBudget(JNIEnv *env, jobject /* this */,
+                                                      jstring spillDir, jlong maxBytes) {
+    const char* spillDirStr = env->GetStringUTFChars(spillDir, nullptr);
+    LOGI("nativeConfigureMemoryBudget called: %s, %lld bytes", spillDirStr, (long long)maxBytes);
+    
+    bool success = access(spillDirStr, W_OK) == 0;
+    if (success) {
+        spdf::memory_budget().configure(maxBytes > 0 ? (uint64_t)maxBytes : 0, spillDirStr);
+    } else {
+        LOGE("Spill directory %s is not writable", spillDirStr);
+    }
+    
+    env->ReleaseStringUTFChars(spillDir, spillDirStr);
+    return success ? JNI_TRUE : JNI_FALSE;
+}
+
+// {"limit","held","peak","waits","overcommits","spilled"} of the memory budget, in bytes and counts
+extern "C"
+JNIEXPORT jstring JNICALL
+Java_com_example_smart_1pdf_SpdfcorePlugin_nativeMemoryBudgetStats(JNIEnv *env, jobject /* this */) {
+    spdf::MemoryBudget::Stats stats = spdf::memory_budget().stats();
+    spdf::JsonWriter json;
+    json.begin_object()
+        .field("limit", stats.limit)
+        .field("held", stats.held)
+        .field("peak", stats.peak)
+        .field("waits", stats.waits)
+        .field("overcommits", stats.overcommits)
+        .field("spilled", stats.spilled)
+        .end_object();
+    return env->NewStringUTF(json.str().c_str());
+}
+
+extern "C"
+JNIEXPORT jstring JNICALL
+Java_com_example_smart_1pdf_SpdfcorePlugin_nativeExtractText(JNIEnv *env, jobject /* this */,
+                                                      jstring filePath, jint pageNumber) {
+    spdf::TaskClassScope interactive(spdf::TaskClass::Interactive);
+    const char* filePathStr = env->GetStringUTFChars(filePath, nullptr);
+    LOGI("nativeExtractText called: %s, page %d", filePathStr, pageNumber);
+    
+    std::vector<std::string> pages;
+    PdfErrorCode error_code = PdfErrorCode_Success;
+    std::string error_message;
+    bool result = spdf::extract_document_text(filePathStr, &pages, &error_code, &error_message, pageNumber);
+    env->ReleaseStringUTFChars(filePath, filePathStr);
+    
+    if (!result) {
+        LOGE("Text extraction failed, error: %d (%s)", error_code, error_message.c_str());
+        return nullptr;
+    }
+    
+    // Page 0 asks for the whole document, pages separated by form feeds
+    std::string text;
+    if (pageNumber == 0) {
+        for (size_t i = 0; i < pages.size(); i++) {
+            text += pages[i];
+            if (i + 1 < pages.size()) {
+                text += '\f';
+            }
+        }
+    } else {
+        text = pages[pageNumber - 1];
+    }
+    return env->NewStringUTF(toModifiedUtf8(text).c_str());
+}
+
+extern "C"
+JNIEXPORT jboolean JNICALL
+Java_com_example_smart_1pdf_SpdfcorePlugin_nativeConfigureSearchIndex(JNIEnv *env, jobject /* this */,
+                                                      jstring indexFile) {
+    const char* indexFileStr = env->GetStringUTFChars(indexFile, nullptr);
+    LOGI("nativeConfigureSearchIndex called: %s", indexFileStr);
+    
+    std::lock_guard<std::mutex> lock(search_index_mutex);
+    search_index_file = indexFileStr;
+    // A missing index is normal on first start; it is created by the first save
+    if (search_index.load(search_index_file)) {
+        spdf::SearchIndex::Stats stats = search_index.stats();
+        LOGI("Search index ready: %zu documents, %zu terms", stats.documents, stats.terms);
+    }
+    
+    env->ReleaseStringUTFChars(indexFile, indexFileStr);
+    return JNI_TRUE;
+}
+
+// Indexes any of filePaths that are new or changed, then searches them.
+// Returns a JSON array of {"path","page","score"} or null on failure.
+extern "C"
+JNIEXPORT jstring JNICALL
+Java_com_example_smart_1pdf_SpdfcorePlugin_nativeSearchText(JNIEnv *env, jobject /* this */,
+                                                      jobjectArray filePaths, jstring query, jint limit) {
+    spdf::TaskClassScope interactive(spdf::TaskClass::Interactive);
+    std::vector<std::string> filePathsVec = jstringArrayToVector(env, filePaths);
+    const char* queryStr = env->GetStringUTFChars(query, nullptr);
+    LOGI("nativeSearchText called: '%s' across %zu files", queryStr, filePathsVec.size());
+    
+    size_t added = 0;
+    for (const auto& path : filePathsVec) {
+        spdf::FileIdentity identity;
+        if (!spdf::FileIdentity::of(path, &identity) || search_index.contains(path, identity)) {
+            continue;
+        }
+        std::vector<std::string> pages;
+        PdfErrorCode error_code = PdfErrorCode_Success;
+        std::string error_message;
+        if (spdf::extract_document_text(path, &pages, &error_code, &error_message)) {
+            search_index.add_document(path, identity, pages);
+            added++;
+        } else {
+            LOGE("Cannot index %s, error: %d (%s)", path.c_str(), error_code, error_message.c_str());
+            search_index.remove_document(path);
+        }
+    }
+    if (added > 0) {
+        std::lock_guard<std::mutex> lock(search_index_mutex);
+        if (!search_index_file.empty() && !search_index.save(search_index_file)) {
+            LOGE("Failed to save search index to %s", search_index_file.c_str());
+        }
+    }
+    
+    std::vector<spdf::SearchIndex::Hit> hits =
+        search_index.search(queryStr, limit > 0 ? (size_t)limit : 20, filePathsVec);
+    env->ReleaseStringUTFChars(query, queryStr);
+    LOGI("Search indexed %zu new files, %zu hits", added, hits.size());
+    
+    std::string json = "[";
+    for (const auto& hit : hits) {
+        spdf::JsonWriter item;
+        item.begin_object()
+            .field("path", hit.path)
+            .field("page", hit.page)
+            .field("score", (int64_t)hit.score)
+            .end_object();
+        json += (json.size() > 1 ? "," : "") + item.str();
+    }
+    json += "]";
+    return env->NewStringUTF(toModifiedUtf8(json).c_str());
+}
+
+extern "C"
+JNIEXPORT jint JNICALL
+Java_com_example_smart_1pdf_SpdfcorePlugin_nativeIsPasswordProtected(JNIEnv *env, jobject /* this */,
+                                                      jstring filePath) {
+    spdf::TaskClassScope interactive(spdf::TaskClass::Interactive);
+    const char* filePathStr = env->GetStringUTFChars(filePath, nullptr);
+    LOGI("nativeIsPasswordProtected called: %s", filePathStr);
+    
+    bool encrypted = false;
+    PdfErrorCode error_code = PdfErrorCode_Success;
+    std::string error_message;
+    bool result = spdf::is_document_encrypted(filePathStr, &encrypted, &error_code, &error_message);
+    env->ReleaseStringUTFChars(filePath, filePathStr);
+    
+    if (!result) {
+        LOGE("Encryption check failed, error: %d (%s)", error_code, error_message.c_str());
+        return -1;
+    }
+    return encrypted ? 1 : 0;
+}
+
+// Lock and unlock return the PdfErrorCode so a wrong password can be told apart from other failures
+extern "C"
+JNIEXPORT jint JNICALL
+Java_com_example_smart_1pdf_SpdfcorePlugin_nativeLockPdf(JNIEnv *env, jobject /* this */,
+                                                      jstring inputPath, jstring password, jstring outputPath,
+                                                      jboolean linearize, jboolean objectStreams) {
+    const char* inputPathStr = env->GetStringUTFChars(inputPath, nullptr);
+    const char* passwordStr = env->GetStringUTFChars(password, nullptr);
+    const char* outputPathStr = env->GetStringUTFChars(outputPath, nullptr);
+    LOGI("nativeLockPdf called: %s -> %s", inputPathStr, outputPathStr);
+    
+    PdfErrorCode error_code = PdfErrorCode_Success;
+    std::string error_message;
+    spdf::WriteOptions layout;
+    layout.linearize = linearize == JNI_TRUE;
+    layout.object_streams = objectStreams == JNI_TRUE;
+    bool result = spdf::lock_document(inputPathStr, passwordStr, outputPathStr, layout, &error_code, &error_message);
+    if (!result) {
+        LOGE("Locking failed, error: %d (%s)", error_code, error_message.c_str());
+    }
+    
+    env->ReleaseStringUTFChars(inputPath, inputPathStr);
+    env->ReleaseStringUTFChars(password, passwordStr);
+    env->ReleaseStringUTFChars(outputPath, outputPathStr);
+    return (jint)error_code;
+}
+
+extern "C"
+JNIEXPORT jint JNICALL
+Java_com_example_smart_1pdf_SpdfcorePlugin_nativeUnlockPdf(JNIEnv *env, jobject /* this */,
+                                                      jstring inputPath, jstring password, jstring outputPath,
+                                                      jboolean linearize, jboolean objectStreams) {
+    const char* inputPathStr = env->GetStringUTFChars(inputPath, nullptr);
+    const char* passwordStr = env->GetStringUTFChars(password, nullptr);
+    const char* outputPathStr = env->GetStringUTFChars(outputPath, nullptr);
+    LOGI("nativeUnlockPdf called: %s -> %s", inputPathStr, outputPathStr);
+    
+    PdfErrorCode error_code = PdfErrorCode_Success;
+    std::string error_message;
+    spdf::WriteOptions layout;
+    layout.linearize = linearize == JNI_TRUE;
+    layout.object_streams = objectStreams == JNI_TRUE;
+    bool result = spdf::unlock_document(inputPathStr, passwordStr, outputPathStr, layout, &error_code, &error_message);
+    if (!result) {
+        LOGE("Unlocking failed, error: %d (%s)", error_code, error_message.c_str());
+    }
+    
+    env->ReleaseStringUTFChars(inputPath, inputPathStr);
+    env->ReleaseStringUTFChars(password, passwordStr);
+    env->ReleaseStringUTFChars(outputPath, outputPathStr);
+    return (jint)error_code;
+}
+
+// Rewrites a file in the linearized (fast web view) layout, with object streams, pruned of the objects
+// its pages do not use or with its fonts subset; output may be the input itself
+extern "C"
+JNIEXPORT jint JNICALL
+Java_com_example_smart_1pdf_SpdfcorePlugin_nativeRewritePdf(JNIEnv *env, jobject /* this */,
+                                                      jstring inputPath, jstring outputPath,
+                                                      jboolean linearize, jboolean objectStreams,
+                                                      jboolean prune, jboolean subsetFonts) {
+    const char* inputPathStr = env->GetStringUTFChars(inputPath, nullptr);
+    const char* outputPathStr = env->GetStringUTFChars(outputPath, nullptr);
+    LOGI("nativeRewritePdf called: %s -> %s", inputPathStr, outputPathStr);
+    
+    PdfErrorCode error_code = PdfErrorCode_Success;
+    std::string error_message;
+    spdf::WriteOptions layout;
+    layout.linearize = linearize == JNI_TRUE;
+    layout.object_streams = objectStreams == JNI_TRUE;
+    layout.prune = prune == JNI_TRUE;
+    layout.subset_fonts = subsetFonts == JNI_TRUE;
+    bool result = spdf::rewrite_file(inputPathStr, outputPathStr, layout, &error_code, &error_message);
+    if (!result) {
+        LOGE("Rewriting failed, error: %d (%s)", error_code, error_message.c_str());
+    }
+    
+    env->ReleaseStringUTFChars(inputPath, inputPathStr);
+    env->ReleaseStringUTFChars(outputPath, outputPathStr);
+    return (jint)error_code;
+}
+
+// Writes a rebuilt copy of a damaged file (truncated, broken cross-reference data or page tree); intact
+// files are copied through the writer unchanged in content
+extern "C"
+JNIEXPORT jint JNICALL
+Java_com_example_smart_1pdf_SpdfcorePlugin_nativeRepairPdf(JNIEnv *env, jobject /* this */,
+                                                      jstring inputPath, jstring outputPath) {
+    const char* inputPathStr = env->GetStringUTFChars(inputPath, nullptr);
+    const char* outputPathStr = env->GetStringUTFChars(outputPath, nullptr);
+    LOGI("nativeRepairPdf called: %s -> %s", inputPathStr, outputPathStr);
+    
+    PdfErrorCode error_code = PdfErrorCode_Success;
+    std::string error_message;
+    bool result = spdf::rewrite_file(inputPathStr, outputPathStr, spdf::WriteOptions(), &error_code, &error_message);
+    if (!result) {
+        LOGE("Repair failed, error: %d (%s)", error_code, error_message.c_str());
+    }
+    
+    env->ReleaseStringUTFChars(inputPath, inputPathStr);
+    env->ReleaseStringUTFChars(outputPath, outputPathStr);
+    return (jint)error_code;
+}
+
+// Two-pass native merge: inputs are measured, then written in parallel at their final offsets
+extern "C"
+JNIEXPORT jint JNICALL
+Java_com_example_smart_1pdf_SpdfcorePlugin_nativeMergeFilesParallel(JNIEnv *env, jobject /* this */,
+                                                            jobjectArray inputPaths, jstring outputPath) {
+    std::vector<std::string> inputPathsVec = jstringArrayToVector(env, inputPaths);
+    const char* outputPathStr = env->GetStringUTFChars(outputPath, nullptr);
+    LOGI("nativeMergeFilesParallel called: %zu inputs -> %s", inputPathsVec.size(), outputPathStr);
+    
+    PdfErrorCode error_code = PdfErrorCode_Success;
+    std::string error_message;
+    bool result = spdf::merge_documents(inputPathsVec, outputPathStr, 0, &error_code, &error_message);
+    if (!result) {
+        LOGE("Parallel merge failed, error: %d (%s)", error_code, error_message.c_str());
+    }
+    
+    env->ReleaseStringUTFChars(outputPath, outputPathStr);
+    return (jint)error_code;
+}
+
+// Reorders, rotates and deletes pages by appending a new page tree to the file;
+// script is a page edit script (see spdf_edit.h)
+extern "C"
+JNIEXPORT jint JNICALL
+Java_com_example_smart_1pdf_SpdfcorePlugin_nativeEditPages(JNIEnv *env, jobject /* this */,
+                                                     jstring inputPath, jstring outputPath, jstring script) {
+    const char* inputPathStr = env->GetStringUTFChars(inputPath, nullptr);
+    const char* outputPathStr = env->GetStringUTFChars(outputPath, nullptr);
+    const char* scriptStr = env->GetStringUTFChars(script, nullptr);
+    LOGI("nativeEditPages called: %s -> %s", inputPathStr, outputPathStr);
+    
+    PdfErrorCode error_code = PdfErrorCode_InvalidParameter;
+    std::string error_message;
+    spdf::PageEditScript edits;
+    bool result = spdf::parse_page_edit_script(scriptStr, &edits, &error_message) &&
+                  spdf::edit_pages(inputPathStr, outputPathStr, edits, &error_code, &error_message);
+    if (!result) {
+        LOGE("Page edit failed, error: %d (%s)", error_code, error_message.c_str());
+    }
+    
+    env->ReleaseStringUTFChars(inputPath, inputPathStr);
+    env->ReleaseStringUTFChars(outputPath, outputPathStr);
+    env->ReleaseStringUTFChars(script, scriptStr);
+    return (jint)error_code;
+}
+
+// Downsamples images shown above targetDpi and re-encodes them as JPEG (see spdf_compress.h)
+extern "C"
+JNIEXPORT jint JNICALL
+Java_com_example_smart_1pdf_SpdfcorePlugin_nativeCompressPdf(JNIEnv *env, jobject /* this */,
+                                                      jstring inputPath, jstring outputPath, jint targetDpi) {
+    const char* inputPathStr = env->GetStringUTFChars(inputPath, nullptr);
+    const char* outputPathStr = env->GetStringUTFChars(outputPath, nullptr);
+    LOGI("nativeCompressPdf called: %s -> %s at %d dpi", inputPathStr, outputPathStr, (int)targetDpi);
+    
+    PdfErrorCode error_code = PdfErrorCode_Success;
+    std::string error_message;
+    spdf::CompressOptions options;
+    options.target_dpi = targetDpi;
+    spdf::CompressStats stats;
+    bool result = spdf::compress_file(inputPathStr, outputPathStr, options, &error_code, &error_message, &stats);
+    if (result) {
+        LOGI("Compressed %zu of %zu images (%zu bilevel, %zu unreadable): %llu -> %llu bytes", stats.resampled,
+             stats.images, stats.bilevel, stats.unreadable, (unsigned long long)stats.bytes_before,
+             (unsigned long long)stats.bytes_after);
+    } else {
+        LOGE("Compression failed, error: %d (%s)", error_code, error_message.c_str());
+    }
+    
+    env->ReleaseStringUTFChars(inputPath, inputPathStr);
+    env->ReleaseStringUTFChars(outputPath, outputPathStr);
+    return (jint)error_code;
+}
+
+// Predicts nativeCompressPdf's output size at each of targetDpis without writing anything
+// (see spdf_compress.h). Returns a JSON array of
+// {"targetDpi","bytes","low","high","images","sampled","unreadable"} or null on failure.
+extern "C"
+JNIEXPORT jstring JNICALL
+Java_com_example_smart_1pdf_SpdfcorePlugin_nativeEstimateCompression(JNIEnv *env, jobject /* this */,
+                                                      jstring inputPath, jintArray targetDpis) {
+    const char* inputPathStr = env->GetStringUTFChars(inputPath, nullptr);
+    std::vector<jint> dpis(env->GetArrayLength(targetDpis));
+    env->GetIntArrayRegion(targetDpis, 0, (jsize)dpis.size(), dpis.data());
+    LOGI("nativeEstimateCompression called: %s at %zu resolutions", inputPathStr, dpis.size());
+    
+    std::vector<spdf::CompressOptions> presets(dpis.size());
+    for (size_t i = 0; i < dpis.size(); i++) {
+        presets[i].target_dpi = dpis[i];
+    }
+    std::vector<spdf::CompressEstimate> estimates;
+    PdfErrorCode error_code = PdfErrorCode_Success;
+    std::string error_message;
+    bool result = spdf::estimate_compression(inputPathStr, presets, &estimates, &error_code, &error_message);
+    env->ReleaseStringUTFChars(inputPath, inputPathStr);
+    
+    if (!result) {
+        LOGE("Compression estimate failed, error: %d (%s)", error_code, error_message.c_str());
+        return nullptr;
+    }
+    std::string json = "[";
+    for (size_t i = 0; i < estimates.size(); i++) {
+        spdf::JsonWriter item;
+        item.begin_object()
+            .field("targetDpi", (int32_t)dpis[i])
+            .field("bytes", estimates[i].bytes)
+            .field("low", estimates[i].low)
+            .field("high", estimates[i].high)
+            .field("images", (int64_t)estimates[i].images)
+            .field("sampled", (int64_t)estimates[i].sampled)
+            .field("unreadable", (int64_t)estimates[i].unreadable)
+            .end_object();
+        json += (json.size() > 1 ? "," : "") + item.str();
+    }
+    json += "]";
+    return env->NewStringUTF(json.c_str());
+}
+
+// Exact size of the file nativeMergeFilesParallel would write, from its first pass alone; -1 on failure
+extern "C"
+JNIEXPORT jlong JNICALL
+Java_com_example_smart_1pdf_SpdfcorePlugin_nativeEstimateMergeSize(JNIEnv *env, jobject /* this */,
+                                                      jobjectArray inputPaths) {
+    std::vector<std::string> inputPathsVec = jstringArrayToVector(env, inputPaths);
+    LOGI("nativeEstimateMergeSize called: %zu inputs", inputPathsVec.size());
+    
+    uint64_t size = 0;
+    PdfErrorCode error_code = PdfErrorCode_Success;
+    std::string error_message;
+    if (!spdf::estimate_merge(inputPathsVec, 0, &size, &error_code, &error_message)) {
+        LOGE("Merge estimate failed, error: %d (%s)", error_code, error_message.c_str());
+        return -1;
+    }
+    return (jlong)size;
+}
+
+// Groups of pages that repeat within or across inputs (see spdf_duplicates.h); similarity below 1
+// also groups near matches. Returns a JSON array of groups, each an array of {"input","page"} with
+// the page a merge keeps first, or null on failure.
+extern "C"
+JNIEXPORT jstring JNICALL
+Java_com_example_smart_1pdf_SpdfcorePlugin_nativeFindDuplicatePages(JNIEnv *env, jobject /* this */,
+                                                      jobjectArray inputPaths, jdouble similarity) {
+    std::vector<std::string> inputPathsVec = jstringArrayToVector(env, inputPaths);
+    LOGI("nativeFindDuplicatePages called: %zu inputs at similarity %.2f", inputPathsVec.size(), similarity);
+    
+    spdf::DuplicateOptions options;
+    options.similarity = similarity;
+    std::vector<std::vector<spdf::PageLocation>> groups;
+    PdfErrorCode error_code = PdfErrorCode_Success;
+    std::string error_message;
+    if (!spdf::find_duplicate_pages(inputPathsVec, options, &groups, &error_code, &error_message)) {
+        LOGE("Duplicate search failed, error: %d (%s)", error_code, error_message.c_str());
+        return nullptr;
+    }
+    std::string json = "[";
+    for (const auto& group : groups) {
+        std::string pages = "[";
+        for (const auto& location : group) {
+            spdf::JsonWriter item;
+            item.begin_object()
+                .field("input", (int64_t)location.input)
+                .field("page", location.page)
+                .end_object();
+            pages += (pages.size() > 1 ? "," : "") + item.str();
+        }
+        json += (json.size() > 1 ? "," : "") + pages + "]";
+    }
+    json += "]";
+    return env->NewStringUTF(json.c_str());
+}
+
+// Merges inputs natively keeping only the first of the pages nativeFindDuplicatePages groups
+extern "C"
+JNIEXPORT jint JNICALL
+Java_com_example_smart_1pdf_SpdfcorePlugin_nativeMergeWithoutDuplicates(JNIEnv *env, jobject /* this */,
+                                                      jobjectArray inputPaths, jstring outputPath,
+                                                      jdouble similarity) {
+    std::vector<std::string> inputPathsVec = jstringArrayToVector(env, inputPaths);
+    const char* outputPathStr = env->GetStringUTFChars(outputPath, nullptr);
+    LOGI("nativeMergeWithoutDuplicates called: %zu inputs -> %s", inputPathsVec.size(), outputPathStr);
+    
+    spdf::DuplicateOptions options;
+    options.similarity = similarity;
+    size_t dropped = 0;
+    PdfErrorCode error_code = PdfErrorCode_Success;
+    std::string error_message;
+    bool result = spdf::merge_without_duplicates(inputPathsVec, outputPathStr, options, &dropped, &error_code,
+                                                 &error_message);
+    if (result) {
+        LOGI("Merged without %zu duplicate pages", dropped);
+    } else {
+        LOGE("Merge without duplicates failed, error: %d (%s)", error_code, error_message.c_str());
+    }
+    
+    env->ReleaseStringUTFChars(outputPath, outputPathStr);
+    return (jint)error_code;
+}
+
+// Fills the AcroForm of templatePath once per row of csv (a header naming the fields, then one row
+// per copy; see spdf_form.h), writing row N to outputPattern with "{row}" replaced by N. The
+// template is parsed once and the rows are written side by side as incremental updates.
+extern "C"
+JNIEXPORT jint JNICALL
+Java_com_example_smart_1pdf_SpdfcorePlugin_nativeFillForms(JNIEnv *env, jobject /* this */,
+                                                      jstring templatePath, jstring csv, jstring outputPattern) {
+    const char* templatePathStr = env->GetStringUTFChars(templatePath, nullptr);
+    const char* csvStr = env->GetStringUTFChars(csv, nullptr);
+    const char* outputPatternStr = env->GetStringUTFChars(outputPattern, nullptr);
+    LOGI("nativeFillForms called: %s -> %s", templatePathStr, outputPatternStr);
+    
+    PdfErrorCode error_code = PdfErrorCode_InvalidParameter;
+    std::string error_message;
+    std::vector<spdf::FormValues> rows;
+    std::vector<std::string> outputs;
+    bool result = spdf::parse_form_data(csvStr, &rows, &error_message) &&
+                  spdf::fill_forms(templatePathStr, rows, outputPatternStr, 0, &outputs, &error_code, &error_message);
+    if (result) {
+        LOGI("Filled %zu copies of the form", outputs.size());
+    } else {
+        LOGE("Form fill failed, error: %d (%s)", error_code, error_message.c_str());
+    }
+    
+    env->ReleaseStringUTFChars(templatePath, templatePathStr);
+    env->ReleaseStringUTFChars(csv, csvStr);
+    env->ReleaseStringUTFChars(outputPattern, outputPatternStr);
+    return (jint)error_code;
+}
+
+// Writes every output of an assembly plan (see parse_assembly_plan() in spdf_merge.h), opening
+// each source once for the whole batch
+extern "C"
+JNIEXPORT jint JNICALL
+Java_com_example_smart_1pdf_SpdfcorePlugin_nativeAssembleDocuments(JNIEnv *env, jobject /* this */, jstring plan) {
+    const char* planStr = env->GetStringUTFChars(plan, nullptr);
+    std::vector<spdf::AssemblyOutput> outputs;
+    PdfErrorCode error_code = PdfErrorCode_InvalidParameter;
+    std::string error_message;
+    bool result = spdf::parse_assembly_plan(planStr, &outputs, &error_message);
+    env->ReleaseStringUTFChars(plan, planStr);
+    LOGI("nativeAssembleDocuments called: %zu outputs", outputs.size());
+    
+    result = result && spdf::assemble_documents(outputs, 0, &error_code, &error_message);
+    if (!result) {
+        LOGE("Assembly failed, error: %d (%s)", error_code, error_message.c_str());
+    }
+    return (jint)error_code;
+}
+
+// Merge session keeping parsed inputs between merges (see spdf_merge.h); maxBytes <= 0 uses the
+// default budget. Returns a handle for nativeSessionMerge, to be released with nativeCloseMergeSession.
+extern "C"
+JNIEXPORT jlong JNICALL
+Java_com_example_smart_1pdf_SpdfcorePlugin_nativeOpenMergeSession(JNIEnv* /* env */, jobject /* this */,
+                                                                  jlong maxBytes) {
+    LOGI("nativeOpenMergeSession called: %lld bytes", (long long)maxBytes);
+    spdf::MergeSession* session = maxBytes > 0 ? new spdf::MergeSession((uint64_t)maxBytes) : new spdf::MergeSession();
+    return (jlong)(intptr_t)session;
+}
+
+// nativeMergeFilesParallel through a session: inputs it already holds are not parsed again
+extern "C"
+JNIEXPORT jint JNICALL
+Java_com_example_smart_1pdf_SpdfcorePlugin_nativeSessionMerge(JNIEnv *env, jobject /* this */, jlong session,
+                                                      jobjectArray inputPaths, jstring outputPath) {
+    if (!session) {
+        return (jint)PdfErrorCode_InvalidParameter;
+    }
+    std::vector<std::string> inputPathsVec = jstringArrayToVector(env, inputPaths);
+    const char* outputPathStr = env->GetStringUTFChars(outputPath, nullptr);
+    LOGI("nativeSessionMerge called: %zu inputs -> %s", inputPathsVec.size(), outputPathStr);
+    
+    spdf::MergeSession* mergeSession = (spdf::MergeSession*)(intptr_t)session;
+    PdfErrorCode error_code = PdfErrorCode_Success;
+    std::string error_message;
+    bool result = mergeSession->merge(inputPathsVec, outputPathStr, 0, &error_code, &error_message);
+    if (result) {
+        spdf::MergeSession::Stats stats = mergeSession->stats();
+        LOGI("Session holds %zu inputs in %llu bytes, %llu of them spilled (%llu hits, %llu misses)", stats.entries,
+             (unsigned long long)stats.bytes, (unsigned long long)stats.spilled, (unsigned long long)stats.hits,
+             (unsigned long long)stats.misses);
+    } else {
+        LOGE("Session merge failed, error: %d (%s)", error_code, error_message.c_str());
+    }
+    
+    env->ReleaseStringUTFChars(outputPath, outputPathStr);
+    return (jint)error_code;
+}
+
+extern "C"
+JNIEXPORT void JNICALL
+Java_com_example_smart_1pdf_SpdfcorePlugin_nativeCloseMergeSession(JNIEnv* /* env */, jobject /* this */, jlong session) {
+    LOGI("nativeCloseMergeSession called");
+    delete (spdf::MergeSession*)(intptr_t)session;
+}
+
 extern "C" JNIEXPORT jstring JNICALL
 Java_com_example_smart_1pdf_SpdfcorePlugin_nativeGetVersion(JNIEnv *env, jobject /* this */) {
     LOGI("nativeGetVersion called");
@@ -1,12 +1,16 @@
 package com.example.smart_pdf
 
 import android.content.Context
+import android.os.Handler
+import android.os.Looper
 import android.util.Log
 import io.flutter.embedding.engine.plugins.FlutterPlugin
 import io.flutter.plugin.common.MethodCall
 import io.flutter.plugin.common.MethodChannel
 import io.flutter.plugin.common.MethodChannel.MethodCallHandler
 import io.flutter.plugin.common.MethodChannel.Result
+import java.util.concurrent.ExecutorService
+import java.util.concurrent.Executors
 
 /**
  * Flutter Plugin for spdfcore PDF processing library
@@ -19,6 +23,25 @@ class SpdfcorePlugin: FlutterPlugin, MethodCallHandler {
     companion object {
         private const val CHANNEL = "spdfcore"
         private var isNativeLibraryLoaded = false
+        private const val RESULT_CACHE_DIR = "spdfcore_results"
+        private const val RESULT_CACHE_BYTES = 256L * 1024 * 1024
+        private const val SEARCH_INDEX_FILE = "spdfcore_search.idx"
+        private const val SPILL_DIR = "spdfcore_spill"
+        // Devices with at most this much RAM get a memory budget of 1/MEMORY_BUDGET_DIVISOR of it by default
+        private const val LOW_MEMORY_DEVICE_BYTES = 4L * 1024 * 1024 * 1024
+        private const val MEMORY_BUDGET_DIVISOR = 8
+        // Calls that write files: run one at a time off the platform thread, in the order Dart made
+        // them. The merge session calls are among them so a session closes after the merges queued on it.
+        private val BULK_METHODS = setOf(
+            "mergeFiles", "splitByPages", "extractPage", "splitAtPage", "lockPdf", "unlockPdf", "repairPdf",
+            "editPages", "compressPdf", "fillForms", "assembleDocuments",
+            "openMergeSession", "sessionMerge", "closeMergeSession"
+        )
+        // Calls that read documents for the UI, on a thread of their own so a long bulk call does not hold them up
+        private val QUERY_METHODS = setOf(
+            "getPageCount", "validatePdf", "getPdfInfo", "extractText", "searchText", "isPasswordProtected",
+            "estimateCompression", "estimateMergeSize", "findDuplicatePages"
+        )
         
         // Load the native library
         init {
@@ -45,15 +68,47 @@ class SpdfcorePlugin: FlutterPlugin, MethodCallHandler {
     private lateinit var channel: MethodChannel
     private lateinit var context: Context
     
+    // Open merge sessions by the id handed to Dart, holding their native handles
+    private val mergeSessions = HashMap<Int, Long>()
+    private var nextMergeSessionId = 1
+    
+    private val bulkExecutor: ExecutorService = Executors.newSingleThreadExecutor()
+    private val queryExecutor: ExecutorService = Executors.newSingleThreadExecutor()
+    private val mainHandler = Handler(Looper.getMainLooper())
+    
     // Native function declarations
     private external fun nativeInit(): Boolean
     private external fun nativeGetPageCount(filePath: String): Int
     private external fun nativeValidateFile(filePath: String): Boolean
     private external fun nativeMergeFiles(inputFiles: Array<String>, outputFile: String): Boolean
+    private external fun nativeMergeFilesParallel(inputFiles: Array<String>, outputFile: String): Int
     private external fun nativeGetFileSize(filePath: String): Long
+    private external fun nativeSplitByPages(inputPath: String, pages: IntArray, outputPath: String): Boolean
     private external fun nativeExtractPage(inputPath: String, pageNumber: Int, outputPath: String): Boolean
     private external fun nativeSplitAtPage(inputPath: String, splitPage: Int, outputPrefix: String): Boolean
     private external fun nativeGetVersion(): String
+    private external fun nativeConfigureResultCache(cacheDir: String, maxBytes: Long): Boolean
+    private external fun nativeConfigureMemoryBudget(spillDir: String, maxBytes: Long): Boolean
+    private external fun nativeMemoryBudgetStats(): String
+    private external fun nativeExtractText(filePath: String, pageNumber: Int): String?
+    private external fun nativeConfigureSearchIndex(indexFile: String): Boolean
+    private external fun nativeSearchText(filePaths: Array<String>, query: String, limit: Int): String?
+    private external fun nativeIsPasswordProtected(filePath: String): Int
+    private external fun nativeLockPdf(inputPath: String, password: String, outputPath: String, linearize: Boolean, objectStreams: Boolean): Int
+    private external fun nativeUnlockPdf(inputPath: String, password: String, outputPath: String, linearize: Boolean, objectStreams: Boolean): Int
+    private external fun nativeRepairPdf(inputPath: String, outputPath: String): Int
+    private external fun nativeRewritePdf(inputPath: String, outputPath: String, linearize: Boolean, objectStreams: Boolean, prune: Boolean, subsetFonts: Boolean): Int
+    private external fun nativeEditPages(inputPath: String, outputPath: String, script: String): Int
+    private external fun nativeCompressPdf(inputPath: String, outputPath: String, targetDpi: Int): Int
+    private external fun nativeEstimateCompression(inputPath: String, targetDpis: IntArray): String?
+    private external fun nativeEstimateMergeSize(inputPaths: Array<String>): Long
+    private external fun nativeOpenMergeSession(maxBytes: Long): Long
+    private external fun nativeSessionMerge(session: Long, inputPaths: Array<String>, outputPath: String): Int
+    private external fun nativeCloseMergeSession(session: Long)
+    private external fun nativeAssembleDocuments(plan: String): Int
+    private external fun nativeFindDuplicatePages(inputPaths: Array<String>, similarity: Double): String?
+    private external fun nativeMergeWithoutDuplicates(inputPaths: Array<String>, outputPath: String, similarity: Double): Int
+    private external fun nativeFillForms(templatePath: String, csv: String, outputPattern: String): Int
     
     override fun onAttachedToEngine(flutterPluginBinding: FlutterPlugin.FlutterPluginBinding) {
         channel = MethodChannel(flutterPluginBinding.binaryMessenger, CHANNEL)
@@ -65,6 +120,29 @@ class SpdfcorePlugin: FlutterPlugin, MethodCallHandler {
     }
     
     override fun onMethodCall(call: MethodCall, result: Result) {
+        when (call.method) {
+            in BULK_METHODS -> bulkExecutor.execute { handleMethodCall(call, MainThreadResult(result)) }
+            in QUERY_METHODS -> queryExecutor.execute { handleMethodCall(call, MainThreadResult(result)) }
+            else -> handleMethodCall(call, result)
+        }
+    }
+    
+    // Hands the reply of a call run on a worker thread back to the platform thread, where Flutter expects it
+    private inner class MainThreadResult(private val result: Result) : Result {
+        override fun success(value: Any?) {
+            mainHandler.post { result.success(value) }
+        }
+        
+        override fun error(errorCode: String, errorMessage: String?, errorDetails: Any?) {
+            mainHandler.post { result.error(errorCode, errorMessage, errorDetails) }
+        }
+        
+        override fun notImplemented() {
+            mainHandler.post { result.notImplemented() }
+        }
+    }
+    
+    private fun handleMethodCall(call: MethodCall, result: Result) {
         try {
             // If native library is not loaded, provide fallback implementations
             if (!isNativeLibraryLoaded) {
@@ -116,6 +194,15 @@ class SpdfcorePlugin: FlutterPlugin, MethodCallHandler {
                             android.util.Log.i("SpdfcorePlugin", "Calling nativeInit...")
                             val initResult = nativeInit()
                             android.util.Log.i("SpdfcorePlugin", "nativeInit returned: $initResult")
+                            if (initResult) {
+                                val cacheDir = java.io.File(context.cacheDir, RESULT_CACHE_DIR).absolutePath
+                                if (!nativeConfigureResultCache(cacheDir, RESULT_CACHE_BYTES)) {
+                                    android.util.Log.w("SpdfcorePlugin", "Result cache unavailable at $cacheDir")
+                                }
+                                val indexFile = java.io.File(context.filesDir, SEARCH_INDEX_FILE).absolutePath
+                                nativeConfigureSearchIndex(indexFile)
+                                configureMemoryBudget(defaultMemoryBudget())
+                            }
                             initResult
                         } catch (e: UnsatisfiedLinkError) {
                             android.util.Log.e("SpdfcorePlugin", "UnsatisfiedLinkError in nativeInit: ${e.message}")
@@ -187,10 +274,20 @@ class SpdfcorePlugin: FlutterPlugin, MethodCallHandler {
                     val inputFiles = call.argument<List<String>>("inputFiles")
                     val outputFile = call.argument<String>("outputFile")
                     
+                    val linearize = call.argument<Boolean>("linearize") ?: false
+                    val objectStreams = call.argument<Boolean>("objectStreams") ?: false
+                    val parallel = call.argument<Boolean>("parallel") ?: false
+                    val subsetFonts = call.argument<Boolean>("subsetFonts") ?: false
+                    val skipDuplicatePages = call.argument<Boolean>("skipDuplicatePages") ?: false
+                    
                     if (inputFiles != null && outputFile != null) {
                         val success = if (isNativeLibraryLoaded) {
                             try {
-                                nativeMergeFiles(inputFiles.toTypedArray(), outputFile)
+                                // The native merges read damaged inputs through the recovery scan themselves
+                                val merged = if (skipDuplicatePages) nativeMergeWithoutDuplicates(inputFiles.toTypedArray(), outputFile, 1.0) == 0
+                                             else if (parallel) nativeMergeFilesParallel(inputFiles.toTypedArray(), outputFile) == 0
+                                             else withRepairedInputs(inputFiles) { inputs -> nativeMergeFiles(inputs.toTypedArray(), outputFile) }
+                                merged && rewriteOutputs(listOf(outputFile), linearize, objectStreams, subsetFonts = subsetFonts)
                             } catch (e: UnsatisfiedLinkError) {
                                 false
                             }
@@ -204,18 +301,41 @@ class SpdfcorePlugin: FlutterPlugin, MethodCallHandler {
                 }
                 
                 "splitByPages" -> {
-                    // Not implemented yet, return false
-                    result.success(false)
+                    val inputFile = call.argument<String>("inputFile")
+                    val pages = call.argument<List<Int>>("pages")
+                    val outputFile = call.argument<String>("outputFile")
+                    val linearize = call.argument<Boolean>("linearize") ?: false
+                    val objectStreams = call.argument<Boolean>("objectStreams") ?: false
+                    val prune = call.argument<Boolean>("prune") ?: false
+                    val subsetFonts = call.argument<Boolean>("subsetFonts") ?: false
+                    
+                    if (inputFile != null && pages != null && pages.isNotEmpty() && outputFile != null) {
+                        try {
+                            val success = withRepairedInputs(listOf(inputFile)) { inputs -> nativeSplitByPages(inputs[0], pages.toIntArray(), outputFile) } &&
+                                rewriteOutputs(listOf(outputFile), linearize, objectStreams, prune, subsetFonts)
+                            result.success(success)
+                        } catch (e: Exception) {
+                            Log.e("SpdfcorePlugin", "Error splitting PDF by pages: ${e.message}")
+                            result.error("SPLIT_ERROR", "Failed to split PDF by pages: ${e.message}", null)
+                        }
+                    } else {
+                        result.error("INVALID_ARGUMENT", "inputFile, pages, and outputFile are required", null)
+                    }
                 }
                 
                 "extractPage" -> {
                     val inputPath = call.argument<String>("inputPath")
                     val pageNumber = call.argument<Int>("pageNumber")
                     val outputPath = call.argument<String>("outputPath")
+                    val linearize = call.argument<Boolean>("linearize") ?: false
+                    val objectStreams = call.argument<Boolean>("objectStreams") ?: false
+                    val prune = call.argument<Boolean>("prune") ?: false
+                    val subsetFonts = call.argument<Boolean>("subsetFonts") ?: false
                     
                     if (inputPath != null && pageNumber != null && outputPath != null) {
                         try {
-                            val success = nativeExtractPage(inputPath, pageNumber, outputPath)
+                            val success = withRepairedInputs(listOf(inputPath)) { inputs -> nativeExtractPage(inputs[0], pageNumber, outputPath) } &&
+                                rewriteOutputs(listOf(outputPath), linearize, objectStreams, prune, subsetFonts)
                             result.success(success)
                         } catch (e: Exception) {
                             Log.e("SpdfcorePlugin", "Error extracting page: ${e.message}")
@@ -230,10 +350,15 @@ class SpdfcorePlugin: FlutterPlugin, MethodCallHandler {
                     val inputPath = call.argument<String>("inputPath")
                     val splitPage = call.argument<Int>("splitPage")
                     val outputPrefix = call.argument<String>("outputPrefix")
+                    val linearize = call.argument<Boolean>("linearize") ?: false
+                    val objectStreams = call.argument<Boolean>("objectStreams") ?: false
+                    val prune = call.argument<Boolean>("prune") ?: false
+                    val subsetFonts = call.argument<Boolean>("subsetFonts") ?: false
                     
                     if (inputPath != null && splitPage != null && outputPrefix != null) {
                         try {
-                            val success = nativeSplitAtPage(inputPath, splitPage, outputPrefix)
+                            val success = withRepairedInputs(listOf(inputPath)) { inputs -> nativeSplitAtPage(inputs[0], splitPage, outputPrefix) } &&
+                                rewriteOutputs(listOf("${outputPrefix}_part1.pdf", "${outputPrefix}_part2.pdf"), linearize, objectStreams, prune, subsetFonts)
                             result.success(success)
                         } catch (e: Exception) {
                             Log.e("SpdfcorePlugin", "Error splitting PDF at page: ${e.message}")
@@ -244,6 +369,239 @@ class SpdfcorePlugin: FlutterPlugin, MethodCallHandler {
                     }
                 }
                 
+                "extractText" -> {
+                    val filePath = call.argument<String>("filePath")
+                    val pageNumber = call.argument<Int>("pageNumber") ?: 0
+                    
+                    if (filePath != null) {
+                        val text = nativeExtractText(filePath, pageNumber)
+                        if (text != null) {
+                            result.success(text)
+                        } else {
+                            result.error("TEXT_ERROR", "Failed to extract text from $filePath", null)
+                        }
+                    } else {
+                        result.error("INVALID_ARGUMENT", "filePath is required", null)
+                    }
+                }
+                
+                "searchText" -> {
+                    val filePaths = call.argument<List<String>>("filePaths")
+                    val query = call.argument<String>("query")
+                    val limit = call.argument<Int>("limit") ?: 20
+                    
+                    if (filePaths != null && query != null) {
+                        val hits = nativeSearchText(filePaths.toTypedArray(), query, limit)
+                        if (hits != null) {
+                            result.success(hits)
+                        } else {
+                            result.error("SEARCH_ERROR", "Failed to search text", null)
+                        }
+                    } else {
+                        result.error("INVALID_ARGUMENT", "filePaths and query are required", null)
+                    }
+                }
+                
+                "isPasswordProtected" -> {
+                    val filePath = call.argument<String>("filePath")
+                    
+                    if (filePath != null) {
+                        when (nativeIsPasswordProtected(filePath)) {
+                            1 -> result.success(true)
+                            0 -> result.success(false)
+                            else -> result.error("FILE_ERROR", "Failed to read $filePath", null)
+                        }
+                    } else {
+                        result.error("INVALID_ARGUMENT", "filePath is required", null)
+                    }
+                }
+                
+                "lockPdf", "unlockPdf" -> {
+                    val inputFile = call.argument<String>("inputFile")
+                    val password = call.argument<String>("password")
+                    val outputFile = call.argument<String>("outputFile")
+                    val linearize = call.argument<Boolean>("linearize") ?: false
+                    val objectStreams = call.argument<Boolean>("objectStreams") ?: false
+                    val locking = call.method == "lockPdf"
+                    
+                    if (inputFile != null && password != null && outputFile != null) {
+                        // 3 is PdfErrorCode_EncryptedPdf: the password did not open the document
+                        when (val code = if (locking) nativeLockPdf(inputFile, password, outputFile, linearize, objectStreams)
+                                         else nativeUnlockPdf(inputFile, password, outputFile, linearize, objectStreams)) {
+                            0 -> result.success(true)
+                            3 -> result.error("WRONG_PASSWORD", "Incorrect password for $inputFile", null)
+                            else -> result.error(if (locking) "LOCK_ERROR" else "UNLOCK_ERROR",
+                                                 "Failed to ${call.method} $inputFile (error $code)", null)
+                        }
+                    } else {
+                        result.error("INVALID_ARGUMENT", "inputFile, password, and outputFile are required", null)
+                    }
+                }
+                
+                "repairPdf" -> {
+                    val inputFile = call.argument<String>("inputFile")
+                    val outputFile = call.argument<String>("outputFile")
+                    
+                    if (inputFile != null && outputFile != null) {
+                        when (val code = nativeRepairPdf(inputFile, outputFile)) {
+                            0 -> result.success(true)
+                            else -> result.error("REPAIR_ERROR", "Failed to repair $inputFile (error $code)", null)
+                        }
+                    } else {
+                        result.error("INVALID_ARGUMENT", "inputFile and outputFile are required", null)
+                    }
+                }
+                
+                "editPages" -> {
+                    val inputFile = call.argument<String>("inputFile")
+                    val outputFile = call.argument<String>("outputFile")
+                    val script = call.argument<String>("script")
+                    
+                    if (inputFile != null && outputFile != null && script != null) {
+                        when (val code = nativeEditPages(inputFile, outputFile, script)) {
+                            0 -> result.success(true)
+                            6 -> result.error("INVALID_ARGUMENT", "Invalid page edit '$script'", null)
+                            else -> result.error("EDIT_ERROR", "Failed to edit pages of $inputFile (error $code)", null)
+                        }
+                    } else {
+                        result.error("INVALID_ARGUMENT", "inputFile, outputFile and script are required", null)
+                    }
+                }
+                
+                "compressPdf" -> {
+                    val inputFile = call.argument<String>("inputFile")
+                    val outputFile = call.argument<String>("outputFile")
+                    val targetDpi = call.argument<Int>("targetDpi") ?: 150
+                    val linearize = call.argument<Boolean>("linearize") ?: false
+                    val objectStreams = call.argument<Boolean>("objectStreams") ?: false
+                    
+                    if (inputFile != null && outputFile != null) {
+                        when (val code = nativeCompressPdf(inputFile, outputFile, targetDpi)) {
+                            0 -> result.success(rewriteOutputs(listOf(outputFile), linearize, objectStreams))
+                            else -> result.error("COMPRESS_ERROR", "Failed to compress $inputFile (error $code)", null)
+                        }
+                    } else {
+                        result.error("INVALID_ARGUMENT", "inputFile and outputFile are required", null)
+                    }
+                }
+                
+                "estimateCompression" -> {
+                    val inputFile = call.argument<String>("inputFile")
+                    val targetDpis = call.argument<List<Int>>("targetDpis") ?: listOf(150)
+                    
+                    if (inputFile != null && targetDpis.isNotEmpty()) {
+                        val estimates = nativeEstimateCompression(inputFile, targetDpis.toIntArray())
+                        if (estimates != null) {
+                            result.success(estimates)
+                        } else {
+                            result.error("ESTIMATE_ERROR", "Failed to estimate the compression of $inputFile", null)
+                        }
+                    } else {
+                        result.error("INVALID_ARGUMENT", "inputFile and at least one target resolution are required", null)
+                    }
+                }
+                
+                "estimateMergeSize" -> {
+                    val inputFiles = call.argument<List<String>>("inputFiles")
+                    
+                    if (inputFiles != null && inputFiles.isNotEmpty()) {
+                        val size = nativeEstimateMergeSize(inputFiles.toTypedArray())
+                        if (size >= 0) {
+                            result.success(size)
+                        } else {
+                            result.error("ESTIMATE_ERROR", "Failed to measure the merge of ${inputFiles.size} files", null)
+                        }
+                    } else {
+                        result.error("INVALID_ARGUMENT", "inputFiles are required", null)
+                    }
+                }
+                
+                "findDuplicatePages" -> {
+                    val inputFiles = call.argument<List<String>>("inputFiles")
+                    val similarity = call.argument<Number>("similarity")?.toDouble() ?: 1.0
+                    
+                    if (inputFiles != null && inputFiles.isNotEmpty()) {
+                        val groups = nativeFindDuplicatePages(inputFiles.toTypedArray(), similarity)
+                        if (groups != null) {
+                            result.success(groups)
+                        } else {
+                            result.error("DUPLICATES_ERROR", "Failed to compare the pages of ${inputFiles.size} files", null)
+                        }
+                    } else {
+                        result.error("INVALID_ARGUMENT", "inputFiles are required", null)
+                    }
+                }
+                
+                "fillForms" -> {
+                    val templateFile = call.argument<String>("templateFile")
+                    val csv = call.argument<String>("csv")
+                    val outputPattern = call.argument<String>("outputPattern")
+                    
+                    if (templateFile != null && csv != null && outputPattern != null) {
+                        when (val code = nativeFillForms(templateFile, csv, outputPattern)) {
+                            0 -> result.success(true)
+                            6 -> result.error("INVALID_ARGUMENT", "Form data does not fit the fields of $templateFile", null)
+                            else -> result.error("FILL_ERROR", "Failed to fill the form of $templateFile (error $code)", null)
+                        }
+                    } else {
+                        result.error("INVALID_ARGUMENT", "templateFile, csv and outputPattern are required", null)
+                    }
+                }
+                
+                "assembleDocuments" -> {
+                    val plan = call.argument<String>("plan")
+                    
+                    if (plan != null) {
+                        result.success(nativeAssembleDocuments(plan) == 0)
+                    } else {
+                        result.error("INVALID_ARGUMENT", "plan is required", null)
+                    }
+                }
+                
+                "configureMemoryBudget" -> {
+                    val maxBytes = call.argument<Number>("maxBytes")?.toLong() ?: 0L
+                    result.success(configureMemoryBudget(maxBytes))
+                }
+                
+                "memoryBudgetStats" -> {
+                    result.success(nativeMemoryBudgetStats())
+                }
+                
+                "openMergeSession" -> {
+                    val maxBytes = call.argument<Number>("maxBytes")?.toLong() ?: 0L
+                    
+                    if (isNativeLibraryLoaded) {
+                        val id = synchronized(mergeSessions) {
+                            val id = nextMergeSessionId++
+                            mergeSessions[id] = nativeOpenMergeSession(maxBytes)
+                            id
+                        }
+                        result.success(id)
+                    } else {
+                        result.error("NATIVE_LIBRARY_UNAVAILABLE", "Native library not loaded, operation not supported", null)
+                    }
+                }
+                
+                "sessionMerge" -> {
+                    val sessionId = call.argument<Int>("sessionId")
+                    val inputFiles = call.argument<List<String>>("inputFiles")
+                    val outputFile = call.argument<String>("outputFile")
+                    val session = sessionId?.let { synchronized(mergeSessions) { mergeSessions[it] } }
+                    
+                    if (session != null && inputFiles != null && outputFile != null) {
+                        result.success(nativeSessionMerge(session, inputFiles.toTypedArray(), outputFile) == 0)
+                    } else {
+                        result.error("INVALID_ARGUMENT", "an open sessionId, inputFiles and outputFile are required", null)
+                    }
+                }
+                
+                "closeMergeSession" -> {
+                    val sessionId = call.argument<Int>("sessionId")
+                    val session = sessionId?.let { synchronized(mergeSessions) { mergeSessions.remove(it) } }
+                    session?.let { nativeCloseMergeSession(it) }
+                    result.success(null)
+                }
+                
                 "getVersion" -> {
                     try {
                         val version = nativeGetVersion()
@@ -326,8 +684,76 @@ class SpdfcorePlugin: FlutterPlugin, MethodCallHandler {
         }
     }
     
+    // Runs a core operation; if it fails, retries once on copies of the inputs rebuilt by the native
+    // recovery scan, for damaged files such as interrupted downloads
+    private fun withRepairedInputs(inputs: List<String>, operation: (List<String>) -> Boolean): Boolean {
+        if (operation(inputs)) {
+            return true
+        }
+        val repaired = inputs.map { input ->
+            val copy = java.io.File.createTempFile("repaired", ".pdf", context.cacheDir)
+            if (nativeRepairPdf(input, copy.absolutePath) == 0) copy else null.also { copy.delete() }
+        }
+        try {
+            if (repaired.any { it == null }) {
+                return false
+            }
+            Log.i("SpdfcorePlugin", "Retrying with repaired copies of $inputs")
+            return operation(repaired.map { it!!.absolutePath })
+        } finally {
+            repaired.forEach { it?.delete() }
+        }
+    }
+    
+    // Rewrites finished outputs in place in the linearized (fast web view) layout, with object streams,
+    // pruned of the objects and resources their pages do not use or with fonts cut down to the glyphs shown
+    private fun rewriteOutputs(outputs: List<String>, linearize: Boolean, objectStreams: Boolean, prune: Boolean = false,
+                               subsetFonts: Boolean = false): Boolean {
+        if (!linearize && !objectStreams && !prune && !subsetFonts) {
+            return true
+        }
+        return outputs.all { output ->
+            val code = nativeRewritePdf(output, output, linearize, objectStreams, prune, subsetFonts)
+            if (code != 0) {
+                Log.e("SpdfcorePlugin", "Failed to rewrite $output (error $code)")
+            }
+            code == 0
+        }
+    }
+    
+    // Budget on devices with little RAM, 0 (none) elsewhere
+    private fun defaultMemoryBudget(): Long {
+        val activityManager = context.getSystemService(android.content.Context.ACTIVITY_SERVICE) as android.app.ActivityManager
+        val memoryInfo = android.app.ActivityManager.MemoryInfo()
+        activityManager.getMemoryInfo(memoryInfo)
+        return if (activityManager.isLowRamDevice || memoryInfo.totalMem <= LOW_MEMORY_DEVICE_BYTES) {
+            memoryInfo.totalMem / MEMORY_BUDGET_DIVISOR
+        } else {
+            0L
+        }
+    }
+    
+    // Native memory budget, spilling to the app's cache directory; maxBytes <= 0 removes it
+    private fun configureMemoryBudget(maxBytes: Long): Boolean {
+        val spillDir = java.io.File(context.cacheDir, SPILL_DIR)
+        spillDir.mkdirs()
+        val configured = nativeConfigureMemoryBudget(spillDir.absolutePath, maxBytes)
+        if (!configured) {
+            Log.w("SpdfcorePlugin", "Memory budget unavailable: cannot spill to $spillDir")
+        }
+        return configured
+    }
+    
     override fun onDetachedFromEngine(binding: FlutterPlugin.FlutterPluginBinding) {
         channel.setMethodCallHandler(null)
-        // No cleanup needed for current implementation
+        queryExecutor.shutdown()
+        // After the bulk calls already queued, which may still be using the sessions
+        bulkExecutor.execute {
+            synchronized(mergeSessions) {
+                mergeSessions.values.forEach { nativeCloseMergeSession(it) }
+                mergeSessions.clear()
+            }
+        }
+        bulkExecutor.shutdown()
     }
 }
\ No newline at end of file
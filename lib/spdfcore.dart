@@ -1,4 +1,5 @@
 import 'dart:async';
+import 'dart:convert';
 import 'dart:io';
 import 'package:flutter/services.dart';
 
@@ -47,35 +48,60 @@ class Spdfcore {
   }
   
   /// Merge multiple PDF files into one
+  /// [linearize] writes the output for fast web view (page 1 opens before the rest is read)
+  /// [objectStreams] writes a smaller PDF 1.5 file with compressed object and cross-reference streams
+  /// [parallel] merges natively on every core: the inputs are measured first, then written side by side
+  /// at their final offsets, which is much faster for many large inputs. Outlines and forms are not kept.
+  /// [subsetFonts] cuts embedded fonts down to the glyphs the pages show and keeps one copy of a font
+  /// that several inputs embed
+  /// [skipDuplicatePages] merges natively and keeps only the first of pages that repeat within or
+  /// across the inputs (see findDuplicatePages). Outlines, forms and document info are not kept.
   /// Returns true if merge successful
-  static Future<bool> mergeFiles(List<String> inputFiles, String outputFile) async {
+  static Future<bool> mergeFiles(List<String> inputFiles, String outputFile, {bool linearize = false, bool objectStreams = false, bool parallel = false, bool subsetFonts = false, bool skipDuplicatePages = false}) async {
     final bool result = await _channel.invokeMethod('mergeFiles', {
       'inputFiles': inputFiles,
       'outputFile': outputFile,
+      'linearize': linearize,
+      'objectStreams': objectStreams,
+      'parallel': parallel,
+      'subsetFonts': subsetFonts,
+      'skipDuplicatePages': skipDuplicatePages,
     });
     return result;
   }
   
   /// Split PDF by extracting specific pages
   /// [pages] should contain 1-based page numbers
+  /// [prune] drops the objects and resources of the input the kept pages do not use
+  /// [subsetFonts] cuts embedded fonts down to the glyphs the kept pages show
   /// Returns true if split successful
-  static Future<bool> splitByPages(String inputFile, List<int> pages, String outputFile) async {
+  static Future<bool> splitByPages(String inputFile, List<int> pages, String outputFile, {bool linearize = false, bool objectStreams = false, bool prune = false, bool subsetFonts = false}) async {
     final bool result = await _channel.invokeMethod('splitByPages', {
       'inputFile': inputFile,
       'pages': pages,
       'outputFile': outputFile,
+      'linearize': linearize,
+      'objectStreams': objectStreams,
+      'prune': prune,
+      'subsetFonts': subsetFonts,
     });
     return result;
   }
   
   /// Extract a single page from PDF
   /// [pageNumber] should be 1-based
+  /// [prune] drops the objects and resources of the input the kept pages do not use
+  /// [subsetFonts] cuts embedded fonts down to the glyphs the kept pages show
   /// Returns true if extraction successful
-  static Future<bool> extractPage(String inputFile, int pageNumber, String outputFile) async {
+  static Future<bool> extractPage(String inputFile, int pageNumber, String outputFile, {bool linearize = false, bool objectStreams = false, bool prune = false, bool subsetFonts = false}) async {
     final bool result = await _channel.invokeMethod('extractPage', {
       'inputPath': inputFile,
       'pageNumber': pageNumber,
       'outputPath': outputFile,
+      'linearize': linearize,
+      'objectStreams': objectStreams,
+      'prune': prune,
+      'subsetFonts': subsetFonts,
     });
     return result;
   }
@@ -83,16 +109,220 @@ class Spdfcore {
   /// Split PDF at a specific page number
   /// Creates two files: outputPrefix_part1.pdf and outputPrefix_part2.pdf
   /// [splitPage] is 1-based - pages 1 to splitPage go to part1, rest to part2
+  /// [prune] drops the objects and resources of the input the kept pages do not use
+  /// [subsetFonts] cuts embedded fonts down to the glyphs the kept pages show
   /// Returns true if split successful
-  static Future<bool> splitAtPage(String inputFile, int splitPage, String outputPrefix) async {
+  static Future<bool> splitAtPage(String inputFile, int splitPage, String outputPrefix, {bool linearize = false, bool objectStreams = false, bool prune = false, bool subsetFonts = false}) async {
     final bool result = await _channel.invokeMethod('splitAtPage', {
       'inputPath': inputFile,
       'splitPage': splitPage,
       'outputPrefix': outputPrefix,
+      'linearize': linearize,
+      'objectStreams': objectStreams,
+      'prune': prune,
+      'subsetFonts': subsetFonts,
     });
     return result;
   }
   
+  /// Extract the text of a PDF
+  /// [pageNumber] is 1-based; 0 returns every page, separated by form feeds
+  static Future<String> extractText(String filePath, {int pageNumber = 0}) async {
+    final String result = await _channel.invokeMethod('extractText', {
+      'filePath': filePath,
+      'pageNumber': pageNumber,
+    });
+    return result;
+  }
+  
+  /// Search the text of [filePaths] for pages containing every word of [query]
+  /// A trailing '*' matches a word prefix. Files are indexed on first use and
+  /// re-indexed when they change, so repeated searches do not re-parse them.
+  static Future<List<TextSearchHit>> searchText(List<String> filePaths, String query, {int limit = 20}) async {
+    final String result = await _channel.invokeMethod('searchText', {
+      'filePaths': filePaths,
+      'query': query,
+      'limit': limit,
+    });
+    final List<dynamic> hits = jsonDecode(result) as List<dynamic>;
+    return hits.map((hit) => TextSearchHit.fromMap(Map<String, dynamic>.from(hit as Map))).toList();
+  }
+  
+  /// Whether [filePath] is encrypted; only the file's trailer is read
+  static Future<bool> isPasswordProtected(String filePath) async {
+    final bool result = await _channel.invokeMethod('isPasswordProtected', {
+      'filePath': filePath,
+    });
+    return result;
+  }
+  
+  /// Encrypt a PDF with AES-256, using [password] as user and owner password
+  /// Returns true if the locked copy was written
+  static Future<bool> lockPdf(String inputFile, String password, String outputFile, {bool linearize = false, bool objectStreams = false}) async {
+    final bool result = await _channel.invokeMethod('lockPdf', {
+      'inputFile': inputFile,
+      'password': password,
+      'outputFile': outputFile,
+      'linearize': linearize,
+      'objectStreams': objectStreams,
+    });
+    return result;
+  }
+  
+  /// Write a decrypted copy of a password protected PDF
+  /// Throws a PlatformException with code WRONG_PASSWORD if [password] does not open it
+  static Future<bool> unlockPdf(String inputFile, String password, String outputFile, {bool linearize = false, bool objectStreams = false}) async {
+    final bool result = await _channel.invokeMethod('unlockPdf', {
+      'inputFile': inputFile,
+      'password': password,
+      'outputFile': outputFile,
+      'linearize': linearize,
+      'objectStreams': objectStreams,
+    });
+    return result;
+  }
+  
+  /// Write a rebuilt copy of a damaged PDF (truncated download, broken
+  /// cross-reference table or page tree) that other tools can open.
+  /// mergeFiles, extractPage and splitAtPage already retry with repaired
+  /// copies when an input is damaged.
+  static Future<bool> repairPdf(String inputFile, String outputFile) async {
+    final bool result = await _channel.invokeMethod('repairPdf', {
+      'inputFile': inputFile,
+      'outputFile': outputFile,
+    });
+    return result;
+  }
+  
+  /// Reorder, rotate and delete pages without rewriting the file: the
+  /// original bytes are kept and a new page tree is appended to them.
+  /// Page numbers refer to [inputFile]. [order] lists pages in their new
+  /// order (pages left out follow in their original order), [rotate] maps a
+  /// page to the clockwise degrees (a multiple of 90) added to its rotation
+  /// and [delete] lists pages to drop.
+  static Future<bool> editPages(String inputFile, String outputFile, {List<int> order = const [], Map<int, int> rotate = const {}, List<int> delete = const []}) async {
+    final statements = <String>[
+      if (order.isNotEmpty) 'order ${order.join(',')}',
+      for (final entry in rotate.entries) 'rotate ${entry.value} ${entry.key}',
+      if (delete.isNotEmpty) 'delete ${delete.join(',')}',
+    ];
+    final bool result = await _channel.invokeMethod('editPages', {
+      'inputFile': inputFile,
+      'outputFile': outputFile,
+      'script': statements.join('; '),
+    });
+    return result;
+  }
+  
+  /// Shrink a PDF by downsampling its images to [targetDpi] at the largest
+  /// size each one is shown on a page, re-encoded as JPEG at the lowest
+  /// quality that still looks the same. Scanned black-and-white pages
+  /// become 1-bit CCITT G4 images. Text and vector content is kept.
+  static Future<bool> compressPdf(String inputFile, String outputFile, {int targetDpi = 150, bool linearize = false, bool objectStreams = false}) async {
+    final bool result = await _channel.invokeMethod('compressPdf', {
+      'inputFile': inputFile,
+      'outputFile': outputFile,
+      'targetDpi': targetDpi,
+      'linearize': linearize,
+      'objectStreams': objectStreams,
+    });
+    return result;
+  }
+  
+  /// Predict what compressPdf would write for each of [targetDpis] without
+  /// writing anything. Text and vector content is measured exactly; a sample
+  /// of the images is recompressed and the rest extrapolated, so each
+  /// estimate comes with a likely range.
+  static Future<List<CompressionEstimate>> estimateCompression(String inputFile, {List<int> targetDpis = const [72, 150, 300]}) async {
+    final String result = await _channel.invokeMethod('estimateCompression', {
+      'inputFile': inputFile,
+      'targetDpis': targetDpis,
+    });
+    final List<dynamic> estimates = jsonDecode(result) as List<dynamic>;
+    return estimates.map((estimate) => CompressionEstimate.fromMap(Map<String, dynamic>.from(estimate as Map))).toList();
+  }
+  
+  /// Size in bytes of the file mergeFiles would write for [inputFiles] with
+  /// parallel set, found without writing it
+  static Future<int> estimateMergeSize(List<String> inputFiles) async {
+    final int result = await _channel.invokeMethod('estimateMergeSize', {
+      'inputFiles': inputFiles,
+    });
+    return result;
+  }
+  
+  /// Pages that repeat within or across [inputFiles], such as re-exported
+  /// drafts or attachments included twice, in one pass over all of them.
+  /// Pages match when their content and the fonts and images it uses are
+  /// the same, however the files store them. A [similarity] below 1 (e.g.
+  /// 0.9) also matches pages that differ in a few places. Each group lists
+  /// the page mergeFiles with skipDuplicatePages keeps first; blank pages
+  /// are never grouped.
+  static Future<List<List<PageLocation>>> findDuplicatePages(List<String> inputFiles, {double similarity = 1.0}) async {
+    final String result = await _channel.invokeMethod('findDuplicatePages', {
+      'inputFiles': inputFiles,
+      'similarity': similarity,
+    });
+    final List<dynamic> groups = jsonDecode(result) as List<dynamic>;
+    return groups.map((group) => (group as List<dynamic>).map((page) {
+      final map = Map<String, dynamic>.from(page as Map);
+      return PageLocation(inputFiles[map['input'] as int], map['page'] as int);
+    }).toList()).toList();
+  }
+  
+  /// Write many documents at once, each assembled from pages of a few
+  /// sources, in place of a split and a merge per document. Each source is
+  /// opened once for the whole batch and the outputs are written side by
+  /// side. Outlines, forms and document info are not kept.
+  /// Returns true if every output was written
+  static Future<bool> assembleDocuments(List<AssemblyOutput> outputs) async {
+    final bool result = await _channel.invokeMethod('assembleDocuments', {
+      'plan': outputs.map((output) => output._planLine()).join('\n'),
+    });
+    return result;
+  }
+  
+  /// Fill the form of [templateFile] once per entry of [rows], each mapping
+  /// field names ("address.city" for nested fields) to values, and write
+  /// copy N to [outputPattern] with "{row}" replaced by N (and "{field}" by
+  /// that field's value). The template is parsed once and each copy is its
+  /// bytes followed by the changed fields, so large batches are written at
+  /// storage speed. Check boxes take "yes"/"no" or a state name; fields a
+  /// row leaves out keep the template's value.
+  /// Returns true if every copy was written
+  static Future<bool> fillForms(String templateFile, List<Map<String, String>> rows, String outputPattern) async {
+    final fields = <String>{for (final row in rows) ...row.keys}.toList();
+    String cell(String value) => value.contains(RegExp('[",\r\n]')) ? '"${value.replaceAll('"', '""')}"' : value;
+    final csv = [
+      fields.map(cell).join(','),
+      for (final row in rows) fields.map((field) => cell(row[field] ?? '')).join(','),
+    ].join('\n');
+    final bool result = await _channel.invokeMethod('fillForms', {
+      'templateFile': templateFile,
+      'csv': csv,
+      'outputPattern': outputPattern,
+    });
+    return result;
+  }
+  
+  /// Cap the memory native operations hold at once to [maxBytes]; 0
+  /// removes the cap. Near the cap operations wait for each other and move
+  /// what they keep to files in the app's cache directory, so they get
+  /// slower instead of running out of memory. Devices with 4 GB of RAM or
+  /// less get an eighth of it by default.
+  static Future<bool> configureMemoryBudget(int maxBytes) async {
+    final bool result = await _channel.invokeMethod('configureMemoryBudget', {
+      'maxBytes': maxBytes,
+    });
+    return result;
+  }
+  
+  /// What native operations hold against the memory budget now and at most
+  static Future<MemoryBudgetStats> memoryBudgetStats() async {
+    final String result = await _channel.invokeMethod('memoryBudgetStats');
+    return MemoryBudgetStats.fromMap(Map<String, dynamic>.from(jsonDecode(result) as Map));
+  }
+  
   /// Get the library version
   static Future<String> getVersion() async {
     final String result = await _channel.invokeMethod('getVersion');
@@ -118,6 +348,74 @@ class Spdfcore {
   }
 }
 
+/// Pages of one source of an assembled document
+class AssemblyPart {
+  final String source;
+  /// 1-based page numbers in order; empty takes every page
+  final List<int> pages;
+  
+  const AssemblyPart(this.source, [this.pages = const []]);
+}
+
+/// One document written by Spdfcore.assembleDocuments
+class AssemblyOutput {
+  final String path;
+  final List<AssemblyPart> parts;
+  
+  const AssemblyOutput(this.path, this.parts);
+  
+  // One line of the native plan: quoted OUTPUT then SOURCE[:PAGES] tokens
+  String _planLine() {
+    String quote(String token) {
+      if (token.contains('"') || token.contains('\n')) {
+        throw ArgumentError.value(token, 'path', 'must not contain quotes or line breaks');
+      }
+      return '"$token"';
+    }
+    final tokens = [
+      quote(path),
+      for (final part in parts) quote(part.pages.isEmpty ? part.source : '${part.source}:${part.pages.join(',')}'),
+    ];
+    return tokens.join(' ');
+  }
+}
+
+/// Merges that keep their inputs parsed between calls, for merging the same
+/// cover and terms pages with many different bodies. An input merged before
+/// is not parsed or read again unless its file changed. Merges work like
+/// mergeFiles with parallel set. Call [close] to release the memory held.
+class MergeSession {
+  final int _id;
+  
+  MergeSession._(this._id);
+  
+  /// Open a session keeping up to [maxBytes] of inputs (0 uses the default of 64 MB)
+  static Future<MergeSession> open({int maxBytes = 0}) async {
+    final int id = await Spdfcore._channel.invokeMethod('openMergeSession', {
+      'maxBytes': maxBytes,
+    });
+    return MergeSession._(id);
+  }
+  
+  /// Merge [inputFiles] into [outputFile]
+  /// Returns true if merge successful
+  Future<bool> merge(List<String> inputFiles, String outputFile) async {
+    final bool result = await Spdfcore._channel.invokeMethod('sessionMerge', {
+      'sessionId': _id,
+      'inputFiles': inputFiles,
+      'outputFile': outputFile,
+    });
+    return result;
+  }
+  
+  /// Release the session; it cannot be used afterwards
+  Future<void> close() async {
+    await Spdfcore._channel.invokeMethod('closeMergeSession', {
+      'sessionId': _id,
+    });
+  }
+}
+
 /// Data class for PDF information
 class PdfInfo {
   final int pageCount;
@@ -174,6 +472,112 @@ class PdfInfo {
   }
 }
 
+/// One page matching a text search
+class TextSearchHit {
+  final String filePath;
+  final int pageNumber;
+  final int score;
+  
+  const TextSearchHit({
+    required this.filePath,
+    required this.pageNumber,
+    required this.score,
+  });
+  
+  factory TextSearchHit.fromMap(Map<String, dynamic> map) {
+    return TextSearchHit(
+      filePath: map['path'] as String,
+      pageNumber: map['page'] as int,
+      score: map['score'] as int,
+    );
+  }
+  
+  @override
+  String toString() {
+    return 'TextSearchHit(filePath: $filePath, pageNumber: $pageNumber, score: $score)';
+  }
+}
+
+/// State of the native memory budget, see Spdfcore.configureMemoryBudget
+class MemoryBudgetStats {
+  final int limit;        // bytes; 0 when there is no budget
+  final int held;         // bytes held now
+  final int peak;         // most bytes held at once
+  final int waits;        // operations that waited for memory
+  final int overcommits;  // operations that went ahead over the budget
+  final int spilled;      // bytes moved to spill files
+  
+  const MemoryBudgetStats({
+    required this.limit,
+    required this.held,
+    required this.peak,
+    required this.waits,
+    required this.overcommits,
+    required this.spilled,
+  });
+  
+  factory MemoryBudgetStats.fromMap(Map<String, dynamic> map) {
+    return MemoryBudgetStats(
+      limit: map['limit'] as int,
+      held: map['held'] as int,
+      peak: map['peak'] as int,
+      waits: map['waits'] as int,
+      overcommits: map['overcommits'] as int,
+      spilled: map['spilled'] as int,
+    );
+  }
+}
+
+/// Predicted output of compressPdf at one target resolution
+class CompressionEstimate {
+  final int targetDpi;
+  final int bytes;
+  final int low;
+  final int high;
+  final int images;
+  final int sampledImages;
+  final int unreadableImages;  // of the sampled, those that could not be decoded and stay as they are
+  
+  const CompressionEstimate({
+    required this.targetDpi,
+    required this.bytes,
+    required this.low,
+    required this.high,
+    required this.images,
+    required this.sampledImages,
+    required this.unreadableImages,
+  });
+  
+  factory CompressionEstimate.fromMap(Map<String, dynamic> map) {
+    return CompressionEstimate(
+      targetDpi: map['targetDpi'] as int,
+      bytes: map['bytes'] as int,
+      low: map['low'] as int,
+      high: map['high'] as int,
+      images: map['images'] as int,
+      sampledImages: map['sampled'] as int,
+      unreadableImages: map['unreadable'] as int,
+    );
+  }
+  
+  @override
+  String toString() {
+    return 'CompressionEstimate(targetDpi: $targetDpi, bytes: $bytes, low: $low, high: $high, images: $images, sampledImages: $sampledImages, unreadableImages: $unreadableImages)';
+  }
+}
+
+/// One page of a set of files
+class PageLocation {
+  final String file;
+  /// 1-based
+  final int page;
+  
+  const PageLocation(this.file, this.page);
+  
+  @override
+  String toString() => 'PageLocation($file, page $page)';
+}
+
 /// Exception thrown when PDF operations fail
 class PdfException implements Exception {
   final String message;
@@ -202,9 +606,9 @@ class SafeSpdfcore {
   }
   
   /// Safe version of mergeFiles that returns a Result
-  static Future<Result<String, PdfException>> mergeFiles(List<String> inputFiles, String outputFile) async {
+  static Future<Result<String, PdfException>> mergeFiles(List<String> inputFiles, String outputFile, {bool linearize = false, bool objectStreams = false, bool parallel = false, bool subsetFonts = false, bool skipDuplicatePages = false}) async {
     try {
-      final success = await Spdfcore.mergeFiles(inputFiles, outputFile);
+      final success = await Spdfcore.mergeFiles(inputFiles, outputFile, linearize: linearize, objectStreams: objectStreams, parallel: parallel, subsetFonts: subsetFonts, skipDuplicatePages: skipDuplicatePages);
       if (success) {
         return Result.success(outputFile);
       } else {
@@ -216,9 +620,9 @@ class SafeSpdfcore {
   }
   
   /// Safe version of splitByPages that returns a Result
-  static Future<Result<String, PdfException>> splitByPages(String inputFile, List<int> pages, String outputFile) async {
+  static Future<Result<String, PdfException>> splitByPages(String inputFile, List<int> pages, String outputFile, {bool linearize = false, bool objectStreams = false, bool prune = false, bool subsetFonts = false}) async {
     try {
-      final success = await Spdfcore.splitByPages(inputFile, pages, outputFile);
+      final success = await Spdfcore.splitByPages(inputFile, pages, outputFile, linearize: linearize, objectStreams: objectStreams, prune: prune, subsetFonts: subsetFonts);
       if (success) {
         return Result.success(outputFile);
       } else {
@@ -230,9 +634,9 @@ class SafeSpdfcore {
   }
   
   /// Safe version of extractPage that returns a Result
-  static Future<Result<String, PdfException>> extractPage(String inputFile, int pageNumber, String outputFile) async {
+  static Future<Result<String, PdfException>> extractPage(String inputFile, int pageNumber, String outputFile, {bool linearize = false, bool objectStreams = false, bool prune = false, bool subsetFonts = false}) async {
     try {
-      final success = await Spdfcore.extractPage(inputFile, pageNumber, outputFile);
+      final success = await Spdfcore.extractPage(inputFile, pageNumber, outputFile, linearize: linearize, objectStreams: objectStreams, prune: prune, subsetFonts: subsetFonts);
       if (success) {
         return Result.success(outputFile);
       } else {
@@ -243,10 +647,38 @@ class SafeSpdfcore {
     }
   }
   
+  /// Safe version of editPages that returns a Result
+  static Future<Result<String, PdfException>> editPages(String inputFile, String outputFile, {List<int> order = const [], Map<int, int> rotate = const {}, List<int> delete = const []}) async {
+    try {
+      final success = await Spdfcore.editPages(inputFile, outputFile, order: order, rotate: rotate, delete: delete);
+      if (success) {
+        return Result.success(outputFile);
+      } else {
+        return Result.failure(PdfException('Failed to edit pages'));
+      }
+    } catch (e) {
+      return Result.failure(PdfException('Exception: $e'));
+    }
+  }
+  
+  /// Safe version of compressPdf that returns a Result
+  static Future<Result<String, PdfException>> compressPdf(String inputFile, String outputFile, {int targetDpi = 150, bool linearize = false, bool objectStreams = false}) async {
+    try {
+      final success = await Spdfcore.compressPdf(inputFile, outputFile, targetDpi: targetDpi, linearize: linearize, objectStreams: objectStreams);
+      if (success) {
+        return Result.success(outputFile);
+      } else {
+        return Result.failure(PdfException('Failed to compress PDF'));
+      }
+    } catch (e) {
+      return Result.failure(PdfException('Exception: $e'));
+    }
+  }
+  
   /// Safe version of splitAtPage that returns a Result
-  static Future<Result<String, PdfException>> splitAtPage(String inputFile, int splitPage, String outputPrefix) async {
+  static Future<Result<String, PdfException>> splitAtPage(String inputFile, int splitPage, String outputPrefix, {bool linearize = false, bool objectStreams = false, bool prune = false, bool subsetFonts = false}) async {
     try {
-      final success = await Spdfcore.splitAtPage(inputFile, splitPage, outputPrefix);
+      final success = await Spdfcore.splitAtPage(inputFile, splitPage, outputPrefix, linearize: linearize, objectStreams: objectStreams, prune: prune, subsetFonts: subsetFonts);
       if (success) {
         return Result.success('$outputPrefix (creates _part1.pdf and _part2.pdf)');
       } else {
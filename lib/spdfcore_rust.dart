@@ -1,6 +1,7 @@
 // lib/spdfcore_rust.dart
 import 'bridge_generated.dart/ffi.dart' as bridge;
 import 'dart:io';
+import 'spdfcore.dart';
 
 /// Dart wrapper for the Rust PDF library (via flutter_rust_bridge)
 class SpdfcoreRust {
@@ -59,11 +60,9 @@ class SpdfcoreRust {
     ];
   }
 
-  /// Compress PDF (placeholder - currently just copies the file)
+  /// Compress PDF by downsampling its images in the native core
   Future<String> compressPdf(String inputFile, String outputFile) async {
-    // For now, just copy the file as compression might not be implemented in Rust yet
-    final input = File(inputFile);
-    await input.copy(outputFile);
+    await Spdfcore.compressPdf(inputFile, outputFile);
     return outputFile;
   }
 
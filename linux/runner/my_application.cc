@@ -6,6 +6,7 @@
 #endif
 
 #include "flutter/generated_plugin_registrant.h"
+#include "spdfcore_plugin.h"
 
 struct _MyApplication {
   GtkApplication parent_instance;
@@ -72,6 +73,10 @@ static void my_application_activate(GApplication* application) {
   gtk_widget_realize(GTK_WIDGET(view));
 
   fl_register_plugins(FL_PLUGIN_REGISTRY(view));
+  g_autoptr(FlPluginRegistrar) spdfcore_registrar =
+      fl_plugin_registry_get_registrar_for_plugin(FL_PLUGIN_REGISTRY(view),
+                                                  "SpdfcorePlugin");
+  spdfcore_plugin_register_with_registrar(spdfcore_registrar);
 
   gtk_widget_grab_focus(GTK_WIDGET(view));
 }
@@ -0,0 +1,484 @@
+#include "spdfcore_plugin.h"
+
+#include <dlfcn.h>
+
+#include <algorithm>
+#include <condition_variable>
+#include <cstring>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "spdfcore.h"
+
+namespace {
+
+constexpr char kChannelName[] = "spdfcore";
+constexpr char kLibraryName[] = "libspdfcore_ffi.so";
+
+// Entry points resolved from libspdfcore_ffi.so. The first group is required,
+// the rest may be missing from older builds of the core and are checked per
+// call, matching spdfcore_jni.cpp.
+struct SpdfcoreApi {
+  void* handle = nullptr;
+  decltype(&pdf_get_page_count) get_page_count = nullptr;
+  decltype(&pdf_validate) validate = nullptr;
+  decltype(&pdf_merge_files) merge_files = nullptr;
+  decltype(&free_c_string) free_string = nullptr;
+
+  decltype(&pdf_get_file_size) get_file_size = nullptr;
+  decltype(&pdf_split_by_pages) split_by_pages = nullptr;
+  decltype(&pdf_extract_page) extract_page = nullptr;
+  decltype(&pdf_split_at_page) split_at_page = nullptr;
+  decltype(&spdfcore_version) version = nullptr;
+};
+
+template <typename T>
+void resolve(void* handle, const char* name, T* out) {
+  *out = reinterpret_cast<T>(dlsym(handle, name));
+}
+
+bool load_api(SpdfcoreApi* api) {
+  if (api->handle != nullptr) {
+    return true;
+  }
+  void* handle = dlopen(kLibraryName, RTLD_LAZY);
+  if (handle == nullptr) {
+    g_warning("Cannot load %s: %s", kLibraryName, dlerror());
+    return false;
+  }
+  resolve(handle, "pdf_get_page_count", &api->get_page_count);
+  resolve(handle, "pdf_validate", &api->validate);
+  resolve(handle, "pdf_merge_files", &api->merge_files);
+  resolve(handle, "free_c_string", &api->free_string);
+  if (api->get_page_count == nullptr || api->validate == nullptr ||
+      api->merge_files == nullptr || api->free_string == nullptr) {
+    g_warning("%s is missing required symbols", kLibraryName);
+    dlclose(handle);
+    *api = SpdfcoreApi();
+    return false;
+  }
+  resolve(handle, "pdf_get_file_size", &api->get_file_size);
+  resolve(handle, "pdf_split_by_pages", &api->split_by_pages);
+  resolve(handle, "pdf_extract_page", &api->extract_page);
+  resolve(handle, "pdf_split_at_page", &api->split_at_page);
+  resolve(handle, "spdfcore_version", &api->version);
+  api->handle = handle;
+  return true;
+}
+
+// Runs one C ABI call and releases its error message. Returns true only when
+// the call succeeded and reported PdfErrorCode_Success.
+template <typename Call>
+bool invoke(const SpdfcoreApi& api, Call call) {
+  PdfErrorCode error_code = PdfErrorCode_Success;
+  char* error_message = nullptr;
+  bool result = call(&error_code, &error_message);
+  if (error_message != nullptr) {
+    g_debug("spdfcore error %d: %s", error_code, error_message);
+    api.free_string(error_message);
+  }
+  return result && error_code == PdfErrorCode_Success;
+}
+
+// Fixed-size pool that runs method calls off the platform thread. Queued
+// tasks still run on shutdown so every pending call gets a response.
+class WorkerPool {
+ public:
+  explicit WorkerPool(size_t thread_count) {
+    for (size_t i = 0; i < thread_count; i++) {
+      threads_.emplace_back([this]() { Run(); });
+    }
+  }
+
+  ~WorkerPool() {
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      stopping_ = true;
+    }
+    ready_.notify_all();
+    for (auto& thread : threads_) {
+      thread.join();
+    }
+  }
+
+  void Post(std::function<void()> task) {
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      tasks_.push_back(std::move(task));
+    }
+    ready_.notify_one();
+  }
+
+ private:
+  void Run() {
+    for (;;) {
+      std::function<void()> task;
+      {
+        std::unique_lock<std::mutex> lock(mutex_);
+        ready_.wait(lock, [this]() { return stopping_ || !tasks_.empty(); });
+        if (tasks_.empty()) {
+          return;
+        }
+        task = std::move(tasks_.front());
+        tasks_.pop_front();
+      }
+      task();
+    }
+  }
+
+  std::vector<std::thread> threads_;
+  std::deque<std::function<void()>> tasks_;
+  std::mutex mutex_;
+  std::condition_variable ready_;
+  bool stopping_ = false;
+};
+
+struct PendingResponse {
+  FlMethodCall* method_call;
+  FlMethodResponse* response;
+};
+
+// Delivers a worker's result on the platform thread, where the engine
+// expects method call responses.
+gboolean deliver_response(gpointer user_data) {
+  PendingResponse* pending = static_cast<PendingResponse*>(user_data);
+  g_autoptr(GError) error = nullptr;
+  if (!fl_method_call_respond(pending->method_call, pending->response,
+                              &error)) {
+    g_warning("Failed to send spdfcore response: %s", error->message);
+  }
+  g_object_unref(pending->method_call);
+  g_object_unref(pending->response);
+  delete pending;
+  return G_SOURCE_REMOVE;
+}
+
+FlMethodResponse* success_response(FlValue* value) {
+  g_autoptr(FlValue) result = value;
+  return FL_METHOD_RESPONSE(fl_method_success_response_new(result));
+}
+
+void respond_argument_error(FlMethodCall* method_call, const char* message) {
+  fl_method_call_respond_error(method_call, "INVALID_ARGUMENT", message,
+                               nullptr, nullptr);
+}
+
+void respond_value(FlMethodCall* method_call, FlValue* value) {
+  g_autoptr(FlValue) result = value;
+  fl_method_call_respond_success(method_call, result, nullptr);
+}
+
+bool lookup_string(FlValue* args, const char* key, std::string* out) {
+  if (args == nullptr || fl_value_get_type(args) != FL_VALUE_TYPE_MAP) {
+    return false;
+  }
+  FlValue* value = fl_value_lookup_string(args, key);
+  if (value == nullptr || fl_value_get_type(value) != FL_VALUE_TYPE_STRING) {
+    return false;
+  }
+  *out = fl_value_get_string(value);
+  return true;
+}
+
+bool lookup_int(FlValue* args, const char* key, int64_t* out) {
+  if (args == nullptr || fl_value_get_type(args) != FL_VALUE_TYPE_MAP) {
+    return false;
+  }
+  FlValue* value = fl_value_lookup_string(args, key);
+  if (value == nullptr || fl_value_get_type(value) != FL_VALUE_TYPE_INT) {
+    return false;
+  }
+  *out = fl_value_get_int(value);
+  return true;
+}
+
+bool lookup_list(FlValue* args, const char* key, FlValueType element_type,
+                 FlValue** out) {
+  if (args == nullptr || fl_value_get_type(args) != FL_VALUE_TYPE_MAP) {
+    return false;
+  }
+  FlValue* value = fl_value_lookup_string(args, key);
+  if (value == nullptr || fl_value_get_type(value) != FL_VALUE_TYPE_LIST) {
+    return false;
+  }
+  for (size_t i = 0; i < fl_value_get_length(value); i++) {
+    if (fl_value_get_type(fl_value_get_list_value(value, i)) != element_type) {
+      return false;
+    }
+  }
+  *out = value;
+  return true;
+}
+
+int64_t page_count(const SpdfcoreApi& api, const std::string& path) {
+  int32_t pages = 0;
+  bool ok = invoke(api, [&](PdfErrorCode* code, char** message) {
+    return api.get_page_count(path.c_str(), &pages, code, message);
+  });
+  return ok ? pages : -1;
+}
+
+int64_t file_size(const SpdfcoreApi& api, const std::string& path) {
+  if (api.get_file_size == nullptr) {
+    return -1;
+  }
+  uint64_t size = 0;
+  bool ok = invoke(api, [&](PdfErrorCode* code, char** message) {
+    return api.get_file_size(path.c_str(), &size, code, message);
+  });
+  return ok ? static_cast<int64_t>(size) : -1;
+}
+
+bool validate(const SpdfcoreApi& api, const std::string& path) {
+  bool is_valid = false;
+  bool ok = invoke(api, [&](PdfErrorCode* code, char** message) {
+    return api.validate(path.c_str(), &is_valid, code, message);
+  });
+  return ok && is_valid;
+}
+
+}  // namespace
+
+struct _SpdfcorePlugin {
+  GObject parent_instance;
+
+  FlMethodChannel* channel;
+  SpdfcoreApi* api;
+  WorkerPool* pool;
+};
+
+G_DEFINE_TYPE(SpdfcorePlugin, spdfcore_plugin, g_object_get_type())
+
+// Runs |task| on the worker pool and responds to |method_call| with its result.
+static void spdfcore_plugin_dispatch(SpdfcorePlugin* self,
+                                     FlMethodCall* method_call,
+                                     std::function<FlMethodResponse*()> task) {
+  g_object_ref(method_call);
+  self->pool->Post([method_call, task]() {
+    PendingResponse* pending = new PendingResponse{method_call, task()};
+    g_idle_add(deliver_response, pending);
+  });
+}
+
+// Parses arguments on the platform thread and queues the native call.
+static void spdfcore_plugin_handle_method_call(SpdfcorePlugin* self,
+                                               FlMethodCall* method_call) {
+  const gchar* method = fl_method_call_get_name(method_call);
+  FlValue* args = fl_method_call_get_args(method_call);
+  SpdfcoreApi* api = self->api;
+
+  if (strcmp(method, "init") == 0) {
+    respond_value(method_call, fl_value_new_bool(load_api(api)));
+    return;
+  }
+  if (strcmp(method, "cleanup") == 0) {
+    fl_method_call_respond_success(method_call, nullptr, nullptr);
+    return;
+  }
+  if (api->handle == nullptr) {
+    fl_method_call_respond_error(
+        method_call, "NATIVE_LIBRARY_UNAVAILABLE",
+        "Native library not loaded, operation not supported", nullptr,
+        nullptr);
+    return;
+  }
+
+  if (strcmp(method, "getVersion") == 0) {
+    const char* version = api->version != nullptr ? api->version() : nullptr;
+    respond_value(method_call,
+                  fl_value_new_string(version != nullptr ? version : "1.0.0"));
+    return;
+  }
+
+  std::string file_path;
+  if (strcmp(method, "getPageCount") == 0) {
+    if (!lookup_string(args, "filePath", &file_path)) {
+      respond_argument_error(method_call, "filePath is required");
+      return;
+    }
+    spdfcore_plugin_dispatch(self, method_call, [api, file_path]() {
+      return success_response(fl_value_new_int(page_count(*api, file_path)));
+    });
+  } else if (strcmp(method, "getFileSize") == 0) {
+    if (!lookup_string(args, "filePath", &file_path)) {
+      respond_argument_error(method_call, "filePath is required");
+      return;
+    }
+    spdfcore_plugin_dispatch(self, method_call, [api, file_path]() {
+      int64_t size = file_size(*api, file_path);
+      if (size < 0) {
+        return FL_METHOD_RESPONSE(fl_method_error_response_new(
+            "FILE_ERROR", "Failed to get file size", nullptr));
+      }
+      return success_response(fl_value_new_int(size));
+    });
+  } else if (strcmp(method, "validatePdf") == 0) {
+    if (!lookup_string(args, "filePath", &file_path)) {
+      respond_argument_error(method_call, "filePath is required");
+      return;
+    }
+    spdfcore_plugin_dispatch(self, method_call, [api, file_path]() {
+      return success_response(fl_value_new_bool(validate(*api, file_path)));
+    });
+  } else if (strcmp(method, "getPdfInfo") == 0) {
+    if (!lookup_string(args, "filePath", &file_path)) {
+      respond_argument_error(method_call, "filePath is required");
+      return;
+    }
+    spdfcore_plugin_dispatch(self, method_call, [api, file_path]() {
+      FlValue* info = fl_value_new_map();
+      fl_value_set_string_take(info, "pageCount",
+                               fl_value_new_int(page_count(*api, file_path)));
+      fl_value_set_string_take(info, "fileSize",
+                               fl_value_new_int(file_size(*api, file_path)));
+      fl_value_set_string_take(info, "isValid",
+                               fl_value_new_bool(validate(*api, file_path)));
+      fl_value_set_string_take(info, "filePath",
+                               fl_value_new_string(file_path.c_str()));
+      return success_response(info);
+    });
+  } else if (strcmp(method, "mergeFiles") == 0) {
+    FlValue* input_list = nullptr;
+    std::string output_file;
+    if (!lookup_list(args, "inputFiles", FL_VALUE_TYPE_STRING, &input_list) ||
+        !lookup_string(args, "outputFile", &output_file)) {
+      respond_argument_error(
+          method_call, "inputFiles and outputFile are required");
+      return;
+    }
+    std::vector<std::string> input_files;
+    for (size_t i = 0; i < fl_value_get_length(input_list); i++) {
+      input_files.push_back(
+          fl_value_get_string(fl_value_get_list_value(input_list, i)));
+    }
+    spdfcore_plugin_dispatch(self, method_call, [api, input_files,
+                                                 output_file]() {
+      std::vector<const char*> paths;
+      for (const auto& path : input_files) {
+        paths.push_back(path.c_str());
+      }
+      bool ok = invoke(*api, [&](PdfErrorCode* code, char** message) {
+        return api->merge_files(paths.data(), paths.size(),
+                                output_file.c_str(), code, message);
+      });
+      return success_response(fl_value_new_bool(ok));
+    });
+  } else if (strcmp(method, "splitByPages") == 0) {
+    FlValue* page_list = nullptr;
+    std::string output_file;
+    if (!lookup_string(args, "inputFile", &file_path) ||
+        !lookup_list(args, "pages", FL_VALUE_TYPE_INT, &page_list) ||
+        !lookup_string(args, "outputFile", &output_file)) {
+      respond_argument_error(
+          method_call, "inputFile, pages, and outputFile are required");
+      return;
+    }
+    std::vector<int32_t> pages;
+    for (size_t i = 0; i < fl_value_get_length(page_list); i++) {
+      pages.push_back(static_cast<int32_t>(
+          fl_value_get_int(fl_value_get_list_value(page_list, i))));
+    }
+    spdfcore_plugin_dispatch(self, method_call, [api, file_path, pages,
+                                                 output_file]() {
+      bool ok = api->split_by_pages != nullptr &&
+                invoke(*api, [&](PdfErrorCode* code, char** message) {
+                  return api->split_by_pages(file_path.c_str(), pages.data(),
+                                             pages.size(), output_file.c_str(),
+                                             code, message);
+                });
+      return success_response(fl_value_new_bool(ok));
+    });
+  } else if (strcmp(method, "extractPage") == 0) {
+    int64_t page_number = 0;
+    std::string output_path;
+    if (!lookup_string(args, "inputPath", &file_path) ||
+        !lookup_int(args, "pageNumber", &page_number) ||
+        !lookup_string(args, "outputPath", &output_path)) {
+      respond_argument_error(
+          method_call, "inputPath, pageNumber, and outputPath are required");
+      return;
+    }
+    spdfcore_plugin_dispatch(self, method_call, [api, file_path, page_number,
+                                                 output_path]() {
+      bool ok = api->extract_page != nullptr &&
+                invoke(*api, [&](PdfErrorCode* code, char** message) {
+                  return api->extract_page(file_path.c_str(),
+                                           static_cast<int32_t>(page_number),
+                                           output_path.c_str(), code, message);
+                });
+      return success_response(fl_value_new_bool(ok));
+    });
+  } else if (strcmp(method, "splitAtPage") == 0) {
+    int64_t split_page = 0;
+    std::string output_prefix;
+    if (!lookup_string(args, "inputPath", &file_path) ||
+        !lookup_int(args, "splitPage", &split_page) ||
+        !lookup_string(args, "outputPrefix", &output_prefix)) {
+      respond_argument_error(
+          method_call, "inputPath, splitPage, and outputPrefix are required");
+      return;
+    }
+    spdfcore_plugin_dispatch(self, method_call, [api, file_path, split_page,
+                                                 output_prefix]() {
+      bool ok = api->split_at_page != nullptr &&
+                invoke(*api, [&](PdfErrorCode* code, char** message) {
+                  return api->split_at_page(file_path.c_str(),
+                                            static_cast<int32_t>(split_page),
+                                            output_prefix.c_str(), code,
+                                            message);
+                });
+      return success_response(fl_value_new_bool(ok));
+    });
+  } else {
+    fl_method_call_respond_not_implemented(method_call, nullptr);
+  }
+}
+
+static void method_call_cb(FlMethodChannel* channel, FlMethodCall* method_call,
+                           gpointer user_data) {
+  spdfcore_plugin_handle_method_call(SPDFCORE_PLUGIN(user_data), method_call);
+}
+
+// Implements GObject::dispose.
+static void spdfcore_plugin_dispose(GObject* object) {
+  SpdfcorePlugin* self = SPDFCORE_PLUGIN(object);
+  // Join the workers before the API table they read from goes away.
+  delete self->pool;
+  self->pool = nullptr;
+  if (self->api != nullptr && self->api->handle != nullptr) {
+    dlclose(self->api->handle);
+  }
+  delete self->api;
+  self->api = nullptr;
+  g_clear_object(&self->channel);
+  G_OBJECT_CLASS(spdfcore_plugin_parent_class)->dispose(object);
+}
+
+static void spdfcore_plugin_class_init(SpdfcorePluginClass* klass) {
+  G_OBJECT_CLASS(klass)->dispose = spdfcore_plugin_dispose;
+}
+
+static void spdfcore_plugin_init(SpdfcorePlugin* self) {
+  self->api = new SpdfcoreApi();
+  // At least two workers so a long merge never blocks info requests.
+  self->pool = new WorkerPool(
+      std::max(2u, std::thread::hardware_concurrency()));
+}
+
+void spdfcore_plugin_register_with_registrar(FlPluginRegistrar* registrar) {
+  SpdfcorePlugin* plugin =
+      SPDFCORE_PLUGIN(g_object_new(spdfcore_plugin_get_type(), nullptr));
+
+  g_autoptr(FlStandardMethodCodec) codec = fl_standard_method_codec_new();
+  plugin->channel =
+      fl_method_channel_new(fl_plugin_registrar_get_messenger(registrar),
+                            kChannelName, FL_METHOD_CODEC(codec));
+  fl_method_channel_set_method_call_handler(
+      plugin->channel, method_call_cb, g_object_ref(plugin), g_object_unref);
+
+  g_object_unref(plugin);
+}
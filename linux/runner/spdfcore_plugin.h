@@ -0,0 +1,18 @@
+#ifndef FLUTTER_SPDFCORE_PLUGIN_H_
+#define FLUTTER_SPDFCORE_PLUGIN_H_
+
+#include <flutter_linux/flutter_linux.h>
+
+G_DECLARE_FINAL_TYPE(SpdfcorePlugin, spdfcore_plugin, SPDFCORE, PLUGIN,
+                     GObject)
+
+/**
+ * spdfcore_plugin_register_with_registrar:
+ * @registrar: an #FlPluginRegistrar.
+ *
+ * Registers the "spdfcore" method channel, backed by libspdfcore_ffi.so and a
+ * native worker pool. Exposes the same methods as the Android SpdfcorePlugin.
+ */
+void spdfcore_plugin_register_with_registrar(FlPluginRegistrar* registrar);
+
+#endif  // FLUTTER_SPDFCORE_PLUGIN_H_